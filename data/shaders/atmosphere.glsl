@@ -13,6 +13,11 @@ precision mediump float;
 
 uniform highp float u_atm_p[12];
 uniform highp vec3  u_sun;
+uniform highp vec3  u_moon;
+// Skybrightness model terms: b_night_term, K, b_moon_term, C3,
+// b_twilight_term, C4, luminance scale and max cos distance to the sun and
+// moon.
+uniform highp float u_sb[8];
 uniform highp float u_tm[3]; // Tonemapping koefs.
 
 varying lowp    vec4        v_color;
@@ -21,7 +26,6 @@ varying lowp    vec4        v_color;
 
 attribute highp   vec4       a_pos;
 attribute highp   vec3       a_sky_pos;
-attribute highp   float      a_luminance;
 
 highp float gammaf(highp float c)
 {
@@ -42,6 +46,80 @@ vec3 xyy_to_srgb(highp vec3 xyy)
     return srgb;
 }
 
+// Same approximations as in skybrightness.c, since the model has been
+// calibrated with them.
+highp float fast_exp(highp float x)
+{
+    x = 1.0 + x / 1024.0;
+    x *= x; x *= x; x *= x; x *= x;
+    x *= x; x *= x; x *= x; x *= x;
+    x *= x; x *= x;
+    return x;
+}
+
+highp float fast_exp10(highp float x)
+{
+    return fast_exp(x * 2.302585);
+}
+
+highp float fast_acos(highp float x)
+{
+    return 1.5707963 - (x + x * x * x *
+        (1.0 / 6.0 + x * x * (3.0 / 40.0 + 5.0 / 112.0 * x * x)));
+}
+
+// Same as skybrightness_get_luminance.
+highp float sky_luminance(highp float cos_moon_dist, highp float cos_sun_dist,
+                          highp float cos_zenith_dist)
+{
+    highp float moon_dist, sun_dist, bKX, FS, FM;
+    highp float b_daylight, b_twilight, b_moon, b_total;
+
+    // This avoid issues in the algo.
+    cos_moon_dist = min(cos_moon_dist, 0.9998477);
+    cos_sun_dist  = min(cos_sun_dist, 0.9998477);
+    moon_dist = acos(cos_moon_dist);
+    sun_dist = acos(cos_sun_dist);
+
+    // Air mass.
+    bKX = fast_exp10(-0.4 * u_sb[1] /
+            (cos_zenith_dist + 0.025 * fast_exp(-11.0 * cos_zenith_dist)));
+
+    // Daylight brightness.
+    FS = 18886.28 / (sun_dist * sun_dist) +
+         fast_exp10(6.15 - (sun_dist + 0.001) * 1.43239) +
+         229086.77 * (1.06 + cos_sun_dist * cos_sun_dist);
+    b_daylight = 9.289663e-12 * (1.0 - bKX) *
+                 (FS * u_sb[5] + 440000.0 * (1.0 - u_sb[5]));
+
+    // Twilight brightness.
+    b_twilight = fast_exp10(u_sb[4] + 0.063661977 *
+                            fast_acos(cos_zenith_dist) / max(u_sb[1], 0.05)) *
+                 (1.7453293 / sun_dist) * (1.0 - bKX);
+
+    b_total = min(b_twilight, b_daylight);
+
+    // Moonlight brightness.
+    FM = 18886.28 / (moon_dist * moon_dist) +
+         fast_exp10(6.15 - moon_dist * 1.43239) +
+         229086.77 * (1.06 + cos_moon_dist * cos_moon_dist);
+    b_moon = u_sb[2] * (1.0 - bKX) *
+             (FM * u_sb[3] + 440000.0 * (1.0 - u_sb[3])) / 1000000.0;
+    b_total += b_moon;
+
+    // Dark night sky brightness, don't compute if less than 1% daylight.
+    if ((u_sb[0] * bKX) / b_total > 0.01) {
+        b_total += (0.4 + 0.6 / sqrt(0.04 + 0.96 *
+                    cos_zenith_dist * cos_zenith_dist)) * u_sb[0] * bKX;
+    }
+
+    // Light pollution.
+    b_total += 0.0000000000015;
+
+    // Convert to nano lambert then cd/m2.
+    return max(b_total, 0.0) / 1.11e-15 * 3.183e-6;
+}
+
 void main()
 {
     highp vec3 xyy;
@@ -51,7 +129,7 @@ void main()
     gl_Position = a_pos;
 
     // First compute the xy color component (chromaticity) from Preetham model
-    // and re-inject a_luminance for Y component (luminance).
+    // and the Y component (luminance) from the skybrightness model.
     p[2] = abs(p[2]); // Mirror below horizon.
     cos_gamma = dot(p, u_sun);
     cos_gamma2 = cos_gamma * cos_gamma;
@@ -64,7 +142,8 @@ void main()
     xyy.y = ((1. + u_atm_p[6] * exp(u_atm_p[7] / cos_theta)) *
              (1. + u_atm_p[8] * exp(u_atm_p[9] * gamma) +
               u_atm_p[10] * cos_gamma2)) * u_atm_p[11];
-    xyy.z = a_luminance;
+    xyy.z = sky_luminance(min(dot(p, u_moon), u_sb[7]),
+                          min(cos_gamma, u_sb[7]), p[2]) * u_sb[6];
 
     // Ad-hoc tuning. Scaling before the blue shift allows to obtain proper
     // blueish colors at sun set instead of very red, which is a shortcoming
@@ -15,6 +15,33 @@ varying lowp    vec4        v_color;
 
 #ifdef VERTEX_SHADER
 
+#if defined(PROJ_PERSPECTIVE) || defined(PROJ_STEREOGRAPHIC)
+
+// Retained quad: the vertices are the 3d positions of the grid, and we do
+// the projection here.
+uniform   highp   mat4 u_mv;            // Grid frame to view rotation.
+uniform   highp   mat4 u_proj;          // Perspective matrix.
+uniform   highp   vec2 u_proj_scale;    // Scaling and flip after projection.
+uniform   highp   mat3 u_tex_transf;    // Grid uv to texture uv.
+
+attribute highp     vec3    a_pos;
+attribute highp     vec2    a_tex_pos;
+
+void main()
+{
+    highp vec3 p = normalize((u_mv * vec4(a_pos, 0.0)).xyz);
+#ifdef PROJ_PERSPECTIVE
+    highp vec4 clip = u_proj * vec4(p, 1.0);
+    gl_Position = vec4(clip.xy * u_proj_scale, 0.0, clip.w);
+#else
+    gl_Position = vec4(p.xy * (2.0 / (1.0 - p.z)) * u_proj_scale, 0.0, 1.0);
+#endif
+    v_tex_pos = (u_tex_transf * vec3(a_tex_pos, 1.0)).xy;
+    v_color = u_color;
+}
+
+#else
+
 attribute highp     vec4    a_pos;
 attribute mediump   vec2    a_tex_pos;
 attribute lowp      vec3    a_color;
@@ -26,6 +53,8 @@ void main()
     v_color = vec4(a_color, 1.0) * u_color;
 }
 
+#endif
+
 #endif
 #ifdef FRAGMENT_SHADER
 
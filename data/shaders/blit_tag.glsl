@@ -17,13 +17,13 @@ varying lowp    vec4        v_color;
 
 attribute highp     vec4 a_pos;
 attribute mediump   vec2 a_tex_pos;
-attribute lowp      vec3 a_color;
+attribute lowp      vec4 a_color;
 
 void main()
 {
     gl_Position = a_pos;
     v_tex_pos = a_tex_pos;
-    v_color = vec4(a_color, 1.0) * u_color;
+    v_color = a_color * u_color;
 }
 
 #endif
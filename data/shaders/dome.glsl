@@ -0,0 +1,61 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * Warp of the dome cube map faces into a fisheye (azimuthal equidistant)
+ * image.  The faces are stored side by side in a 3x2 grid.
+ */
+
+#ifdef GL_ES
+precision highp float;
+#endif
+
+uniform highp   vec2        u_scale;    // Fisheye scaling and flips.
+uniform highp   mat3        u_faces[6]; // Rotation from view to each face.
+uniform highp   vec2        u_face_uv;  // Size of a face in the texture.
+uniform highp   float       u_margin;   // Half a texel in a face uv.
+uniform mediump sampler2D   u_tex;
+
+varying highp   vec2        v_pos;
+
+#ifdef VERTEX_SHADER
+
+attribute highp vec4 a_pos;
+
+void main()
+{
+    gl_Position = vec4(a_pos.xy, 0.0, 1.0);
+    v_pos = a_pos.xy * u_scale;
+}
+
+#endif
+#ifdef FRAGMENT_SHADER
+
+void main()
+{
+    highp float r = length(v_pos);
+    highp vec3 dir, p;
+    highp vec2 uv;
+
+    gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+    if (r > 3.14159265) return;
+    dir = vec3(r > 0.0 ? v_pos * (sin(r) / r) : vec2(0.0), -cos(r));
+
+    // Look for the face that contains the direction.
+    for (int i = 0; i < 6; i++) {
+        p = u_faces[i] * dir;
+        if (-p.z <= max(abs(p.x), abs(p.y))) continue;
+        uv = clamp(p.xy / -p.z * 0.5 + 0.5, u_margin, 1.0 - u_margin);
+        uv += vec2(mod(float(i), 3.0), floor(float(i) / 3.0));
+        gl_FragColor = texture2D(u_tex, uv * u_face_uv);
+        break;
+    }
+}
+
+#endif
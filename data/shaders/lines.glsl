@@ -8,21 +8,28 @@
  */
 
 uniform   lowp      vec2    u_win_size;
-uniform   lowp      float   u_line_width;
 uniform   lowp      float   u_line_glow;
 uniform   lowp      vec4    u_color;
 
-varying   mediump   vec2    v_uv;
+varying   mediump   vec2    v_uv; // Line width and distance to line in pixel.
+varying   lowp      vec4    v_color;
 
 #ifdef VERTEX_SHADER
 
 attribute highp     vec2    a_pos;
+attribute highp     vec2    a_tangent;
 attribute highp     vec2    a_tex_pos;
+attribute lowp      vec4    a_color;
 
 void main()
 {
-    gl_Position = vec4((a_pos / u_win_size - 0.5) * vec2(2.0, -2.0), 0.0, 1.0);
+    // Move the point to its side of the line.  A null tangent gives a
+    // degenerated quad.
+    highp vec2 n = vec2(-a_tangent.y, a_tangent.x);
+    highp vec2 pos = a_pos + n * inversesqrt(max(dot(n, n), 1e-12)) * a_tex_pos.y;
+    gl_Position = vec4((pos / u_win_size - 0.5) * vec2(2.0, -2.0), 0.0, 1.0);
     v_uv = a_tex_pos;
+    v_color = a_color * u_color;
 }
 
 #endif
@@ -31,12 +38,13 @@ void main()
 void main()
 {
     mediump float dist = abs(v_uv.y); // Distance to line in pixel.
+    mediump float width = v_uv.x;
     // Use smooth step on 2.4px to emulate an anti-aliased line
-    mediump float base = 1.0 - smoothstep(u_line_width / 2.0 - 1.2, u_line_width / 2.0 + 1.2, dist);
+    mediump float base = 1.0 - smoothstep(width / 2.0 - 1.2, width / 2.0 + 1.2, dist);
     // Generate a glow with 5px radius
     mediump float glow = (1.0 - dist / 5.0) * u_line_glow;
     // Only use the most visible of both to avoid changing brightness
-    gl_FragColor = vec4(u_color.rgb, u_color.a * max(glow, base));
+    gl_FragColor = vec4(v_color.rgb, v_color.a * max(glow, base));
 }
 
 #endif
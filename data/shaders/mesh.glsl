@@ -12,6 +12,29 @@ uniform   lowp    vec2 u_fbo_size;
 
 #ifdef VERTEX_SHADER
 
+#if defined(PROJ_PERSPECTIVE) || defined(PROJ_STEREOGRAPHIC)
+
+// Retained mesh: the vertices are the 3d positions in the mesh frame, and
+// we do the projection here.
+uniform   highp   mat4 u_mv;            // Mesh frame to view rotation.
+uniform   highp   mat4 u_proj;          // Perspective matrix.
+uniform   highp   vec2 u_proj_scale;    // Scaling and flip after projection.
+
+attribute highp   vec3 a_pos;
+
+void main()
+{
+    highp vec3 p = normalize((u_mv * vec4(a_pos, 0.0)).xyz);
+#ifdef PROJ_PERSPECTIVE
+    highp vec4 clip = u_proj * vec4(p, 1.0);
+    gl_Position = vec4(clip.xy * u_proj_scale, 0.0, clip.w);
+#else
+    gl_Position = vec4(p.xy * (2.0 / (1.0 - p.z)) * u_proj_scale, 0.0, 1.0);
+#endif
+}
+
+#else
+
 attribute highp   vec2 a_pos;
 
 void main()
@@ -20,6 +43,8 @@ void main()
                        0.0, 1.0);
 }
 
+#endif
+
 #endif
 #ifdef FRAGMENT_SHADER
 
@@ -18,6 +18,61 @@ varying lowp    vec4 v_color;
 
 #ifdef VERTEX_SHADER
 
+#if defined(PROJ_PERSPECTIVE) || defined(PROJ_STEREOGRAPHIC)
+
+// Retained points: the positions and magnitudes are static, and we do the
+// projection and the radius and luminance computation here.  See
+// core_get_point_for_mag and point_params_t.
+uniform highp   mat4  u_mv;             // Points frame to view rotation.
+uniform highp   mat4  u_proj;           // Perspective matrix.
+uniform highp   vec2  u_proj_scale;     // Scaling and flip after projection.
+uniform highp   vec3  u_aberration;     // Observer velocity (unit of c).
+uniform highp   float u_win_scale;      // Framebuffer pixels per window pixel.
+uniform highp   float u_lum_scale;
+uniform highp   vec2  u_tonemapper;     // p, scale.
+uniform highp   vec2  u_star_scale;     // linear, relative.
+uniform highp   vec4  u_radius;         // skip, min, max, dim factor.
+
+attribute highp   vec3  a_pos;
+attribute highp   float a_vmag;
+attribute lowp    vec4  a_color;
+
+void main()
+{
+    highp vec3 p;
+    highp vec4 clip;
+    highp float lum, ld, r;
+
+    p = normalize(a_pos + u_aberration);
+    p = normalize((u_mv * vec4(p, 0.0)).xyz);
+#ifdef PROJ_PERSPECTIVE
+    clip = u_proj * vec4(p, 1.0);
+    gl_Position = vec4(clip.xy * u_proj_scale, 0.0, clip.w);
+#else
+    gl_Position = vec4(p.xy * (2.0 / (1.0 - p.z)) * u_proj_scale, 0.0, 1.0);
+#endif
+
+    lum = u_lum_scale * pow(10.0, -0.4 * a_vmag);
+    ld = max(log(1.0 + u_tonemapper.x * lum) * u_tonemapper.y, 0.0);
+    r = u_star_scale.x * pow(ld, u_star_scale.y / 2.0);
+    if (r < u_radius.x) { // Too small: skip the point.
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        r = 0.0;
+        ld = 0.0;
+    }
+    if (r > 0.0 && r < u_radius.y) {
+        ld *= pow(r / u_radius.y, u_radius.w);
+        r = u_radius.y;
+    }
+    ld = pow(ld, 1.0 / 2.2);
+    r = min(r, u_radius.z);
+
+    gl_PointSize = r * u_win_scale * 2.0 / u_core_size;
+    v_color = vec4(a_color.rgb, clamp(ld, 0.0, 1.0)) * u_color;
+}
+
+#else
+
 attribute highp   vec2  a_pos;
 attribute lowp    vec4  a_color;
 attribute mediump float a_size;
@@ -29,6 +84,8 @@ void main()
     v_color = a_color * u_color;
 }
 
+#endif
+
 #endif
 #ifdef FRAGMENT_SHADER
 
@@ -217,6 +217,12 @@ static int mipsCPUInfo(CPUFeature feature) {
 
 }
 VP8CPUInfo VP8GetCPUInfo = mipsCPUInfo;
+#elif defined(EMSCRIPTEN) && defined(WEBP_USE_SSE2)
+// wasm SIMD build (-msimd128 -msse2): the SSE2 intrinsics are available.
+static int wasmCPUInfo(CPUFeature feature) {
+  return (feature == kSSE2);
+}
+VP8CPUInfo VP8GetCPUInfo = wasmCPUInfo;
 #else
 VP8CPUInfo VP8GetCPUInfo = NULL;
 #endif
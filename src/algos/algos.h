@@ -9,6 +9,9 @@
 
 /* Some astronomy related algorithms to extends erfa library. */
 
+#ifndef ALGOS_H
+#define ALGOS_H
+
 #include <stdbool.h>
 
 /************ Healpix utils ************************************************/
@@ -66,6 +69,48 @@ void healpix_get_boundaries(int nside, int pix, double out[4][3]);
  */
 void healpix_get_bounding_cap(int nside, int pix, double out[4]);
 
+/*
+ * Function: healpix_vec2pix_n
+ * Compute the nest pix index of an array of vectors
+ *
+ * Parameters:
+ *   nside  - Nside parameter of the healpix map.
+ *   n      - Number of vectors.
+ *   v      - Input vectors (don't need to be normalized).
+ *   pix    - Output nest pix indices.
+ */
+void healpix_vec2pix_n(int nside, int n, const double (*v)[3], int *pix);
+
+/*
+ * Function: healpix_get_boundaries_n
+ * Compute the four corners of an array of nest pixels
+ *
+ * Same as <healpix_get_boundaries> for several pixels.
+ */
+void healpix_get_boundaries_n(int nside, int n, const int *pix,
+                              double (*out)[4][3]);
+
+/*
+ * Function: healpix_query_disc
+ * List all the nest pixels of an order that intersect a cap
+ *
+ * The pixels are found by descending the healpix tree from order zero and
+ * only visiting the tiles whose bounding cap intersects the cap, so the
+ * result is conservative: some pixels close to the cap border might not
+ * actually intersect it.
+ *
+ * Parameters:
+ *   order  - Order of the returned pixels.
+ *   cap    - A cap (normalized direction and cosine of the angular radius).
+ *   max_nb - Size of the output array.
+ *   out    - Output array of nest pix indices, sorted.
+ *
+ * Return:
+ *   The total number of pixels, that can be larger than max_nb, in which
+ *   case only the first max_nb pixels are written.
+ */
+int healpix_query_disc(int order, const double cap[4], int max_nb, int *out);
+
 /* Compute moon position.
  *
  * inputs:
@@ -162,6 +207,44 @@ void refraction(const double v[3], double pressure, double temperature,
 void refraction_inv(const double v[3], double pressure, double temperature,
                     double out[3]);
 
+/*
+ * Type: refraction_table_t
+ * Lookup tables of the refraction model for a given pressure and
+ * temperature, indexed by the sine of the altitude.
+ */
+#define REFRACTION_TABLE_SIZE 1372
+typedef struct refraction_table {
+    double pressure;
+    double temperature;
+    float z[REFRACTION_TABLE_SIZE];      // Refracted sine of altitude.
+    float inv[REFRACTION_TABLE_SIZE][2]; // Sin/cos of the inverse angle.
+} refraction_table_t;
+
+/*
+ * Function: refraction_table_prepare
+ * Compute the refraction tables for a given pressure and temperature.
+ */
+void refraction_table_prepare(refraction_table_t *table,
+                              double pressure, double temperature);
+
+/*
+ * Function: refraction_table_apply
+ * Same as <refraction>, with the values interpolated from the tables.
+ *
+ * The error compared to the direct model is under 0.5 arcsec.
+ */
+void refraction_table_apply(const refraction_table_t *table,
+                            const double v[3], double out[3]);
+
+/*
+ * Function: refraction_table_apply_inv
+ * Same as <refraction_inv>, with the values interpolated from the tables.
+ *
+ * The error is under 0.5 arcsec above -3 deg of altitude.
+ */
+void refraction_table_apply_inv(const refraction_table_t *table,
+                                const double v[3], double out[3]);
+
 /* Galilean satellites positions using l1.2 semi-analytic theory by
  * L.Duriez.
  * ftp://ftp.imcce.fr/pub/ephem/satel/galilean/L1/L1.2/
@@ -219,6 +302,31 @@ int orbit_compute_pv(
         double od,        // variation of o in time (rad/day).
         double wd);       // variation of w in time (rad/day).
 
+/*
+ * Function: orbit_compute_pv_batch
+ * Compute positions and speeds from several orbits elements.
+ *
+ * Same as <orbit_compute_pv>, with all the elements passed as arrays, no
+ * variation of o and w, and always using an iterative Kepler solver.
+ *
+ * Parameters:
+ *   precision - Precision for the kepler equation in rad.
+ *   mjd    - Time of the positions (MJD).
+ *   nb     - Number of orbits.
+ *   d, i, o, w, a, n, e, ma - Arrays of orbit elements, same units as in
+ *            <orbit_compute_pv>.
+ *   pos    - Get the computed positions.
+ *   speed  - Get the computed speeds (can be NULL).
+ *
+ * Return:
+ *   zero.
+ */
+int orbit_compute_pv_batch(
+        double precision, double mjd, int nb,
+        const float *d, const float *i, const float *o, const float *w,
+        const float *a, const float *n, const float *e, const float *ma,
+        double (*pos)[3], double (*speed)[3]);
+
 /*
  * Function: orbit_elements_from_pv
  * Compute Kepler orbit element from a body positon and speed.
@@ -247,8 +355,47 @@ int orbit_elements_from_pv(const double p[3], const double v[3], double mu,
                            double *e,
                            double *ma);
 
+/*
+ * Function: chebyshev_node
+ * Return the position in [-1, 1] of a Chebyshev node.
+ *
+ * Parameters:
+ *   n      - Number of nodes.
+ *   i      - Index of the node.
+ */
+double chebyshev_node(int n, int i);
+
+/*
+ * Function: chebyshev_fit
+ * Compute the coefficients of a Chebyshev approximation.
+ *
+ * Parameters:
+ *   n      - Number of coefficients.
+ *   f      - Values of the function at the n nodes given by
+ *            <chebyshev_node>.
+ *   coefs  - Output coefficients.
+ */
+void chebyshev_fit(int n, const double *f, double *coefs);
+
+/*
+ * Function: chebyshev_eval
+ * Evaluate a Chebyshev approximation.
+ *
+ * Parameters:
+ *   n      - Number of coefficients.
+ *   coefs  - Coefficients, as returned by <chebyshev_fit>.
+ *   x      - Position in [-1, 1].
+ *   deriv  - If not NULL, get the derivative relative to x.
+ *
+ * Return:
+ *   The value of the approximation at x.
+ */
+double chebyshev_eval(int n, const double *coefs, double x, double *deriv);
+
 /*
  * Function: bv_to_rgb
  * Convert a B-V color index value to an RGB color.
  */
 void bv_to_rgb(double bv, double rgb[3]);
+
+#endif // ALGOS_H
@@ -0,0 +1,75 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "swe.h"
+
+double chebyshev_node(int n, int i)
+{
+    return cos(M_PI * (i + 0.5) / n);
+}
+
+void chebyshev_fit(int n, const double *f, double *coefs)
+{
+    int i, j;
+    double c;
+    for (j = 0; j < n; j++) {
+        c = 0;
+        for (i = 0; i < n; i++)
+            c += f[i] * cos(M_PI * j * (i + 0.5) / n);
+        coefs[j] = c * 2.0 / n;
+    }
+    // So that we don't have to halve the first term in the evaluation.
+    coefs[0] /= 2;
+}
+
+double chebyshev_eval(int n, const double *coefs, double x, double *deriv)
+{
+    // t: T(k), u: U(k-1), so that T'(k) = k * U(k-1).
+    double t_prev = 1, t = x, u_prev = 0, u = 1, tmp, ret, d = 0;
+    int k;
+
+    ret = coefs[0];
+    if (n > 1) {
+        ret += coefs[1] * x;
+        d = coefs[1];
+    }
+    for (k = 2; k < n; k++) {
+        tmp = 2 * x * t - t_prev;
+        t_prev = t;
+        t = tmp;
+        tmp = 2 * x * u - u_prev;
+        u_prev = u;
+        u = tmp;
+        ret += coefs[k] * t;
+        d += coefs[k] * k * u;
+    }
+    if (deriv) *deriv = d;
+    return ret;
+}
+
+#if COMPILE_TESTS
+
+static void test_chebyshev(void)
+{
+    const int n = 13;
+    double f[13], coefs[13], x, v, d;
+    int i;
+
+    for (i = 0; i < n; i++) f[i] = sin(2 * chebyshev_node(n, i));
+    chebyshev_fit(n, f, coefs);
+    for (x = -1; x <= 1; x += 0.01) {
+        v = chebyshev_eval(n, coefs, x, &d);
+        assert(fabs(v - sin(2 * x)) < 1e-9);
+        assert(fabs(d - 2 * cos(2 * x)) < 1e-7);
+    }
+}
+
+TEST_REGISTER(NULL, test_chebyshev, TEST_AUTO)
+
+#endif
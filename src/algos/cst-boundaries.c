@@ -7,12 +7,32 @@
  * repository.
  */
 
+#include "algos.h"
+#include "tests.h"
+
+#include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "erfa.h"
 
+// Healpix order of the constellations index.
+#define INDEX_ORDER 8
+#define INDEX_NSIDE (1 << INDEX_ORDER)
+#define INDEX_SIZE (12 * INDEX_NSIDE * INDEX_NSIDE)
+// Max sampling step along the boundaries when marking the index (rad),
+// about a quarter of a pixel.
+#define INDEX_STEP 0.001
+
+// Index values.
+enum {
+    INDEX_UNKNOWN   = 0,   // Not computed yet.
+    INDEX_BOUNDARY  = 255, // Use the exact polygon test.
+    // Other values are the constellation index + 1.
+};
+
 struct cst {
     const char id[5];
     double center[2];
@@ -2343,19 +2363,144 @@ static bool test_cst(const struct cst *cst, double ra, double dec)
     return n % 2 == 1;
 }
 
-int find_constellation_at(const double pos[3], char id[5])
+static int find_constellation_exact(const double pos[3])
 {
-    const struct cst *cst;
     int i;
     double ra, dec;
     eraC2s(pos, &ra, &dec);
+    for (i = 0; CSTS[i].id[0]; i++) {
+        if (test_cst(&CSTS[i], ra, dec)) return i;
+    }
+    return -1;
+}
 
+// Mark the pixel containing a point and all its neighbours as boundary.
+static void mark_boundary(uint8_t *index, double ra, double dec)
+{
+    int i, pix, neighbours[8];
+    ra = eraAnp(ra);
+    healpix_ang2pix(INDEX_NSIDE, M_PI / 2 - dec, ra, &pix);
+    index[pix] = INDEX_BOUNDARY;
+    healpix_get_neighbours(INDEX_NSIDE, pix, neighbours);
+    for (i = 0; i < 8; i++) {
+        if (neighbours[i] >= 0) index[neighbours[i]] = INDEX_BOUNDARY;
+    }
+}
+
+/*
+ * Create the index with all the pixels crossed by a boundary marked.
+ *
+ * The boundaries are either meridian segments or parallel arcs, so we
+ * sample them and mark the pixels with their neighbours, to be sure not
+ * to miss any pixel only crossed at a corner.
+ */
+static uint8_t *create_index(void)
+{
+    uint8_t *index;
+    const struct cst *cst;
+    const double *a, *b;
+    double len, d, k;
+    int i, j, n;
+
+    index = calloc(INDEX_SIZE, 1);
     for (i = 0; ((cst = &CSTS[i]))->id[0]; i++) {
-        if (test_cst(cst, ra, dec)) {
-            if (id) memcpy(id, cst->id, 5);
-            return i;
+        for (j = 0; j < cst->n; j++) {
+            a = cst->points[j];
+            b = cst->points[(j + 1) % cst->n];
+            if (a[0] == b[0]) { // Meridian.
+                d = b[1] - a[1];
+                len = fabs(d);
+            } else { // Parallel, along the smallest arc.
+                d = eraAnpm(b[0] - a[0]);
+                len = fabs(d) * cos(a[1]);
+            }
+            n = (int)ceil(len / INDEX_STEP) + 1;
+            for (k = 0; k <= n; k++) {
+                if (a[0] == b[0])
+                    mark_boundary(index, a[0], a[1] + d * k / n);
+                else
+                    mark_boundary(index, a[0] + d * k / n, a[1]);
+            }
         }
     }
-    memcpy(id, "???", 4);
-    return -1;
+    return index;
+}
+
+static uint8_t *get_index(void)
+{
+    static uint8_t *g_index = NULL;
+    uint8_t *index, *expected = NULL;
+
+    index = __atomic_load_n(&g_index, __ATOMIC_ACQUIRE);
+    if (index) return index;
+    // In the unlikely case two threads create the index at the same time,
+    // only one of them is kept.
+    index = create_index();
+    if (!__atomic_compare_exchange_n(&g_index, &expected, index, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(index);
+        index = expected;
+    }
+    return index;
+}
+
+/*
+ * The constellation of the interior pixels of the index is computed
+ * lazily the first time we look it up, so the index creation only has to
+ * mark the boundaries.  Writing the same value from several threads is
+ * harmless.
+ */
+int find_constellation_at(const double pos[3], char id[5])
+{
+    uint8_t *index = get_index();
+    double theta, phi;
+    int pix, ret, v;
+
+    eraC2s(pos, &phi, &theta);
+    healpix_ang2pix(INDEX_NSIDE, M_PI / 2 - theta, eraAnp(phi), &pix);
+    v = __atomic_load_n(&index[pix], __ATOMIC_RELAXED);
+    if (v == INDEX_BOUNDARY || v == INDEX_UNKNOWN) {
+        ret = find_constellation_exact(pos);
+        // No boundary crosses the pixel, so any point gives the same value.
+        if (v == INDEX_UNKNOWN && ret >= 0)
+            __atomic_store_n(&index[pix], ret + 1, __ATOMIC_RELAXED);
+    } else {
+        ret = v - 1;
+    }
+    if (id) memcpy(id, ret >= 0 ? CSTS[ret].id : "???", ret >= 0 ? 5 : 4);
+    return ret;
 }
+
+#if COMPILE_TESTS
+
+static void test_cst_index(void)
+{
+    int i, j, a, b;
+    double pos[3], ra, dec;
+    const struct cst *cst;
+
+    // Random points, and points close to the boundaries vertices.
+    srand(0);
+    for (i = 0; i < 10000; i++) {
+        ra = (double)rand() / RAND_MAX * 2 * M_PI;
+        dec = asin((double)rand() / RAND_MAX * 2 - 1);
+        eraS2c(ra, dec, pos);
+        a = find_constellation_at(pos, NULL);
+        b = find_constellation_exact(pos);
+        assert(a == b);
+    }
+    for (i = 0; ((cst = &CSTS[i]))->id[0]; i++) {
+        for (j = 0; j < cst->n; j++) {
+            ra = cst->points[j][0] + 1e-4 * ((double)rand() / RAND_MAX - 0.5);
+            dec = cst->points[j][1] + 1e-4 * ((double)rand() / RAND_MAX - 0.5);
+            eraS2c(ra, dec, pos);
+            a = find_constellation_at(pos, NULL);
+            b = find_constellation_exact(pos);
+            assert(a == b);
+        }
+    }
+}
+
+TEST_REGISTER(NULL, test_cst_index, TEST_AUTO)
+
+#endif
@@ -326,3 +326,62 @@ void healpix_get_bounding_cap(int nside, int pix, double out[4])
             out[3] = d;
     }
 }
+
+void healpix_vec2pix_n(int nside, int n, const double (*v)[3], int *pix)
+{
+    int i;
+    double r, z, phi;
+    for (i = 0; i < n; i++) {
+        r = sqrt(v[i][0] * v[i][0] + v[i][1] * v[i][1] + v[i][2] * v[i][2]);
+        z = v[i][2] / r;
+        phi = atan2(v[i][1], v[i][0]);
+        pix[i] = ang2pix_nest_z_phi(nside, z, phi);
+    }
+}
+
+void healpix_get_boundaries_n(int nside, int n, const int *pix,
+                              double (*out)[4][3])
+{
+    int i, j, ix, iy, face;
+    for (i = 0; i < n; i++) {
+        healpix_nest2xyf(nside, pix[i], &ix, &iy, &face);
+        for (j = 0; j < 4; j++) {
+            healpix_xyf2vec(nside, ix + (j % 2), iy + (j / 2), face,
+                            out[i][j]);
+        }
+    }
+}
+
+static void query_disc_rec(int order, int pix, int max_order,
+                           const double cap[4], int max_nb, int *out,
+                           int *nb)
+{
+    double tile_cap[4];
+    int i;
+
+    // The tiles bounding caps only use the corners, but the edges of the
+    // tiles are not great circles.  At low order we always descend, after
+    // that we add a 10% margin to the caps radius.
+    if (order >= 2) {
+        healpix_get_bounding_cap(1 << order, pix, tile_cap);
+        tile_cap[3] = cos(fmin(acos(fmax(-1, fmin(1, tile_cap[3]))) * 1.1,
+                               M_PI));
+        if (!cap_intersects_cap(cap, tile_cap)) return;
+    }
+    if (order == max_order) {
+        if (*nb < max_nb) out[*nb] = pix;
+        (*nb)++;
+        return;
+    }
+    for (i = 0; i < 4; i++)
+        query_disc_rec(order + 1, pix * 4 + i, max_order, cap, max_nb, out,
+                       nb);
+}
+
+int healpix_query_disc(int order, const double cap[4], int max_nb, int *out)
+{
+    int pix, nb = 0;
+    for (pix = 0; pix < 12; pix++)
+        query_disc_rec(0, pix, order, cap, max_nb, out, &nb);
+    return nb;
+}
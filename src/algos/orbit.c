@@ -8,8 +8,14 @@
  */
 
 #include <math.h>
+#include <stddef.h>
 #define PI (3.141592653589793238462643)
 
+// Number of orbits solved together in orbit_compute_pv_batch.
+#define KEPLER_LANES 8
+// Max number of Newton iterations for the batched Kepler solver.
+#define KEPLER_MAX_ITER 32
+
 static void vec3_cross(const double a[3], const double b[3], double out[3])
 {
     double tmp[3];
@@ -47,6 +53,59 @@ static double kepler(double m, double de, double precision)
     return e0;
 }
 
+/*
+ * Solve the Kepler equation for up to KEPLER_LANES orbits at once.
+ *
+ * All the lanes run the same number of Newton iterations, without any
+ * branch in the inner loops, so that the compiler can vectorize them.
+ */
+static void kepler_batch(int nb, const double m[KEPLER_LANES],
+                         const double de[KEPLER_LANES], double precision,
+                         double out[KEPLER_LANES])
+{
+    int i, iter;
+    double delta[KEPLER_LANES], err;
+
+    for (i = 0; i < nb; i++)
+        out[i] = m[i] + de[i] * sin(m[i]) * (1.0 + de[i] * cos(m[i]));
+    for (iter = 0; iter < KEPLER_MAX_ITER; iter++) {
+        for (i = 0; i < nb; i++) {
+            delta[i] = (out[i] - de[i] * sin(out[i]) - m[i]) /
+                       (1.0 - de[i] * cos(out[i]));
+            out[i] -= delta[i];
+        }
+        err = 0;
+        for (i = 0; i < nb; i++) err = fmax(err, fabs(delta[i]));
+        if (err <= precision) break;
+    }
+}
+
+// Compute position and speed from the true anomaly.
+static void compute_pv_from_anomaly(
+        double v, double i, double o, double w, double a, double n,
+        double e, double pos[3], double speed[3])
+{
+    double r, rdot, rfdot, u;
+
+    // Compute radius vector.
+    r = a * (1 - pow(e, 2)) / (1 + e * cos(v));
+    u = v + w;
+    // Compute position into the plane of the ecliptic.
+    pos[0] = r * (cos(o) * cos(u) - sin(o) * sin(u) * cos(i));
+    pos[1] = r * (sin(o) * cos(u) + cos(o) * sin(u) * cos(i));
+    pos[2] = r * (sin(u) * sin(i));
+
+    // Compute speed if required.
+    if (!speed) return;
+    rdot = n * a * (e * sin(v)) / sqrt(1.0 - e * e);
+    rfdot = n * a * (1.0 + e * cos(v)) / sqrt(1.0 - e * e);
+    speed[0] = rdot * (cos(u) * cos(o) - sin(u) * sin(o) * cos(i)) +
+               rfdot * (-sin(u) * cos(o) - cos(u) * sin(o) * cos(i));
+    speed[1] = rdot * (cos(u) * sin(o) + sin(u) * cos(o) * cos(i)) +
+               rfdot * (-sin(u) * sin(o) + cos(u) * cos(o) * cos(i));
+    speed[2] = rdot * (sin(u) * sin(i)) + rfdot * (cos(u) * sin(i));
+}
+
 /*
  * Function: orbit_compute_pv
  * Compute position and speed from orbit elements.
@@ -83,7 +142,7 @@ int orbit_compute_pv(
         double od,        // variation of o in time (rad/day).
         double wd)        // variation of w in time (rad/day).
 {
-    double m, v, r, rdot, rfdot, u, ae, ae2;
+    double m, v, ae, ae2;
     // Get the number of day since element date.
     d = mjd - d;
     // Compute the mean anomaly.
@@ -103,25 +162,43 @@ int orbit_compute_pv(
         v = 2.0 * atan2(sqrt((1.0 + e) / (1.0 - e)) * sin(ae2), cos(ae2));
     }
 
-    // Compute radius vector.
     o = o + d * od;
     w = w + d * wd;
-    r = a * (1 - pow(e, 2)) / (1 + e * cos(v));
-    u = v + w;
-    // Compute position into the plane of the ecliptic.
-    pos[0] = r * (cos(o) * cos(u) - sin(o) * sin(u) * cos(i));
-    pos[1] = r * (sin(o) * cos(u) + cos(o) * sin(u) * cos(i));
-    pos[2] = r * (sin(u) * sin(i));
+    compute_pv_from_anomaly(v, i, o, w, a, n, e, pos, speed);
+    return 0;
+}
 
-    // Compute speed if required.
-    if (!speed) return 0;
-    rdot = n * a * (e * sin(v)) / sqrt(1.0 - e * e);
-    rfdot = n * a * (1.0 + e * cos(v)) / sqrt(1.0 - e * e);
-    speed[0] = rdot * (cos(u) * cos(o) - sin(u) * sin(o) * cos(i)) +
-               rfdot * (-sin(u) * cos(o) - cos(u) * sin(o) * cos(i));
-    speed[1] = rdot * (cos(u) * sin(o) + sin(u) * cos(o) * cos(i)) +
-               rfdot * (-sin(u) * sin(o) + cos(u) * cos(o) * cos(i));
-    speed[2] = rdot * (sin(u) * sin(i)) + rfdot * (cos(u) * sin(i));
+/*
+ * Function: orbit_compute_pv_batch
+ * Compute positions and speeds from several orbits elements.
+ *
+ * Same as orbit_compute_pv, for many orbits stored as arrays of elements,
+ * and always using an iterative Kepler solver.
+ */
+int orbit_compute_pv_batch(
+        double precision, double mjd, int nb,
+        const float *d, const float *i, const float *o, const float *w,
+        const float *a, const float *n, const float *e, const float *ma,
+        double (*pos)[3], double (*speed)[3])
+{
+    int k, j, lanes;
+    double m[KEPLER_LANES], de[KEPLER_LANES], ae[KEPLER_LANES], v;
+
+    for (k = 0; k < nb; k += KEPLER_LANES) {
+        lanes = nb - k < KEPLER_LANES ? nb - k : KEPLER_LANES;
+        for (j = 0; j < lanes; j++) {
+            m[j] = fmod(n[k + j] * (mjd - d[k + j]) + ma[k + j], 2.0 * PI);
+            de[j] = e[k + j];
+        }
+        kepler_batch(lanes, m, de, precision, ae);
+        for (j = 0; j < lanes; j++) {
+            v = 2.0 * atan2(sqrt((1.0 + de[j]) / (1.0 - de[j])) *
+                            sin(ae[j] / 2.0), cos(ae[j] / 2.0));
+            compute_pv_from_anomaly(v, i[k + j], o[k + j], w[k + j],
+                                    a[k + j], n[k + j], de[j], pos[k + j],
+                                    speed ? speed[k + j] : NULL);
+        }
+    }
     return 0;
 }
 
@@ -9,7 +9,7 @@
 
 #include <stdbool.h>
 #include <math.h>
-#include "utils/vec.h"
+#include "swe.h"
 
 // Use more flexible refraction model coming from Stellarium instead of the
 // one from ERFA lib. It has a much better behaviour for low altitudes ~< 5 deg
@@ -18,27 +18,27 @@
 // ERFA model for higher altitudes, and revert to this one for lower ones.
 
 #define DD2Rf ((float)M_PI / 180.f)
-void refraction(const double v[3], double pressure, double temperature,
-                double out[3])
+
+// The following 2 values are set according to Georg Zotti comment in
+// original Stellarium code, so that nothing happens below -5 degrees.
+// This must be -5 or higher.
+#define MIN_GEO_ALTITUDE_DEG (-3.54f)
+// This must be positive. Transition zone goes that far below the values
+// just specified.
+#define TRANSITION_WIDTH_GEO_DEG 1.46f
+
+// Return the refracted sine of the altitude.
+static float refracted_sinalt(double sinalt, double pressure,
+                              double temperature)
 {
-    // The following 2 variables are set according to Georg Zotti comment in
-    // original Stellarium code, so that nothing happens below -5 degrees.
-
-    // This must be -5 or higher.
-    static const float MIN_GEO_ALTITUDE_DEG = -3.54f;
-    // This must be positive. Transition zone goes that far below the values
-    // just specified.
-    static const float TRANSITION_WIDTH_GEO_DEG = 1.46f;
     // Hopefully, the compiler pre-compute this
     const float min_sinalt = sinf(MIN_GEO_ALTITUDE_DEG * DD2Rf -
                                          TRANSITION_WIDTH_GEO_DEG * DD2Rf);
 
-    assert(vec3_is_normalized(v));
-    vec3_copy(v, out);
-    if (v[2] < min_sinalt)
-        return;
+    if (sinalt < min_sinalt)
+        return sinalt;
 
-    float geom_alt_deg = asinf(v[2]) / DD2Rf;
+    float geom_alt_deg = asinf(sinalt) / DD2Rf;
 
     const float p_saemundson = 1.02f * pressure / 1010.f * 283.f /
                          (273.f + temperature) / 60.f;
@@ -50,7 +50,7 @@ void refraction(const double v[3], double pressure, double temperature,
         geom_alt_deg += r;
         if (geom_alt_deg > 90.)
             geom_alt_deg = 90.;
-        out[2] = sinf(geom_alt_deg * DD2Rf);
+        return sinf(geom_alt_deg * DD2Rf);
     }
     else if (geom_alt_deg > MIN_GEO_ALTITUDE_DEG - TRANSITION_WIDTH_GEO_DEG)
     {
@@ -60,9 +60,19 @@ void refraction(const double v[3], double pressure, double temperature,
                      (MIN_GEO_ALTITUDE_DEG + 5.11f)) * DD2Rf) + 0.0019279f;
         geom_alt_deg += r_m5 * (geom_alt_deg - (MIN_GEO_ALTITUDE_DEG -
                         TRANSITION_WIDTH_GEO_DEG)) / TRANSITION_WIDTH_GEO_DEG;
-        out[2] = sinf(geom_alt_deg * DD2Rf);
+        return sinf(geom_alt_deg * DD2Rf);
     }
-    vec3_normalize(out, out);
+    return sinalt;
+}
+
+void refraction(const double v[3], double pressure, double temperature,
+                double out[3])
+{
+    assert(vec3_is_normalized(v));
+    vec3_copy(v, out);
+    out[2] = refracted_sinalt(v[2], pressure, temperature);
+    if (out[2] != v[2])
+        vec3_normalize(out, out);
 }
 
 void refraction_inv(const double v[3], double pressure, double temperature,
@@ -86,3 +96,115 @@ void refraction_inv(const double v[3], double pressure, double temperature,
     vec3_copy(a, out);
     assert(vec3_is_normalized(out));
 }
+
+/*
+ * The tables nodes are evenly spaced in sine of altitude, starting from the
+ * bottom of the transition zone, with a node exactly at its top so that
+ * the linear interpolation doesn't smooth the model discontinuity.
+ */
+#define TABLE_SPLIT 32 // Number of nodes in the transition zone.
+
+static double table_z0(void)
+{
+    return sin((MIN_GEO_ALTITUDE_DEG - TRANSITION_WIDTH_GEO_DEG) * DD2R);
+}
+
+static double table_step(void)
+{
+    return (sin(MIN_GEO_ALTITUDE_DEG * DD2R) - table_z0()) / TABLE_SPLIT;
+}
+
+void refraction_table_prepare(refraction_table_t *table,
+                              double pressure, double temperature)
+{
+    int i;
+    double z, v[3], out[3], d;
+    const double z0 = table_z0(), step = table_step();
+
+    assert(z0 + (REFRACTION_TABLE_SIZE - 1) * step >= 1.0);
+    table->pressure = pressure;
+    table->temperature = temperature;
+    for (i = 0; i < REFRACTION_TABLE_SIZE; i++) {
+        z = min(z0 + i * step, 1.0);
+        table->z[i] = refracted_sinalt(z, pressure, temperature);
+        // Angle from the apparent altitude to the geometric altitude.
+        vec3_set(v, sqrt(1 - z * z), 0, z);
+        refraction_inv(v, pressure, temperature, out);
+        d = atan2(out[2], out[0]) - asin(z);
+        table->inv[i][0] = sin(d);
+        table->inv[i][1] = cos(d);
+    }
+}
+
+// Compute the index and interpolation factor of a sine of altitude.
+// Return false if the value is under the table range.
+static bool table_index(double z, int *i, double *f)
+{
+    double u = (z - table_z0()) / table_step();
+    if (u <= 0) return false;
+    *i = min((int)u, REFRACTION_TABLE_SIZE - 2);
+    *f = u - *i;
+    return true;
+}
+
+void refraction_table_apply(const refraction_table_t *table,
+                            const double v[3], double out[3])
+{
+    int i;
+    double f;
+    assert(vec3_is_normalized(v));
+    vec3_copy(v, out);
+    if (!table_index(v[2], &i, &f)) return;
+    out[2] = mix(table->z[i], table->z[i + 1], f);
+    vec3_normalize(out, out);
+}
+
+void refraction_table_apply_inv(const refraction_table_t *table,
+                                const double v[3], double out[3])
+{
+    int i;
+    double f, h, sd, cd, up[3];
+    assert(vec3_is_normalized(v));
+    h = sqrt(v[0] * v[0] + v[1] * v[1]);
+    if (h == 0.0 || !table_index(v[2], &i, &f)) {
+        vec3_copy(v, out);
+        return;
+    }
+    sd = mix(table->inv[i][0], table->inv[i + 1][0], f);
+    cd = mix(table->inv[i][1], table->inv[i + 1][1], f);
+    // Rotate along the vertical circle.
+    vec3_set(up, -v[2] * v[0] / h, -v[2] * v[1] / h, h);
+    vec3_mul(cd, v, out);
+    vec3_addk(out, up, sd, out);
+    vec3_normalize(out, out);
+}
+
+#if COMPILE_TESTS
+
+static void test_refraction_table(void)
+{
+    double alt, v[3], ref[3], out[3], err, max_err = 0;
+    refraction_table_t *table = calloc(1, sizeof(*table));
+
+    refraction_table_prepare(table, 1013.25, 15);
+    for (alt = -10; alt <= 90; alt += 0.0137) {
+        eraS2c(0.3, alt * DD2R, v);
+        refraction(v, 1013.25, 15, ref);
+        refraction_table_apply(table, v, out);
+        err = eraSepp(ref, out);
+        refraction_inv(v, 1013.25, 15, ref);
+        refraction_table_apply_inv(table, v, out);
+        // The inverse model has a discontinuity in the transition zone.
+        if (alt > -3) err = max(err, eraSepp(ref, out));
+        max_err = max(max_err, err);
+    }
+    if (max_err > 1.0 * ERFA_DAS2R) {
+        LOG_E("Refraction table error: %g arcsec", max_err * ERFA_DR2AS);
+        assert(false);
+    }
+    free(table);
+}
+
+TEST_REGISTER(NULL, test_refraction_table, TEST_AUTO)
+
+#endif
@@ -12,8 +12,10 @@
 #include "utils/mesh2d.h"
 #include "utils/vec.h"
 #include "utils/utils.h"
+#include "tests.h"
 
 #include <assert.h>
+#include <float.h>
 #include <math.h>
 
 typedef struct item item_t;
@@ -36,9 +38,32 @@ struct item
     } mesh;
 };
 
+// Max number of grid cells per axis.
+#define GRID_MAX_SIZE 64
+
+/*
+ * Uniform grid index of the items, in window space.
+ *
+ * Each cell contains the indices of all the items whose bounding box
+ * overlaps it.  The index is rebuilt lazily on the first lookup after the
+ * items changed, reusing the previous buffers.
+ */
+typedef struct grid {
+    bool    dirty;
+    double  origin[2];
+    double  cell_size;
+    int     size[2];     // Number of cells in x and y.
+    int     cells[GRID_MAX_SIZE * GRID_MAX_SIZE + 2]; // Cells start offsets.
+    int     *entries;    // Items indices sorted by cell.
+    int     entries_nb;
+    int     entries_allocated;
+} grid_t;
+
 struct areas
 {
     UT_array *items;
+    grid_t *grid;
+    double offset[2]; // Added to the positions of the new shapes.
 };
 
 /*
@@ -71,6 +96,7 @@ areas_t *areas_create(void)
     areas_t *areas;
     areas = calloc(1, sizeof(*areas));
     utarray_new(areas->items, &item_icd);
+    areas->grid = calloc(1, sizeof(*areas->grid));
     return areas;
 }
 
@@ -78,11 +104,12 @@ void areas_add_circle(areas_t *areas, const double pos[2], double r,
                       uint64_t oid, uint64_t hint)
 {
     item_t item = {};
-    memcpy(item.pos, pos, sizeof(item.pos));
+    vec2_add(pos, areas->offset, item.pos);
     item.a = item.b = r;
     item.oid = oid;
     item.hint = hint;
     utarray_push_back(areas->items, &item);
+    areas->grid->dirty = true;
 }
 
 void areas_add_ellipse(areas_t *areas, const double pos[2], double angle,
@@ -90,13 +117,14 @@ void areas_add_ellipse(areas_t *areas, const double pos[2], double angle,
                        uint64_t oid, uint64_t hint)
 {
     item_t item = {};
-    memcpy(item.pos, pos, sizeof(item.pos));
+    vec2_add(pos, areas->offset, item.pos);
     item.angle = angle;
     item.a = a;
     item.b = b;
     item.oid = oid;
     item.hint = hint;
     utarray_push_back(areas->items, &item);
+    areas->grid->dirty = true;
 }
 
 void areas_add_triangles_mesh(areas_t *areas, int verts_count,
@@ -107,8 +135,10 @@ void areas_add_triangles_mesh(areas_t *areas, int verts_count,
 {
     item_t item = {};
     double r;
+    int i;
 
     mesh2d_get_bounding_circle(verts, indices, indices_count, item.pos, &r);
+    vec2_add(item.pos, areas->offset, item.pos);
     item.a = item.b = r;
     item.oid = oid;
     item.hint = hint;
@@ -116,13 +146,22 @@ void areas_add_triangles_mesh(areas_t *areas, int verts_count,
     // Copy the mesh data.
     item.mesh.verts_count = verts_count;
     item.mesh.verts = calloc(verts_count, sizeof(*item.mesh.verts));
-    memcpy(item.mesh.verts, verts, verts_count * sizeof(*item.mesh.verts));
+    for (i = 0; i < verts_count; i++) {
+        item.mesh.verts[i][0] = verts[i][0] + areas->offset[0];
+        item.mesh.verts[i][1] = verts[i][1] + areas->offset[1];
+    }
     item.mesh.indices_count = indices_count;
     item.mesh.indices = calloc(indices_count, sizeof(*item.mesh.indices));
     memcpy(item.mesh.indices, indices,
            indices_count * sizeof(*item.mesh.indices));
 
     utarray_push_back(areas->items, &item);
+    areas->grid->dirty = true;
+}
+
+void areas_set_offset(areas_t *areas, const double offset[2])
+{
+    vec2_copy(offset, areas->offset);
 }
 
 void areas_clear_all(areas_t *areas)
@@ -133,6 +172,101 @@ void areas_clear_all(areas_t *areas)
         free(item->mesh.indices);
     }
     utarray_clear(areas->items);
+    areas->grid->dirty = true;
+}
+
+// Compute the range of cells covered by a bounding box.
+// Return false if the box is too large, in which case we put the item in
+// the extra cell that is always checked.
+static bool grid_get_range(const grid_t *grid, const double aabb[2][2],
+                           int range[2][2])
+{
+    int i, j;
+    double v;
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 2; j++) {
+            v = floor((aabb[j][i] - grid->origin[i]) / grid->cell_size);
+            range[j][i] = clamp(v, 0, grid->size[i] - 1);
+        }
+    }
+    return (range[1][0] - range[0][0] + 1) *
+           (range[1][1] - range[0][1] + 1) <= 16;
+}
+
+static void item_get_aabb(const item_t *item, double aabb[2][2])
+{
+    double r = max(item->a, item->b);
+    aabb[0][0] = item->pos[0] - r;
+    aabb[0][1] = item->pos[1] - r;
+    aabb[1][0] = item->pos[0] + r;
+    aabb[1][1] = item->pos[1] + r;
+}
+
+// Call a function for each cell an item belongs to.
+#define ITEM_ITER_CELLS(grid, item, cell, code) do { \
+        double aabb_[2][2]; \
+        int range_[2][2], x_, y_; \
+        item_get_aabb(item, aabb_); \
+        if (!grid_get_range(grid, aabb_, range_)) { \
+            cell = grid->size[0] * grid->size[1]; \
+            code; \
+            break; \
+        } \
+        for (y_ = range_[0][1]; y_ <= range_[1][1]; y_++) \
+        for (x_ = range_[0][0]; x_ <= range_[1][0]; x_++) { \
+            cell = y_ * grid->size[0] + x_; \
+            code; \
+        } \
+    } while (0)
+
+static void grid_build(grid_t *grid, const UT_array *items)
+{
+    const item_t *item = NULL;
+    double bounds[2][2] = {{DBL_MAX, DBL_MAX}, {-DBL_MAX, -DBL_MAX}};
+    double extent;
+    int nb = utarray_len(items), i, n, cell, cells_nb, *count;
+
+    grid->dirty = false;
+    grid->entries_nb = 0;
+    if (nb == 0) return;
+    while ((item = (const item_t*)utarray_next(items, item))) {
+        for (i = 0; i < 2; i++) {
+            bounds[0][i] = min(bounds[0][i], item->pos[i]);
+            bounds[1][i] = max(bounds[1][i], item->pos[i]);
+        }
+    }
+    // Aim for a few items per cell.
+    n = clamp((int)sqrt(nb / 2), 1, GRID_MAX_SIZE);
+    extent = max(bounds[1][0] - bounds[0][0], bounds[1][1] - bounds[0][1]);
+    grid->cell_size = max(extent / n, 1.0);
+    for (i = 0; i < 2; i++) {
+        grid->origin[i] = bounds[0][i];
+        grid->size[i] = clamp((int)((bounds[1][i] - bounds[0][i]) /
+                                    grid->cell_size) + 1, 1, GRID_MAX_SIZE);
+    }
+    // The last cell is for the items too large to be put in the grid.
+    cells_nb = grid->size[0] * grid->size[1] + 1;
+
+    // Counting sort of the items indices by cell.
+    count = grid->cells;
+    memset(count, 0, (cells_nb + 1) * sizeof(*count));
+    while ((item = (const item_t*)utarray_next(items, item)))
+        ITEM_ITER_CELLS(grid, item, cell, count[cell + 1]++);
+    for (i = 0; i < cells_nb; i++) count[i + 1] += count[i];
+    grid->entries_nb = count[cells_nb];
+    if (grid->entries_nb > grid->entries_allocated) {
+        grid->entries_allocated = max(grid->entries_nb,
+                                      grid->entries_allocated * 2);
+        grid->entries = realloc(grid->entries, grid->entries_allocated *
+                                               sizeof(*grid->entries));
+    }
+    for (i = 0; i < nb; i++) {
+        item = (const item_t*)utarray_eltptr(items, i);
+        ITEM_ITER_CELLS(grid, item, cell, grid->entries[count[cell]++] = i);
+    }
+    // Shift back the offsets to the start of each cell.
+    memmove(count + 1, count, cells_nb * sizeof(*count));
+    count[0] = 0;
 }
 
 // Compute the signed distance of a point to an item.
@@ -181,25 +315,58 @@ static double lookup_score(const item_t *item, const double pos[static 2],
 
 }
 
-int areas_lookup(const areas_t *areas, const double pos[2], double max_dist,
-                 uint64_t *oid, uint64_t *hint)
+// Check all the items of a grid cell.
+static void lookup_cell(const areas_t *areas, int cell, const double pos[2],
+                        double max_dist, int *best, double *best_score)
 {
-    item_t *item = NULL, *best = NULL;
-    double score, best_score = 0.0;
+    const grid_t *grid = areas->grid;
+    const item_t *item;
+    double score;
+    int i, idx;
 
-    while ( (item = (item_t*)utarray_next(areas->items, item)) ) {
+    for (i = grid->cells[cell]; i < grid->cells[cell + 1]; i++) {
+        idx = grid->entries[i];
+        item = (const item_t*)utarray_eltptr(areas->items, idx);
         score = lookup_score(item, pos, max_dist);
-        if (score > best_score) {
-            best_score = score;
-            best = item;
+        // In case of equality keep the first added item, as if we were
+        // iterating the whole list.
+        if (score > *best_score ||
+                (score == *best_score && score > 0 && idx < *best)) {
+            *best_score = score;
+            *best = idx;
         }
     }
-    if (!best) return 0;
-    *oid = best->oid;
-    *hint = best->hint;
+}
+
+int areas_lookup(const areas_t *areas, const double pos[2], double max_dist,
+                 uint64_t *oid, uint64_t *hint)
+{
+    const item_t *best_item;
+    grid_t *grid = areas->grid;
+    double best_score = 0.0;
+    double aabb[2][2] = {{pos[0] - max_dist, pos[1] - max_dist},
+                         {pos[0] + max_dist, pos[1] + max_dist}};
+    int best = -1, range[2][2], x, y;
+
+    if (grid->dirty) grid_build(grid, areas->items);
+    if (grid->entries_nb == 0) return 0;
+
+    grid_get_range(grid, aabb, range);
+    for (y = range[0][1]; y <= range[1][1]; y++)
+        for (x = range[0][0]; x <= range[1][0]; x++)
+            lookup_cell(areas, y * grid->size[0] + x, pos, max_dist,
+                        &best, &best_score);
+    lookup_cell(areas, grid->size[0] * grid->size[1], pos, max_dist,
+                &best, &best_score);
+
+    if (best == -1) return 0;
+    best_item = (const item_t*)utarray_eltptr(areas->items, best);
+    *oid = best_item->oid;
+    *hint = best_item->hint;
     return 1;
 }
 
+
 /*
  * Function: areas_lookup_aabb
  * Get the list of all shapes in the area intersecting a bouding box
@@ -231,3 +398,65 @@ int areas_lookup_aabb(
     }
     return ret;
 }
+
+#if COMPILE_TESTS
+
+// Reference lookup iterating all the items.
+static int lookup_linear(const areas_t *areas, const double pos[2],
+                         double max_dist, uint64_t *oid)
+{
+    item_t *item = NULL, *best = NULL;
+    double score, best_score = 0.0;
+
+    while ( (item = (item_t*)utarray_next(areas->items, item)) ) {
+        score = lookup_score(item, pos, max_dist);
+        if (score > best_score) {
+            best_score = score;
+            best = item;
+        }
+    }
+    if (!best) return 0;
+    *oid = best->oid;
+    return 1;
+}
+
+static void test_areas(void)
+{
+    areas_t *areas;
+    double pos[2];
+    uint64_t oid, oid_ref, hint;
+    int i, pass, r;
+
+    srand(0);
+    areas = areas_create();
+    assert(!areas_lookup(areas, VEC(0, 0), 10, &oid, &hint));
+    for (pass = 0; pass < 2; pass++) {
+        areas_clear_all(areas);
+        for (i = 0; i < 5000; i++) {
+            pos[0] = rand() % 2000;
+            pos[1] = rand() % 1000;
+            if (i % 2)
+                areas_add_circle(areas, pos, rand() % 8, i + 1, 0);
+            else
+                areas_add_ellipse(areas, pos, rand() % 3,
+                                  rand() % 20 + 1, rand() % 5 + 1, i + 1, 0);
+        }
+        // Add a few large shapes that don't fit in the grid.
+        areas_add_circle(areas, VEC(1000, 500), 800, 10001, 0);
+        areas_add_ellipse(areas, VEC(-100, 500), 0.5, 500, 10, 10002, 0);
+
+        for (i = 0; i < 200; i++) {
+            pos[0] = rand() % 2400 - 200;
+            pos[1] = rand() % 1200 - 100;
+            r = areas_lookup(areas, pos, 5, &oid, &hint);
+            assert(r == lookup_linear(areas, pos, 5, &oid_ref));
+            assert(!r || oid == oid_ref);
+        }
+    }
+    areas_clear_all(areas);
+    assert(!areas_lookup(areas, VEC(0, 0), 10, &oid, &hint));
+}
+
+TEST_REGISTER(NULL, test_areas, TEST_AUTO);
+
+#endif
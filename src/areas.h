@@ -82,6 +82,19 @@ int areas_lookup_aabb(
         const areas_t *areas, const double aabb[2][2], void *user,
         void (*callback)(void *user, uint64_t oid, uint64_t hint));
 
+/*
+ * Function: areas_set_offset
+ * Set an offset added to the positions of the shapes we add next.
+ *
+ * Used when we render several views in the same window, so that the
+ * shapes are added in window space.
+ *
+ * Parameters:
+ *   areas  - an areas instance.
+ *   offset - the offset in window space.
+ */
+void areas_set_offset(areas_t *areas, const double offset[2]);
+
 /*
  * Function: areas_clear_all
  * Remove all the shapes in an areas instance.
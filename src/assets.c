@@ -8,12 +8,31 @@
  */
 
 #include "swe.h"
+#include "utils/shmcache.h"
 #include <sys/stat.h>
 
-static const int DEFAULT_DELAY = 60;
+/*
+ * If ASSETS_DIR is defined, the native builds don't bundle the assets into
+ * the binary.  Instead they are read from uncompressed files in that
+ * directory (created with 'tools/make-assets.py --files'), and memory
+ * mapped on first use.
+ */
+#if defined(ASSETS_DIR) && !defined(__EMSCRIPTEN__)
+#   define ASSETS_MMAP 1
+#   include <fcntl.h>
+#   include <ftw.h>
+#   include <sys/mman.h>
+#   include <unistd.h>
+#else
+#   define ASSETS_MMAP 0
+#endif
 
+static const int DEFAULT_DELAY = 60;
 
-static void assets_update(void);
+// Max memory used by the data of the unused online and file assets, and
+// min number of frames an asset must stay unused before we delete it.
+#define CACHE_MAX_SIZE (64 * (1 << 20))
+#define EVICT_MIN_AGE 60
 
 enum {
     STATIC      = 1 << 8,
@@ -21,9 +40,38 @@ enum {
     FREE_DATA   = 1 << 10,
     LOGGED      = 1 << 11,
     CAN_RELEASE = 1 << 12,
+    MAPPED      = 1 << 13, // File in ASSETS_DIR.
+    RECORDED    = 1 << 14, // Arrival passed to the session recorder.
+    SHARED      = 1 << 15, // Data in (or added to) the shared cache.
+    PACKED      = 1 << 16, // Bundled asset in a separate pack.
 };
 
 typedef struct asset asset_t;
+typedef struct inflater inflater_t;
+typedef struct pack pack_t;
+
+// A pack file of bundled assets.  See <asset_register_packed>.
+struct pack
+{
+    UT_hash_handle  hh;
+    const char      *name;
+    asset_buffer_t  *buffer; // The pack data once loaded.
+    int             code;    // Set once loaded or failed.
+};
+
+// Decompress a bundled asset in a thread.
+struct inflater
+{
+    worker_t        worker;
+    asset_t         *asset;
+    const void      *compressed_data;
+    int             compressed_size;
+    void            *data;
+    int             size;
+    bool            started;
+    inflater_t      *prev, *next;
+};
+
 struct asset
 {
     UT_hash_handle  hh;
@@ -34,13 +82,54 @@ struct asset
     void            *compressed_data;
     void            *data;
     int             size;
-    int             last_used;
+    int             cost;       // Size counted in the cache size.
+    int             last_frame; // Frame of the last access.
     int             delay;
+    double          priority;
+    asset_buffer_t  *buffer;
+    inflater_t      *inflater;
+    char            *path; // Only for MAPPED assets.
+    pack_t          *pack; // Only for PACKED assets.
+    int             pack_offset;
+    int             pack_size;
+    asset_t         *lru_prev, *lru_next;
+    asset_t         *release_prev, *release_next;
 };
 
 // Global map of all the assets.
 static asset_t *g_assets = NULL;
 
+// The non static assets, sorted from the most recently used, and the total
+// cost of their data.  See <assets_update>.
+static struct {
+    asset_t     *lru;
+    int64_t     size;
+    int         frame;
+    int64_t     evictions; // Number of assets deleted to fit the budget.
+} g_cache = {};
+
+// All the packs of bundled assets, and their base url.
+static struct {
+    pack_t      *map;
+    char        *url;
+} g_packs = {};
+
+// Assets to release at the next update.
+static asset_t *g_to_release = NULL;
+
+// Bundled assets queued for decompression, in the order of <asset_warmup>.
+static struct {
+    inflater_t  *list;
+    int         nb_tot;
+    int         nb_done;
+} g_warmup = {};
+
+#ifndef __EMSCRIPTEN__
+// Second level cache of the online assets data, shared between the
+// processes.  See <assets_set_shared_cache>.
+static shmcache_t *g_shared = NULL;
+#endif
+
 // Global hook function.
 static struct {
     void *user;
@@ -80,11 +169,24 @@ static asset_t *asset_get(const char *url, int flags)
         asset->flags |= flags;
         if (flags & ASSET_DELAY) asset->delay = DEFAULT_DELAY;
         HASH_ADD_KEYPTR(hh, g_assets, asset->url, strlen(asset->url), asset);
+    } else if (!(asset->flags & STATIC)) {
+        DL_DELETE2(g_cache.lru, asset, lru_prev, lru_next);
+    }
+    if (!(asset->flags & STATIC)) {
+        DL_PREPEND2(g_cache.lru, asset, lru_prev, lru_next);
+        asset->last_frame = g_cache.frame;
     }
-    asset->last_used = 0;
     return asset;
 }
 
+// Update the size of an asset data in the cache.
+static void asset_set_cost(asset_t *asset, int cost)
+{
+    if (asset->flags & STATIC) return;
+    g_cache.size += cost - asset->cost;
+    asset->cost = cost;
+}
+
 void asset_register(const char *url, const void *data, int size,
                     bool compressed)
 {
@@ -105,6 +207,232 @@ void asset_register(const char *url, const void *data, int size,
                     strlen(asset->url), asset);
 }
 
+void asset_register_packed(const char *url, const char *pack_name,
+                           int offset, int size, bool compressed)
+{
+    asset_t *asset;
+    pack_t *pack;
+
+    assert(str_startswith(url, "asset://"));
+    HASH_FIND_STR(g_packs.map, pack_name, pack);
+    if (!pack) {
+        pack = calloc(1, sizeof(*pack));
+        pack->name = pack_name;
+        HASH_ADD_KEYPTR(hh, g_packs.map, pack->name, strlen(pack->name),
+                        pack);
+    }
+    asset = calloc(1, sizeof(*asset));
+    asset->flags = STATIC | PACKED | (compressed ? COMPRESSED : 0);
+    asset->url = url;
+    asset->pack = pack;
+    asset->pack_offset = offset;
+    asset->pack_size = size;
+    HASH_ADD_KEYPTR(hh, g_assets, asset->url, strlen(asset->url), asset);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void assets_set_packs_url(const char *url)
+{
+    free(g_packs.url);
+    g_packs.url = strdup(url);
+}
+
+/*
+ * Point a packed asset to its data, if its pack is loaded.
+ *
+ * The pack data is retained forever, so that the online assets cache
+ * never evicts it.
+ */
+static void asset_unpack(asset_t *asset, int *code)
+{
+    pack_t *pack = asset->pack;
+    char *url;
+    const uint8_t *data;
+
+    if (!pack->code) {
+        if (asprintf(&url, "%s/%s", g_packs.url ?: "packs", pack->name) < 0)
+            return;
+        if (asset_get_data2(url, 0, NULL, &pack->code))
+            pack->buffer = asset_retain(url);
+        free(url);
+    }
+    *code = pack->code;
+    if (!pack->buffer) return;
+    data = (const uint8_t*)pack->buffer->data + asset->pack_offset;
+    if (asset->flags & COMPRESSED) {
+        asset->compressed_data = (void*)data;
+        asset->compressed_size = asset->pack_size;
+    } else {
+        asset->data = (void*)data;
+        asset->size = asset->pack_size;
+    }
+}
+
+#if ASSETS_MMAP
+
+static int register_file(const char *path, const struct stat *st, int type,
+                         struct FTW *ftw)
+{
+    asset_t *asset;
+    char *url;
+
+    if (type != FTW_F) return 0;
+    asprintf(&url, "asset://%s", path + strlen(ASSETS_DIR) + 1);
+    HASH_FIND_STR(g_assets, url, asset);
+    if (asset) {
+        free(url);
+        return 0;
+    }
+    asset = calloc(1, sizeof(*asset));
+    asset->flags = STATIC | MAPPED;
+    asset->url = url;
+    asset->path = strdup(path);
+    HASH_ADD_KEYPTR(hh, g_assets, asset->url, strlen(asset->url), asset);
+    return 0;
+}
+
+// Register all the files of ASSETS_DIR, without reading them yet.
+static void register_assets_dir(void) __attribute__((constructor));
+static void register_assets_dir(void)
+{
+    if (nftw(ASSETS_DIR, register_file, 16, FTW_PHYS) != 0)
+        LOG_E("Cannot read assets dir %s", ASSETS_DIR);
+}
+
+/*
+ * Map a file asset in memory.  The pages are shared with the system file
+ * cache, so they can be evicted and don't count in our heap.
+ *
+ * We always want a null byte after the data, for the text assets.  The end
+ * of the last mapped page is filled with zeros, but if the file size is a
+ * multiple of the page size we have to read the file instead.
+ */
+static void asset_map(asset_t *asset)
+{
+    int fd;
+    struct stat st;
+    void *data;
+
+    fd = open(asset->path, O_RDONLY);
+    if (fd < 0) return;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+            st.st_size % sysconf(_SC_PAGESIZE) != 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED) {
+            asset->data = data;
+            asset->size = st.st_size;
+        }
+    }
+    close(fd);
+    if (asset->data) return;
+    asset->data = read_file(asset->path, &asset->size);
+    if (asset->data) asset->flags |= FREE_DATA;
+}
+
+#endif // ASSETS_MMAP
+
+static void inflate(inflater_t *inf)
+{
+    int r __attribute__((unused));
+    inf->size = ((uint32_t*)inf->compressed_data)[0];
+    assert(inf->size > 0);
+    // Always add a NULL byte at the end so that text data are properly
+    // null terminated.
+    inf->data = malloc(inf->size + 1);
+    ((char*)inf->data)[inf->size] = '\0';
+    r = z_uncompress(inf->data, inf->size,
+                     inf->compressed_data + 4, inf->compressed_size - 4);
+    assert(r == 0);
+}
+
+static int inflate_worker(worker_t *worker)
+{
+    inflate((inflater_t*)worker);
+    return 0;
+}
+
+static void inflater_init(inflater_t *inf, asset_t *asset)
+{
+    worker_init(&inf->worker, inflate_worker);
+    inf->asset = asset;
+    inf->compressed_data = asset->compressed_data;
+    inf->compressed_size = asset->compressed_size;
+}
+
+// Set the asset data from a finished inflater.
+static void asset_set_inflated(asset_t *asset, inflater_t *inf)
+{
+    asset->data = inf->data;
+    asset->size = inf->size;
+    asset->flags |= FREE_DATA;
+}
+
+/*
+ * Decompress a bundled asset now.  If the asset is queued for warmup, we
+ * take it back from the workers queue, or wait for it if the inflation
+ * already started.
+ */
+static void asset_inflate(asset_t *asset)
+{
+    inflater_t tmp = {}, *inf = asset->inflater;
+
+    if (!inf) {
+        inflater_init(&tmp, asset);
+        inflate(&tmp);
+        asset_set_inflated(asset, &tmp);
+        return;
+    }
+    if (!inf->started || worker_cancel(&inf->worker)) {
+        inflate(inf);
+    } else {
+        // Running in a thread.  This should be short.
+        while (!worker_iter(&inf->worker)) {}
+    }
+    asset_set_inflated(asset, inf);
+    DL_DELETE(g_warmup.list, inf);
+    free(inf);
+    asset->inflater = NULL;
+    g_warmup.nb_done++;
+}
+
+void asset_warmup(const char *prefix)
+{
+    asset_t *asset;
+    inflater_t *inf;
+    for (asset = g_assets; asset; asset = asset->hh.next) {
+        if (!(asset->flags & COMPRESSED) || asset->data) continue;
+        // Packed assets can only be decompressed once the pack is loaded.
+        if (!asset->compressed_data) continue;
+        if (asset->inflater || !str_startswith(asset->url, prefix)) continue;
+        inf = calloc(1, sizeof(*inf));
+        inflater_init(inf, asset);
+        // Assets queued first are decompressed first.
+        inf->worker.priority = -g_warmup.nb_tot;
+        asset->inflater = inf;
+        DL_APPEND(g_warmup.list, inf);
+        g_warmup.nb_tot++;
+    }
+}
+
+int asset_warmup_update(void)
+{
+    inflater_t *inf, *tmp;
+    DL_FOREACH_SAFE(g_warmup.list, inf, tmp) {
+        if (!inf->started) {
+            inf->started = true;
+            // Without threads the worker runs immediately, in which case
+            // we only decompress one asset per update.
+            if (worker_iter(&inf->worker)) break;
+            continue;
+        }
+        if (!worker_iter(&inf->worker)) continue;
+        asset_inflate(inf->asset);
+    }
+    progressbar_report("assets", "Assets", g_warmup.nb_done,
+                       g_warmup.nb_tot, -1);
+    return g_warmup.nb_tot - g_warmup.nb_done;
+}
+
 const void *asset_get_data(const char *url, int *size, int *code)
 {
     return asset_get_data2(url, 0, size, code);
@@ -113,13 +441,11 @@ const void *asset_get_data(const char *url, int *size, int *code)
 const void *asset_get_data2(const char *url, int flags, int *size, int *code)
 {
     asset_t *asset;
-    int r, default_size, default_code;
+    int default_size, default_code;
     const void *data = NULL;
-    (void)r;
     size = size ?: &default_size;
     code = code ?: &default_code;
 
-    assets_update();
     asset = asset_get(url, flags);
     *code = 0;
     *size = 0;
@@ -129,25 +455,23 @@ const void *asset_get_data2(const char *url, int flags, int *size, int *code)
         goto end;
     }
 
-    if (!asset->data && asset->compressed_data) {
-        asset->size = ((uint32_t*)asset->compressed_data)[0];
-        assert(asset->size > 0);
-        // Always add a NULL byte at the end so that text data are properly
-        // null terminated.
-        asset->data = malloc(asset->size + 1);
-        ((char*)asset->data)[asset->size] = '\0';
-        r = z_uncompress(asset->data, asset->size,
-                         asset->compressed_data + 4,
-                         asset->compressed_size - 4);
-        asset->flags |= FREE_DATA;
-        assert(r == 0);
+    if ((asset->flags & PACKED) && !asset->data && !asset->compressed_data) {
+        asset_unpack(asset, code);
+        if (!asset->data && !asset->compressed_data) goto end;
+        *code = 0;
     }
+    if (!asset->data && asset->compressed_data) asset_inflate(asset);
+#if ASSETS_MMAP
+    // The mapped files are never unmapped, as for the bundled data.
+    if (!asset->data && (asset->flags & MAPPED)) asset_map(asset);
+#endif
 
     // Apply hook if set.
     if (g_hook.fn && !asset->request && !asset->data) {
         asset->data = g_hook.fn(g_hook.user, url, &asset->size, code);
         if (*code != -1) {
             asset->flags |= FREE_DATA;
+            asset_set_cost(asset, asset->size);
             *size = asset->size;
             data = asset->data;
             goto end;
@@ -163,6 +487,7 @@ const void *asset_get_data2(const char *url, int flags, int *size, int *code)
         }
         asset->data = read_file(url, &asset->size);
         asset->flags |= FREE_DATA;
+        asset_set_cost(asset, asset->size);
     }
 
     if (asset->data) {
@@ -171,6 +496,21 @@ const void *asset_get_data2(const char *url, int flags, int *size, int *code)
         return asset->data;
     }
 
+#ifndef __EMSCRIPTEN__
+    // The data of the shared cache is not counted in our budget, since it
+    // doesn't belong to this process.
+    if (g_shared && !asset->request && !(asset->flags & SHARED)) {
+        asset->data = (void*)shmcache_get(g_shared, url, &asset->size);
+        if (asset->data) {
+            asset->flags |= SHARED;
+            *code = 200;
+            *size = asset->size;
+            data = asset->data;
+            goto end;
+        }
+    }
+#endif
+
     if (!asset->request) {
         if (asset->delay) {
             asset->delay--;
@@ -178,21 +518,46 @@ const void *asset_get_data2(const char *url, int flags, int *size, int *code)
             return NULL;
         }
         asset->request = request_create(asset->url);
+        request_set_priority(asset->request, asset->priority);
+        trace_event('i', "assets", "request", 0, trace_get_time(), 0,
+                    "\"url\": \"%s\"", asset->url);
     }
     data = request_get_data(asset->request, size, code);
-    if (*code && (flags & ASSET_USED_ONCE))
+    if (data) asset_set_cost(asset, *size);
+#ifndef __EMSCRIPTEN__
+    if (g_shared && data && *code == 200 && !(asset->flags & SHARED)) {
+        asset->flags |= SHARED;
+        shmcache_put(g_shared, url, data, *size);
+    }
+#endif
+    if (*code && (flags & ASSET_USED_ONCE) && !(asset->flags & CAN_RELEASE)) {
         asset->flags |= CAN_RELEASE;
+        DL_APPEND2(g_to_release, asset, release_prev, release_next);
+    }
 
     // All error return codes return NULL data.
     if (*code >= 400) data = NULL;
 
 end:
+    if (asset && *code && !(asset->flags & RECORDED)) {
+        asset->flags |= RECORDED;
+        recorder_on_asset(url, *code);
+    }
     LOG_RET(asset, url, *code, flags);
     return data;
 }
 
 static void asset_release_(asset_t *asset)
 {
+    if (asset->buffer) {
+        // The buffer is now the owner of the data.
+        if (asset->buffer->owned && asset->buffer->owned == asset->data) {
+            asset->data = NULL;
+            asset->size = 0;
+        }
+        asset_buffer_release(asset->buffer);
+        asset->buffer = NULL;
+    }
     if (asset->flags & FREE_DATA) {
         free(asset->data);
         asset->data = NULL;
@@ -200,27 +565,43 @@ static void asset_release_(asset_t *asset)
     }
     if (asset->request)
         request_delete(asset->request);
+    if (asset->flags & CAN_RELEASE)
+        DL_DELETE2(g_to_release, asset, release_prev, release_next);
     if (!(asset->flags & STATIC)) {
+        asset_set_cost(asset, 0);
+        DL_DELETE2(g_cache.lru, asset, lru_prev, lru_next);
         HASH_DEL(g_assets, asset);
         free(asset->url);
         free(asset);
     }
 }
 
-static void assets_update(void)
+void assets_update(void)
 {
     asset_t *asset, *tmp;
-    HASH_ITER(hh, g_assets, asset, tmp) {
-        if ((asset->flags & CAN_RELEASE)) {
-            asset_release_(asset);
-            continue;
-        }
-        if (asset->flags & STATIC) continue;
-        if (asset->last_used++ < 128) continue;
-        // XXX: to finish: delete unused assets.
+
+    g_cache.frame++;
+    DL_FOREACH_SAFE2(g_to_release, asset, tmp, release_next)
+        asset_release_(asset);
+
+    // Delete the least recently used assets until we fit in the budget.
+    // The assets still loading have no cost, but if nobody asked for them
+    // for a while we can delete them too.
+    while (g_cache.size > CACHE_MAX_SIZE && g_cache.lru) {
+        asset = g_cache.lru->lru_prev; // Tail of the list.
+        if (g_cache.frame - asset->last_frame < EVICT_MIN_AGE) break;
+        asset_release_(asset);
+        g_cache.evictions++;
     }
 }
 
+void assets_get_stats(int *nb, int64_t *size, int64_t *evictions)
+{
+    *nb = HASH_COUNT(g_assets);
+    *size = g_cache.size;
+    *evictions = g_cache.evictions;
+}
+
 const char *asset_iter_(const char *base, void **i)
 {
     asset_t *asset = (*i);
@@ -241,6 +622,62 @@ void asset_release(const char *url)
     asset_release_(asset);
 }
 
+void asset_cancel(const char *url)
+{
+    asset_t *asset;
+    HASH_FIND_STR(g_assets, url, asset);
+    if (!asset || !asset->request) return;
+    request_cancel(asset->request);
+}
+
+void asset_set_priority(const char *url, double priority)
+{
+    asset_t *asset;
+    HASH_FIND_STR(g_assets, url, asset);
+    if (!asset) return;
+    asset->priority = priority;
+    if (asset->request) request_set_priority(asset->request, priority);
+}
+
+asset_buffer_t *asset_retain(const char *url)
+{
+    asset_t *asset;
+    asset_buffer_t *buf;
+    int size, code;
+    const void *data;
+
+    HASH_FIND_STR(g_assets, url, asset);
+    assert(asset);
+    if (asset->buffer) goto end;
+
+    data = asset_get_data(url, &size, &code);
+    assert(data);
+    buf = calloc(1, sizeof(*buf));
+    buf->ref = 1;
+    buf->data = data;
+    buf->size = size;
+    // Take the ownership of the data, so that we don't have to copy it.
+    if (asset->flags & FREE_DATA) {
+        asset->flags &= ~FREE_DATA;
+        buf->owned = asset->data;
+    } else if (asset->request) {
+        buf->owned = request_detach_data(asset->request);
+    }
+    asset->buffer = buf;
+
+end:
+    __atomic_add_fetch(&asset->buffer->ref, 1, __ATOMIC_RELAXED);
+    return asset->buffer;
+}
+
+void asset_buffer_release(asset_buffer_t *buf)
+{
+    if (!buf) return;
+    if (__atomic_sub_fetch(&buf->ref, 1, __ATOMIC_ACQ_REL)) return;
+    free(buf->owned);
+    free(buf);
+}
+
 /*
  * Function: asset_set_hook
  * Set a global function to handle special urls.
@@ -256,7 +693,19 @@ void asset_set_hook(void *user,
     g_hook.fn = fn;
 }
 
+#ifndef __EMSCRIPTEN__
+int assets_set_shared_cache(const char *name, int64_t size)
+{
+    // The assets can keep pointers to the shared data, so we never close
+    // the previous cache.
+    if (g_shared) return 0;
+    g_shared = shmcache_open(name, size);
+    return g_shared ? 0 : -1;
+}
+#endif
+
 
+#if !ASSETS_MMAP
 #include "assets/cities.txt.inl"
 #include "assets/font.inl"
 #include "assets/mpcorb.dat.inl"
@@ -266,3 +715,4 @@ void asset_set_hook(void *user,
 #include "assets/stars.inl"
 #include "assets/symbols.png.inl"
 #include "assets/textures.inl"
+#endif
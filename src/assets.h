@@ -8,6 +8,7 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /*
  * File: assets.h
@@ -85,6 +86,87 @@ const void *asset_get_data2(const char *url, int flags, int *size, int *code);
  */
 void asset_release(const char *url);
 
+/*
+ * Function: assets_update
+ * Release the unused assets, called once per frame.
+ *
+ * The assets flagged with ASSET_USED_ONCE are released, and the least
+ * recently used online and file assets are deleted when their data go over
+ * the cache budget.  The data of an asset can be deleted once we stop
+ * calling <asset_get_data> for it, so the code that keeps using the data
+ * should retain it with <asset_retain>.
+ */
+void assets_update(void);
+
+/*
+ * Function: assets_get_stats
+ * Get the memory usage of the assets.
+ *
+ * Parameters:
+ *   nb        - Number of known assets, including the static ones.
+ *   size      - Size in bytes of the non static assets data.
+ *   evictions - Number of assets deleted to fit the cache budget since
+ *               the start.
+ */
+void assets_get_stats(int *nb, int64_t *size, int64_t *evictions);
+
+/*
+ * Function: asset_cancel
+ * Abort the network request of an asset that is still loading.
+ *
+ * This frees the connection for other requests.  The request will start
+ * again if we call <asset_get_data> on the same url later.  Does nothing
+ * if the data has already been received.
+ */
+void asset_cancel(const char *url);
+
+/*
+ * Function: asset_set_priority
+ * Set the priority of the network request of an asset.
+ *
+ * When there are too many concurrent requests, the waiting ones start in
+ * decreasing priority order.  The default priority is zero.  Does nothing
+ * if the asset has never been requested.
+ */
+void asset_set_priority(const char *url, double priority);
+
+/*
+ * Type: asset_buffer_t
+ * Reference counted handle on the data of an asset.
+ *
+ * This allows to keep using the data of an asset after it has been
+ * released, for example to decode it in a worker thread without copying it.
+ *
+ * Attributes:
+ *   data   - The asset data, always followed by a null byte.
+ *   size   - Size of the data.
+ */
+typedef struct asset_buffer {
+    const void  *data;
+    int         size;
+    int         ref;    // Atomic reference counter.
+    void        *owned; // Memory freed with the last reference.
+} asset_buffer_t;
+
+/*
+ * Function: asset_retain
+ * Get a new reference on the data of a loaded asset.
+ *
+ * Should only be called after <asset_get_data> returned some data.  The
+ * returned buffer stays valid until <asset_buffer_release> is called, even
+ * if the asset is released.
+ */
+asset_buffer_t *asset_retain(const char *url);
+
+/*
+ * Function: asset_buffer_release
+ * Release a reference returned by <asset_retain>.
+ *
+ * Contrary to the other assets functions, this can be called from any
+ * thread.
+ */
+void asset_buffer_release(asset_buffer_t *buf);
+
 /*
  * Macro: ASSET_ITER
  * Iter all the asset url that start with a given prefix.
@@ -101,6 +183,10 @@ const char *asset_iter_(const char *base, void **i);
  *
  * Not supposed to be used directly.  Instead we should use the ASSET_REGISTER
  * macro.
+ *
+ * Native builds compiled with ASSETS_DIR defined don't bundle the assets,
+ * but register all the files of that directory at startup instead, and
+ * memory map them when they are first used.
  */
 void asset_register(const char *url, const void *data, int size,
                     bool compressed);
@@ -110,6 +196,94 @@ void asset_register(const char *url, const void *data, int size,
     static void register_asset_##id_(void) { \
         asset_register("asset://" name_, data_, sizeof(data_), comp_); }
 
+/*
+ * Function: asset_register_packed
+ * Register a bundled asset whose data is in a separate pack file.
+ *
+ * The builds compiled with ASSETS_PACKS defined don't embed the data of the
+ * big asset groups (stars, skycultures...) in the binary.  Instead
+ * tools/make-assets.py writes them into one pack file per group, and the
+ * assets are registered with their position in the pack.  The pack is
+ * fetched the first time we get the data of one of its assets, and then
+ * kept for the whole session.  Until then <asset_get_data> returns NULL
+ * with a zero code, as for any online asset.
+ *
+ * Not supposed to be used directly.  Instead we should use the
+ * ASSET_REGISTER_PACKED macro.
+ *
+ * Parameters:
+ *   url        - The asset url (asset://...).
+ *   pack       - Name of the pack file, relative to the packs url.
+ *   offset     - Offset of the asset data in the pack.
+ *   size       - Size of the asset data in the pack.
+ *   compressed - Whether the data is compressed.
+ */
+void asset_register_packed(const char *url, const char *pack, int offset,
+                           int size, bool compressed);
+
+#define ASSET_REGISTER_PACKED(id_, name_, pack_, offset_, size_, comp_) \
+    static void register_asset_##id_(void) __attribute__((constructor)); \
+    static void register_asset_##id_(void) { \
+        asset_register_packed("asset://" name_, pack_, offset_, size_, \
+                              comp_); }
+
+/*
+ * Function: assets_set_packs_url
+ * Set the base url of the assets pack files.
+ *
+ * Default to 'packs', relative to the page.  Must be called before we get
+ * the data of any packed asset.
+ */
+void assets_set_packs_url(const char *url);
+
+/*
+ * Function: asset_warmup
+ * Queue the bundled assets starting with a given prefix for decompression
+ * in the background.
+ *
+ * The assets are decompressed by the workers pool in the order of the
+ * calls, so we should first queue the assets needed for the first frames.
+ * Getting the data of an asset that is still queued decompresses it
+ * immediately, as without warmup.
+ */
+void asset_warmup(const char *prefix);
+
+/*
+ * Function: asset_warmup_update
+ * Collect the assets decompressed in the background.
+ *
+ * Should be called once per frame.  The progress is reported with the
+ * 'assets' progress bar.
+ *
+ * Return:
+ *   The number of assets still waiting for decompression.
+ */
+int asset_warmup_update(void);
+
+/*
+ * Function: assets_set_shared_cache
+ * Use a shared memory cache for the online assets data.
+ *
+ * This is for the deployments that run several engine processes on the same
+ * host: the data of the online assets (tiles, catalogs...) received by any
+ * process are added to a POSIX shared memory segment, where the other
+ * processes find them instead of doing their own requests, and without
+ * keeping their own copy.  Only the raw data are shared, each process still
+ * decodes the tiles it uses.  See <shmcache.h>.
+ *
+ * Can only be set once, the following calls are ignored.  Not available in
+ * the javascript version.
+ *
+ * Parameters:
+ *   name   - Name of the shared memory object, starting with '/'.  All the
+ *            processes using the same name share the same cache.
+ *   size   - Size of the segment, if we are the first process to open it.
+ *
+ * Return:
+ *   0 on success, or -1 if the segment could not be opened.
+ */
+int assets_set_shared_cache(const char *name, int64_t size);
+
 /*
  * Function: asset_set_hook
  * Set a global function to handle special urls.
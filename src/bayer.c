@@ -9,12 +9,19 @@
 
 #include "bayer.h"
 
-#include "uthash.h"
 #include "utils/utils.h"
 
-#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    int32_t     hip;
+    uint8_t     cst;        // 1-indexed.
+    uint8_t     bayer;      // 1-indexed.
+    uint8_t     bayer_n;    // For double stars.
+} entry_t;
 
-static const unsigned char DATA[7329];
+static const entry_t ENTRIES[1531];
 
 static const char *GREEK[][3] = {
     {"α", "alf", "Alpha"},
@@ -54,45 +61,26 @@ static const char *CSTS[] = {
     "Psc", "PsA", "Vol", "Pup", "Ret", "Sgr", "Sco", "Ser", "Sex", "Men",
     "Tau", "Tel", "Tuc", "Tri", "TrA", "Aqr", "Vir", "Vel"};
 
-typedef struct {
-    UT_hash_handle  hh;
-
-    int             hip;
-    uint8_t         cst;
-    uint8_t         bayer;
-    uint8_t         bayer_n;
-} entry_t;
-
-static entry_t *g_data = NULL;        // Global array.
-static entry_t *g_entries = NULL;     // Global hash.
-
-static void bayer_init(void)
+/*
+ * Binary search of the last entry for a given HIP number.
+ *
+ * We use the last one so that we get the same result as with the uthash
+ * table we used before for the few stars with several components.
+ */
+static const entry_t *find_entry(int hip)
 {
-    struct {int hip; uint8_t cst, bayer, bayer_n; char pad;} *data;
-    int size, nb, i;
-
-    memcpy(&size, DATA, 4);
-    data = malloc(size);
-    z_uncompress(data, size, DATA + 4, ARRAY_SIZE(DATA) - 4);
-
-    nb = size / sizeof(*data);
-    g_data = calloc(nb + 1, sizeof(*g_data));
-    for (i = 0; i < nb; i++) {
-        assert(data[i].hip);
-        g_data[i].hip = data[i].hip;
-        g_data[i].cst = data[i].cst;
-        g_data[i].bayer = data[i].bayer;
-        g_data[i].bayer_n = data[i].bayer_n;
-        HASH_ADD_INT(g_entries, hip, &g_data[i]);
+    int base = 0, n = ARRAY_SIZE(ENTRIES), half;
+    while (n > 1) {
+        half = n / 2;
+        base = (ENTRIES[base + half].hip <= hip) ? base + half : base;
+        n -= half;
     }
-    free(data);
+    return ENTRIES[base].hip == hip ? &ENTRIES[base] : NULL;
 }
 
 bool bayer_get(int hip, char cons[4], int *bayer, int *n)
 {
-    entry_t *e;
-    if (!g_entries) bayer_init();
-    HASH_FIND_INT(g_entries, &hip, e);
+    const entry_t *e = find_entry(hip);
     if (!e) {
         *bayer = 0;
         return false;
@@ -108,9 +96,8 @@ bool bayer_iter(int i, int *hip, char cons[4], int *bayer, int *n,
                 const char *greek[3])
 {
     const entry_t *e;
-    if (!g_data) bayer_init();
-    e = &g_data[i];
-    if (!e->hip) return false;
+    if (i < 0 || i >= ARRAY_SIZE(ENTRIES)) return false;
+    e = &ENTRIES[i];
     *hip = e->hip;
     memcpy(cons, CSTS[(e->cst - 1)], 4);
     *bayer = e->bayer;
@@ -121,396 +108,421 @@ bool bayer_iter(int i, int *hip, char cons[4], int *bayer, int *n,
     return true;
 }
 
-// Binary data of the form:
-//
-// hip      4 bytes
-// cst      1 byte (1-indexed)
-// bayer    1 byte (1-indexed)
-// bayer_n  1 byte (for double stars)
-// padding  1 byte
+/******* TESTS **********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+
+#include <assert.h>
+
+static void test_bayer_get(void)
+{
+    char cst[4];
+    int bayer, n;
+    // Sirius (α CMa).
+    assert(bayer_get(32349, cst, &bayer, &n));
+    assert(strcmp(cst, "CMa") == 0 && bayer == 1 && n == 0);
+    // First and last entries.
+    assert(bayer_get(88, cst, &bayer, &n) && strcmp(cst, "Phe") == 0);
+    assert(bayer_get(118322, cst, &bayer, &n) && strcmp(cst, "Tuc") == 0);
+    // Double star, we get the last component.
+    assert(bayer_get(40167, cst, &bayer, &n) && bayer == 6 && n == 2);
+    // No bayer designation.
+    assert(!bayer_get(1, cst, &bayer, &n) && bayer == 0);
+    assert(!bayer_get(118323, NULL, &bayer, NULL));
+}
+
+TEST_REGISTER(NULL, test_bayer_get, TEST_AUTO);
+#endif
+
+// Sorted by HIP number.  Stars with several components have several
+// entries with the same HIP number.
 //
 // Generated from The BSC5P database
 // http://heasarc.gsfc.nasa.gov/W3Browse/star-catalog/bsc5p.html
-// using tools/makebayer.py
+// using tools/make-bayer.py
 
-static const unsigned char DATA[7329] __attribute__((aligned(4))) = {
-    216,47,0,0, // uncompressed size
-    120,218,45,218,119,124,85,85,214,198,241,125,79,104,6,145,0,138,130,68,
-    138,65,106,16,136,148,208,65,73,16,8,45,84,69,5,236,34,162,34,150,177,
-    97,193,54,130,98,239,5,43,58,96,1,81,20,21,44,216,113,236,206,188,58,163,
-    40,58,118,177,143,51,50,239,119,29,248,131,207,143,115,238,57,123,61,207,
-    218,109,237,155,123,194,153,133,84,40,164,244,211,89,152,165,180,245,116,
-    44,74,169,209,124,172,147,210,128,99,177,110,74,21,199,97,189,148,118,
-    140,231,234,167,180,228,124,108,144,210,219,167,226,14,41,125,18,44,78,
-    105,78,60,215,48,165,205,167,224,142,41,205,140,118,26,165,116,69,188,
-    183,83,74,127,142,120,141,83,90,127,6,150,164,116,203,66,108,146,210,245,
-    167,97,211,148,234,159,139,205,82,122,45,116,236,156,82,159,179,113,151,
-    148,158,252,19,54,79,105,94,220,223,53,165,19,79,196,221,10,169,229,188,
-    96,150,238,162,61,227,163,218,179,153,255,223,219,30,139,10,105,103,26,
-    50,62,222,163,41,227,99,14,13,25,31,115,197,204,248,152,236,94,198,199,
-    181,47,20,82,198,199,240,23,145,143,163,226,218,59,19,227,57,109,116,162,
-    57,227,163,97,11,212,198,160,181,62,119,111,70,180,203,199,53,218,204,
-    60,187,62,218,227,227,146,61,144,143,105,165,200,71,191,208,229,95,135,
-    184,207,199,230,151,188,207,199,205,45,93,239,150,210,199,222,37,55,213,
-    223,80,72,69,244,223,178,30,245,195,171,47,35,253,77,218,248,92,219,143,
-    38,20,107,41,205,69,244,175,246,76,145,255,255,197,189,34,250,255,237,
-    221,162,226,66,90,26,247,139,179,212,138,230,162,134,133,180,32,103,150,
-    38,242,87,196,207,82,26,139,248,104,214,26,233,255,41,174,253,235,64,111,
-    17,221,109,198,22,82,29,122,138,107,80,155,205,130,218,252,231,24,164,
-    231,141,253,176,110,33,125,62,60,152,165,139,227,154,134,39,134,34,93,
-    151,28,128,116,77,25,141,116,13,137,247,229,245,221,241,40,103,59,214,
-    34,29,109,227,90,252,209,227,80,252,166,147,112,231,66,170,205,153,165,
-    27,119,47,164,186,6,232,138,156,89,106,91,134,244,148,119,70,122,10,173,
-    145,158,121,123,161,252,28,220,9,233,168,83,142,116,148,118,71,58,174,
-    107,135,116,140,235,138,116,252,184,55,210,209,41,218,165,227,111,109,
-    80,142,62,107,133,59,21,210,242,210,96,150,142,107,143,250,249,135,136,
-    67,95,223,46,40,63,171,35,126,140,207,62,41,213,147,167,3,189,91,143,174,
-    165,61,144,174,67,187,35,93,71,4,233,122,190,45,210,245,147,119,234,209,
-    117,177,113,84,143,174,150,238,213,163,107,230,0,164,235,220,222,72,87,
-    171,158,72,215,192,189,81,219,19,59,34,93,31,116,13,102,105,100,103,164,
-    107,83,196,147,191,241,113,223,24,170,223,13,233,188,91,191,214,163,243,
-    188,50,20,243,236,208,183,75,33,13,111,28,204,82,179,38,193,162,244,85,
-    206,58,169,71,232,51,46,111,218,75,27,252,188,208,14,249,89,16,52,48,127,
-    169,68,126,14,160,175,62,63,245,250,35,237,195,232,170,207,207,215,157,
-    144,159,107,246,68,126,142,141,118,248,89,31,215,252,204,160,179,62,63,
-    93,229,163,62,45,91,186,160,241,87,196,103,125,154,230,84,32,31,23,244,
-    66,154,26,230,44,164,198,251,32,63,13,7,34,63,223,28,90,72,13,232,107,
-    124,20,210,247,201,76,148,239,49,71,32,125,207,7,233,219,117,6,210,55,
-    107,54,210,55,250,158,148,118,240,94,179,187,209,123,75,150,161,247,122,
-    220,143,222,123,233,1,244,222,143,119,161,247,14,14,122,111,204,74,228,
-    107,183,248,156,159,151,227,58,198,77,73,33,153,102,169,214,184,48,205,
-    210,29,114,91,172,189,251,246,68,237,45,107,129,218,155,103,141,42,214,
-    222,20,193,139,181,55,179,25,106,111,124,188,47,79,71,55,70,13,205,206,
-    153,165,195,226,190,246,175,52,158,139,119,44,164,107,115,102,233,249,
-    142,216,168,144,118,232,20,204,210,91,198,109,177,252,61,25,113,228,111,
-    66,196,241,238,162,208,33,127,39,53,71,121,123,197,224,44,142,113,160,
-    83,139,141,131,95,140,219,98,235,208,97,161,179,121,172,43,104,29,154,
-    17,62,172,67,197,147,228,154,175,195,131,124,117,153,142,124,117,221,206,
-    253,38,32,127,13,166,32,95,223,198,115,244,190,31,215,250,117,235,45,230,
-    182,247,103,124,137,222,63,251,101,244,222,188,215,208,130,114,125,206,
-    44,157,244,41,202,207,56,11,218,142,218,89,164,95,118,148,159,199,110,
-    69,249,217,125,21,202,79,139,207,80,222,151,61,141,198,207,138,117,65,
-    235,216,19,40,222,161,31,162,113,211,238,47,246,44,113,199,136,47,61,169,
-    183,254,110,36,238,173,193,216,199,180,223,72,188,207,111,66,57,217,198,
-    44,61,114,7,138,123,112,80,220,67,238,69,113,167,111,231,214,21,40,254,
-    67,116,53,226,243,176,27,145,142,249,203,49,246,53,227,162,145,126,120,
-    198,56,106,164,15,63,206,153,165,89,15,33,93,251,222,135,198,113,191,184,
-    223,36,75,67,226,186,105,33,221,20,215,77,179,244,167,208,221,180,40,53,
-    141,118,244,211,212,208,97,253,123,59,103,150,110,191,29,245,233,218,156,
-    89,250,115,232,208,111,83,66,191,126,171,206,89,72,187,94,143,250,239,
-    137,11,10,105,39,235,229,71,57,179,244,239,11,81,62,54,231,204,210,23,
-    183,163,188,148,221,137,242,242,201,109,40,47,215,223,140,250,161,246,
-    26,148,143,87,130,242,209,229,38,148,135,85,75,81,30,254,184,3,229,161,
-    206,221,40,15,239,70,187,242,240,147,122,96,39,121,120,41,167,61,230,207,
-    104,92,166,237,108,114,9,202,199,29,65,227,243,208,120,207,248,220,115,
-    49,242,125,202,162,96,33,205,136,107,227,180,232,6,52,78,151,95,139,252,
-    78,186,28,249,29,118,5,242,249,217,201,214,0,253,189,250,65,228,175,230,
-    54,228,227,217,87,145,238,159,228,191,49,221,231,26,39,141,181,119,255,
-    181,168,157,149,207,162,247,103,211,110,186,164,47,189,91,226,223,40,154,
-    74,228,101,15,251,113,137,188,172,182,238,149,104,239,40,94,75,228,229,
-    27,222,74,228,229,110,154,74,180,223,163,28,181,223,65,78,74,252,123,201,
-    255,75,98,30,136,85,18,251,73,60,47,47,159,70,28,255,127,208,255,75,228,
-    97,114,80,30,142,124,181,144,74,196,252,228,53,148,135,94,246,249,18,121,
-    120,206,103,37,250,191,42,244,232,255,89,180,150,136,121,86,43,164,191,
-    44,244,201,67,15,235,106,137,207,138,204,123,195,43,175,133,130,7,155,
-    124,134,89,250,122,139,156,243,51,224,115,228,103,166,185,215,132,159,
-    165,214,161,38,252,60,102,125,104,194,207,112,147,166,9,63,147,182,122,
-    142,135,147,247,112,205,207,150,15,92,243,115,185,117,163,9,15,23,5,105,
-    255,250,55,247,245,111,157,223,131,89,90,249,127,168,35,30,207,153,165,
-    115,222,71,30,42,255,133,60,92,251,13,242,183,250,123,228,239,113,107,
-    93,19,254,238,111,24,204,210,213,113,205,223,214,208,205,223,203,76,52,
-    225,239,59,253,111,154,164,238,183,32,63,191,170,199,76,147,116,217,67,
-    200,207,165,219,217,118,57,242,181,234,126,228,171,185,113,210,148,175,
-    205,198,89,83,190,38,62,134,124,61,122,30,242,245,83,60,199,215,127,140,
-    231,166,124,221,96,60,55,229,107,254,50,212,79,151,171,187,154,234,167,
-    110,79,33,31,127,141,56,124,124,21,181,137,190,109,29,237,211,191,133,
-    127,195,53,93,242,31,164,175,138,207,102,244,45,249,37,165,157,205,191,
-    171,115,102,105,225,119,232,243,54,51,82,50,141,211,139,199,161,235,13,
-    65,250,79,61,16,233,191,57,72,255,123,214,217,93,232,255,32,62,167,255,
-    243,105,72,127,58,9,233,255,38,218,161,127,231,67,144,254,22,199,34,253,
-    229,115,144,254,1,199,32,253,63,197,251,244,191,63,19,233,127,117,22,242,
-    112,224,108,212,15,191,6,249,121,254,80,148,255,5,135,163,252,247,61,5,
-    173,39,83,207,8,102,169,60,103,81,90,126,102,176,78,250,232,172,96,221,
-    212,243,236,96,189,52,122,65,176,126,154,115,78,176,65,154,121,110,112,
-    135,84,124,148,190,224,247,107,113,154,243,219,129,158,230,242,51,220,
-    188,109,206,119,145,120,205,249,190,55,238,243,123,204,9,200,239,92,62,
-    155,243,185,148,175,230,124,238,199,79,243,168,27,142,68,99,117,122,206,
-    44,29,195,111,115,126,107,229,163,57,191,165,241,190,9,125,81,206,44,61,
-    19,159,243,251,169,121,193,78,26,161,110,100,39,245,183,159,178,147,90,
-    198,53,29,147,130,116,212,85,239,177,147,186,219,15,217,73,203,226,154,
-    158,175,223,176,247,123,255,134,119,208,251,215,255,13,189,255,195,123,
-    232,253,11,227,58,214,157,127,162,247,71,127,130,222,175,180,47,237,230,
-    253,77,65,253,55,236,239,200,87,183,120,158,175,119,163,61,227,124,233,
-    220,66,178,133,167,191,6,181,127,142,243,83,11,237,247,138,107,237,255,
-    162,126,105,161,253,35,230,160,246,175,82,247,180,48,23,255,145,51,75,
-    71,168,135,90,136,51,45,104,46,77,205,153,165,79,212,65,45,196,25,22,207,
-    201,223,87,234,134,150,226,60,208,1,197,185,78,29,220,82,156,23,187,161,
-    56,99,123,160,56,103,170,111,91,218,31,183,49,75,221,229,171,37,63,135,
-    196,251,226,220,220,19,249,153,162,126,110,201,207,90,245,117,75,113,154,
-    169,43,90,138,51,188,18,245,211,228,156,89,234,21,212,79,157,212,209,45,
-    245,211,111,17,215,184,60,61,218,49,46,127,237,141,250,169,113,47,52,46,
-    23,245,65,227,114,176,117,107,247,208,107,254,236,78,239,141,95,32,189,
-    237,191,69,122,87,197,231,244,150,126,133,242,242,75,220,167,179,155,121,
-    216,202,252,219,244,35,122,239,38,247,91,69,61,238,253,86,222,59,204,243,
-    173,188,119,180,250,164,149,247,214,169,47,90,121,239,130,205,168,176,
-    252,49,103,150,6,196,251,124,190,245,51,242,217,218,124,110,197,231,238,
-    65,107,85,105,206,44,189,105,191,50,84,210,43,39,163,3,232,235,57,179,
-    116,248,69,40,238,34,231,213,82,113,167,90,55,74,197,109,117,61,138,59,
-    200,185,182,84,220,53,206,205,165,242,58,39,222,19,175,191,115,109,169,
-    120,79,198,243,226,117,179,62,149,138,247,243,149,104,158,159,97,95,46,
-    149,207,3,157,155,75,173,187,13,46,8,102,105,129,245,172,212,248,111,116,
-    103,48,75,91,110,69,249,93,108,29,45,149,223,71,35,174,252,62,28,215,177,
-    31,58,111,151,154,247,7,57,143,151,154,247,245,67,143,241,216,212,126,
-    93,106,192,159,158,51,75,85,252,217,18,210,197,246,231,61,228,243,60,186,
-    246,112,30,56,63,167,115,223,101,200,95,249,165,200,223,59,65,254,102,
-    7,249,251,61,222,227,239,222,32,127,173,162,61,254,218,214,202,169,118,
-    223,177,14,180,214,238,35,53,40,95,31,28,141,218,91,108,221,104,173,189,
-    69,214,195,214,177,255,30,143,198,253,178,19,131,89,218,199,250,215,58,
-    234,242,201,168,189,73,214,177,214,242,181,209,252,111,45,79,39,88,103,
-    90,203,199,225,167,4,179,116,149,28,154,218,233,110,231,215,54,226,181,
-    152,130,226,221,123,60,138,119,253,25,24,231,235,106,20,239,21,227,182,
-    13,253,79,27,167,109,196,121,198,60,104,19,231,52,227,177,141,120,87,218,
-    239,218,136,119,93,149,251,198,125,127,231,229,54,198,253,240,156,206,
-    169,147,81,63,205,56,26,141,251,163,231,161,113,191,248,28,212,47,135,
-    157,130,250,229,177,19,80,191,28,119,12,234,151,125,14,65,253,50,62,168,
-    95,38,79,64,253,50,125,59,215,56,39,183,177,239,175,48,79,218,234,135,
-    5,125,131,89,26,182,15,242,177,161,31,242,113,177,121,213,150,143,189,
-    43,144,143,246,241,60,31,85,113,173,6,232,209,43,104,255,141,231,248,57,
-    48,218,225,103,211,0,228,231,206,82,53,181,124,237,123,16,202,215,220,
-    17,40,95,155,246,197,200,215,16,20,231,32,231,192,118,226,44,116,94,107,
-    39,206,174,206,135,237,204,163,13,206,121,237,228,235,50,231,210,118,218,
-    191,51,218,209,254,65,250,171,157,246,159,211,255,237,244,211,238,227,
-    80,158,206,27,141,198,243,197,53,193,44,173,217,15,229,235,235,104,79,
-    77,48,181,79,48,75,239,228,44,74,93,156,27,219,217,128,255,85,17,228,63,
-    238,219,128,79,28,16,172,147,62,9,125,205,234,166,31,163,157,102,245,82,
-    175,225,193,250,169,99,117,176,65,218,18,126,154,17,24,58,236,231,75,114,
-    58,87,143,9,214,73,199,56,207,182,211,15,123,171,179,218,233,135,253,236,
-    207,237,228,127,249,84,148,255,159,205,31,71,168,52,252,79,40,63,109,23,
-    160,252,76,50,142,246,148,159,58,241,185,252,188,31,215,242,115,212,185,
-    40,63,187,169,143,247,212,15,173,251,169,229,226,123,3,250,203,188,191,
-    40,168,63,175,200,153,165,235,228,185,76,59,245,248,42,211,206,201,242,
-    80,166,157,239,249,46,139,121,16,207,153,7,111,228,44,74,7,236,141,113,
-    192,237,30,116,206,112,190,46,139,126,237,134,106,173,27,226,115,7,186,
-    113,206,235,101,242,255,90,123,148,255,143,202,80,158,71,202,79,153,113,
-    249,166,124,149,25,151,115,135,161,113,249,142,254,43,147,135,121,131,
-    208,134,254,125,206,44,181,26,28,44,74,183,59,159,151,201,203,226,136,
-    35,47,63,92,102,172,145,241,204,149,200,215,250,211,81,94,254,113,9,198,
-    126,166,142,104,207,79,199,133,24,245,206,60,140,117,66,29,209,94,94,54,
-    94,138,241,253,65,188,79,127,243,120,207,184,185,208,124,110,79,247,29,
-    167,34,221,199,168,67,218,27,55,75,150,160,249,181,224,42,228,99,167,197,
-    200,199,31,87,32,31,11,47,68,62,102,93,142,230,215,37,215,32,63,233,6,
-    212,175,23,158,143,116,255,79,191,154,226,105,147,126,222,43,234,149,42,
-    164,251,32,113,108,153,233,36,241,59,184,255,135,231,59,184,127,233,5,
-    200,79,151,243,144,159,251,230,35,63,67,232,239,192,207,69,234,161,14,
-    252,236,171,30,234,192,207,175,103,111,59,43,236,71,127,7,126,134,198,
-    125,126,70,203,79,7,235,198,81,57,179,244,118,206,162,116,245,105,168,
-    206,126,236,79,65,235,123,180,103,126,172,137,248,230,71,243,120,159,223,
-    33,113,205,231,20,121,234,192,231,135,23,33,63,229,111,201,49,221,215,
-    188,137,241,125,199,38,164,251,44,251,96,71,186,191,182,175,117,164,123,
-    214,255,144,238,205,246,252,142,116,215,117,30,239,24,231,96,231,210,142,
-    81,55,59,231,118,164,251,185,231,144,238,19,54,32,221,43,213,63,29,245,
-    195,29,65,253,240,175,165,168,31,54,220,133,214,221,214,119,7,213,39,241,
-    190,254,168,116,190,237,168,160,255,54,103,150,154,57,183,117,164,247,
-    233,181,168,95,154,62,137,250,165,207,71,168,95,26,170,143,58,26,87,123,
-    255,21,249,121,251,190,66,82,130,164,223,31,65,126,122,57,127,118,226,
-    231,106,245,121,39,103,155,103,115,102,233,187,71,145,175,207,158,192,
-    168,11,86,35,95,111,61,137,124,253,172,174,239,196,87,251,184,230,171,
-    79,180,27,223,243,58,71,116,178,71,92,157,51,75,83,163,61,254,166,216,
-    71,59,241,87,120,174,144,127,7,188,248,129,66,254,221,207,125,57,179,52,
-    42,218,231,239,203,149,200,223,238,171,130,246,155,53,104,125,218,235,
-    241,96,150,58,108,231,141,57,139,210,219,17,159,239,227,156,55,58,241,
-    125,218,254,133,212,89,221,242,96,127,228,175,179,253,167,51,127,55,198,
-    125,253,85,127,56,70,189,51,24,249,90,22,228,43,217,199,58,243,181,120,
-    60,242,245,172,125,160,51,95,207,111,231,147,246,187,206,252,61,85,139,
-    250,237,169,120,158,175,51,131,124,253,253,0,228,235,166,136,99,60,157,
-    58,26,249,249,204,62,208,217,184,58,213,190,208,89,63,37,251,70,103,122,
-    255,136,118,233,93,167,254,235,172,159,198,218,111,58,235,159,61,173,219,
-    74,198,52,192,58,213,133,254,106,235,84,23,250,251,91,215,187,208,255,
-    156,117,169,11,221,235,173,67,93,232,158,211,3,233,253,221,58,213,133,
-    190,219,172,115,93,232,155,100,61,235,66,95,239,71,212,252,218,27,103,
-    220,118,213,222,51,127,160,246,246,55,190,186,106,239,240,123,81,62,218,
-    223,143,177,207,221,131,177,190,58,247,119,149,143,234,53,24,223,227,4,
-    227,251,155,103,80,156,51,95,64,113,94,223,136,226,236,234,156,219,85,
-    30,14,248,7,54,142,218,161,144,186,202,195,166,104,95,30,150,70,60,121,
-    88,30,122,244,231,99,171,131,89,250,212,184,237,106,223,248,125,93,48,
-    75,243,95,65,121,185,229,165,96,33,173,127,57,152,165,181,230,97,87,235,
-    230,119,57,179,116,183,115,99,87,227,122,222,10,148,183,157,173,191,229,
-    124,110,166,189,156,207,157,172,195,229,124,254,187,51,242,121,140,188,
-    149,243,57,90,62,203,195,103,59,180,254,127,148,51,75,21,242,86,206,239,
-    76,251,112,121,212,229,242,89,30,253,207,83,57,191,223,148,35,191,107,
-    229,181,156,223,135,173,255,229,198,111,147,78,193,44,181,182,191,149,
-    243,247,194,30,200,223,138,54,193,44,93,170,94,115,52,72,253,213,157,221,
-    232,58,225,102,140,243,247,61,72,87,149,243,114,55,186,46,88,130,116,61,
-    169,14,236,198,195,145,55,34,61,123,93,129,241,253,157,249,213,141,158,
-    167,238,217,198,171,213,175,221,232,105,249,32,210,211,255,46,148,247,
-    127,155,207,221,228,125,139,121,211,77,222,135,62,92,72,134,88,122,217,
-    60,219,59,198,147,245,220,81,35,93,105,253,236,238,250,45,251,70,119,122,
-    222,176,190,119,167,231,45,235,115,119,122,222,221,206,71,111,68,186,206,
-    81,95,58,218,164,122,135,161,247,214,169,47,123,120,175,158,243,101,15,
-    239,45,84,95,246,240,252,117,206,153,61,60,255,130,115,99,15,62,190,85,
-    111,246,224,99,213,193,200,71,125,245,102,15,250,27,57,79,247,144,215,
-    45,113,63,254,46,20,215,124,212,53,190,148,138,169,205,199,40,206,181,
-    207,163,253,124,234,187,40,78,217,19,40,206,173,214,209,158,226,60,176,
-    30,227,92,21,159,139,115,128,115,97,207,56,39,174,66,113,110,49,206,122,
-    138,83,109,93,236,41,206,143,79,161,56,43,227,190,190,189,202,184,238,
-    41,111,11,159,70,121,187,215,184,235,41,111,151,188,143,250,243,98,231,
-    205,158,230,109,181,243,103,79,243,182,171,117,186,167,241,121,183,113,
-    216,211,188,157,253,56,26,135,39,27,215,61,141,195,85,106,126,83,60,85,
-    42,246,43,232,223,193,121,174,66,158,22,218,204,43,232,143,205,177,130,
-    254,27,21,133,21,113,78,102,182,130,254,42,235,65,5,253,199,170,209,42,
-    232,191,40,62,119,14,189,52,103,150,22,182,69,62,110,85,236,84,240,177,
-    33,218,51,199,150,231,204,82,11,157,83,97,159,107,153,51,75,95,57,244,
-    85,240,53,86,177,94,193,215,241,14,239,21,124,189,97,78,85,240,181,194,
-    24,173,240,239,193,156,89,122,32,116,241,183,44,218,243,76,199,184,54,
-    239,134,25,60,21,124,222,110,81,170,208,198,146,174,193,44,53,136,107,
-    126,203,86,170,181,249,61,235,176,66,82,10,167,58,234,244,94,124,23,31,
-    139,124,247,85,143,247,178,175,156,146,51,75,141,143,196,186,133,212,60,
-    103,150,246,13,218,51,135,231,204,82,19,117,124,47,249,248,119,80,62,94,
-    119,142,239,37,31,155,14,70,253,121,72,180,43,15,99,103,160,60,252,236,
-    92,222,75,127,126,155,179,144,62,181,46,41,197,211,131,47,162,124,175,
-    212,47,189,229,123,168,254,238,45,206,226,156,89,218,67,127,247,22,103,
-    177,254,235,45,206,86,251,99,111,113,30,48,15,149,248,169,198,188,235,
-    195,71,191,171,145,143,183,205,183,62,113,94,118,238,235,163,189,151,227,
-    190,254,219,18,247,227,251,76,243,181,143,122,253,163,155,130,89,106,31,
-    237,104,239,112,231,183,62,244,45,249,94,46,180,123,162,243,112,95,237,
-    54,118,254,233,171,221,51,127,67,237,182,112,142,238,171,221,101,206,213,
-    125,233,188,45,167,115,197,127,49,190,87,183,222,245,165,115,173,58,163,
-    175,250,116,122,42,160,253,223,62,223,55,214,167,160,124,204,166,199,150,
-    151,118,177,127,87,138,179,230,21,52,127,102,189,22,204,242,181,167,178,
-    168,40,125,171,223,43,197,125,112,5,138,123,190,245,191,146,159,13,111,
-    160,120,202,165,84,41,94,31,231,243,74,62,214,235,195,74,249,223,215,58,
-    83,41,94,83,235,84,165,125,254,155,197,193,44,141,119,110,174,228,115,
-    209,99,104,94,237,231,80,90,105,125,236,210,38,152,165,231,140,155,74,
-    227,239,169,107,209,248,59,67,29,80,105,94,77,183,62,85,26,119,187,232,
-    207,202,93,98,253,64,227,109,171,250,161,210,188,234,107,252,87,26,103,
-    15,183,44,36,91,100,90,107,191,238,199,215,50,251,106,63,94,30,144,212,
-    126,180,173,201,153,165,163,212,14,253,248,249,98,20,242,211,32,254,102,
-    192,207,235,180,246,227,231,199,184,207,207,55,138,186,126,230,215,198,
-    46,193,44,149,56,15,42,25,210,187,206,135,253,181,191,223,68,212,254,23,
-    6,83,127,121,42,214,126,127,237,126,60,16,181,219,117,4,106,247,75,237,
-    245,215,238,150,97,168,221,190,251,97,252,93,84,99,253,227,239,179,234,
-    137,254,250,229,123,117,66,127,249,185,57,158,151,159,43,70,162,249,185,
-    100,59,167,49,215,95,126,102,215,160,252,76,156,134,242,243,83,220,151,
-    159,173,209,158,252,172,137,107,249,121,79,39,247,151,159,177,242,208,
-    95,126,38,89,111,7,68,125,109,125,29,64,255,111,179,144,254,145,214,237,
-    1,244,191,112,4,210,127,228,81,24,245,67,124,78,255,177,113,223,184,157,
-    179,157,199,111,231,233,57,179,116,78,144,175,207,172,235,3,98,254,197,
-    53,95,27,230,34,95,199,157,128,124,253,112,34,198,239,18,212,255,3,212,
-    215,203,167,5,179,52,48,104,28,124,51,37,152,165,135,114,22,165,93,226,
-    185,146,58,169,81,254,121,221,84,123,64,176,94,106,24,250,229,225,145,
-    35,81,30,102,205,64,121,216,55,124,200,195,144,136,111,125,218,154,51,
-    75,59,132,111,117,65,215,227,131,244,30,138,242,178,41,222,151,151,203,
-    46,46,36,93,150,254,99,188,14,148,151,115,237,191,3,227,251,138,243,80,
-    94,158,118,222,28,40,47,151,31,129,242,178,68,125,55,48,190,199,178,158,
-    12,212,175,111,30,136,81,15,204,198,248,59,172,245,109,32,255,43,226,61,
-    99,106,200,57,193,44,45,159,133,145,135,67,80,30,42,174,71,253,218,46,
-    222,183,254,46,82,7,12,228,107,190,117,97,32,95,117,78,68,190,26,133,46,
-    190,190,182,78,12,228,235,144,197,65,235,119,196,163,191,139,250,118,16,
-    253,127,91,139,217,182,26,112,16,253,21,119,184,142,239,187,213,241,131,
-    232,222,67,253,60,136,238,121,247,35,221,167,170,23,6,209,125,64,60,71,
-    119,95,235,193,32,186,143,53,63,7,233,183,29,227,115,122,7,199,253,157,
-    98,157,68,122,103,197,251,244,118,204,89,72,237,212,217,131,232,238,160,
-    158,24,68,119,207,103,144,238,123,158,69,186,223,181,190,12,50,46,47,15,
-    93,241,187,18,235,204,32,249,63,196,57,205,84,77,107,140,155,193,116,95,
-    50,27,233,158,110,156,12,246,236,31,250,117,48,221,143,59,39,14,86,135,
-    205,156,30,204,210,123,198,229,224,248,77,134,241,49,152,254,122,219,89,
-    28,247,249,184,97,18,242,113,187,115,221,96,62,46,80,167,12,230,227,215,
-    129,198,134,120,223,247,197,24,255,234,185,33,226,109,116,254,31,18,223,
-    87,142,64,249,170,170,70,113,223,86,199,13,145,175,47,212,207,67,196,235,
-    88,137,226,140,14,138,243,207,145,24,127,167,84,143,15,17,231,52,231,249,
-    33,226,172,142,118,228,171,99,92,203,87,31,117,250,16,249,106,26,113,229,
-    233,117,231,249,33,242,244,127,206,243,67,228,233,252,214,40,63,95,168,
-    19,135,200,207,227,67,81,126,62,142,56,250,119,119,251,201,80,186,103,
-    217,55,134,210,189,255,117,72,247,13,198,207,80,186,151,92,133,116,47,
-    180,223,12,141,253,223,57,221,82,147,166,47,66,207,175,13,122,190,237,
-    101,104,29,156,151,51,75,175,230,44,74,47,57,71,15,243,254,230,171,49,
-    206,59,241,60,223,109,237,143,251,122,127,247,147,11,201,146,149,126,85,
-    223,58,26,165,91,213,13,195,221,159,166,14,24,174,221,65,99,145,142,219,
-    36,119,184,118,254,103,29,31,174,157,141,54,201,225,218,249,151,117,116,
-    120,236,19,214,177,225,244,181,141,107,227,166,215,118,94,219,37,152,109,
-    251,206,76,251,229,198,76,85,212,157,45,81,251,247,239,142,49,30,226,111,
-    63,218,255,52,62,215,126,141,92,87,105,191,240,98,33,85,121,247,174,13,
-    184,195,182,191,5,84,233,159,123,253,191,170,97,33,253,80,28,52,255,244,
-    81,149,127,159,201,113,149,119,95,139,235,56,151,25,143,85,250,103,142,
-    190,138,191,5,238,251,178,107,253,99,88,165,42,253,179,42,226,249,247,
-    176,115,64,149,126,250,209,57,162,74,27,11,227,90,63,125,232,217,42,253,
-    212,184,189,26,144,254,143,205,195,234,200,155,243,102,53,253,47,139,81,
-    77,127,156,237,170,227,251,112,239,86,199,239,162,182,115,13,127,213,124,
-    156,108,191,171,166,125,79,126,170,105,111,25,215,180,175,139,107,121,
-    59,36,158,163,249,85,231,135,106,250,207,17,191,90,219,245,156,35,170,
-    105,159,91,138,124,244,148,183,106,62,90,68,60,218,222,164,185,218,255,
-    123,208,88,29,231,224,230,219,126,187,245,108,220,143,243,191,123,213,
-    234,182,29,183,243,169,156,89,26,19,159,239,90,148,254,43,63,213,222,125,
-    223,60,183,165,165,137,246,227,17,252,237,99,190,143,224,239,224,184,207,
-    223,4,235,195,8,254,218,197,231,124,205,191,23,249,154,122,39,242,117,
-    146,117,102,4,95,31,254,5,227,119,107,214,151,17,241,253,164,124,141,160,
-    251,56,235,201,8,58,191,136,251,52,28,188,220,88,143,223,55,220,142,177,
-    159,95,128,234,148,135,114,102,233,166,139,81,220,19,157,63,246,23,119,
-    129,115,203,254,226,118,185,13,227,251,126,231,201,253,197,189,124,1,138,
-    123,194,173,104,63,63,55,103,150,234,222,96,239,243,252,28,243,101,164,
-    251,207,159,142,242,218,210,60,24,41,175,171,175,66,121,93,39,206,72,250,
-    106,196,25,25,121,93,140,242,154,180,59,146,222,159,175,197,248,222,210,
-    58,48,42,206,37,230,253,40,122,251,238,143,242,115,151,245,96,84,252,142,
-    43,62,167,115,147,243,227,40,245,91,195,1,193,44,221,54,22,233,221,103,
-    12,198,223,81,227,61,122,231,91,39,70,233,255,121,39,21,210,104,237,238,
-    16,204,172,157,57,179,212,255,0,212,254,40,251,201,104,237,239,175,62,
-    26,173,253,97,115,144,175,206,234,225,209,177,127,219,135,70,219,175,231,
-    231,204,210,247,103,97,180,127,17,242,253,93,206,44,45,152,137,250,229,
-    143,233,168,95,166,169,179,70,199,249,33,167,125,211,126,51,218,249,225,
-    230,156,89,250,49,226,200,207,147,115,81,126,214,205,67,181,212,219,57,
-    179,244,104,188,215,52,254,238,136,242,244,98,220,215,175,23,171,227,71,
-    27,91,63,135,15,251,242,214,156,234,254,249,193,162,180,82,93,63,58,254,
-    62,114,54,26,119,167,171,107,148,60,233,83,135,166,26,254,55,231,204,210,
-    80,231,162,26,190,63,176,56,214,240,253,157,69,175,70,94,59,237,27,116,
-    94,49,88,107,248,127,91,221,86,35,175,109,213,107,53,234,226,173,57,179,
-    180,88,29,87,35,191,247,88,191,106,248,158,16,239,219,175,79,200,153,165,
-    157,212,117,177,198,92,24,241,140,135,215,213,119,53,252,174,113,126,170,
-    225,119,183,96,147,216,79,144,207,19,21,17,53,124,174,27,131,124,174,138,
-    247,141,139,198,65,126,38,57,4,213,56,251,45,206,169,253,242,66,242,104,
-    122,40,24,251,145,67,247,24,253,249,83,39,228,171,183,115,213,24,190,230,
-    78,69,253,121,140,126,30,195,79,83,249,31,163,63,119,205,153,165,125,172,
-    183,99,244,231,37,221,48,126,31,17,237,241,243,106,92,235,199,203,13,202,
-    49,177,255,201,195,24,62,218,243,61,134,143,191,203,223,24,62,14,138,56,
-    124,84,168,23,199,240,81,220,1,213,254,237,67,135,115,95,143,206,193,162,
-    116,97,206,58,233,162,156,117,83,113,196,109,86,47,141,201,89,63,245,137,
-    184,205,26,164,221,34,110,252,125,69,126,98,13,25,22,159,203,195,127,131,
-    242,80,28,241,244,235,23,206,229,82,159,190,177,207,140,141,239,25,157,
-    191,199,242,191,52,174,249,255,214,249,125,44,255,83,212,3,164,167,251,
-    213,1,227,60,55,72,157,55,206,115,227,205,151,113,81,183,218,191,198,197,
-    239,106,206,192,248,253,151,122,113,92,253,248,59,0,198,239,17,213,129,
-    227,228,103,133,250,98,156,252,124,161,222,24,39,63,79,170,19,198,201,
-    207,254,230,223,56,249,57,86,125,57,78,126,90,170,11,199,201,203,242,90,
-    49,98,189,83,47,142,23,247,27,241,198,139,251,185,231,199,199,223,101,
-    198,163,184,181,158,31,47,238,94,195,81,220,171,227,190,254,185,37,103,
-    150,94,162,123,188,248,55,142,67,241,203,204,239,241,226,95,101,61,24,
-    47,254,255,197,181,248,111,13,66,241,91,5,245,207,127,227,121,58,90,132,
-    14,253,179,108,34,58,187,172,204,153,165,211,232,31,111,188,125,30,207,
-    201,119,203,208,37,223,27,131,242,93,119,20,202,119,243,208,45,223,189,
-    205,111,93,159,54,170,67,39,168,3,54,231,204,210,110,230,251,4,62,94,140,
-    207,249,40,53,31,39,240,49,233,84,140,186,94,61,59,129,238,15,140,183,
-    9,116,175,85,15,76,160,123,209,25,72,119,119,117,242,4,186,79,49,207,39,
-    208,217,211,121,81,137,156,86,197,159,124,204,215,71,115,102,249,111,66,
-    106,179,162,180,143,125,177,86,30,127,121,16,229,177,231,70,172,187,173,
-    214,171,245,239,104,251,77,109,252,94,38,158,215,127,87,241,86,171,141,
-    6,188,212,198,239,74,228,166,214,190,254,124,73,48,75,27,237,55,181,116,
-    28,231,157,90,58,230,70,59,37,219,126,67,92,75,207,116,251,228,196,248,
-    126,179,3,234,199,21,234,172,137,226,95,21,20,127,150,125,123,162,248,
-    247,216,215,39,202,219,76,235,201,36,207,47,48,31,39,197,247,161,101,232,
-    249,238,234,153,73,158,191,206,248,159,228,249,110,214,165,73,98,117,83,
-    196,78,82,159,30,102,254,79,162,183,110,220,167,247,150,120,159,222,166,
-    246,179,201,218,219,235,86,140,223,69,60,128,218,251,222,254,57,89,123,
-    127,191,188,144,255,54,250,248,135,208,250,117,241,74,228,101,165,243,
-    237,100,237,213,198,251,218,59,120,21,106,111,104,188,167,31,22,94,129,
-    250,161,161,122,48,126,235,212,238,118,228,127,228,50,148,163,113,242,
-    59,89,30,214,235,143,201,242,208,76,158,38,155,223,183,168,231,39,155,
-    223,163,31,11,102,105,90,196,147,227,178,117,104,252,252,39,40,15,247,
-    4,213,3,211,214,7,179,116,127,206,162,212,92,61,50,217,58,246,85,206,44,
-    61,243,191,252,171,241,116,243,199,200,223,207,91,144,191,19,127,193,248,
-    221,205,111,200,223,75,198,194,20,249,250,248,75,215,241,189,223,239,200,
-    95,212,128,83,248,171,112,38,156,194,223,100,123,200,20,254,118,105,129,
-    252,149,125,228,57,254,190,255,39,198,247,6,159,33,127,255,248,20,249,
-    107,240,3,242,55,241,15,140,253,198,216,152,98,94,156,17,237,240,117,232,
-    206,200,87,215,208,197,215,14,161,203,88,122,229,67,52,47,154,220,164,
-    70,81,79,220,126,15,210,59,127,37,198,111,205,30,64,58,126,125,13,233,
-    232,120,55,138,123,193,83,168,189,254,171,81,59,255,15,104,239,202,179,
+static const entry_t ENTRIES[1531] = {
+    {88,70,19,0}, {122,57,8,0}, {183,3,6,0}, {677,2,1,0}, {746,16,2,0},
+    {761,3,10,1}, {765,70,5,0}, {814,57,3,3}, {930,3,10,2}, {950,3,8,0},
+    {1067,62,3,0}, {1168,62,22,0}, {1366,2,8,0}, {1473,2,18,0}, {1562,6,9,0},
+    {1599,83,6,0}, {1647,83,16,0}, {1686,2,17,0}, {1708,3,9,0},
+    {1902,83,14,0}, {2021,45,2,0}, {2072,70,10,0}, {2081,70,1,0},
+    {2210,3,7,0}, {2472,70,11,1}, {2484,83,2,1}, {2487,83,2,2},
+    {2505,16,11,0}, {2578,83,2,3}, {2599,16,10,0}, {2629,83,8,0},
+    {2802,70,11,2}, {2912,2,16,0}, {2920,16,6,0}, {3031,2,5,0}, {3092,2,4,0},
+    {3179,16,1,0}, {3245,70,12,0}, {3277,70,14,0}, {3300,16,14,0},
+    {3330,83,17,0}, {3356,3,11,1}, {3405,70,7,0}, {3414,16,16,0},
+    {3419,6,2,0}, {3455,6,21,1}, {3456,3,11,2}, {3504,16,15,0}, {3693,2,6,0},
+    {3781,45,11,0}, {3786,71,4,0}, {3801,16,13,0}, {3821,16,7,0},
+    {3881,2,13,0}, {3909,6,21,2}, {3949,70,17,0}, {4084,83,11,1},
+    {4292,16,20,1}, {4293,83,11,2}, {4371,6,21,3}, {4422,16,20,2},
+    {4427,16,3,0}, {4436,2,12,0}, {4463,2,7,0}, {4577,3,1,0}, {4587,6,21,4},
+    {4770,3,14,0}, {4829,70,24,0}, {4843,18,20,0}, {4852,3,18,0},
+    {4889,71,18,0}, {4906,71,5,0}, {5131,71,23,1}, {5132,71,23,1},
+    {5165,70,2,0}, {5268,83,9,0}, {5300,70,20,0}, {5310,71,23,2},
+    {5336,16,12,0}, {5348,70,6,0}, {5364,6,7,0}, {5434,2,21,0}, {5447,2,2,0},
+    {5454,71,23,3}, {5542,16,8,0}, {5571,71,22,0}, {5586,71,19,0},
+    {5737,71,6,0}, {5742,71,21,0}, {5743,71,6,0}, {5862,70,13,0},
+    {5896,83,10,0}, {6193,71,20,0}, {6242,16,21,0}, {6411,2,14,0},
+    {6537,6,8,0}, {6686,16,4,0}, {6692,16,23,0}, {6706,71,17,0},
+    {6813,2,24,0}, {6867,70,3,0}, {7007,71,12,0}, {7083,70,4,0},
+    {7097,71,7,0}, {7294,16,22,0}, {7463,3,19,0}, {7513,2,20,0},
+    {7535,71,16,0}, {7588,34,1,0}, {7719,2,22,0}, {7818,2,19,0},
+    {7879,45,19,1}, {7884,71,13,0}, {7955,3,16,0}, {8068,64,21,0},
+    {8102,6,19,0}, {8198,71,15,0}, {8209,3,5,0}, {8366,45,19,2},
+    {8497,6,22,0}, {8645,6,6,0}, {8751,45,7,1}, {8796,84,1,0}, {8832,7,3,1},
+    {8833,71,14,0}, {8837,70,23,0}, {8882,70,21,0}, {8886,16,5,0},
+    {8903,7,2,0}, {8928,45,7,2}, {8991,45,18,0}, {9007,34,22,0},
+    {9009,16,24,0}, {9110,7,9,0}, {9153,7,11,0}, {9236,45,1,0}, {9347,6,20,0},
+    {9383,84,22,0}, {9440,36,16,0}, {9459,70,22,0}, {9487,71,1,0},
+    {9570,84,5,0}, {9640,2,3,1}, {9677,36,13,0}, {9836,7,10,0}, {9884,7,1,0},
+    {10064,84,2,0}, {10306,7,7,0}, {10320,36,12,0}, {10324,6,14,1},
+    {10418,45,16,1}, {10513,45,16,2}, {10602,34,21,0}, {10644,84,4,0},
+    {10670,84,3,0}, {10729,64,22,0}, {10732,7,8,0}, {10826,6,15,0},
+    {11001,45,4,0}, {11072,36,10,0}, {11095,45,10,0}, {11249,7,14,0},
+    {11258,43,11,0}, {11345,6,17,0}, {11407,34,10,0}, {11477,36,21,0},
+    {11484,6,14,2}, {11569,16,9,0}, {11757,45,12,0}, {11767,69,1,0},
+    {11783,6,18,0}, {11867,36,11,1}, {11918,36,24,0}, {12093,6,13,0},
+    {12122,36,9,1}, {12186,36,11,2}, {12225,43,7,0}, {12288,36,9,2},
+    {12332,7,13,0}, {12387,6,4,0}, {12390,6,5,0}, {12394,45,5,0},
+    {12484,43,6,0}, {12486,34,9,0}, {12640,7,12,0}, {12653,43,9,0},
+    {12706,6,3,0}, {12770,6,16,0}, {12777,64,8,0}, {12803,7,15,0},
+    {12828,6,12,0}, {12843,34,19,1}, {12871,43,3,0}, {12876,45,6,0},
+    {13040,36,7,1}, {13141,43,13,0}, {13147,36,2,0}, {13165,7,16,0},
+    {13197,36,3,1}, {13202,36,3,2}, {13225,36,7,2}, {13244,45,13,0},
+    {13265,36,7,3}, {13268,64,7,0}, {13288,34,19,2}, {13327,7,18,0},
+    {13473,36,23,0}, {13531,64,19,0}, {13579,7,17,1}, {13701,34,7,0},
+    {13702,7,17,0}, {13847,34,8,1}, {13879,64,16,0}, {13884,43,2,0},
+    {13914,7,5,0}, {13942,36,6,0}, {13954,6,11,0}, {14060,34,17,1},
+    {14086,36,5,0}, {14131,45,8,0}, {14135,6,1,0}, {14146,34,19,3},
+    {14168,34,17,2}, {14240,43,12,0}, {14293,34,17,3}, {14328,64,3,0},
+    {14354,64,17,0}, {14576,64,2,0}, {14632,64,9,0}, {14668,64,10,0},
+    {14817,64,24,0}, {14838,7,4,0}, {14879,36,1,0}, {15110,7,6,0},
+    {15197,34,6,0}, {15201,45,9,0}, {15330,75,6,1}, {15371,75,6,2},
+    {15457,6,10,0}, {15474,34,19,4}, {15627,7,19,0}, {15863,64,1,0},
+    {15900,81,15,0}, {15987,36,22,1}, {16083,81,14,0}, {16112,36,22,2},
+    {16156,36,22,3}, {16245,75,10,0}, {16335,64,18,0}, {16537,34,5,0},
+    {16611,34,19,5}, {16826,64,23,0}, {17007,36,19,0}, {17304,36,4,0},
+    {17358,64,4,0}, {17378,34,4,0}, {17440,75,2,0}, {17448,64,15,0},
+    {17529,64,13,0}, {17593,34,16,0}, {17618,36,18,0}, {17651,34,19,6},
+    {17678,45,3,0}, {17702,81,7,0}, {17717,34,19,7}, {17738,36,17,0},
+    {17959,38,3,0}, {18216,34,19,8}, {18246,64,6,0}, {18532,64,5,0},
+    {18543,34,3,0}, {18597,75,4,0}, {18614,64,14,0}, {18673,34,19,9},
+    {18724,81,11,0}, {18744,75,3,0}, {18772,75,9,0}, {18907,81,13,0},
+    {19167,64,11,0}, {19205,81,23,0}, {19515,43,4,0}, {19587,34,15,1},
+    {19747,43,1,0}, {19780,75,1,0}, {19812,64,12,0}, {19849,34,15,2},
+    {19860,81,12,0}, {19893,31,3,0}, {19921,75,5,0}, {19990,81,24,0},
+    {20020,75,8,0}, {20042,34,20,4}, {20049,80,4,0}, {20205,81,3,0},
+    {20250,81,21,0}, {20297,80,13,0}, {20384,75,7,0}, {20430,81,22,0},
+    {20455,81,4,0}, {20507,34,14,0}, {20635,81,10,0}, {20711,81,20,0},
+    {20732,81,16,0}, {20885,81,8,1}, {20889,81,5,0}, {20894,81,8,2},
+    {21060,11,4,0}, {21248,34,20,1}, {21273,81,17,0}, {21281,31,1,0},
+    {21393,34,20,2}, {21421,81,1,0}, {21444,34,13,0}, {21673,81,18,1},
+    {21683,81,18,2}, {21770,11,1,0}, {21861,11,2,0}, {21881,81,19,0},
+    {21914,63,11,0}, {21949,80,12,0}, {21998,11,11,0}, {22040,31,10,0},
+    {22109,34,12,0}, {22280,11,6,0}, {22449,60,16,3}, {22488,11,13,0},
+    {22509,60,16,2}, {22531,63,9,0}, {22534,63,9,0}, {22549,60,16,4},
+    {22667,60,15,1}, {22701,34,24,0}, {22783,38,1,0}, {22797,60,16,5},
+    {22845,60,16,1}, {22871,80,7,0}, {22957,60,15,2}, {23015,21,9,0},
+    {23123,60,16,6}, {23148,80,14,0}, {23364,34,23,0}, {23416,21,5,0},
+    {23453,21,6,0}, {23467,80,2,0}, {23482,63,7,1}, {23497,81,9,0},
+    {23522,38,2,0}, {23595,11,3,0}, {23596,11,3,0}, {23649,63,7,2},
+    {23685,49,5,0}, {23693,31,6,0}, {23767,21,7,0}, {23875,34,2,0},
+    {23972,34,11,0}, {24244,49,9,0}, {24305,49,12,0}, {24327,49,10,0},
+    {24331,60,17,0}, {24340,21,12,0}, {24372,31,8,0}, {24436,60,2,0},
+    {24608,21,1,0}, {24659,22,15,0}, {24674,60,19,0}, {24813,21,11,0},
+    {24829,63,6,0}, {24845,49,11,0}, {24873,49,13,0}, {25048,21,17,0},
+    {25098,63,10,0}, {25281,60,7,0}, {25292,21,18,0}, {25303,63,8,0},
+    {25336,60,3,0}, {25428,81,2,0}, {25429,31,11,0}, {25473,60,23,0},
+    {25541,21,21,0}, {25606,49,2,0}, {25859,22,5,0}, {25918,80,3,0},
+    {25923,60,20,0}, {25930,60,4,0}, {25984,21,22,0}, {25985,49,1,0},
+    {26069,31,2,0}, {26176,60,21,1}, {26207,60,11,0}, {26220,60,8,1},
+    {26221,60,8,1}, {26224,60,8,1}, {26235,60,8,2}, {26241,60,9,0},
+    {26264,80,9,0}, {26311,60,5,0}, {26366,60,21,2}, {26394,80,16,0},
+    {26412,22,13,1}, {26451,81,6,0}, {26460,22,13,2}, {26549,60,18,0},
+    {26594,60,24,0}, {26634,22,1,0}, {26727,60,6,0}, {27072,49,3,0},
+    {27100,31,4,0}, {27196,21,15,0}, {27204,22,12,0}, {27288,49,6,0},
+    {27321,63,2,0}, {27366,60,10,0}, {27369,80,11,0}, {27483,21,19,0},
+    {27530,63,3,0}, {27534,31,5,0}, {27566,80,10,0}, {27628,22,2,0},
+    {27639,21,20,0}, {27654,49,4,0}, {27673,21,13,0}, {27810,22,11,0},
+    {27913,60,22,1}, {27949,21,14,0}, {27989,60,1,0}, {28010,22,14,0},
+    {28098,22,18,0}, {28103,49,7,0}, {28199,22,3,0}, {28328,22,7,0},
+    {28358,21,4,0}, {28360,21,2,0}, {28380,21,8,0}, {28404,21,16,0},
+    {28614,60,12,0}, {28716,60,22,2}, {28909,31,7,1}, {28910,49,8,0},
+    {28957,22,16,1}, {29034,22,8,0}, {29038,60,13,0}, {29064,22,16,2},
+    {29134,31,13,0}, {29271,80,1,0}, {29276,63,4,0}, {29353,31,7,2},
+    {29426,60,14,0}, {29651,48,3,0}, {29655,37,7,0}, {29696,21,10,0},
+    {29807,22,10,0}, {30122,39,6,0}, {30277,22,4,0}, {30321,31,16,1},
+    {30324,39,2,0}, {30342,63,13,0}, {30343,37,12,0}, {30419,48,5,0},
+    {30422,48,5,0}, {30438,15,1,0}, {30520,21,23,1}, {30565,31,16,2},
+    {30788,39,11,0}, {30867,48,2,0}, {30883,37,13,0}, {31125,39,14,1},
+    {31137,63,12,0}, {31416,39,14,2}, {31564,39,13,1}, {31592,39,13,2},
+    {31681,37,3,0}, {31685,74,13,0}, {31700,39,13,3}, {31789,21,23,3},
+    {31832,21,23,2}, {31897,80,6,0}, {32173,21,23,4}, {32246,37,5,0},
+    {32349,39,1,0}, {32362,37,14,0}, {32480,21,23,5}, {32562,21,23,6},
+    {32607,63,1,0}, {32759,39,10,0}, {32768,74,19,0}, {32844,21,23,7},
+    {32912,73,9,0}, {33018,37,8,0}, {33133,21,23,8}, {33152,39,15,1},
+    {33160,39,8,0}, {33302,39,16,0}, {33345,39,12,0}, {33347,39,9,0},
+    {33377,21,23,9}, {33384,80,8,0}, {33579,39,5,0}, {33856,39,18,0},
+    {33927,37,24,0}, {33977,39,15,2}, {34045,39,3,0}, {34088,37,6,0},
+    {34444,39,4,0}, {34473,73,3,1}, {34481,73,3,2}, {34693,37,19,0},
+    {34769,48,4,0}, {35037,39,24,0}, {35228,73,4,0}, {35264,74,16,0},
+    {35350,37,11,0}, {35415,39,19,0}, {35550,37,4,0}, {35904,39,7,0},
+    {36039,80,5,0}, {36041,66,5,0}, {36046,37,9,0}, {36188,66,2,0},
+    {36265,66,7,0}, {36284,66,3,0}, {36366,37,17,0}, {36377,74,18,0},
+    {36641,66,4,1}, {36723,66,4,2}, {36812,66,4,3}, {36850,37,1,0},
+    {36962,37,20,0}, {37229,74,10,1}, {37265,37,15,0}, {37279,66,1,0},
+    {37447,48,1,0}, {37504,73,6,0}, {37629,37,18,0}, {37740,37,10,0},
+    {37826,37,2,0}, {38016,37,16,0}, {38070,74,15,0}, {38170,74,14,0},
+    {38373,66,6,0}, {38538,37,21,0}, {38827,15,22,0}, {38901,74,22,0},
+    {39191,13,24,0}, {39424,37,22,0}, {39429,74,6,0}, {39757,74,17,0},
+    {39780,13,12,0}, {39794,73,5,0}, {39863,48,6,0}, {39953,88,3,2},
+    {40007,13,23,1}, {40023,13,23,0}, {40167,13,6,1}, {40167,13,6,2},
+    {40526,13,2,0}, {40702,12,1,0}, {40817,73,10,1}, {40834,73,10,2},
+    {40843,13,22,0}, {40881,13,11,0}, {40888,12,8,0}, {41003,73,7,0},
+    {41037,15,5,0}, {41312,73,2,0}, {41377,13,21,1}, {41404,13,21,2},
+    {41704,40,15,0}, {41816,13,20,1}, {41822,13,8,0}, {41909,13,7,0},
+    {41940,13,20,2}, {42313,44,4,0}, {42334,9,7,0}, {42402,44,18,0},
+    {42425,73,8,0}, {42438,40,16,1}, {42483,9,6,0}, {42515,9,2,0},
+    {42527,40,16,2}, {42536,88,15,0}, {42556,13,5,0}, {42637,12,7,0},
+    {42799,44,7,0}, {42806,13,3,0}, {42828,9,1,0}, {42911,13,4,0},
+    {42913,88,4,0}, {43100,13,9,0}, {43103,13,9,0}, {43109,44,5,0},
+    {43234,44,17,0}, {43409,9,3,0}, {43584,13,18,1}, {43587,13,17,1},
+    {43813,44,6,0}, {43825,9,4,0}, {43834,13,17,2}, {43908,57,6,0},
+    {43932,13,18,2}, {43970,13,15,1}, {44001,13,15,2}, {44066,13,1,0},
+    {44127,40,9,0}, {44154,13,18,3}, {44382,73,1,0}, {44390,40,17,0},
+    {44405,13,13,0}, {44471,40,10,0}, {44659,44,24,0}, {44798,13,10,0},
+    {44816,88,11,0}, {44818,13,19,0}, {44824,9,10,0}, {44857,40,18,1},
+    {44946,13,14,0}, {45001,9,5,0}, {45038,40,18,2}, {45075,40,19,0},
+    {45238,15,2,0}, {45336,44,8,0}, {45410,13,16,0}, {45556,15,9,0},
+    {45860,52,1,0}, {45902,9,8,0}, {45941,88,10,0}, {46026,9,11,0},
+    {46107,12,9,0}, {46146,50,10,0}, {46390,44,1,0}, {46454,50,24,0},
+    {46509,44,19,1}, {46515,54,5,0}, {46651,88,23,0}, {46657,54,6,1},
+    {46734,54,6,2}, {46750,50,11,0}, {46771,50,14,0}, {46776,44,19,2},
+    {46853,40,8,0}, {46928,12,6,0}, {47431,44,9,0}, {47452,44,10,0},
+    {47508,50,15,0}, {47723,50,23,0}, {47758,54,8,0}, {47908,50,5,0},
+    {47956,12,13,0}, {48002,15,20,0}, {48319,40,20,0}, {48356,44,20,1},
+    {48402,40,21,0}, {48437,79,3,0}, {48455,50,12,0}, {48774,88,21,0},
+    {48883,50,13,0}, {48926,54,7,0}, {49029,50,16,0}, {49065,12,12,0},
+    {49326,12,12,2}, {49402,44,20,2}, {49583,50,7,0}, {49641,79,1,0},
+    {49669,50,1,0}, {49841,44,11,0}, {50099,15,24,0}, {50335,50,6,0},
+    {50372,40,11,0}, {50414,79,5,0}, {50583,50,3,1}, {50801,40,12,0},
+    {51069,44,12,0}, {51172,54,1,0}, {51233,67,2,0}, {51362,79,4,0},
+    {51376,54,4,0}, {51437,79,2,0}, {51614,44,21,1}, {51624,50,17,0},
+    {51839,12,3,0}, {51905,44,21,2}, {52085,44,21,0}, {52419,15,8,0},
+    {52595,12,4,1}, {52633,12,4,2}, {52727,88,12,0}, {52943,44,13,0},
+    {53295,40,24,0}, {53502,54,9,0}, {53702,57,7,0}, {53740,24,1,0},
+    {53910,40,2,0}, {54061,40,1,0}, {54182,50,22,0}, {54204,44,22,1},
+    {54255,44,22,2}, {54539,40,23,0}, {54682,24,2,0}, {54742,24,23,0},
+    {54872,50,4,0}, {54879,50,8,0}, {55084,50,21,0}, {55203,40,14,0},
+    {55219,40,13,0}, {55282,24,4,0}, {55425,17,16,0}, {55434,50,18,0},
+    {55598,24,11,0}, {55642,50,9,0}, {55687,24,5,0}, {55705,24,3,0},
+    {55874,24,10,0}, {55945,50,19,0}, {56211,32,11,0}, {56243,17,15,1},
+    {56250,17,15,2}, {56343,44,14,0}, {56561,17,11,0}, {56633,24,8,0},
+    {56647,50,20,0}, {56675,12,16,0}, {56779,87,24,0}, {56802,24,9,0},
+    {56922,44,15,0}, {57283,24,6,0}, {57328,87,14,0}, {57363,56,11,0},
+    {57380,87,13,0}, {57399,40,22,0}, {57581,56,12,0}, {57632,50,2,0},
+    {57757,87,2,0}, {57936,44,2,0}, {58001,40,3,0}, {58188,24,7,0},
+    {58484,12,5,0}, {58590,87,16,0}, {58758,28,8,1}, {58867,28,8,2},
+    {58905,12,10,0}, {58948,87,15,0}, {59072,28,7,0}, {59196,17,4,0},
+    {59199,27,1,0}, {59316,27,5,0}, {59449,17,17,0}, {59747,28,4,0},
+    {59774,40,4,0}, {59803,27,3,0}, {59929,56,5,0}, {60000,12,2,0},
+    {60009,28,6,0}, {60129,87,7,0}, {60189,27,6,0}, {60260,28,5,0},
+    {60320,56,6,2}, {60329,56,6,1}, {60718,28,1,1}, {60742,19,3,0},
+    {60823,17,18,0}, {60965,27,4,0}, {61084,28,3,0}, {61174,27,7,0},
+    {61199,56,3,0}, {61281,32,10,0}, {61317,20,2,0}, {61359,27,2,0},
+    {61585,56,1,0}, {61622,17,19,0}, {61740,87,22,0}, {61932,17,3,0},
+    {61941,87,3,0}, {61960,87,17,0}, {62268,28,9,0}, {62322,56,2,0},
+    {62434,28,2,0}, {62931,28,10,0}, {62956,40,5,0}, {62985,87,23,0},
+    {63003,28,12,1}, {63005,28,12,2}, {63007,28,11,0}, {63031,57,9,0},
+    {63090,87,4,0}, {63121,20,1,1}, {63125,20,1,2}, {63608,87,5,0},
+    {63613,56,4,0}, {63724,17,14,1}, {64004,17,14,2}, {64094,56,8,0},
+    {64166,44,23,0}, {64238,87,8,0}, {64241,19,1,0}, {64394,19,2,0},
+    {64661,56,7,0}, {64852,87,18,0}, {64962,44,3,0}, {65109,17,9,0},
+    {65378,40,6,0}, {65468,56,9,1}, {65474,87,1,0}, {65628,56,9,2},
+    {66249,87,6,0}, {66657,17,5,0}, {66753,57,10,0}, {67275,10,19,0},
+    {67301,40,7,0}, {67459,10,20,0}, {67464,17,13,0}, {67472,17,12,0},
+    {67927,10,7,0}, {68002,17,6,0}, {68245,17,21,0}, {68282,17,20,1},
+    {68520,87,19,0}, {68523,17,20,2}, {68702,17,2,0}, {68756,32,1,0},
+    {68815,58,8,0}, {68862,17,22,0}, {68895,44,16,0}, {68933,17,8,0},
+    {69427,87,10,0}, {69481,10,10,1}, {69483,10,10,2}, {69673,10,1,0},
+    {69701,87,9,0}, {69713,10,9,0}, {69732,10,11,0}, {69896,58,7,0},
+    {69974,87,11,0}, {69996,51,9,0}, {70012,87,20,0}, {70090,17,23,0},
+    {70248,58,5,0}, {70497,10,8,0}, {70574,51,19,1}, {70576,51,19,2},
+    {70638,57,4,0}, {70755,87,21,0}, {71053,10,17,0}, {71075,10,3,0},
+    {71121,51,18,0}, {71284,10,18,0}, {71352,17,7,0}, {71536,51,17,0},
+    {71681,17,1,0}, {71683,17,1,0}, {71762,10,16,1}, {71795,10,6,0},
+    {71860,51,1,0}, {71908,23,1,0}, {71957,87,12,0}, {72105,10,5,0},
+    {72125,10,15,0}, {72370,58,1,0}, {72489,5,12,0}, {72603,5,1,1},
+    {72607,69,2,0}, {72622,5,1,2}, {72659,10,14,0}, {72683,51,15,0},
+    {72934,5,14,1}, {72965,23,6,0}, {73129,23,8,0}, {73133,5,14,2},
+    {73273,51,2,0}, {73334,17,10,0}, {73473,5,4,0}, {73540,57,16,1},
+    {73555,10,2,0}, {73568,10,24,0}, {73714,5,18,0}, {73745,10,23,0},
+    {73771,57,16,2}, {73776,23,7,0}, {73807,51,16,0}, {73945,5,13,0},
+    {74117,51,11,0}, {74296,57,24,0}, {74376,51,10,1}, {74380,51,10,2},
+    {74392,5,9,0}, {74395,51,6,0}, {74596,10,22,0}, {74666,10,4,0},
+    {74778,23,4,0}, {74785,5,2,0}, {74824,23,2,0}, {74837,23,5,0},
+    {74911,51,12,0}, {74946,85,3,0}, {75049,26,15,0}, {75097,69,3,0},
+    {75118,5,15,0}, {75141,51,4,0}, {75177,51,21,1}, {75181,51,13,2},
+    {75206,51,13,1}, {75264,51,5,0}, {75304,51,21,2}, {75312,26,7,0},
+    {75323,23,3,0}, {75379,5,5,0}, {75411,10,12,1}, {75415,10,12,2},
+    {75439,51,20,0}, {75458,32,9,0}, {75530,78,19,1}, {75695,26,2,0},
+    {75809,69,16,1}, {75829,69,16,1}, {75973,10,13,1}, {76008,69,8,0},
+    {76013,58,10,1}, {76041,10,13,2}, {76069,78,19,2}, {76126,5,6,0},
+    {76127,26,8,0}, {76267,26,1,0}, {76276,78,4,0}, {76297,51,3,0},
+    {76307,26,12,0}, {76333,5,3,0}, {76337,78,19,3}, {76423,78,19,4},
+    {76424,78,19,5}, {76440,85,5,0}, {76470,5,20,0}, {76534,10,21,0},
+    {76552,51,24,0}, {76600,5,19,0}, {76669,26,6,1}, {76669,26,6,2},
+    {76695,69,16,2}, {76705,51,23,1}, {76750,58,10,2}, {76810,78,19,6},
+    {76852,78,9,0}, {76866,78,22,0}, {76878,78,19,7}, {76880,5,10,0},
+    {76945,51,23,2}, {76952,26,3,0}, {76996,57,17,0}, {77048,26,16,0},
+    {77052,78,23,0}, {77055,69,6,0}, {77060,5,7,0}, {77070,78,1,0},
+    {77111,78,19,8}, {77233,78,2,0}, {77257,78,11,0}, {77336,78,20,0},
+    {77450,78,10,0}, {77512,26,4,0}, {77516,78,12,0}, {77578,78,24,0},
+    {77622,78,5,0}, {77634,51,22,0}, {77655,26,10,0}, {77661,78,17,0},
+    {77760,42,22,0}, {77811,5,11,0}, {77853,5,8,0}, {77952,85,2,0},
+    {77982,85,10,0}, {78012,26,11,0}, {78072,78,3,0}, {78104,77,17,0},
+    {78105,51,14,1}, {78106,51,14,2}, {78132,78,21,0}, {78159,26,5,0},
+    {78265,77,16,0}, {78384,51,7,0}, {78401,77,4,0}, {78459,26,17,0},
+    {78493,26,9,0}, {78527,32,8,0}, {78554,78,16,0}, {78592,42,20,0},
+    {78639,33,7,0}, {78662,33,9,1}, {78727,77,14,0}, {78820,77,2,1},
+    {78821,77,2,2}, {78914,33,4,0}, {78918,51,8,0}, {78933,77,24,1},
+    {78990,77,24,2}, {79043,42,10,0}, {79045,42,10,0}, {79101,42,21,0},
+    {79119,26,19,0}, {79153,33,9,2}, {79374,77,13,0}, {79375,77,23,0},
+    {79497,33,6,0}, {79509,33,10,0}, {79540,77,22,0}, {79593,59,4,0},
+    {79607,26,18,0}, {79653,33,8,0}, {79664,85,4,0}, {79757,26,20,0},
+    {79790,33,3,1}, {79822,69,7,0}, {79882,59,5,0}, {79963,33,11,0},
+    {79992,42,19,0}, {80000,33,3,2}, {80047,58,4,1}, {80057,58,4,2},
+    {80079,77,15,0}, {80112,77,18,0}, {80170,42,3,0}, {80179,78,18,0},
+    {80181,26,14,0}, {80197,26,13,1}, {80214,26,13,2}, {80331,32,7,0},
+    {80343,59,23,0}, {80463,42,24,0}, {80473,59,17,0}, {80569,59,22,0},
+    {80582,33,5,0}, {80628,59,20,0}, {80645,85,9,0}, {80686,85,6,0},
+    {80763,77,1,0}, {80816,42,2,0}, {80883,59,11,0}, {80894,59,21,0},
+    {80975,59,24,0}, {81065,58,3,0}, {81122,33,12,0}, {81126,42,18,0},
+    {81252,85,8,0}, {81266,77,19,0}, {81377,59,6,0}, {81693,42,6,0},
+    {81710,85,7,1}, {81833,42,7,0}, {81852,58,2,0}, {82080,69,5,0},
+    {82273,85,1,0}, {82363,4,7,0}, {82396,77,5,0}, {82514,77,12,1},
+    {82545,77,12,2}, {82671,77,6,1}, {82673,59,9,0}, {82729,77,6,2},
+    {83000,59,10,0}, {83081,4,6,0}, {83153,4,5,1}, {83207,42,5,0},
+    {83431,4,5,2}, {83608,32,12,0}, {83895,32,6,0}, {84012,59,7,0},
+    {84143,77,7,0}, {84345,42,1,1}, {84379,42,4,0}, {84380,42,16,0},
+    {84535,69,11,0}, {84625,59,15,0}, {84626,59,15,0}, {84880,78,13,0},
+    {84893,59,14,0}, {84969,58,6,0}, {84970,59,8,0}, {84979,58,9,0},
+    {85079,4,9,0}, {85112,42,17,0}, {85258,4,2,0}, {85267,4,3,0},
+    {85312,4,10,0}, {85355,59,18,0}, {85670,32,2,0}, {85693,42,11,0},
+    {85696,77,20,0}, {85727,4,4,0}, {85792,4,1,0}, {85819,32,13,1},
+    {85822,69,4,0}, {85829,32,13,2}, {85927,77,11,0}, {86032,59,1,0},
+    {86092,4,18,0}, {86201,32,24,0}, {86228,77,8,0}, {86263,78,14,0},
+    {86284,59,12,0}, {86305,4,16,0}, {86414,42,9,0}, {86486,4,11,0},
+    {86565,78,15,0}, {86614,32,23,0}, {86620,32,23,0}, {86670,77,10,0},
+    {86742,59,2,0}, {86796,4,12,0}, {86929,61,7,0}, {86974,42,12,0},
+    {87073,77,9,1}, {87108,59,3,0}, {87294,77,9,2}, {87314,4,20,1},
+    {87379,4,20,2}, {87585,32,14,0}, {87808,42,8,0}, {87833,32,3,0},
+    {87933,42,14,0}, {87998,42,13,0}, {88048,59,13,0}, {88175,78,6,0},
+    {88404,59,19,0}, {88635,76,3,0}, {88714,4,8,0}, {88794,42,15,0},
+    {88866,61,16,0}, {89042,61,9,0}, {89112,82,5,0}, {89341,76,12,0},
+    {89642,76,7,0}, {89826,53,10,0}, {89908,32,21,0}, {89931,76,4,0},
+    {89937,32,22,0}, {89962,78,7,0}, {90098,61,14,0}, {90133,57,21,0},
+    {90135,8,6,0}, {90185,76,5,0}, {90191,53,12,0}, {90422,82,1,0},
+    {90496,76,11,0}, {90568,82,6,0}, {90595,8,3,0}, {90797,61,13,0},
+    {90830,82,4,1}, {90853,82,4,2}, {90968,25,10,2}, {90969,25,10,1},
+    {90982,25,8,0}, {91117,8,1,0}, {91262,53,1,0}, {91726,8,4,0},
+    {91792,61,6,0}, {91845,8,5,0}, {91875,25,11,0}, {91919,53,5,1},
+    {91926,53,5,2}, {91971,53,6,1}, {91973,53,6,2}, {92041,76,21,0},
+    {92175,8,2,0}, {92226,25,12,0}, {92294,61,8,0}, {92308,25,7,1},
+    {92382,25,7,2}, {92398,53,13,1}, {92405,53,13,0}, {92420,53,2,0},
+    {92512,32,15,0}, {92609,61,11,0}, {92646,82,10,0}, {92728,53,4,1},
+    {92761,76,13,1}, {92782,32,20,0}, {92791,53,4,2}, {92824,57,22,0},
+    {92845,76,13,2}, {92855,76,18,0}, {92946,78,8,1}, {92951,78,8,2},
+    {93015,61,10,0}, {93026,8,7,0}, {93057,76,14,1}, {93085,76,14,2},
+    {93148,82,11,0}, {93163,61,24,0}, {93174,25,5,0}, {93194,53,3,0},
+    {93244,1,5,0}, {93279,53,11,0}, {93506,76,6,0}, {93542,25,6,0},
+    {93683,76,15,0}, {93747,1,6,0}, {93805,1,11,0}, {93815,82,17,0},
+    {93825,25,3,0}, {93864,76,19,0}, {93903,53,9,0}, {94005,25,4,0},
+    {94114,25,1,0}, {94141,76,16,0}, {94160,25,2,0}, {94376,32,4,0},
+    {94481,53,7,0}, {94643,76,23,0}, {94648,32,19,0}, {94713,53,8,0},
+    {94724,61,19,0}, {94779,29,10,0}, {94834,1,24,1}, {95002,1,24,2},
+    {95081,32,16,0}, {95168,76,17,1}, {95176,76,20,0}, {95188,76,17,2},
+    {95241,76,2,1}, {95261,82,7,0}, {95294,76,2,2}, {95347,76,1,0},
+    {95477,76,22,1}, {95486,76,22,2}, {95501,1,4,0}, {95503,76,22,3},
+    {95585,1,13,0}, {95771,68,1,0}, {95853,29,9,0}, {95932,82,12,0},
+    {95947,29,2,1}, {95951,29,2,2}, {96100,32,18,0}, {96229,1,12,0},
+    {96341,82,9,0}, {96441,29,8,0}, {96468,1,9,0}, {96483,1,10,0},
+    {96516,35,5,0}, {96665,1,18,0}, {96683,29,21,0}, {96757,35,1,0},
+    {96837,35,2,0}, {96957,1,22,0}, {97139,1,23,0}, {97165,29,4,0},
+    {97229,1,20,0}, {97278,1,3,0}, {97365,35,4,0}, {97421,82,13,0},
+    {97433,32,5,0}, {97473,1,16,0}, {97496,35,6,0}, {97629,29,22,0},
+    {97649,1,1,0}, {97675,1,15,0}, {97804,1,7,0}, {97938,1,14,0},
+    {98032,76,9,0}, {98036,1,2,0}, {98055,29,23,0}, {98066,76,24,0},
+    {98103,1,21,0}, {98110,29,7,0}, {98337,35,3,0}, {98412,76,8,1},
+    {98421,76,8,2}, {98478,61,12,1}, {98495,61,5,0}, {98624,61,12,2},
+    {98702,32,17,0}, {98823,1,19,0}, {98920,35,7,0}, {99120,82,14,0},
+    {99240,61,4,0}, {99255,18,10,0}, {99352,35,8,0}, {99473,1,8,0},
+    {99529,14,14,1}, {99572,14,14,0}, {99675,29,15,1}, {99742,1,17,0},
+    {99848,29,15,2}, {100027,14,1,1}, {100064,14,1,2}, {100195,14,18,0},
+    {100310,14,13,0}, {100325,14,2,2}, {100345,14,2,0}, {100453,29,3,0},
+    {100469,76,10,1}, {100591,76,10,2}, {100751,61,1,0}, {100881,14,16,0},
+    {101027,14,17,0}, {101093,18,8,0}, {101120,14,15,0}, {101123,14,15,0},
+    {101138,29,24,1}, {101243,29,24,2}, {101421,30,5,0}, {101477,55,13,0},
+    {101483,30,7,0}, {101589,30,6,0}, {101612,61,21,1}, {101751,14,19,1},
+    {101769,30,2,0}, {101772,46,1,0}, {101773,61,17,0}, {101800,30,9,0},
+    {101882,30,8,0}, {101916,30,10,0}, {101923,14,19,0}, {101958,30,1,0},
+    {101983,61,21,2}, {101984,14,20,0}, {102098,29,1,0}, {102125,57,12,2},
+    {102157,61,20,0}, {102162,57,12,1}, {102281,30,4,0}, {102333,46,7,0},
+    {102395,61,2,0}, {102422,18,7,0}, {102431,18,20,1}, {102485,14,23,0},
+    {102488,29,5,0}, {102531,30,3,1}, {102532,30,3,2}, {102589,29,11,0},
+    {102618,86,5,0}, {102693,55,9,0}, {102773,61,18,0}, {102790,46,6,0},
+    {102831,55,1,0}, {102950,46,9,0}, {102978,14,24,0}, {102989,55,2,0},
+    {103045,86,12,0}, {103227,46,2,0}, {103413,29,13,0}, {103569,65,5,0},
+    {103738,55,3,0}, {103813,65,11,0}, {103882,55,6,0}, {104019,14,7,0},
+    {104043,57,1,0}, {104060,29,14,0}, {104085,46,12,0}, {104139,14,8,0},
+    {104148,55,4,0}, {104177,55,7,0}, {104365,14,22,0}, {104382,57,18,0},
+    {104459,86,13,0}, {104521,65,3,0}, {104732,29,6,0}, {104755,61,15,0},
+    {104858,65,4,0}, {104887,29,19,0}, {104963,14,21,0}, {104987,65,1,0},
+    {105102,29,18,0}, {105138,29,20,0}, {105140,55,5,0}, {105199,18,1,0},
+    {105319,46,8,0}, {105382,55,8,1}, {105515,14,9,0}, {105570,65,2,0},
+    {105696,55,8,2}, {105841,46,3,0}, {105858,61,3,0}, {105881,14,6,0},
+    {106032,18,2,0}, {106278,86,2,0}, {106327,41,14,0}, {106481,29,17,0},
+    {106723,14,5,0}, {106786,86,14,0}, {106985,14,3,0}, {107089,57,13,0},
+    {107136,29,16,1}, {107188,14,10,0}, {107259,18,12,0}, {107310,29,12,1},
+    {107315,62,5,0}, {107354,62,10,0}, {107380,72,9,0}, {107418,18,13,0},
+    {107517,14,11,0}, {107533,29,16,2}, {107556,14,4,0}, {107608,72,8,0},
+    {107835,46,15,0}, {107843,57,11,0}, {108036,14,12,0}, {108085,41,3,0},
+    {108281,46,16,0}, {108431,46,4,0}, {108478,46,10,0}, {108661,72,7,0},
+    {108870,46,5,0}, {108874,86,15,0}, {108917,18,14,0}, {109068,62,13,0},
+    {109074,86,1,0}, {109081,46,10,0}, {109111,41,11,0}, {109139,86,9,0},
+    {109176,62,9,0}, {109268,41,1,0}, {109285,72,12,0}, {109289,72,20,0},
+    {109352,62,16,1}, {109410,62,16,0}, {109422,72,19,0}, {109427,62,8,0},
+    {109492,18,6,0}, {109556,18,11,0}, {109789,72,11,0}, {109857,18,5,0},
+    {109908,41,12,1}, {109973,41,12,2}, {110003,86,8,0}, {110078,57,23,0},
+    {110130,83,1,0}, {110256,57,5,0}, {110273,86,17,0}, {110395,86,3,0},
+    {110478,41,16,1}, {110506,41,16,2}, {110538,47,2,0}, {110618,46,13,0},
+    {110672,86,16,0}, {110838,83,4,0}, {110936,41,13,0}, {110960,86,6,1},
+    {110988,18,4,0}, {110991,18,4,0}, {110997,41,4,1}, {111043,41,4,2},
+    {111056,18,17,0}, {111123,86,18,0}, {111138,72,6,0}, {111169,47,1,0},
+    {111188,72,2,0}, {111196,57,20,0}, {111310,83,13,0}, {111449,86,20,0},
+    {111497,86,7,0}, {111594,41,18,1}, {111643,41,18,2}, {111710,86,10,0},
+    {111954,72,5,0}, {112029,62,6,0}, {112051,62,15,0}, {112122,41,2,0},
+    {112158,62,7,0}, {112203,41,17,0}, {112374,41,7,0}, {112405,57,2,0},
+    {112440,62,11,0}, {112447,62,14,0}, {112542,86,19,1}, {112623,41,5,0},
+    {112716,86,19,2}, {112724,18,9,0}, {112748,62,12,0}, {112781,57,14,0},
+    {112935,62,18,0}, {112948,72,3,0}, {112961,86,11,0}, {113044,41,19,1},
+    {113136,86,4,0}, {113137,46,17,0}, {113186,62,17,0}, {113190,41,19,2},
+    {113191,41,19,2}, {113246,72,4,0}, {113307,41,19,3}, {113368,72,1,0},
+    {113638,41,6,0}, {113726,2,15,0}, {113860,72,16,0}, {113881,62,2,0},
+    {113889,71,2,0}, {113957,41,10,0}, {113963,62,1,0}, {114131,41,8,0},
+    {114132,41,20,0}, {114222,18,16,0}, {114421,41,9,0}, {114724,86,21,0},
+    {114855,86,23,1}, {114939,86,22,0}, {114971,71,3,0}, {114996,83,3,0},
+    {115033,86,23,2}, {115054,41,21,0}, {115088,18,15,0}, {115102,3,3,0},
+    {115115,86,23,3}, {115250,62,19,0}, {115623,62,20,0}, {115713,41,15,0},
+    {115738,71,10,0}, {115830,71,8,0}, {115836,57,19,0}, {116231,3,2,0},
+    {116389,70,9,0}, {116584,2,11,0}, {116631,2,9,0}, {116727,18,3,0},
+    {116737,70,8,0}, {116758,86,24,1}, {116771,71,9,0}, {116805,2,10,0},
+    {116820,3,12,0}, {116928,71,11,0}, {116971,86,24,2}, {117221,2,23,0},
+    {117301,16,19,0}, {117315,70,18,0}, {117452,3,4,0}, {117689,57,3,1},
+    {117718,62,21,0}, {117863,16,17,0}, {118114,57,3,2}, {118121,83,7,0},
+    {118131,62,23,0}, {118234,70,16,0}, {118243,16,18,0}, {118268,71,24,0},
+    {118322,83,5,0},
 };
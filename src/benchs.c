@@ -0,0 +1,360 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * Benchmarks of the core algorithms.
+ *
+ * Compile with 'make bench', then run with:
+ *
+ *   ./stellarium-web-engine --run-benchs[=filter]
+ */
+
+#include "swe.h"
+
+#if COMPILE_BENCHS
+
+#include "sgp4.h"
+#include "skybrightness.h"
+#include "zlib.h"
+
+// Stored results, so that the compiler doesn't remove the benchmarked code.
+static volatile double g_sink;
+
+// Some deterministic unit vectors.
+static void get_pos(int i, double out[3])
+{
+    double theta = (i % 997) * M_PI / 997;
+    double phi = (i % 1999) * 2 * M_PI / 1999;
+    eraS2c(phi, M_PI / 2 - theta, out);
+}
+
+static void bench_healpix_ang2pix(int n)
+{
+    int i, pix;
+    for (i = 0; i < n; i++) {
+        healpix_ang2pix(256, (i % 997) * M_PI / 997,
+                        (i % 1999) * 2 * M_PI / 1999, &pix);
+        g_sink = pix;
+    }
+}
+
+static void bench_healpix_get_boundaries(int n)
+{
+    int i;
+    double out[4][3];
+    for (i = 0; i < n; i++) {
+        healpix_get_boundaries(64, i % (12 * 64 * 64), out);
+        g_sink = out[0][0];
+    }
+}
+
+static void bench_healpix_vec2pix_n(int n)
+{
+    int i, pix[1024];
+    double (*pos)[3] = malloc(1024 * sizeof(*pos));
+    for (i = 0; i < 1024; i++) get_pos(i, pos[i]);
+    for (i = 0; i < n; i += 1024) {
+        healpix_vec2pix_n(256, min(1024, n - i), pos, pix);
+        g_sink = pix[0];
+    }
+    free(pos);
+}
+
+static void bench_healpix_query_disc(int n)
+{
+    int i, pix[256];
+    double cap[4] = {0, 0, 0, cos(5 * DD2R)};
+    for (i = 0; i < n; i++) {
+        get_pos(i, cap);
+        g_sink = healpix_query_disc(5, cap, 256, pix);
+    }
+}
+
+static void setup_core(void)
+{
+    core_init(100, 100, 1.0);
+    observer_update(core->observer, false);
+}
+
+static void bench_convert_frame(int n)
+{
+    int i;
+    double pos[3], out[3];
+    for (i = 0; i < n; i++) {
+        get_pos(i, pos);
+        convert_frame(core->observer, FRAME_ICRF, FRAME_OBSERVED, true,
+                      pos, out);
+        g_sink = out[0];
+    }
+}
+
+static void bench_convert_frame_fast_n(int n)
+{
+    int i;
+    double (*pos)[3] = malloc(1024 * sizeof(*pos));
+    for (i = 0; i < 1024; i++) get_pos(i, pos[i]);
+    for (i = 0; i < n; i += 1024) {
+        convert_frame_fast_n(core->observer, FRAME_ICRF, FRAME_VIEW,
+                             min(1024, n - i), pos, pos);
+        g_sink = pos[0][0];
+    }
+    free(pos);
+}
+
+static void bench_convert_frame_n(int n)
+{
+    int i, j;
+    double (*pos)[3] = malloc(1024 * sizeof(*pos));
+    for (i = 0; i < n; i += 1024) {
+        // The conversion is done in place, so reset the positions.
+        for (j = 0; j < 1024; j++) get_pos(j, pos[j]);
+        convert_frame_n(core->observer, FRAME_ASTROM, FRAME_VIEW, true,
+                        min(1024, n - i), pos[0], pos[0], 0);
+        g_sink = pos[0][0];
+    }
+    free(pos);
+}
+
+static void bench_project(int type, int n)
+{
+    int i;
+    projection_t proj;
+    double pos[4] = {0, 0, 0, 1}, out[4];
+    projection_init(&proj, type, 90 * DD2R, 800, 600);
+    for (i = 0; i < n; i++) {
+        get_pos(i, pos);
+        // Only use the front hemisphere.
+        pos[2] = -fabs(pos[2]);
+        project(&proj, PROJ_TO_NDC_SPACE, 4, pos, out);
+        g_sink = out[0];
+    }
+}
+
+static void bench_project_perspective(int n)
+{
+    bench_project(PROJ_PERSPECTIVE, n);
+}
+
+static void bench_project_stereographic(int n)
+{
+    bench_project(PROJ_STEREOGRAPHIC, n);
+}
+
+static void bench_project_mercator(int n)
+{
+    bench_project(PROJ_MERCATOR, n);
+}
+
+static void bench_project_hammer(int n)
+{
+    bench_project(PROJ_HAMMER, n);
+}
+
+static void bench_project_fisheye(int n)
+{
+    bench_project(PROJ_FISHEYE, n);
+}
+
+static void bench_orbit_compute_pv(int n)
+{
+    int i;
+    double pos[3], speed[3];
+    // Ceres elements.
+    for (i = 0; i < n; i++) {
+        orbit_compute_pv(0, 58000 + i * 0.1, pos, speed,
+                         58600, 10.59 * DD2R, 80.31 * DD2R, 73.60 * DD2R,
+                         2.77, 0.2141 * DD2R, 0.0760, 77.37 * DD2R, 0, 0);
+        g_sink = pos[0];
+    }
+}
+
+static void bench_mat4_mul_vec3_dir(int n)
+{
+    int i;
+    double mat[4][4], v[3];
+    mat4_set_identity(mat);
+    mat4_rx(0.3, mat, mat);
+    mat4_rz(1.2, mat, mat);
+    for (i = 0; i < n; i++) {
+        get_pos(i, v);
+        mat4_mul_vec3_dir(mat, v, v);
+        g_sink = v[0];
+    }
+}
+
+static void bench_mat4f_mul_vec3_dir(int n)
+{
+    int i;
+    double mat[4][4], v[3];
+    float matf[4][4], vf[3];
+    mat4_set_identity(mat);
+    mat4_rx(0.3, mat, mat);
+    mat4_rz(1.2, mat, mat);
+    mat4_to_float(mat, (float*)matf);
+    for (i = 0; i < n; i++) {
+        get_pos(i, v);
+        vec3_to_float(v, vf);
+        mat4f_mul_vec3_dir(matf, vf, vf);
+        g_sink = vf[0];
+    }
+}
+
+static sgp4_elsetrec_t *g_satrec = NULL;
+
+static void setup_sgp4(void)
+{
+    double startmfe, stopmfe, deltamin;
+    if (g_satrec) return;
+    g_satrec = sgp4_twoline2rv(
+        "1 25544U 98067A   19216.19673594 -.00000629  00000-0 -27822-5 0  9998",
+        "2 25544  51.6446 123.0769 0006303 213.9941 302.5470 15.51020378182708",
+        'c', 'm', 'i', &startmfe, &stopmfe, &deltamin);
+}
+
+static void bench_sgp4(int n)
+{
+    int i;
+    double r[3], v[3];
+    for (i = 0; i < n; i++) {
+        sgp4(g_satrec, 58700 + i * 0.001, r, v);
+        g_sink = r[0];
+    }
+}
+
+static void bench_l12(int n)
+{
+    int i;
+    double pv[2][3];
+    for (i = 0; i < n; i++) {
+        l12(DJM0, 58000 + i * 0.01, 1 + i % 4, pv);
+        g_sink = pv[0][0];
+    }
+}
+
+static void bench_moon_pos(int n)
+{
+    int i;
+    double lambda, beta, dist;
+    for (i = 0; i < n; i++) {
+        moon_pos(DJM0 + 58000 + i * 0.01, &lambda, &beta, &dist);
+        g_sink = lambda;
+    }
+}
+
+static void bench_find_constellation_at(int n)
+{
+    int i;
+    double pos[3];
+    char id[5];
+    for (i = 0; i < n; i++) {
+        get_pos(i, pos);
+        find_constellation_at(pos, id);
+        g_sink = id[0];
+    }
+}
+
+static skybrightness_t g_skybrightness;
+static skybrightness_table_t g_skybrightness_table;
+
+static void setup_skybrightness(void)
+{
+    skybrightness_prepare(&g_skybrightness, 2019, 6, -10, 45 * DD2R, 0,
+                          15, 40, 60 * DD2R, 100 * DD2R);
+    skybrightness_table_prepare(&g_skybrightness_table, &g_skybrightness);
+}
+
+static void bench_skybrightness_get_luminance(int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        g_sink = skybrightness_get_luminance(&g_skybrightness,
+                cos((i % 180) * DD2R), cos((i % 173) * DD2R),
+                cos((i % 90) * DD2R));
+    }
+}
+
+static void bench_skybrightness_table_get_luminance(int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        g_sink = skybrightness_table_get_luminance(&g_skybrightness_table,
+                cos((i % 180) * DD2R), cos((i % 173) * DD2R),
+                cos((i % 90) * DD2R));
+    }
+}
+
+static void bench_skybrightness_table_prepare(int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        skybrightness_table_prepare(&g_skybrightness_table, &g_skybrightness);
+        g_sink = g_skybrightness_table.sun[0][0];
+    }
+}
+
+// A compressed eph block of 64KiB.
+static uint8_t *g_eph_block = NULL;
+static int g_eph_block_size;
+
+static void setup_eph_block(void)
+{
+    int i, size = 1 << 16;
+    uint8_t *data;
+    unsigned long comp_size;
+
+    if (g_eph_block) return;
+    data = malloc(size);
+    for (i = 0; i < size; i++) data[i] = (i * 7) ^ (i >> 5);
+    comp_size = compressBound(size);
+    g_eph_block = malloc(8 + comp_size);
+    compress(g_eph_block + 8, &comp_size, data, size);
+    memcpy(g_eph_block, &size, 4);
+    memcpy(g_eph_block + 4, &(int){comp_size}, 4);
+    g_eph_block_size = 8 + comp_size;
+    free(data);
+}
+
+static void bench_eph_read_compressed_block(int n)
+{
+    int i, ofs, size;
+    void *data;
+    for (i = 0; i < n; i++) {
+        ofs = 0;
+        data = eph_read_compressed_block(g_eph_block, g_eph_block_size,
+                                         &ofs, &size);
+        g_sink = size;
+        free(data);
+    }
+}
+
+BENCH_REGISTER(NULL, bench_healpix_ang2pix)
+BENCH_REGISTER(NULL, bench_healpix_get_boundaries)
+BENCH_REGISTER(NULL, bench_healpix_vec2pix_n)
+BENCH_REGISTER(NULL, bench_healpix_query_disc)
+BENCH_REGISTER(setup_core, bench_convert_frame)
+BENCH_REGISTER(setup_core, bench_convert_frame_fast_n)
+BENCH_REGISTER(setup_core, bench_convert_frame_n)
+BENCH_REGISTER(NULL, bench_project_perspective)
+BENCH_REGISTER(NULL, bench_project_stereographic)
+BENCH_REGISTER(NULL, bench_project_mercator)
+BENCH_REGISTER(NULL, bench_project_hammer)
+BENCH_REGISTER(NULL, bench_project_fisheye)
+BENCH_REGISTER(NULL, bench_mat4_mul_vec3_dir)
+BENCH_REGISTER(NULL, bench_mat4f_mul_vec3_dir)
+BENCH_REGISTER(NULL, bench_orbit_compute_pv)
+BENCH_REGISTER(setup_sgp4, bench_sgp4)
+BENCH_REGISTER(NULL, bench_l12)
+BENCH_REGISTER(NULL, bench_moon_pos)
+BENCH_REGISTER(NULL, bench_find_constellation_at)
+BENCH_REGISTER(setup_skybrightness, bench_skybrightness_get_luminance)
+BENCH_REGISTER(setup_skybrightness, bench_skybrightness_table_get_luminance)
+BENCH_REGISTER(setup_skybrightness, bench_skybrightness_table_prepare)
+BENCH_REGISTER(setup_eph_block, bench_eph_read_compressed_block)
+
+#endif // COMPILE_BENCHS
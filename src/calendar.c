@@ -12,6 +12,16 @@
 #define DHOUR (1.0 / 24.0)
 #define DMIN  (DHOUR / 60.0)
 
+// Bounds of the adaptive time step (day).
+#define MIN_STEP DHOUR
+#define MAX_STEP 1.0
+// Fraction of an event function range an object can move over one step, so
+// that we get a few samples inside the range.
+#define STEP_FACTOR 0.25
+// Max relative motion of two objects over one step once they are close
+// enough for a two bodies event (rad).  About one hour for the Moon.
+#define PAIR_STEP (0.5 * DD2R)
+
 typedef struct cobj cobj_t;
 typedef struct event event_t;
 typedef struct event_type event_type_t;
@@ -21,6 +31,12 @@ struct cobj {
     obj_t *obj;
     double obs_z;  // Z value of observed position (if < 0 below horizon).
     double ra, de;
+    double pvo[2][4];
+    double pos[3];      // Normalized ICRF direction.
+    double step_pos[3]; // Direction at the last step.
+    double speed;       // Angular speed estimated at the last step (rad/day).
+    bool pair;          // Can be the first object of a two bodies event.
+    event_t *events;    // Events being tracked with this object first.
 };
 
 struct calendar
@@ -31,7 +47,10 @@ struct calendar
     double start;
     double end;
     double time;
-    event_t *events;
+    double last_time; // Time of the last step, NAN before the first one.
+    double sun_pos[3];
+    double sun_speed;
+    event_t *events;  // Found events, not returned yet.
     int flags;
 };
 
@@ -41,6 +60,9 @@ struct event_type
     int nb_objs;
     int flags;
     double precision;
+    // Angular distance (rad) from the event under which the function is
+    // defined, used to bound the time step from the objects speed.
+    double range;
     // Compute the value for the event.
     double (*func)(const event_type_t *type,
                    const observer_t *obs,
@@ -76,20 +98,28 @@ struct event
     int status;
 };
 
-// Newton algo.
+// Secant algo, kept inside the [x0, x1] bracket (Illinois variant), since
+// the event functions are not defined outside of it.
 // XXX: should I move this into algos ?
 static double newton(double (*f)(double x, void *user),
                      double x0, double x1, double precision, void *user)
 {
-    double f0, f1, tmp;
+    double f0, f1, x, fx;
     f0 = f(x0, user);
     f1 = f(x1, user);
     while (f1 && fabs(x1 - x0) > precision && f1 != f0) {
-        tmp = x1;
-        x1 = x1 + (x1 - x0) / (f0 / f1 - 1.0);
-        x0 = tmp;
-        f0 = f1;
-        f1 = f(x1, user);
+        x = x1 - f1 * (x1 - x0) / (f1 - f0);
+        if (!(x > min(x0, x1) && x < max(x0, x1))) x = (x0 + x1) / 2;
+        fx = f(x, user);
+        if (isnan(fx)) break;
+        if (fx * f1 < 0) {
+            x0 = x1;
+            f0 = f1;
+        } else {
+            f0 /= 2;
+        }
+        x1 = x;
+        f1 = fx;
     }
     return x1;
 }
@@ -99,25 +129,22 @@ static double conjunction_func(const event_type_t *type,
                                const cobj_t *o, const cobj_t *_)
 {
     double ohpos[3], shpos[3];
-    double pvo[2][4], olon, slon, lat;
+    double olon, slon, lat;
     double v;
     if (memcmp(o->obj->type, type->obj_type, 4) != 0) return NAN;
 
     // Compute obj and sun geocentric ecliptic longitudes.
-    obj_get_pvo(o->obj, obs, pvo);
-    mat3_mul_vec3(obs->ri2e, pvo[0], ohpos);
+    mat3_mul_vec3(obs->ri2e, o->pvo[0], ohpos);
     mat3_mul_vec3(obs->ri2e, obs->sun_pvo[0], shpos);
     eraC2s(ohpos, &olon, &lat);
     eraC2s(shpos, &slon, &lat);
 
     v = eraAnpm(olon - slon - type->target);
-    if (fabs(v) > 15.0 * DD2R) return NAN;
+    if (fabs(v) > type->range) return NAN;
     return v;
 }
 
-static double vertical_align_event_func(const event_type_t *type,
-                                        const observer_t *obs,
-                                        const cobj_t *o1, const cobj_t *o2)
+static bool vertical_align_match(const cobj_t *o1, const cobj_t *o2)
 {
     const char types[4][2][4] = {
         {"Moo", "Pla"},
@@ -125,22 +152,24 @@ static double vertical_align_event_func(const event_type_t *type,
         {"Pla", "Pla"},
         {"Pla", "*"},
     };
-    double sep, o1_pvo[2][4], o2_pvo[2][4];
     int i;
 
     // Make sure the objects are of the right types.
     if (memcmp(o1->obj->type, o2->obj->type, 4) == 0 && (o1 > o2))
-        return NAN;
+        return false;
     for (i = 0; i < ARRAY_SIZE(types); i++) {
         if (memcmp(o1->obj->type, types[i][0], 4) == 0 &&
-            memcmp(o2->obj->type, types[i][1], 4) == 0) break;
+            memcmp(o2->obj->type, types[i][1], 4) == 0) return true;
     }
-    if (i == ARRAY_SIZE(types)) return NAN;
+    return false;
+}
 
-    obj_get_pvo(o1->obj, obs, o1_pvo);
-    obj_get_pvo(o2->obj, obs, o2_pvo);
-    sep = eraSepp(o1_pvo[0], o2_pvo[0]);
-    if (sep > 5 * DD2R) return NAN;
+static double vertical_align_event_func(const event_type_t *type,
+                                        const observer_t *obs,
+                                        const cobj_t *o1, const cobj_t *o2)
+{
+    if (!vertical_align_match(o1, o2)) return NAN;
+    if (vec3_dot(o1->pos, o2->pos) < cos(type->range)) return NAN;
     return eraAnpm(o1->ra - o2->ra);
 }
 
@@ -201,6 +230,7 @@ static const event_type_t event_types[] = {
         .obj_type = "Moo",
         .target = 0,
         .precision = DMIN,
+        .range = 15 * DD2R,
         .format = moon_format,
     },
     {
@@ -210,6 +240,7 @@ static const event_type_t event_types[] = {
         .obj_type = "Moo",
         .target = 180 * DD2R,
         .precision = DMIN,
+        .range = 15 * DD2R,
         .format = moon_format,
     },
     {
@@ -219,6 +250,7 @@ static const event_type_t event_types[] = {
         .obj_type = "Moo",
         .target = 90 * DD2R,
         .precision = DMIN,
+        .range = 15 * DD2R,
         .format = moon_format,
     },
     {
@@ -228,6 +260,7 @@ static const event_type_t event_types[] = {
         .obj_type = "Moo",
         .target = -90 * DD2R,
         .precision = DMIN,
+        .range = 15 * DD2R,
         .format = moon_format,
     },
     {
@@ -237,6 +270,7 @@ static const event_type_t event_types[] = {
         .obj_type = "Pla",
         .target = 0,
         .precision = DMIN,
+        .range = 15 * DD2R,
         .format = conjunction_format,
     },
     {
@@ -246,6 +280,7 @@ static const event_type_t event_types[] = {
         .obj_type = "Pla",
         .target = 180 * DD2R,
         .precision = DMIN,
+        .range = 15 * DD2R,
         .format = conjunction_format,
     },
     {
@@ -255,6 +290,7 @@ static const event_type_t event_types[] = {
         .obj_type = "MPl",
         .target = 180 * DD2R,
         .precision = DHOUR,
+        .range = 15 * DD2R,
         .format = conjunction_format,
     },
     {
@@ -262,6 +298,7 @@ static const event_type_t event_types[] = {
         .nb_objs = 2,
         .func = vertical_align_event_func,
         .precision = DHOUR,
+        .range = 5 * DD2R,
         .format = vertical_align_format,
     },
     {},
@@ -295,34 +332,44 @@ void calendar_print(void)
                  USER_PASS(&utcoffset), print_callback);
 }
 
-static bool is_obj_hidden(cobj_t *obj, const observer_t *obs)
+static bool is_obj_hidden(const cobj_t *obj, const observer_t *obs)
 {
     if (!obj) return true;
     return obj->obs_z < 0;
 }
 
-static int check_event(const event_type_t *ev_type,
-                       const observer_t *obs,
-                       const cobj_t *o1, const cobj_t *o2,
-                       int flags,
-                       event_t **events)
+/*
+ * Update the tracked event of a given type and objects.
+ *
+ * The events are stored in the first object list, so that we can check
+ * the objects in parallel.
+ */
+static void check_event(const event_type_t *ev_type,
+                        const observer_t *obs,
+                        const cobj_t *o1, const cobj_t *o2,
+                        int flags,
+                        event_t **events)
 {
     double v, time = obs->tt;
     event_t *ev;
-    bool hidden = false;
+    bool hidden;
 
     hidden = is_obj_hidden(o1, obs) && is_obj_hidden(o2, obs);
-    if (!(flags & CALENDAR_HIDDEN) && hidden)
-        v = NAN;
-    else
-        v = ev_type->func(ev_type, obs, o1, o2);
-    if (isnan(v)) return 0;
+    if (!(flags & CALENDAR_HIDDEN) && hidden) return;
+    v = ev_type->func(ev_type, obs, o1, o2);
+
     DL_FOREACH(*events, ev) {
-        if (!ev->type) break;
         if (ev->status != EV_STATE_MAYBE) continue;
         if (ev->type == ev_type && ev->o1 == o1 && ev->o2 == o2)
             break;
     }
+    if (isnan(v)) {
+        if (ev) {
+            DL_DELETE(*events, ev);
+            free(ev);
+        }
+        return;
+    }
     if (!ev) {
         ev = calloc(1, sizeof(*ev));
         DL_APPEND(*events, ev);
@@ -334,43 +381,29 @@ static int check_event(const event_type_t *ev_type,
         ev->time_range[0] = ev->time_range[1] = time;
         ev->status = EV_STATE_MAYBE;
         ev->flags = hidden ? CALENDAR_HIDDEN : 0;
-    } else {
-        if (!hidden) ev->flags &= !CALENDAR_HIDDEN;
-        if (v * ev->v <= 0.0) {
-            ev->time = time;
-            ev->time_range[1] = time;
-            ev->time_range[0] = time - DHOUR;
-            ev->status = EV_STATE_FOUND;
-        }
-        ev->v = v;
+        return;
     }
-    return 0;
-}
-
-static int clean_events(event_t **events, const observer_t *obs) {
-    double v;
-    event_t *ev, *tmp;
-    DL_FOREACH_SAFE(*events, ev, tmp) {
-        if (ev->status == EV_STATE_MAYBE) {
-            v = ev->type->func(ev->type, obs, ev->o1, ev->o2);
-            if (isnan(v)) {
-                DL_DELETE(*events, ev);
-                free(ev);
-            }
-        }
+    if (!hidden) ev->flags &= ~CALENDAR_HIDDEN;
+    if (v * ev->v <= 0.0) {
+        // The event happened since the last time we got a value.
+        ev->time = time;
+        ev->time_range[0] = ev->time_range[1];
+        ev->status = EV_STATE_FOUND;
     }
-    return 0;
+    ev->time_range[1] = time;
+    ev->v = v;
 }
 
 static void cobj_update(cobj_t *o, const observer_t *obs)
 {
-    double pvo[2][4], p[4];
+    double p[4];
     if (!o) return;
-    obj_get_pvo(o->obj, obs, pvo);
-    eraC2s(pvo[0], &o->ra, &o->de);
+    obj_get_pvo(o->obj, obs, o->pvo);
+    vec3_normalize(o->pvo[0], o->pos);
+    eraC2s(o->pvo[0], &o->ra, &o->de);
     o->ra = eraAnp(o->ra);
     o->de = eraAnp(o->de);
-    convert_framev4(obs, FRAME_ICRF, FRAME_OBSERVED, pvo[0], p);
+    convert_framev4(obs, FRAME_ICRF, FRAME_OBSERVED, o->pvo[0], p);
     o->obs_z = p[2];
 }
 
@@ -378,16 +411,13 @@ static void cobj_update(cobj_t *o, const observer_t *obs)
 // Function that can be used in the newton algo (slow).
 static double newton_fn_(double time, void *user)
 {
-    double ret;
     observer_t *obs = USER_GET(user, 0);
     event_t *ev = USER_GET(user, 1);
     obs->tt = time;
     observer_update(obs, true);
-    if (ev->o1) cobj_update(ev->o1, obs);
-    if (ev->o2) cobj_update(ev->o2, obs);
-    ret = ev->type->func(ev->type, obs, ev->o1, ev->o2);
-    assert(!isnan(ret));
-    return ret;
+    cobj_update((cobj_t*)ev->o1, obs);
+    cobj_update((cobj_t*)ev->o2, obs);
+    return ev->type->func(ev->type, obs, ev->o1, ev->o2);
 }
 
 static int event_cmp(const void *e1, const void *e2)
@@ -439,7 +469,8 @@ calendar_t *calendar_create(const observer_t *obs,
 {
     calendar_t *cal;
     cal = calloc(1, sizeof(*cal));
-    int allocated = 0;
+    int i, allocated = 0;
+    const char *type;
 
     cal->obs = *obs;
     // Make a full update at mid time, so that we can do fast update after that
@@ -450,11 +481,19 @@ calendar_t *calendar_create(const observer_t *obs,
     // Create all the objects.
     list_objs(&cal->obs, USER_PASS(&cal->objs, &cal->nb_objs, &allocated),
               obj_add_f);
+    // Only the Moon and the planets can be the first object of a vertical
+    // alignment.
+    for (i = 0; i < cal->nb_objs; i++) {
+        type = cal->objs[i].obj->type;
+        cal->objs[i].pair = memcmp(type, "Moo", 4) == 0 ||
+                            memcmp(type, "Pla", 4) == 0;
+    }
 
     cal->flags = flags;
     cal->start = start;
     cal->end = end;
     cal->time = start;
+    cal->last_time = NAN;
 
     return cal;
 }
@@ -465,9 +504,10 @@ void calendar_delete(calendar_t *cal)
     int i;
     event_t *ev, *ev_tmp;
 
-    // Release all objects.
+    // Release all objects and their events.
     for (i = 0; i < cal->nb_objs; i++) {
         obj_release(cal->objs[i].obj);
+        DL_FOREACH_SAFE(cal->objs[i].events, ev, ev_tmp) free(ev);
     }
     free(cal->objs);
     // Delete events.
@@ -475,67 +515,132 @@ void calendar_delete(calendar_t *cal)
     free(cal);
 }
 
-EMSCRIPTEN_KEEPALIVE
-int calendar_compute(calendar_t *cal)
+// Check all the events of a range of objects, run in parallel.
+static void check_events_block(void *user, int start, int end)
 {
-    double step = DHOUR;
-    int i, j;
-    cobj_t *o1, *o2;
+    calendar_t *cal = USER_GET(user, 0);
     const event_type_t *ev_type;
-    event_t *ev, *ev_tmp;
-
-    if (cal->time >= cal->end) goto end;
+    cobj_t *o1;
+    int i, j;
 
-    // Only compute event for one time iteration.
-    cal->obs.tt = cal->time;
-    observer_update(&cal->obs, true);
-    for (i = 0; i < cal->nb_objs; i++) {
-        cobj_update(&cal->objs[i], &cal->obs);
-    }
-    // Check one body events.
-    for (i = 0; i < cal->nb_objs; i++) {
+    for (i = start; i < end; i++) {
         o1 = &cal->objs[i];
         for (ev_type = &event_types[0]; ev_type->func; ev_type++) {
             if (ev_type->nb_objs == 1) {
                 check_event(ev_type, &cal->obs, o1, NULL, cal->flags,
-                            &cal->events);
+                            &o1->events);
+            }
+            if (ev_type->nb_objs != 2 || !o1->pair) continue;
+            for (j = 0; j < cal->nb_objs; j++) {
+                if (j == i) continue;
+                check_event(ev_type, &cal->obs, o1, &cal->objs[j],
+                            cal->flags, &o1->events);
             }
         }
     }
-    // Check two bodies events.
-    for (i = 0; i < cal->nb_objs; i++)
-    for (j = 0; j < cal->nb_objs; j++) {
+}
+
+/*
+ * Compute the next time step from the objects speed.
+ *
+ * The step is small enough so that the one body event functions get a few
+ * samples over their range.  For the two bodies events, we directly jump
+ * to the time the objects could get close enough, and then do fine steps.
+ */
+static double get_step(const calendar_t *cal)
+{
+    const event_type_t *ev_type;
+    const cobj_t *o1, *o2;
+    double step = MAX_STEP, speed, sep;
+    int i, j;
+
+    if (isnan(cal->last_time)) return MIN_STEP;
+    for (i = 0; i < cal->nb_objs; i++) {
         o1 = &cal->objs[i];
-        o2 = &cal->objs[j];
-        if (o1 == o2) continue;
         for (ev_type = &event_types[0]; ev_type->func; ev_type++) {
-            if (ev_type->nb_objs == 2) {
-                check_event(ev_type, &cal->obs, o1, o2, cal->flags,
-                            &cal->events);
+            if (ev_type->nb_objs == 1) {
+                if (memcmp(o1->obj->type, ev_type->obj_type, 4) != 0)
+                    continue;
+                speed = o1->speed + cal->sun_speed;
+                if (speed > 0)
+                    step = min(step, STEP_FACTOR * 2 * ev_type->range / speed);
+                continue;
+            }
+            if (!o1->pair) continue;
+            for (j = 0; j < cal->nb_objs; j++) {
+                o2 = &cal->objs[j];
+                if (j == i || !vertical_align_match(o1, o2)) continue;
+                // Add some margin since the speed is only an estimate.
+                speed = (o1->speed + o2->speed) * 1.25;
+                if (speed <= 0) continue;
+                sep = eraSepp(o1->pos, o2->pos);
+                step = min(step, max(sep - ev_type->range, PAIR_STEP) / speed);
             }
         }
     }
-    clean_events(&cal->events, &cal->obs);
-    cal->time += step;
-    return 1;
+    return clamp(step, MIN_STEP, MAX_STEP);
+}
 
-end:
-    // Remove all the tmp events
-    DL_FOREACH_SAFE(cal->events, ev, ev_tmp) {
-        if (ev->status != EV_STATE_FOUND) {
-            DL_DELETE(cal->events, ev);
-            free(ev);
+/*
+ * Refine the events found during the last step and move them to the
+ * results list.
+ */
+static void collect_events(calendar_t *cal)
+{
+    int i;
+    event_t *ev, *ev_tmp, *found = NULL;
+
+    for (i = 0; i < cal->nb_objs; i++) {
+        DL_FOREACH_SAFE(cal->objs[i].events, ev, ev_tmp) {
+            if (ev->status != EV_STATE_FOUND) continue;
+            DL_DELETE(cal->objs[i].events, ev);
+            DL_APPEND(found, ev);
         }
     }
     // Compute fine value using newton algo.
-    DL_FOREACH(cal->events, ev) {
-        if (ev->type->precision >= step) continue;
+    DL_FOREACH(found, ev) {
+        if (ev->type->precision >= ev->time_range[1] - ev->time_range[0])
+            continue;
         ev->time = newton(newton_fn_,
                           ev->time_range[0], ev->time_range[1],
                           ev->type->precision, USER_PASS(&cal->obs, ev));
     }
-    DL_SORT(cal->events, event_cmp);
-    return 0;
+    // All the events are in the last step range, so sorting them keeps the
+    // results in order.
+    DL_SORT(found, event_cmp);
+    DL_CONCAT(cal->events, found);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int calendar_compute(calendar_t *cal)
+{
+    int i;
+    cobj_t *o;
+    double dt, sun_pos[3];
+
+    if (cal->time >= cal->end) return 0;
+
+    // Only compute event for one time iteration.
+    cal->obs.tt = cal->time;
+    observer_update(&cal->obs, true);
+    // The objects update is not thread safe, so we do it first.
+    dt = cal->time - cal->last_time;
+    for (i = 0; i < cal->nb_objs; i++) {
+        o = &cal->objs[i];
+        cobj_update(o, &cal->obs);
+        if (!isnan(dt)) o->speed = eraSepp(o->step_pos, o->pos) / dt;
+        vec3_copy(o->pos, o->step_pos);
+    }
+    vec3_normalize(cal->obs.sun_pvo[0], sun_pos);
+    if (!isnan(dt)) cal->sun_speed = eraSepp(cal->sun_pos, sun_pos) / dt;
+    vec3_copy(sun_pos, cal->sun_pos);
+
+    worker_parallel_for(cal->nb_objs, 16, USER_PASS(cal), check_events_block);
+    collect_events(cal);
+
+    cal->last_time = cal->time;
+    cal->time += get_step(cal);
+    return cal->time < cal->end ? 1 : 0;
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -547,15 +652,17 @@ int calendar_get_results(calendar_t *cal, void *user,
 {
     int n = 0;
     char buf[128];
-    event_t *ev;
-    DL_FOREACH(cal->events, ev) {
+    event_t *ev, *ev_tmp;
+    DL_FOREACH_SAFE(cal->events, ev, ev_tmp) {
         cal->obs.tt = ev->time;
         observer_update(&cal->obs, true);
-        cobj_update(ev->o1, &cal->obs);
-        cobj_update(ev->o2, &cal->obs);
+        cobj_update((cobj_t*)ev->o1, &cal->obs);
+        cobj_update((cobj_t*)ev->o2, &cal->obs);
         ev->type->format(ev, buf, ARRAY_SIZE(buf));
         callback(ev->time, ev->type->name, buf, ev->flags,
                  ev->o1->obj, ev->o2 ? ev->o2->obj : NULL, user);
+        DL_DELETE(cal->events, ev);
+        free(ev);
         n++;
     }
     return n;
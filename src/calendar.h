@@ -51,7 +51,9 @@ calendar_t *calendar_create(const observer_t *obs,
  *
  * To compute all the events we have to call this function several times
  * until it returns 0.  This allow to use it in a loop without blocking the
- * thread.
+ * thread.  Each call advances the time by a step adapted to the objects
+ * motion, and the events found are available right away with
+ * <calendar_get_results>.
  *
  * Return:
  *   0 if the computation has finished, 1 otherwise.
@@ -60,9 +62,10 @@ int calendar_compute(calendar_t *cal);
 
 /*
  * Function: calendar_get_results
- * Get all the events from a calendar.
+ * Get the events found by calendar_compute since the last call.
  *
- * This should be called only after calendar_compute has finished.
+ * This can be called between two calls to calendar_compute to get the
+ * events as they are found, in time order.
  */
 int calendar_get_results(calendar_t *cal, void *user,
                          int (*callback)(double ut1, const char *type,
@@ -9,8 +9,43 @@
 
 #include "swe.h"
 
+#include <zlib.h> // For crc32.
+
+#ifdef HAVE_PTHREAD
+#   include <pthread.h>
+#endif
+
 core_t *core;   // The global core object.
 
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t g_lock;
+static pthread_once_t g_lock_once = PTHREAD_ONCE_INIT;
+
+static void lock_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&g_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+#endif
+
+void core_lock(void)
+{
+#ifdef HAVE_PTHREAD
+    pthread_once(&g_lock_once, lock_init);
+    pthread_mutex_lock(&g_lock);
+#endif
+}
+
+void core_unlock(void)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&g_lock);
+#endif
+}
+
 #define CORE_MIN_FOV (1./3600 * DD2R)
 #define exp10(x) exp((x) * log(10.f))
 
@@ -27,6 +62,48 @@ static void core_on_utcoffset_changed(obj_t *obj, const attribute_t *attr)
     core->utc_offset = clamp(core->utc_offset, -24 * 60, +24 * 60);
 }
 
+static void core_on_threads_count_changed(obj_t *obj,
+                                         const attribute_t *attr)
+{
+    core->threads_count = max(core->threads_count, 0);
+    worker_set_threads_count(core->threads_count);
+}
+
+static void core_on_cache_size_changed(obj_t *obj, const attribute_t *attr)
+{
+    // The caches sizes are stored as int bytes values.
+    core->images_cache_size = clamp(core->images_cache_size, 1, 2047);
+    core->stars_cache_size = clamp(core->stars_cache_size, 1, 2047);
+    core->dsos_cache_size = clamp(core->dsos_cache_size, 1, 2047);
+    hips_set_cache_size(HIPS_CACHE_IMAGES, core->images_cache_size << 20);
+    hips_set_cache_size(HIPS_CACHE_STARS, core->stars_cache_size << 20);
+    hips_set_cache_size(HIPS_CACHE_DSOS, core->dsos_cache_size << 20);
+}
+
+// Forget all the selectable shapes of the previous frames.
+static void clear_picking(void)
+{
+    areas_clear_all(core->areas);
+    if (core->rend && core->rend->pick_clear)
+        core->rend->pick_clear(core->rend);
+}
+
+static void core_on_gpu_picking_changed(obj_t *obj, const attribute_t *attr)
+{
+    // The static modules have to be rendered again to register their
+    // meshes in the new place.
+    clear_picking();
+    core->layers.dirty = true;
+}
+
+static void core_on_persistent_cache_size_changed(
+        obj_t *obj, const attribute_t *attr)
+{
+    core->persistent_cache_size = clamp(core->persistent_cache_size, 0,
+                                        1 << 20);
+    request_set_cache_max_size((int64_t)core->persistent_cache_size << 20);
+}
+
 static void add_progressbar(void *user, const char *id, const char *label,
                             int v, int total)
 {
@@ -60,6 +137,11 @@ static obj_t *core_get(const obj_t *obj, const char *id, int flags)
     return NULL;
 }
 
+static int module_load(obj_t *module);
+static struct module_prof *prof_get_module_data(const obj_t *module);
+static void flush_inputs(void);
+static double lum_hist_get_lwmax(bool *fast);
+
 EMSCRIPTEN_KEEPALIVE
 obj_t *core_get_module(const char *id)
 {
@@ -74,17 +156,13 @@ obj_t *core_get_module(const char *id)
     while (*id) {
         end = strchr(id, '.') ?: id + strlen(id);
         len = end - id;
-        DL_FOREACH(ret->children, m) {
-            if (!m->id) continue;
-            if (strncmp(m->id, id, len) == 0 && m->id[len] == '\0') {
-                ret = m;
-                id += len;
-                if (*id == '.') id++;
-                break;
-            }
-        }
+        m = module_find_child(ret, id, len);
         if (!m) return NULL;
+        ret = m;
+        id += len;
+        if (*id == '.') id++;
     }
+    if (ret->klass->load) module_load(ret);
     return ret;
 }
 
@@ -92,6 +170,15 @@ static obj_t *core_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint)
 {
     obj_t *module;
     obj_t *ret;
+    uint64_t module_hint;
+
+    // First check the global index.  The hint given by the caller, if any,
+    // takes precedence.
+    module = module_find_by_oid(oid, &module_hint);
+    if (module) {
+        ret = obj_get_by_oid(module, oid, hint ?: module_hint);
+        if (ret) return ret;
+    }
     DL_FOREACH(core->obj.children, module) {
         ret = obj_get_by_oid(module, oid, hint);
         if (ret) return ret;
@@ -112,6 +199,17 @@ static int core_list(const obj_t *obj, observer_t *obs,
     return nb;
 }
 
+static int core_query(const obj_t *obj, observer_t *obs,
+                      const obj_query_t *query, void *user,
+                      int (*f)(void *user, obj_t *obj))
+{
+    obj_t *module;
+    DL_FOREACH(core->obj.children, module) {
+        if (module_query(module, obs, query, user, f)) return 1;
+    }
+    return 0;
+}
+
 static int core_add_data_source(obj_t *obj, const char *url, const char *type,
                                 json_value *args)
 {
@@ -126,6 +224,15 @@ static int core_add_data_source(obj_t *obj, const char *url, const char *type,
     return 1;
 }
 
+// Modules rendered at or after this order are drawn on top of the static
+// layer at each frame.  See <core_render>.
+#define LAYERS_DYNAMIC_RENDER_ORDER 100
+
+static bool is_module_dynamic(const obj_t *module)
+{
+    return module_get_render_order(module) >= LAYERS_DYNAMIC_RENDER_ORDER;
+}
+
 static int modules_sort_cmp(void *a, void *b)
 {
     obj_t *at, *bt;
@@ -142,11 +249,19 @@ static int modules_sort_cmp(void *a, void *b)
  * Parameters:
  *   proj   - Pointer to a projection_t instance that get initialized.
  */
-void core_get_proj(projection_t *proj)
+// Time in the future used for the tiles prefetching (sec).
+#define PREFETCH_TIME 0.5
+
+// Slowest view motion (in fov per second) for which we lower the
+// resolution, and lowest resolution scale.
+#define DYNRES_MIN_SPEED 0.2
+#define DYNRES_MIN_SCALE 0.5
+
+static void get_proj_for_fov(projection_t *proj, double fov)
 {
     double fovx, fovy;
     double aspect = core->win_size[0] / core->win_size[1];
-    projection_compute_fovs(core->proj, core->fov, aspect, &fovx, &fovy);
+    projection_compute_fovs(core->proj, fov, aspect, &fovx, &fovy);
     projection_init(proj, core->proj, fovx,
                     core->win_size[0], core->win_size[1]);
     if (core->flip_view_vertical)
@@ -155,12 +270,21 @@ void core_get_proj(projection_t *proj)
         proj->flags |= PROJ_FLIP_HORIZONTAL;
 }
 
+void core_get_proj(projection_t *proj)
+{
+    get_proj_for_fov(proj, core->fov);
+}
+
 obj_t *core_get_obj_at(double x, double y, double max_dist)
 {
     double pos[2] = {x, y};
-    uint64_t oid, hint;
-    if (!areas_lookup(core->areas, pos, max_dist, &oid, &hint))
-        return NULL;
+    uint64_t oid = 0, hint = 0;
+    if (!areas_lookup(core->areas, pos, max_dist, &oid, &hint)) {
+        if (!core->gpu_picking || !core->rend || !core->rend->pick)
+            return NULL;
+        if (!core->rend->pick(core->rend, pos, max_dist, &oid))
+            return NULL;
+    }
     if (!oid) return NULL;
     return obj_get_by_oid(NULL, oid, hint);
 }
@@ -248,6 +372,7 @@ static void core_set_default(void)
     core->star_relative_scale = 1.1;
 
     core->lwmax_min = 0.052;
+    core->lwmax_weight = 1;
     core->max_point_radius = 50.0;
     core->min_point_radius = 0.9;  // In physical pixels
     core->skip_point_radius = 0.25;
@@ -268,22 +393,35 @@ static void on_progressbar(const char *id)
 }
 
 // Callback for texture loading.
-static uint8_t *texture_load_function(
-        void *user, const char *url, int *code,
-        int *w, int *h, int *bpp)
-{
-    const void *data;
-    int size;
-    data = asset_get_data(url, &size, code);
-    if (!data) return NULL;
+static const void *texture_fetch_function(
+        void *user, const char *url, int *code, int *size, void **handle)
+{
+    asset_buffer_t *buf;
+    if (!asset_get_data(url, size, code)) return NULL;
+    // Keep the data alive while it is decoded in a worker.
+    buf = asset_retain(url);
+    *handle = buf;
+    return buf->data;
+}
+
+static uint8_t *texture_decode_function(
+        void *user, const void *data, int size, int *w, int *h, int *bpp)
+{
     return img_read_from_mem(data, size, w, h, bpp);
 }
 
+static void texture_release_function(void *user, void *handle)
+{
+    asset_buffer_release(handle);
+}
+
 EMSCRIPTEN_KEEPALIVE
 void core_init(double win_w, double win_h, double pixel_scale)
 {
     char cache_dir[1024];
     obj_klass_t *module;
+    obj_t *obj;
+    double t, start_time = sys_get_unix_time();
 
     // Why do we even need those attributes?
     assert(!isnan(win_w) && !isnan(win_h) && !isnan(pixel_scale));
@@ -294,11 +432,23 @@ void core_init(double win_w, double win_h, double pixel_scale)
         return;
     }
     profile_init();
-    texture_set_load_callback(NULL, texture_load_function);
+    texture_set_load_callbacks(NULL, texture_fetch_function,
+                               texture_decode_function,
+                               texture_release_function);
     snprintf(cache_dir, sizeof(cache_dir), "%s/%s",
              sys_get_user_dir(), ".cache");
     request_init(cache_dir);
 
+    // Decompress the bundled assets in the order we are going to use them.
+    asset_warmup("asset://shaders/");
+    asset_warmup("asset://font/");
+    asset_warmup("asset://stars/");
+    asset_warmup("asset://skycultures/");
+    asset_warmup("asset://planets.ini");
+    asset_warmup("asset://symbols.png");
+    asset_warmup("asset://textures/");
+    asset_warmup("asset://");
+
     core = (core_t*)obj_create("core", "core", NULL, NULL);
     core->win_size[0] = win_w;
     core->win_size[1] = win_h;
@@ -307,13 +457,27 @@ void core_init(double win_w, double win_h, double pixel_scale)
     core->point_dim_factor = 3;
     core->dso_hints_mag_offset = -0.8;
     core->display_limit_mag = 99;
+    core->jobs_budget = 0.004;
+    core->quality.target_fps = 30;
+    core->accuracy = ACCURACY_PRECISE;
+    core->render_accuracy = ACCURACY_RENDER;
+    core->images_cache_size = hips_get_cache_size(HIPS_CACHE_IMAGES, NULL);
+    core->stars_cache_size = hips_get_cache_size(HIPS_CACHE_STARS, NULL);
+    core->dsos_cache_size = hips_get_cache_size(HIPS_CACHE_DSOS, NULL);
+    core->images_cache_size >>= 20;
+    core->stars_cache_size >>= 20;
+    core->dsos_cache_size >>= 20;
 
     core->observer = (observer_t*)obj_create("observer", "observer",
                                              (obj_t*)core, NULL);
 
+    // The modules with a load method only parse their data later, see
+    // module_load.
     for (module = obj_get_all_klasses(); module; module = module->next) {
         if (!(module->flags & OBJ_MODULE)) continue;
-        obj_create(module->id, module->id, (obj_t*)core, NULL);
+        t = sys_get_unix_time();
+        obj = obj_create(module->id, module->id, (obj_t*)core, NULL);
+        prof_get_module_data(obj)->init = sys_get_unix_time() - t;
     }
     DL_SORT(core->obj.children, modules_sort_cmp);
 
@@ -321,6 +485,7 @@ void core_init(double win_w, double win_h, double pixel_scale)
     progressbar_add_listener(on_progressbar);
 
     core_set_default();
+    core->prof.startup = sys_get_unix_time() - start_time;
 }
 
 void core_release(void)
@@ -329,6 +494,7 @@ void core_release(void)
     DL_FOREACH(core->obj.children, module) {
         if (module->klass->del) module->klass->del(module);
     }
+    arena_release(&core->frame_arena);
     profile_release();
 }
 
@@ -458,13 +624,320 @@ static int core_update_mount(double dt)
 }
 
 EMSCRIPTEN_KEEPALIVE
-int core_update(double dt)
+// Update the smoothed view velocities.
+static void update_motion(double dt)
+{
+    typeof(core->motion) *m = &core->motion;
+    double k;
+    const observer_t *obs = core->observer;
+
+    if (dt <= 0) return;
+    if (m->fov) {
+        // Smooth over about 0.1 sec.
+        k = min(dt / 0.1, 1.0);
+        m->v_yaw = mix(m->v_yaw, eraAnpm(obs->yaw - m->yaw) / dt, k);
+        m->v_pitch = mix(m->v_pitch, (obs->pitch - m->pitch) / dt, k);
+        m->v_log_fov = mix(m->v_log_fov, log(core->fov / m->fov) / dt, k);
+    }
+    m->yaw = obs->yaw;
+    m->pitch = obs->pitch;
+    m->fov = core->fov;
+}
+
+/*
+ * Compute the view we expect to have in PREFETCH_TIME, using the current
+ * direction and zoom animations if any, or the current velocities.
+ *
+ * Return false if the view is not going to change much.
+ */
+static bool get_predicted_view(double *yaw, double *pitch, double *fov)
+{
+    double t, q[4], v[3] = {1, 0, 0}, p0[3], p1[3];
+    const typeof(core->fov_animation) *anim = &core->fov_animation;
+
+    if (core->target.duration &&
+            (!core->target.lock || core->target.move_to_lock)) {
+        t = min(core->target.t + PREFETCH_TIME / core->target.duration, 1);
+        quat_slerp(core->target.src_q, core->target.dst_q,
+                   smoothstep(0.0, 1.0, t), q);
+        quat_mul_vec3(q, v, v);
+        eraC2s(v, yaw, pitch);
+    } else {
+        *yaw = core->observer->yaw + core->motion.v_yaw * PREFETCH_TIME;
+        *pitch = core->observer->pitch + core->motion.v_pitch * PREFETCH_TIME;
+        *pitch = clamp(*pitch, -M_PI / 2, +M_PI / 2);
+    }
+
+    if (anim->duration && anim->dst_fov) {
+        t = min(anim->t + PREFETCH_TIME / anim->duration, 1);
+        *fov = mix(anim->src_fov, anim->dst_fov, smoothstep(0.0, 1.0, t));
+    } else {
+        *fov = core->fov * exp(core->motion.v_log_fov * PREFETCH_TIME);
+    }
+    if (!(*fov > 0)) return false;
+
+    eraS2c(core->observer->yaw, core->observer->pitch, p0);
+    eraS2c(*yaw, *pitch, p1);
+    return eraSepp(p0, p1) > 0.05 * core->fov ||
+           fabs(log(*fov / core->fov)) > 0.05;
+}
+
+/*
+ * Compute the resolution scale of the static modules for the next frame.
+ *
+ * Like the quality controller, we lower the scale when the frames go above
+ * the budget, and slowly raise it when they are well below.  The view
+ * speed gives how low we can go, since we notice the details less the
+ * faster they move, and we go back directly to the full resolution once
+ * the view settles.
+ */
+static double get_dynres_scale(void)
+{
+    const typeof(core->motion) *m = &core->motion;
+    double speed, budget, scale = core->dynres.scale ?: 1.0;
+
+    if (!core->dynres.enabled || core->quality.target_fps <= 0) return 1.0;
+    speed = hypot(m->v_yaw * cos(core->observer->pitch), m->v_pitch) /
+            core->fov + fabs(m->v_log_fov);
+    if (!(speed >= DYNRES_MIN_SPEED)) return 1.0;
+    budget = 1.0 / core->quality.target_fps;
+    if (core->quality.frame_time > budget)
+        scale -= 0.1;
+    else if (core->quality.frame_time < budget * 0.6)
+        scale += 0.05;
+    return clamp(scale, max(DYNRES_MIN_SCALE, sqrt(DYNRES_MIN_SPEED / speed)),
+                 1.0);
+}
+
+/*
+ * Get the profiling data of a module.
+ *
+ * If we have too many modules, the last ones share the last slot.
+ */
+static struct module_prof *prof_get_module_data(const obj_t *module)
+{
+    int i;
+    struct module_prof *prof = NULL;
+    for (i = 0; i < core->prof.nb_modules; i++) {
+        if (core->prof.modules[i].module == module) {
+            prof = &core->prof.modules[i];
+            break;
+        }
+    }
+    if (!prof && i == ARRAY_SIZE(core->prof.modules))
+        prof = &core->prof.modules[i - 1];
+    if (!prof) {
+        prof = &core->prof.modules[core->prof.nb_modules++];
+        memset(prof, 0, sizeof(*prof));
+        prof->module = module;
+    }
+    return prof;
+}
+
+// Get the profiling timings of a module for the current frame.
+static struct module_prof_frame *prof_get_module(const obj_t *module)
 {
-    bool atm_visible;
-    double lwmax;
+    struct module_prof *prof = prof_get_module_data(module);
+    return &prof->frames[core->prof.frame % PROF_NB_FRAMES];
+}
+
+/*
+ * Call the load method of a module, if it has one.
+ *
+ * Return:
+ *   1 if the module data got loaded by this call, 0 otherwise.
+ */
+static int module_load(obj_t *module)
+{
+    double t;
     int r;
-    obj_t *atm, *module;
+    if (!module->klass->load) return 0;
+    t = sys_get_unix_time();
+    r = module->klass->load(module);
+    if (r) prof_get_module_data(module)->load += sys_get_unix_time() - t;
+    return r;
+}
+
+// Start the profiling timings of a new frame.
+static void prof_new_frame(void)
+{
+    int i, k;
+    k = ++core->prof.frame % PROF_NB_FRAMES;
+    for (i = 0; i < core->prof.nb_modules; i++)
+        memset(&core->prof.modules[i].frames[k], 0,
+               sizeof(core->prof.modules[i].frames[k]));
+    core->prof.flush[k] = 0;
+    core->prof.allocs[k] = 0;
+    core->prof.allocs_start = allocs_get_count();
+}
+
+static json_value *core_fn_render_stats(obj_t *obj, const attribute_t *attr,
+                                        const json_value *args)
+{
+    if (!core->rend || !core->rend->get_stats) return json_null_new();
+    return core->rend->get_stats(core->rend);
+}
+
+/*
+ * Memory used by the caches.  All the counters (hits, misses, evictions)
+ * are cumulated since the start, so the clients should compare two calls
+ * to get rates.
+ */
+static json_value *core_fn_memory_stats(obj_t *obj, const attribute_t *attr,
+                                        const json_value *args)
+{
+    int nb;
+    int64_t size, evictions;
+    json_value *ret, *val;
+
+    ret = json_object_new(0);
+    assets_get_stats(&nb, &size, &evictions);
+    val = json_object_push(ret, "assets", json_object_new(0));
+    json_object_push(val, "nb", json_integer_new(nb));
+    json_object_push(val, "size", json_integer_new(size));
+    json_object_push(val, "evictions", json_integer_new(evictions));
+    texture_get_live(&nb, &size);
+    val = json_object_push(ret, "textures", json_object_new(0));
+    json_object_push(val, "nb", json_integer_new(nb));
+    json_object_push(val, "size", json_integer_new(size));
+    json_object_push(ret, "hips", hips_get_memory_stats());
+    return ret;
+}
+
+static json_value *core_fn_timings(obj_t *obj, const attribute_t *attr,
+                                   const json_value *args)
+{
+    int i, j, k, n;
+    const struct module_prof *prof;
+    json_value *ret, *modules, *m, *values[3];
+
+    n = min(core->prof.frame, PROF_NB_FRAMES);
+    ret = json_object_new(0);
+    json_object_push(ret, "frames", json_integer_new(n));
+    json_object_push(ret, "startup", json_double_new(core->prof.startup));
+    values[0] = json_object_push(ret, "flush", json_array_new(n));
+    // Oldest frames first.
+    for (j = core->prof.frame - n + 1; j <= core->prof.frame; j++) {
+        k = j % PROF_NB_FRAMES;
+        json_array_push(values[0], json_double_new(core->prof.flush[k]));
+    }
+    if (allocs_get_count() >= 0) {
+        values[0] = json_object_push(ret, "allocs", json_array_new(n));
+        for (j = core->prof.frame - n + 1; j <= core->prof.frame; j++) {
+            k = j % PROF_NB_FRAMES;
+            json_array_push(values[0],
+                            json_integer_new(core->prof.allocs[k]));
+        }
+    }
+    modules = json_object_push(ret, "modules", json_object_new(0));
+    for (i = 0; i < core->prof.nb_modules; i++) {
+        prof = &core->prof.modules[i];
+        if (!prof->module->id) continue;
+        m = json_object_push(modules, prof->module->id, json_object_new(0));
+        json_object_push(m, "init", json_double_new(prof->init));
+        json_object_push(m, "load", json_double_new(prof->load));
+        values[0] = json_object_push(m, "update", json_array_new(n));
+        values[1] = json_object_push(m, "render", json_array_new(n));
+        values[2] = json_object_push(m, "post_render", json_array_new(n));
+        for (j = core->prof.frame - n + 1; j <= core->prof.frame; j++) {
+            k = j % PROF_NB_FRAMES;
+            json_array_push(values[0],
+                            json_double_new(prof->frames[k].update));
+            json_array_push(values[1],
+                            json_double_new(prof->frames[k].render));
+            json_array_push(values[2],
+                            json_double_new(prof->frames[k].post_render));
+        }
+    }
+    return ret;
+}
+
+// Max number of modules updated concurrently.
+#define PARALLEL_UPDATE_MAX 32
+
+// Only run the modules updates on the worker pool if they took more than
+// this at the previous frame (sec), since the dispatch has a cost.
+#define PARALLEL_UPDATE_MIN_TIME 0.0005
+
+static void update_modules_block(void *user, int start, int end)
+{
+    obj_t **modules = USER_GET(user, 0);
+    const double *dt = USER_GET(user, 1);
+    int *rets = USER_GET(user, 2);
+    double *times = USER_GET(user, 3);
+    int i;
+    double t;
+
+    for (i = start; i < end; i++) {
+        t = sys_get_unix_time();
+        rets[i] = modules[i]->klass->update(modules[i], *dt);
+        times[i] = sys_get_unix_time() - t;
+    }
+}
+
+/*
+ * Call the update method of all the modules, in render order.
+ *
+ * The consecutive modules with the OBJ_UPDATE_PARALLEL flag are updated
+ * concurrently on the worker pool, the other modules are updated alone,
+ * after all the previous ones are done.
+ */
+static void update_modules(double dt)
+{
+    obj_t *module, *run[PARALLEL_UPDATE_MAX];
+    int rets[PARALLEL_UPDATE_MAX], i, n, last;
+    double times[PARALLEL_UPDATE_MAX], last_time;
+    struct module_prof *prof;
+
+    last = (core->prof.frame + PROF_NB_FRAMES - 1) % PROF_NB_FRAMES;
+    module = core->obj.children;
+    while (module) {
+        n = 0;
+        last_time = 0;
+        while (module && n < PARALLEL_UPDATE_MAX &&
+               (!module->klass->update ||
+                (module->klass->flags & OBJ_UPDATE_PARALLEL))) {
+            if (module->klass->update) {
+                prof = prof_get_module_data(module);
+                last_time += prof->frames[last].update;
+                run[n++] = module;
+            }
+            module = module->next;
+        }
+        if (!n && module) {
+            run[n++] = module;
+            module = module->next;
+        }
+        if (n > 1 && last_time > PARALLEL_UPDATE_MIN_TIME) {
+            worker_parallel_for(n, 1, USER_PASS(run, &dt, rets, times),
+                                update_modules_block);
+        } else {
+            update_modules_block(USER_PASS(run, &dt, rets, times), 0, n);
+        }
+
+        for (i = 0; i < n; i++) {
+            prof_get_module(run[i])->update = times[i];
+            if (rets[i] < 0) LOG_E("Error updating module '%s'", run[i]->id);
+            // Positive values mean that the module is still changing.
+            if (rets[i] > 0) core->redraw.dirty = true;
+            if (rets[i] > 0 && !is_module_dynamic(run[i]))
+                core->layers.dirty = true;
+        }
+    }
+}
 
+int core_update(double dt)
+{
+    bool atm_visible, fast;
+    double lwmax, old_lwmax;
+    obj_t *atm;
+
+    recorder_push("u %.17g", dt);
+    core_lock();
+    prof_new_frame();
+    flush_inputs();
+    // Notify all the changes since the last frame at once.
+    module_flush_changes();
     atm = core_get_module("atmosphere");
     assert(atm);
     obj_get_attr(atm, "visible", &atm_visible);
@@ -472,21 +945,32 @@ int core_update(double dt)
     // Update telescope according to the fov.
     if (core->telescope_auto)
         telescope_auto(&core->telescope, core->fov);
+    asset_warmup_update();
+    assets_update();
     progressbar_update();
-
-    // Update eye adaptation.
-    if (core->fast_adaptation && core->lwmax > core->tonemapper.lwmax) {
-        lwmax = core->lwmax;
-    } else {
-        lwmax = exp(logf(core->tonemapper.lwmax) +
-                    (logf(core->lwmax) - logf(core->tonemapper.lwmax)) *
-                    min(0.16 * dt / 0.01666, 0.5));
+    if (hips_update_loaders()) core->redraw.dirty = core->layers.dirty = true;
+    if (jobs_run(core->jobs_budget))
+        core->redraw.dirty = core->layers.dirty = true;
+
+    // Update eye adaptation.  The luminances are only reported by the
+    // rendering, so we keep the current value if we skipped the frame.
+    if (core->redraw.rendered) {
+        core->lwmax = lum_hist_get_lwmax(&fast);
+        if (fast && core->lwmax > core->tonemapper.lwmax) {
+            lwmax = core->lwmax;
+        } else {
+            lwmax = exp(logf(core->tonemapper.lwmax) +
+                        (logf(core->lwmax) - logf(core->tonemapper.lwmax)) *
+                        min(0.16 * dt / 0.01666, 0.5));
+        }
+        old_lwmax = core->tonemapper.lwmax;
+        tonemapper_update(&core->tonemapper, core->tonemapper_p, -1,
+                          core->exposure_scale, lwmax);
+        if (fabs(lwmax - old_lwmax) > old_lwmax * 0.001)
+            core->redraw.dirty = true;
+        core->redraw.rendered = false;
     }
 
-    tonemapper_update(&core->tonemapper, core->tonemapper_p, -1,
-                      core->exposure_scale, lwmax);
-    core->lwmax = core->lwmax_min; // Reset for next frame.
-
     // Adjust star linear scale in function of screen pixel size
     // It ranges from 0.5 for a small screen to 1.4 for large screens
     double delta = -1.0 + min(core->win_size[0], core->win_size[1]) / 400;
@@ -497,24 +981,80 @@ int core_update(double dt)
     core_update_mount(dt);
 
     DL_SORT(core->obj.children, modules_sort_cmp);
-    DL_FOREACH(core->obj.children, module) {
-        if (module->klass->update) {
-            r = module->klass->update(module, dt);
-            if (r < 0) LOG_E("Error updating module '%s'", module->id);
-        }
-    }
+    update_modules(dt);
 
+    update_motion(dt);
+    core_unlock();
+    recorder_pop();
     return 0;
 }
 
+void core_layers_on_changed(const obj_t *obj, const char *attr)
+{
+    // The view and the time are checked when we render.
+    if (obj == (const obj_t*)core->observer) return;
+    if (obj == &core->obj &&
+            (strcmp(attr, "hovered") == 0 || strcmp(attr, "fps") == 0))
+        return;
+    if ((obj->klass->flags & OBJ_MODULE) && is_module_dynamic(obj)) return;
+    core->layers.dirty = true;
+}
+
+// Hash of all the values the static layer depends on, except the time.
+static uint32_t get_layer_key(const painter_t *painter)
+{
+    uint32_t key;
+    const observer_t *obs = painter->obs;
+    const projection_t *proj = painter->proj;
+    const double values[] = {
+        obs->yaw, obs->pitch, obs->roll, obs->view_offset_alt,
+        proj->type, proj->flags, proj->scaling[0], proj->scaling[1],
+        proj->window_size[0], proj->window_size[1], painter->pixel_scale,
+        painter->flags, painter->degrade, painter->stars_limit_mag,
+        painter->hints_limit_mag, painter->hard_limit_mag,
+        core->tonemapper.p, core->tonemapper.lwmax,
+        core->tonemapper.exposure,
+    };
+    key = crc32(0, (void*)values, sizeof(values));
+    key = crc32(key, (void*)&obs->hash_partial, sizeof(obs->hash_partial));
+    key = crc32(key, (void*)obs->mount_quat, sizeof(obs->mount_quat));
+    key = crc32(key, (void*)proj->mat, sizeof(proj->mat));
+    return key;
+}
+
+// Max time difference (days) for which we can reuse the static layer: half
+// a pixel of the diurnal motion, and at most one second.  The objects
+// moving faster than the stars can lag up to that.
+static double get_layer_max_dt(const painter_t *painter)
+{
+    double pixel = core->fov / hypot(painter->fb_size[0],
+                                     painter->fb_size[1]);
+    return min(0.5 * pixel / (ERFA_D2PI * 1.00273781191135448),
+               1.0 / ERFA_DAYSEC);
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool core_needs_render(void)
+{
+    int nb_done;
+    if (core->redraw.dirty) return true;
+    if (request_get_nb_running(&nb_done)) return true;
+    if (nb_done != core->redraw.nb_requests_done) return true;
+    observer_update(core->observer, true);
+    return core->observer->hash != core->redraw.obs_hash ||
+           core->fov != core->redraw.fov;
+}
+
 // Test whether the landscape hides the view below the horizon.
 static bool is_below_horizon_hidden(void)
 {
+    static const attribute_t *visible_attr = NULL;
     obj_t *ls;
     bool visible;
     double direction[4];
     ls = core_get_module("landscapes");
-    obj_get_attr(ls, "visible", &visible);
+    if (!visible_attr) visible_attr = obj_get_attr_(ls, "visible");
+    obj_attr_get(ls, visible_attr, &visible);
     if (!visible) return false;
 
     // If we look down, it means the landscape is semi transparent, and so
@@ -546,27 +1086,66 @@ static void core_get_point_for_mag_(
 
 
 /*
- * Function: core_get_point_for_mag
- * Compute a point radius and luminosity from a observed magnitude.
- *
- * The function is almost linear, but when the points get too small,
- * I make the curve go to zero faster, so that the bright stars get a
- * higher contrast.  Also for very small points, we use a minimum radius
- * and instead lower the luminance.
+ * Point for mag lookup table.
  *
- * Parameters:
- *   mag       - The observed magnitude.
- *   radius    - Output radius in window pixels.
- *   luminance - Output luminance from 0 to 1, gamma corrected.  Ignored if
- *               set to NULL.
+ * Computing the points radius and luminance for each rendered star is
+ * expensive, so we cache the values in a table indexed by magnitude, that
+ * is rebuilt every time one of the parameters of the computation changes.
  */
-void core_get_point_for_mag(double mag, double *radius, double *luminance)
+
+#define POINT_LUT_MAG_MIN   (-32)
+#define POINT_LUT_MAG_MAX   (+64)
+#define POINT_LUT_STEPS     32 // Number of values per magnitude.
+#define POINT_LUT_SIZE \
+    ((POINT_LUT_MAG_MAX - POINT_LUT_MAG_MIN) * POINT_LUT_STEPS + 1)
+
+// All the values the points radius and luminance depend on.
+typedef struct {
+    double          star_linear_scale;
+    double          star_scale_screen_factor;
+    double          star_relative_scale;
+    tonemapper_t    tonemapper;
+    double          light_grasp;
+    double          magnification;
+    double          win_pixels_scale;
+    double          min_point_radius;
+    double          max_point_radius;
+    double          skip_point_radius;
+    double          point_dim_factor;
+} point_lut_key_t;
+
+static struct {
+    bool            valid;
+    point_lut_key_t key;
+    double          skip_mag; // Points fainter than that are not rendered.
+    struct {
+        float raw_radius;   // Radius without lower limit.
+        float radius;
+        float luminance;
+    } values[POINT_LUT_SIZE];
+} g_point_lut = {};
+
+static void point_lut_get_key(point_lut_key_t *key)
 {
-    double ld, r;
-    const double r_min = core->min_point_radius / core->win_pixels_scale;
+    memset(key, 0, sizeof(*key)); // So that we can use memcmp.
+    key->star_linear_scale = core->star_linear_scale;
+    key->star_scale_screen_factor = core->star_scale_screen_factor;
+    key->star_relative_scale = core->star_relative_scale;
+    key->tonemapper = core->tonemapper;
+    key->light_grasp = core->telescope.light_grasp;
+    key->magnification = core->telescope.magnification;
+    key->win_pixels_scale = core->win_pixels_scale;
+    key->min_point_radius = core->min_point_radius;
+    key->max_point_radius = core->max_point_radius;
+    key->skip_point_radius = core->skip_point_radius;
+    key->point_dim_factor = core->point_dim_factor;
+}
 
-    // Get radius and luminance without any contraint on the radius.
-    core_get_point_for_mag_(mag, &r, &ld);
+// Final radius and luminance from the value without any radius constraint.
+static void point_constrain(double r, double ld,
+                            double *radius, double *luminance)
+{
+    const double r_min = core->min_point_radius / core->win_pixels_scale;
 
     // If the radius is really too small, we don't render the star.
     if (r < core->skip_point_radius) {
@@ -588,6 +1167,119 @@ void core_get_point_for_mag(double mag, double *radius, double *luminance)
     if (luminance) *luminance = clamp(ld, 0, 1);
 }
 
+static double point_lut_get_mag(int i)
+{
+    return POINT_LUT_MAG_MIN + (double)i / POINT_LUT_STEPS;
+}
+
+/*
+ * Function: point_lut_mag_for_radius
+ * Compute the vmag for a given unconstrained radius from the table.
+ *
+ * Since the radius decreases with the magnitude, we can do a binary search
+ * and then interpolate between the two closest values.
+ */
+static double point_lut_mag_for_radius(double target_r)
+{
+    int i = 0, j = POINT_LUT_SIZE - 1, k;
+    double r1, r2;
+    if (g_point_lut.values[i].raw_radius <= target_r)
+        return POINT_LUT_MAG_MIN;
+    if (g_point_lut.values[j].raw_radius >= target_r)
+        return POINT_LUT_MAG_MAX;
+    while (j - i > 1) {
+        k = (i + j) / 2;
+        *(g_point_lut.values[k].raw_radius > target_r ? &i : &j) = k;
+    }
+    r1 = g_point_lut.values[i].raw_radius;
+    r2 = g_point_lut.values[j].raw_radius;
+    return mix(point_lut_get_mag(i), point_lut_get_mag(j),
+               (r1 - target_r) / (r1 - r2));
+}
+
+// Make sure the point lookup table is up to date.
+static void point_lut_update(void)
+{
+    point_lut_key_t key;
+    double r, ld, radius, luminance;
+    int i;
+
+    point_lut_get_key(&key);
+    if (g_point_lut.valid && !memcmp(&key, &g_point_lut.key, sizeof(key)))
+        return;
+    for (i = 0; i < POINT_LUT_SIZE; i++) {
+        core_get_point_for_mag_(point_lut_get_mag(i), &r, &ld);
+        point_constrain(r, ld, &radius, &luminance);
+        g_point_lut.values[i].raw_radius = r;
+        g_point_lut.values[i].radius = radius;
+        g_point_lut.values[i].luminance = luminance;
+    }
+    g_point_lut.key = key;
+    g_point_lut.valid = true;
+    g_point_lut.skip_mag = point_lut_mag_for_radius(core->skip_point_radius);
+}
+
+/*
+ * Function: core_get_point_for_mag
+ * Compute a point radius and luminosity from a observed magnitude.
+ *
+ * The function is almost linear, but when the points get too small,
+ * I make the curve go to zero faster, so that the bright stars get a
+ * higher contrast.  Also for very small points, we use a minimum radius
+ * and instead lower the luminance.
+ *
+ * Parameters:
+ *   mag       - The observed magnitude.
+ *   radius    - Output radius in window pixels.
+ *   luminance - Output luminance from 0 to 1, gamma corrected.  Ignored if
+ *               set to NULL.
+ */
+void core_get_point_for_mag(double mag, double *radius, double *luminance)
+{
+    double r, ld, x, f;
+    int i;
+
+    // Compute the value directly if we are outside the table.
+    if (!(mag >= POINT_LUT_MAG_MIN && mag < POINT_LUT_MAG_MAX)) {
+        core_get_point_for_mag_(mag, &r, &ld);
+        point_constrain(r, ld, radius, luminance);
+        return;
+    }
+
+    point_lut_update();
+    if (mag > g_point_lut.skip_mag) {
+        *radius = 0;
+        if (luminance) *luminance = 0;
+        return;
+    }
+    x = (mag - POINT_LUT_MAG_MIN) * POINT_LUT_STEPS;
+    i = (int)x;
+    f = x - i;
+    // Don't interpolate with a value past the skip limit.
+    if (g_point_lut.values[i + 1].radius == 0) f = 0;
+    *radius = mix(g_point_lut.values[i].radius,
+                  g_point_lut.values[i + 1].radius, f);
+    if (luminance) {
+        *luminance = mix(g_point_lut.values[i].luminance,
+                         g_point_lut.values[i + 1].luminance, f);
+    }
+}
+
+void core_get_point_params(point_params_t *params)
+{
+    const tonemapper_t *t = &core->tonemapper;
+    params->lum_scale = core_mag_to_lum_apparent(0, 0);
+    params->tm_p = t->p;
+    params->tm_scale = t->exposure / log(1.0 + t->p * t->lwmax);
+    params->linear_scale = core->star_linear_scale *
+                           core->star_scale_screen_factor;
+    params->relative_scale = core->star_relative_scale;
+    params->skip_radius = core->skip_point_radius;
+    params->min_radius = core->min_point_radius / core->win_pixels_scale;
+    params->max_radius = core->max_point_radius;
+    params->dim_factor = core->point_dim_factor;
+}
+
 /*
  * Function: compute_vmag_for_radius
  * Compute the vmag for a given screen radius.
@@ -600,25 +1292,38 @@ void core_get_point_for_mag(double mag, double *radius, double *luminance)
  */
 static double compute_vmag_for_radius(double target_r)
 {
-    // Compute by dichotomy.
-    const int max_iter = 32;
-    double m = 0, m1 = -128, m2 = 128.0;
-    double r, l;
-    const double delta = 0.001;
-    int i;
+    point_lut_update();
+    return point_lut_mag_for_radius(target_r);
+}
 
-    core_get_point_for_mag_(m1, &r, &l);
-    for (i = 0; i < max_iter; i++) {
-        m = (m1 + m2) / 2;
-        core_get_point_for_mag_(m, &r, &l);
-        if (fabs(r - target_r) < delta) return m;
-        *(r > target_r ? &m1 : &m2) = m;
-    }
-    if (i >= max_iter) {
-        LOG_D("Too many iterations! target_r: %f -> mag:%f",
-              target_r, m);
+/*
+ * Function: quality_update
+ * Update the adaptive quality controller with the last frame render time.
+ *
+ * We only use the CPU time spent in core_render, so that the idle time
+ * between frames when we render on demand doesn't count.  The quality
+ * goes down faster than it goes up, and we keep a dead band between the
+ * two thresholds to avoid oscillating between two levels.
+ */
+static void quality_update(double render_time)
+{
+    double budget, degrade = core->quality.degrade;
+
+    core->quality.frame_time = core->quality.frame_time ?
+        mix(core->quality.frame_time, render_time, 0.1) : render_time;
+    if (core->quality.target_fps <= 0) {
+        degrade = 0;
+    } else {
+        budget = 1.0 / core->quality.target_fps;
+        if (core->quality.frame_time > budget)
+            degrade += 0.02;
+        else if (core->quality.frame_time < budget * 0.6)
+            degrade -= 0.005;
+        degrade = clamp(degrade, 0, 1);
     }
-    return m;
+    if (degrade == core->quality.degrade) return;
+    core->quality.degrade = degrade;
+    module_changed(&core->obj, "quality");
 }
 
 /*
@@ -644,16 +1349,160 @@ static void win_to_observed(double x, double y, double p[3])
 }
 
 
+static int render_views(double win_w, double win_h, double pixel_scale,
+                        int nb, const core_view_t *views, const int *faces);
+
+// Max number of modules render tasks per frame.
+#define MAX_RENDER_TASKS 16
+
+static void render_tasks_block(void *user, int start, int end)
+{
+    const render_task_t *tasks = USER_GET(user, 0);
+    const int *ofs = USER_GET(user, 1); // Index of each task first block.
+    const int nb = *(int*)USER_GET(user, 2);
+    int b, k, i;
+
+    for (b = start; b < end; b++) {
+        for (k = 0; k < nb - 1 && ofs[k + 1] <= b; k++) {}
+        i = (b - ofs[k]) * tasks[k].block;
+        tasks[k].fn((void*)tasks[k].args, i,
+                    min(i + tasks[k].block, tasks[k].n));
+    }
+}
+
+/*
+ * Run the prepare tasks of all the modules we are about to render.
+ *
+ * All the tasks blocks go into a single parallel for on the worker pool,
+ * so that the modules don't have to wait for each other.  The modules are
+ * then rendered one after the other, in render order.
+ */
+static void prepare_modules(const painter_t *painter, bool reuse)
+{
+    render_task_t tasks[MAX_RENDER_TASKS];
+    int ofs[MAX_RENDER_TASKS + 1] = {}, nb = 0;
+    render_task_t *task;
+    obj_t *module;
+
+    DL_FOREACH(core->obj.children, module) {
+        if (!module->klass->prepare || nb >= MAX_RENDER_TASKS) continue;
+        if (reuse && !is_module_dynamic(module)) continue;
+        task = &tasks[nb];
+        memset(task, 0, sizeof(*task));
+        if (!module->klass->prepare(module, painter, task)) continue;
+        if (task->n <= 0) continue;
+        assert(task->block > 0 && task->fn);
+        ofs[nb + 1] = ofs[nb] + (task->n + task->block - 1) / task->block;
+        nb++;
+    }
+    if (!nb) return;
+    worker_parallel_for(ofs[nb], 1, USER_PASS(tasks, ofs, &nb),
+                        render_tasks_block);
+}
+
+// Max size of the dome cube map faces (px).
+#define DOME_MAX_FACE_SIZE 2048
+
+// Yaw and pitch of the dome cube map faces (deg).  The side faces are
+// horizontal, so that a dome looking at the zenith only needs five faces.
+static const double DOME_FACES[6][2] = {
+    {0, 0}, {90, 0}, {180, 0}, {-90, 0}, {0, 90}, {0, -90},
+};
+
+/*
+ * Render the fisheye projection through a cube map.
+ *
+ * Projecting all the vertices with the fisheye projection breaks the
+ * lines tessellation, and disables the GPU projection of the tiles, so
+ * instead we render the cube faces we need as 90° perspective views, and
+ * let the renderer warp them into the fisheye image in one pass.
+ *
+ * Return false if the renderer doesn't support it.
+ */
+static bool render_dome(double win_w, double win_h, double pixel_scale)
+{
+    const observer_t *obs = core->observer;
+    projection_t proj;
+    core_view_t views[6];
+    int i, nb = 0, faces[6], size;
+    double fb_w = win_w * pixel_scale, max_r, sep;
+
+    if (!core->rend || !core->rend->cubemap_init) return false;
+    core_get_proj(&proj);
+    // Same resolution as the fisheye at the center of the faces.
+    size = min(2 * fb_w / (2 * proj.scaling[0]), DOME_MAX_FACE_SIZE);
+    size = core->rend->cubemap_init(core->rend, size);
+    if (!size) return false;
+
+    // Only render the faces that intersect the window.
+    max_r = min(M_PI, hypot(proj.scaling[0], proj.scaling[1]) +
+                      fabs(obs->view_offset_alt));
+    for (i = 0; i < 6; i++) {
+        sep = eraSeps(DOME_FACES[i][0] * DD2R, DOME_FACES[i][1] * DD2R,
+                      0, obs->pitch);
+        if (sep - atan(sqrt(2)) >= max_r) continue;
+        faces[nb] = i;
+        views[nb++] = (core_view_t) {
+            .viewport = {0, 0, size / pixel_scale, size / pixel_scale},
+            .yaw = DOME_FACES[i][0] * DD2R,
+            .pitch = DOME_FACES[i][1] * DD2R - obs->pitch,
+            .roll = -obs->roll,
+            .fov = 90 * DD2R,
+        };
+    }
+    render_views(win_w, win_h, pixel_scale, nb, views, faces);
+    return true;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int core_render(double win_w, double win_h, double pixel_scale)
+{
+    const core_view_t view = {.viewport = {0, 0, win_w, win_h}};
+    recorder_on_render(win_w, win_h, pixel_scale);
+    if (core->proj == PROJ_FISHEYE &&
+            render_dome(win_w, win_h, pixel_scale))
+        return 0;
+    return core_render_views(win_w, win_h, pixel_scale, 1, &view);
+}
+
+int core_render_views(double win_w, double win_h, double pixel_scale,
+                      int nb, const core_view_t *views)
+{
+    return render_views(win_w, win_h, pixel_scale, nb, views, NULL);
+}
+
+/*
+ * Render a list of views.
+ *
+ * If faces is set, the views are rendered into these faces of the dome
+ * cube map, that is then warped into the window.
+ */
+static int render_views(double win_w, double win_h, double pixel_scale,
+                        int nb, const core_view_t *views, const int *faces)
 {
     PROFILE(core_render, 0);
     obj_t *module;
-    projection_t proj;
-    double t;
-    double max_vmag, hints_vmag;
-
-    // Used to make sure some values are not touched during render.
+    observer_t *obs = core->observer;
+    const core_view_t *view;
+    projection_t proj, pred_proj;
+    observer_t pred_obs;
+    painter_t painter, pred_painter;
+    double t, pred_yaw, pred_pitch, pred_fov;
+    double max_vmag, hints_vmag, start_time;
+    double degrade = core->quality.degrade;
+    int accuracy;
+    bool prefetch, reuse = false, dynamic, captured = false, scaled = false;
+    // The static layer only holds a single view.
+    const bool single = nb == 1 && !faces;
+    // No need to keep a layer of a view that moves.
+    const double dynres = single ? get_dynres_scale() : 1.0;
+    const bool use_layers = core->layers.enabled && single && dynres == 1;
+    int i, nb_done;
+    uint32_t layer_key = 0;
+    double rv2o[3][3], faces_rot[6][3][3] = {};
+
+    // Used to make sure some values are not touched during render, and to
+    // restore the ones we change for each view.
     struct {
         observer_t obs;
         double fov;
@@ -661,17 +1510,28 @@ int core_render(double win_w, double win_h, double pixel_scale)
         .obs = *core->observer,
         .fov = core->fov,
     };
-    (void)bck;
 
+    assert(nb > 0 && nb <= CORE_MAX_VIEWS);
+    recorder_push(NULL);
+    core_lock();
+    start_time = sys_get_unix_time();
+    accuracy = core->accuracy;
+    core->accuracy = core->render_accuracy;
     core->win_size[0] = win_w;
     core->win_size[1] = win_h;
     core->win_pixels_scale = pixel_scale;
-    core_get_proj(&proj);
 
-    observer_update(core->observer, true);
+    // Shared by all the views, that only change the observer orientation.
+    observer_update(obs, true);
+    mat3_copy(obs->rv2o, rv2o);
+    prefetch = single &&
+               get_predicted_view(&pred_yaw, &pred_pitch, &pred_fov);
     max_vmag = compute_vmag_for_radius(core->skip_point_radius);
     hints_vmag = compute_vmag_for_radius(core->show_hints_radius);
     hints_vmag += 4; // To keep compatibility for the moment!
+    // Lower the stars and labels density when the quality is reduced.
+    max_vmag -= degrade * 1.5;
+    hints_vmag -= degrade * 2.0;
 
     t = sys_get_unix_time();
     if (!core->prof.start_time) core->prof.start_time = t;
@@ -685,55 +1545,203 @@ int core_render(double win_w, double win_h, double pixel_scale)
 
     if (!core->rend)
         core->rend = render_gl_create();
-    labels_reset();
-
-    painter_t painter = {
-        .rend = core->rend,
-        .obs = core->observer,
-        .transform = &mat4_identity,
-        .fb_size = {win_w * pixel_scale, win_h * pixel_scale},
-        .pixel_scale = pixel_scale,
-        .proj = &proj,
-        .stars_limit_mag = max_vmag,
-        .hints_limit_mag = hints_vmag,
-        .hard_limit_mag = core->display_limit_mag,
-        .points_halo = 7.0,
-        .color = {1.0, 1.0, 1.0, 1.0},
-        .contrast = 1.0,
-        .lines_width = 1.0,
-        .flags = (is_below_horizon_hidden() ? PAINTER_HIDE_BELOW_HORIZON : 0),
-        .lines_glow = 0.2
-    };
-    painter_update_clip_info(&painter);
-    paint_prepare(&painter, win_w, win_h, pixel_scale);
 
-    DL_FOREACH(core->obj.children, module) {
-        obj_render(module, &painter);
+    for (i = 0; i < nb; i++) {
+        view = &views[i];
+        // Only the matrices are recomputed, since the time and location
+        // didn't change.
+        obs->yaw = bck.obs.yaw + view->yaw;
+        obs->pitch = bck.obs.pitch + view->pitch;
+        obs->roll = bck.obs.roll + view->roll;
+        observer_update(obs, true);
+        core->fov = view->fov ?: bck.fov;
+        core->win_size[0] = view->viewport[2];
+        core->win_size[1] = view->viewport[3];
+        if (faces) {
+            projection_init(&proj, PROJ_PERSPECTIVE, core->fov,
+                            view->viewport[2], view->viewport[3]);
+            mat3_mul(obs->ro2v, rv2o, faces_rot[faces[i]]);
+        } else {
+            core_get_proj(&proj);
+        }
+
+        painter = (painter_t) {
+            .rend = core->rend,
+            .obs = obs,
+            .transform = &mat4_identity,
+            .fb_size = {view->viewport[2] * pixel_scale,
+                        view->viewport[3] * pixel_scale},
+            .pixel_scale = pixel_scale,
+            .proj = &proj,
+            .stars_limit_mag = max_vmag,
+            .hints_limit_mag = hints_vmag,
+            .hard_limit_mag = core->display_limit_mag,
+            .points_halo = 7.0,
+            .color = {1.0, 1.0, 1.0, 1.0},
+            .contrast = 1.0,
+            .lines_width = 1.0,
+            .flags = (is_below_horizon_hidden() ?
+                      PAINTER_HIDE_BELOW_HORIZON : 0),
+            .lines_glow = degrade < 0.5 ? 0.2 : 0.0,
+            .degrade = degrade,
+        };
+
+        // Painter for the predicted view.  Update its clip info first, so
+        // that the clipping tests cache keeps the current view.
+        if (prefetch) {
+            pred_obs = *obs;
+            pred_obs.yaw = pred_yaw;
+            pred_obs.pitch = pred_pitch;
+            observer_update(&pred_obs, true);
+            get_proj_for_fov(&pred_proj, pred_fov);
+            pred_painter = painter;
+            pred_painter.obs = &pred_obs;
+            pred_painter.proj = &pred_proj;
+            painter_update_clip_info(&pred_painter);
+            painter.prefetch = &pred_painter;
+        }
+        painter_update_clip_info(&painter);
+        if (i == 0) paint_prepare(&painter, win_w, win_h, pixel_scale);
+        if (dynres < 1) scaled = paint_scaled_begin(&painter, dynres);
+        if (faces) paint_cubemap_face(&painter, faces[i]);
+        else if (nb > 1) paint_set_viewport(&painter, view->viewport);
+        areas_set_offset(core->areas, view->viewport);
+        labels_set_view(i, nb);
+
+        // If nothing changed in the static modules since the last frame,
+        // we only draw their layer, and keep their labels and picking
+        // areas.
+        if (i == 0) {
+            if (request_get_nb_running(&nb_done) ||
+                    nb_done != core->redraw.nb_requests_done)
+                core->layers.dirty = true;
+            layer_key = get_layer_key(&painter);
+            reuse = use_layers && core->layers.valid &&
+                    !core->layers.dirty && layer_key == core->layers.key &&
+                    fabs(obs->tt - core->layers.tt) <=
+                        get_layer_max_dt(&painter) &&
+                    paint_layer_draw(&painter);
+            if (!reuse) {
+                labels_reset();
+                clear_picking();
+                core->layers.valid = false;
+            }
+        }
+
+        prepare_modules(&painter, reuse);
+
+        // The modules are sorted by render order, so the renderer must not
+        // mix the items of two modules.
+        DL_FOREACH(core->obj.children, module) {
+            dynamic = is_module_dynamic(module);
+            if (reuse && !dynamic) continue;
+            // The labels and ui stay at the full resolution.
+            if (scaled && dynamic) {
+                paint_scaled_end(&painter);
+                scaled = false;
+            }
+            // Capture the static modules before the first dynamic one.
+            if (!reuse && dynamic && !captured && use_layers) {
+                captured = true;
+                core->layers.valid = paint_layer_capture(&painter);
+                core->layers.dirty = false;
+                core->layers.key = layer_key;
+                core->layers.tt = obs->tt;
+            }
+            if (module->klass->load && module->klass->render)
+                module_load(module);
+            t = sys_get_unix_time();
+            obj_render(module, &painter);
+            prof_get_module(module)->render = sys_get_unix_time() - t;
+            paint_barrier(&painter);
+        }
+        if (scaled) paint_scaled_end(&painter);
+
+        // Render the viewport cap for debugging.
+        if ((0)) {
+            paint_cap(&painter, FRAME_ICRF,
+                      painter.clip_info[FRAME_ICRF].bounding_cap);
+        }
+
+        assert(obs->yaw == bck.obs.yaw + view->yaw);
+        assert(obs->pitch == bck.obs.pitch + view->pitch);
+        assert(core->fov == (view->fov ?: bck.fov));
     }
 
-    // Render the viewport cap for debugging.
-    if ((0)) {
-        paint_cap(&painter, FRAME_ICRF,
-                  painter.clip_info[FRAME_ICRF].bounding_cap);
+    // Restore the main view.
+    obs->yaw = bck.obs.yaw;
+    obs->pitch = bck.obs.pitch;
+    obs->roll = bck.obs.roll;
+    observer_update(obs, true);
+    core->fov = bck.fov;
+    core->win_size[0] = win_w;
+    core->win_size[1] = win_h;
+    areas_set_offset(core->areas, VEC(0, 0));
+    labels_set_view(0, 1);
+
+    // Warp the dome faces into the window.  The picking areas are in the
+    // faces coordinates, so we can't use them.
+    if (faces) {
+        core_get_proj(&proj);
+        painter.proj = &proj;
+        paint_cubemap_warp(&painter, faces_rot);
+        clear_picking();
     }
 
     // Flush all rendering pipeline
+    t = sys_get_unix_time();
     paint_finish(&painter);
+    core->prof.flush[core->prof.frame % PROF_NB_FRAMES] =
+        sys_get_unix_time() - t;
 
     // Do post render (e.g. for GUI)
     DL_FOREACH(core->obj.children, module) {
-        if (module->klass->post_render)
+        if (module->klass->post_render) {
+            t = sys_get_unix_time();
             module->klass->post_render(module, &painter);
+            prof_get_module(module)->post_render = sys_get_unix_time() - t;
+        }
+    }
+
+    arena_reset(&core->frame_arena);
+    if (core->prof.allocs_start >= 0) {
+        core->prof.allocs[core->prof.frame % PROF_NB_FRAMES] =
+            allocs_get_count() - core->prof.allocs_start;
     }
 
-    assert(bck.obs.yaw == core->observer->yaw);
-    assert(bck.obs.pitch == core->observer->pitch);
-    assert(bck.fov == core->fov);
+    // The frames reusing the static layer don't tell anything about the
+    // time needed to render the sky.
+    if (!reuse) quality_update(sys_get_unix_time() - start_time);
+    // Keep rendering until we are back to the full resolution.
+    core->dynres.scale = dynres;
+    core->redraw.dirty = core->quality.degrade != degrade || dynres < 1;
+
+    // Load the data of at most one module per frame, now that the frame
+    // is rendered, so that they are ready when we need them.
+    DL_FOREACH(core->obj.children, module) {
+        if (module_load(module)) {
+            core->redraw.dirty = core->layers.dirty = true;
+            break;
+        }
+    }
+    // Only the static modules report the luminance for the eye adaptation.
+    if (!reuse) core->redraw.rendered = true;
+    core->redraw.obs_hash = obs->hash;
+    core->redraw.fov = core->fov;
+    request_get_nb_running(&core->redraw.nb_requests_done);
+    core->accuracy = accuracy;
+    core_unlock();
+    recorder_pop();
     return 0;
 }
 
+void *core_frame_alloc(size_t size)
+{
+    return arena_alloc(&core->frame_arena, size);
+}
+
 EMSCRIPTEN_KEEPALIVE
-void core_on_mouse(int id, int state, double x, double y)
+static void dispatch_mouse(int id, int state, double x, double y)
 {
     obj_t *module;
     DL_FOREACH(core->obj.children, module) {
@@ -743,8 +1751,55 @@ void core_on_mouse(int id, int state, double x, double y)
     }
 }
 
-EMSCRIPTEN_KEEPALIVE
-void core_on_key(int key, int action)
+static void on_mouse(int id, int state, double x, double y)
+{
+    int i;
+    typeof(core->inputs.moves[0]) *move = NULL;
+
+    core->redraw.dirty = true;
+    for (i = 0; i < core->inputs.nb_moves; i++) {
+        if (core->inputs.moves[i].id == id) {
+            move = &core->inputs.moves[i];
+            break;
+        }
+    }
+    if (!move && core->inputs.nb_moves < ARRAY_SIZE(core->inputs.moves)) {
+        move = &core->inputs.moves[core->inputs.nb_moves++];
+        *move = (typeof(*move)) { .id = id, .state = state };
+        dispatch_mouse(id, state, x, y);
+        return;
+    }
+    if (!move) { // No more slots, don't coalesce.
+        dispatch_mouse(id, state, x, y);
+        return;
+    }
+
+    if (state == -1 || state == move->state) {
+        move->pos[0] = x;
+        move->pos[1] = y;
+        move->pending = true;
+        return;
+    }
+    // State change: flush the pending move first to keep the order.
+    if (move->pending) {
+        dispatch_mouse(id, move->state, move->pos[0], move->pos[1]);
+        move->pending = false;
+    }
+    move->state = state;
+    dispatch_mouse(id, state, x, y);
+    // Release the slot of ended touches, since their id are not reused.
+    if (state == 0)
+        *move = core->inputs.moves[--core->inputs.nb_moves];
+}
+
+void core_on_mouse(int id, int state, double x, double y)
+{
+    recorder_push("m %d %d %.17g %.17g", id, state, x, y);
+    on_mouse(id, state, x, y);
+    recorder_pop();
+}
+
+static void on_key(int key, int action)
 {
     static char *SC[][3] = {
         {"A", "core.atmosphere"},
@@ -763,20 +1818,22 @@ void core_on_key(int key, int action)
     int i;
     bool v;
     obj_t *module;
-    const char *attr;
+    const attribute_t *attr;
     char buf[128];
 
     core->inputs.keys[key] = (action != KEY_ACTION_UP);
+    core->redraw.dirty = true;
 
     if (core->gui_want_capture_mouse) return;
     if (action != KEY_ACTION_DOWN) return;
 
     for (i = 0; i < ARRAY_SIZE(SC); i++) {
         if (SC[i][0][0] == key) {
-            attr = SC[i][2] ?: "visible";
             module = core_get_module(SC[i][1]);
-            obj_get_attr(module, attr, &v);
-            obj_set_attr(module, attr, !v);
+            attr = obj_get_attr_(module, SC[i][2] ?: "visible");
+            obj_attr_get(module, attr, &v);
+            v = !v;
+            obj_attr_set(module, attr, &v);
             return;
         }
     }
@@ -786,9 +1843,19 @@ void core_on_key(int key, int action)
     }
 }
 
+EMSCRIPTEN_KEEPALIVE
+void core_on_key(int key, int action)
+{
+    recorder_push("k %d %d", key, action);
+    on_key(key, action);
+    recorder_pop();
+}
+
 void core_on_char(uint32_t c)
 {
     int i;
+    recorder_push("c %u", c);
+    core->redraw.dirty = true;
     if (c > 0 && c < 0x10000) {
         for (i = 0; i < ARRAY_SIZE(core->inputs.chars); i++) {
             if (!core->inputs.chars[i]) {
@@ -797,10 +1864,21 @@ void core_on_char(uint32_t c)
             }
         }
     }
+    recorder_pop();
 }
 
 EMSCRIPTEN_KEEPALIVE
 void core_on_zoom(double k, double x, double y)
+{
+    recorder_push("z %.17g %.17g %.17g", k, x, y);
+    core->redraw.dirty = true;
+    core->inputs.zoom = (core->inputs.zoom ?: 1.0) * k;
+    core->inputs.zoom_pos[0] = x;
+    core->inputs.zoom_pos[1] = y;
+    recorder_pop();
+}
+
+static void apply_zoom(double k, double x, double y)
 {
     double fov, pos_start[3], pos_end[3];
     double sal, saz, dal, daz;
@@ -823,6 +1901,25 @@ void core_on_zoom(double k, double x, double y)
     module_changed(&core->observer->obj, "yaw");
 }
 
+// Process the mouse moves and zooms received since the last update.
+static void flush_inputs(void)
+{
+    int i;
+    typeof(core->inputs.moves[0]) *move;
+
+    for (i = 0; i < core->inputs.nb_moves; i++) {
+        move = &core->inputs.moves[i];
+        if (!move->pending) continue;
+        move->pending = false;
+        dispatch_mouse(move->id, move->state, move->pos[0], move->pos[1]);
+    }
+    if (core->inputs.zoom) {
+        apply_zoom(core->inputs.zoom, core->inputs.zoom_pos[0],
+                   core->inputs.zoom_pos[1]);
+        core->inputs.zoom = 0;
+    }
+}
+
 double core_mag_to_illuminance(double vmag)
 {
     /*
@@ -959,10 +2056,52 @@ void core_report_vmag_in_fov(double vmag, double r, double sep)
 
 void core_report_luminance_in_fov(double lum, bool fast_adaptation)
 {
-    if (lum > core->lwmax) {
-        core->fast_adaptation = fast_adaptation;
-        core->lwmax = lum;
+    core_report_luminance_n(1, &lum, NULL, fast_adaptation);
+}
+
+void core_report_luminance_n(int n, const double *lum, const double *weight,
+                             bool fast_adaptation)
+{
+    int i, bin;
+    const double scale = LUM_HIST_SIZE / (LUM_HIST_LOG_MAX - LUM_HIST_LOG_MIN);
+
+    for (i = 0; i < n; i++) {
+        // Values under the min adaptation have no effect anyway.
+        if (!(lum[i] > core->lwmax_min)) continue;
+        bin = (log10(lum[i]) - LUM_HIST_LOG_MIN) * scale;
+        bin = clamp(bin, 0, LUM_HIST_SIZE - 1);
+        core->lum_hist.weight[bin] += weight ? weight[i] : 1;
+        if (lum[i] > core->lum_hist.max[bin]) {
+            core->lum_hist.max[bin] = lum[i];
+            core->lum_hist.fast[bin] = fast_adaptation;
+        }
+    }
+}
+
+/*
+ * Compute the adaptation luminance from the histogram, and reset it for
+ * the next frame.
+ *
+ * We go down from the brightest bin until we reach the needed weight, and
+ * use the max luminance reported in that bin, so that with a weight of
+ * one we get the exact max of all the reported values.
+ */
+static double lum_hist_get_lwmax(bool *fast)
+{
+    int i;
+    double weight = 0, ret = core->lwmax_min;
+
+    *fast = false;
+    for (i = LUM_HIST_SIZE - 1; i >= 0; i--) {
+        weight += core->lum_hist.weight[i];
+        if (weight > 0 && weight >= core->lwmax_weight) {
+            ret = max(ret, core->lum_hist.max[i]);
+            *fast = core->lum_hist.fast[i];
+            break;
+        }
     }
+    memset(&core->lum_hist, 0, sizeof(core->lum_hist));
+    return ret;
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -1056,6 +2195,7 @@ static obj_klass_t core_klass = {
     .get = core_get,
     .get_by_oid = core_get_by_oid,
     .list = core_list,
+    .query = core_query,
     .add_data_source = core_add_data_source,
     .attributes = (attribute_t[]) {
         PROPERTY(utcoffset, TYPE_INT, MEMBER(core_t, utc_offset),
@@ -1070,8 +2210,15 @@ static obj_klass_t core_klass = {
                  MEMBER(core_t, dso_hints_mag_offset)),
         PROPERTY(progressbars, TYPE_JSON, .fn = core_fn_progressbars),
         PROPERTY(fps, TYPE_FLOAT, MEMBER(core_t, prof.fps)),
+        PROPERTY(draw_calls, TYPE_INT, MEMBER(core_t, prof.draw_calls)),
+        PROPERTY(timings, TYPE_JSON, .fn = core_fn_timings),
+        PROPERTY(render_stats, TYPE_JSON, .fn = core_fn_render_stats),
+        PROPERTY(memory_stats, TYPE_JSON, .fn = core_fn_memory_stats),
+        PROPERTY(gpu_timers, TYPE_BOOL, MEMBER(core_t, prof.gpu_timers)),
         PROPERTY(clicks, TYPE_INT, MEMBER(core_t, clicks)),
         PROPERTY(ignore_clicks, TYPE_BOOL, MEMBER(core_t, ignore_clicks)),
+        PROPERTY(gpu_picking, TYPE_BOOL, MEMBER(core_t, gpu_picking),
+                 .on_changed = core_on_gpu_picking_changed),
         PROPERTY(zoom, TYPE_FLOAT, MEMBER(core_t, zoom)),
         PROPERTY(test, TYPE_BOOL, MEMBER(core_t, test)),
         PROPERTY(exposure_scale, TYPE_FLOAT, MEMBER(core_t, exposure_scale)),
@@ -1087,6 +2234,30 @@ static obj_klass_t core_klass = {
         PROPERTY(flip_view_horizontal, TYPE_BOOL,
                  MEMBER(core_t, flip_view_horizontal)),
         PROPERTY(mount_frame, TYPE_ENUM, MEMBER(core_t, mount_frame)),
+        PROPERTY(threads_count, TYPE_INT, MEMBER(core_t, threads_count),
+                 .on_changed = core_on_threads_count_changed),
+        PROPERTY(jobs_budget, TYPE_FLOAT, MEMBER(core_t, jobs_budget)),
+        PROPERTY(target_fps, TYPE_FLOAT,
+                 MEMBER(core_t, quality.target_fps)),
+        PROPERTY(quality, TYPE_FLOAT, MEMBER(core_t, quality.degrade)),
+        PROPERTY(accuracy, TYPE_ENUM, MEMBER(core_t, accuracy)),
+        PROPERTY(render_accuracy, TYPE_ENUM,
+                 MEMBER(core_t, render_accuracy)),
+        PROPERTY(layers_cache, TYPE_BOOL, MEMBER(core_t, layers.enabled)),
+        PROPERTY(dynamic_resolution, TYPE_BOOL,
+                 MEMBER(core_t, dynres.enabled)),
+        PROPERTY(images_cache_size, TYPE_INT,
+                 MEMBER(core_t, images_cache_size),
+                 .on_changed = core_on_cache_size_changed),
+        PROPERTY(stars_cache_size, TYPE_INT,
+                 MEMBER(core_t, stars_cache_size),
+                 .on_changed = core_on_cache_size_changed),
+        PROPERTY(dsos_cache_size, TYPE_INT,
+                 MEMBER(core_t, dsos_cache_size),
+                 .on_changed = core_on_cache_size_changed),
+        PROPERTY(persistent_cache_size, TYPE_INT,
+                 MEMBER(core_t, persistent_cache_size),
+                 .on_changed = core_on_persistent_cache_size_changed),
         {}
     }
 };
@@ -1149,7 +2320,50 @@ static void test_info(void)
     obj_get_info(obj, core->observer, INFO_VMAG, &vmag);
 }
 
+// Check that the points lookup table matches the direct computation.
+static void test_point_lut(void)
+{
+    double mag, r, ld, radius, luminance, skip_mag;
+    core_init(100, 100, 1.0);
+    skip_mag = compute_vmag_for_radius(core->skip_point_radius);
+    for (mag = -5; mag < 20; mag += 0.0731) {
+        if (fabs(mag - skip_mag) < 0.05) continue;
+        core_get_point_for_mag_(mag, &r, &ld);
+        point_constrain(r, ld, &r, &ld);
+        core_get_point_for_mag(mag, &radius, &luminance);
+        test_float(radius, r, 0.01);
+        test_float(luminance, ld, 0.01);
+    }
+}
+
+// Check that the point params give the same result as the shader would.
+static void test_point_params(void)
+{
+    double mag, r, ld, radius, luminance;
+    point_params_t p;
+    core_init(100, 100, 1.0);
+    core_get_point_params(&p);
+    for (mag = -5; mag < 20; mag += 0.0731) {
+        ld = p.lum_scale * pow(10.0, -0.4 * mag);
+        ld = max(log(1.0 + p.tm_p * ld) * p.tm_scale, 0.0);
+        r = p.linear_scale * pow(ld, p.relative_scale / 2.0);
+        if (r < p.skip_radius) r = ld = 0;
+        if (r > 0 && r < p.min_radius) {
+            ld *= pow(r / p.min_radius, p.dim_factor);
+            r = p.min_radius;
+        }
+        ld = clamp(pow(ld, 1.0 / 2.2), 0, 1);
+        r = min(r, p.max_radius);
+        core_get_point_for_mag_(mag, &radius, &luminance);
+        point_constrain(radius, luminance, &radius, &luminance);
+        test_float(radius, r, 0.001);
+        test_float(luminance, ld, 0.001);
+    }
+}
+
 TEST_REGISTER(NULL, test_core, TEST_AUTO);
+TEST_REGISTER(NULL, test_point_lut, TEST_AUTO);
+TEST_REGISTER(NULL, test_point_params, TEST_AUTO);
 TEST_REGISTER(NULL, test_vec, TEST_AUTO);
 TEST_REGISTER(NULL, test_basic, TEST_AUTO);
 TEST_REGISTER(NULL, test_info, TEST_AUTO);
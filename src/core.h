@@ -11,6 +11,7 @@
 
 #include "areas.h"
 #include "calendar.h"
+#include "occultations.h"
 #include "events.h"
 #include "frames.h"
 #include "labels.h"
@@ -20,6 +21,7 @@
 #include "observer.h"
 #include "obj.h"
 #include "module.h"
+#include "search.h"
 #include "otypes.h"
 #include "bayer.h"
 #include "telescope.h"
@@ -28,6 +30,14 @@
 
 typedef struct core core_t;
 
+// Number of frames kept in the core profiling timings.
+#define PROF_NB_FRAMES 64
+
+// Size and range (in log10 of cd/m²) of the eye adaptation histogram.
+#define LUM_HIST_SIZE 64
+#define LUM_HIST_LOG_MIN -6.0
+#define LUM_HIST_LOG_MAX 10.0
+
 extern core_t *core;    // Global core object.
 
 /******* Section: Core ****************************************************/
@@ -56,10 +66,18 @@ struct core
     double          display_limit_mag;
 
     tonemapper_t    tonemapper;
-    bool            fast_adaptation; // True if eye adpatation is fast
     double          tonemapper_p;
-    double          lwmax; // Max visible luminance.
+    double          lwmax; // Adaptation luminance of the last frame.
     double          lwmax_min; // Min value for lwmax.
+    // Cumulated weight of the brightest reported luminances needed to
+    // set the adaptation.  With 1, any single report is enough.
+    double          lwmax_weight;
+    // Histogram of the luminances reported during the frame.
+    struct {
+        double      weight[LUM_HIST_SIZE];
+        double      max[LUM_HIST_SIZE]; // Max luminance of each bin.
+        bool        fast[LUM_HIST_SIZE]; // Fast adaptation for the max.
+    } lum_hist;
     double          lwsky_average;  // Current average sky luminance
     double          max_point_radius; // Max radius in pixel.
     double          min_point_radius;
@@ -87,12 +105,66 @@ struct core
         double      start_time; // Start of measurement window (sec)
         int         nb_frames;  // Number of frames elapsed.
         double      fps;        // Averaged FPS counter.
+        int         draw_calls; // Number of draw calls of the last frame.
+        bool        gpu_timers; // Measure the gpu time of the rendering.
+        // Ring buffers of the CPU time spent in each module and in the
+        // rendering flush during the last PROF_NB_FRAMES frames (sec).
+        // The current frame is at index (frame % PROF_NB_FRAMES).
+        struct module_prof {
+            const obj_t *module;
+            float init; // Time spent creating the module at startup.
+            float load; // Time spent in the module delayed loading.
+            struct module_prof_frame {
+                float update;
+                float render;
+                float post_render;
+            } frames[PROF_NB_FRAMES];
+        } modules[32];
+        int         nb_modules;
+        float       flush[PROF_NB_FRAMES];
+        // Number of heap allocations during each frame, if we count them
+        // (see allocs.h).
+        int         allocs[PROF_NB_FRAMES];
+        int64_t     allocs_start;
+        int         frame; // Number of updates so far.
+        float       startup; // Total time spent in core_init.
     } prof;
 
+    // Scratch memory reset at the end of each frame.  See
+    // <core_frame_alloc>.
+    arena_t         frame_arena;
+
+    // Render on demand state.  See <core_needs_render>.
+    struct {
+        bool        dirty;    // Set when anything changed since last render.
+        bool        rendered; // Set when we rendered since last update.
+        uint64_t    obs_hash; // Observer hash of the last rendered frame.
+        double      fov;      // Fov of the last rendered frame.
+        int         nb_requests_done; // Completed requests at last render.
+    } redraw;
+
+    // Static layer cache.  See <core_render>.
+    struct {
+        bool        enabled;  // Set with the 'layers_cache' attribute.
+        bool        valid;    // Set when the renderer holds a layer.
+        bool        dirty;    // Set when the static modules changed.
+        uint32_t    key;      // Hash of the view of the layer.
+        double      tt;       // Time of the layer.
+    } layers;
+
+    // Dynamic resolution.  See <core_render>.
+    struct {
+        bool        enabled;  // Set with the 'dynamic_resolution' attribute.
+        double      scale;    // Resolution scale of the last frame.
+    } dynres;
+
     // Number of clicks so far.  This is just so that we can wait for clicks
     // from the ui.
     int clicks;
     bool ignore_clicks; // Don't select on click.
+    // Pick the meshes with the renderer instead of the areas.
+    // See <core_get_obj_at>.
+    bool gpu_picking;
 
     struct {
         struct {
@@ -102,6 +174,18 @@ struct core
         } touches[2];
         bool        keys[512]; // Table of all key state.
         uint32_t    chars[16]; // Unicode characters.
+
+        // Mouse moves and zooms received since the last update.  They are
+        // coalesced and only processed once in core_update.
+        struct {
+            int     id;
+            int     state;      // Last dispatched state.
+            double  pos[2];
+            bool    pending;
+        } moves[4];
+        int         nb_moves;
+        double      zoom;       // Accumulated zoom factor, or zero.
+        double      zoom_pos[2];
     } inputs;
     bool            gui_want_capture_mouse;
 
@@ -125,17 +209,71 @@ struct core
     // Zoom movement. -1 to zoom out, +1 to zoom in.
     double zoom;
 
+    // Smoothed view velocities, used to prefetch the tiles of the view we
+    // are moving to.
+    struct {
+        double      yaw, pitch, fov;    // Values at the previous update.
+        double      v_yaw, v_pitch;     // rad/s.
+        double      v_log_fov;          // Zoom speed (1/s).
+    } motion;
+
     // Maintains a list of clickable/hoverable areas.
     areas_t         *areas;
 
     // FRAME_OBSERVED for altaz mount.
     int mount_frame;
 
+    // Number of threads of the worker pool (0 for automatic).
+    int threads_count;
+
+    // Time spent each frame running the background jobs (sec).  See
+    // <jobs_run>.
+    double jobs_budget;
+
+    // Adaptive quality controller.  We measure the time spent in
+    // core_render and lower the rendering quality when it goes above the
+    // frame budget.  See <painter_t.degrade>.
+    struct {
+        double target_fps; // Zero to disable the controller.
+        double frame_time; // Smoothed render time (sec).
+        double degrade;    // Current quality reduction in [0, 1].
+    } quality;
+
+    // Accuracy tier of the positions computations, and the one we use
+    // while rendering.  See <ACCURACY>.
+    int accuracy;
+    int render_accuracy;
+
+    // Sizes of the tiles caches (MB).  See <hips_set_cache_size>.
+    int images_cache_size;
+    int stars_cache_size;
+    int dsos_cache_size;
+    // Max size of the persistent requests cache (MB).
+    // See <request_set_cache_max_size>.
+    int persistent_cache_size;
+
     // Can be used for debugging.  It's conveniant to have an exposed test
     // attribute.
     bool test;
 };
 
+/*
+ * Enum: ACCURACY
+ * Accuracy tiers of the positions computations.
+ *
+ * ACCURACY_RENDER      - Errors below the size of a pixel on screen.  The
+ *                        core switches to it while rendering.
+ * ACCURACY_PRECISE     - Sub arcsecond.  The default, so that the API
+ *                        queries and the calendar stay precise.
+ * ACCURACY_REFERENCE   - Evaluate the full theories at each call, without
+ *                        the cached interpolations.
+ */
+enum {
+    ACCURACY_RENDER     = 0,
+    ACCURACY_PRECISE    = 1,
+    ACCURACY_REFERENCE  = 2,
+};
+
 enum {
     KEY_ACTION_UP      = 0,
     KEY_ACTION_DOWN    = 1,
@@ -202,11 +340,160 @@ void core_observer_update();
  */
 void core_set_view_offset(double center_y_offset);
 
+/*
+ * Function: core_render
+ * Render the current frame.
+ *
+ * If the 'layers_cache' attribute is set, the modules rendered before the
+ * labels (the surveys, stars, planets, lines...) are rendered into an
+ * offscreen layer, and the next frames only draw this layer and the
+ * modules on top of it (labels, pointer and ui), as long as the view
+ * didn't change, the time stayed within half a pixel of the sky motion,
+ * and nothing changed in the static modules.  This makes the frames that
+ * only update the overlays, like the hovering, much cheaper.
+ *
+ * If the 'dynamic_resolution' attribute is set, the same modules are
+ * rendered at a lower resolution and upscaled while the view moves fast
+ * and the frames go above the 'target_fps' budget.  The labels and the ui
+ * stay at the full resolution, and we go back to it as soon as the view
+ * settles.
+ */
 int core_render(double win_w, double win_h, double pixel_scale);
-// x and y in screen coordinates.
+
+// Max number of views rendered by <core_render_views>.
+#define CORE_MAX_VIEWS 32
+
+/*
+ * Type: core_view_t
+ * One of the views rendered by <core_render_views>.
+ *
+ * Attributes:
+ *   viewport   - Rect of the view in the window (x, y, w, h), with the
+ *                origin at the top left.
+ *   yaw        - Offset added to the observer yaw (rad).
+ *   pitch      - Offset added to the observer pitch (rad).
+ *   roll       - Offset added to the observer roll (rad).
+ *   fov        - Fov of the view, or zero to use the core fov (rad).
+ */
+typedef struct core_view {
+    double viewport[4];
+    double yaw;
+    double pitch;
+    double roll;
+    double fov;
+} core_view_t;
+
+/*
+ * Function: core_render_views
+ * Render several views of the sky in the same frame.
+ *
+ * For example the channels of a dome projector, or a split screen.  The
+ * observer, the time dependent values and the objects positions are only
+ * computed once, and the views share the modules data and tiles caches.
+ * Each view then only culls, projects and draws what it sees, and lays
+ * out its own labels.
+ *
+ * The static layer cache is disabled when rendering several views, and
+ * the picking areas are in window space, but the interactive functions
+ * (like <core_get_obj_at>) only know about the main view.
+ *
+ * Parameters:
+ *   win_w          - Window width.
+ *   win_h          - Window height.
+ *   pixel_scale    - Window pixel scale.
+ *   nb             - Number of views, up to CORE_MAX_VIEWS.
+ *   views          - The views.
+ */
+int core_render_views(double win_w, double win_h, double pixel_scale,
+                      int nb, const core_view_t *views);
+
+/*
+ * Function: core_lock
+ * Lock the core shared state
+ *
+ * The modules, the catalogs and the tiles caches are shared by all the
+ * threads, and only the observers can be owned by a thread.  <core_update>
+ * and <core_render> hold the lock for the whole frame, and <obj_get_info>
+ * holds it while querying the object, so that other threads can compute
+ * objects informations in parallel to the rendering.  For example:
+ *
+ *   observer_t *obs = (observer_t*)obj_clone(&core->observer->obj);
+ *   obj_set_attr(&obs->obj, "utc", utc);
+ *   obj_get_info(obj, obs, INFO_RADEC, radec);
+ *
+ * Each thread should use its own observer, since <observer_update> is
+ * done outside of the lock.  Any other access to the core from a thread
+ * (obj_get, obj_get_pvo, attributes...) should be done inside a
+ * core_lock / core_unlock block.  The lock is recursive.
+ */
+void core_lock(void);
+
+/*
+ * Function: core_unlock
+ * Release the lock taken with <core_lock>.
+ */
+void core_unlock(void);
+
+/*
+ * Function: core_frame_alloc
+ * Allocate temporary memory that stays valid until the end of the frame.
+ *
+ * The memory is released at the end of <core_render>, so there is no need
+ * to free it.  This is faster than malloc for the per frame temporary
+ * arrays, and once the frames memory usage is stable it doesn't do any
+ * heap allocation.  Should only be used from the main thread.
+ */
+void *core_frame_alloc(size_t size);
+
+/*
+ * Function: core_needs_render
+ * Test whether the next frame would be different from the last rendered one
+ *
+ * The embedder can use it after <core_update> to skip <core_render> when
+ * the view and the time are still, for example:
+ *
+ *   core_update(dt);
+ *   if (core_needs_render()) core_render(w, h, scale);
+ *
+ * We need a new frame if the observer or the fov changed, a module attribute
+ * changed, a fader or an animation is running, some data is still loading,
+ * or we got some input events.  Since the core doesn't know about the
+ * canvas, the embedder should always render after a resize.
+ */
+bool core_needs_render(void);
+
+/*
+ * Function: core_layers_on_changed
+ * Notify the core that an object attribute changed
+ *
+ * Called by <module_changed>, so that we can invalidate the static layer
+ * if the change can affect it.
+ */
+void core_layers_on_changed(const obj_t *obj, const char *attr);
+
+/*
+ * Function: core_on_mouse
+ * Notify the core of a mouse or touch event
+ *
+ * The moves (state -1, or same state as the previous event) are coalesced
+ * and only processed at the next <core_update>.  Press and release events
+ * are processed immediately, after the pending move of the same pointer.
+ *
+ * Parameters:
+ *   id     - Pointer id.
+ *   state  - 1 for down, 0 for up, -1 for move with the same state.
+ *   x, y   - Screen coordinates.
+ */
 void core_on_mouse(int id, int state, double x, double y);
 void core_on_key(int key, int action);
 void core_on_char(uint32_t c);
+
+/*
+ * Function: core_on_zoom
+ * Zoom in or out around a screen position
+ *
+ * The zooms are accumulated and applied at the next <core_update>.
+ */
 void core_on_zoom(double zoom, double x, double y);
 
 /*
@@ -222,6 +509,11 @@ void core_get_proj(projection_t *proj);
  * Function: core_get_obj_at
  * Get the object at a given screen position.
  *
+ * The shapes registered in the areas are tested first.  If the
+ * 'gpu_picking' attribute is set, the meshes are not registered in the
+ * areas, and if no shape was found the renderer draws the meshes of the
+ * last frame into an offscreen id buffer around the position instead.
+ *
  * Parameters:
  *   x        - The screen x position.
  *   y        - The screen y position.
@@ -258,8 +550,34 @@ obj_t *core_get_module(const char *id);
  */
 void core_report_vmag_in_fov(double vmag, double r, double sep);
 
+/*
+ * Function: core_report_luminance_in_fov
+ * Inform the core that a given luminance is visible.
+ *
+ * Same as <core_report_luminance_n> for a single value of weight 1.
+ */
 void core_report_luminance_in_fov(double lum, bool fast_adaptation);
 
+/*
+ * Function: core_report_luminance_n
+ * Add visible luminances to the eye adaptation histogram.
+ *
+ * All the values reported during a frame are accumulated into a log
+ * scale histogram, and the adaptation luminance is set once per frame
+ * from the brightest bins whose cumulated weight reaches
+ * core->lwmax_weight.  Modules should report all their values at once
+ * rather than one call per object.
+ *
+ * Parameters:
+ *   n      - Number of values.
+ *   lum    - Luminances (cd/m²).
+ *   weight - Weight of each value, or NULL for a weight of 1.
+ *   fast_adaptation - If set, the eyes adapt immediately to the values
+ *                     brighter than the current adaptation.
+ */
+void core_report_luminance_n(int n, const double *lum, const double *weight,
+                             bool fast_adaptation);
+
 /*
  * Function: core_get_point_for_mag
  * Compute a point radius and luminosity from a visual magnitude.
@@ -272,6 +590,37 @@ void core_report_luminance_in_fov(double lum, bool fast_adaptation);
  */
 void core_get_point_for_mag(double mag, double *radius, double *luminance);
 
+/*
+ * Type: point_params_t
+ * Parameters of the <core_get_point_for_mag> computation.
+ *
+ * This allows the renderer to compute the points radius and luminance in a
+ * shader:
+ *
+ *   lum = lum_scale * 10^(-0.4 * mag)
+ *   ld  = max(0, log(1 + tm_p * lum) * tm_scale)
+ *   r   = linear_scale * ld^(relative_scale / 2)
+ *
+ * Followed by the same radius constraints as in <core_get_point_for_mag>.
+ */
+typedef struct point_params {
+    float lum_scale;
+    float tm_p;
+    float tm_scale;
+    float linear_scale;
+    float relative_scale;
+    float skip_radius;
+    float min_radius;
+    float max_radius;
+    float dim_factor;
+} point_params_t;
+
+/*
+ * Function: core_get_point_params
+ * Get the current parameters of the points radius and luminance.
+ */
+void core_get_point_params(point_params_t *params);
+
 /*
  * Function: core_mag_to_illuminance
  * Compute the illuminance for a given magnitude.
@@ -399,6 +748,13 @@ obj_t *city_create(const char *name, const char *country_code,
                    double elevation,
                    double get_near);
 
+// Search the bundled cities by name prefix.
+int city_search(const char *prefix, int max_nb, void *user,
+                int (*f)(void *user, obj_t *city));
+
+// Return the nearest bundled city from a position.
+obj_t *city_get_nearest(double latitude, double longitude, double max_dist);
+
 /*
  * Function: skyculture_get_name
  * Get the name of a star in the current skyculture.
@@ -406,10 +762,19 @@ obj_t *city_create(const char *name, const char *country_code,
  * Parameters:
  *   skycultures    - A skyculture module.
  *   oid            - Object id of a star.
- *   buf            - A text buffer that get filled with the name.
  *
  * Return:
- *   NULL if no name was found.  A pointer to the passed buffer otherwise.
+ *   NULL if no name was found.  Otherwise the name, that stays valid as
+ *   long as the skyculture is active.
+ */
+const char *skycultures_get_name(obj_t *skycultures, uint64_t oid);
+
+/*
+ * Function: skycultures_get_label
+ * Same as <skycultures_get_name>, but return the translated name.
+ *
+ * The translations are computed once when the skyculture gets activated,
+ * and again after a call to <sys_translations_changed>, so this is cheap
+ * enough to be called for each star label at each frame.
  */
-const char *skycultures_get_name(obj_t *skycultures, uint64_t oid,
-                                 char buf[128]);
+const char *skycultures_get_label(obj_t *skycultures, uint64_t oid);
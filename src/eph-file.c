@@ -38,7 +38,8 @@
  * Compressed data block:
  *   4 bytes: data size
  *   4 bytes: compressed data size
- *   n bytes: compressed data
+ *   n bytes: compressed data (zlib stream, possibly using a preset
+ *            dictionary, see eph_add_dictionary)
  *
  * Tabular data:
  *   4 bytes: flags (1: data is shuffled)
@@ -47,7 +48,7 @@
  *   4 bytes: row number
  *   Then for each column:
  *     4 bytes: id string
- *     4 bytes: type ('f', 'i', 'Q', 's')
+ *     4 bytes: type ('f', 'i', 'h', 'Q', 's')
  *     4 bytes: unit (one of EPH_UNIT value, e.g EPH_RAD or 0 to ignore)
  *     4 bytes: start offset in bytes
  *     4 bytes: data size
@@ -63,6 +64,71 @@
     } \
 } while (0)
 
+#define MAX_DICTIONARIES 16
+
+// Preset dictionaries of the compressed blocks.  Only appended to, so that
+// the loader threads can read them without lock.
+static struct {
+    uint32_t    id;     // Adler32 of the data, as stored in the streams.
+    void        *data;
+    int         size;
+} g_dicts[MAX_DICTIONARIES];
+static int g_nb_dicts = 0;
+
+int eph_add_dictionary(const void *data, int size)
+{
+    uint32_t id = adler32(adler32(0, NULL, 0), data, size);
+    int i, nb = __atomic_load_n(&g_nb_dicts, __ATOMIC_ACQUIRE);
+
+    for (i = 0; i < nb; i++) {
+        if (g_dicts[i].id == id) return 0;
+    }
+    if (nb == MAX_DICTIONARIES) {
+        LOG_E("Too many eph dictionaries");
+        return -1;
+    }
+    g_dicts[nb].id = id;
+    g_dicts[nb].data = malloc(size);
+    g_dicts[nb].size = size;
+    memcpy(g_dicts[nb].data, data, size);
+    __atomic_store_n(&g_nb_dicts, nb + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * Same as zlib uncompress, but also support the streams compressed with
+ * one of the registered preset dictionaries.
+ */
+static int block_uncompress(void *dest, unsigned long *dest_size,
+                            const void *src, int src_size)
+{
+    z_stream s = {
+        .next_in = (void*)src,
+        .avail_in = src_size,
+        .next_out = dest,
+        .avail_out = *dest_size,
+    };
+    int r, i, nb;
+
+    if (inflateInit(&s) != Z_OK) return -1;
+    r = inflate(&s, Z_FINISH);
+    if (r == Z_NEED_DICT) {
+        nb = __atomic_load_n(&g_nb_dicts, __ATOMIC_ACQUIRE);
+        for (i = 0; i < nb; i++) {
+            if (g_dicts[i].id == s.adler) break;
+        }
+        if (i < nb && inflateSetDictionary(&s, g_dicts[i].data,
+                                           g_dicts[i].size) == Z_OK) {
+            r = inflate(&s, Z_FINISH);
+        } else {
+            LOG_E("Missing eph dictionary %08lx", s.adler);
+        }
+    }
+    *dest_size = s.total_out;
+    inflateEnd(&s);
+    return r == Z_STREAM_END ? 0 : -1;
+}
+
 int eph_read_tile_header(const void *data, int data_size, int *data_ofs,
                          int *version, int *order, int *pix)
 {
@@ -88,13 +154,41 @@ void *eph_read_compressed_block(const void *data, int data_size,
     lsize = *size;
     ret = malloc(lsize);
     *data_ofs += 8 + comp_size;
-    if (uncompress(ret, &lsize, data + 8, comp_size) != Z_OK) {
+    if (block_uncompress(ret, &lsize, data + 8, comp_size) != 0) {
         LOG_E("Cannot uncompress data");
+        free(ret);
         return NULL;
     }
     return ret;
 }
 
+const void *eph_read_compressed_block_tmp(const void *data, int data_size,
+                                         int *data_ofs, int *size)
+{
+    // Per thread scratch buffer, only growing, so that decoding a tile
+    // doesn't need any allocation once the loader threads are warm.
+    static __thread uint8_t *buf = NULL;
+    static __thread int buf_size = 0;
+    int comp_size;
+    unsigned long lsize;
+
+    data += *data_ofs;
+    memcpy(size, data, 4);
+    memcpy(&comp_size, data + 4, 4);
+    *data_ofs += 8 + comp_size;
+    if (*size > buf_size) {
+        buf_size = *size;
+        buf = realloc(buf, buf_size);
+    }
+    lsize = *size;
+    if (block_uncompress(buf, &lsize, data + 8, comp_size) != 0 ||
+            lsize != *size) {
+        LOG_E("Cannot uncompress data");
+        return NULL;
+    }
+    return buf;
+}
+
 int eph_load(const void *data, int data_size, void *user,
              int (*callback)(const char type[4],
                              const void *data, int size, void *user))
@@ -201,6 +295,7 @@ int eph_read_table_row(const void *data, int data_size, int *data_ofs,
     union {
         char    *s;
         int      i;
+        int16_t  h;
         float    f;
         uint64_t q;
     } v;
@@ -217,6 +312,10 @@ int eph_read_table_row(const void *data, int data_size, int *data_ofs,
             if (got) memcpy(&v.i, data + columns[i].start, 4);
             *va_arg(ap, int*) = v.i;
             break;
+        case 'h':
+            if (got) memcpy(&v.h, data + columns[i].start, 2);
+            *va_arg(ap, int*) = v.h;
+            break;
         case 'f':
             if (got) memcpy(&v.f, data + columns[i].start, 4);
             *va_arg(ap, double*) = eph_convert_f(
@@ -239,3 +338,123 @@ int eph_read_table_row(const void *data, int data_size, int *data_ofs,
     *data_ofs += columns[0].row_size;
     return 0;
 }
+
+// Copy the bytes of a column for n consecutive rows.
+// If the table is shuffled, byte k of row i is stored at (k * nb + i), so
+// each byte of the column is read from a contiguous plane of the table.
+static void read_column_bytes(const uint8_t *data, int nb, bool shuffled,
+                              const eph_table_column_t *column, int size,
+                              int row, int n, uint8_t *out, int stride)
+{
+    int i, k;
+    const uint8_t *src;
+
+    if (!shuffled) {
+        src = data + row * column->row_size + column->start;
+        for (i = 0; i < n; i++)
+            memcpy(out + i * stride, src + i * column->row_size, size);
+        return;
+    }
+    for (k = 0; k < size; k++) {
+        src = data + (column->start + k) * nb + row;
+        for (i = 0; i < n; i++)
+            out[i * stride + k] = src[i];
+    }
+}
+
+static int column_value_size(const eph_table_column_t *column)
+{
+    switch (column->type) {
+    case 'i': return 4;
+    case 'h': return 2;
+    case 'f': return 4;
+    case 'Q': return 8;
+    case 's': return column->size;
+    default: return 0;
+    }
+}
+
+int eph_read_table_column(const void *data, int data_size, int nb, int flags,
+                          const eph_table_column_t *column,
+                          void *out, int stride)
+{
+    int i, size = column_value_size(column);
+    float *f;
+
+    CHECK(size > 0);
+    if (!column->got) {
+        for (i = 0; i < nb; i++) memset(out + i * stride, 0, size);
+        return 0;
+    }
+    CHECK(column->start + size <= column->row_size);
+    CHECK(nb * column->row_size <= data_size);
+    read_column_bytes(data, nb, flags & 1, column, size, 0, nb, out, stride);
+
+    if (column->type == 'f' && column->unit &&
+            column->src_unit != column->unit) {
+        for (i = 0; i < nb; i++) {
+            f = out + i * stride;
+            *f = eph_convert_f(column->src_unit, column->unit, *f);
+        }
+    }
+    return 0;
+}
+
+int eph_read_table_value(const void *data, int data_size, int nb, int flags,
+                         const eph_table_column_t *column, int row,
+                         void *out)
+{
+    int size = column_value_size(column);
+    float *f = out;
+
+    CHECK(size > 0);
+    CHECK(row >= 0 && row < nb);
+    if (!column->got) {
+        memset(out, 0, size);
+        return 0;
+    }
+    CHECK(column->start + size <= column->row_size);
+    CHECK(nb * column->row_size <= data_size);
+    read_column_bytes(data, nb, flags & 1, column, size, row, 1, out, 0);
+    if (column->type == 'f')
+        *f = eph_convert_f(column->src_unit, column->unit, *f);
+    return 0;
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static void test_eph_dictionary(void)
+{
+    const char dict[] = "vmag ra de plx pra pde bv ids";
+    const char src[] = "vmag ra de plx pra pde";
+    uint8_t block[8 + 128];
+    const char *out;
+    z_stream s = {};
+    int size = sizeof(src), comp_size, ofs;
+
+    // Compress a block with the dictionary.
+    deflateInit(&s, 9);
+    deflateSetDictionary(&s, (const void*)dict, sizeof(dict));
+    s.next_in = (void*)src;
+    s.avail_in = sizeof(src);
+    s.next_out = block + 8;
+    s.avail_out = sizeof(block) - 8;
+    assert(deflate(&s, Z_FINISH) == Z_STREAM_END);
+    comp_size = s.total_out;
+    deflateEnd(&s);
+    memcpy(block, &size, 4);
+    memcpy(block + 4, &comp_size, 4);
+
+    ofs = 0;
+    assert(eph_add_dictionary(dict, sizeof(dict)) == 0);
+    out = eph_read_compressed_block_tmp(block, sizeof(block), &ofs, &size);
+    assert(out && size == sizeof(src));
+    assert(strcmp(out, src) == 0);
+    assert(ofs == 8 + comp_size);
+}
+
+TEST_REGISTER(NULL, test_eph_dictionary, TEST_AUTO);
+
+#endif
@@ -30,6 +30,34 @@ int eph_read_tile_header(const void *data, int data_size, int *data_ofs,
 void *eph_read_compressed_block(const void *data, int data_size,
                                 int *data_ofs, int *size);
 
+/*
+ * Function: eph_read_compressed_block_tmp
+ * Same as eph_read_compressed_block, but uncompress the data into a per
+ * thread scratch buffer instead of a new allocation.
+ *
+ * The returned pointer must not be freed, and is only valid until the next
+ * call from the same thread.
+ */
+const void *eph_read_compressed_block_tmp(const void *data, int data_size,
+                                         int *data_ofs, int *size);
+
+/*
+ * Function: eph_add_dictionary
+ * Register a preset dictionary for the compressed blocks.
+ *
+ * The blocks of a survey can be compressed with a shared zlib dictionary,
+ * so that the structure repeated in every small tile doesn't have to be
+ * compressed again in each of them.  The zlib streams store the adler32
+ * checksum of their dictionary, so the blocks don't need any format change,
+ * and we just need to register the dictionary before decoding them.
+ *
+ * Should be called from the main thread.  The data is copied.
+ *
+ * Return:
+ *   0 on success, or -1 if there are too many dictionaries.
+ */
+int eph_add_dictionary(const void *data, int size);
+
 void eph_shuffle_bytes(uint8_t *data, int nb, int size);
 
 /*
@@ -75,4 +103,41 @@ int eph_read_table_row(const void *data, int data_size, int *data_ofs,
                        int nb_columns, const eph_table_column_t *columns,
                        ...);
 
+/*
+ * Function: eph_read_table_column
+ * Decode all the values of a table column.
+ *
+ * This works directly on the uncompressed data block, shuffled or not, so
+ * there is no need to call <eph_shuffle_bytes> first.
+ *
+ * Parameters:
+ *   data       - The uncompressed table data.
+ *   data_size  - Size of the table data.
+ *   nb         - Number of rows, as returned by <eph_read_table_header>.
+ *   flags      - Table flags, as returned by <eph_read_table_header>.
+ *   column     - The column to decode.
+ *   out        - Receive the values: int32 for 'i', int16 for 'h', float
+ *                for 'f' (converted to the column unit), uint64 for 'Q' and
+ *                the raw bytes for 's'.  Values of missing columns are set
+ *                to zero.
+ *   stride     - Offset in bytes between two output values, so that we can
+ *                decode straight into an array of structures.
+ *
+ * Return:
+ *   0 on success, -1 if the column doesn't fit into the data.
+ */
+int eph_read_table_column(const void *data, int data_size, int nb, int flags,
+                          const eph_table_column_t *column,
+                          void *out, int stride);
+
+/*
+ * Function: eph_read_table_value
+ * Decode a single value of a table column.
+ *
+ * Same as <eph_read_table_column>, but only for the given row.
+ */
+int eph_read_table_value(const void *data, int data_size, int nb, int flags,
+                         const eph_table_column_t *column, int row,
+                         void *out);
+
 #endif // EPH_FILE_H
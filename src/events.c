@@ -81,6 +81,23 @@ static double rise_dist(double time, void *user)
     return alt + radius - data->obs->horizon;
 }
 
+// Distance of the object to the meridian, decreasing at upper transit.
+static double transit_dist(double time, void *user)
+{
+    struct {
+        observer_t *obs;
+        obj_t *obj;
+    } *data = user;
+    double pvo[2][4], observed[4];
+
+    data->obs->tt = time;
+    observer_update(data->obs, false);
+    obj_get_pvo(data->obj, data->obs, pvo);
+    convert_framev4(data->obs, FRAME_ICRF, FRAME_OBSERVED, pvo[0], observed);
+    // The horizontal Y axis points to the East.
+    return observed[1];
+}
+
 EMSCRIPTEN_KEEPALIVE
 double compute_event(observer_t *obs,
                      obj_t *obj,
@@ -97,9 +114,140 @@ double compute_event(observer_t *obs,
         obj_t *obj;
     } data = {&obs2, obj};
     rising = event == EVENT_RISE ? +1 : -1;
-    ret = find_zero(rise_dist, start_time, end_time,
+    ret = find_zero(event == EVENT_TRANSIT ? transit_dist : rise_dist,
+                    start_time, end_time,
                     (end_time - start_time) / 24, precision,
                     rising, &data);
     return ret;
 }
 
+
+// Number of samples per day used to bracket the batch events.
+#define BATCH_SAMPLES_PER_DAY 24
+
+// Position of one object at one sample time of the batch.
+typedef struct {
+    double pos[4];      // ICRF position, then observed after conversion.
+    double radius;
+} batch_sample_t;
+
+typedef struct {
+    int nb_objs;
+    int nb_samples;
+    double start_time;
+    observer_t *observers; // One fast updated observer per sample.
+    batch_sample_t *samples; // nb_objs * nb_samples.
+    double *out;
+} batch_t;
+
+// Add an event into the batch output, keeping only the first of each day.
+static void batch_add_event(const batch_t *b, int obj, int event, double t)
+{
+    int day, nb_days = (b->nb_samples - 1) / BATCH_SAMPLES_PER_DAY;
+    double *v;
+
+    day = floor(t - b->start_time);
+    if (day < 0 || day >= nb_days) return;
+    v = &b->out[(obj * nb_days + day) * 3 + event];
+    if (isnan(*v) || t < *v) *v = t;
+}
+
+/*
+ * Convert the samples of a range of objects to the observed frame and
+ * bracket their events, run in parallel.
+ *
+ * The approximate times are linearly interpolated from the samples, and
+ * refined afterward.
+ */
+static void batch_check_block(void *user, int start, int end)
+{
+    batch_t *b = USER_GET(user, 0);
+    batch_sample_t *s;
+    const observer_t *obs;
+    double p[4], alt, f[2], last[2] = {0}, t, dt;
+    int i, k;
+
+    dt = 1.0 / BATCH_SAMPLES_PER_DAY;
+    for (i = start; i < end; i++) {
+        for (k = 0; k < b->nb_samples; k++) {
+            s = &b->samples[i * b->nb_samples + k];
+            obs = &b->observers[k];
+            convert_framev4(obs, FRAME_ICRF, FRAME_OBSERVED, s->pos, p);
+            vec3_normalize(p, s->pos);
+            alt = asin(s->pos[2]);
+            f[0] = alt + s->radius - obs->horizon;
+            f[1] = s->pos[1];
+            // Rise and set share the altitude function.
+            if (k > 0 && sign(f[0]) != sign(last[0])) {
+                t = obs->tt - dt * f[0] / (f[0] - last[0]);
+                batch_add_event(b, i, sign(f[0]) > 0 ? 0 : 1, t);
+            }
+            if (k > 0 && sign(f[1]) == -1 && sign(last[1]) == 1) {
+                t = obs->tt - dt * f[1] / (f[1] - last[1]);
+                batch_add_event(b, i, 2, t);
+            }
+            last[0] = f[0];
+            last[1] = f[1];
+        }
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+int compute_events_batch(const observer_t *obs,
+                         int nb_objs, obj_t **objs,
+                         double start_time, int nb_days,
+                         double precision, double *out)
+{
+    batch_t b = {
+        .nb_objs = nb_objs,
+        .nb_samples = nb_days * BATCH_SAMPLES_PER_DAY + 1,
+        .start_time = start_time,
+        .out = out,
+    };
+    observer_t obs2 = *obs;
+    batch_sample_t *s;
+    double pvo[2][4], t, dt, *v;
+    int i, k, ev;
+    struct {
+        observer_t *obs;
+        obj_t *obj;
+    } data = {&obs2};
+
+    if (nb_objs <= 0 || nb_days <= 0) return 0;
+    for (i = 0; i < nb_objs * nb_days * 3; i++) out[i] = NAN;
+    b.observers = malloc(b.nb_samples * sizeof(*b.observers));
+    b.samples = calloc(nb_objs * b.nb_samples, sizeof(*b.samples));
+    dt = 1.0 / BATCH_SAMPLES_PER_DAY;
+
+    // Sample all the objects with a single fast observer update per time.
+    // The objects update is not thread safe, so we do it first.
+    for (k = 0; k < b.nb_samples; k++) {
+        obs2.tt = start_time + k * dt;
+        observer_update(&obs2, true);
+        b.observers[k] = obs2;
+        for (i = 0; i < nb_objs; i++) {
+            s = &b.samples[i * b.nb_samples + k];
+            obj_get_pvo(objs[i], &obs2, pvo);
+            vec4_copy(pvo[0], s->pos);
+            obj_get_info(objs[i], &obs2, INFO_RADIUS, &s->radius);
+        }
+    }
+    worker_parallel_for(nb_objs, 8, USER_PASS(&b), batch_check_block);
+
+    // Refine the approximate times with the accurate observer.
+    for (i = 0; i < nb_objs; i++) {
+        data.obj = objs[i];
+        for (k = 0; k < nb_days * 3; k++) {
+            v = &out[i * nb_days * 3 + k];
+            if (isnan(*v)) continue;
+            ev = k % 3;
+            t = newton(ev == 2 ? transit_dist : rise_dist,
+                       *v - precision, *v + precision, precision, &data);
+            if (!isnan(t) && fabs(t - *v) < dt) *v = t;
+        }
+    }
+
+    free(b.observers);
+    free(b.samples);
+    return 0;
+}
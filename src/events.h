@@ -16,6 +16,7 @@ typedef struct obj obj_t;
 enum {
     EVENT_RISE      = 1 << 0,
     EVENT_SET       = 1 << 1,
+    EVENT_TRANSIT   = 1 << 2,
 };
 
 // Compute time for a given event.
@@ -28,3 +29,28 @@ double compute_event(observer_t *obs, obj_t *obj, int event,
                      double start_time, double end_time,
                      double precision);
 
+
+/*
+ * Function: compute_events_batch
+ * Compute the daily rise, set and transit times of several objects.
+ *
+ * The objects are first sampled once per hour, sharing a single fast
+ * observer update per sample time, and the events bracketed in parallel.
+ * Each event is then refined with accurate observer updates.
+ *
+ * Parameters:
+ *   obs        - An observer.
+ *   nb_objs    - Number of objects.
+ *   objs       - Array of objects.
+ *   start_time - Start time of the first day (MJD, same time scale as
+ *                <compute_event>).
+ *   nb_days    - Number of days.
+ *   precision  - Precision of the results (day).
+ *   out        - Output array of nb_objs * nb_days * 3 values.  For each
+ *                object and each day the rise, set and upper transit
+ *                times, or NAN if the event doesn't happen that day.
+ */
+int compute_events_batch(const observer_t *obs,
+                         int nb_objs, obj_t **objs,
+                         double start_time, int nb_days,
+                         double precision, double *out);
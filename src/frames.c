@@ -9,6 +9,10 @@
 
 #include "swe.h"
 
+// Min fov at which the render accuracy uses the fast apparent direction of
+// the distant objects, so that a pixel is always bigger than the errors.
+#define RENDER_FAST_MIN_FOV (1.0 * DD2R)
+
 static void correct_speed_of_light(double pv[2][3]) {
     double ldt = vec3_norm(pv[0]) * DAU / LIGHT_YEAR_IN_METER * DJY;
     vec3_addk(pv[0], pv[1], -ldt, pv[0]);
@@ -86,7 +90,7 @@ static void convert_frame_forward(const observer_t *obs,
 
         if (obs->refraction) {
             if (at_inf) {
-                refraction(p, obs->pressure, 15.0, p);
+                refraction_table_apply(&obs->refraction_table, p, p);
             } else {
                 // Special case for null's vectors
                 double dist = vec3_norm(p);
@@ -95,7 +99,7 @@ static void convert_frame_forward(const observer_t *obs,
                     return;
                 }
                 vec3_mul(1.0 / dist, p, p);
-                refraction(p, obs->pressure, 15.0, p);
+                refraction_table_apply(&obs->refraction_table, p, p);
                 vec3_mul(dist, p, p);
             }
         }
@@ -131,7 +135,7 @@ static void convert_frame_backward(const observer_t *obs,
     if (origin >= FRAME_OBSERVED && dest < FRAME_OBSERVED) {
         if (obs->refraction){
             if (at_inf) {
-                refraction_inv(p, obs->pressure, 15.0, p);
+                refraction_table_apply_inv(&obs->refraction_table, p, p);
             } else {
                 // Special case for null's vectors
                 double dist = vec3_norm(p);
@@ -140,7 +144,7 @@ static void convert_frame_backward(const observer_t *obs,
                     return;
                 }
                 vec3_mul(1.0 / dist, p, p);
-                refraction_inv(p, obs->pressure, 15.0, p);
+                refraction_table_apply_inv(&obs->refraction_table, p, p);
                 vec3_mul(dist, p, p);
             }
         }
@@ -170,13 +174,91 @@ static void convert_frame_backward(const observer_t *obs,
     vec3_normalize(p, p);
 }
 
+// Check if a conversion is only a rotation, so that we can use the
+// precomposed matrix.
+static bool is_rotation(const observer_t *obs, int origin, int dest,
+                        bool at_inf)
+{
+    if (!at_inf || origin == FRAME_ASTROM || dest == FRAME_ASTROM)
+        return false;
+    if (obs->refraction && min(origin, dest) < FRAME_OBSERVED &&
+            max(origin, dest) >= FRAME_OBSERVED)
+        return false;
+    return true;
+}
+
+void convert_frame_fast(const observer_t *obs, int origin, int dest,
+                        const double in[3], double out[3])
+{
+    obs = obs ?: (observer_t*)core->observer;
+    mat3_mul_vec3(obs->rframes[origin][dest], in, out);
+}
+
+void convert_frame_fast_n(const observer_t *obs, int origin, int dest, int n,
+                          const double (*in)[3], double (*out)[3])
+{
+    int i;
+    double mat[3][3];
+    obs = obs ?: (observer_t*)core->observer;
+    mat3_copy(obs->rframes[origin][dest], mat);
+    for (i = 0; i < n; i++)
+        mat3_mul_vec3(mat, in[i], out[i]);
+}
+
+void convert_frame_n(const observer_t *obs, int origin, int dest, bool at_inf,
+                     int n, const double *in, double *out, int stride)
+{
+    int i;
+    double mat[3][3];
+    const double *v;
+    double *o;
+
+    PROFILE(convert_frame_n, PROFILE_AGGREGATE);
+    obs = obs ?: (observer_t*)core->observer;
+    stride = stride ?: 3 * sizeof(double);
+
+    // Points at infinity in FRAME_ASTROM: first apply the aberration, then
+    // we can use the rotation from ICRF.
+    if (at_inf && origin == FRAME_ASTROM && dest != FRAME_ASTROM &&
+            is_rotation(obs, FRAME_ICRF, dest, true)) {
+        for (i = 0; i < n; i++) {
+            v = (const void*)in + i * stride;
+            o = (void*)out + i * stride;
+            astrometric_to_apparent(obs, v, true, o);
+        }
+        in = out;
+        origin = FRAME_ICRF;
+    }
+
+    if (!is_rotation(obs, origin, dest, at_inf)) {
+        for (i = 0; i < n; i++) {
+            v = (const void*)in + i * stride;
+            o = (void*)out + i * stride;
+            convert_frame(obs, origin, dest, at_inf, v, o);
+        }
+        return;
+    }
+
+    mat3_copy(obs->rframes[origin][dest], mat);
+    for (i = 0; i < n; i++) {
+        v = (const void*)in + i * stride;
+        o = (void*)out + i * stride;
+        mat3_mul_vec3(mat, v, o);
+    }
+}
+
 EMSCRIPTEN_KEEPALIVE
 int convert_frame(const observer_t *obs,
                         int origin, int dest, bool at_inf,
                         const double in[3], double out[3])
 {
-    PROFILE(convert_frame, PROFILE_AGGREGATE);
     obs = obs ?: (observer_t*)core->observer;
+    if (is_rotation(obs, origin, dest, at_inf)) {
+        mat3_mul_vec3(obs->rframes[origin][dest], in, out);
+        return 0;
+    }
+
+    PROFILE(convert_frame, PROFILE_AGGREGATE);
 
     vec3_copy(in, out);
     assert(!isnan(out[0] + out[1] + out[2]));
@@ -243,7 +325,15 @@ void astrometric_to_apparent(const observer_t *obs, const double in[3],
 {
     eraCp(in, out);
 
-    if (inf) {
+    if (inf && core && core->accuracy == ACCURACY_RENDER &&
+            core->fov > RENDER_FAST_MIN_FOV) {
+        // First order aberration, without the light deflection by the Sun.
+        // The errors are below 2 arcsec, and only close to the Sun.
+        assert(vec3_is_normalized(out));
+        vec3_mul(1.0 - vec3_dot(out, obs->astrom.v), out, out);
+        vec3_add(out, obs->astrom.v, out);
+        vec3_normalize(out, out);
+    } else if (inf) {
         assert(vec3_is_normalized(out));
         // Light deflection by the Sun, giving BCRS natural direction.
         // TODO: adapt this formula for solar system bodies, this works only for
@@ -434,6 +524,41 @@ static void test_convert_origin(void)
     }
 }
 
+// Compare the precomposed rotations with the step by step conversion.
+static void test_convert_frame_fast(void)
+{
+    int i, j, k;
+    double p[3], ref[3], out[3];
+    const int frames[] = {FRAME_ICRF, FRAME_CIRS, FRAME_OBSERVED, FRAME_VIEW};
+    observer_t *obs;
+
+    core_init(100, 100, 1.0);
+    obs = core->observer;
+    obj_set_attr((obj_t*)obs, "utc", 58450.0);
+    obj_set_attr((obj_t*)obs, "latitude", 33.7 * DD2R);
+    obj_set_attr((obj_t*)obs, "pitch", 20 * DD2R);
+    obs->refraction = false;
+    observer_update(obs, false);
+
+    for (i = 0; i < ARRAY_SIZE(frames); i++)
+    for (j = 0; j < ARRAY_SIZE(frames); j++)
+    for (k = 0; k < 16; k++) {
+        eraS2c(k * 0.4, k * 0.2 - 1.5, p);
+        vec3_copy(p, ref);
+        if (frames[j] > frames[i])
+            convert_frame_forward(obs, frames[i], frames[j], true, ref);
+        if (frames[j] < frames[i])
+            convert_frame_backward(obs, frames[i], frames[j], true, ref);
+        convert_frame_fast(obs, frames[i], frames[j], p, out);
+        if (eraSepp(ref, out) > 1e-12) {
+            LOG_E("Frame %d to %d error: %g rad", frames[i], frames[j],
+                  eraSepp(ref, out));
+            assert(false);
+        }
+    }
+}
+
 TEST_REGISTER(NULL, test_convert_origin, TEST_AUTO)
+TEST_REGISTER(NULL, test_convert_frame_fast, TEST_AUTO)
 
 #endif
@@ -144,6 +144,58 @@ int convert_framev4(const observer_t *obs,
                     int origin, int dest,
                     const double in[S 4], double out[S 4]);
 
+/*
+ * Function: convert_frame_fast
+ * Rotate a 3D vector from a frame to an other with a single matrix.
+ *
+ * This uses the rotations precomputed by the last <observer_update>, and
+ * ignores the refraction and the aberration (FRAME_ASTROM is considered the
+ * same as FRAME_ICRF).  Use <convert_frame> when those effects matter.
+ *
+ * Parameters:
+ *   obs    - The observer.  If NULL we use the current core observer.
+ *   origin - The origin frame.  One of the <FRAME> enum values.
+ *   dest   - The dest frame.  One of the <FRAME> enum values.
+ *   in     - Input 3D vector.
+ *   out    - Output 3D vector.
+ */
+void convert_frame_fast(const observer_t *obs, int origin, int dest,
+                        const double in[S 3], double out[S 3]);
+
+/*
+ * Function: convert_frame_fast_n
+ * Same as <convert_frame_fast>, for an array of vectors.
+ *
+ * The input and output arrays can be the same.
+ */
+void convert_frame_fast_n(const observer_t *obs, int origin, int dest, int n,
+                          const double (*in)[3], double (*out)[3]);
+
+/*
+ * Function: convert_frame_n
+ * Same as <convert_frame>, for an array of vectors.
+ *
+ * When the conversion is a simple rotation (possibly after the aberration
+ * for points at infinity in FRAME_ASTROM) we compose the matrix only once
+ * and apply it to all the vectors, otherwise we fall back to calling
+ * <convert_frame> for each vector.
+ *
+ * The input and output arrays can be the same.
+ *
+ * Parameters:
+ *   obs    - The observer.  If NULL we use the current core observer.
+ *   origin - The origin frame.  One of the <FRAME> enum values.
+ *   dest   - The dest frame.  One of the <FRAME> enum values.
+ *   at_inf - true for normalized vectors of fixed objects.
+ *   n      - Number of vectors.
+ *   in     - Pointer to the first input vector.
+ *   out    - Pointer to the first output vector.
+ *   stride - Offset in bytes between two consecutive vectors in both
+ *            arrays, or 0 for packed arrays of double[3].
+ */
+void convert_frame_n(const observer_t *obs, int origin, int dest, bool at_inf,
+                     int n, const double *in, double *out, int stride);
+
 /* Enum: ORIGIN
  * Represent a reference system, i.e. the origin of a reference frame and the
  * associated intertial frame.
@@ -490,6 +490,7 @@ geojson_t *geojson_parse(const json_value *data, const json_value *filter)
     const json_value *features;
     int i;
     geojson_t *geojson = calloc(1, sizeof(*geojson));
+    json_expression_t *expr = filter ? json_expression_compile(filter) : NULL;
 
     if (!type) ERROR("Cannot find 'type' attribute");
     if (strcmp(type, "FeatureCollection") == 0) {
@@ -499,8 +500,8 @@ geojson_t *geojson_parse(const json_value *data, const json_value *filter)
         geojson->features = calloc(geojson->nb_features,
                                    sizeof(*geojson->features));
         for (i = 0; i < features->u.array.length; i++) {
-            if (        filter && !json_expression_eval_bool(
-                        features->u.array.values[i], filter))
+            if (expr && !json_expression_test(expr,
+                                              features->u.array.values[i]))
                 continue;
             if (parse_feature(features->u.array.values[i],
                               &geojson->features[i]))
@@ -515,10 +516,12 @@ geojson_t *geojson_parse(const json_value *data, const json_value *filter)
         ERROR("type %s not supported", type);
     }
 
+    json_expression_delete(expr);
     return geojson;
 
 error:
     LOG_W("Error parsing geojson: %s", error_msg);
+    json_expression_delete(expr);
     geojson_delete(geojson);
     return NULL;
 }
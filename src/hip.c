@@ -18,10 +18,9 @@ static const uint8_t PIX_ORDER_2[] = {
 int hip_get_pix(int hip, int order)
 {
     int ret;
-    if (order > 2) return -1;
-    if (hip >= sizeof(PIX_ORDER_2)) return -1;
+    if ((unsigned)order > 2) return -1;
+    if ((unsigned)hip >= sizeof(PIX_ORDER_2)) return -1;
     ret = PIX_ORDER_2[hip];
     if (ret == 255) return -1;
-    ret /= (1 << (2 * (2 - order))); // For order 0 and 1.
-    return ret;
+    return ret >> (2 * (2 - order)); // For order 0 and 1.
 }
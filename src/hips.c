@@ -15,11 +15,16 @@
 // Should be good enough...
 #define URL_MAX_SIZE 4096
 
-// Size of the cache allocated to all the hips tiles.
+// Default sizes of the tiles caches (in bytes), indexed by HIPS_CACHE
+// value.  The images cost includes the GPU textures memory.
 // Note: we get into trouble if the tiles visible on screen actually use
 // more space than that.  We could use a more clever cache that can grow
 // past its limit if the items are still in use!
-#define CACHE_SIZE (256 * (1 << 20))
+static const int CACHE_SIZES[HIPS_CACHE_COUNT] = {
+    [HIPS_CACHE_IMAGES] = 256 * (1 << 20),
+    [HIPS_CACHE_STARS]  =  64 * (1 << 20),
+    [HIPS_CACHE_DSOS]   =  32 * (1 << 20),
+};
 
 // Flags of the tiles:
 enum {
@@ -37,6 +42,20 @@ enum {
     (TILE_NO_CHILD_0 | TILE_NO_CHILD_1 | TILE_NO_CHILD_2 | TILE_NO_CHILD_3)
 
 typedef struct tile tile_t;
+typedef struct loader loader_t;
+
+// Loader to parse the tile data in a thread.
+struct loader {
+    worker_t    worker;
+    tile_t      *tile;
+    asset_buffer_t *data; // The source data, released once parsed.
+    const void  *src;     // Tile data in the source data.
+    int         src_size;
+    int         cost;
+    bool        requested; // Set when the tile is requested.
+    loader_t    *prev, *next;
+};
+
 struct tile {
     struct {
         int order;
@@ -46,27 +65,60 @@ struct tile {
     fader_t     fader;
     int         flags;
     const void  *data;
-
-    // Loader to parse the image in a thread.
-    struct {
-        worker_t worker;
-        tile_t *tile;
-        void *data;
-        int size;
-        int cost;
-    } *loader;
+    loader_t    *loader;
+    double      request_time; // Time of the first request (sec).
+    double      state_time;   // Time of the last loading step (sec).
+    int         cost; // Cost in the cache, also counted in hips->mem.
+    int         hits; // Number of times we got the tile from the cache.
+    int         reduce; // Log2 of the image decoding size reduction.
 };
 
 /*
  * Type: tile_key_t
  * Key used for the tiles cache.
+ *
+ * The image tiles decoded at a reduced size are separate entries, so that
+ * we can keep using them while the full size tile is loading.
  */
 typedef struct {
     uint32_t    hips_hash;
     int         order;
     int         pix;
+    int         reduce;
 } tile_key_t;
 
+// Number of tiles per side of the tiles atlases.
+#define ATLAS_SIDE 8
+
+/*
+ * Type: tile_atlas_t
+ * A texture shared by up to ATLAS_SIDE^2 tiles of a survey.
+ *
+ * All the tiles of an atlas have the same size and format, so that the
+ * renderer can batch the quads of different tiles together.
+ */
+typedef struct tile_atlas tile_atlas_t;
+struct tile_atlas {
+    tile_atlas_t *next, *prev;
+    hips_t      *hips;
+    texture_t   *tex;
+    int         tile_size;
+    int         bpp;
+    uint64_t    used; // Bit mask of the used slots.
+};
+
+/*
+ * Type: fallback_t
+ * Remember which ancestor tile to use when a tile texture is not ready.
+ */
+typedef struct {
+    UT_hash_handle  hh;
+    tile_key_t      key;
+    int             order;   // Order of the ancestor.
+    int             pix;     // Pix of the ancestor.
+    int             version; // Value of the survey fallbacks_version.
+} fallback_t;
+
 /*
  * Type: img_tile_t
  * type data for images surveys.
@@ -74,11 +126,98 @@ typedef struct {
 typedef struct {
     void        *img;
     int         w, h, bpp;
+    texture_compressed_t *compressed; // Set instead of img for KTX2 tiles.
+    int         reduce;  // Log2 of the decoding size reduction.
     texture_t   *tex;
+    tile_atlas_t *atlas; // Set if the texture is in an atlas.
+    int         slot;    // Index of the tile in the atlas.
 } img_tile_t;
 
-// Gobal cache for all the tiles.
-static cache_t *g_cache = NULL;
+// Gobal caches for all the tiles, indexed by HIPS_CACHE value.
+static cache_t *g_caches[HIPS_CACHE_COUNT] = {};
+
+// List of all the surveys, for the memory stats.
+static hips_t *g_hips = NULL;
+
+// List of all the tiles loaders.
+static loader_t *g_loaders = NULL;
+
+/*
+ * Type: download_t
+ * A tile whose data is still being downloaded.
+ *
+ * We keep track of them so that we can cancel the requests of the tiles
+ * that are not visible anymore, and forward the tiles priorities to the
+ * assets manager.
+ */
+typedef struct download {
+    UT_hash_handle  hh;
+    tile_key_t      key;
+    int             unused; // Number of updates since last requested.
+    double          start_time; // Time of the first request (sec).
+    char            url[];
+} download_t;
+
+// Number of updates after which we cancel a download nobody requested.
+#define DOWNLOAD_MAX_UNUSED 2
+
+static download_t *g_downloads = NULL;
+
+// Max time spent creating tiles in the main thread per frame (sec).  The
+// tiles whose data arrives once it is elapsed are created at the next
+// frames.
+#define CREATE_BUDGET 0.004
+
+// Time spent creating tiles in the main thread since the last update, and
+// number of tiles postponed because of the budget.
+static double g_create_time = 0;
+static int g_create_postponed = 0;
+
+// Global function called each time a tile gets loaded.
+static struct {
+    void *user;
+    void (*fn)(void *user, const char *url, int order, int pix,
+               double delay);
+} g_tile_hook = {};
+
+// Tiles requested since the last call to <hips_get_visited_tiles>.
+static struct {
+    char                *filter; // Record only the surveys matching it.
+    hips_tile_info_t    *tiles;
+    int                 nb;
+    int                 allocated;
+} g_visited = {};
+
+/*
+ * Type: bundle_t
+ * State of a tiles bundle file.
+ *
+ * When the survey properties have a 'hips_bundle_order' value, all the
+ * tiles of a given Dir up to this order are packed into a single
+ * 'Norder<o>/Dir<d>/Bundle.bin' file.  The file starts with an index:
+ *
+ *   char[4]    "HBDL"
+ *   uint32     Number of tiles N.
+ *   N times:
+ *     uint32   Tile pix, in increasing order.
+ *     uint32   Offset of the tile data from the start of the file.
+ *     uint32   Size of the tile data.
+ *
+ * All the values are little endian.  Tiles not listed in the index don't
+ * exist.
+ */
+typedef struct bundle {
+    UT_hash_handle  hh;
+    struct {
+        int order;
+        int dir;
+    } key;
+    bool            missing;   // Fallback to the individual tiles files.
+    int             nb_left;   // Number of tiles not extracted yet.
+} bundle_t;
+
+#define BUNDLE_HEADER_SIZE 8
+#define BUNDLE_ENTRY_SIZE 12
 
 struct hips {
     char        *url;
@@ -98,23 +237,57 @@ struct hips {
         uint8_t     *src_data; // Encoded image data (png, webp...)
         uint8_t     *data;     // RGB[A] image data.
         int         w, h, bpp, size;
-        texture_t   *textures[12];
+        texture_t   *texture;
     }           allsky;
 
     // Contains all the properties as a json object.
     json_value *properties;
+    // Preset dictionary of the eph tiles blocks, relative to the survey
+    // url (property 'eph_dictionary').  See <eph_add_dictionary>.
+    struct {
+        char    *path;
+        bool    loaded;
+    }           eph_dict;
     int order;
     int order_min;
     int tile_width;
+    int bundle_order; // Max order of the bundled tiles, or -1.
+    bundle_t *bundles;
+    tile_atlas_t *atlases; // Pool of textures atlases for the tiles.
+
+    // Closest ancestor with a texture of the tiles not loaded yet.  See
+    // <get_fallback_texture>.
+    fallback_t  *fallbacks;
+    int         fallbacks_version;
+
+    // Tiles visited by the last rendering of a survey in the observed
+    // frame (e.g. landscapes).  Those surveys are static relative to the
+    // view as long as the user doesn't move, so we can skip the traversal.
+    struct {
+        uint32_t    key; // See <get_visible_key>.
+        int         nb;
+        int         allocated;
+        struct { int order, pix, split, flags; } *tiles;
+    } visible;
 
     // The settings as passed in the create function.
     hips_settings_t settings;
+
+    // Number of tiles of the survey in the cache, and their total cost.
+    struct {
+        int     nb;
+        int64_t size;
+    } mem;
+
+    hips_t      *prev, *next; // In the g_hips list.
 };
 
 
 static const void *create_img_tile(
         void *user, int order, int pix, void *src, int size,
         int *cost, int *transparency);
+static const void *create_img_tile_reduced(
+        void *data, int size, int reduce, int *cost, int *transparency);
 static int delete_img_tile(void *tile);
 
 hips_t *hips_create(const char *url, double release_date,
@@ -132,9 +305,11 @@ hips_t *hips_create(const char *url, double release_date,
     hips->service_url = strdup(url);
     hips->ext = "jpg";
     hips->order_min = 3;
+    hips->bundle_order = -1;
     hips->release_date = release_date;
     hips->frame = FRAME_ASTROM;
     hips->hash = crc32(0, (void*)url, strlen(url));
+    DL_APPEND(g_hips, hips);
     return hips;
 }
 
@@ -143,6 +318,33 @@ void hips_set_frame(hips_t *hips, int frame)
     hips->frame = frame;
 }
 
+// Id of the tile async events in the traces.
+static uint32_t tile_trace_id(const tile_key_t *key)
+{
+    return crc32(0, (void*)key, sizeof(*key));
+}
+
+static void trace_tile(char phase, const char *name, const hips_t *hips,
+                       int order, int pix)
+{
+    if (!trace_is_enabled()) return;
+    trace_event(phase, "hips", name,
+                tile_trace_id(&(tile_key_t){hips->hash, order, pix}),
+                trace_get_time(), 0,
+                "\"url\": \"%s\", \"order\": %d, \"pix\": %d",
+                hips->url, order, pix);
+}
+
+// Trace the decoding of a tile as a complete event.
+static void trace_tile_create(const tile_t *tile, double start)
+{
+    if (!trace_is_enabled()) return;
+    trace_event('X', "hips", "create_tile", 0, start,
+                trace_get_time() - start,
+                "\"url\": \"%s\", \"order\": %d, \"pix\": %d",
+                tile->hips->url, tile->pos.order, tile->pos.pix);
+}
+
 // Get the url for a given file in the survey.
 // Automatically add ?v=<release_date> for online surveys.
 static const char *get_url_for(const hips_t *hips, char *buf,
@@ -183,10 +385,19 @@ static int property_handler(void* user, const char* section,
         hips->order_min = atoi(value);
     if (strcmp(name, "hips_tile_width") == 0)
         hips->tile_width = atoi(value);
+    if (strcmp(name, "hips_bundle_order") == 0)
+        hips->bundle_order = atoi(value);
     if (strcmp(name, "hips_release_date") == 0)
         hips->release_date = hips_parse_date(value);
+    if (strcmp(name, "eph_dictionary") == 0)
+        hips->eph_dict.path = strdup(value);
     if (strcmp(name, "hips_tile_format") == 0) {
-             if (strstr(value, "webp")) hips->ext = "webp";
+        // Only use the compressed tiles if the GPU can render them.
+        if (strstr(value, "ktx2") && texture_supports_compression()) {
+            hips->ext = "ktx2";
+            hips->allsky.not_available = true;
+        }
+        else if (strstr(value, "webp")) hips->ext = "webp";
         else if (strstr(value, "jpeg")) hips->ext = "jpg";
         else if (strstr(value, "png"))  hips->ext = "png";
         else if (strstr(value, "eph"))  {
@@ -236,21 +447,60 @@ static int parse_properties(hips_t *hips)
 }
 
 
+static cache_t *get_cache(int cache)
+{
+    assert(cache >= 0 && cache < HIPS_CACHE_COUNT);
+    if (!g_caches[cache]) g_caches[cache] = cache_create(CACHE_SIZES[cache]);
+    return g_caches[cache];
+}
+
+// Update the cache cost of a tile already in the cache.
+static void tile_set_cost(tile_t *tile, int cost)
+{
+    tile_key_t key = {tile->hips->hash, tile->pos.order, tile->pos.pix,
+                      tile->reduce};
+    tile->hips->mem.size += cost - tile->cost;
+    tile->cost = cost;
+    cache_set_cost(get_cache(tile->hips->settings.cache), &key, sizeof(key),
+                   cost);
+}
+
+static void loader_delete(loader_t *loader)
+{
+    DL_DELETE(g_loaders, loader);
+    asset_buffer_release(loader->data);
+    free(loader);
+}
+
 // Used by the cache.
 static int del_tile(void *data)
 {
     tile_t *tile = data;
-    // XXX: why the worker_is_running?
+    // Can't delete the tile while a thread is still using it.
     if (tile->loader && worker_is_running(&tile->loader->worker))
         return CACHE_KEEP;
+    if (tile->loader) loader_delete(tile->loader);
     if (tile->data) {
         if (tile->hips->settings.delete_tile(tile->data) == CACHE_KEEP)
             return CACHE_KEEP;
     }
+    tile->hips->mem.nb--;
+    tile->hips->mem.size -= tile->cost;
     free(tile);
     return 0;
 }
 
+static void tile_add_to_cache(tile_t *tile, int cost)
+{
+    tile_key_t key = {tile->hips->hash, tile->pos.order, tile->pos.pix,
+                      tile->reduce};
+    tile->cost = cost;
+    tile->hips->mem.nb++;
+    tile->hips->mem.size += cost;
+    cache_add(get_cache(tile->hips->settings.cache), &key, sizeof(key), tile,
+              cost, del_tile);
+}
+
 static bool img_is_transparent(
         const uint8_t *img, int img_w, int img_h, int bpp,
         int x, int y, int w, int h)
@@ -322,72 +572,268 @@ int hips_traverse(void *user, int callback(int order, int pix, void *user))
  * Return:
  *   The texture_t, or NULL if none is found.
  */
-texture_t *hips_get_tile_texture(
+/*
+ * Function: atlas_add_tile
+ * Try to upload a tile image into one of the survey atlases.
+ *
+ * Only the square tiles with a power of two size up to 512 px can be
+ * put into an atlas.  A new atlas is allocated if all the existing ones
+ * are full.
+ *
+ * Return:
+ *   true if the tile texture is now in an atlas.
+ */
+static bool atlas_add_tile(hips_t *hips, img_tile_t *tile)
+{
+    tile_atlas_t *atlas;
+    int size = tile->w, slot;
+
+    if (tile->w != tile->h || size > 512 || (size & (size - 1))) return false;
+    DL_FOREACH(hips->atlases, atlas) {
+        if (atlas->tile_size == size && atlas->bpp == tile->bpp &&
+                atlas->used != UINT64_MAX)
+            break;
+    }
+    if (!atlas) {
+        atlas = calloc(1, sizeof(*atlas));
+        atlas->hips = hips;
+        atlas->tile_size = size;
+        atlas->bpp = tile->bpp;
+        atlas->tex = texture_create(size * ATLAS_SIDE, size * ATLAS_SIDE,
+                                    tile->bpp);
+        texture_set_data(atlas->tex, NULL, size * ATLAS_SIDE,
+                         size * ATLAS_SIDE, tile->bpp);
+        DL_APPEND(hips->atlases, atlas);
+    }
+    slot = __builtin_ctzll(~atlas->used);
+    atlas->used |= 1ULL << slot;
+    texture_set_sub_data(atlas->tex, tile->img,
+                         (slot % ATLAS_SIDE) * size,
+                         (slot / ATLAS_SIDE) * size, size, size);
+    atlas->tex->ref++;
+    tile->tex = atlas->tex;
+    tile->atlas = atlas;
+    tile->slot = slot;
+    return true;
+}
+
+static void atlas_remove_tile(img_tile_t *tile)
+{
+    tile_atlas_t *atlas = tile->atlas;
+    atlas->used &= ~(1ULL << tile->slot);
+    texture_release(tile->tex);
+    if (atlas->used) return;
+    DL_DELETE(atlas->hips->atlases, atlas);
+    texture_release(atlas->tex);
+    free(atlas);
+}
+
+/*
+ * Compute the uv transformation to a sub rectangle of a texture.
+ *
+ * We keep half a texel of margin so that the linear filtering doesn't
+ * sample the neighbour tiles.
+ */
+static void get_sub_rect_transf(int x, int y, int size, int w, int h,
+                                double transf[3][3])
+{
+    double m[3][3] = MAT3_IDENTITY;
+    mat3_itranslate(m, (x + 0.5) / w, (y + 0.5) / h);
+    mat3_iscale(m, (size - 1.0) / w, (size - 1.0) / h, 1.0);
+    mat3_mul(transf, m, transf);
+}
+
+// Get the texture of a tile, or of the allsky, without falling back to the
+// parent tiles.
+static texture_t *get_tile_own_texture(
         hips_t *hips, int order, int pix, int flags,
-        double transf[3][3], double *fade,
-        bool *loading_complete)
+        double transf[3][3], bool *loading_complete)
 {
-    PROFILE(hips_get_tile_texture, PROFILE_AGGREGATE)
-    bool loading_complete_;
-    int code, x, y, nbw;
+    bool loading_complete_, other_size = false;
+    int code, x, y, nbw, reduce;
     img_tile_t *tile = NULL;
-    texture_t *tex;
+    double start;
 
     if (!loading_complete) loading_complete = &loading_complete_;
-    // Set all the default values.
-    *loading_complete = false;
-    if (fade) *fade = 1.0;
-
-    if (!hips_is_ready(hips)) return NULL;
-    if (order < hips->order_min) return NULL;
-
     if (order <= hips->order && !(flags & HIPS_FORCE_USE_ALLSKY)) {
         tile = hips_get_tile(hips, order, pix, flags, &code);
         if (!tile && code && code != 598)
             *loading_complete = true;
+        // While the tile is loading at a new size, use any other size
+        // still in the cache, starting from the largest.
+        for (reduce = 0; !tile && !code && reduce < 4; reduce++) {
+            if (reduce * HIPS_REDUCE_1 == (flags & HIPS_REDUCE_MASK))
+                continue;
+            tile = hips_get_tile(hips, order, pix,
+                                 (flags & ~HIPS_REDUCE_MASK) |
+                                 HIPS_CACHED_ONLY | reduce * HIPS_REDUCE_1,
+                                 &(int){0});
+            other_size = tile;
+        }
     }
 
-    // Create texture if needed.
-    if (tile && tile->img && !tile->tex) {
-        tile->tex = texture_from_data(tile->img, tile->w, tile->h, tile->bpp,
-                                      0, 0, tile->w, tile->h, 0);
+    // Create texture if needed.  If we already uploaded too much data in
+    // this frame, we use the parent tile until the next frame.
+    if (tile && (tile->img || tile->compressed) && !tile->tex &&
+            texture_reserve_upload(tile->w * tile->h * tile->bpp)) {
+        start = trace_get_time();
+        if (tile->compressed) {
+            tile->tex = texture_from_compressed(tile->compressed);
+            if (!tile->tex) LOG_W("Unsupported tile format: %s", hips->url);
+        } else if (!atlas_add_tile(hips, tile)) {
+            tile->tex = texture_from_data(tile->img, tile->w, tile->h,
+                                          tile->bpp, 0, 0, tile->w, tile->h,
+                                          0);
+        }
+        if (trace_is_enabled()) {
+            trace_event('X', "hips", "texture_upload", 0, start,
+                        trace_get_time() - start,
+                        "\"url\": \"%s\", \"order\": %d, \"pix\": %d, "
+                        "\"w\": %d, \"h\": %d",
+                        hips->url, order, pix, tile->w, tile->h);
+            trace_tile('e', "tile", hips, order, pix);
+        }
         free(tile->img);
         tile->img = NULL;
+        free(tile->compressed);
+        tile->compressed = NULL;
+        hips->fallbacks_version++;
+        // The image now lives in the GPU memory.
+        tile_set_cost(cache_get(get_cache(hips->settings.cache),
+                                &(tile_key_t){hips->hash, order, pix,
+                                              tile->reduce},
+                                sizeof(tile_key_t)),
+                      sizeof(tile_t) + sizeof(*tile) +
+                      (tile->atlas ? tile->w * tile->h * tile->bpp :
+                       texture_get_memory_size(tile->tex)));
     }
     if (tile && tile->tex) {
-        *loading_complete = true;
+        *loading_complete = !other_size;
+        if (tile->atlas && transf) {
+            get_sub_rect_transf(
+                    (tile->slot % ATLAS_SIDE) * tile->atlas->tile_size,
+                    (tile->slot / ATLAS_SIDE) * tile->atlas->tile_size,
+                    tile->atlas->tile_size, tile->atlas->tex->w,
+                    tile->atlas->tex->h, transf);
+        }
         return tile->tex;
     }
 
 
     // Return the allsky texture if the tile is not ready yet.  Only do
-    // it for level 0 allsky for the moment.
+    // it for level 0 allsky for the moment.  All the pixels share the
+    // same texture.
     if (!tile && order == 0 && hips->allsky.data) {
-        if (!hips->allsky.textures[pix]) {
+        if (!hips->allsky.texture) {
+            hips->allsky.texture = texture_from_data(
+                    hips->allsky.data, hips->allsky.w, hips->allsky.h,
+                    hips->allsky.bpp, 0, 0, hips->allsky.w, hips->allsky.h,
+                    0);
+            hips->fallbacks_version++;
+        }
+        if (transf) {
             nbw = (int)sqrt(12 * (1 << (2 * hips->order_min)));
             x = (pix % nbw) * hips->allsky.w / nbw;
             y = (pix / nbw) * hips->allsky.w / nbw;
-            hips->allsky.textures[pix] = texture_from_data(
-                    hips->allsky.data, hips->allsky.w, hips->allsky.h,
-                    hips->allsky.bpp,
-                    x, y, hips->allsky.w / nbw, hips->allsky.w / nbw, 0);
+            get_sub_rect_transf(x, y, hips->allsky.w / nbw, hips->allsky.w,
+                                hips->allsky.h, transf);
         }
-        return hips->allsky.textures[pix];
+        return hips->allsky.texture;
+    }
+    return NULL;
+}
+
+static void clear_fallbacks(hips_t *hips)
+{
+    fallback_t *fb, *tmp;
+    HASH_ITER(hh, hips->fallbacks, fb, tmp) {
+        HASH_DEL(hips->fallbacks, fb);
+        free(fb);
+    }
+}
+
+/*
+ * Function: get_fallback_texture
+ * Get the texture of the closest ancestor of a tile that has one.
+ *
+ * The ancestor found is remembered in the survey fallbacks map, so that
+ * the next frames only need a single cache lookup instead of walking up
+ * all the parent tiles.  The map entries are invalidated each time a new
+ * tile texture gets created, since a closer ancestor might then be
+ * available.
+ */
+static texture_t *get_fallback_texture(
+        hips_t *hips, int order, int pix, int flags, double transf[3][3])
+{
+    tile_key_t key = {hips->hash, order, pix};
+    fallback_t *fb;
+    texture_t *tex = NULL;
+    double m[3][3] = MAT3_IDENTITY;
+    int o, p;
+
+    HASH_FIND(hh, hips->fallbacks, &key, sizeof(key), fb);
+    if (fb && fb->version == hips->fallbacks_version)
+        tex = get_tile_own_texture(hips, fb->order, fb->pix, flags, m, NULL);
+
+    if (!tex) {
+        for (o = order - 1; o >= hips->order_min; o--) {
+            mat3_set_identity(m);
+            tex = get_tile_own_texture(hips, o, pix >> (2 * (order - o)),
+                                       flags, m, NULL);
+            if (tex) break;
+        }
+        if (!tex) return NULL;
+        if (!fb) {
+            // Don't let the map grow without limit.
+            if (HASH_COUNT(hips->fallbacks) >= 4096)
+                clear_fallbacks(hips);
+            fb = calloc(1, sizeof(*fb));
+            fb->key = key;
+            HASH_ADD(hh, hips->fallbacks, key, sizeof(key), fb);
+        }
+        fb->order = o;
+        fb->pix = pix >> (2 * (order - o));
+        fb->version = hips->fallbacks_version;
     }
 
-    // If we didn't find the tile, or the texture is not loaded yet,
-    // fallback to one of the parent tile texture.
-    if (order == hips->order_min) return NULL; // No parent.
-    tex = hips_get_tile_texture(
-            hips, order - 1, pix / 4, flags, transf, NULL, NULL);
-    if (!tex) return NULL;
     if (transf) {
-        mat3_iscale(transf, 0.5, 0.5, 1.0);
-        mat3_itranslate(transf, (pix % 4) / 2, (pix % 4) % 2);
+        for (o = fb->order + 1; o <= order; o++) {
+            p = pix >> (2 * (order - o));
+            mat3_iscale(m, 0.5, 0.5, 1.0);
+            mat3_itranslate(m, (p % 4) / 2, (p % 4) % 2);
+        }
+        mat3_mul(transf, m, transf);
     }
     return tex;
 }
 
+texture_t *hips_get_tile_texture(
+        hips_t *hips, int order, int pix, int flags,
+        double transf[3][3], double *fade,
+        bool *loading_complete)
+{
+    PROFILE(hips_get_tile_texture, PROFILE_AGGREGATE)
+    bool loading_complete_;
+    texture_t *tex;
+
+    if (!loading_complete) loading_complete = &loading_complete_;
+    // Set all the default values.
+    *loading_complete = false;
+    if (fade) *fade = 1.0;
+
+    if (!hips_is_ready(hips)) return NULL;
+    if (order < hips->order_min) return NULL;
+
+    tex = get_tile_own_texture(hips, order, pix, flags, transf,
+                               loading_complete);
+    if (tex) return tex;
+
+    // If we didn't find the tile, or the texture is not loaded yet,
+    // fallback to one of the parent tile texture.
+    if (order == hips->order_min) return NULL; // No parent.
+    return get_fallback_texture(hips, order, pix, flags, transf);
+}
+
 
 static int render_visitor(hips_t *hips, const painter_t *painter_,
                           int order, int pix, int split, int flags,
@@ -399,7 +845,8 @@ static int render_visitor(hips_t *hips, const painter_t *painter_,
     texture_t *tex;
     uv_map_t map;
     bool loaded;
-    double fade;
+    const bool outside = !(flags & HIPS_PLANET);
+    double fade, priority;
     // UV transfo mat with swapped x and y.
     const double uv_swap[3][3] = {{0, 1, 0}, {1, 0, 0}, {0, 0, 1}};
     double uv[3][3] = MAT3_IDENTITY;
@@ -409,6 +856,11 @@ static int render_visitor(hips_t *hips, const painter_t *painter_,
     tex = hips_get_tile_texture(hips, order, pix, flags, uv, &fade, &loaded);
     mat3_mul(uv, uv_swap, uv);
     if (loaded) (*nb_loaded)++;
+    if (!loaded) {
+        priority = painter_get_healpix_priority(&painter, hips->frame,
+                                                order, pix, outside);
+        hips_set_tile_priority(hips, order, pix, priority);
+    }
     if (!tex) return 0;
     painter.color[3] *= fade;
     painter_set_texture(&painter, PAINTER_TEX_COLOR, tex, uv);
@@ -418,6 +870,90 @@ static int render_visitor(hips_t *hips, const painter_t *painter_,
 }
 
 
+// Load the tiles that are going to be visible soon.
+static int prefetch_visitor(hips_t *hips, const painter_t *painter,
+                            int order, int pix, int split, int flags,
+                            void *user)
+{
+    const painter_t *current = USER_GET(user, 0);
+    const bool outside = !(flags & HIPS_PLANET);
+    double priority;
+    int code;
+
+    // Already requested by the current view rendering.
+    if (!painter_is_healpix_clipped(current, hips->frame, order, pix,
+                                    outside))
+        return 0;
+    hips_get_tile(hips, order, pix, HIPS_LOAD_IN_THREAD, &code);
+    if (code) return 0;
+    // Always after the currently visible tiles.
+    priority = painter_get_healpix_priority(painter, hips->frame,
+                                            order, pix, outside);
+    hips_set_tile_priority(hips, order, pix, priority - 32);
+    return 0;
+}
+
+// Key of all the values the traversal of a survey in the observed frame
+// depends on.
+static uint32_t get_visible_key(const hips_t *hips, const painter_t *painter,
+                                double angle, int split_order)
+{
+    uint32_t key;
+    const projection_t *proj = painter->proj;
+    const double values[] = {
+        angle, split_order, hips->order, hips->order_min,
+        hips->allsky.data ? 1 : 0, painter->fb_size[0], painter->fb_size[1],
+        painter->flags, painter->degrade, proj->type, proj->flags,
+        proj->scaling[0], proj->scaling[1], proj->window_size[0],
+        proj->window_size[1],
+    };
+    key = crc32(0, (void*)values, sizeof(values));
+    key = crc32(key, (void*)painter->obs->ro2v, sizeof(painter->obs->ro2v));
+    key = crc32(key, (void*)*painter->transform, sizeof(*painter->transform));
+    key = crc32(key, (void*)proj->mat, sizeof(proj->mat));
+    return key;
+}
+
+static int record_visitor(hips_t *hips, const painter_t *painter,
+                          int order, int pix, int split, int flags,
+                          void *user)
+{
+    typeof(hips->visible) *visible = &hips->visible;
+    if (visible->nb >= visible->allocated) {
+        visible->allocated = max(64, visible->allocated * 2);
+        visible->tiles = realloc(visible->tiles,
+                visible->allocated * sizeof(*visible->tiles));
+    }
+    visible->tiles[visible->nb++] = (typeof(*visible->tiles)) {
+        order, pix, split, flags};
+    return render_visitor(hips, painter, order, pix, split, flags, user);
+}
+
+// Render a survey in the observed frame, reusing the list of visible tiles
+// of the previous frame if the view didn't change.
+static void render_observed(hips_t *hips, const painter_t *painter,
+                            double angle, int split_order,
+                            int *nb_tot, int *nb_loaded)
+{
+    int i;
+    uint32_t key = get_visible_key(hips, painter, angle, split_order);
+
+    if (key != hips->visible.key) {
+        hips->visible.key = key;
+        hips->visible.nb = 0;
+        hips_render_traverse(hips, painter, angle, split_order,
+                             USER_PASS(nb_tot, nb_loaded), record_visitor);
+        return;
+    }
+    for (i = 0; i < hips->visible.nb; i++) {
+        render_visitor(hips, painter, hips->visible.tiles[i].order,
+                       hips->visible.tiles[i].pix,
+                       hips->visible.tiles[i].split,
+                       hips->visible.tiles[i].flags,
+                       USER_PASS(nb_tot, nb_loaded));
+    }
+}
+
 int hips_render(hips_t *hips, const painter_t *painter, double angle,
                 int split_order)
 {
@@ -425,10 +961,19 @@ int hips_render(hips_t *hips, const painter_t *painter, double angle,
     int nb_tot = 0, nb_loaded = 0;
     if (painter->color[3] == 0.0) return 0;
     if (!hips_is_ready(hips)) return 0;
-    hips_render_traverse(hips, painter, angle, split_order,
-                         USER_PASS(&nb_tot, &nb_loaded),
-                         render_visitor);
+    if (hips->frame == FRAME_OBSERVED && painter->obs) {
+        render_observed(hips, painter, angle, split_order,
+                        &nb_tot, &nb_loaded);
+    } else {
+        hips_render_traverse(hips, painter, angle, split_order,
+                             USER_PASS(&nb_tot, &nb_loaded),
+                             render_visitor);
+    }
     progressbar_report(hips->url, hips->label, nb_loaded, nb_tot, -1);
+    if (painter->prefetch && painter->transform == &mat4_identity) {
+        hips_render_traverse(hips, painter->prefetch, angle, split_order,
+                             USER_PASS(painter), prefetch_visitor);
+    }
     return 0;
 }
 
@@ -502,6 +1047,19 @@ static bool hips_update(hips_t *hips)
         init_label(hips);
     }
 
+    // The eph tiles cannot be decoded before their dictionary is loaded.
+    if (hips->eph_dict.path && !hips->eph_dict.loaded) {
+        snprintf(url, sizeof(url), "%s/%s?v=%d", hips->service_url,
+                 hips->eph_dict.path, (int)hips->release_date);
+        data = asset_get_data2(url, ASSET_USED_ONCE, &size, &code);
+        if (!code) return false;
+        if (data)
+            eph_add_dictionary(data, size);
+        else
+            LOG_W("Cannot get eph dictionary %s: %d", url, code);
+        hips->eph_dict.loaded = true;
+    }
+
     // Get the allsky before anything else if available.
     // Only for level zero allsky images.  We don't use the other ones.
     if (!hips->allsky.worker.fn &&
@@ -546,34 +1104,52 @@ int hips_get_render_order(const hips_t *hips, const painter_t *painter,
     pix_per_rad = painter->fb_size[0] / atan(painter->proj->scaling[0]) / 2;
     px = pix_per_rad * angle;
     w = hips->tile_width ?: 256;
-    return round(log2(px / (4.0 * sqrt(2.0) * w)));
+    // Use up to one order less when the quality is reduced.
+    return round(log2(px / (4.0 * sqrt(2.0) * w)) - painter->degrade);
 }
 
 // Similar to hips_render, but instead of actually rendering the tiles
 // we call a callback function.  This can be used when we need better
 // control on the rendering.
-int hips_render_traverse(
-        hips_t *hips, const painter_t *painter,
-        double angle, int split_order, void *user,
-        int (*callback)(hips_t *hips, const painter_t *painter,
-                        int order, int pix, int split, int flags, void *user))
+// Compute the actual order at which we render a survey, and the flags
+// to pass to the traverse callback.
+static int get_traverse_order(const hips_t *hips, const painter_t *painter,
+                              double angle, int *flags)
 {
     int render_order;
-    int flags = 0;
-    hips_update(hips);
+    *flags = 0;
     render_order = hips_get_render_order(hips, painter, angle);
     if (angle < 2.0 * M_PI)
-        flags |= HIPS_PLANET;
-    assert(split_order >= 0);
+        *flags |= HIPS_PLANET;
+
+    // The tiles of the min order can be rendered much smaller than their
+    // resolution, like for the far planets.  In that case we can decode
+    // them at a reduced size, up to 8 times smaller.
+    if (render_order < hips->order_min)
+        *flags |= min(hips->order_min - render_order, 3) * HIPS_REDUCE_1;
 
     // For extrem low resolution force using the allsky if available so that
     // we don't download too much data.
     if (render_order < -5 && hips->allsky.data)
-        flags |= HIPS_FORCE_USE_ALLSKY;
+        *flags |= HIPS_FORCE_USE_ALLSKY;
 
     // Clamp the render order into physically possible range.
     render_order = clamp(render_order, hips->order_min, hips->order);
     render_order = min(render_order, 9); // Hard limit.
+    return render_order;
+}
+
+int hips_render_traverse(
+        hips_t *hips, const painter_t *painter,
+        double angle, int split_order, void *user,
+        int (*callback)(hips_t *hips, const painter_t *painter,
+                        int order, int pix, int split, int flags, void *user))
+{
+    int render_order;
+    int flags;
+    hips_update(hips);
+    render_order = get_traverse_order(hips, painter, angle, &flags);
+    assert(split_order >= 0);
 
     // Can't split less than the rendering order.
     split_order = max(split_order, render_order);
@@ -584,6 +1160,124 @@ int hips_render_traverse(
     return 0;
 }
 
+// One survey of a multi surveys rendering.
+typedef struct {
+    hips_t          *hips;
+    const painter_t *painter;
+    int             order;  // Render order of the survey.
+    int             flags;
+    int             nb_tot;
+    int             nb_loaded;
+} multi_layer_t;
+
+static int multi_render_visitor(hips_t *hips, const painter_t *painter_,
+                                int order, int pix, int split, int flags,
+                                void *user)
+{
+    int i, o, p, nb = *(int*)USER_GET(user, 0), lorder, lpix;
+    multi_layer_t *layers = USER_GET(user, 1), *layer;
+    painter_t painter;
+    texture_t *tex;
+    uv_map_t map;
+    bool loaded;
+    double fade, priority;
+    const double uv_swap[3][3] = {{0, 1, 0}, {1, 0, 0}, {0, 0, 1}};
+    double uv[3][3];
+
+    // The geometry is the same for all the surveys.
+    uv_map_init_healpix(&map, order, pix, false, true);
+    for (i = 0; i < nb; i++) {
+        layer = &layers[i];
+        // Surveys with a lower render order use their parent tile.
+        lorder = min(order, layer->order);
+        lpix = pix >> (2 * (order - lorder));
+        mat3_set_identity(uv);
+        // Only count each parent tile once for the progress report.
+        if ((pix & ((1 << (2 * (order - lorder))) - 1)) == 0)
+            layer->nb_tot++;
+        tex = hips_get_tile_texture(layer->hips, lorder, lpix,
+                                    layer->flags | HIPS_LOAD_IN_THREAD,
+                                    uv, &fade, &loaded);
+        if (loaded && lpix << (2 * (order - lorder)) == pix)
+            layer->nb_loaded++;
+        if (!loaded) {
+            priority = painter_get_healpix_priority(
+                    layer->painter, layer->hips->frame, lorder, lpix,
+                    !(flags & HIPS_PLANET));
+            hips_set_tile_priority(layer->hips, lorder, lpix, priority);
+        }
+        if (!tex) continue;
+        // Same as the parent fallback of hips_get_tile_texture.
+        for (o = lorder + 1; o <= order; o++) {
+            p = pix >> (2 * (order - o));
+            mat3_iscale(uv, 0.5, 0.5, 1.0);
+            mat3_itranslate(uv, (p % 4) / 2, (p % 4) % 2);
+        }
+        mat3_mul(uv, uv_swap, uv);
+        painter = *layer->painter;
+        painter.color[3] *= fade;
+        painter_set_texture(&painter, PAINTER_TEX_COLOR, tex, uv);
+        paint_quad(&painter, layer->hips->frame, &map, split);
+    }
+    return 0;
+}
+
+int hips_render_multi(int nb, hips_t **surveys, const painter_t *painters,
+                      double angle, int split_order)
+{
+    PROFILE(hips_render_multi, 0);
+    multi_layer_t layers[HIPS_MULTI_MAX];
+    int i, n = 0, top = 0;
+
+    assert(nb <= HIPS_MULTI_MAX);
+    for (i = 0; i < nb; i++) {
+        if (painters[i].color[3] == 0.0) continue;
+        if (!hips_is_ready(surveys[i])) continue;
+        layers[n] = (multi_layer_t) {
+            .hips = surveys[i],
+            .painter = &painters[i],
+        };
+        layers[n].order = get_traverse_order(surveys[i], &painters[i],
+                                             angle, &layers[n].flags);
+        n++;
+    }
+    if (n == 0) return 0;
+
+    // We can only share the traversal if all the surveys are in the same
+    // frame, otherwise render them separately.
+    for (i = 1; i < n; i++) {
+        if (layers[i].hips->frame != layers[0].hips->frame) break;
+    }
+    if (n == 1 || i < n) {
+        for (i = 0; i < n; i++) {
+            hips_render(layers[i].hips, layers[i].painter, angle,
+                        split_order);
+        }
+        return 0;
+    }
+
+    // Traverse using the survey with the highest render order.
+    for (i = 1; i < n; i++) {
+        if (layers[i].order > layers[top].order) top = i;
+    }
+    hips_render_traverse(layers[top].hips, layers[top].painter, angle,
+                         split_order, USER_PASS(&n, layers),
+                         multi_render_visitor);
+
+    for (i = 0; i < n; i++) {
+        progressbar_report(layers[i].hips->url, layers[i].hips->label,
+                           layers[i].nb_loaded, layers[i].nb_tot, -1);
+        if (layers[i].painter->prefetch &&
+                layers[i].painter->transform == &mat4_identity) {
+            hips_render_traverse(layers[i].hips,
+                                 layers[i].painter->prefetch, angle,
+                                 split_order, USER_PASS(layers[i].painter),
+                                 prefetch_visitor);
+        }
+    }
+    return 0;
+}
+
 int hips_parse_hipslist(
         const char *data, void *user,
         int callback(void *user, const char *url, double release_date))
@@ -626,21 +1320,161 @@ next:
     return nb;
 }
 
+// Create the data of a tile, with the image surveys decoding at the tile
+// reduced size.
+static const void *tile_create_data(tile_t *tile, void *data, int size,
+                                    int *cost, int *transparency)
+{
+    const hips_t *hips = tile->hips;
+    if (tile->reduce && hips->settings.create_tile == create_img_tile)
+        return create_img_tile_reduced(data, size, tile->reduce, cost,
+                                       transparency);
+    return hips->settings.create_tile(hips->settings.user, tile->pos.order,
+                                      tile->pos.pix, data, size, cost,
+                                      transparency);
+}
+
 static int load_tile_worker(worker_t *worker)
 {
     int transparency = 0;
-    typeof(((tile_t*)0)->loader) loader = (void*)worker;
+    loader_t *loader = (void*)worker;
     tile_t *tile = loader->tile;
-    hips_t *hips = tile->hips;
-    tile->data = hips->settings.create_tile(
-                    hips->settings.user, tile->pos.order, tile->pos.pix,
-                    loader->data, loader->size, &loader->cost, &transparency);
+    double start = trace_get_time();
+    tile->data = tile_create_data(tile, (void*)loader->src,
+                                  loader->src_size, &loader->cost,
+                                  &transparency);
+    trace_tile_create(tile, start);
     if (!tile->data) tile->flags |= TILE_LOAD_ERROR;
     tile->flags |= (transparency * TILE_NO_CHILD_0);
-    free(loader->data);
+    asset_buffer_release(loader->data);
+    loader->data = NULL;
     return 0;
 }
 
+static uint32_t read_u32(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+}
+
+/*
+ * Find a tile data in a bundle file.
+ *
+ * Return:
+ *   200 if the tile is in the bundle, 404 if not, or 500 if the bundle
+ *   is invalid.
+ */
+static int bundle_find(const uint8_t *data, int size, int pix,
+                       const void **tile_data, int *tile_size)
+{
+    int nb, i0 = 0, i1, i;
+    uint32_t p, offset, tsize;
+    const uint8_t *entry;
+
+    if (size < BUNDLE_HEADER_SIZE || memcmp(data, "HBDL", 4) != 0)
+        return 500;
+    nb = read_u32(data + 4);
+    if (nb < 0 || nb > (size - BUNDLE_HEADER_SIZE) / BUNDLE_ENTRY_SIZE)
+        return 500;
+    i1 = nb;
+    while (i0 < i1) {
+        i = (i0 + i1) / 2;
+        entry = data + BUNDLE_HEADER_SIZE + i * BUNDLE_ENTRY_SIZE;
+        p = read_u32(entry);
+        if (p < pix) {
+            i0 = i + 1;
+            continue;
+        }
+        if (p > pix) {
+            i1 = i;
+            continue;
+        }
+        offset = read_u32(entry + 4);
+        tsize = read_u32(entry + 8);
+        if (offset > size || tsize > size - offset) return 500;
+        *tile_data = data + offset;
+        *tile_size = tsize;
+        return 200;
+    }
+    return 404;
+}
+
+static bundle_t *get_bundle(hips_t *hips, int order, int pix)
+{
+    bundle_t *bundle, key = {.key = {order, (pix / 10000) * 10000}};
+    HASH_FIND(hh, hips->bundles, &key.key, sizeof(key.key), bundle);
+    if (bundle) return bundle;
+    bundle = calloc(1, sizeof(*bundle));
+    bundle->key = key.key;
+    bundle->nb_left = -1;
+    HASH_ADD(hh, hips->bundles, key, sizeof(bundle->key), bundle);
+    return bundle;
+}
+
+/*
+ * Get a tile data from its bundle file.
+ *
+ * Return:
+ *   The tile data and the bundle url in url, or NULL if it's not available,
+ *   with the same code convention as asset_get_data.  If the bundle doesn't
+ *   exist, code is set to -1, and we should try the tile url instead.
+ */
+static const void *get_tile_from_bundle(hips_t *hips, int order, int pix,
+                                        char *url, int *size, int *code)
+{
+    bundle_t *bundle;
+    const void *data, *tile_data = NULL;
+    int bundle_size;
+
+    bundle = get_bundle(hips, order, pix);
+    if (bundle->missing) {
+        *code = -1;
+        return NULL;
+    }
+    get_url_for(hips, url, "Norder%d/Dir%d/Bundle.bin",
+                order, bundle->key.dir);
+    data = asset_get_data2(url, ASSET_ACCEPT_404, &bundle_size, code);
+    if (!(*code)) return NULL;
+    if (!data) {
+        LOG_W("Cannot get tiles bundle %s (%d)", url, *code);
+        bundle->missing = true;
+        *code = -1;
+        return NULL;
+    }
+    if (bundle->nb_left == -1)
+        bundle->nb_left = read_u32((const uint8_t*)data + 4);
+    *code = bundle_find(data, bundle_size, pix, &tile_data, size);
+    if (*code == 500) {
+        LOG_W("Invalid tiles bundle %s", url);
+        asset_release(url);
+        bundle->missing = true;
+        *code = -1;
+        return NULL;
+    }
+    return tile_data;
+}
+
+// Called each time we extracted a tile from its bundle, to release the
+// bundle data once we got all its tiles.
+static void bundle_on_tile_extracted(hips_t *hips, int order, int pix,
+                                     const char *url)
+{
+    bundle_t *bundle = get_bundle(hips, order, pix);
+    if (--bundle->nb_left <= 0) asset_release(url);
+}
+
+static void on_tile_loaded(tile_t *tile)
+{
+    tile->state_time = sys_get_unix_time();
+    // For image surveys the trace ends at the texture upload.
+    if (tile->hips->settings.create_tile != create_img_tile || !tile->data)
+        trace_tile('e', "tile", tile->hips, tile->pos.order, tile->pos.pix);
+    else
+        trace_tile('n', "loaded", tile->hips, tile->pos.order, tile->pos.pix);
+    if (!g_tile_hook.fn) return;
+    g_tile_hook.fn(g_tile_hook.user, tile->hips->url, tile->pos.order,
+                   tile->pos.pix, sys_get_unix_time() - tile->request_time);
+}
+
 static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
                               int *code)
 {
@@ -648,20 +1482,31 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
     int size, parent_code, asset_flags, cost = 0, transparency = 0;
     char url[URL_MAX_SIZE];
     tile_t *tile, *parent;
-    tile_key_t key = {hips->hash, order, pix};
+    // Only the image tiles can be decoded at a reduced size.
+    const int reduce = hips->settings.create_tile == create_img_tile ?
+                       (flags & HIPS_REDUCE_MASK) / HIPS_REDUCE_1 : 0;
+    tile_key_t key = {hips->hash, order, pix, reduce};
+    // The downloads are shared by all the sizes.
+    const tile_key_t dkey = {hips->hash, order, pix};
+    cache_t *cache = get_cache(hips->settings.cache);
+    download_t *download;
+    bool bundled;
+    double start, request_time = sys_get_unix_time();
 
     assert(order >= 0);
     *code = 0;
 
-    if (!g_cache) g_cache = cache_create(CACHE_SIZE);
-    tile = cache_get(g_cache, &key, sizeof(key));
+    tile = cache_get(cache, &key, sizeof(key));
+    if (tile) tile->hits++;
 
     // Got a tile but it is still loading.
     if (tile && tile->loader) {
+        tile->loader->requested = true;
         if (!worker_iter(&tile->loader->worker)) return NULL;
-        cache_set_cost(g_cache, &key, sizeof(key), tile->loader->cost);
-        free(tile->loader);
+        tile_set_cost(tile, sizeof(*tile) + tile->loader->cost);
+        loader_delete(tile->loader);
         tile->loader = NULL;
+        on_tile_loaded(tile);
     }
     if (tile) {
         *code = 200;
@@ -676,8 +1521,11 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
         return NULL;
     }
 
-    // Skip if we already know that this tile doesn't exists.
-    if (order > hips->order_min) {
+    // Skip if we already know that this tile doesn't exists.  If the tile
+    // is already downloading, the parent was checked when we started it,
+    // so we don't need to walk up the parents again.
+    HASH_FIND(hh, g_downloads, &dkey, sizeof(dkey), download);
+    if (order > hips->order_min && !download) {
         parent = hips_get_tile_(hips, order - 1, pix / 4, flags, &parent_code);
         if (!parent) return NULL; // Always get parent first.
         if (parent->flags & (TILE_NO_CHILD_0 << (pix % 4))) {
@@ -685,12 +1533,46 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
             return NULL;
         }
     }
-    get_url_for(hips, url, "Norder%d/Dir%d/Npix%d.%s",
-                order, (pix / 10000) * 10000, pix, hips->ext);
-    asset_flags = ASSET_ACCEPT_404;
-    if (order > 0) asset_flags |= ASSET_DELAY;
-    data = asset_get_data2(url, asset_flags, &size, code);
-    if (!(*code)) return NULL; // Still loading the file.
+    *code = -1;
+    if (order <= hips->bundle_order)
+        data = get_tile_from_bundle(hips, order, pix, url, &size, code);
+    bundled = *code != -1;
+    if (!bundled) {
+        get_url_for(hips, url, "Norder%d/Dir%d/Npix%d.%s",
+                    order, (pix / 10000) * 10000, pix, hips->ext);
+        asset_flags = ASSET_ACCEPT_404;
+        if (order > 0) asset_flags |= ASSET_DELAY;
+        data = asset_get_data2(url, asset_flags, &size, code);
+    }
+    if (!(*code)) { // Still loading the file.
+        // The bundles are shared by many tiles, don't cancel them.
+        if (bundled) return NULL;
+        if (!download) {
+            download = calloc(1, sizeof(*download) + strlen(url) + 1);
+            download->key = dkey;
+            download->start_time = request_time;
+            strcpy(download->url, url);
+            HASH_ADD(hh, g_downloads, key, sizeof(key), download);
+            trace_tile('b', "tile", hips, order, pix);
+        }
+        download->unused = 0;
+        return NULL;
+    }
+    if (    !(flags & HIPS_LOAD_IN_THREAD) && (*code) / 100 == 2 &&
+            g_create_time >= CREATE_BUDGET) {
+        *code = 0;
+        if (download) download->unused = 0;
+        g_create_postponed++;
+        return NULL;
+    }
+    if (download) {
+        request_time = download->start_time;
+        HASH_DEL(g_downloads, download);
+        free(download);
+    } else {
+        trace_tile('b', "tile", hips, order, pix);
+    }
+    trace_tile('n', "data", hips, order, pix);
 
     // If the tile doesn't exists, mark it in the parent tile so that we
     // won't have to search for it again.
@@ -715,59 +1597,259 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
     tile->pos.order = order;
     tile->pos.pix = pix;
     tile->hips = hips;
-    cache_add(g_cache, &key, sizeof(key), tile, sizeof(*tile) + cost,
-              del_tile);
+    tile->request_time = request_time;
+    tile->state_time = sys_get_unix_time();
+    tile->reduce = reduce;
 
     if (!(flags & HIPS_LOAD_IN_THREAD)) {
-        tile->data = hips->settings.create_tile(
-                hips->settings.user, order, pix, data, size,
-                &cost, &transparency);
+        start = trace_get_time();
+        tile->data = tile_create_data(tile, (void*)data, size, &cost,
+                                      &transparency);
+        trace_tile_create(tile, start);
+        g_create_time += trace_get_time() - start;
         tile->flags |= (transparency * TILE_NO_CHILD_0);
         if (!tile->data) {
             LOG_W("Cannot parse tile %s", url);
             tile->flags |= TILE_LOAD_ERROR;
         }
-        asset_release(url);
+        if (!bundled) asset_release(url);
+        else bundle_on_tile_extracted(hips, order, pix, url);
+        tile_add_to_cache(tile, sizeof(*tile) + cost);
+        on_tile_loaded(tile);
     } else {
         tile->loader = calloc(1, sizeof(*tile->loader));
         worker_init(&tile->loader->worker, load_tile_worker);
-        tile->loader->data = malloc(size);
-        tile->loader->size = size;
+        // Keep a reference to the asset data instead of copying it.
+        tile->loader->data = asset_retain(url);
+        tile->loader->src = data;
+        tile->loader->src_size = size;
         tile->loader->tile = tile;
-        memcpy(tile->loader->data, data, size);
-        asset_release(url);
+        tile->loader->requested = true;
+        DL_APPEND(g_loaders, tile->loader);
+        trace_tile('n', "queued", hips, order, pix);
+        // Until the tile is parsed, count the memory of the source data.
+        tile_add_to_cache(tile,
+                sizeof(*tile) + sizeof(*tile->loader) + size);
+        if (!bundled) asset_release(url);
+        else bundle_on_tile_extracted(hips, order, pix, url);
         *code = 0;
         return NULL;
     }
     return tile;
 }
 
+// Add a tile to the list of the visited tiles.
+static void record_visited_tile(const hips_t *hips, int order, int pix,
+                                const tile_t *tile, int code)
+{
+    hips_tile_info_t *info;
+    tile_key_t key = {hips->hash, order, pix};
+    download_t *download;
+
+    if (code / 100 == 4) return; // The tile doesn't exist.
+    if (g_visited.nb == g_visited.allocated) {
+        g_visited.allocated = max(256, g_visited.allocated * 2);
+        g_visited.tiles = realloc(g_visited.tiles,
+                g_visited.allocated * sizeof(*g_visited.tiles));
+    }
+    info = &g_visited.tiles[g_visited.nb++];
+    *info = (hips_tile_info_t) {
+        .order = order,
+        .pix = pix,
+        .frame = hips->frame,
+        .state = HIPS_TILE_WAITING,
+    };
+    if (tile) {
+        info->time = tile->state_time;
+        info->hits = tile->hits;
+        if (tile->flags & TILE_LOAD_ERROR)
+            info->state = HIPS_TILE_ERROR;
+        else if (tile->loader && worker_is_running(&tile->loader->worker))
+            info->state = HIPS_TILE_DECODING;
+        else if (tile->loader)
+            info->state = HIPS_TILE_QUEUED;
+        else
+            info->state = HIPS_TILE_LOADED;
+    } else if (code) {
+        info->state = HIPS_TILE_ERROR;
+    } else {
+        HASH_FIND(hh, g_downloads, &key, sizeof(key), download);
+        if (download) {
+            info->state = HIPS_TILE_DOWNLOADING;
+            info->time = download->start_time;
+        }
+    }
+}
+
 const void *hips_get_tile(hips_t *hips, int order, int pix, int flags,
                           int *code)
 {
     tile_t *tile = hips_get_tile_(hips, order, pix, flags, code);
     if (*code == 0) assert(!tile);
+    if (g_visited.filter && strstr(hips->url, g_visited.filter))
+        record_visited_tile(hips, order, pix, tile, *code);
     return tile ? tile->data : NULL;
 }
 
+void hips_record_visited_tiles(const char *filter)
+{
+    free(g_visited.filter);
+    g_visited.filter = filter ? strdup(filter) : NULL;
+    g_visited.nb = 0;
+}
+
+const hips_tile_info_t *hips_get_visited_tiles(int *nb)
+{
+    *nb = g_visited.nb;
+    g_visited.nb = 0;
+    return g_visited.tiles;
+}
+
+void hips_set_tile_priority(hips_t *hips, int order, int pix,
+                            double priority)
+{
+    tile_t *tile;
+    download_t *download;
+    tile_key_t key = {hips->hash, order, pix};
+    tile = cache_get(get_cache(hips->settings.cache), &key, sizeof(key));
+    if (!tile) {
+        HASH_FIND(hh, g_downloads, &key, sizeof(key), download);
+        if (download) asset_set_priority(download->url, priority);
+        return;
+    }
+    if (!tile->loader) return;
+    worker_set_priority(&tile->loader->worker, priority);
+}
+
+int hips_update_loaders(void)
+{
+    loader_t *loader;
+    download_t *download, *tmp;
+    int nb = g_create_postponed;
+    g_create_time = 0;
+    g_create_postponed = 0;
+    DL_FOREACH(g_loaders, loader) {
+        if (!loader->requested) worker_cancel(&loader->worker);
+        else nb++;
+        loader->requested = false;
+    }
+    HASH_ITER(hh, g_downloads, download, tmp) {
+        if (download->unused++ < DOWNLOAD_MAX_UNUSED) {
+            nb++;
+            continue;
+        }
+        asset_cancel(download->url);
+        HASH_DEL(g_downloads, download);
+        free(download);
+    }
+    return nb;
+}
+
+void hips_set_cache_size(int cache, int size)
+{
+    cache_set_max_size(get_cache(cache), size);
+}
+
+int hips_get_cache_size(int cache, int *used)
+{
+    if (used) *used = cache_get_current_size(get_cache(cache));
+    return cache_get_max_size(get_cache(cache));
+}
+
+json_value *hips_get_memory_stats(void)
+{
+    const char *NAMES[HIPS_CACHE_COUNT] = {
+        [HIPS_CACHE_IMAGES] = "images",
+        [HIPS_CACHE_STARS]  = "stars",
+        [HIPS_CACHE_DSOS]   = "dsos",
+    };
+    json_value *ret, *caches, *surveys, *val;
+    cache_stats_t stats;
+    const hips_t *hips;
+    int i;
+
+    ret = json_object_new(0);
+    caches = json_object_push(ret, "caches", json_object_new(0));
+    for (i = 0; i < HIPS_CACHE_COUNT; i++) {
+        cache_get_stats(get_cache(i), &stats);
+        val = json_object_push(caches, NAMES[i], json_object_new(0));
+        json_object_push(val, "nb", json_integer_new(stats.nb));
+        json_object_push(val, "size", json_integer_new(stats.size));
+        json_object_push(val, "max_size", json_integer_new(stats.max_size));
+        json_object_push(val, "hits", json_integer_new(stats.hits));
+        json_object_push(val, "misses", json_integer_new(stats.misses));
+        json_object_push(val, "evictions",
+                         json_integer_new(stats.evictions));
+    }
+    surveys = json_object_push(ret, "surveys", json_object_new(0));
+    DL_FOREACH(g_hips, hips) {
+        if (!hips->mem.nb) continue;
+        val = json_object_push(surveys, hips->url, json_object_new(0));
+        json_object_push(val, "nb", json_integer_new(hips->mem.nb));
+        json_object_push(val, "size", json_integer_new(hips->mem.size));
+    }
+    return ret;
+}
+
+/*
+ * Create a tile from a compressed image.  We keep a copy of the data
+ * since the source is released once the tile is created.
+ */
+static img_tile_t *create_compressed_tile(const texture_compressed_t *img,
+                                          int *cost)
+{
+    int i, size = 0;
+    img_tile_t *tile;
+    uint8_t *data;
+
+    for (i = 0; i < img->levels_count; i++) size += img->levels[i].size;
+    tile = calloc(1, sizeof(*tile));
+    tile->compressed = malloc(sizeof(*img) + size);
+    *tile->compressed = *img;
+    data = (uint8_t*)(tile->compressed + 1);
+    for (i = 0; i < img->levels_count; i++) {
+        memcpy(data, img->levels[i].data, img->levels[i].size);
+        tile->compressed->levels[i].data = data;
+        data += img->levels[i].size;
+    }
+    tile->w = img->w;
+    tile->h = img->h;
+    // Only used for the upload budget: compressed bytes per pixel.
+    tile->bpp = max(size / (img->w * img->h), 1);
+    // We can't check the transparency of compressed tiles.
+    *cost = sizeof(*tile) + size;
+    return tile;
+}
+
 /*
  * Default tile support for images surveys
  */
 static const void *create_img_tile(
         void *user, int order, int pix, void *data, int size,
         int *cost, int *transparency)
+{
+    // Special case for allsky tiles!  Just return an empty image tile.
+    if (order == -1)
+        return calloc(1, sizeof(img_tile_t));
+    return create_img_tile_reduced(data, size, 0, cost, transparency);
+}
+
+static const void *create_img_tile_reduced(
+        void *data, int size, int reduce, int *cost, int *transparency)
 {
     void *img;
     int i, w, h, bpp = 0;
     img_tile_t *tile;
+    texture_compressed_t compressed;
 
-    // Special case for allsky tiles!  Just return an empty image tile.
-    if (order == -1) {
-        tile = calloc(1, sizeof(*tile));
+    // The compressed textures are always used at full size.
+    if (texture_ktx2_parse(data, size, &compressed)) {
+        tile = create_compressed_tile(&compressed, cost);
+        tile->reduce = reduce;
         return tile;
     }
 
-    img = img_read_from_mem(data, size, &w, &h, &bpp);
+    img = img_read_from_mem_reduced(data, size, reduce, &w, &h, &bpp);
     if (!img) {
         LOG_W("Cannot parse img");
         return NULL;
@@ -777,6 +1859,7 @@ static const void *create_img_tile(
     tile->w = w;
     tile->h = h;
     tile->bpp = bpp;
+    tile->reduce = reduce;
     // Compute transparency.
     for (i = 0; i < 4; i++) {
         if (img_is_transparent(img, w, h, bpp,
@@ -784,14 +1867,19 @@ static const void *create_img_tile(
                 *transparency |= 1 << i;
         }
     }
-    *cost = w * h * bpp;
+    *cost = sizeof(*tile) + w * h * bpp;
     return tile;
 }
 
 static int delete_img_tile(void *tile_)
 {
     img_tile_t *tile = tile_;
-    texture_release(tile->tex);
+    if (tile->atlas)
+        atlas_remove_tile(tile);
+    else
+        texture_release(tile->tex);
+    free(tile->img);
+    free(tile->compressed);
     free(tile);
     return 0;
 }
@@ -815,3 +1903,39 @@ double hips_parse_date(const char *str)
     eraDtf2d("UTC", iy, im, id, ihr, imn, 0, &d1, &d2);
     return d1 - DJM0 + d2;
 }
+
+void hips_set_tile_hook(void *user,
+        void (*fn)(void *user, const char *url, int order, int pix,
+                   double delay))
+{
+    g_tile_hook.user = user;
+    g_tile_hook.fn = fn;
+}
+
+#if COMPILE_TESTS
+
+static void test_bundle(void)
+{
+    // Bundle with the tiles 2 and 5.
+    const uint8_t data[] = {
+        'H', 'B', 'D', 'L', 2, 0, 0, 0,
+        2, 0, 0, 0, 32, 0, 0, 0, 3, 0, 0, 0,
+        5, 0, 0, 0, 35, 0, 0, 0, 2, 0, 0, 0,
+        'a', 'b', 'c', 'd', 'e',
+    };
+    const void *tile;
+    int size;
+
+    assert(bundle_find(data, sizeof(data), 2, &tile, &size) == 200);
+    assert(size == 3 && memcmp(tile, "abc", 3) == 0);
+    assert(bundle_find(data, sizeof(data), 5, &tile, &size) == 200);
+    assert(size == 2 && memcmp(tile, "de", 2) == 0);
+    assert(bundle_find(data, sizeof(data), 3, &tile, &size) == 404);
+    // Truncated data.
+    assert(bundle_find(data, sizeof(data) - 1, 5, &tile, &size) == 500);
+    assert(bundle_find(data, 16, 2, &tile, &size) == 500);
+}
+
+TEST_REGISTER(NULL, test_bundle, TEST_AUTO);
+
+#endif
@@ -27,6 +27,25 @@ enum {
     HIPS_FORCE_USE_ALLSKY       = 1 << 1,
     HIPS_LOAD_IN_THREAD         = 1 << 2,
     HIPS_CACHED_ONLY            = 1 << 3,
+    // Log2 of the factor by which the image tiles can be decoded smaller,
+    // when they are rendered below their resolution (two bits).
+    HIPS_REDUCE_1               = 1 << 4,
+    HIPS_REDUCE_MASK            = 3 << 4,
+};
+
+/*
+ * Enum: HIPS_CACHE
+ * The tiles caches.
+ *
+ * Each kind of survey puts its tiles in a separate cache with its own size
+ * budget, so that for example the stars tiles cannot evict the images
+ * tiles.
+ */
+enum {
+    HIPS_CACHE_IMAGES = 0,
+    HIPS_CACHE_STARS,
+    HIPS_CACHE_DSOS,
+    HIPS_CACHE_COUNT
 };
 
 /*
@@ -40,6 +59,8 @@ enum {
  *                 load a tile that is not in the cache.  See note [1]
  *   delete_tile - function used to delete the data returned by create_tile.
  *   user        - pointer passed to create_tile.
+ *   cache       - the cache used for the tiles (default to
+ *                 HIPS_CACHE_IMAGES).
  *
  * Note 1:
  *   The create_tile function needs to return a cost value (in bytes) for the
@@ -51,6 +72,7 @@ typedef struct hips_settings {
                                int size, int *cost, int *transparency);
     int (*delete_tile)(void *tile);
     void *user;
+    int cache;
 } hips_settings_t;
 
 /*
@@ -86,6 +108,159 @@ hips_t *hips_create(const char *url, double release_date,
 const void *hips_get_tile(hips_t *hips, int order, int pix, int flags,
                           int *code);
 
+/*
+ * Function: hips_set_tile_priority
+ * Set the loading priority of a tile that is still loading.
+ *
+ * Tiles with a higher priority are downloaded and decoded first.  Does
+ * nothing if the tile is not loading.
+ *
+ * Parameters:
+ *   hips     - a hips survey.
+ *   order    - order of the tile.
+ *   pix      - pix of the tile.
+ *   priority - the new priority.  See <painter_get_healpix_priority>.
+ */
+void hips_set_tile_priority(hips_t *hips, int order, int pix,
+                            double priority);
+
+/*
+ * Function: hips_update_loaders
+ * Cancel the queued tiles decoding that have not been requested since the
+ * previous call, and the tiles downloads that have not been requested for
+ * a few calls.
+ *
+ * This should be called once per frame, so that the tiles that went out of
+ * the screen before their loading started don't delay the visible ones.
+ * The tiles are put back in the queue as soon as they get requested again.
+ *
+ * Return:
+ *   The number of tiles decoding or downloads requested recently, that
+ *   are still pending.
+ */
+int hips_update_loaders(void);
+
+/*
+ * Function: hips_set_tile_hook
+ * Set a global function called each time a tile gets loaded.
+ *
+ * This is mostly useful for benchmarks.  The function gets the hips url,
+ * the tile position, and the delay in seconds between the first request
+ * of the tile and the moment its data got ready.  Set fn to NULL to remove
+ * the hook.
+ */
+void hips_set_tile_hook(void *user,
+        void (*fn)(void *user, const char *url, int order, int pix,
+                   double delay));
+
+/*
+ * Enum: HIPS_TILE_STATE
+ * The loading state of a tile, as reported by <hips_get_visited_tiles>.
+ *
+ *   HIPS_TILE_WAITING      - Not requested yet, usually because the parent
+ *                            tile is not loaded.
+ *   HIPS_TILE_DOWNLOADING  - The tile data is being downloaded.
+ *   HIPS_TILE_QUEUED       - Waiting for a thread to parse the data.
+ *   HIPS_TILE_DECODING     - The data is being parsed in a thread.
+ *   HIPS_TILE_LOADED       - The tile is ready.
+ *   HIPS_TILE_ERROR        - The tile could not be downloaded or parsed.
+ */
+enum {
+    HIPS_TILE_WAITING = 0,
+    HIPS_TILE_DOWNLOADING,
+    HIPS_TILE_QUEUED,
+    HIPS_TILE_DECODING,
+    HIPS_TILE_LOADED,
+    HIPS_TILE_ERROR,
+};
+
+/*
+ * Type: hips_tile_info_t
+ * Debug information about a visited tile.
+ *
+ * Attributes:
+ *   order - Healpix order of the tile.
+ *   pix   - Healpix pix of the tile.
+ *   frame - Frame of the survey.
+ *   state - One of the <HIPS_TILE_STATE> values.
+ *   time  - Unix time at which the tile got into its current state, or
+ *           zero if unknown.
+ *   hits  - Number of times the tile was found in the cache.
+ */
+typedef struct hips_tile_info {
+    int     order;
+    int     pix;
+    int     frame;
+    int     state;
+    double  time;
+    int     hits;
+} hips_tile_info_t;
+
+/*
+ * Function: hips_record_visited_tiles
+ * Start to record the tiles requested with <hips_get_tile>.
+ *
+ * This is only meant for debugging.
+ *
+ * Parameters:
+ *   filter - Only the tiles of the surveys whose url contains this string
+ *            get recorded.  Set to NULL to stop the recording.
+ */
+void hips_record_visited_tiles(const char *filter);
+
+/*
+ * Function: hips_get_visited_tiles
+ * Get the tiles recorded since the last call, and reset the list.
+ *
+ * A tile requested several times appears several times in the list.
+ *
+ * Parameters:
+ *   nb - Get the number of tiles.
+ *
+ * Return:
+ *   The tiles, valid until the next call to <hips_get_tile>.
+ */
+const hips_tile_info_t *hips_get_visited_tiles(int *nb);
+
+/*
+ * Function: hips_set_cache_size
+ * Set the maximum size of one of the tiles caches.
+ *
+ * The tiles costs are in bytes, and include the memory used by the GPU
+ * textures.  If the cache is already bigger than the new size, the least
+ * recently used tiles get deleted immediately.
+ *
+ * Parameters:
+ *   cache  - one of the <HIPS_CACHE> values.
+ *   size   - the new size in bytes.
+ */
+void hips_set_cache_size(int cache, int size);
+
+/*
+ * Function: hips_get_cache_size
+ * Get the maximum size of one of the tiles caches.
+ *
+ * Parameters:
+ *   cache  - one of the <HIPS_CACHE> values.
+ *   used   - if not NULL, get the current size of the cache.
+ *
+ * Return:
+ *   The maximum size of the cache in bytes.
+ */
+int hips_get_cache_size(int cache, int *used);
+
+/*
+ * Function: hips_get_memory_stats
+ * Get the usage statistics of the tiles caches, as a json object.
+ *
+ * The object has two attributes:
+ *   caches  - The stats of each tiles cache (see <cache_stats_t>), indexed
+ *             by name: 'images', 'stars' and 'dsos'.
+ *   surveys - The number of tiles in the caches and their cost in bytes
+ *             for each survey, indexed by url.
+ */
+json_value *hips_get_memory_stats(void);
+
 /*
  * Function: hips_is_ready
  * Check if a hips survey is ready to use
@@ -128,6 +303,10 @@ int hips_traverse(void *user, int callback(int order, int pix, void *user));
  *   - If all else failed, return NULL.  In that case the UV and projection
  *     are still set, so that the client can still render a fallback texture.
  *
+ * The tiles textures are packed into shared atlases, and the allsky
+ * pixels all use the same texture, so the uv transformation must always
+ * be applied, even when the tile itself is loaded.
+ *
  * Parameters:
  *   order   - Order of the tile we are looking for.
  *   pix     - Pixel index of the tile we are looking for.
@@ -207,6 +386,31 @@ int hips_get_render_order(const hips_t *hips, const painter_t *painter,
 int hips_render(hips_t *hips, const painter_t *painter, double angle,
                 int split_order);
 
+// Max number of surveys accepted by hips_render_multi.
+#define HIPS_MULTI_MAX 4
+
+/*
+ * Function: hips_render_multi
+ * Render several surveys blended together in a single pass.
+ *
+ * The healpix tree is only traversed once, using the survey with the
+ * highest render order, and for each visible tile we paint all the surveys
+ * in order with the same clipping and grid geometry.  The surveys with a
+ * lower render order use the texture of their parent tile.
+ *
+ * If the surveys are not all in the same frame, this falls back to
+ * calling <hips_render> for each of them.
+ *
+ * Parameters:
+ *   nb          - Number of surveys (max HIPS_MULTI_MAX).
+ *   surveys     - The surveys, from bottom to top.
+ *   painters    - The painter used for each survey.
+ *   angle       - Visible angle the surveys have in the sky.
+ *   split_order - The requested order of the final quad divisions.
+ */
+int hips_render_multi(int nb, hips_t **surveys, const painter_t *painters,
+                      double angle, int split_order);
+
 /*
  * Function: hips_render_traverse
  * Similar to hips_render, but instead of actually rendering the tiles
@@ -42,7 +42,9 @@ Module.afterInit(function() {
     // TODO: manage paning and flicking here
 
     Module._core_update(dt / 1000);
-    Module._core_render(canvas.width, canvas.height, 1);
+    // In render on demand mode, only render when something changed.
+    if (sizeChanged || !Module.renderOnDemand || Module._core_needs_render())
+      Module._core_render(canvas.width, canvas.height, 1);
 
     window.requestAnimationFrame(render)
   }
@@ -0,0 +1,66 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * Optional loader that picks the best engine build supported by the
+ * browser: the multi-threaded SIMD build (make js-mt) if possible, else
+ * the default single threaded build (make js).
+ *
+ * The multi-threaded build needs SharedArrayBuffer, which is only
+ * available when the page is served with cross origin isolation headers:
+ *
+ *   Cross-Origin-Opener-Policy: same-origin
+ *   Cross-Origin-Embedder-Policy: require-corp
+ *
+ * Usage:
+ *
+ *   StelWebEngineLoad('static/js/', {
+ *     canvas: document.getElementById('stel-canvas'),
+ *     onReady: function(stel) { ... }
+ *   });
+ */
+
+(function() {
+
+  // Smallest wasm module using a SIMD instruction.
+  var SIMD_TEST = new Uint8Array([
+    0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10,
+    1, 8, 0, 65, 0, 253, 15, 253, 98, 11]);
+
+  // Check if we can run the multi-threaded SIMD build.
+  var supportsMT = function() {
+    if (typeof WebAssembly !== 'object') return false;
+    if (typeof SharedArrayBuffer === 'undefined') return false;
+    if (typeof crossOriginIsolated !== 'undefined' && !crossOriginIsolated)
+      return false;
+    try {
+      return WebAssembly.validate(SIMD_TEST);
+    } catch (e) {
+      return false;
+    }
+  };
+
+  // Load the best engine variant from a directory, and create the engine
+  // with the given arguments.  Return a promise.
+  window.StelWebEngineLoad = function(dir, args) {
+    var name = supportsMT() ? 'stellarium-web-engine-mt' :
+                              'stellarium-web-engine';
+    args = args || {};
+    args.wasmFile = args.wasmFile || (dir + name + '.wasm');
+    return new Promise(function(resolve, reject) {
+      var script = document.createElement('script');
+      script.src = dir + name + '.js';
+      script.onload = function() { resolve(StelWebEngine(args)); };
+      script.onerror = reject;
+      document.head.appendChild(script);
+    });
+  };
+
+  window.StelWebEngineSupportsMT = supportsMT;
+})();
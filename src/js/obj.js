@@ -18,6 +18,8 @@ Module.afterInit(function() {
   var module_remove = Module.cwrap('module_remove', null, ['number', 'number']);
   var module_get_tree = Module.cwrap('module_get_tree', 'number',
     ['number', 'number']);
+  var module_get_tree_changes = Module.cwrap('module_get_tree_changes',
+    'number', ['number', 'number', 'number']);
   var module_get_path = Module.cwrap('module_get_path', 'number',
     ['number', 'number']);
   var obj_create_str = Module.cwrap('obj_create_str', 'number',
@@ -27,6 +29,14 @@ Module.afterInit(function() {
   var core_get_module = Module.cwrap('core_get_module', 'number', ['string']);
   var obj_get_info_json = Module.cwrap('obj_get_info_json', 'number',
     ['number', 'number', 'string']);
+  var obj_get_attr_ = Module.cwrap('obj_get_attr_', 'number',
+    ['number', 'string']);
+  var module_query_records = Module.cwrap('module_query_records', 'number',
+    ['number', 'number', 'number', 'number', 'number', 'number', 'string',
+     'number', 'number', 'number', 'number']);
+
+  // Cache of the attribute handles, indexed by klass pointer and name.
+  var g_attr_handles = {};
 
   // List of {obj, attr, callback}
   var g_listeners = [];
@@ -192,6 +202,144 @@ Module.afterInit(function() {
     return ret;
   };
 
+  /*
+   * Class: ObjRecords
+   * Wasm heap buffers to bulk query objects (see obj_record_t in obj.h).
+   *
+   * The records are read directly from the heap, without any json.  The
+   * buffers are kept between calls, call free when not needed anymore.
+   *
+   * Arguments:
+   *   maxNb      - Max number of records.
+   *   namesSize  - Size of the names buffer in bytes (default 32 * maxNb).
+   */
+  var RECORD_SIZE = 56;
+  var ObjRecords = function(maxNb, namesSize) {
+    this.maxNb = maxNb;
+    this.namesSize = namesSize || 32 * maxNb;
+    this.records = Module._malloc(maxNb * RECORD_SIZE);
+    this.names = Module._malloc(this.namesSize);
+    this.length = 0;
+  };
+
+  // List the objects of a module.  Return the number of records.
+  ObjRecords.prototype.list = function(module, obs, maxMag) {
+    obs = obs || Module.observer;
+    this.length = Module._module_list_records(module.v, obs.v, maxMag,
+        this.maxNb, this.records, this.names, this.namesSize);
+    return this.length;
+  };
+
+  // Fill the records of a list of SweObj.
+  ObjRecords.prototype.query = function(objs, obs) {
+    obs = obs || Module.observer;
+    var nb = Math.min(objs.length, this.maxNb);
+    var ptrs = Module._malloc(nb * 4);
+    for (var i = 0; i < nb; i++) Module.HEAPU32[(ptrs >> 2) + i] = objs[i].v;
+    Module._obj_get_records(nb, ptrs, obs.v, this.records, this.names,
+                            this.namesSize);
+    Module._free(ptrs);
+    this.length = nb;
+    return nb;
+  };
+
+  // List the objects of a module inside a cone.  Only the HiPS tiles
+  // intersecting the cone are visited.
+  //
+  // Arguments:
+  //   module   - A module (core for all objects).
+  //   ra, dec  - ICRF direction of the cone center (rad).
+  //   radius   - Radius of the cone (rad).
+  //   maxMag   - Max magnitude.
+  //   type     - Optional otype filter (e.g. '*' for all the stars).
+  //   obs      - Optional observer.
+  ObjRecords.prototype.cone = function(module, ra, dec, radius, maxMag,
+                                       type, obs) {
+    obs = obs || Module.observer;
+    this.length = module_query_records(module.v, obs.v, ra, dec, radius,
+        maxMag, type || '', this.maxNb, this.records, this.names,
+        this.namesSize);
+    return this.length;
+  };
+
+  // Return a plain object for a record.
+  ObjRecords.prototype.get = function(i) {
+    var p = this.records + i * RECORD_SIZE;
+    var f = Module.HEAPF64, u = Module.HEAPU32;
+    var nameOfs = Module.HEAP32[(p + 12) >> 2];
+    var hex = function(v) { return ('0000000' + v.toString(16)).slice(-8); };
+    return {
+      oid: hex(u[(p + 4) >> 2]) + hex(u[p >> 2]),
+      type: Module.UTF8ToString(p + 8, 4),
+      name: nameOfs >= 0 ? Module.UTF8ToString(this.names + nameOfs) : null,
+      ra: f[(p + 16) >> 3],
+      dec: f[(p + 24) >> 3],
+      az: f[(p + 32) >> 3],
+      alt: f[(p + 40) >> 3],
+      vmag: f[(p + 48) >> 3],
+    };
+  };
+
+  ObjRecords.prototype.free = function() {
+    Module._free(this.records);
+    Module._free(this.names);
+  };
+
+  Module['ObjRecords'] = ObjRecords;
+
+  /*
+   * Function: getEphemeris
+   * Compute an ephemeris table for a list of objects.
+   *
+   * Arguments:
+   *   objs     - Array of SweObj.
+   *   args     - Object with the attributes:
+   *     obs      - Optional observer.
+   *     start    - Start TT MJD.
+   *     end      - End TT MJD.
+   *     step     - Time step in days (default to one minute).
+   *     fields   - Array of fields in 'ra', 'dec', 'az', 'alt', 'vmag',
+   *                'distance' (default to all).
+   *
+   * Return:
+   *   An object {fields, times, values}, with values a Float64Array ordered
+   *   by time, then object, then field.
+   */
+  var EPH_FIELDS = ['ra', 'dec', 'az', 'alt', 'vmag', 'distance'];
+  Module['getEphemeris'] = function(objs, args) {
+    var obs = args.obs || Module.observer;
+    var step = args.step || 1 / 24 / 60;
+    var fields = args.fields || EPH_FIELDS;
+    var flags = 0, nbFields = 0, i;
+    for (i = 0; i < EPH_FIELDS.length; i++) {
+      if (fields.indexOf(EPH_FIELDS[i]) === -1) continue;
+      flags |= 1 << i;
+      nbFields++;
+    }
+    var nbSteps = Module._obj_get_ephemeris(objs.length, 0, obs.v,
+        args.start, args.end, step, flags, 0);
+    var ptrs = Module._malloc(objs.length * 4);
+    for (i = 0; i < objs.length; i++)
+      Module.HEAPU32[(ptrs >> 2) + i] = objs[i].v;
+    var size = nbSteps * objs.length * nbFields;
+    var out = Module._malloc(size * 8);
+    Module._obj_get_ephemeris(objs.length, ptrs, obs.v, args.start,
+                              args.end, step, flags, out);
+    var values = new Float64Array(Module.HEAPF64.subarray(
+        out >> 3, (out >> 3) + size));
+    Module._free(out);
+    Module._free(ptrs);
+    var times = new Float64Array(nbSteps);
+    for (i = 0; i < nbSteps; i++) times[i] = args.start + i * step;
+    return {
+      fields: EPH_FIELDS.filter(function(f) {
+        return fields.indexOf(f) !== -1;
+      }),
+      times: times,
+      values: values,
+    };
+  };
+
   // XXX: deprecated.
   SweObj.prototype.getTree = function(detailed) {
     detailed = (detailed !== undefined) ? detailed : false
@@ -202,6 +350,26 @@ Module.afterInit(function() {
     return ret
   };
 
+  /*
+   * Function: getTreeChanges
+   * Return the objects of the tree that changed since a given version.
+   *
+   * Arguments:
+   *   since    - Version returned by a previous call, or 0 to get the
+   *              whole tree.
+   *   detailed - Whether to add hints to the values or not.
+   *
+   * Return:
+   *   An object of the form {version: <int>, changes: {<path>: {attrs: {},
+   *   children: []}}}, with the paths relative to this object.
+   */
+  SweObj.prototype.getTreeChanges = function(since, detailed) {
+    var cret = module_get_tree_changes(this.v, detailed ? 1 : 0, since || 0)
+    var ret = JSON.parse(Module.UTF8ToString(cret))
+    Module._free(cret)
+    return ret
+  };
+
   /*
    * Function: computeVisibility
    *
@@ -278,6 +446,47 @@ Module.afterInit(function() {
     return ret.v;
   }
 
+  // Return a malloced array of attribute handles for a list of names.
+  SweObj.prototype._getAttrHandles = function(names) {
+    // The klass pointer is the first member of the object.
+    var klass = Module.HEAPU32[this.v >> 2];
+    var ptr = Module._malloc(names.length * 4);
+    for (var i = 0; i < names.length; i++) {
+      var key = klass + ':' + names[i];
+      if (!(key in g_attr_handles))
+        g_attr_handles[key] = obj_get_attr_(this.v, names[i]);
+      assert(g_attr_handles[key], 'No attribute ' + names[i]);
+      Module.HEAPU32[(ptr >> 2) + i] = g_attr_handles[key];
+    }
+    return ptr;
+  }
+
+  // Read several numerical attributes at once, without json conversion.
+  // Vector attributes are returned flattened in the result array.
+  //
+  // Inputs:
+  //  names     List of attribute names.
+  SweObj.prototype.getAttrs = function(names) {
+    var attrs = this._getAttrHandles(names);
+    var out = Module._malloc(names.length * 4 * 8);
+    var nb = Module._obj_get_attrs_values(this.v, names.length, attrs, out);
+    var ret = Array.from(Module.HEAPF64.subarray(out >> 3, (out >> 3) + nb));
+    Module._free(out);
+    Module._free(attrs);
+    return ret;
+  }
+
+  // Set several numerical attributes at once, without json conversion.
+  // Use the same values layout as getAttrs.
+  SweObj.prototype.setAttrs = function(names, values) {
+    var attrs = this._getAttrHandles(names);
+    var ptr = Module._malloc(values.length * 8);
+    Module.HEAPF64.set(values, ptr >> 3);
+    Module._obj_set_attrs_values(this.v, names.length, attrs, ptr);
+    Module._free(ptr);
+    Module._free(attrs);
+  }
+
   Module['getModule'] = function(name) {
     var obj = core_get_module(name);
     return obj ? new SweObj(obj) : null;
@@ -320,18 +529,28 @@ Module.afterInit(function() {
     return ret ? new SweObj(ret) : null;
   }
 
-  var onObjChanged = Module.addFunction(function(objPtr, attr) {
-    attr = Module.UTF8ToString(attr);
-    for (var i = 0; i < g_listeners.length; i++) {
-      var listener = g_listeners[i];
-      if (    (listener.obj === null || listener.obj === objPtr) &&
-        (listener.attr === null || listener.attr === attr)) {
-        var obj = new SweObj(objPtr);
-        listener.callback.apply(listener.ctx, [obj, attr]);
+  // Called once per frame with all the changes as a json list of
+  // [objPtr, attr, value].  The value is passed as a third argument to
+  // the listeners so that they don't have to read it back.
+  var onChanges = Module.addFunction(function(changes) {
+    changes = JSON.parse(Module.UTF8ToString(changes));
+    var objs = {};
+    for (var i = 0; i < changes.length; i++) {
+      var objPtr = changes[i][0];
+      var attr = changes[i][1];
+      var value = changes[i][2];
+      if (value && value.swe_) value = value.v;
+      for (var j = 0; j < g_listeners.length; j++) {
+        var listener = g_listeners[j];
+        if (    (listener.obj === null || listener.obj === objPtr) &&
+          (listener.attr === null || listener.attr === attr)) {
+          if (!(objPtr in objs)) objs[objPtr] = new SweObj(objPtr);
+          listener.callback.apply(listener.ctx, [objs[objPtr], attr, value]);
+        }
       }
     }
-  }, 'vii');
-  Module._module_add_global_listener(onObjChanged);
+  }, 'vi');
+  Module._module_add_global_changes_listener(onChanges);
 
 
   // Add some convenience functions to access swe values directly as a
@@ -364,11 +583,8 @@ Module.afterInit(function() {
   }
 
   Module['onValueChanged'] = function(callback) {
-    Module.change(function(obj, attr) {
+    Module.change(function(obj, attr, value) {
       var path = obj.path + "." + attr;
-      var value = obj[attr];
-      if (value && typeof(value) === 'object' && value.swe_)
-        value = value.v;
       path = path.substr(5); // Remove the initial 'core.'
       callback(path, value);
     });
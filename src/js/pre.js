@@ -8,8 +8,13 @@
  */
 
 // Allow to set the memory file path in 'memFile' argument.
+// For the multi-threaded build (see loader.js), the workers script is
+// looked for in the same directory as the wasm file.
 Module['locateFile'] = function(path) {
-  if (path === "stellarium-web-engine.wasm") return Module.wasmFile;
+  if (path === "stellarium-web-engine.wasm" ||
+      path === "stellarium-web-engine-mt.wasm") return Module.wasmFile;
+  if (path === "stellarium-web-engine-mt.worker.js" && Module.wasmFile)
+    return Module.wasmFile.replace(/[^\/]*$/, '') + path;
   return path;
 }
 
@@ -46,6 +51,13 @@ Module['onRuntimeInitialized'] = function() {
   // Call all the functions registered with Module.afterInit(f)
   for (var i in Module.extendFns) { Module.extendFns[i]() }
 
+  // The bundled assets packs (see assets_set_packs_url) are looked for in
+  // the 'packsUrl' argument, or next to the wasm file.
+  if (Module.packsUrl || Module.wasmFile) {
+    Module.cwrap('assets_set_packs_url', null, ['string'])(
+      Module.packsUrl || Module.wasmFile.replace(/[^\/]*$/, '') + 'packs');
+  }
+
   Module._core_init(0, 0, 1);
   Module.core = Module.getModule('core');
   Module.observer = Module.getModule('observer');
@@ -242,11 +254,12 @@ Module['calendar'] = function(args) {
   // long as it doesn't return 0.
   if (args.iterator) {
     var cal = Module._calendar_create(this.observer.v, start, end, 1);
+    var callback = getCallback();
     return function() {
       var ret = Module._calendar_compute(cal);
+      // Stream the events as they are found.
+      Module._calendar_get_results(cal, 0, callback);
       if (!ret) {
-        var callback = getCallback();
-        Module._calendar_get_results(cal, 0, callback);
         Module.removeFunction(callback);
         Module._calendar_delete(cal);
       }
@@ -259,6 +272,124 @@ Module['calendar'] = function(args) {
   Module.removeFunction(callback);
 }
 
+/*
+ * Function: computeEvents
+ * Compute the daily rise, set and transit times of several objects.
+ *
+ * Parameters:
+ *   settings - Plain object with attributes:
+ *     objs      - array of objects.
+ *     obs       - an observer.  If not set use current core observer.
+ *     startTime - TT MJD start time.  If not set use the observer time.
+ *     days      - number of days (default to 1).
+ *     precision - precision of the times in day (default to 30 seconds).
+ *
+ * Return:
+ *   For each object, an array of plain objects, one per day, of the form:
+ *   {rise: <riseTime>, set: <setTime>, transit: <transitTime>}, with the
+ *   times in TT MJD, or null if the event doesn't happen that day.
+ */
+Module['computeEvents'] = function(args) {
+  var obs = args.obs || Module.core.observer;
+  var startTime = args.startTime || obs.tt;
+  var days = args.days || 1;
+  var precision = args.precision || 1 / 24 / 60 / 2;
+  var nb = args.objs.length;
+  var objs = Module._malloc(nb * 4);
+  var out = Module._malloc(nb * days * 3 * 8);
+  for (var i = 0; i < nb; i++)
+    Module._setValue(objs + i * 4, args.objs[i].v, 'i32');
+  Module._compute_events_batch(obs.v, nb, objs, startTime, days,
+                               precision, out);
+  var getTime = function(i) {
+    var v = Module._getValue(out + i * 8, 'double');
+    return isNaN(v) ? null : v;
+  };
+  var ret = [];
+  for (var i = 0; i < nb; i++) {
+    var objRet = [];
+    for (var d = 0; d < days; d++) {
+      var j = (i * days + d) * 3;
+      objRet.push({rise: getTime(j), set: getTime(j + 1),
+                   transit: getTime(j + 2)});
+    }
+    ret.push(objRet);
+  }
+  Module._free(objs);
+  Module._free(out);
+  return ret;
+}
+
+/*
+ * Function: searchOccultations
+ * Find the stars and planets occulted by the Moon, or passing close to it.
+ *
+ * Parameters:
+ *   settings - Plain object with attributes:
+ *     obs       - an observer.  If not set use current core observer.
+ *     startTime - TT MJD start time.  If not set use the observer time.
+ *     days      - number of days (default to 30).
+ *     maxVmag   - only consider the objects brighter than this (default
+ *                 to 6).
+ *     maxSep    - max separation from the Moon limb in radian (default
+ *                 to 0, only the occultations).
+ *
+ * Return:
+ *   An array of plain objects sorted by time, of the form:
+ *   {time: <minSepTime>, start: <startTime>, end: <endTime>, sep: <sep>,
+ *    obj: <obj>}, with the times in TT MJD, and start and end set to null
+ *   if the object is not occulted.  The returned objects should be released
+ *   with obj.destroy().
+ */
+Module['searchOccultations'] = function(args) {
+  var obs = args.obs || Module.core.observer;
+  var startTime = args.startTime || obs.tt;
+  var days = args.days || 30;
+  var maxVmag = (args.maxVmag !== undefined) ? args.maxVmag : 6;
+  var maxSep = args.maxSep || 0;
+  var ret = [];
+  var callback = Module.addFunction(
+    function(time, start, end, sep, obj, user) {
+      Module._obj_retain(obj);
+      ret.push({
+        time: time,
+        start: isNaN(start) ? null : start,
+        end: isNaN(end) ? null : end,
+        sep: sep,
+        obj: new Module.SweObj(obj)
+      });
+      return 0;
+    }, 'iddddii');
+  Module._occultations_search(obs.v, startTime, startTime + days, maxVmag,
+                              maxSep, 0, callback);
+  Module.removeFunction(callback);
+  return ret;
+}
+
+/*
+ * Function: traceStart
+ * Start recording the tiles pipeline trace events.
+ */
+Module['traceStart'] = function() {
+  Module._trace_start();
+}
+
+/*
+ * Function: traceStop
+ * Stop recording the trace events and return them.
+ *
+ * Return:
+ *   The events in the Chrome trace event format, that can be saved as a
+ *   json file and loaded in chrome://tracing or Perfetto.
+ */
+Module['traceStop'] = function() {
+  Module._trace_stop();
+  var cret = Module._trace_export();
+  var ret = JSON.parse(Module.UTF8ToString(cret));
+  Module._free(cret);
+  return ret;
+}
+
 Module['c2s'] = function(v) {
   var x = v[0];
   var y = v[1];
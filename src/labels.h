@@ -17,6 +17,19 @@ enum {
 
 void labels_reset(void);
 
+/*
+ * Function: labels_set_view
+ * Set the view the labels are added to and rendered in.
+ *
+ * When we render several views in the same frame, each view only lays
+ * out and renders the labels that were added while rendering it.
+ *
+ * Parameters:
+ *   view     - Index of the view, up to 31.
+ *   nb_views - Number of views rendered in the frame.
+ */
+void labels_set_view(int view, int nb_views);
+
 /*
  * Function: labels_add
  * Render a label on screen.
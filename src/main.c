@@ -15,6 +15,9 @@
 #   include <fenv.h>
 #endif
 
+// Before glfw, for the GL extensions prototypes.
+#include "utils/gl.h"
+
 #ifdef GLES2
 #   define GLFW_INCLUDE_ES2
 #endif
@@ -28,12 +31,33 @@
 
 static GLFWwindow   *g_window = NULL;
 
+// Max time step given to core_update, so that we don't jump forward after
+// the loop slept or got stuck (sec).
+#define MAX_DT 0.25
+// Max time we sleep when nothing changes (sec).
+#define IDLE_TIMEOUT 1.0
+// Min frame time while some requests are running (sec).
+#define FRAME_TIME (1.0 / 60)
+// Number of frames rendered by the replay mode.
+#define REPLAY_NB_FRAMES 600
+
+// Number of workers finished so far, incremented from the pool threads.
+static int g_nb_workers_done = 0;
+
 typedef struct
 {
     bool run_tests;
     char *tests_filter;
+    bool run_benchs;
+    char *benchs_filter;
     bool calendar;
     bool gen_doc;
+    char *bench;
+    char *render;
+    char *replay;
+    char *record;
+    char *playback;
+    char *data;
     char *args[3];
 } args_t;
 
@@ -45,14 +69,36 @@ static char doc[] = "A virtual planetarium";
 static char args_doc[] = "";
 #define OPT_RUN_TESTS 1
 #define OPT_GEN_DOC 2
+#define OPT_BENCH 3
+#define OPT_RUN_BENCHS 4
+#define OPT_RENDER 5
+#define OPT_REPLAY 6
+#define OPT_RECORD 7
+#define OPT_PLAYBACK 8
+#define OPT_DATA 9
 static struct argp_option options[] = {
 
 #if COMPILE_TESTS
     {"run-tests", OPT_RUN_TESTS, "filter", OPTION_ARG_OPTIONAL,
                                                     "Run the unit tests" },
+#endif
+#if COMPILE_BENCHS
+    {"run-benchs", OPT_RUN_BENCHS, "filter", OPTION_ARG_OPTIONAL,
+                                                    "Run the benchmarks" },
 #endif
     {"calendar", 'c', NULL, 0, "print events calendar"},
     {"gen-doc", OPT_GEN_DOC, NULL, 0, "print doc for the defined classes"},
+    {"bench", OPT_BENCH, "script", 0,
+                            "run a rendering benchmark script (json)"},
+    {"render", OPT_RENDER, "script", 0,
+                            "render a batch of views to png files (json)"},
+    {"replay", OPT_REPLAY, "file", 0,
+                            "replay and time a captured frame"},
+    {"record", OPT_RECORD, "file", 0, "record the session inputs"},
+    {"playback", OPT_PLAYBACK, "file", 0,
+                            "play and time a recorded session"},
+    {"data", OPT_DATA, "dir", 0,
+                            "local data directory used by the playback"},
     { 0 }
 };
 
@@ -66,9 +112,31 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
         args->run_tests = true;
         args->tests_filter = arg;
         break;
+    case OPT_RUN_BENCHS:
+        args->run_benchs = true;
+        args->benchs_filter = arg;
+        break;
     case OPT_GEN_DOC:
         args->gen_doc = true;
         break;
+    case OPT_BENCH:
+        args->bench = arg;
+        break;
+    case OPT_RENDER:
+        args->render = arg;
+        break;
+    case OPT_REPLAY:
+        args->replay = arg;
+        break;
+    case OPT_RECORD:
+        args->record = arg;
+        break;
+    case OPT_PLAYBACK:
+        args->playback = arg;
+        break;
+    case OPT_DATA:
+        args->data = arg;
+        break;
     case 'c':
         args->calendar = true;
         break;
@@ -90,6 +158,11 @@ static struct argp argp = { options, parse_opt, args_doc, doc };
 
 static void run_main_loop(void (*func)(void));
 static void loop_function(void);
+static void on_worker_finished(void);
+static int run_bench(const char *path);
+static int run_render(const char *path);
+static int run_replay(const char *path);
+static int run_playback(const char *path, const char *data_dir);
 
 static void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
 {
@@ -156,6 +229,16 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    if (args.run_benchs) {
+        benchs_run(args.benchs_filter);
+        return 0;
+    }
+
+    if (args.bench) return run_bench(args.bench);
+    if (args.render) return run_render(args.render);
+    if (args.replay) return run_replay(args.replay);
+    if (args.playback) return run_playback(args.playback, args.data);
+
     glfwInit();
     glfwWindowHint(GLFW_SAMPLES, 2);
     g_window = glfwCreateWindow(w, h, title, NULL, NULL);
@@ -173,6 +256,7 @@ int main(int argc, char **argv)
 
     core_init(fb_size[0], fb_size[1], 1.0);
     core_add_default_sources();
+    worker_set_on_finished(on_worker_finished);
 
     if (DEFINED(COMPILE_TESTS)) {
         tests_run("auto"); // Run all the automatic tests.
@@ -180,22 +264,54 @@ int main(int argc, char **argv)
         core_init(fb_size[0], fb_size[1], 1.0);
     }
 
+    if (args.record) recorder_start(args.record);
     run_main_loop(loop_function);
+    recorder_stop();
     core_release();
 
     return 0;
 }
 
+// Called from the pool threads: wake up the main loop.
+static void on_worker_finished(void)
+{
+    __atomic_add_fetch(&g_nb_workers_done, 1, __ATOMIC_RELAXED);
+    glfwPostEmptyEvent();
+}
+
+/*
+ * The loop only renders when the core reports some changes, or when some
+ * workers finished since they might have new data to show.  Otherwise it
+ * sleeps until we get some inputs, some workers results, or some network
+ * data.
+ */
 static void loop_function(void)
 {
-    int fb_size[2];
-    double dt = 1.0 / 60.0; // Assume fixed 60fps.
+    int fb_size[2], nb_workers_done;
+    static int last_nb_workers_done = 0;
+    static double last_time = 0;
+    double t, dt;
+
+    t = glfwGetTime();
+    dt = last_time ? min(t - last_time, MAX_DT) : FRAME_TIME;
+    last_time = t;
     glfwGetFramebufferSize(g_window, &fb_size[0], &fb_size[1]);
 
     core_update(dt);
-    core_render(fb_size[0], fb_size[1], 1.0);
-    glfwSwapBuffers(g_window);
-    glfwPollEvents();
+    nb_workers_done = __atomic_load_n(&g_nb_workers_done, __ATOMIC_RELAXED);
+    if (core_needs_render() || nb_workers_done != last_nb_workers_done) {
+        last_nb_workers_done = nb_workers_done;
+        core_render(fb_size[0], fb_size[1], 1.0);
+        glfwSwapBuffers(g_window);
+        // While some requests are running the core always needs a render,
+        // so we wait for the network data until the end of the frame
+        // rather than spinning.
+        if (request_get_nb_running(NULL))
+            request_wait(FRAME_TIME - (glfwGetTime() - t));
+        glfwPollEvents();
+        return;
+    }
+    glfwWaitEventsTimeout(IDLE_TIMEOUT);
 }
 
 static void run_main_loop(void (*func)(void))
@@ -206,4 +322,640 @@ static void run_main_loop(void (*func)(void))
     glfwTerminate();
 }
 
+/*
+ * Benchmark mode.
+ *
+ * The script is a json file of the form:
+ *
+ *   {
+ *     "width": 800,
+ *     "height": 600,
+ *     "data": "<local data directory>",
+ *     "views": [
+ *       {"time": 58000.5, "az": 180, "alt": 20, "fov": 60, "frames": 60,
+ *        "wait": 600, "capture": "view-0.cap"},
+ *       ...
+ *     ]
+ *   }
+ *
+ * The time is an UTC MJD, the angles are in degree.  For each view we
+ * render the given number of frames, and then keep rendering until the
+ * core doesn't need to render anymore, up to 'wait' frames.  The
+ * simulation always advances by 1/60 sec per frame.  If 'capture' is set,
+ * one more frame is rendered at the end of the view, and saved into the
+ * given file for the replay mode.
+ *
+ * If set, all the http urls are loaded from the data directory instead,
+ * using the url path.  The results are printed to stdout as json, with
+ * the time spent in each module for each frame, and the tiles loading
+ * delays percentiles.
+ */
+
+typedef struct {
+    const char *data_dir;
+    double *tiles_delays;
+    int nb_tiles, tiles_allocated;
+} bench_t;
+
+static void *bench_asset_hook(void *user, const char *url, int *size,
+                              int *code)
+{
+    bench_t *bench = user;
+    const char *path;
+    char buf[1024];
+    void *data;
+
+    if (    !bench->data_dir ||
+            !(str_startswith(url, "http://") ||
+              str_startswith(url, "https://"))) {
+        *code = -1;
+        return NULL;
+    }
+    path = strchr(strstr(url, "://") + 3, '/') ?: "/";
+    snprintf(buf, sizeof(buf), "%s%.*s", bench->data_dir,
+             (int)strcspn(path, "?"), path);
+    data = read_file(buf, size);
+    *code = data ? 200 : 404;
+    return data;
+}
+
+static void bench_tile_hook(void *user, const char *url, int order, int pix,
+                            double delay)
+{
+    bench_t *bench = user;
+    if (bench->nb_tiles >= bench->tiles_allocated) {
+        bench->tiles_allocated = max(1024, bench->tiles_allocated * 2);
+        bench->tiles_delays = realloc(bench->tiles_delays,
+                bench->tiles_allocated * sizeof(*bench->tiles_delays));
+    }
+    bench->tiles_delays[bench->nb_tiles++] = delay;
+}
+
+static int double_cmp(const void *a, const void *b)
+{
+    return cmp(*(const double*)a, *(const double*)b);
+}
+
+static void bench_frame(int view, int frame, bool first)
+{
+    int i, k, fb_size[2];
+    double t;
+
+    glfwGetFramebufferSize(g_window, &fb_size[0], &fb_size[1]);
+    t = sys_get_unix_time();
+    core_update(1.0 / 60.0);
+    core_render(fb_size[0], fb_size[1], 1.0);
+    glFinish();
+    t = sys_get_unix_time() - t;
+
+    k = core->prof.frame % PROF_NB_FRAMES;
+    printf("%s\n    {\"view\": %d, \"frame\": %d, \"time\": %.6f, "
+           "\"flush\": %.6f, \"modules\": {",
+           first ? "" : ",", view, frame, t, core->prof.flush[k]);
+    for (i = 0; i < core->prof.nb_modules; i++) {
+        printf("%s\"%s\": [%.6f, %.6f, %.6f]", i ? ", " : "",
+               core->prof.modules[i].module->id,
+               core->prof.modules[i].frames[k].update,
+               core->prof.modules[i].frames[k].render,
+               core->prof.modules[i].frames[k].post_render);
+    }
+    printf("}}");
+    glfwSwapBuffers(g_window);
+    glfwPollEvents();
+}
+
+static int run_bench(const char *path)
+{
+    bench_t bench = {};
+    json_value *script, *views, *view;
+    char *txt;
+    const char *capture;
+    int i, j, size, w, h, nb_frames, max_wait, n, fb_size[2];
+    bool first = true;
+
+    txt = read_file(path, &size);
+    if (!txt) {
+        LOG_E("Cannot read bench script %s", path);
+        return -1;
+    }
+    script = json_parse(txt, size);
+    free(txt);
+    views = script ? json_get_attr(script, "views", json_array) : NULL;
+    if (!views) {
+        LOG_E("Invalid bench script %s", path);
+        json_value_free(script);
+        return -1;
+    }
+    w = json_get_attr_i(script, "width", 800);
+    h = json_get_attr_i(script, "height", 600);
+    bench.data_dir = json_get_attr_s(script, "data");
+
+    // Offscreen rendering.
+    glfwInit();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    g_window = glfwCreateWindow(w, h, "swe bench", NULL, NULL);
+    glfwMakeContextCurrent(g_window);
+    glfwSwapInterval(0);
+
+    asset_set_hook(&bench, bench_asset_hook);
+    hips_set_tile_hook(&bench, bench_tile_hook);
+    core_init(w, h, 1.0);
+    core_add_default_sources();
+    // Only wrap the renderer if we need it.
+    for (i = 0; i < views->u.array.length; i++) {
+        if (json_get_attr_s(views->u.array.values[i], "capture")) {
+            core->rend = render_capture_create(render_gl_create());
+            break;
+        }
+    }
+
+    printf("{\n  \"frames\": [");
+    for (i = 0; i < views->u.array.length; i++) {
+        view = views->u.array.values[i];
+        obj_set_attr(&core->observer->obj, "utc",
+                     json_get_attr_f(view, "time", core->observer->utc));
+        obj_set_attr(&core->observer->obj, "yaw",
+                     json_get_attr_f(view, "az", 0) * DD2R);
+        obj_set_attr(&core->observer->obj, "pitch",
+                     json_get_attr_f(view, "alt", 0) * DD2R);
+        obj_set_attr(&core->obj, "fov",
+                     json_get_attr_f(view, "fov", 60) * DD2R);
+        nb_frames = json_get_attr_i(view, "frames", 1);
+        max_wait = json_get_attr_i(view, "wait", 0);
+        for (j = 0; j < nb_frames || (j < nb_frames + max_wait &&
+                                      core_needs_render()); j++) {
+            bench_frame(i, j, first);
+            first = false;
+        }
+        capture = json_get_attr_s(view, "capture");
+        if (capture) {
+            render_capture_frame(core->rend, capture);
+            glfwGetFramebufferSize(g_window, &fb_size[0], &fb_size[1]);
+            core_update(1.0 / 60.0);
+            core_render(fb_size[0], fb_size[1], 1.0);
+            glfwSwapBuffers(g_window);
+            glfwPollEvents();
+        }
+    }
+    printf("\n  ],\n");
+
+    n = bench.nb_tiles;
+    qsort(bench.tiles_delays, n, sizeof(double), double_cmp);
+    #define PERCENTILE(p) (n ? bench.tiles_delays[(int)((n - 1) * p)] : 0)
+    printf("  \"tiles\": {\"count\": %d, \"p50\": %.6f, \"p90\": %.6f, "
+           "\"p99\": %.6f, \"max\": %.6f}\n}\n", n,
+           PERCENTILE(0.5), PERCENTILE(0.9), PERCENTILE(0.99),
+           PERCENTILE(1.0));
+    #undef PERCENTILE
+
+    hips_set_tile_hook(NULL, NULL);
+    free(bench.tiles_delays);
+    json_value_free(script);
+    core_release();
+    glfwTerminate();
+    return 0;
+}
+
+/*
+ * Asynchronous read back of the rendered frames.
+ *
+ * Each frame is copied into one pixel buffer object of a small ring, and
+ * we only map it when the ring is full, a few frames later, once the GPU
+ * is done with it.  This way glReadPixels doesn't wait for the frame to
+ * finish.  With GLES2 there is no pixel buffer object, so we fall back to
+ * a synchronous read.
+ */
+#if defined(GL_PIXEL_PACK_BUFFER) && !defined(GLES2)
+#   define READBACK_ASYNC 1
+#else
+#   define READBACK_ASYNC 0
+#endif
+
+#define READBACK_NB 3
+
+typedef struct {
+    GLuint  pbos[READBACK_NB];
+    int     sizes[READBACK_NB][2]; // Size of the frame in each buffer.
+    int     allocated[READBACK_NB]; // Size of each buffer.
+    int     ids[READBACK_NB];
+    int     first;  // Oldest frame in the ring.
+    int     nb;     // Number of frames in the ring.
+    uint8_t *img;
+    int     img_size;
+    void    *user;
+    void    (*on_frame)(void *user, int id, const uint8_t *img,
+                        int w, int h);
+} readback_t;
+
+// Flip the GL bottom up rows into the readback image, and pass it to the
+// callback.
+static void readback_output(readback_t *rb, int id, const uint8_t *data,
+                            int w, int h)
+{
+    int i;
+    if (rb->img_size < w * h * 4) {
+        rb->img_size = w * h * 4;
+        rb->img = realloc(rb->img, rb->img_size);
+    }
+    for (i = 0; i < h; i++)
+        memcpy(rb->img + i * w * 4, data + (h - 1 - i) * w * 4, w * 4);
+    rb->on_frame(rb->user, id, rb->img, w, h);
+}
+
+// Map the oldest frame of the ring and output it.
+static void readback_pop(readback_t *rb)
+{
+#if READBACK_ASYNC
+    int i = rb->first, w = rb->sizes[i][0], h = rb->sizes[i][1];
+    const uint8_t *data;
+
+    assert(rb->nb);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbos[i]);
+    data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, w * h * 4,
+                            GL_MAP_READ_BIT);
+    if (data) readback_output(rb, rb->ids[i], data, w, h);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    rb->first = (rb->first + 1) % READBACK_NB;
+    rb->nb--;
+#endif
+}
+
+// Queue the read of the current framebuffer.
+static void readback_push(readback_t *rb, int id, int w, int h)
+{
+#if READBACK_ASYNC
+    int i;
+    if (rb->nb == READBACK_NB) readback_pop(rb);
+    i = (rb->first + rb->nb) % READBACK_NB;
+    if (!rb->pbos[i]) glGenBuffers(1, &rb->pbos[i]);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbos[i]);
+    if (rb->allocated[i] < w * h * 4) {
+        rb->allocated[i] = w * h * 4;
+        glBufferData(GL_PIXEL_PACK_BUFFER, w * h * 4, NULL, GL_STREAM_READ);
+    }
+    glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    rb->sizes[i][0] = w;
+    rb->sizes[i][1] = h;
+    rb->ids[i] = id;
+    rb->nb++;
+#else
+    uint8_t *data = malloc(w * h * 4);
+    glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    readback_output(rb, id, data, w, h);
+    free(data);
+#endif
+}
+
+// Output all the frames still in the ring.
+static void readback_flush(readback_t *rb)
+{
+    while (rb->nb) readback_pop(rb);
+}
+
+static void readback_release(readback_t *rb)
+{
+#if READBACK_ASYNC
+    int i;
+    for (i = 0; i < READBACK_NB; i++) {
+        if (rb->pbos[i]) glDeleteBuffers(1, &rb->pbos[i]);
+    }
+#endif
+    free(rb->img);
+}
+
+// Output of the batch render frames, either as png files or raw RGBA
+// frames written to a command (typically a video encoder).
+typedef struct {
+    const char  *out;   // File name, or printf pattern with the frame id.
+    FILE        *pipe;
+} render_output_t;
+
+static void on_render_frame(void *user, int id, const uint8_t *img,
+                            int w, int h)
+{
+    render_output_t *output = user;
+    char path[1024];
+
+    if (output->pipe) {
+        if (fwrite(img, w * h * 4, 1, output->pipe) != 1)
+            LOG_E("Cannot write frame %d", id);
+        return;
+    }
+    snprintf(path, sizeof(path), output->out, id);
+    img_write(img, w, h, 4, path);
+    LOG_I("Rendered frame %d to %s", id, path);
+}
+
+/*
+ * Batch render mode.
+ *
+ * Render a list of views without any visible window, and save each of
+ * them as a png image.  The script is a json file of the form:
+ *
+ *   {
+ *     "width": 800,
+ *     "height": 600,
+ *     "data": "<local data directory>",
+ *     "views": [
+ *       {"time": 58000.5, "lat": 43.6, "lon": 1.4, "az": 180, "alt": 20,
+ *        "fov": 60, "width": 1024, "height": 768, "wait": 600,
+ *        "out": "out-0.png"},
+ *       {"time": 58000.5, "az": 90, "alt": 30, "fov": 40, "frames": 600,
+ *        "step": 60, "out": "trail-%04d.png"},
+ *       {"time": 58000.5, "az": 90, "alt": 30, "fov": 40, "frames": 600,
+ *        "step": 60, "pipe": "ffmpeg -f rawvideo -pix_fmt rgba "
+ *                            "-s 800x600 -r 30 -i - out.mp4"},
+ *       ...
+ *     ]
+ *   }
+ *
+ * The width, height and data attributes have the same meaning than for the
+ * benchmark mode; each view can override the image size.  The views are
+ * rendered one after the other with the same core instance, so that the
+ * loaded tiles stay in the cache between the views: ordering the views by
+ * location on the sky makes the batch much faster.  For each view we keep
+ * rendering until the core doesn't need to render anymore (all the visible
+ * data loaded), up to 'wait' frames (default to 600).
+ *
+ * A view can also export a sequence of frames, for time lapses: 'frames'
+ * images are rendered, the observer time moving by 'step' seconds between
+ * them.  The 'out' name is then a printf pattern with the frame index, or
+ * instead of files the frames can be streamed as raw RGBA data, top row
+ * first, to the standard input of a 'pipe' command.  Since the core stays
+ * the same, only the tiles that come into view need to be loaded between
+ * two frames.  The frames are read back asynchronously, so that the GPU
+ * can render the next frame while we save the previous one.
+ */
+static int run_render(const char *path)
+{
+    bench_t bench = {};
+    json_value *script, *views, *view;
+    char *txt, buf[64];
+    const char *pipe_cmd;
+    int i, j, k, size, w, h, max_w, max_h, max_wait, nb_frames;
+    double time, step;
+    readback_t rb = {.on_frame = on_render_frame};
+    render_output_t output;
+
+    txt = read_file(path, &size);
+    if (!txt) {
+        LOG_E("Cannot read render script %s", path);
+        return -1;
+    }
+    script = json_parse(txt, size);
+    free(txt);
+    views = script ? json_get_attr(script, "views", json_array) : NULL;
+    if (!views) {
+        LOG_E("Invalid render script %s", path);
+        json_value_free(script);
+        return -1;
+    }
+    w = json_get_attr_i(script, "width", 800);
+    h = json_get_attr_i(script, "height", 600);
+    bench.data_dir = json_get_attr_s(script, "data");
+
+    // We render all the views into a single offscreen framebuffer big
+    // enough for the largest one.
+    max_w = w;
+    max_h = h;
+    for (i = 0; i < views->u.array.length; i++) {
+        view = views->u.array.values[i];
+        max_w = max(max_w, json_get_attr_i(view, "width", w));
+        max_h = max(max_h, json_get_attr_i(view, "height", h));
+    }
+
+    glfwInit();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    g_window = glfwCreateWindow(max_w, max_h, "swe render", NULL, NULL);
+    if (!g_window) {
+        LOG_E("Cannot create offscreen context");
+        json_value_free(script);
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(g_window);
+    glfwSwapInterval(0);
+
+    asset_set_hook(&bench, bench_asset_hook);
+    core_init(w, h, 1.0);
+    core_add_default_sources();
+
+    rb.user = &output;
+    for (i = 0; i < views->u.array.length; i++) {
+        view = views->u.array.values[i];
+        w = json_get_attr_i(view, "width", json_get_attr_i(script, "width",
+                                                             800));
+        h = json_get_attr_i(view, "height", json_get_attr_i(script, "height",
+                                                              600));
+        time = json_get_attr_f(view, "time", core->observer->utc);
+        nb_frames = json_get_attr_i(view, "frames", 1);
+        step = json_get_attr_f(view, "step", 0);
+        output = (render_output_t) {.out = json_get_attr_s(view, "out")};
+        if (!output.out) {
+            snprintf(buf, sizeof(buf), nb_frames > 1 ?
+                     "render-%04d-%%04d.png" : "render-%04d.png", i);
+            output.out = buf;
+        }
+        pipe_cmd = json_get_attr_s(view, "pipe");
+        if (pipe_cmd) {
+            output.pipe = popen(pipe_cmd, "w");
+            if (!output.pipe) {
+                LOG_E("Cannot run %s", pipe_cmd);
+                continue;
+            }
+        }
+        obj_set_attr(&core->observer->obj, "latitude",
+                json_get_attr_f(view, "lat",
+                                core->observer->phi * DR2D) * DD2R);
+        obj_set_attr(&core->observer->obj, "longitude",
+                json_get_attr_f(view, "lon",
+                                core->observer->elong * DR2D) * DD2R);
+        obj_set_attr(&core->observer->obj, "yaw",
+                     json_get_attr_f(view, "az", 0) * DD2R);
+        obj_set_attr(&core->observer->obj, "pitch",
+                     json_get_attr_f(view, "alt", 0) * DD2R);
+        obj_set_attr(&core->obj, "fov",
+                     json_get_attr_f(view, "fov", 60) * DD2R);
+        max_wait = json_get_attr_i(view, "wait", 600);
+        for (k = 0; k < nb_frames; k++) {
+            obj_set_attr(&core->observer->obj, "utc",
+                         time + k * step / 86400);
+            for (j = 0; j == 0 || (j < max_wait && core_needs_render());
+                 j++) {
+                core_update(1.0 / 60.0);
+                core_render(w, h, 1.0);
+                glfwPollEvents();
+            }
+            readback_push(&rb, nb_frames > 1 ? k : i, w, h);
+        }
+        readback_flush(&rb);
+        if (output.pipe) pclose(output.pipe);
+    }
+
+    readback_release(&rb);
+    json_value_free(script);
+    core_release();
+    glfwTerminate();
+    return 0;
+}
+
+/*
+ * Replay mode.
+ *
+ * Replay a frame captured with the benchmark mode 'capture' attribute
+ * again and again, without any catalog loaded, and print the rendering
+ * time percentiles as json.  This allows to profile the GPU side of a
+ * frame in isolation.
+ */
+static int run_replay(const char *path)
+{
+    render_capture_t *cap;
+    renderer_t *rend;
+    int i, win_size[2];
+    double scale, t, times[REPLAY_NB_FRAMES], sum = 0;
+
+    // We need the core for the fonts and shaders assets.
+    glfwInit();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    g_window = glfwCreateWindow(800, 600, "swe replay", NULL, NULL);
+    if (!g_window) {
+        LOG_E("Cannot create offscreen context");
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(g_window);
+    glfwSwapInterval(0);
+    core_init(800, 600, 1.0);
+
+    cap = render_capture_load(path);
+    if (!cap) {
+        core_release();
+        glfwTerminate();
+        return -1;
+    }
+    render_capture_get_size(cap, win_size, &scale);
+    glfwSetWindowSize(g_window, win_size[0] * scale, win_size[1] * scale);
+    rend = render_gl_create();
+
+    for (i = 0; i < REPLAY_NB_FRAMES; i++) {
+        t = sys_get_unix_time();
+        if (render_capture_replay(cap, rend)) break;
+        glFinish();
+        times[i] = sys_get_unix_time() - t;
+        sum += times[i];
+        glfwSwapBuffers(g_window);
+        glfwPollEvents();
+    }
+    if (i == REPLAY_NB_FRAMES) {
+        qsort(times, i, sizeof(double), double_cmp);
+        printf("{\"frames\": %d, \"mean\": %.6f, \"p50\": %.6f, "
+               "\"p90\": %.6f, \"max\": %.6f}\n", i, sum / i,
+               times[i / 2], times[i * 9 / 10], times[i - 1]);
+    }
+
+    render_capture_delete(cap);
+    core_release();
+    glfwTerminate();
+    return i == REPLAY_NB_FRAMES ? 0 : -1;
+}
+
+/*
+ * Playback mode.
+ *
+ * Play a session recorded with the --record option (or recorder_start)
+ * again, offscreen, and print the frames times percentiles as json.  The
+ * frame time is the time spent in the updates since the previous render,
+ * plus the render itself.
+ *
+ * If a data directory is given, all the http urls are loaded from it as
+ * for the benchmark mode, and each asset only becomes available at the
+ * update where it arrived during the recording, so that the workload is
+ * the same from one run to the other.
+ */
+
+typedef struct {
+    bench_t     bench;
+    playback_t  *pb;
+} playback_bench_t;
+
+static void *playback_asset_hook(void *user, const char *url, int *size,
+                                 int *code)
+{
+    playback_bench_t *pbb = user;
+    if (pbb->bench.data_dir && !playback_is_asset_ready(pbb->pb, url)) {
+        *code = 0;
+        return NULL;
+    }
+    return bench_asset_hook(&pbb->bench, url, size, code);
+}
+
+static int run_playback(const char *path, const char *data_dir)
+{
+    playback_bench_t pbb = {.bench.data_dir = data_dir};
+    double v[3], t, frame_time = 0, sum = 0, *times = NULL;
+    int type, n = 0, allocated = 0, win_size[2] = {800, 600};
+
+    pbb.pb = playback_load(path);
+    if (!pbb.pb) return -1;
+
+    glfwInit();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    g_window = glfwCreateWindow(win_size[0], win_size[1], "swe playback",
+                                NULL, NULL);
+    if (!g_window) {
+        LOG_E("Cannot create offscreen context");
+        playback_delete(pbb.pb);
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(g_window);
+    glfwSwapInterval(0);
+
+    asset_set_hook(&pbb, playback_asset_hook);
+    core_init(win_size[0], win_size[1], 1.0);
+    core_add_default_sources();
+
+    while ((type = playback_step(pbb.pb, v))) {
+        t = sys_get_unix_time();
+        if (type == 'u') {
+            core_update(v[0]);
+            frame_time += sys_get_unix_time() - t;
+            continue;
+        }
+        if (v[0] * v[2] != win_size[0] || v[1] * v[2] != win_size[1]) {
+            win_size[0] = v[0] * v[2];
+            win_size[1] = v[1] * v[2];
+            glfwSetWindowSize(g_window, win_size[0], win_size[1]);
+        }
+        core_render(v[0], v[1], v[2]);
+        glFinish();
+        frame_time += sys_get_unix_time() - t;
+        if (n >= allocated) {
+            allocated = max(1024, allocated * 2);
+            times = realloc(times, allocated * sizeof(*times));
+        }
+        times[n++] = frame_time;
+        sum += frame_time;
+        frame_time = 0;
+        glfwSwapBuffers(g_window);
+        glfwPollEvents();
+    }
+
+    qsort(times, n, sizeof(double), double_cmp);
+    #define PERCENTILE(p) (n ? times[(int)((n - 1) * p)] : 0)
+    printf("{\"frames\": %d, \"mean\": %.6f, \"p50\": %.6f, "
+           "\"p90\": %.6f, \"p99\": %.6f, \"max\": %.6f}\n",
+           n, n ? sum / n : 0, PERCENTILE(0.5), PERCENTILE(0.9),
+           PERCENTILE(0.99), PERCENTILE(1.0));
+    #undef PERCENTILE
+
+    free(times);
+    playback_delete(pbb.pb);
+    core_release();
+    glfwTerminate();
+    return 0;
+}
+
 #endif
@@ -10,6 +10,19 @@
 #include "swe.h"
 
 static void (*g_listener)(obj_t *module, const char *attr) = NULL;
+static void (*g_changes_listener)(const char *changes) = NULL;
+
+// Changes waiting for the next call to module_flush_changes.
+typedef struct {
+    obj_t   *module;
+    char    *attr;
+} change_t;
+
+static struct {
+    int         nb;
+    int         allocated;
+    change_t    *list;
+} g_changes = {};
 
 EMSCRIPTEN_KEEPALIVE
 int module_update(obj_t *module, double dt)
@@ -82,6 +95,110 @@ int module_list_objs2(const obj_t *obj, observer_t *obs,
  *   1 if the source was no recognised.
  *   a negative error code otherwise.
  */
+static int list_records_callback(void *user, obj_t *obj)
+{
+    observer_t *obs = USER_GET(user, 0);
+    obj_record_t *out = USER_GET(user, 1);
+    int *nb = USER_GET(user, 2);
+    int max_nb = *(int*)USER_GET(user, 3);
+    char *names = USER_GET(user, 4);
+    int names_size = *(int*)USER_GET(user, 5);
+    int *names_ofs = USER_GET(user, 6);
+
+    if (*nb >= max_nb) return 1;
+    obj_get_record(obj, obs, &out[(*nb)++], names, names_size, names_ofs);
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int module_list_records(const obj_t *obj, observer_t *obs, double max_mag,
+                        int max_nb, obj_record_t *out,
+                        char *names, int names_size)
+{
+    int nb = 0, names_ofs = 0;
+    module_list_objs(obj, obs, max_mag, 0,
+                     USER_PASS(obs, out, &nb, &max_nb, names, &names_size,
+                               &names_ofs),
+                     list_records_callback);
+    return nb;
+}
+
+void obj_query_init(obj_query_t *query, double ra, double dec, double radius,
+                    double max_mag, const char *type)
+{
+    memset(query, 0, sizeof(*query));
+    eraS2c(ra, dec, query->cap);
+    query->cap[3] = radius >= M_PI ? -1 : cos(radius);
+    query->max_mag = max_mag;
+    if (type) strncpy(query->type, type, 4);
+    if (query->type[0]) otype_mask_add(&query->types, query->type);
+}
+
+bool obj_query_match(const obj_query_t *query, obj_t *obj, observer_t *obs)
+{
+    double vmag, pvo[2][4], pos[3];
+    char type[4];
+
+    if (    obj_get_info(obj, obs, INFO_VMAG, &vmag) == 0 &&
+            vmag > query->max_mag)
+        return false;
+    if (query->type[0]) {
+        if (obj_get_info(obj, obs, INFO_TYPE, type)) return false;
+        if (!otype_mask_test(&query->types, otype_get_id(type)))
+            return false;
+    }
+    if (query->cap[3] > -1) {
+        obj_get_pvo(obj, obs, pvo);
+        vec3_normalize(pvo[0], pos);
+        if (!cap_contains_vec3(query->cap, pos)) return false;
+    }
+    return true;
+}
+
+static int query_callback(void *user, obj_t *obj)
+{
+    const obj_query_t *query = USER_GET(user, 0);
+    observer_t *obs = USER_GET(user, 1);
+    int (*f)(void *user, obj_t *obj) = USER_GET(user, 2);
+    void *f_user = USER_GET(user, 3);
+    bool *stopped = USER_GET(user, 4);
+
+    if (!obj_query_match(query, obj, obs)) return 0;
+    if (f(f_user, obj)) *stopped = true;
+    return *stopped;
+}
+
+int module_query(const obj_t *obj, observer_t *obs,
+                 const obj_query_t *query, void *user,
+                 int (*f)(void *user, obj_t *obj))
+{
+    bool stopped = false;
+    if (obj->klass->query)
+        return obj->klass->query(obj, obs, query, user, f);
+    module_list_objs(obj, obs, query->max_mag, 0,
+                     USER_PASS(query, obs, f, user, &stopped),
+                     query_callback);
+    return stopped ? 1 : 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int module_query_records(const obj_t *obj, observer_t *obs,
+                         double ra, double dec, double radius,
+                         double max_mag, const char *type,
+                         int max_nb, obj_record_t *out,
+                         char *names, int names_size)
+{
+    int nb = 0, names_ofs = 0;
+    obj_query_t query;
+
+    obj_query_init(&query, ra, dec, radius, max_mag, type);
+    module_query(obj, obs, &query,
+                 USER_PASS(obs, out, &nb, &max_nb, names, &names_size,
+                           &names_ofs),
+                 list_records_callback);
+    return nb;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int module_add_data_source(obj_t *obj, const char *url, const char *type,
                            json_value *args)
@@ -136,6 +253,86 @@ obj_t *obj_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint)
     return NULL;
 }
 
+/*
+ * Global index of the objects oids.  Open addressing hash table with
+ * linear probing, since it can contain up to millions of entries (one per
+ * minor planet), and uthash would use too much memory.
+ */
+typedef struct {
+    uint64_t    oid;
+    uint64_t    hint;
+    obj_t       *module; // NULL for empty slots.
+} oid_entry_t;
+
+static struct {
+    int         nb;
+    int         bits;
+    oid_entry_t *entries;
+} g_oid_index = {};
+
+static oid_entry_t *oid_index_lookup(uint64_t oid)
+{
+    uint64_t mask = (1ULL << g_oid_index.bits) - 1;
+    uint64_t i = (oid * 11400714819323198485ULL) >> (64 - g_oid_index.bits);
+    oid_entry_t *e;
+
+    while (true) {
+        e = &g_oid_index.entries[i];
+        if (!e->module || e->oid == oid) return e;
+        i = (i + 1) & mask;
+    }
+}
+
+// Rebuild the index with a new size, skipping the entries of a module.
+static void oid_index_rebuild(int bits, const obj_t *skip)
+{
+    int i, size = g_oid_index.entries ? 1 << g_oid_index.bits : 0;
+    oid_entry_t *entries = g_oid_index.entries, *e;
+
+    g_oid_index.bits = bits;
+    g_oid_index.nb = 0;
+    g_oid_index.entries = calloc(1 << bits, sizeof(*entries));
+    for (i = 0; i < size; i++) {
+        if (!entries[i].module || entries[i].module == skip) continue;
+        e = oid_index_lookup(entries[i].oid);
+        *e = entries[i];
+        g_oid_index.nb++;
+    }
+    free(entries);
+}
+
+void module_register_oid(obj_t *module, uint64_t oid, uint64_t hint)
+{
+    oid_entry_t *e;
+
+    // Keep the load factor under 3/4.
+    if (!g_oid_index.entries)
+        oid_index_rebuild(10, NULL);
+    if ((g_oid_index.nb + 1) * 4 > (3 << g_oid_index.bits))
+        oid_index_rebuild(g_oid_index.bits + 1, NULL);
+    e = oid_index_lookup(oid);
+    if (!e->module) g_oid_index.nb++;
+    e->oid = oid;
+    e->hint = hint;
+    e->module = module;
+}
+
+void module_unregister_oids(const obj_t *module)
+{
+    if (!g_oid_index.entries) return;
+    oid_index_rebuild(g_oid_index.bits, module);
+}
+
+obj_t *module_find_by_oid(uint64_t oid, uint64_t *hint)
+{
+    oid_entry_t *e;
+    if (!g_oid_index.entries) return NULL;
+    e = oid_index_lookup(oid);
+    if (!e->module) return NULL;
+    if (hint) *hint = e->hint;
+    return e->module;
+}
+
 // For modules: return the order in which the modules should be rendered.
 // NOTE: if we used deferred rendering this wouldn't be needed at all!
 double module_get_render_order(const obj_t *module)
@@ -152,10 +349,111 @@ void module_add_global_listener(void (*f)(obj_t *module, const char *attr))
     g_listener = f;
 }
 
+EMSCRIPTEN_KEEPALIVE
+void module_add_global_changes_listener(void (*f)(const char *changes))
+{
+    g_changes_listener = f;
+}
+
+// Current version of the objects tree, incremented at each change.
+static uint32_t g_tree_version = 0;
+
+// Mark an object as changed in the tree versions.
+static void tree_mark_changed(obj_t *obj, bool recursive)
+{
+    obj_t *child, *parent;
+    obj->version = obj->tree_version = ++g_tree_version;
+    for (parent = obj->parent; parent; parent = parent->parent)
+        parent->tree_version = g_tree_version;
+    if (!recursive) return;
+    for (child = obj->children; child; child = child->next)
+        tree_mark_changed(child, true);
+}
+
 void module_changed(obj_t *module, const char *attr)
 {
-    if (g_listener)
-        g_listener(module, attr);
+    int i;
+    change_t *change;
+
+    tree_mark_changed(module, false);
+
+    // Any attribute change might need a new frame.
+    if (core) {
+        core->redraw.dirty = true;
+        core_layers_on_changed(module, attr);
+    }
+    if (!g_listener && !g_changes_listener) return;
+
+    // Only keep one change per attribute until the next flush.
+    for (i = 0; i < g_changes.nb; i++) {
+        change = &g_changes.list[i];
+        if (change->module == module && strcmp(change->attr, attr) == 0)
+            return;
+    }
+    if (g_changes.nb >= g_changes.allocated) {
+        g_changes.allocated = max(16, g_changes.allocated * 2);
+        g_changes.list = realloc(g_changes.list,
+                                 g_changes.allocated * sizeof(change_t));
+    }
+    change = &g_changes.list[g_changes.nb++];
+    change->module = module;
+    change->attr = strdup(attr);
+    // Make sure the module is still alive at flush time.
+    obj_retain(module);
+}
+
+// Serialize a list of changes into a json array of [module, attr, value].
+static char *serialize_changes(int nb, const change_t *changes)
+{
+    int i, size;
+    json_value *jchanges, *jchange, *jval;
+    const attribute_t *attr;
+    char *ret;
+
+    jchanges = json_array_new(nb);
+    for (i = 0; i < nb; i++) {
+        attr = obj_get_attr_(changes[i].module, changes[i].attr);
+        // Don't call functions attributes, they might have side effects.
+        jval = NULL;
+        if (attr && attr->is_prop)
+            jval = obj_call_json(changes[i].module, changes[i].attr, NULL);
+        jchange = json_array_new(3);
+        json_array_push(jchange,
+                        json_integer_new((uintptr_t)changes[i].module));
+        json_array_push(jchange, json_string_new(changes[i].attr));
+        json_array_push(jchange, jval ?: json_null_new());
+        json_array_push(jchanges, jchange);
+    }
+    size = json_measure(jchanges);
+    ret = calloc(1, size);
+    json_serialize(ret, jchanges);
+    json_builder_free(jchanges);
+    return ret;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void module_flush_changes(void)
+{
+    int i, nb = g_changes.nb;
+    change_t *changes = g_changes.list;
+    char *str;
+
+    if (!nb) return;
+    // The listeners might change values again, so we start a new list
+    // before calling them.
+    memset(&g_changes, 0, sizeof(g_changes));
+
+    if (g_changes_listener) {
+        str = serialize_changes(nb, changes);
+        g_changes_listener(str);
+        free(str);
+    }
+    for (i = 0; i < nb; i++) {
+        if (g_listener) g_listener(changes[i].module, changes[i].attr);
+        obj_release(changes[i].module);
+        free(changes[i].attr);
+    }
+    free(changes);
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -165,15 +463,44 @@ void module_add(obj_t *parent, obj_t *child)
     assert(parent);
     child->parent = parent;
     DL_APPEND(parent->children, child);
+    // In case of duplicated ids, only the first child is in the hash, so
+    // that we get the same result as a search in the list.
+    if (child->id && !module_find_child(parent, child->id, -1))
+        HASH_ADD_KEYPTR(hh, parent->children_hash, child->id,
+                        strlen(child->id), child);
+    tree_mark_changed(child, true);
+    tree_mark_changed(parent, false);
 }
 
 EMSCRIPTEN_KEEPALIVE
 void module_remove(obj_t *parent, obj_t *child)
 {
+    obj_t *other;
+
     assert(child->parent == parent);
     assert(parent);
     child->parent = NULL;
     DL_DELETE(parent->children, child);
+    tree_mark_changed(parent, false);
+    if (!child->id || module_find_child(parent, child->id, -1) != child)
+        return;
+    HASH_DELETE(hh, parent->children_hash, child);
+    // Put back the next child with the same id if any.
+    DL_FOREACH(parent->children, other) {
+        if (other->id && strcmp(other->id, child->id) == 0) {
+            HASH_ADD_KEYPTR(hh, parent->children_hash, other->id,
+                            strlen(other->id), other);
+            break;
+        }
+    }
+}
+
+obj_t *module_find_child(const obj_t *module, const char *id, int len)
+{
+    obj_t *ret;
+    if (len < 0) len = strlen(id);
+    HASH_FIND(hh, module->children_hash, id, len, ret);
+    return ret;
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -181,13 +508,9 @@ obj_t *module_get_child(const obj_t *module, const char *id)
 {
     obj_t *ret;
     assert(id);
-    DL_FOREACH(module->children, ret) {
-        if (ret->id && strcmp(ret->id, id) == 0) {
-            ret->ref++;
-            return ret;
-        }
-    }
-    return NULL;
+    ret = module_find_child(module, id, -1);
+    if (ret) ret->ref++;
+    return ret;
 }
 
 static json_value *json_extract_attr(json_value *val, const char *attr)
@@ -203,19 +526,14 @@ static json_value *json_extract_attr(json_value *val, const char *attr)
     return ret;
 }
 
-static json_value *module_get_tree_json(const obj_t *obj, bool detailed)
+// Add all the properties of an object to a json object.
+static void tree_add_props(const obj_t *obj, bool detailed, json_value *ret)
 {
     int i;
     attribute_t *attr;
-    json_value *ret, *val, *tmp;
-    obj_t *child;
-    obj_klass_t *klass;
+    json_value *val, *tmp;
+    obj_klass_t *klass = obj->klass;
 
-    assert(obj);
-    klass = obj->klass;
-
-    ret = json_object_new(0);
-    // Add all the properties.
     for (i = 0; ; i++) {
         if (!klass || !klass->attributes) break;
         attr = &klass->attributes[i];
@@ -230,10 +548,24 @@ static json_value *module_get_tree_json(const obj_t *obj, bool detailed)
         }
         json_object_push(ret, attr->name, val);
     }
+}
+
+static bool tree_has_child(const obj_t *child)
+{
+    return child->id && (child->klass->flags & OBJ_IN_JSON_TREE);
+}
+
+static json_value *module_get_tree_json(const obj_t *obj, bool detailed)
+{
+    json_value *ret, *val;
+    obj_t *child;
+
+    assert(obj);
+    ret = json_object_new(0);
+    tree_add_props(obj, detailed, ret);
     // Add all the children
     for (child = obj->children; child; child = child->next) {
-        if (!child->id) continue;
-        if (!(child->klass->flags & OBJ_IN_JSON_TREE)) continue;
+        if (!tree_has_child(child)) continue;
         val = module_get_tree_json(child, detailed);
         json_object_push(ret, child->id, val);
     }
@@ -266,6 +598,56 @@ char *module_get_tree(const obj_t *obj, bool detailed)
     return ret;
 }
 
+// Add the objects changed since a version to a flat json object.
+static void tree_add_changes(const obj_t *obj, const char *path,
+                             uint32_t since, bool detailed, json_value *out)
+{
+    json_value *jobj, *jattrs, *jchildren;
+    obj_t *child;
+    char child_path[1024];
+
+    if (since && obj->tree_version <= since) return;
+    if (!since || obj->version > since) {
+        jobj = json_object_new(0);
+        jattrs = json_object_new(0);
+        tree_add_props(obj, detailed, jattrs);
+        json_object_push(jobj, "attrs", jattrs);
+        jchildren = json_array_new(0);
+        for (child = obj->children; child; child = child->next) {
+            if (tree_has_child(child))
+                json_array_push(jchildren, json_string_new(child->id));
+        }
+        json_object_push(jobj, "children", jchildren);
+        json_object_push(out, path, jobj);
+    }
+    for (child = obj->children; child; child = child->next) {
+        if (!tree_has_child(child)) continue;
+        snprintf(child_path, sizeof(child_path), "%s%s%s",
+                 path, *path ? "." : "", child->id);
+        tree_add_changes(child, child_path, since, detailed, out);
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+char *module_get_tree_changes(const obj_t *obj, bool detailed,
+                              uint32_t since)
+{
+    char *ret;
+    json_value *jret, *jchanges;
+    json_serialize_opts opts = {.mode = json_serialize_mode_packed};
+
+    assert(obj);
+    jret = json_object_new(0);
+    json_object_push(jret, "version", json_integer_new(g_tree_version));
+    jchanges = json_object_new(0);
+    tree_add_changes(obj, "", since, detailed, jchanges);
+    json_object_push(jret, "changes", jchanges);
+    ret = calloc(1, json_measure_ex(jret, opts));
+    json_serialize_ex(ret, jret, opts);
+    json_builder_free(jret);
+    return ret;
+}
+
 // Return the path of the object relative to a root object.
 // Inputs:
 //  obj         The object.
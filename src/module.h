@@ -10,6 +10,8 @@
 #ifndef MODULE_H
 #define MODULE_H
 
+#include "otypes.h"
+
 /*
  * Function: module_update
  * Update the module.
@@ -44,6 +46,110 @@ int module_list_objs2(const obj_t *obj, observer_t *obs,
                      double max_mag, void *user,
                      int (*f)(void *, obj_t *));
 
+/*
+ * Type: obj_query_t
+ * A sky objects range query.
+ *
+ * Attributes:
+ *   cap        - ICRF cone of the query, as a unit direction followed by
+ *                the cosine of the cone radius.  Set cap[3] to -1 for the
+ *                full sky.
+ *   max_mag    - Only consider objects below this magnitude.
+ *   type       - Only consider objects of this otype or its descendants.
+ *                Set to an empty string for any type.
+ *   types      - Mask of the type and its descendants, set by
+ *                <obj_query_init>.
+ */
+struct obj_query {
+    double  cap[4];
+    double  max_mag;
+    char    type[4];
+    otype_mask_t types;
+};
+
+/*
+ * Function: obj_query_init
+ * Initialize a cone query.
+ *
+ * Parameters:
+ *   query      - The query to initialize.
+ *   ra         - ICRF right ascension of the cone center (rad).
+ *   dec        - ICRF declination of the cone center (rad).
+ *   radius     - Radius of the cone (rad), or >= PI for the full sky.
+ *   max_mag    - Max magnitude.
+ *   type       - Otype filter, or NULL for any.
+ */
+void obj_query_init(obj_query_t *query, double ra, double dec, double radius,
+                    double max_mag, const char *type);
+
+/*
+ * Function: obj_query_match
+ * Check if an object matches a query.
+ */
+bool obj_query_match(const obj_query_t *query, obj_t *obj, observer_t *obs);
+
+/*
+ * Function: module_query
+ * List all the objects of a module matching a query.
+ *
+ * Modules that store their objects in HiPS tiles (stars, dsos) only visit
+ * the tiles intersecting the cone, and filter the objects directly on the
+ * tiles data.  For the other modules we filter the output of
+ * <module_list_objs>.
+ *
+ * Parameters:
+ *   module - The module (core for all objects).
+ *   obs    - The observer.
+ *   query  - The query.
+ *   user   - Data passed to the callback.
+ *   f      - Callback called once per object.  Return a non zero value to
+ *            stop the query.
+ *
+ * Return:
+ *   1 if the query got stopped by the callback, 0 otherwise.
+ */
+int module_query(const obj_t *module, observer_t *obs,
+                 const obj_query_t *query, void *user,
+                 int (*f)(void *user, obj_t *obj));
+
+/*
+ * Function: module_query_records
+ * Same as <module_query>, but the results are written into records, as
+ * with <module_list_records>.
+ *
+ * Return:
+ *   The number of records written.
+ */
+int module_query_records(const obj_t *module, observer_t *obs,
+                         double ra, double dec, double radius,
+                         double max_mag, const char *type,
+                         int max_nb, obj_record_t *out,
+                         char *names, int names_size);
+
+/*
+ * Function: module_list_records
+ * List the objects of a module directly into an array of <obj_record_t>.
+ *
+ * This is the bulk version of module_list_objs for the js code: no object
+ * is returned, so there is nothing to release, and the records can be
+ * read directly from the wasm heap.
+ *
+ * Parameters:
+ *   module     - The module (core for all objects).
+ *   obs        - The observer used to compute the records.
+ *   max_mag    - Only consider objects below this magnitude.
+ *   max_nb     - Size of the out array.
+ *   out        - Output records.
+ *   names      - Buffer for the objects names (see <obj_get_record>).
+ *   names_size - Size of the names buffer.
+ *
+ * Return:
+ *   The number of records written.
+ */
+int module_list_records(const obj_t *module, observer_t *obs, double max_mag,
+                        int max_nb, obj_record_t *out,
+                        char *names, int names_size);
+
 /*
  * Function: module_add_data_source
  * Add a data source url to a module
@@ -93,6 +199,43 @@ obj_t *obj_get_by_oid(const obj_t *module, uint64_t oid, uint64_t hint);
  */
 double module_get_render_order(const obj_t *module);
 
+/*
+ * Function: module_register_oid
+ * Add an object oid to the global oid index.
+ *
+ * This allows <obj_get_by_oid> on the core to directly query the module
+ * owning the object instead of trying all the modules in turn.  Modules
+ * should only register the objects that they cannot quickly find.
+ *
+ * If the oid is already registered, the previous entry is replaced.
+ *
+ * Parameters:
+ *   module - The module owning the object.
+ *   oid    - The object oid.
+ *   hint   - Value passed as hint to the module get_by_oid method, to
+ *            locate the object in the module.  The module must check
+ *            that the hint is still valid.
+ */
+void module_register_oid(obj_t *module, uint64_t oid, uint64_t hint);
+
+/*
+ * Function: module_unregister_oids
+ * Remove all the oids of a module from the global oid index.
+ *
+ * This is automatically called when a module is destroyed.
+ */
+void module_unregister_oids(const obj_t *module);
+
+/*
+ * Function: module_find_by_oid
+ * Return the module that registered a given oid, or NULL.
+ *
+ * Parameters:
+ *   oid    - An object oid.
+ *   hint   - Get the registered hint value.  Can be NULL.
+ */
+obj_t *module_find_by_oid(uint64_t oid, uint64_t *hint);
+
 /*
  * Function: module_add_global_listener
  * Register a callback to be called anytime an attribute of a module changes.
@@ -102,13 +245,34 @@ double module_get_render_order(const obj_t *module);
  */
 void module_add_global_listener(void (*f)(obj_t *module, const char *attr));
 
+/*
+ * Function: module_add_global_changes_listener
+ * Register a callback to be called with all the changes of a frame.
+ *
+ * The changes are passed as a json array of [module, attr, value] entries,
+ * with one entry per changed attribute, so that the listener doesn't need
+ * to read back the values.  Function attributes have a null value.
+ */
+void module_add_global_changes_listener(void (*f)(const char *changes));
+
 /*
  * Function: module_changed
  * Should be called by modules after they manually change one of their
  * attributes.
+ *
+ * The listeners are not called immediately: the changes are accumulated
+ * and de-duplicated until the next call to <module_flush_changes>.
  */
 void module_changed(obj_t *module, const char *attr);
 
+/*
+ * Function: module_flush_changes
+ * Notify the listeners of all the changes since the last call.
+ *
+ * This is called once per frame by <core_update>.
+ */
+void module_flush_changes(void);
+
 /*
  * Macro: MODULE_ITER
  * Iter all the children of a given module of a given type.
@@ -146,6 +310,20 @@ void module_remove(obj_t *module, obj_t *child);
  */
 obj_t *module_get_child(const obj_t *module, const char *id);
 
+/*
+ * Function: module_find_child
+ * Return a module child by id, using the children hash table.
+ *
+ * Contrary to <module_get_child> this doesn't change the ref counting of
+ * the returned module.
+ *
+ * Parameters:
+ *   module - A module.
+ *   id     - Id of the child.
+ *   len    - Length of the id, or -1 if the id is null terminated.
+ */
+obj_t *module_find_child(const obj_t *module, const char *id, int len);
+
 /*
  * Function: module_get_tree
  * Return a json tree of all the attributes and children of this module.
@@ -159,6 +337,33 @@ obj_t *module_get_child(const obj_t *module, const char *id);
  */
 char *module_get_tree(const obj_t *obj, bool detailed);
 
+/*
+ * Function: module_get_tree_changes
+ * Return the parts of an objects tree that changed since a given version.
+ *
+ * Each object keeps the tree version of its last change, and of the last
+ * change of its descendants, so that we only visit the changed subtrees.
+ * An object changes when <module_changed> is called on it, or when
+ * children are added to or removed from it.
+ *
+ * Parameters:
+ *   obj        - The root object.
+ *   detailed   - Whether to add hints to the values or not.
+ *   since      - A version returned by a previous call, or zero to get
+ *                the whole tree.
+ *
+ * Return:
+ *   A newly allocated json string of the form:
+ *
+ *     {"version": <current version>,
+ *      "changes": {<path>: {"attrs": {...}, "children": [<id>, ...]}}}
+ *
+ *   With the paths relative to the root object, the root itself having an
+ *   empty path.  Caller should delete it.
+ */
+char *module_get_tree_changes(const obj_t *obj, bool detailed,
+                              uint32_t since);
+
 /*
  * Function: obj_get_path
  * Return the path of the module relative to a root module.
@@ -16,22 +16,6 @@
  *
  */
 
-/*
- * Type: atmosphere_t
- * Atmosphere module struct.
- */
-typedef struct atmosphere {
-    obj_t           obj;
-    // The twelves tile textures of healpix at order 0 and construction bufs.
-    struct {
-        texture_t       *tex;
-        float           (*buf)[3];  // color buffer (in xyY).
-        bool            visible;
-    } tiles[12];
-    fader_t         visible;
-    double      turbidity;
-} atmosphere_t;
-
 // All the precomputed data
 typedef struct {
     double sun_pos[3];
@@ -47,17 +31,51 @@ typedef struct {
     double eclipse_factor; // Solar eclipse adjustment.
     double landscape_lum; // Average luminance of the landscape.
 
-    // Updated during rendering.
-    double sum_lum;
-    double max_lum;
-    int    nb_lum;
-
     // Cos Maximum distance between 2 points of the grid on which the atmosphere
     // is rendered. It is used to avoid aliasing in fast varying regions of the
     // atmosphere, like near moon border.
     float cos_grid_angular_step;
 } render_data_t;
 
+// Luminance values sampled for the eye adaptation.
+typedef struct {
+    double sum_lum;
+    double max_lum;
+    int    nb_lum;
+} lum_stats_t;
+
+/*
+ * Type: atmosphere_t
+ * Atmosphere module struct.
+ */
+typedef struct atmosphere {
+    obj_t           obj;
+    // The twelves tile textures of healpix at order 0 and construction bufs.
+    struct {
+        texture_t       *tex;
+        float           (*buf)[3];  // color buffer (in xyY).
+        bool            visible;
+    } tiles[12];
+    fader_t         visible;
+    double      turbidity;
+
+    // The render data is only recomputed when the observer location, the
+    // turbidity, or the sun and moon change.
+    struct {
+        bool            valid;
+        uint64_t        obs_hash;
+        double          turbidity;
+        double          sun_pos[3];
+        double          moon_pos[3];
+        double          sun_vmag;
+        double          moon_vmag;
+        render_data_t   data;
+        lum_stats_t     tiles_lum[48]; // For each order one tile.
+        bool            tiles_done[48];
+    } cache;
+} atmosphere_t;
+
+
 static double F2(const double *lam, double cos_theta,
                  double gamma, double cos_gamma)
 {
@@ -144,9 +162,9 @@ static void prepare_skybrightness(
                           eraSepp(sun_pos, zenith));
 }
 
-static float compute_lum(void *user, const float pos[3])
+static float compute_lum(const render_data_t *d, const double pos[3],
+                         lum_stats_t *stats)
 {
-    render_data_t *d = user;
     double p[3] = {pos[0], pos[1], pos[2]};
     const double zenith[3] = {0, 0, 1};
     float lum;
@@ -161,16 +179,60 @@ static float compute_lum(void *user, const float pos[3])
     // Update luminance sum for eye adaptation.
     // If we are below horizon use the precomputed landscape luminance.
     if (pos[2] > 0) {
-        d->sum_lum += lum;
-        d->nb_lum++;
-        d->max_lum = max(d->max_lum, lum);
+        stats->sum_lum += lum;
+        stats->nb_lum++;
+        stats->max_lum = max(stats->max_lum, lum);
     }
     else {
-        d->max_lum = max(d->max_lum, d->landscape_lum);
+        stats->max_lum = max(stats->max_lum, d->landscape_lum);
     }
     return lum;
 }
 
+/*
+ * Function: update_cache
+ * Recompute the render data if the sun, moon or observer changed.
+ *
+ * The positions and magnitudes are compared with a small tolerance, so
+ * that a slowly moving sun doesn't force an update at every frame.
+ */
+static void update_cache(atmosphere_t *atm, const painter_t *painter,
+                         const double sun_pos[3], double sun_vmag,
+                         const double moon_pos[3], double moon_vmag)
+{
+    const double cos_tolerance = cos(0.01 * DD2R);
+    const double vmag_tolerance = 0.01;
+    const observer_t *obs = painter->obs;
+
+    // The hash_partial only depends on the observer location, and not on the
+    // view direction.
+    if (    atm->cache.valid &&
+            atm->cache.obs_hash == obs->hash_partial &&
+            atm->cache.turbidity == atm->turbidity &&
+            vec3_dot(atm->cache.sun_pos, sun_pos) >= cos_tolerance &&
+            vec3_dot(atm->cache.moon_pos, moon_pos) >= cos_tolerance &&
+            fabs(atm->cache.sun_vmag - sun_vmag) <= vmag_tolerance &&
+            fabs(atm->cache.moon_vmag - moon_vmag) <= vmag_tolerance)
+        return;
+
+    atm->cache.data = prepare_render_data(sun_pos, sun_vmag,
+                                          moon_pos, moon_vmag,
+                                          atm->turbidity);
+    // This is quite ad-hoc as in reality we are using a HIPS grid
+    atm->cache.data.cos_grid_angular_step = cos(15. * DD2R);
+    prepare_skybrightness(&atm->cache.data.skybrightness,
+                          painter, sun_pos, moon_pos, moon_vmag);
+
+    atm->cache.valid = true;
+    atm->cache.obs_hash = obs->hash_partial;
+    atm->cache.turbidity = atm->turbidity;
+    vec3_copy(sun_pos, atm->cache.sun_pos);
+    vec3_copy(moon_pos, atm->cache.moon_pos);
+    atm->cache.sun_vmag = sun_vmag;
+    atm->cache.moon_vmag = moon_vmag;
+    memset(atm->cache.tiles_done, 0, sizeof(atm->cache.tiles_done));
+}
+
 static int atmosphere_update(obj_t *obj, double dt)
 {
     atmosphere_t *atm = (atmosphere_t*)obj;
@@ -178,21 +240,40 @@ static int atmosphere_update(obj_t *obj, double dt)
 }
 
 static void render_tile(atmosphere_t *atm, const painter_t *painter,
-                        int order, int pix)
+                        lum_stats_t *stats, int order, int pix)
 {
     int split, i;
     uv_map_t map;
+    double grid[9][4];
+    lum_stats_t *tile_lum;
 
     if (painter_is_healpix_clipped(painter, FRAME_OBSERVED, order, pix, true))
         return;
     if (order < 1) {
         for (i = 0; i < 4; i++)
-            render_tile(atm, painter, order + 1, pix * 4 + i);
+            render_tile(atm, painter, stats, order + 1, pix * 4 + i);
         return;
     }
-    split = 4; // Adhoc split value to look good while not being too slow.
+    // Adhoc split value to look good while not being too slow.
+    split = painter->degrade < 0.5 ? 4 : 2;
     uv_map_init_healpix(&map, order, pix, true, true);
     paint_quad(painter, FRAME_OBSERVED, &map, split);
+
+    // The luminance is computed in the shader, here we only sample a
+    // coarser grid to get the average and max luminance of the visible
+    // tiles.  The samples of each tile are kept until the cache changes.
+    assert(order == 1);
+    tile_lum = &atm->cache.tiles_lum[pix];
+    if (!atm->cache.tiles_done[pix]) {
+        memset(tile_lum, 0, sizeof(*tile_lum));
+        uv_map_grid(&map, 2, grid);
+        for (i = 0; i < 9; i++)
+            compute_lum(&atm->cache.data, grid[i], tile_lum);
+        atm->cache.tiles_done[pix] = true;
+    }
+    stats->sum_lum += tile_lum->sum_lum;
+    stats->nb_lum += tile_lum->nb_lum;
+    stats->max_lum = max(stats->max_lum, tile_lum->max_lum);
 }
 
 static int atmosphere_render(const obj_t *obj, const painter_t *painter_)
@@ -201,7 +282,8 @@ static int atmosphere_render(const obj_t *obj, const painter_t *painter_)
     atmosphere_t *atm = (atmosphere_t*)obj;
     obj_t *sun, *moon;
     double sun_pos[4], moon_pos[4], sun_vmag, moon_vmag;
-    render_data_t data;
+    const render_data_t *data;
+    lum_stats_t stats = {};
     int i;
     painter_t painter = *painter_;
     core->lwsky_average = 0.0001;
@@ -219,43 +301,44 @@ static int atmosphere_render(const obj_t *obj, const painter_t *painter_)
     obj_get_info(sun, obs, INFO_VMAG, &sun_vmag);
     obj_get_info(moon, obs, INFO_VMAG, &moon_vmag);
 
-    // XXX: this could be cached!
-    data = prepare_render_data(sun_pos, sun_vmag, moon_pos, moon_vmag,
-                               atm->turbidity);
-    // This is quite ad-hoc as in reality we are using a HIPS grid
-    data.cos_grid_angular_step = cos(15. * DD2R);
-    prepare_skybrightness(&data.skybrightness,
-            &painter, sun_pos, moon_pos, moon_vmag);
+    update_cache(atm, &painter, sun_pos, sun_vmag, moon_pos, moon_vmag);
+    data = &atm->cache.data;
 
     // Set the shader attributes.
-    painter.atm.p[0]  = data.Px[0];
-    painter.atm.p[1]  = data.Px[1];
-    painter.atm.p[2]  = data.Px[2];
-    painter.atm.p[3]  = data.Px[3];
-    painter.atm.p[4]  = data.Px[4];
-    painter.atm.p[5]  = data.kx;
-
-    painter.atm.p[6]  = data.Py[0];
-    painter.atm.p[7]  = data.Py[1];
-    painter.atm.p[8]  = data.Py[2];
-    painter.atm.p[9]  = data.Py[3];
-    painter.atm.p[10] = data.Py[4];
-    painter.atm.p[11] = data.ky;
-
-    vec3_to_float(sun_pos, painter.atm.sun);
-    painter.atm.compute_lum = compute_lum;
-    painter.atm.user = &data;
+    painter.atm.p[0]  = data->Px[0];
+    painter.atm.p[1]  = data->Px[1];
+    painter.atm.p[2]  = data->Px[2];
+    painter.atm.p[3]  = data->Px[3];
+    painter.atm.p[4]  = data->Px[4];
+    painter.atm.p[5]  = data->kx;
+
+    painter.atm.p[6]  = data->Py[0];
+    painter.atm.p[7]  = data->Py[1];
+    painter.atm.p[8]  = data->Py[2];
+    painter.atm.p[9]  = data->Py[3];
+    painter.atm.p[10] = data->Py[4];
+    painter.atm.p[11] = data->ky;
+
+    vec3_to_float(data->sun_pos, painter.atm.sun);
+    vec3_to_float(data->moon_pos, painter.atm.moon);
+    painter.atm.sb[0] = data->skybrightness.b_night_term;
+    painter.atm.sb[1] = data->skybrightness.K;
+    painter.atm.sb[2] = data->skybrightness.b_moon_term;
+    painter.atm.sb[3] = data->skybrightness.C3;
+    painter.atm.sb[4] = data->skybrightness.b_twilight_term;
+    painter.atm.sb[5] = data->skybrightness.C4;
+    painter.atm.sb[6] = data->eclipse_factor;
+    painter.atm.sb[7] = data->cos_grid_angular_step;
     painter.flags |= PAINTER_ADD | PAINTER_ATMOSPHERE_SHADER;
     painter.color[3] = atm->visible.value;
 
-    data.max_lum = 0;
     for (i = 0; i < 12; i++) {
-        render_tile(atm, &painter, 0, i);
+        render_tile(atm, &painter, &stats, 0, i);
     }
 
-    core_report_luminance_in_fov(data.max_lum, true);
-    if (data.nb_lum)
-        core->lwsky_average = data.sum_lum / data.nb_lum;
+    core_report_luminance_in_fov(stats.max_lum, true);
+    if (stats.nb_lum)
+        core->lwsky_average = stats.sum_lum / stats.nb_lum;
     return 0;
 }
 
@@ -267,6 +350,209 @@ static int atmosphere_init(obj_t *obj, json_value *args)
     return 0;
 }
 
+/*
+ * Type: conditions_time_t
+ * The part of the sky conditions that only depends on the time, shared by
+ * all the locations of the grid.
+ */
+typedef struct {
+    double  tt;         // TT MJD.
+    double  sun[3];     // Geocentric Sun position, Earth fixed frame (AU).
+    double  moon[3];    // Geocentric Moon position, Earth fixed frame (AU).
+    double  moon_illumination;
+    double  moon_vmag;
+    int     year;
+    int     month;
+} conditions_time_t;
+
+/*
+ * Type: conditions_t
+ * A sky conditions grid computation, shared by all the workers.
+ */
+typedef struct {
+    double  lat[2];     // Latitude range (rad).
+    double  lon[2];     // Longitude range (rad).
+    int     nb_lat;
+    int     nb_lon;
+    double  elevation;  // Elevation above the sea level (m).
+    conditions_time_t *times;
+    // Output, nb_lon x nb_lat values for each time.
+    float   *sun_alt;
+    float   *moon_alt;
+    float   *lum;
+} conditions_t;
+
+/*
+ * Compute the time dependent part of the sky conditions.
+ *
+ * We only use the geocentric positions, the Moon parallax is added for
+ * each location.  The Earth fixed frame ignores the polar motion.
+ */
+static void conditions_time_init(conditions_time_t *c, double tt)
+{
+    double pvh[2][3], pvb[2][3], moon[3], lambda, beta, dist, obl;
+    double rmatecl[3][3], rmatp[3][3], rc2i[3][3], rpom[3][3], rc2t[3][3];
+    double ut11, ut12, phase, fd, p[3], m[3];
+    int day;
+
+    c->tt = tt;
+    // Same model as the planets module.
+    eraEpv00(DJM0, tt, pvh, pvb);
+    vec3_mul(-1, pvh[0], c->sun);
+    moon_pos(DJM0 + tt, &lambda, &beta, &dist);
+    dist *= 1000.0 / DAU;
+    obl = eraObl06(DJM0, tt);
+    eraIr(rmatecl);
+    eraRx(-obl, rmatecl);
+    eraS2p(lambda, beta, dist, moon);
+    eraRxp(rmatecl, moon, moon);
+    eraPmat76(DJM0, tt, rmatp);
+    eraTrxp(rmatp, moon, c->moon);
+
+    // Rotate into the Earth fixed frame.
+    eraTtut1(DJM0, tt, deltat(tt), &ut11, &ut12);
+    eraC2i06a(DJM0, tt, rc2i);
+    eraIr(rpom);
+    eraC2tcio(rc2i, eraEra00(ut11, ut12), rpom, rc2t);
+    eraRxp(rc2t, c->sun, c->sun);
+    eraRxp(rc2t, c->moon, c->moon);
+
+    // Phase angle, and magnitude from the Astronomical Almanac formula.
+    vec3_sub(c->sun, c->moon, p);
+    vec3_mul(-1, c->moon, m);
+    phase = eraSepp(p, m) * DR2D;
+    c->moon_illumination = (1 + cos(phase * DD2R)) / 2;
+    c->moon_vmag = -12.73 + 0.026 * phase + 4E-9 * pow(phase, 4);
+    eraJd2cal(DJM0, tt, &c->year, &c->month, &day, &fd);
+}
+
+// Compute a row of the grid at a given time.  Can run in any thread.
+static void conditions_row(const conditions_t *c, int time, int row)
+{
+    const conditions_time_t *t = &c->times[time];
+    const float cos_max = cos(15. * DD2R); // As for the rendering.
+    const int ofs = (time * c->nb_lat + row) * c->nb_lon;
+    double lat, lon, pos[3], up[3], sun[3], moon[3], cs, cm;
+    skybrightness_t sb;
+    int i;
+
+    lat = mix(c->lat[0], c->lat[1], c->nb_lat > 1 ?
+              (double)row / (c->nb_lat - 1) : 0.5);
+    vec3_normalize(t->sun, sun);
+    for (i = 0; i < c->nb_lon; i++) {
+        lon = mix(c->lon[0], c->lon[1], c->nb_lon > 1 ?
+                  (double)i / (c->nb_lon - 1) : 0.5);
+        eraGd2gc(1, lon, lat, c->elevation, pos);
+        vec3_mul(1.0 / DAU, pos, pos);
+        vec3_sub(t->moon, pos, moon);
+        vec3_normalize(moon, moon);
+        vec3_set(up, cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat));
+        cs = vec3_dot(sun, up);
+        cm = vec3_dot(moon, up);
+        skybrightness_prepare(&sb, t->year, t->month, t->moon_vmag,
+                              lat, c->elevation, 15, 40, acos(cm), acos(cs));
+        c->sun_alt[ofs + i] = asin(cs);
+        c->moon_alt[ofs + i] = asin(cm);
+        c->lum[ofs + i] = skybrightness_get_luminance(
+                &sb, min(cm, cos_max), min(cs, cos_max), 1.0);
+    }
+}
+
+static void conditions_block(void *user, int start, int end)
+{
+    const conditions_t *c = USER_GET(user, 0);
+    int i;
+    for (i = start; i < end; i++)
+        conditions_row(c, i / c->nb_lat, i % c->nb_lat);
+}
+
+static json_value *float_array_json(const float *v, int n, double scale)
+{
+    json_value *ret = json_array_new(n);
+    int i;
+    for (i = 0; i < n; i++) json_array_push(ret, json_double_new(v[i] * scale));
+    return ret;
+}
+
+/*
+ * Function: compute_conditions_fn
+ * Compute the sky conditions over a grid of locations, at several times.
+ *
+ * The time dependent part (Earth position, precession-nutation, Sun and
+ * Moon positions) is computed once per time, and then each location only
+ * needs a rotation and the sky brightness model.  The rows of the grid are
+ * computed in parallel.  The altitudes are geometric, without refraction.
+ *
+ * The argument is an object with the optional attributes:
+ *   lat_min   - Min latitude (deg), default to -90.
+ *   lat_max   - Max latitude (deg), default to 90.
+ *   lon_min   - Min longitude (deg), default to -180.
+ *   lon_max   - Max longitude (deg), default to 180.
+ *   nb_lat    - Number of latitudes, default to 19.
+ *   nb_lon    - Number of longitudes, default to 37.
+ *   elevation - Elevation of all the locations (m), default to 0.
+ *   times     - Array of times (TT MJD), default to the observer time.
+ *
+ * Return:
+ *   An array with for each time an object of the form:
+ *   {time, moon_illumination, sun_alt, moon_alt, zenith_luminance}, where
+ *   the last three are arrays of the values at each location, row by row
+ *   from the min latitude, with the altitudes in degrees and the zenith
+ *   sky luminance in cd/m².
+ */
+static json_value *compute_conditions_fn(
+        obj_t *obj, const attribute_t *attr, const json_value *args)
+{
+    json_value *jargs = (json_value*)args, *jtimes, *ret, *val, *v;
+    conditions_t c = {};
+    int i, n, nb_times = 1;
+    double tt = core->observer->tt;
+
+    c.lat[0] = json_get_attr_f(jargs, "lat_min", -90) * DD2R;
+    c.lat[1] = json_get_attr_f(jargs, "lat_max", +90) * DD2R;
+    c.lon[0] = json_get_attr_f(jargs, "lon_min", -180) * DD2R;
+    c.lon[1] = json_get_attr_f(jargs, "lon_max", +180) * DD2R;
+    c.nb_lat = max(1, json_get_attr_f(jargs, "nb_lat", 19));
+    c.nb_lon = max(1, json_get_attr_f(jargs, "nb_lon", 37));
+    c.elevation = json_get_attr_f(jargs, "elevation", 0);
+    jtimes = json_get_attr(jargs, "times", json_array);
+    if (jtimes) nb_times = jtimes->u.array.length;
+
+    c.times = calloc(nb_times, sizeof(*c.times));
+    for (i = 0; i < nb_times; i++) {
+        v = jtimes ? jtimes->u.array.values[i] : NULL;
+        if (v && v->type == json_double) tt = v->u.dbl;
+        if (v && v->type == json_integer) tt = v->u.integer;
+        conditions_time_init(&c.times[i], tt);
+    }
+    n = c.nb_lat * c.nb_lon;
+    c.sun_alt = malloc(nb_times * n * sizeof(*c.sun_alt));
+    c.moon_alt = malloc(nb_times * n * sizeof(*c.moon_alt));
+    c.lum = malloc(nb_times * n * sizeof(*c.lum));
+    worker_parallel_for(nb_times * c.nb_lat, 1, USER_PASS(&c),
+                        conditions_block);
+
+    ret = json_array_new(nb_times);
+    for (i = 0; i < nb_times; i++) {
+        val = json_object_new(0);
+        json_object_push(val, "time", json_double_new(c.times[i].tt));
+        json_object_push(val, "moon_illumination",
+                         json_double_new(c.times[i].moon_illumination));
+        json_object_push(val, "sun_alt",
+                         float_array_json(c.sun_alt + i * n, n, DR2D));
+        json_object_push(val, "moon_alt",
+                         float_array_json(c.moon_alt + i * n, n, DR2D));
+        json_object_push(val, "zenith_luminance",
+                         float_array_json(c.lum + i * n, n, 1));
+        json_array_push(ret, val);
+    }
+    free(c.times);
+    free(c.sun_alt);
+    free(c.moon_alt);
+    free(c.lum);
+    return ret;
+}
+
 static void atmosphere_gui(obj_t *obj, int location)
 {
     atmosphere_t *atm = (void*)obj;
@@ -283,7 +569,7 @@ static void atmosphere_gui(obj_t *obj, int location)
 static obj_klass_t atmosphere_klass = {
     .id     = "atmosphere",
     .size   = sizeof(atmosphere_t),
-    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE,
+    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_UPDATE_PARALLEL,
     .init = atmosphere_init,
     .render = atmosphere_render,
     .update = atmosphere_update,
@@ -292,6 +578,7 @@ static obj_klass_t atmosphere_klass = {
     .attributes = (attribute_t[]) {
         PROPERTY(visible, TYPE_BOOL, MEMBER(atmosphere_t, visible.target)),
         PROPERTY(turbidity, TYPE_FLOAT, MEMBER(atmosphere_t, turbidity)),
+        FUNCTION(compute_conditions, .fn = compute_conditions_fn),
         {}
     },
 };
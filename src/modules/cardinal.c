@@ -96,7 +96,7 @@ static int cardinal_render(const obj_t *obj, const painter_t *painter)
 static obj_klass_t cardinal_klass = {
     .id = "cardinals",
     .size = sizeof(cardinal_t),
-    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE,
+    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_UPDATE_PARALLEL,
     .render = cardinal_render,
     .init   = cardinal_init,
     .update = cardinal_update,
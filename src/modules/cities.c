@@ -34,49 +34,263 @@ static obj_klass_t city_klass = {
 };
 OBJ_REGISTER(city_klass)
 
+
+// Size of the cities spatial index grid.
+#define GRID_W 72   // 5 deg cells.
+#define GRID_H 36
+
+/*
+ * Type: city_entry_t
+ * A city of the bundled database.
+ *
+ * The strings point into the module data block.  We only create the city
+ * objects for the entries that get returned by the module functions.
+ */
+typedef struct city_entry {
+    const char  *name;          // Upper case ascii name.
+    const char  *country_code;
+    const char  *timezone;
+    float       latitude;       // (rad)
+    float       longitude;      // (rad)
+    float       elevation;      // (m)
+    uint64_t    oid;
+} city_entry_t;
+
 typedef struct cities {
     obj_t       obj;
+    bool        loaded; // Set once the bundled cities have been parsed.
+    char        *data;  // All the entries strings.
+    int         nb;
+    city_entry_t *entries; // Sorted by name.
+    // Spatial index: the entries indices sorted by grid cell, and the start
+    // of each cell in this array.
+    int         *grid;
+    int         grid_start[GRID_W * GRID_H + 1];
 } cities_t;
 
-static int cities_init(obj_t *obj, json_value *args);
+static int cities_load(obj_t *obj);
+static void cities_del(obj_t *obj);
 static obj_t *cities_get(const obj_t *obj, const char *id, int flags);
 static obj_t *cities_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint);
 static obj_klass_t cities_klass = {
     .id = "cities",
     .size = sizeof(cities_t),
     .flags = OBJ_MODULE,
-    .init = cities_init,
+    .load = cities_load,
+    .del = cities_del,
     .get = cities_get,
     .get_by_oid = cities_get_by_oid,
 };
 
 OBJ_REGISTER(cities_klass)
 
-static void add_cities(cities_t *cities);
+static int grid_cell(double latitude, double longitude)
+{
+    int x, y;
+    x = floor((longitude + M_PI) / (2 * M_PI) * GRID_W);
+    y = floor((latitude + M_PI / 2) / M_PI * GRID_H);
+    x = (x % GRID_W + GRID_W) % GRID_W;
+    y = clamp(y, 0, GRID_H - 1);
+    return y * GRID_W + x;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+    const city_entry_t *e1 = a, *e2 = b;
+    return strcmp(e1->name, e2->name) ?:
+           strcmp(e1->country_code, e2->country_code);
+}
+
+// Parse the bundled cities and build the indices.
+static void add_cities(cities_t *cities)
+{
+    char *pos, *asciiname, *country_code, *timezone;
+    char id[256];
+    double lat, lon, el;
+    int i, n, cell, *count;
+    city_entry_t *e;
+
+    pos = cities->data = strdup(
+            asset_get_data("asset://cities.txt", NULL, NULL));
+    assert(pos);
+    for (n = 0, i = 0; pos[i]; i++) n += pos[i] == '\n';
+    cities->entries = calloc(n, sizeof(*cities->entries));
+
+    while (pos && *pos) {
+#define TOK(d, s) ({char *r = d; d = strchr(d, s); *d++ = '\0'; r;})
+        TOK(pos, '\t'); // name
+        asciiname = TOK(pos, '\t');
+        str_to_upper(asciiname, asciiname);
+        lat = atof(TOK(pos, '\t'));
+        lon = atof(TOK(pos, '\t'));
+        el = atof(TOK(pos, '\t'));
+        country_code = TOK(pos, '\t');
+        timezone = TOK(pos, '\n');
+#undef TOK
+        assert(cities->nb < n);
+        e = &cities->entries[cities->nb++];
+        e->name = asciiname;
+        e->country_code = country_code;
+        e->timezone = timezone;
+        e->latitude = lat * DD2R;
+        e->longitude = lon * DD2R;
+        e->elevation = el;
+        snprintf(id, sizeof(id), "CITY %s %s", country_code, asciiname);
+        e->oid = oid_create("CITY", crc32(0, (void*)id, strlen(id)));
+    }
+    qsort(cities->entries, cities->nb, sizeof(*cities->entries), entry_cmp);
+
+    // Counting sort of the entries by grid cell.
+    count = calloc(GRID_W * GRID_H, sizeof(*count));
+    for (i = 0; i < cities->nb; i++) {
+        e = &cities->entries[i];
+        count[grid_cell(e->latitude, e->longitude)]++;
+    }
+    for (i = 0; i < GRID_W * GRID_H; i++)
+        cities->grid_start[i + 1] = cities->grid_start[i] + count[i];
+    memset(count, 0, GRID_W * GRID_H * sizeof(*count));
+    cities->grid = malloc(cities->nb * sizeof(*cities->grid));
+    for (i = 0; i < cities->nb; i++) {
+        e = &cities->entries[i];
+        cell = grid_cell(e->latitude, e->longitude);
+        cities->grid[cities->grid_start[cell] + count[cell]++] = i;
+    }
+    free(count);
+}
 
-static int cities_init(obj_t *obj, json_value *args)
+// Parsing all the cities takes some time, so we only do it once the
+// module is first used, instead of at startup.
+static int cities_load(obj_t *obj)
 {
     cities_t *cities = (void*)obj;
+    if (cities->loaded) return 0;
+    cities->loaded = true;
     add_cities(cities);
-    return 0;
+    return 1;
+}
+
+static void cities_del(obj_t *obj)
+{
+    cities_t *cities = (void*)obj;
+    free(cities->data);
+    free(cities->entries);
+    free(cities->grid);
+}
+
+// Return the city object of an entry, creating it if needed.
+static obj_t *city_from_entry(cities_t *cities, const city_entry_t *e)
+{
+    char id[256];
+    city_t *city;
+
+    snprintf(id, sizeof(id), "CITY %s %s", e->country_code, e->name);
+    city = (city_t*)module_find_child(&cities->obj, id, -1);
+    if (city) return &city->obj;
+    city = (city_t*)obj_create("city", id, (obj_t*)cities, NULL);
+    city->obj.oid = e->oid;
+    snprintf(city->country_code, sizeof(city->country_code), "%s",
+             e->country_code);
+    city->timezone = strdup(e->timezone);
+    city->latitude = e->latitude;
+    city->longitude = e->longitude;
+    city->elevation = e->elevation;
+    return &city->obj;
+}
+
+// Return the index of the first entry whose name is not below a given
+// upper case name.
+static int entries_lower_bound(const cities_t *cities, const char *name)
+{
+    int i = 0, n = cities->nb, half;
+    while (n > 0) {
+        half = n / 2;
+        if (strcmp(cities->entries[i + half].name, name) < 0) {
+            i += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return i;
+}
+
+/*
+ * Find the nearest entry to a given position, in a given radius.
+ *
+ * We only check the grid cells that intersect the radius bounding box.
+ */
+static const city_entry_t *find_nearest(const cities_t *cities,
+                                        double latitude, double longitude,
+                                        double radius, double *dist)
+{
+    int x, y, x0, x1, y0, y1, i, cell;
+    double dlon, d;
+    const city_entry_t *e, *ret = NULL;
+
+    *dist = DBL_MAX;
+    y0 = grid_cell(latitude - radius, 0) / GRID_W;
+    y1 = grid_cell(latitude + radius, 0) / GRID_W;
+    x0 = 0;
+    x1 = GRID_W - 1;
+    if (fabs(latitude) + radius < M_PI / 2 && radius < M_PI / 2) {
+        dlon = asin(sin(radius) / cos(latitude));
+        x0 = floor((longitude - dlon + M_PI) / (2 * M_PI) * GRID_W);
+        x1 = floor((longitude + dlon + M_PI) / (2 * M_PI) * GRID_W);
+        if (x1 - x0 >= GRID_W) {
+            x0 = 0;
+            x1 = GRID_W - 1;
+        }
+    }
+    for (y = y0; y <= y1; y++) {
+        for (x = x0; x <= x1; x++) {
+            cell = y * GRID_W + (x % GRID_W + GRID_W) % GRID_W;
+            for (i = cities->grid_start[cell];
+                 i < cities->grid_start[cell + 1]; i++) {
+                e = &cities->entries[cities->grid[i]];
+                d = eraSeps(longitude, latitude, e->longitude, e->latitude);
+                if (d > radius || d >= *dist) continue;
+                *dist = d;
+                ret = e;
+            }
+        }
+    }
+    return ret;
 }
 
 static obj_t *cities_get(const obj_t *obj, const char *id, int flags)
 {
+    cities_t *cities = (void*)obj;
     obj_t *city;
+    const city_entry_t *e;
+    int i;
+
     if (!str_startswith(id, "CITY ")) return NULL;
-    DL_FOREACH(obj->children, city) {
-        if (strcmp(city->id, id) == 0) {
-            city->ref++; // XXX: make it singleton.
-            return city;
-        }
+    // Cities created by city_create or already returned.
+    city = module_find_child(obj, id, -1);
+    if (city) {
+        city->ref++; // XXX: make it singleton.
+        return city;
+    }
+    // Ids are 'CITY <country code> <name>'.
+    cities_load((obj_t*)obj);
+    if (strlen(id) < 9 || id[7] != ' ') return NULL;
+    for (i = entries_lower_bound(cities, id + 8); i < cities->nb; i++) {
+        e = &cities->entries[i];
+        if (strcmp(e->name, id + 8) != 0) break;
+        if (strncmp(e->country_code, id + 5, 2) != 0) continue;
+        city = city_from_entry(cities, e);
+        city->ref++;
+        return city;
     }
     return NULL;
 }
 
 static obj_t *cities_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint)
 {
+    cities_t *cities = (void*)obj;
     obj_t *city;
+    int i;
+
     if (!oid_is_catalog(oid, "CITY")) return NULL;
     DL_FOREACH(obj->children, city) {
         if (city->oid == oid) {
@@ -84,44 +298,85 @@ static obj_t *cities_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint)
             return city;
         }
     }
+    cities_load((obj_t*)obj);
+    for (i = 0; i < cities->nb; i++) {
+        if (cities->entries[i].oid != oid) continue;
+        city = city_from_entry(cities, &cities->entries[i]);
+        city->ref++;
+        return city;
+    }
     return NULL;
 }
 
-static void add_cities(cities_t *cities)
+/*
+ * Function: city_search
+ * Search the bundled cities whose name starts with a given prefix.
+ *
+ * The search is case insensitive, and the cities are returned sorted by
+ * name.
+ *
+ * Parameters:
+ *   prefix - Ascii name prefix.
+ *   max_nb - Maximum number of results.
+ *   user   - Data passed to the callback.
+ *   f      - Callback called for each city.  The city objects are owned by
+ *            the cities module.  Can return a non zero value to stop the
+ *            search.
+ *
+ * Return:
+ *   The number of cities passed to the callback.
+ */
+EMSCRIPTEN_KEEPALIVE
+int city_search(const char *prefix, int max_nb, void *user,
+                int (*f)(void *user, obj_t *city))
 {
-    char *data, *pos;
-    char *name, *asciiname, *country_code, *timezone;
-    char asciiname_upper[128], id[256];
-    double lat, lon, el;
-    city_t *city;
+    cities_t *cities = (void*)core_get_module("cities");
+    char name[128];
+    int i, len, nb = 0;
 
-    pos = data = strdup(asset_get_data("asset://cities.txt", NULL, NULL));
-    assert(pos);
-    while (pos && *pos) {
-#define TOK(d, s) ({char *r = d; d = strchr(d, s); *d++ = '\0'; r;})
-        name = TOK(pos, '\t');
-        (void)name;
-        asciiname = TOK(pos, '\t');
-        assert(strlen(asciiname) < sizeof(asciiname_upper));
-        str_to_upper(asciiname, asciiname_upper);
-        lat = atof(TOK(pos, '\t'));
-        lon = atof(TOK(pos, '\t'));
-        el = atof(TOK(pos, '\t'));
-        country_code = TOK(pos, '\t');
-        timezone = TOK(pos, '\n');
+    snprintf(name, sizeof(name), "%s", prefix);
+    str_to_upper(name, name);
+    len = strlen(name);
+    for (i = entries_lower_bound(cities, name);
+         i < cities->nb && nb < max_nb; i++) {
+        if (strncmp(cities->entries[i].name, name, len) != 0) break;
+        nb++;
+        if (f(user, city_from_entry(cities, &cities->entries[i]))) break;
+    }
+    return nb;
+}
 
-        snprintf(id, sizeof(id), "CITY %s %s", country_code, asciiname_upper);
-        city = (city_t*)obj_create("city", id, (obj_t*)cities, NULL);
-        city->obj.oid = oid_create("CITY", crc32(0, (void*)id, strlen(id)));
+/*
+ * Function: city_get_nearest
+ * Return the nearest bundled city from a given position.
+ *
+ * Parameters:
+ *   latitude   - Latitude (rad).
+ *   longitude  - Longitude (rad).
+ *   max_dist   - Maximum distance (km).
+ *
+ * Return:
+ *   The city object, owned by the cities module, or NULL if no city is
+ *   closer than max_dist.
+ */
+EMSCRIPTEN_KEEPALIVE
+obj_t *city_get_nearest(double latitude, double longitude, double max_dist)
+{
+    const double EARTH_RADIUS_KM = 6371;
+    cities_t *cities = (void*)core_get_module("cities");
+    const city_entry_t *e;
+    double dist, radius = 5 * DD2R;
 
-        strcpy(city->country_code, country_code);
-        city->timezone = strdup(timezone);
-        city->longitude = lon * DD2R;
-        city->latitude = lat * DD2R;
-        city->elevation = el;
-#undef TOK
+    max_dist = min(max_dist / EARTH_RADIUS_KM, M_PI);
+    // Increase the search radius until we find a city.  Any city closer
+    // would have been found in the same pass.
+    while (true) {
+        radius = min(radius, max_dist);
+        e = find_nearest(cities, latitude, longitude, radius, &dist);
+        if (e) return city_from_entry(cities, e);
+        if (radius >= max_dist) return NULL;
+        radius *= 2;
     }
-    free(data);
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -132,16 +387,18 @@ obj_t *city_create(const char *name, const char *country_code,
                    double elevation,
                    double nearby)
 {
-    obj_t *cities = core_get_module("cities");
-    char id[256], asciiname_upper[256];
-    double dist, best_dist = FLT_MAX;
+    cities_t *cities = (void*)core_get_module("cities");
+    char id[256];
+    double dist, best_dist = DBL_MAX;
     const double EARTH_RADIUS_KM = 6371;
     city_t *city, *best = NULL;
+    const city_entry_t *e;
     if (isnan(elevation)) elevation = 0;
 
     snprintf(id, sizeof(id), "CITY %s %s", country_code, name);
     str_to_upper(id, id);
-    // First search for a nearby city.
+    // First search for a nearby city, either already created, or in the
+    // bundled database.
     if (!isnan(nearby)) {
         MODULE_ITER(cities, city, "city") {
             dist = EARTH_RADIUS_KM *
@@ -156,6 +413,10 @@ obj_t *city_create(const char *name, const char *country_code,
                 best = city;
             }
         }
+        e = find_nearest(cities, latitude, longitude,
+                         min(nearby / EARTH_RADIUS_KM, M_PI), &dist);
+        if (e && dist * EARTH_RADIUS_KM < best_dist)
+            best = (city_t*)city_from_entry(cities, e);
     }
     if (best) return &best->obj;
 
@@ -165,28 +426,43 @@ obj_t *city_create(const char *name, const char *country_code,
     city->latitude = latitude;
     city->longitude = longitude;
     city->elevation = elevation;
-    str_to_upper(name, asciiname_upper);
     city->obj.oid = oid_create("CITY", crc32(0, (void*)id, strlen(id)));
     return &city->obj;
 }
 
 #if COMPILE_TESTS
 
+static int test_search_callback(void *user, obj_t *city)
+{
+    (*(int*)user)++;
+    return 0;
+}
+
 static void test_cities(void)
 {
     obj_t *cities, *city;
     const char tz[64];
     double lat;
+    int nb = 0;
 
     core_init(100, 100, 1.0);
     cities = core_get_module("cities");
     assert(cities);
-    city = module_get_child(cities, "CITY GB LONDON");
+    city = obj_get(cities, "CITY GB LONDON", 0);
     assert(city);
     obj_get_attr(city, "timezone", tz);
     test_str(tz, "Europe/London");
     obj_get_attr(city, "latitude", &lat);
     assert(fabs(lat * DR2D - 51.50853) < 0.01);
+    assert(obj_get_by_oid(cities, city->oid, 0) == city);
+    obj_release(city);
+    obj_release(city);
+
+    assert(city_search("lond", 10, &nb, test_search_callback) >= 1);
+    assert(nb >= 1);
+    city = city_get_nearest(51.5 * DD2R, -0.1 * DD2R, 100);
+    assert(city && strcmp(city->id, "CITY GB LONDON") == 0);
+
     city = city_create("taipei", "TW", NULL,
                        25.09319 * DD2R, 121.558442 * DD2R, 0, 100);
     assert(city);
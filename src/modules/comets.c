@@ -22,35 +22,76 @@ typedef struct orbit_t {
 } orbit_t;
 
 /*
- * Type: comet_t
- * Object that represents a single comet
+ * Type: comet_data_t
+ * Data of a single comet, as stored in the module table.
  */
 typedef struct {
-    obj_t       obj;
+    uint64_t    oid;
+    char        type[4];
     int         num;
     double      amag;
     double      slope_param;
     orbit_t     orbit;
-    char        name[64]; // e.g 'C/1995 O1 (Hale-Bopp)'
-    bool        on_screen;  // Set once the object has been visible.
+    const char  *name; // e.g 'C/1995 O1 (Hale-Bopp)'
 
     // Cached values.
+    uint64_t    obs_hash; // Hash of the observer of the last update.
     double      vmag;
     double      pvo[2][4];
+} comet_data_t;
+
+/*
+ * Type: comet_t
+ * Object that represents a single comet
+ *
+ * Only created on demand from the module table.
+ */
+typedef struct {
+    obj_t           obj;
+    comet_data_t    data;
 } comet_t;
 
 /*
  * Type: comet_t
  * Comets module object
+ *
+ * The orbits of the elliptical comets are also stored as arrays of orbit
+ * elements, so that we can compute all their positions in batch when the
+ * observer changes.
  */
 typedef struct {
     obj_t   obj;
     char    *source_url;
     bool    parsed; // Set to true once the data has been parsed.
-    int     update_pos; // Index of the position for iterative update.
     regex_t search_reg;
+    int     nb;
+    comet_data_t *comets;
+
+    int     nb_elliptical;
+    int     *elliptical; // Index of the elliptical comets in the table.
+    struct {
+        float *d, *i, *o, *w, *a, *n, *e, *m;
+    } orbits;
+    uint64_t obs_hash; // Hash of the observer of the last batch update.
 } comets_t;
 
+// Precision of the Kepler equation solver (rad).
+#define KEPLER_PRECISION (0.005 * DD2R)
+
+// Number of comets per batch update call.
+#define UPDATE_BLOCK_SIZE 256
+
+// Max number of points painted at once.
+#define RENDER_BLOCK_SIZE 256
+
+// Epoch of the batch orbit elements (MJD).  The time of perihelion is
+// converted into a mean anomaly at this date, so that we don't lose
+// precision by storing it as a float.
+#define ORBITS_EPOCH 60000.0
+
+// Max eccentricity of the orbits we compute with the Kepler solver.
+#define MAX_ELLIPTICAL_E 0.98
+
 
 static const char *orbit_type_to_otype(char o)
 {
@@ -65,15 +106,24 @@ static const char *orbit_type_to_otype(char o)
     }
 }
 
-static void load_data(comets_t *comets, const char *data, int size)
+static comet_t *comet_create(const comet_data_t *data)
 {
     comet_t *comet;
-    int num, nb_err = 0, len, line_idx = 0, r, nb;
+    comet = (comet_t*)obj_create("mpc_comet", NULL, NULL, NULL);
+    comet->data = *data;
+    strncpy(comet->obj.type, data->type, 4);
+    comet->obj.oid = data->oid;
+    return comet;
+}
+
+static void load_data(comets_t *comets, const char *data, int size)
+{
+    comet_data_t *comet;
+    int num, nb_err = 0, len, line_idx = 0, r, capacity = 0;
     double peri_time, peri_dist, e, peri, node, i, epoch, h, g;
     const char *line = NULL;
     char orbit_type;
     char desgn[64];
-    obj_t *tmp;
 
     while (iter_lines(data, size, &line, &len)) {
         line_idx++;
@@ -85,7 +135,13 @@ static void load_data(comets_t *comets, const char *data, int size)
             continue;
         }
 
-        comet = (void*)obj_create("mpc_comet", NULL, &comets->obj, NULL);
+        if (comets->nb >= capacity) {
+            capacity = max(capacity * 2, 1024);
+            comets->comets = realloc(comets->comets,
+                                     capacity * sizeof(*comets->comets));
+        }
+        comet = &comets->comets[comets->nb++];
+        memset(comet, 0, sizeof(*comet));
         comet->num = num;
         comet->amag = h;
         comet->slope_param = g;
@@ -95,26 +151,88 @@ static void load_data(comets_t *comets, const char *data, int size)
         comet->orbit.w = peri * DD2R;
         comet->orbit.q = peri_dist;
         comet->orbit.e = e;
-        strncpy(comet->obj.type, orbit_type_to_otype(orbit_type), 4);
-        strcpy(comet->name, desgn);
-        comet->obj.oid = oid_create("Com", line_idx);
+        strncpy(comet->type, orbit_type_to_otype(orbit_type), 4);
+        comet->name = strdup(desgn);
+        comet->oid = oid_create("Com", line_idx);
         comet->pvo[0][0] = NAN;
+        module_register_oid(&comets->obj, comet->oid, comets->nb);
+        search_add(&comets->obj, comet->name, comet->oid, comets->nb);
     }
 
     if (nb_err) {
         LOG_W("Comet planet data got %d error lines.", nb_err);
     }
-    DL_COUNT(comets->obj.children, tmp, nb);
-    LOG_I("Parsed %d comets", nb);
+    LOG_I("Parsed %d comets", comets->nb);
 }
 
-static int comet_update(comet_t *comet, const observer_t *obs)
+// Fill the batch orbit elements arrays from the comets table.
+static void init_orbits(comets_t *comets)
 {
-    double a, p, n, ph[2][3], pv[2][3], or, sr, b, v, w, r, o, u, i;
+    int i, k, nb = 0;
+    double a, n;
+    const comet_data_t *comet;
     const double K = 0.01720209895; // AU, day
 
+    comets->elliptical = calloc(comets->nb, sizeof(*comets->elliptical));
+    #define X(f) comets->orbits.f = calloc(comets->nb, sizeof(float))
+    X(d); X(i); X(o); X(w); X(a); X(n); X(e); X(m);
+    #undef X
+
+    for (i = 0; i < comets->nb; i++) {
+        comet = &comets->comets[i];
+        if (comet->orbit.e >= MAX_ELLIPTICAL_E) continue;
+        a = comet->orbit.q / (1.0 - comet->orbit.e);
+        n = K / sqrt(a * a * a);
+        k = nb++;
+        comets->elliptical[k] = i;
+        comets->orbits.d[k] = ORBITS_EPOCH;
+        comets->orbits.i[k] = comet->orbit.i;
+        comets->orbits.o[k] = comet->orbit.o;
+        comets->orbits.w[k] = comet->orbit.w;
+        comets->orbits.a[k] = a;
+        comets->orbits.n[k] = n;
+        comets->orbits.e[k] = comet->orbit.e;
+        comets->orbits.m[k] = fmod(n * (ORBITS_EPOCH - comet->orbit.d),
+                                   2 * M_PI);
+    }
+    comets->nb_elliptical = nb;
+}
+
+/*
+ * Compute the apparent position and the magnitude of a comet from its
+ * heliocentric ecliptic position.
+ */
+static void compute_apparent(comet_data_t *comet, const observer_t *obs,
+                             const double pos[3])
+{
+    double ph[2][3], pv[2][3], or, sr;
+
+    mat3_mul_vec3(obs->re2i, pos, ph[0]);
+    vec3_set(ph[1], 0, 0, 0);
+    position_to_apparent(obs, ORIGIN_HELIOCENTRIC, false, ph, pv);
+    vec3_copy(pv[0], comet->pvo[0]);
+    comet->pvo[0][3] = 1;
+    vec3_copy(pv[1], comet->pvo[1]);
+    comet->pvo[1][3] = 0;
+
+    // Compute vmag.
+    // We use the g,k model: m = g + 5*log10(D) + 2.5*k*log10(r)
+    // (http://www.clearskyinstitute.com/xephem/help/xephem.html)
+    sr = vec3_norm(ph[0]);
+    or = vec3_norm(comet->pvo[0]);
+    comet->vmag = comet->amag + 5 * log10(or) +
+                      2.5 * comet->slope_param * log10(sr);
+    comet->obs_hash = obs->hash_pos;
+}
+
+static int comet_update(comet_data_t *comet, const observer_t *obs)
+{
+    double a, p, n, ph[3], b, v, w, r, o, u, i;
+    const double K = 0.01720209895; // AU, day
+
+    if (comet->obs_hash == obs->hash_pos) return 0;
     // Position algo for elliptical comets.
-    if (comet->orbit.e < 0.98) {
+    if (comet->orbit.e < MAX_ELLIPTICAL_E) {
         // Mean distance.
         a = comet->orbit.q / (1.0 - comet->orbit.e);
         // Orbital period.
@@ -122,8 +240,8 @@ static int comet_update(comet_t *comet, const observer_t *obs)
         // Daily motion.
         n = 2 * M_PI / p;
 
-        orbit_compute_pv(0.005 * DD2R,
-                         obs->tt, ph[0], NULL, comet->orbit.d, comet->orbit.i,
+        orbit_compute_pv(KEPLER_PRECISION,
+                         obs->tt, ph, NULL, comet->orbit.d, comet->orbit.i,
                          comet->orbit.o, comet->orbit.w, a, n, comet->orbit.e,
                          0, 0, 0);
     } else {
@@ -140,34 +258,77 @@ static int comet_update(comet_t *comet, const observer_t *obs)
         o = comet->orbit.o;
         u = v + comet->orbit.w;
         i = comet->orbit.i;
-        ph[0][0] = r * (cos(o) * cos(u) - sin(o) * sin(u) * cos(i));
-        ph[0][1] = r * (sin(o) * cos(u) + cos(o) * sin(u) * cos(i));
-        ph[0][2] = r * (sin(u) * sin(i));
+        ph[0] = r * (cos(o) * cos(u) - sin(o) * sin(u) * cos(i));
+        ph[1] = r * (sin(o) * cos(u) + cos(o) * sin(u) * cos(i));
+        ph[2] = r * (sin(u) * sin(i));
     }
 
-    mat3_mul_vec3(obs->re2i, ph[0], ph[0]);
+    compute_apparent(comet, obs, ph);
+    return 0;
+}
 
-    vec3_set(ph[1], 0, 0, 0);
-    position_to_apparent(obs, ORIGIN_HELIOCENTRIC, false, ph, pv);
-    vec3_copy(pv[0], comet->pvo[0]);
-    comet->pvo[0][3] = 1;
-    vec3_copy(pv[1], comet->pvo[1]);
-    comet->pvo[1][3] = 0;
+// Update a range of the elliptical comets.  Can run in any thread.
+static void update_block(void *user, int start, int end)
+{
+    comets_t *comets = USER_GET(user, 0);
+    const observer_t *obs = USER_GET(user, 1);
+    int i, nb = end - start;
+    double pos[UPDATE_BLOCK_SIZE][3];
+
+    assert(nb <= UPDATE_BLOCK_SIZE);
+    orbit_compute_pv_batch(KEPLER_PRECISION, obs->tt, nb,
+            comets->orbits.d + start, comets->orbits.i + start,
+            comets->orbits.o + start, comets->orbits.w + start,
+            comets->orbits.a + start, comets->orbits.n + start,
+            comets->orbits.e + start, comets->orbits.m + start,
+            pos, NULL);
+    for (i = 0; i < nb; i++) {
+        compute_apparent(&comets->comets[comets->elliptical[start + i]],
+                         obs, pos[i]);
+    }
+}
 
-    // Compute vmag.
-    // We use the g,k model: m = g + 5*log10(D) + 2.5*k*log10(r)
-    // (http://www.clearskyinstitute.com/xephem/help/xephem.html)
-    sr = vec3_norm(ph[0]);
-    or = vec3_norm(comet->pvo[0]);
-    comet->vmag = comet->amag + 5 * log10(or) +
-                      2.5 * comet->slope_param * log10(sr);
-    return 0;
+// Update the positions of the non elliptical comets.
+static void update_others(comets_t *comets, const observer_t *obs)
+{
+    int i;
+    for (i = 0; i < comets->nb; i++) {
+        if (comets->comets[i].orbit.e >= MAX_ELLIPTICAL_E)
+            comet_update(&comets->comets[i], obs);
+    }
+}
+
+// Update the positions of all the comets for a given observer.
+static void comets_update_all(comets_t *comets, const observer_t *obs)
+{
+    if (comets->obs_hash == obs->hash_pos) return;
+    worker_parallel_for(comets->nb_elliptical, UPDATE_BLOCK_SIZE,
+                        USER_PASS(comets, obs), update_block);
+    update_others(comets, obs);
+    comets->obs_hash = obs->hash_pos;
+}
+
+static int comets_prepare(const obj_t *obj, const painter_t *painter,
+                          render_task_t *task)
+{
+    comets_t *comets = (void*)obj;
+    const observer_t *obs = painter->obs;
+
+    if (comets->obs_hash == obs->hash_pos) return 0;
+    update_others(comets, obs);
+    *task = (render_task_t) {
+        .n = comets->nb_elliptical, .block = UPDATE_BLOCK_SIZE,
+        .args = {comets, (void*)obs}, .fn = update_block,
+    };
+    // All the tasks are done before the render.
+    comets->obs_hash = obs->hash_pos;
+    return 1;
 }
 
 static int comet_get_info(const obj_t *obj, const observer_t *obs, int info,
                           void *out)
 {
-    comet_t *comet = (comet_t*)obj;
+    comet_data_t *comet = &((comet_t*)obj)->data;
     comet_update(comet, obs);
     switch (info) {
     case INFO_PVO:
@@ -185,35 +346,41 @@ void comet_get_designations(
     int (*f)(const obj_t *obj, void *user, const char *cat, const char *str))
 {
     comet_t *comet = (void*)obj;
-    f(obj, user, "NAME", comet->name);
+    f(obj, user, "NAME", comet->data.name);
 }
 
 
-static int comet_render(const obj_t *obj, const painter_t *painter)
+/*
+ * Compute the point of a comet and add its label if needed.
+ *
+ * Return false if the comet is not visible.
+ */
+static bool get_point(const comet_data_t *comet, const painter_t *painter,
+                      point_t *point)
 {
     double win_pos[2], vmag, size, luminance;
-    comet_t *comet = (comet_t*)obj;
-    point_t point;
     double label_color[4] = RGBA(255, 124, 124, 255);
-    const bool selected = core->selection && obj->oid == core->selection->oid;
+    const bool selected = core->selection &&
+                          comet->oid == core->selection->oid;
     vmag = comet->vmag;
 
-    if (vmag > painter->stars_limit_mag) return 0;
-    if (isnan(comet->pvo[0][0])) return 0; // For the moment!
+    if (vmag > painter->stars_limit_mag) return false;
+    if (isnan(comet->pvo[0][0])) return false; // For the moment!
+    if (painter_is_point_clipped_fast(painter, FRAME_ICRF, comet->pvo[0],
+                                      false))
+        return false;
     if (!painter_project(painter, FRAME_ICRF, comet->pvo[0], false, true,
                          win_pos))
-        return 0;
+        return false;
 
-    comet->on_screen = true;
     core_get_point_for_mag(vmag, &size, &luminance);
 
-    point = (point_t) {
+    *point = (point_t) {
         .pos = {win_pos[0], win_pos[1]},
         .size = size,
         .color = {255, 255, 255, luminance * 255},
-        .oid = obj->oid,
+        .oid = comet->oid,
     };
-    paint_2d_points(painter, 1, &point);
 
     // Render name if needed.
     if (*comet->name && (selected || vmag < painter->hints_limit_mag)) {
@@ -222,8 +389,16 @@ static int comet_render(const obj_t *obj, const painter_t *painter)
         labels_add_3d(comet->name, FRAME_ICRF, comet->pvo[0], false, size,
             FONT_SIZE_BASE, label_color, 0, LABEL_AROUND,
             selected ? TEXT_BOLD : 0,
-            0, obj->oid);
+            0, comet->oid);
     }
+    return true;
+}
+
+static int comet_render(const obj_t *obj, const painter_t *painter)
+{
+    point_t point;
+    if (get_point(&((comet_t*)obj)->data, painter, &point))
+        paint_2d_points(painter, 1, &point);
     return 0;
 }
 
@@ -245,12 +420,6 @@ static int comets_add_data_source(
     return 0;
 }
 
-static bool range_contains(int range_start, int range_size, int nb, int i)
-{
-    if (i < range_start) i += nb;
-    return i > range_start && i < range_start + range_size;
-}
-
 static int comets_update(obj_t *obj, double dt)
 {
     PROFILE(comets_update, 0);
@@ -268,6 +437,7 @@ static int comets_update(obj_t *obj, double dt)
             return 0;
         }
         load_data(comets, data, size);
+        init_orbits(comets);
         asset_release(comets->source_url);
         // Make sure the search work.
         assert(strcmp(obj_get(NULL, "C/1995 O1", 0)->klass->id,
@@ -283,38 +453,31 @@ static int comets_render(const obj_t *obj, const painter_t *painter)
 {
     PROFILE(comets_render, 0);
     comets_t *comets = (void*)obj;
-    comet_t *child;
-    obj_t *tmp;
-    const int update_nb = 32;
-    int nb, i;
-
-    /* To prevent spending too much time computing position of comets that
-     * are not visible, we only render a small number of them at each
-     * frame, using a moving range.  The comets who have been flagged as
-     * on screen get rendered no matter what.  */
-    DL_COUNT(obj->children, tmp, nb);
-    i = 0;
-    MODULE_ITER(obj, child, "mpc_comet") {
-        if (child->on_screen ||
-                range_contains(comets->update_pos, update_nb, nb, i)) {
-            obj_render(&child->obj, painter);
-        }
-        i++;
+    int i, nb = 0;
+    point_t points[RENDER_BLOCK_SIZE];
+
+    comets_update_all(comets, painter->obs);
+    for (i = 0; i < comets->nb; i++) {
+        if (!get_point(&comets->comets[i], painter, &points[nb])) continue;
+        if (++nb < RENDER_BLOCK_SIZE) continue;
+        paint_2d_points(painter, nb, points);
+        nb = 0;
     }
-    comets->update_pos = nb ? (comets->update_pos + update_nb) % nb : 0;
-
+    if (nb) paint_2d_points(painter, nb, points);
     return 0;
 }
 
 static obj_t *comets_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint)
 {
-    obj_t *child;
+    const comets_t *comets = (void*)obj;
+    int i;
     if (!oid_is_catalog(oid, "Com")) return NULL;
-    MODULE_ITER(obj, child, NULL) {
-        if (child->oid == oid) {
-            child->ref++;
-            return child;
-        }
+    // Hint from the oid index: comet index + 1.
+    if (hint && hint <= comets->nb && comets->comets[hint - 1].oid == oid)
+        return (obj_t*)comet_create(&comets->comets[hint - 1]);
+    for (i = 0; i < comets->nb; i++) {
+        if (comets->comets[i].oid == oid)
+            return (obj_t*)comet_create(&comets->comets[i]);
     }
     return NULL;
 }
@@ -322,20 +485,37 @@ static obj_t *comets_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint)
 static obj_t *comets_get(const obj_t *obj, const char *id, int flags)
 {
     comets_t *comets = (comets_t*)obj;
-    comet_t *child;
     regmatch_t matches[3];
-    int r;
+    int r, i;
     r = regexec(&comets->search_reg, id, 3, matches, 0);
     if (r) return NULL;
-    MODULE_ITER(obj, child, "mpc_comet") {
-        if (str_startswith(child->name, id)) {
-            child->obj.ref++;
-            return &child->obj;
-        }
+    for (i = 0; i < comets->nb; i++) {
+        if (str_startswith(comets->comets[i].name, id))
+            return (obj_t*)comet_create(&comets->comets[i]);
     }
     return NULL;
 }
 
+static int comets_list(const obj_t *obj, observer_t *obs,
+                       double max_mag, uint64_t hint, void *user,
+                       int (*f)(void *user, obj_t *obj))
+{
+    comets_t *comets = (void*)obj;
+    comet_t *comet;
+    int i, r;
+
+    comets_update_all(comets, obs);
+    for (i = 0; i < comets->nb; i++) {
+        if (comets->comets[i].vmag > max_mag) continue;
+        if (!f) continue;
+        comet = comet_create(&comets->comets[i]);
+        r = f(user, &comet->obj);
+        obj_release(&comet->obj);
+        if (r) break;
+    }
+    return 0;
+}
+
 /*
  * Meta class declarations.
  */
@@ -356,9 +536,11 @@ static obj_klass_t comets_klass = {
     .init           = comets_init,
     .add_data_source = comets_add_data_source,
     .update         = comets_update,
+    .prepare        = comets_prepare,
     .render         = comets_render,
     .get            = comets_get,
     .get_by_oid     = comets_get_by_oid,
+    .list           = comets_list,
     .render_order   = 20,
 };
 OBJ_REGISTER(comets_klass)
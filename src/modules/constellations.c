@@ -41,8 +41,15 @@ typedef struct constellation {
     fader_t     visible;    // When the constellation is actually visible.
     fader_t     image_loaded_fader;
     obj_t       **stars;
-    // Texture and associated anchors and transformation matrix.
+    // Texture and associated anchors and transformation matrix.  The
+    // texture is only loaded once visible, with a size that depends on
+    // the size on screen.
+    char        *img_path;
     texture_t   *img;
+    texture_t   *img_next;      // Bigger version of img being loaded.
+    int         img_wanted_size; // Texture max_size we want, 0 for full.
+    double      img_priority;   // Loading priority, lower first.
+    bool        img_used;       // Set if the image got rendered.
     anchor_t    anchors[3];
     double      mat[3][3];
     // Set to true if the img matrix need to be rescaled to the image size.
@@ -51,8 +58,24 @@ typedef struct constellation {
     bool        img_need_rescale;
 
     int         error; // Set if we couldn't parse the stars.
-    double last_update; // Last update time in TT
+    // Cached ICRF unit vectors and magnitudes of the stars, so that we
+    // don't have to get them from the stars at each frame.
+    double      (*stars_pos)[4];
+    double      *stars_vmag;
+    double      stars_tt; // Time of the cached positions (TT MJD).
     double bounding_cap[4]; // Bounding cap in ICRS
+    // Cap containing everything we render: lines, boundaries and image.
+    double      render_cap[4];
+    bool        render_cap_dirty;
+
+    // Tesselated boundaries, built once and kept on the GPU.
+    struct {
+        double      (*verts)[3];
+        uint16_t    *indices;
+        int         verts_count;
+        int         indices_count;
+        double      cap[4];
+    } bounds_mesh;
 
     double pvo[2][4];
 } constellation_t;
@@ -69,9 +92,31 @@ typedef struct constellations {
     fader_t     bounds_visible;
     bool        show_all;
     int         labels_display_style;
+    job_t       stars_job; // Resolution of the constellations stars.
+    // Constellations that want a bigger art texture in the current frame.
+    struct {
+        constellation_t **list;
+        int             nb;
+        int             allocated;
+    } art_queue;
 } constellations_t;
 
+// Max number of art textures we load at the same time.
+#define ART_MAX_LOADS 2
+// Range of the reduced art textures sizes (pixel).  Above the max we load
+// the full image.
+#define ART_MIN_SIZE 256
+#define ART_MAX_SIZE 4096
+// GPU memory used by the art above which we release the images that are
+// not rendered anymore (bytes).
+#define ART_MEMORY_BUDGET (128 * 1024 * 1024)
+
+// Max time difference before we recompute the stars positions (day).  The
+// stars proper motions are too small to be visible over this time.
+#define STARS_CACHE_MAX_AGE 365.0
+
 static int constellation_update(constellation_t *con, const observer_t *obs);
+static void build_bounds_mesh(constellation_t *con);
 
 
 // Test if a shape in clipping coordinates is clipped or not.
@@ -173,6 +218,30 @@ static int constellation_create_stars(constellation_t *cons)
     return err;
 }
 
+/*
+ * Resolve the stars of the constellations a few constellations at a time,
+ * since getting a star can require to load its tile synchronously.
+ */
+static int resolve_stars_job(job_t *job, double deadline)
+{
+    constellations_t *csts = job->user;
+    constellation_t *con;
+    MODULE_ITER(csts, con, "constellation") {
+        if (con->stars || con->error) continue;
+        con->error = constellation_create_stars(con);
+        if (sys_get_unix_time() >= deadline) return 0;
+    }
+    return 1;
+}
+
+// Make sure the stars resolution job is queued.
+static void request_stars(constellations_t *csts)
+{
+    if (csts->stars_job.fn && !job_iter(&csts->stars_job)) return;
+    job_init(&csts->stars_job, resolve_stars_job, csts, 0);
+    job_iter(&csts->stars_job);
+}
+
 static int compute_img_mat(const anchor_t anchors[static 3], double mat[3][3])
 {
     int i, r;
@@ -226,23 +295,23 @@ int constellation_set_image(obj_t *obj, const json_value *args)
     constellation_t *cons = (void*)obj;
     char path[1024];
 
-    if (cons->img) return 0; // Already set.
+    if (cons->img_path) return 0; // Already set.
     img = json_get_attr_s(args, "img");
     anchors = json_get_attr_s(args, "anchors");
     base_path = json_get_attr_s(args, "base_path");
 
     if (parse_anchors(anchors, cons->anchors) != 0) goto error;
     join_path(base_path, img, path, sizeof(path));
-    cons->img = texture_from_url(path, TF_LAZY_LOAD);
+    cons->img_path = strdup(path);
     if (json_get_attr_b(args, "uv_in_pixel", false))
         cons->img_need_rescale = true;
-    assert(cons->img);
     // Compute the image transformation matrix
     int err = compute_img_mat(cons->anchors, cons->mat);
     if (err)
         cons->error = -1;
     cons->image_loaded_fader.target = false;
     cons->image_loaded_fader.value = 0;
+    cons->render_cap_dirty = true;
     return 0;
 
 error:
@@ -287,34 +356,109 @@ static void line_animation_effect(double pos[2][4], double k)
     vec3_normalize(p, pos[1]);
 }
 
+/*
+ * Update the cached positions of the constellation stars if the observer
+ * time changed by more than STARS_CACHE_MAX_AGE.
+ *
+ * Return:
+ *   true if the cache has been updated.
+ */
+static bool update_stars_cache(constellation_t *con, const observer_t *obs)
+{
+    int i;
+    double pvo[2][4];
+
+    if (con->stars_pos && fabs(obs->tt - con->stars_tt) < STARS_CACHE_MAX_AGE)
+        return false;
+    if (!con->stars_pos) {
+        con->stars_pos = calloc(con->count, sizeof(*con->stars_pos));
+        con->stars_vmag = calloc(con->count, sizeof(*con->stars_vmag));
+        for (i = 0; i < con->count; i++)
+            obj_get_info(con->stars[i], obs, INFO_VMAG, &con->stars_vmag[i]);
+    }
+    for (i = 0; i < con->count; i++) {
+        obj_get_pvo(con->stars[i], obs, pvo);
+        vec3_normalize(pvo[0], con->stars_pos[i]);
+        con->stars_pos[i][3] = 0; // At infinity.
+    }
+    con->stars_tt = obs->tt;
+    return true;
+}
+
+// Number of points per side of the image grid used for the render cap.
+#define RENDER_CAP_IMG_SPLIT 4
+
+/*
+ * Compute the cap containing the lines, the boundaries and the image, so
+ * that we can skip the constellations outside of the screen with a single
+ * cap test.
+ */
+static void update_render_cap(constellation_t *con)
+{
+    const int n = RENDER_CAP_IMG_SPLIT + 1;
+    int i, nb = 0;
+    double (*points)[3], uv[3], *cap = con->render_cap;
+    const bool has_img = con->img_path && con->mat[2][2] &&
+                         !con->img_need_rescale;
+
+    if (!con->bounds_mesh.verts) build_bounds_mesh(con);
+    points = calloc(con->count + con->bounds_mesh.verts_count + n * n,
+                    sizeof(*points));
+    for (i = 0; i < con->count; i++)
+        vec3_copy(con->stars_pos[i], points[nb++]);
+    for (i = 0; i < con->bounds_mesh.verts_count; i++)
+        vec3_copy(con->bounds_mesh.verts[i], points[nb++]);
+    for (i = 0; has_img && i < n * n; i++) {
+        vec3_set(uv, (double)(i % n) / (n - 1), (double)(i / n) / (n - 1), 1);
+        mat3_mul_vec3(con->mat, uv, points[nb]);
+        vec3_normalize(points[nb], points[nb]);
+        nb++;
+    }
+
+    vec4_set(cap, 0, 0, 0, 1);
+    for (i = 0; i < nb; i++) vec3_add(cap, points[i], cap);
+    if (!nb || !vec3_norm2(cap)) {
+        vec4_set(cap, 1, 0, 0, -1); // Full sky.
+    } else {
+        vec3_normalize(cap, cap);
+        for (i = 0; i < nb; i++) cap[3] = min(cap[3], vec3_dot(cap, points[i]));
+        // Small margin for the curvature of the lines between the points.
+        cap[3] = cos(min(acos(clamp(cap[3], -1, 1)) + 1.0 * DD2R, M_PI));
+    }
+    free(points);
+    con->render_cap_dirty = false;
+}
+
 static int constellation_update(constellation_t *con, const observer_t *obs)
 {
     // The position of a constellation is its middle point.
     constellations_t *cons = (constellations_t*)con->obj.parent;
-    double pvo[2][4], pos[4] = {0, 0, 0, 0}, max_cosdist, d;
+    double pos[4] = {0, 0, 0, 0}, max_cosdist, d;
     int i, err;
     if (con->error) return 0;
     // Optimization: don't update invisible constellation.
     if (!con->show) goto end;
 
-    err = constellation_create_stars(con);
-    if (err) {
-        con->error = err;
-        return 0;
+    if (!con->stars) {
+        // Without the module we can only resolve the stars now.
+        if (!cons) {
+            err = constellation_create_stars(con);
+            if (err) {
+                con->error = err;
+                return 0;
+            }
+        } else {
+            request_stars(cons);
+            return 0;
+        }
     }
     if (con->count == 0) return 0;
 
-    if (obs->tt - con->last_update < 1.0) {
-        // Constellation shape change cannot be seen over the course of
-        // one day
-        goto end;
-    }
-    con->last_update = obs->tt;
+    // Constellation shape change cannot be seen unless the stars moved.
+    if (!update_stars_cache(con, obs)) goto end;
 
-    for (i = 0; i < con->count; i++) {
-        obj_get_pvo(con->stars[i], obs, pvo);
-        vec3_add(pos, pvo[0], pos);
-    }
+    for (i = 0; i < con->count; i++)
+        vec3_add(pos, con->stars_pos[i], pos);
     vec3_normalize(pos, pos);
     vec3_copy(pos, con->pvo[0]);
     con->pvo[0][3] = 0; // At infinity.
@@ -325,20 +469,22 @@ static int constellation_update(constellation_t *con, const observer_t *obs)
     max_cosdist = 1.0;
 
     for (i = 0; i < con->count; i++) {
-        obj_get_pvo(con->stars[i], obs, pvo);
-        d = vec3_dot(con->bounding_cap, pvo[0]);
+        d = vec3_dot(con->bounding_cap, con->stars_pos[i]);
         max_cosdist = min(max_cosdist, d);
     }
     con->bounding_cap[3] = max_cosdist;
+    con->render_cap_dirty = true;
 
 end:
     // Rescale the image matrix once we got the texture if the anchors
     // coordinates were in pixels.
-    if (con->img_need_rescale && con->img && con->img->w) {
+    if (con->img_need_rescale && con->img) {
         assert(con->mat[2][2]);
-        mat3_iscale(con->mat, con->img->w, con->img->h, 1.0);
+        mat3_iscale(con->mat, con->img->src_w, con->img->src_h, 1.0);
         con->img_need_rescale = false;
+        con->render_cap_dirty = true;
     }
+    if (con->render_cap_dirty) update_render_cap(con);
 
     con->show = (cons && cons->show_all) ||
                 (strcasecmp(obs->cst, con->info.id) == 0) ||
@@ -367,7 +513,91 @@ static void spherical_project(
     mat3_mul_vec3(rnpb, out, out);
 }
 
-static int render_bounds(const constellation_t *con,
+// Max angle between two points of the tesselated boundaries.
+#define BOUNDS_MESH_STEP (1.0 * DD2R)
+
+/*
+ * Build the lines mesh of the constellation boundaries.
+ *
+ * The boundaries are segments in B1875 ra/dec, so we split them in small
+ * steps, the same way paint_lines would do with the spherical map.
+ */
+static void build_bounds_mesh(constellation_t *con)
+{
+    typeof(con->bounds_mesh) *mesh = &con->bounds_mesh;
+    const constellation_infos_t *info = &con->info;
+    int i, j, n, nb_verts = 0;
+    double line[2][2], uv[2], p[4], center[3] = {0, 0, 0};
+
+    for (i = 0; i < info->nb_edges; i++) {
+        memcpy(line, info->edges[i], sizeof(line));
+        if (line[1][0] < line[0][0]) line[1][0] += 2 * M_PI;
+        nb_verts += ceil(max(fabs(line[1][0] - line[0][0]),
+                             fabs(line[1][1] - line[0][1])) /
+                         BOUNDS_MESH_STEP) + 1;
+    }
+    mesh->verts = calloc(nb_verts, sizeof(*mesh->verts));
+    mesh->indices = calloc(2 * nb_verts, sizeof(*mesh->indices));
+
+    for (i = 0; i < info->nb_edges; i++) {
+        memcpy(line, info->edges[i], sizeof(line));
+        if (line[1][0] < line[0][0]) line[1][0] += 2 * M_PI;
+        n = ceil(max(fabs(line[1][0] - line[0][0]),
+                     fabs(line[1][1] - line[0][1])) / BOUNDS_MESH_STEP);
+        for (j = 0; j <= n; j++) {
+            vec2_mix(line[0], line[1], n ? (double)j / n : 0, uv);
+            spherical_project(NULL, uv, p);
+            if (j > 0) {
+                mesh->indices[mesh->indices_count++] = mesh->verts_count - 1;
+                mesh->indices[mesh->indices_count++] = mesh->verts_count;
+            }
+            vec3_copy(p, mesh->verts[mesh->verts_count++]);
+            vec3_add(center, p, center);
+        }
+    }
+    assert(mesh->verts_count == nb_verts);
+
+    // Bounding cap of all the vertices.
+    vec4_set(mesh->cap, 1, 0, 0, -1);
+    if (!vec3_norm2(center)) return;
+    vec3_normalize(center, mesh->cap);
+    mesh->cap[3] = 1;
+    for (i = 0; i < mesh->verts_count; i++)
+        mesh->cap[3] = min(mesh->cap[3], vec3_dot(mesh->cap, mesh->verts[i]));
+}
+
+/*
+ * Render the boundaries with a mesh cached on the GPU.
+ *
+ * Only if the renderer can project the mesh itself, otherwise return false.
+ */
+static bool render_bounds_mesh(constellation_t *con, const painter_t *painter)
+{
+    typeof(con->bounds_mesh) *mesh = &con->bounds_mesh;
+    double rot[3][3];
+    uint64_t id;
+
+    // Same conditions as the renderer retained meshes.
+    if (    painter->proj->type != PROJ_PERSPECTIVE &&
+            painter->proj->type != PROJ_STEREOGRAPHIC)
+        return false;
+    if (!painter_get_frame_to_view_matrix(painter, FRAME_ICRF, rot))
+        return false;
+    if (!mesh->verts) build_bounds_mesh(con);
+    if (!mesh->indices_count) return true;
+    // The boundaries only depend on the edges, so we can use the edges
+    // crc as version, in case another skyculture uses the same id.
+    id = oid_create("CSTB", crc32(0, (void*)con->info.id,
+                                  strlen(con->info.id)));
+    paint_mesh_retained(painter, FRAME_ICRF, MODE_LINES, id,
+                        crc32(0, (void*)con->info.edges,
+                              con->info.nb_edges * sizeof(*con->info.edges)),
+                        mesh->verts_count, mesh->verts,
+                        mesh->indices_count, mesh->indices, mesh->cap, 0);
+    return true;
+}
+
+static int render_bounds(constellation_t *con,
                          const painter_t *painter_,
                          bool selected)
 {
@@ -390,7 +620,8 @@ static int render_bounds(const constellation_t *con,
     painter.lines_stripes = 10.0; // Why not working anymore?
     vec4_set(painter.color, 0.6, 0.3, 0.3, 0.4 * painter.color[3]);
     info = &con->info;
-    if (!info) return 0;
+    if (!info->nb_edges) return 0;
+    if (render_bounds_mesh(con, &painter)) return 0;
     for (i = 0; i < info->nb_edges; i++) {
         memcpy(line[0], info->edges[i][0], 2 * sizeof(double));
         memcpy(line[1], info->edges[i][1], 2 * sizeof(double));
@@ -424,7 +655,9 @@ static bool constellation_is_visible(const constellation_t *con,
     // Clipping test.
     pos = calloc(con->count, sizeof(*pos));
     for (i = 0; i < con->count; i++) {
-        obj_get_pos(con->stars[i], painter->obs, FRAME_VIEW, pos[i]);
+        convert_frame(painter->obs, FRAME_ICRF, FRAME_VIEW, true,
+                      con->stars_pos[i], pos[i]);
+        pos[i][3] = 0;
         project(painter->proj, 0, 4, pos[i], pos[i]);
     }
 
@@ -446,9 +679,7 @@ static int render_lines(constellation_t *con, const painter_t *_painter,
     int i;
     double (*lines)[4];
     double lines_color[4];
-    double pvo[2][4];
-    double mag[2], radius[2], visible;
-    observer_t *obs = painter.obs;
+    double radius[2], visible;
     const constellations_t *cons = (const constellations_t*)con->obj.parent;
 
     if (!selected) {
@@ -466,17 +697,11 @@ static int render_lines(constellation_t *con, const painter_t *_painter,
     vec4_emul(lines_color, painter.color, painter.color);
 
     lines = calloc(con->count, sizeof(*lines));
-    for (i = 0; i < con->count; i++) {
-        obj_get_pvo(con->stars[i], obs, pvo);
-        vec3_normalize(pvo[0], lines[i]);
-        lines[i][3] = 0; // To infinity.
-    }
+    memcpy(lines, con->stars_pos, con->count * sizeof(*lines));
 
     for (i = 0; i < con->count; i += 2) {
-        obj_get_info(con->stars[i + 0], obs, INFO_VMAG, &mag[0]);
-        obj_get_info(con->stars[i + 1], obs, INFO_VMAG, &mag[1]);
-        core_get_point_for_mag(mag[0], &radius[0], NULL);
-        core_get_point_for_mag(mag[1], &radius[1], NULL);
+        core_get_point_for_mag(con->stars_vmag[i + 0], &radius[0], NULL);
+        core_get_point_for_mag(con->stars_vmag[i + 1], &radius[1], NULL);
         radius[0] = core_get_apparent_angle_for_point(painter.proj, radius[0]);
         radius[1] = core_get_apparent_angle_for_point(painter.proj, radius[1]);
         // Add some space, using ad-hoc formula.
@@ -500,6 +725,116 @@ static void img_map(const uv_map_t *map, const double v[2], double out[4])
     out[3] = 0;
 }
 
+// Check if an art texture is big enough for a given wanted size.
+static bool art_is_big_enough(const texture_t *tex, int wanted_size)
+{
+    if (!tex->max_size) return true;
+    if (wanted_size && tex->max_size >= wanted_size) return true;
+    // Already loaded without reduction.
+    return tex->id && tex->w == tex->src_w && tex->h == tex->src_h;
+}
+
+// Queue the loading of the art texture if we need a bigger one for the
+// current size on screen.
+static void art_request(constellation_t *con, const painter_t *painter)
+{
+    constellations_t *cons = (constellations_t*)con->obj.parent;
+    double size, win_pos[2];
+    const double *win_size = painter->proj->window_size;
+    int wanted;
+
+    // Size of the image on screen in pixels.
+    size = 2 * acos(min(con->render_cap[3], 1.0)) /
+           core_get_apparent_angle_for_point(painter->proj, 1.0);
+    for (wanted = ART_MIN_SIZE; wanted < size; wanted *= 2) {
+        if (wanted >= ART_MAX_SIZE) {
+            wanted = 0;
+            break;
+        }
+    }
+    if (con->img && art_is_big_enough(con->img, wanted)) return;
+
+    // Load the images closer to the screen center first.
+    painter_project(painter, FRAME_ICRF, con->bounding_cap, true, false,
+                    win_pos);
+    con->img_priority = hypot(win_pos[0] - win_size[0] / 2,
+                              win_pos[1] - win_size[1] / 2);
+    con->img_wanted_size = wanted;
+    if (cons->art_queue.nb >= cons->art_queue.allocated) {
+        cons->art_queue.allocated = max(16, cons->art_queue.allocated * 2);
+        cons->art_queue.list = realloc(cons->art_queue.list,
+                cons->art_queue.allocated * sizeof(*cons->art_queue.list));
+    }
+    cons->art_queue.list[cons->art_queue.nb++] = con;
+}
+
+static int art_priority_cmp(const void *a, const void *b)
+{
+    const constellation_t *ca = *(constellation_t**)a;
+    const constellation_t *cb = *(constellation_t**)b;
+    return cmp(ca->img_priority, cb->img_priority);
+}
+
+// Load the queued art textures with the highest priority.
+static void art_process_queue(constellations_t *cons)
+{
+    constellation_t *con;
+    int i, code = 0;
+
+    qsort(cons->art_queue.list, cons->art_queue.nb,
+          sizeof(*cons->art_queue.list), art_priority_cmp);
+    for (i = 0; i < min(cons->art_queue.nb, ART_MAX_LOADS); i++) {
+        con = cons->art_queue.list[i];
+        if (    con->img_next &&
+                !art_is_big_enough(con->img_next, con->img_wanted_size)) {
+            texture_release(con->img_next);
+            con->img_next = NULL;
+        }
+        if (!con->img_next) {
+            con->img_next = texture_from_url(con->img_path, TF_LAZY_LOAD);
+            con->img_next->max_size = con->img_wanted_size;
+        }
+        if (texture_load(con->img_next, &code)) {
+            texture_release(con->img);
+            con->img = con->img_next;
+            con->img_next = NULL;
+        } else if (code >= 400) {
+            LOG_W("Cannot load constellation image %s", con->img_path);
+            texture_release(con->img_next);
+            con->img_next = NULL;
+            free(con->img_path);
+            con->img_path = NULL;
+        }
+    }
+    cons->art_queue.nb = 0;
+}
+
+// Release the art textures that didn't get rendered if we use too much
+// memory.
+static void art_evict(constellations_t *cons)
+{
+    constellation_t *con;
+    int64_t total = 0;
+
+    MODULE_ITER(&cons->obj, con, "constellation") {
+        if (con->img) total += texture_get_memory_size(con->img);
+        if (con->img_next) total += texture_get_memory_size(con->img_next);
+    }
+    MODULE_ITER(&cons->obj, con, "constellation") {
+        if (total > ART_MEMORY_BUDGET && !con->img_used) {
+            if (con->img) total -= texture_get_memory_size(con->img);
+            if (con->img_next)
+                total -= texture_get_memory_size(con->img_next);
+            texture_release(con->img);
+            texture_release(con->img_next);
+            con->img = con->img_next = NULL;
+            con->image_loaded_fader.target = false;
+            con->image_loaded_fader.value = 0;
+        }
+        con->img_used = false;
+    }
+}
+
 static int render_img(constellation_t *con, const painter_t *painter_,
                       bool selected)
 {
@@ -513,8 +848,11 @@ static int render_img(constellation_t *con, const painter_t *painter_,
                             con->visible.value;
     }
     if (!painter.color[3]) return 0;
-    if (!con->img || !texture_load(con->img, NULL)) return 0;
+    if (!con->img_path) return 0;
     if (!con->mat[2][2]) return 0; // Not computed yet.
+    con->img_used = true;
+    art_request(con, &painter);
+    if (!con->img) return 0;
 
     con->image_loaded_fader.target = true;
 
@@ -523,6 +861,12 @@ static int render_img(constellation_t *con, const painter_t *painter_,
     painter.color[3] *= 0.3 * con->image_loaded_fader.value;
     mat3_copy(con->mat, map.mat);
     map.map = img_map;
+    // The image grid never changes for a given matrix, so that the renderer
+    // can keep it on the GPU.
+    map.at_infinity = true;
+    map.id = oid_create("CSTA", crc32(0, (void*)con->info.id,
+                                      strlen(con->info.id)));
+    map.version = crc32(0, (void*)con->mat, sizeof(con->mat));
     painter_set_texture(&painter, PAINTER_TEX_COLOR, con->img, NULL);
     paint_quad(&painter, FRAME_ICRF, &map, 4);
     return 0;
@@ -587,9 +931,11 @@ static int constellation_render(const obj_t *obj, const painter_t *_painter)
         return 0;
 
     constellation_update(con, painter.obs);
-    if (!con->show) return 0;
-    if (painter_is_cap_clipped(&painter, FRAME_ICRF, con->bounding_cap))
+    if (!con->show || !con->stars_pos) return 0;
+    if (painter_is_cap_clipped(&painter, FRAME_ICRF, con->render_cap)) {
+        con->visible.target = false;
         return 0;
+    }
 
     con->visible.target = constellation_is_visible(con, &painter);
     render_lines(con, &painter, selected);
@@ -613,12 +959,18 @@ static void constellation_del(obj_t *obj)
     int i;
     constellation_t *con = (constellation_t*)obj;
     texture_release(con->img);
+    texture_release(con->img_next);
+    free(con->img_path);
     for (i = 0; i < con->count; i++) {
         obj_release(con->stars[i]);
     }
     free(con->stars);
+    free(con->stars_pos);
+    free(con->stars_vmag);
     free(con->name);
     free(con->name_translated);
+    free(con->bounds_mesh.verts);
+    free(con->bounds_mesh.indices);
 }
 
 static void constellation_get_2d_ellipse(const obj_t *obj,
@@ -676,24 +1028,26 @@ static int constellations_update(obj_t *obj, double dt)
 {
     constellation_t *con;
     constellations_t *cons = (constellations_t*)obj;
+    bool changed = false;
 
-    fader_update(&cons->visible, dt);
-    fader_update(&cons->images_visible, dt);
-    fader_update(&cons->lines_visible, dt);
-    fader_update(&cons->bounds_visible, dt);
+    changed |= fader_update(&cons->visible, dt);
+    changed |= fader_update(&cons->images_visible, dt);
+    changed |= fader_update(&cons->lines_visible, dt);
+    changed |= fader_update(&cons->bounds_visible, dt);
 
     // Skip update if not visible.
-    if (cons->visible.value == 0.0) return 0;
+    if (cons->visible.value == 0.0) return changed ? 1 : 0;
     if (cons->lines_visible.value == 0.0 &&
         cons->images_visible.value == 0.0 &&
         cons->bounds_visible.value == 0.0 &&
-        (!core->selection || core->selection->parent != obj)) return 0;
+        (!core->selection || core->selection->parent != obj))
+        return changed ? 1 : 0;
 
     MODULE_ITER(obj, con, "constellation") {
-        fader_update(&con->image_loaded_fader, dt);
-        fader_update(&con->visible, dt);
+        changed |= fader_update(&con->image_loaded_fader, dt);
+        changed |= fader_update(&con->visible, dt);
     }
-    return 0;
+    return changed ? 1 : 0;
 }
 
 static int constellations_render(const obj_t *obj, const painter_t *painter)
@@ -709,6 +1063,8 @@ static int constellations_render(const obj_t *obj, const painter_t *painter)
     MODULE_ITER(obj, con, "constellation") {
         obj_render((obj_t*)con, painter);
     }
+    art_process_queue(cons);
+    art_evict(cons);
     return 0;
 }
 
@@ -745,7 +1101,8 @@ OBJ_REGISTER(constellation_klass)
 static obj_klass_t constellations_klass = {
     .id = "constellations",
     .size = sizeof(constellations_t),
-    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_LISTABLE,
+    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_LISTABLE |
+             OBJ_UPDATE_PARALLEL,
     .init = constellations_init,
     .update = constellations_update,
     .render = constellations_render,
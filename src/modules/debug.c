@@ -10,18 +10,65 @@
 /*
  * Debug module.  This just adds a menu in the GUI to do run some testing
  * scripts.  Not compiled in release.
+ *
+ * It can also show the tiles requested by a survey, colored by their
+ * loading state.  Set the 'tiles_survey' attribute to a part of the survey
+ * url to enable it.
  */
 
 #include "swe.h"
 
 #if DEBUG
 
+typedef struct debug {
+    obj_t   obj;
+    char    tiles_survey[256]; // Show the tiles of the matching survey.
+} debug_t;
+
+// Colors of the tiles, indexed by HIPS_TILE_STATE value.
+static const double TILE_COLORS[][3] = {
+    [HIPS_TILE_WAITING]     = {0.5, 0.5, 0.5},
+    [HIPS_TILE_DOWNLOADING] = {0.2, 0.4, 1.0},
+    [HIPS_TILE_QUEUED]      = {1.0, 0.8, 0.0},
+    [HIPS_TILE_DECODING]    = {1.0, 0.4, 0.0},
+    [HIPS_TILE_LOADED]      = {0.0, 1.0, 0.0},
+    [HIPS_TILE_ERROR]       = {1.0, 0.0, 0.0},
+};
+
+static const char *TILE_LEGEND[] = {
+    [HIPS_TILE_WAITING]     = "Gray: waiting for the parent",
+    [HIPS_TILE_DOWNLOADING] = "Blue: downloading",
+    [HIPS_TILE_QUEUED]      = "Yellow: queued for decoding",
+    [HIPS_TILE_DECODING]    = "Orange: decoding",
+    [HIPS_TILE_LOADED]      = "Green: loaded",
+    [HIPS_TILE_ERROR]       = "Red: error",
+};
+
+// Time after which a pending tile is shown at full opacity (sec).
+#define TILE_SLOW_TIME 5.0
+
 static void debug_gui(obj_t *obj, int location);
+static int debug_render(const obj_t *obj, const painter_t *painter);
+
+static void debug_on_tiles_survey_changed(obj_t *obj, const attribute_t *attr)
+{
+    debug_t *debug = (void*)obj;
+    hips_record_visited_tiles(debug->tiles_survey[0] ?
+                              debug->tiles_survey : NULL);
+}
+
 static obj_klass_t debug_klass = {
     .id = "debug",
-    .size = sizeof(obj_t),
+    .size = sizeof(debug_t),
     .flags = OBJ_MODULE,
     .gui = debug_gui,
+    .render = debug_render,
+    .render_order = 190, // After all the surveys.
+    .attributes = (attribute_t[]) {
+        PROPERTY(tiles_survey, TYPE_STRING, MEMBER(debug_t, tiles_survey),
+                 .on_changed = debug_on_tiles_survey_changed),
+        {}
+    },
 };
 OBJ_REGISTER(debug_klass)
 
@@ -91,6 +138,117 @@ static void show_target(const target_t *t)
     obj_set_attr((obj_t*)core->observer, "latitude", lat);
 }
 
+/*
+ * Show the memory used by the caches.  The hits and evictions counters are
+ * cumulated since the start, so we compare them to the values of the last
+ * second to get the rates.
+ */
+static void show_memory(void)
+{
+    static struct {
+        double  time;
+        int64_t hits[HIPS_CACHE_COUNT], misses[HIPS_CACHE_COUNT];
+        int64_t evictions[HIPS_CACHE_COUNT];
+        double  hit_ratio[HIPS_CACHE_COUNT], evictions_rate[HIPS_CACHE_COUNT];
+    } last;
+    const double MIB = 1 << 20;
+    int i, nb;
+    int64_t size, evictions, hits, misses;
+    double now = sys_get_unix_time();
+    bool update = now - last.time >= 1.0;
+    json_value *stats, *caches, *surveys, *v;
+
+    assets_get_stats(&nb, &size, &evictions);
+    gui_text("Assets: %d, %.1f MiB, %d evictions", nb, size / MIB,
+             (int)evictions);
+    texture_get_live(&nb, &size);
+    gui_text("Textures: %d, %.1f MiB", nb, size / MIB);
+
+    stats = hips_get_memory_stats();
+    caches = json_get_attr(stats, "caches", json_object);
+    for (i = 0; i < caches->u.object.length; i++) {
+        v = caches->u.object.values[i].value;
+        hits = json_get_attr_i(v, "hits", 0);
+        misses = json_get_attr_i(v, "misses", 0);
+        evictions = json_get_attr_i(v, "evictions", 0);
+        if (update) {
+            last.hit_ratio[i] = (hits - last.hits[i]) /
+                max(1.0, hits - last.hits[i] + misses - last.misses[i]);
+            last.evictions_rate[i] = (evictions - last.evictions[i]) /
+                (now - last.time);
+            last.hits[i] = hits;
+            last.misses[i] = misses;
+            last.evictions[i] = evictions;
+        }
+        gui_text("Tiles %s: %d, %.1f/%.1f MiB, hits %.0f%%, %.1f evictions/s",
+                 caches->u.object.values[i].name,
+                 (int)json_get_attr_i(v, "nb", 0),
+                 json_get_attr_i(v, "size", 0) / MIB,
+                 json_get_attr_i(v, "max_size", 0) / MIB,
+                 last.hit_ratio[i] * 100, last.evictions_rate[i]);
+    }
+    if (update) last.time = now;
+
+    surveys = json_get_attr(stats, "surveys", json_object);
+    for (i = 0; i < surveys->u.object.length; i++) {
+        v = surveys->u.object.values[i].value;
+        gui_text("%s: %d, %.1f MiB", surveys->u.object.values[i].name,
+                 (int)json_get_attr_i(v, "nb", 0),
+                 json_get_attr_i(v, "size", 0) / MIB);
+    }
+    json_builder_free(stats);
+}
+
+/*
+ * Render the tiles requested since the last frame.  The pending tiles get
+ * more opaque with the time spent in their state, so that the stuck ones
+ * stand out, while the loaded tiles fade out after their loading.  The
+ * numbers are the cache hits of each tile.
+ */
+static int debug_render(const obj_t *obj, const painter_t *painter_)
+{
+    const debug_t *debug = (const debug_t*)obj;
+    const hips_tile_info_t *tiles, *tile;
+    painter_t painter = *painter_;
+    int i, nb;
+    double age, pos[3], win[2], now = sys_get_unix_time();
+    char buf[32];
+
+    if (!debug->tiles_survey[0]) return 0;
+    tiles = hips_get_visited_tiles(&nb);
+    painter.lines_width = 2;
+    for (i = 0; i < nb; i++) {
+        tile = &tiles[i];
+        age = tile->time ? now - tile->time : TILE_SLOW_TIME;
+        vec3_copy(TILE_COLORS[tile->state], painter.color);
+        painter.color[3] = min(age / TILE_SLOW_TIME, 1.0);
+        if (tile->state == HIPS_TILE_LOADED)
+            painter.color[3] = max(1.0 - painter.color[3], 0.2);
+        else
+            painter.color[3] = max(painter.color[3], 0.4);
+        paint_tile_contour(&painter, tile->frame, tile->order, tile->pix, 1);
+
+        healpix_pix2vec(1 << tile->order, tile->pix, pos);
+        if (!painter_project(&painter, tile->frame, pos, true, true, win))
+            continue;
+        snprintf(buf, sizeof(buf), "%d", tile->hits);
+        paint_text(&painter, buf, win, ALIGN_CENTER | ALIGN_MIDDLE, 0,
+                   FONT_SIZE_BASE - 3, painter.color, 0);
+    }
+    return 0;
+}
+
+static void show_tiles(debug_t *debug)
+{
+    int i;
+    if (gui_input("Survey", debug->tiles_survey,
+                  sizeof(debug->tiles_survey), NULL)) {
+        debug_on_tiles_survey_changed(&debug->obj, NULL);
+    }
+    for (i = 0; i < ARRAY_SIZE(TILE_LEGEND); i++)
+        gui_text_unformatted(TILE_LEGEND[i]);
+}
+
 static void debug_gui(obj_t *obj, int location)
 {
     int i;
@@ -100,6 +258,14 @@ static void debug_gui(obj_t *obj, int location)
             show_target(&TARGETS[i]);
         gui_tab_end();
     }
+    if (location == 0 && gui_tab("Memory")) {
+        show_memory();
+        gui_tab_end();
+    }
+    if (location == 0 && gui_tab("Tiles")) {
+        show_tiles((debug_t*)obj);
+        gui_tab_end();
+    }
 }
 
 #endif
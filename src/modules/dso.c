@@ -24,11 +24,15 @@ typedef struct {
     uint64_t oid;
     double bounding_cap[4];
     float  display_vmag;
+    int16_t type_id; // See <otype_get_id>.
 } dso_clip_data_t;
 
 /*
  * Type: dso_data_t
  * Holds information data about a single DSO entry
+ *
+ * Only the data needed for rendering is decoded here, all the strings are
+ * stored together in the tile strings pool, see <get_str>.
  */
 typedef struct {
     union {
@@ -36,6 +40,7 @@ typedef struct {
             uint64_t oid;
             double bounding_cap[4];
             float  display_vmag;
+            int16_t type_id;
         };
         dso_clip_data_t clip_data;
     };
@@ -48,15 +53,18 @@ typedef struct {
     float       angle;
 
     int symbol;
-
-    char *morpho;
-    char short_name[64];
-    // List of extra names, separated by '\0', terminated by two '\0'.
-    char *names;
     float  vmag;
+    // Strings of the DSO in the tile pool: short name, morpho, then the
+    // list of extra names, all separated by '\0' and terminated by two '\0'.
+    const char *strs;
 } dso_data_t;
 
-
+// Index of the strings in dso_data_t.strs.
+enum {
+    STR_SHORT_NAME  = 0,
+    STR_MORPHO      = 1,
+    STR_NAMES       = 2,
+};
 
 /*
  * Type: dso_t
@@ -65,6 +73,7 @@ typedef struct {
 typedef struct dso {
     obj_t       obj;
     dso_data_t  data;
+    char        *strs; // Copy of the strings, since the tile can be deleted.
 } dso_t;
 
 /*
@@ -78,8 +87,23 @@ typedef struct tile {
     int         nb;
     dso_data_t  *sources;
     dso_clip_data_t *sources_quick;
+    char        *strs;           // Strings pool of all the sources.
+    int         strs_size;
+    double      bounding_cap[4]; // Cap containing all the sources.
+    otype_mask_t types;          // Types of all the sources.
+    bool        indexed;         // Set once the names are in the index.
 } tile_t;
 
+/*
+ * Type: dso_index_t
+ * Entry of the names to oid index.
+ */
+typedef struct {
+    UT_hash_handle  hh;
+    char            name[32]; // Normalized name, e.g. 'NGC 224'.
+    uint64_t        oid;
+} dso_index_t;
+
 /*
  * Type: dsos_t
  * The module object.
@@ -89,6 +113,11 @@ typedef struct {
     regex_t     search_reg;
     fader_t     visible;
     hips_t      *survey;
+    // Index of the M, NGC and IC names, built as the tiles get loaded.
+    dso_index_t *index;
+    // Only render those types and their descendants if set, e.g. 'G GlC'.
+    char        types[128];
+    otype_mask_t types_mask;
 } dsos_t;
 
 static uint64_t pix_to_nuniq(int order, int pix)
@@ -96,6 +125,12 @@ static uint64_t pix_to_nuniq(int order, int pix)
     return pix + 4 * (1L << (2 * order));
 }
 
+static void nuniq_to_pix(uint64_t nuniq, int *order, int *pix)
+{
+    *order = log2(nuniq / 4) / 2;
+    *pix = nuniq - 4 * (1 << (2 * (*order)));
+}
+
 /*
  * Generate a uniq oid for a DSO.
  *
@@ -114,16 +149,48 @@ static uint64_t make_oid(uint64_t nuniq, int index)
     return oid_create("NDSO", (uint32_t)nuniq << 12 | index);
 }
 
+// Empty strings, for the sources without any.
+static const char EMPTY_STRS[4] = {};
+
+// Get one of the strings of a DSO, e.g. get_str(s->strs, STR_MORPHO).
+static const char *get_str(const char *strs, int idx)
+{
+    if (!strs) return "";
+    for (; idx > 0; idx--) strs += strlen(strs) + 1;
+    return strs;
+}
+
+// Total size of a DSO strings, including the final '\0'.
+static int get_strs_size(const char *strs)
+{
+    const char *names = get_str(strs, STR_NAMES);
+    while (*names) names += strlen(names) + 1;
+    return names + 1 - strs;
+}
+
 static dso_t *dso_create(const dso_data_t *data)
 {
     dso_t *dso;
+    int size;
     dso = (dso_t*)obj_create("dso", NULL, NULL, NULL);
     dso->data = *data;
+    if (data->strs) {
+        size = get_strs_size(data->strs);
+        dso->strs = malloc(size);
+        memcpy(dso->strs, data->strs, size);
+        dso->data.strs = dso->strs;
+    }
     memcpy(&dso->obj.type, data->type, 4);
     dso->obj.oid = data->oid;
     return dso;
 }
 
+static void dso_del(obj_t *obj)
+{
+    dso_t *dso = (dso_t*)obj;
+    free(dso->strs);
+}
+
 static int dso_get_info(const obj_t *obj, const observer_t *obs, int info,
                         void *out)
 {
@@ -143,7 +210,8 @@ static int dso_get_info(const obj_t *obj, const observer_t *obs, int info,
         *(double*)out = dso->data.smax;
         return 0;
     case INFO_MORPHO:
-        *(char**)out = dso->data.morpho;
+        *(const char**)out = *get_str(dso->data.strs, STR_MORPHO) ?
+                             get_str(dso->data.strs, STR_MORPHO) : NULL;
         return 0;
     default:
         return 1;
@@ -151,14 +219,15 @@ static int dso_get_info(const obj_t *obj, const observer_t *obs, int info,
 }
 
 
-// Turn a json array of string into a '\0' separated C string.
-// Move this in utils?
+// Turn a json array of string into the '\0' separated dso strings, with
+// empty short name and morpho.
 static char *parse_json_names(json_value *names)
 {
     int i;
     json_value *jstr;
     UT_string ret;
     utstring_init(&ret);
+    utstring_bincpy(&ret, "\0", 2); // Empty short name and morpho.
     for (i = 0; i < names->u.array.length; i++) {
         jstr = names->u.array.values[i];
         if (jstr->type != json_string) continue; // Not normal!
@@ -172,6 +241,7 @@ static int dso_init(obj_t *obj, json_value *args)
 {
     const double DAM2R = DD2R / 60.0; // arcmin to rad.
     int index;
+    const char *names_str;
 
     // Support creating a dso using noctuasky model data json values.
     dso_t *dso = (dso_t*)obj;
@@ -191,13 +261,16 @@ static int dso_init(obj_t *obj, json_value *args)
     dso->data.display_vmag = isnan(dso->data.vmag) ? DSO_DEFAULT_VMAG :
                                                       dso->data.vmag;
     names = json_get_attr(args, "names", json_array);
-    if (names)
-        dso->data.names = parse_json_names(names);
+    if (names) {
+        dso->strs = parse_json_names(names);
+        dso->data.strs = dso->strs;
+    }
 
     // Since we are not in a tile, we use the hash of the name to generate
     // the oid.
-    if (dso->data.names) {
-        index = crc32(0, (void*)dso->data.names, strlen(dso->data.names));
+    if (dso->data.strs) {
+        names_str = get_str(dso->data.strs, STR_NAMES);
+        index = crc32(0, (void*)names_str, strlen(names_str));
         dso->data.oid = make_oid(0, index % 1024 + 1);
     }
 
@@ -209,6 +282,7 @@ static int dso_init(obj_t *obj, json_value *args)
             dso->data.symbol = symbols_get_for_otype(dso->data.type);
         }
     }
+    dso->data.type_id = otype_get_id(dso->data.type);
     return 0;
 }
 
@@ -225,14 +299,8 @@ static void strip_type(char str[4])
 // Used by the cache.
 static int del_tile(void *data)
 {
-    int i;
     tile_t *tile = data;
-    for (i = 0; i < tile->nb; i++) {
-        free(tile->sources[i].names);
-        free(tile->sources[i].morpho);
-    }
-    free(tile->sources);
-    free(tile->sources_quick);
+    // The sources and the strings are in the same block as the tile.
     free(tile);
     return 0;
 }
@@ -243,17 +311,49 @@ static int dso_data_cmp(const void *a, const void *b)
                ((const dso_data_t*)b)->display_vmag);
 }
 
+// Compute a cap containing all the sources caps of a tile.
+static void compute_tile_bounding_cap(tile_t *tile)
+{
+    int i;
+    double center[3] = {0, 0, 0}, angle = 0, a;
+    const double *cap;
+
+    for (i = 0; i < tile->nb; i++)
+        vec3_add(center, tile->sources_quick[i].bounding_cap, center);
+    if (vec3_norm2(center) == 0) {
+        vec4_set(tile->bounding_cap, 1, 0, 0, -1); // Full sky.
+        return;
+    }
+    vec3_normalize(center, center);
+    for (i = 0; i < tile->nb; i++) {
+        cap = tile->sources_quick[i].bounding_cap;
+        a = acos(clamp(vec3_dot(center, cap), -1, 1)) +
+            acos(clamp(cap[3], -1, 1));
+        // In case of invalid caps, never clip the tile as a whole.
+        if (isnan(a)) {
+            angle = M_PI;
+            break;
+        }
+        angle = max(angle, a);
+    }
+    vec3_copy(center, tile->bounding_cap);
+    tile->bounding_cap[3] = cos(min(angle, M_PI));
+}
+
 static int on_file_tile_loaded(const char type[4],
                                const void *data, int size, void *user)
 {
     tile_t *tile;
     dso_data_t *s;
-    int nb, i, j, version, data_ofs = 0, flags, row_size, order, pix;
-    char morpho[32], ids[256] = {};
-    double bmag, temp_mag, tmp_ra, tmp_de, tmp_smax, tmp_smin, tmp_angle;
-    void *tile_data;
+    int nb, i, j, version, data_ofs = 0, flags, row_size, order, pix, r = 0;
+    char morpho[32], short_name[64], ids[256] = {};
+    float *bmags;
+    int *strs_ofs;
+    size_t tile_size;
+    const void *tile_data;
     const double DAM2R = DD2R / 60.0; // arcmin to rad.
     uint64_t nuniq;
+    UT_string strs;
 
     eph_table_column_t columns[] = {
         {"type", 's', .size=4},
@@ -268,6 +368,20 @@ static int on_file_tile_loaded(const char type[4],
         {"snam", 's', .size=64},
         {"ids",  's', .size=256},
     };
+    // Where to decode each column (but bmag and the strings) in a dso_data_t.
+    const int offsets[] = {
+        offsetof(dso_data_t, type),
+        offsetof(dso_data_t, vmag),
+        -1,
+        offsetof(dso_data_t, ra),
+        offsetof(dso_data_t, de),
+        offsetof(dso_data_t, smax),
+        offsetof(dso_data_t, smin),
+        offsetof(dso_data_t, angle),
+        -1,
+        -1,
+        -1,
+    };
 
     if (strncmp(type, "DSO ", 4) != 0) return 0;
 
@@ -280,34 +394,50 @@ static int on_file_tile_loaded(const char type[4],
         *(tile_t**)user = NULL;
         return -1;
     }
-    tile_data = eph_read_compressed_block(data, size, &data_ofs, &size);
+    tile_data = eph_read_compressed_block_tmp(data, size, &data_ofs, &size);
     if (!tile_data) return -1;
-    data_ofs = 0;
-    if (flags & 1) {
-        eph_shuffle_bytes(tile_data + data_ofs, row_size, nb);
-    }
 
-    tile = calloc(1, sizeof(*tile));
+    // The tile, the sources and the quick sources are allocated in a single
+    // block, that gets extended with the strings at the end.
+    tile_size = sizeof(*tile) + nb * (sizeof(*tile->sources) +
+                                      sizeof(*tile->sources_quick));
+    tile = calloc(1, tile_size);
     tile->mag_min = DBL_MAX;
     tile->mag_max = -DBL_MAX;
     tile->nb = nb;
 
-    tile->sources = calloc(tile->nb, sizeof(dso_data_t));
+    // Decode the table column by column, straight into the sources.
+    tile->sources = (void*)(tile + 1);
+    bmags = calloc(tile->nb, sizeof(*bmags));
+    for (i = 0; i < ARRAY_SIZE(columns); i++) {
+        if (offsets[i] < 0) continue;
+        r |= eph_read_table_column(tile_data, size, nb, flags, &columns[i],
+                                   (void*)tile->sources + offsets[i],
+                                   sizeof(dso_data_t));
+    }
+    r |= eph_read_table_column(tile_data, size, nb, flags, &columns[2],
+                               bmags, sizeof(*bmags));
+    if (r) {
+        LOG_E("Cannot parse file");
+        free(tile);
+        free(bmags);
+        *(tile_t**)user = NULL;
+        return -1;
+    }
+
+    // All the strings go into a single pool per tile.  Since the pool can
+    // be reallocated, we first store the offsets and only set the pointers
+    // at the end.
+    strs_ofs = calloc(tile->nb, sizeof(*strs_ofs));
+    utstring_init(&strs);
 
     for (i = 0; i < tile->nb; i++) {
         s = &tile->sources[i];
-        eph_read_table_row(tile_data, size, &data_ofs,
-                           ARRAY_SIZE(columns), columns,
-                           s->type,
-                           &temp_mag, &bmag, &tmp_ra, &tmp_de,
-                           &tmp_smax, &tmp_smin, &tmp_angle,
-                           morpho, s->short_name, ids);
-        s->ra = tmp_ra * DD2R;
-        s->de = tmp_de * DD2R;
-
-        s->smax = tmp_smax * DAM2R;
-        s->smin = tmp_smin * DAM2R;
-        s->angle = tmp_angle;
+        s->ra *= DD2R;
+        s->de *= DD2R;
+
+        s->smax *= DAM2R;
+        s->smin *= DAM2R;
         if (!s->smin && s->smax) {
             s->smin = s->smax;
             s->angle = NAN;
@@ -318,9 +448,8 @@ static int on_file_tile_loaded(const char type[4],
         s->bounding_cap[3] = cosf(max(s->smin, s->smax));
         eraS2c(s->ra, s->de, s->bounding_cap);
 
-        s->vmag = temp_mag;
         // For the moment use bmag as fallback vmag value
-        if (isnan(s->vmag)) s->vmag = bmag;
+        if (isnan(s->vmag)) s->vmag = bmags[i];
         strip_type(s->type);
         s->display_vmag = isnan(s->vmag) ? DSO_DEFAULT_VMAG : s->vmag;
         tile->mag_min = min(tile->mag_min, s->display_vmag);
@@ -328,24 +457,51 @@ static int on_file_tile_loaded(const char type[4],
         nuniq = pix_to_nuniq(order, pix);
         s->oid = make_oid(nuniq, i);
 
-        if (*morpho) s->morpho = strdup(morpho);
         s->symbol = symbols_get_for_otype(s->type);
-
-        // Turn '|' separated ids into '\0' separated values.
-        if (*ids) {
-            s->names = calloc(1, 2 + strlen(ids));
-            for (j = 0; ids[j]; j++)
-                s->names[j] = ids[j] != '|' ? ids[j] : '\0';
+        s->type_id = otype_get_id(s->type);
+        otype_mask_add_id(&tile->types, s->type_id);
+
+        eph_read_table_value(tile_data, size, nb, flags, &columns[8], i,
+                             morpho);
+        eph_read_table_value(tile_data, size, nb, flags, &columns[9], i,
+                             short_name);
+        eph_read_table_value(tile_data, size, nb, flags, &columns[10], i,
+                             ids);
+        if (!*morpho && !*short_name && !*ids) {
+            strs_ofs[i] = -1;
+            continue;
         }
+        // Turn '|' separated ids into '\0' separated values.
+        for (j = 0; ids[j]; j++)
+            if (ids[j] == '|') ids[j] = '\0';
+        strs_ofs[i] = utstring_len(&strs);
+        utstring_bincpy(&strs, short_name, strlen(short_name) + 1);
+        utstring_bincpy(&strs, morpho, strlen(morpho) + 1);
+        utstring_bincpy(&strs, ids, j + 1);
+        if (j) utstring_bincpy(&strs, "", 1);
+    }
+    free(bmags);
+
+    tile->strs_size = utstring_len(&strs);
+    tile = realloc(tile, tile_size + tile->strs_size);
+    tile->sources = (void*)(tile + 1);
+    tile->sources_quick = (void*)(tile->sources + tile->nb);
+    tile->strs = (char*)tile + tile_size;
+    if (tile->strs_size)
+        memcpy(tile->strs, utstring_body(&strs), tile->strs_size);
+    utstring_done(&strs);
+    for (i = 0; i < tile->nb; i++) {
+        tile->sources[i].strs = strs_ofs[i] >= 0 ?
+            tile->strs + strs_ofs[i] : EMPTY_STRS;
     }
-    free(tile_data);
+    free(strs_ofs);
 
     // Sort DSO in tile by display magnitude
     qsort(tile->sources, tile->nb, sizeof(dso_data_t), dso_data_cmp);
     // Create a small table with all data used for fast tile iteration
-    tile->sources_quick = calloc(tile->nb, sizeof(dso_clip_data_t));
     for (i = 0; i < tile->nb; ++i)
         tile->sources_quick[i] = tile->sources[i].clip_data;
+    compute_tile_bounding_cap(tile);
 
     *(tile_t**)user = tile;
     return 0;
@@ -356,7 +512,11 @@ static const void *dsos_create_tile(void *user, int order, int pix, void *data,
 {
     tile_t *tile;
     eph_load(data, size, &tile, on_file_tile_loaded);
-    if (tile) *cost = tile->nb * sizeof(*tile->sources);
+    if (tile) {
+        *cost = sizeof(*tile) + tile->nb * (sizeof(*tile->sources) +
+                                            sizeof(*tile->sources_quick)) +
+                tile->strs_size;
+    }
     return tile;
 }
 
@@ -369,6 +529,58 @@ static int dsos_init(obj_t *obj, json_value *args)
     return 0;
 }
 
+// Normalize a catalog name for the index, e.g. 'm31' -> 'M 31'.
+// Return false if the name is not a M, NGC or IC name.
+static bool index_name(const char *cat, uint64_t n, char out[32])
+{
+    if (    strcasecmp(cat, "M") != 0 &&
+            strcasecmp(cat, "NGC") != 0 &&
+            strcasecmp(cat, "IC") != 0) return false;
+    snprintf(out, 32, "%s %llu", cat, (unsigned long long)n);
+    str_to_upper(out, out);
+    return true;
+}
+
+// Add a name to the index if it is a M, NGC or IC name.
+static void index_add(dsos_t *dsos, const char *str, uint64_t oid)
+{
+    char cat[8], name[32], c;
+    unsigned long long n;
+    dso_index_t *entry;
+
+    // Only consider plain 'CAT NUMBER' names, not things like 'NGC 224A'.
+    if (sscanf(str, "%7s %llu%c", cat, &n, &c) != 2) return;
+    if (!index_name(cat, n, name)) return;
+    HASH_FIND_STR(dsos->index, name, entry);
+    if (!entry) {
+        entry = calloc(1, sizeof(*entry));
+        strcpy(entry->name, name);
+        HASH_ADD_STR(dsos->index, name, entry);
+    }
+    entry->oid = oid;
+}
+
+// Add the M, NGC and IC names of a tile sources to the index, and all the
+// names to the search index.
+static void index_tile(dsos_t *dsos, tile_t *tile)
+{
+    int i;
+    const char *names;
+    const dso_data_t *s;
+
+    tile->indexed = true;
+    for (i = 0; i < tile->nb; i++) {
+        s = &tile->sources[i];
+        index_add(dsos, get_str(s->strs, STR_SHORT_NAME), s->oid);
+        search_add(&dsos->obj, get_str(s->strs, STR_SHORT_NAME), s->oid, 0);
+        for (names = get_str(s->strs, STR_NAMES); *names;
+             names += strlen(names) + 1) {
+            index_add(dsos, names, s->oid);
+            search_add(&dsos->obj, names, s->oid, 0);
+        }
+    }
+}
+
 // Exactly the same that stars.c get_tile function...
 static tile_t *get_tile(dsos_t *dsos, int order, int pix, bool load,
                         bool *loading_complete)
@@ -378,9 +590,30 @@ static tile_t *get_tile(dsos_t *dsos, int order, int pix, bool load,
     if (!load) flags |= HIPS_CACHED_ONLY;
     tile = hips_get_tile(dsos->survey, order, pix, flags, &code);
     if (loading_complete) *loading_complete = (code != 0);
+    if (tile && !tile->indexed) index_tile(dsos, tile);
     return tile;
 }
 
+// Get a DSO from its oid, using the tile nuniq encoded in the NDSO oids.
+static obj_t *get_from_ndso_oid(dsos_t *dsos, uint64_t oid)
+{
+    int i, order, pix;
+    tile_t *tile;
+    uint64_t nuniq;
+
+    if (!oid_is_catalog(oid, "NDSO")) return NULL;
+    nuniq = oid_get_index(oid) >> 12;
+    if (nuniq < 4) return NULL;
+    nuniq_to_pix(nuniq, &order, &pix);
+    tile = get_tile(dsos, order, pix, true, NULL);
+    if (!tile) return NULL;
+    for (i = 0; i < tile->nb; i++) {
+        if (tile->sources[i].oid == oid)
+            return &dso_create(&tile->sources[i])->obj;
+    }
+    return NULL;
+}
+
 static void compute_hint_transformation(
         const painter_t *painter,
         float ra, float de, float angle,
@@ -421,6 +654,7 @@ static void dso_render_label(const dso_data_t *s2, const dso_clip_data_t *s,
     double color[4], radius;
     char buf[128] = "";
     const float vmag = s->display_vmag;
+    const char *short_name = get_str(s2->strs, STR_SHORT_NAME);
 
     effects = TEXT_BOLD;
     if (selected) {
@@ -432,8 +666,8 @@ static void dso_render_label(const dso_data_t *s2, const dso_clip_data_t *s,
                  fabs(cos(win_angle - M_PI_4)) *
                  fabs(win_size[0] / 2 - win_size[1] / 2);
     radius += 1;
-    if (s2->short_name[0])
-        snprintf(buf, sizeof(buf), "%s", s2->short_name);
+    if (short_name[0])
+        snprintf(buf, sizeof(buf), "%s", short_name);
     if (buf[0]) {
         labels_add_3d(buf, FRAME_ASTROM, s->bounding_cap, true, radius,
                       FONT_SIZE_BASE - 2, color, 0, LABEL_AROUND, effects,
@@ -442,11 +676,21 @@ static void dso_render_label(const dso_data_t *s2, const dso_clip_data_t *s,
 }
 
 
-// Render a DSO from its data.
-static int dso_render_from_data(const dso_data_t *s2, const dso_clip_data_t *s,
-                                const painter_t *painter)
+// Max vmag of the DSOs we render.
+static double get_limit_mag(const painter_t *painter)
+{
+    // Allow to select DSO a bit fainter than the faintest star
+    // as they tend to be more visible as they are extended objects.
+    return min(painter->stars_limit_mag + 1.5, painter->hard_limit_mag);
+}
+
+// Render a DSO from its data, once we know it passed the magnitude and
+// viewport caps tests.
+static void dso_render_unclipped(const dso_data_t *s2,
+                                 const dso_clip_data_t *s,
+                                 const painter_t *painter)
 {
-    PROFILE(dso_render_from_data, PROFILE_AGGREGATE);
+    PROFILE(dso_render_unclipped, PROFILE_AGGREGATE);
     double color[4];
     double win_pos[2], win_size[2], win_angle;
     double hints_limit_mag = painter->hints_limit_mag - 0.5 +
@@ -457,15 +701,6 @@ static int dso_render_from_data(const dso_data_t *s2, const dso_clip_data_t *s,
 
     const float vmag = s->display_vmag;
 
-    // Allow to select DSO a bit fainter than the faintest star
-    // as they tend to be more visible as they are extended objects.
-    if (vmag > painter->stars_limit_mag + 1.5 || vmag > painter->hard_limit_mag)
-        return 1;
-
-    // Check that it's intersecting with current viewport
-    if (painter_is_cap_clipped(painter, FRAME_ASTROM, s->bounding_cap))
-        return 0;
-
     // Special case for Open Clusters, for which the limiting magnitude
     // is more like the one for a star.
     if (s2->symbol == SYMBOL_OPEN_GALACTIC_CLUSTER ||
@@ -486,7 +721,7 @@ static int dso_render_from_data(const dso_data_t *s2, const dso_clip_data_t *s,
         hints_limit_mag = 99;
 
     if (vmag > hints_limit_mag + 2)
-        return 0;
+        return;
 
     compute_hint_transformation(painter, s2->ra, s2->de, s2->angle,
             s2->smax, s2->smin, s2->symbol, win_pos, win_size,
@@ -495,7 +730,7 @@ static int dso_render_from_data(const dso_data_t *s2, const dso_clip_data_t *s,
     // Skip if 2D circle is outside screen (TODO intersect 2D ellipse instead)
     if (painter_is_2d_circle_clipped(painter, win_pos,
                                      max(win_size[0], win_size[1]) / 2))
-        return 0;
+        return;
 
     areas_add_ellipse(core->areas, win_pos, win_angle,
                       win_size[0] / 2, win_size[1] / 2, s->oid, 0);
@@ -504,7 +739,7 @@ static int dso_render_from_data(const dso_data_t *s2, const dso_clip_data_t *s,
     // But the previous steps are still necessary as we want to be able to
     // select them even without hints/names
     if (painter->color[3] < 0.01 && !selected)
-        return 0;
+        return;
 
     if (vmag <= hints_limit_mag + 0.5) {
         tmp_painter = *painter;
@@ -533,9 +768,38 @@ static int dso_render_from_data(const dso_data_t *s2, const dso_clip_data_t *s,
     if (vmag <= hints_limit_mag - 1.) {
         dso_render_label(s2, s, painter, win_size, win_angle);
     }
+}
+
+// Render a DSO from its data.
+static int dso_render_from_data(const dso_data_t *s2, const dso_clip_data_t *s,
+                                const painter_t *painter)
+{
+    if (s->display_vmag > get_limit_mag(painter))
+        return 1;
+    // Check that it's intersecting with current viewport
+    if (painter_is_cap_clipped(painter, FRAME_ASTROM, s->bounding_cap))
+        return 0;
+    dso_render_unclipped(s2, s, painter);
     return 0;
 }
 
+// Test whether none of the caps inside a given cap can be clipped by
+// painter_is_cap_clipped.
+static bool is_cap_never_clipped(const painter_t *painter, int frame,
+                                 const double cap[4])
+{
+    int i;
+    const typeof(painter->clip_info[frame]) *clip = &painter->clip_info[frame];
+    if (!cap_contains_cap(clip->bounding_cap, cap)) return false;
+    if ((painter->flags & PAINTER_HIDE_BELOW_HORIZON) &&
+            !cap_contains_cap(clip->sky_cap, cap))
+        return false;
+    for (i = 0; i < clip->nb_viewport_caps; i++) {
+        if (!cap_contains_cap(clip->viewport_caps[i], cap)) return false;
+    }
+    return true;
+}
+
 static int dso_render(const obj_t *obj, const painter_t *painter)
 {
     const dso_t *dso = (const dso_t*)obj;
@@ -549,10 +813,11 @@ void dso_get_designations(
     const dso_t *dso = (const dso_t*)obj;
     const dso_data_t *s = &dso->data;
 
-    const char *names = s->names;
+    const char *names = get_str(s->strs, STR_NAMES);
     char cat[128] = {};
-    f(obj, user, "", s->short_name); // XXX: should extract cat.
-    while (names && *names) {
+    // XXX: should extract cat.
+    f(obj, user, "", get_str(s->strs, STR_SHORT_NAME));
+    while (*names) {
         strncpy(cat, names, sizeof(cat) - 1);
         if (!strchr(cat, ' ')) { // No catalog.
             f(obj, user, "", cat);
@@ -571,8 +836,11 @@ static int render_visitor(int order, int pix, void *user)
     int *nb_tot = USER_GET(user, 2);
     int *nb_loaded = USER_GET(user, 3);
     tile_t *tile;
-    int i, ret;
-    bool loaded;
+    int i, j, n, lo, hi, nb_visible;
+    int visible[256];
+    bool loaded, never_clipped, filtered;
+    const double limit_mag = get_limit_mag(&painter);
+    const dso_clip_data_t *s;
 
     // Early exit if the tile is clipped.
     if (painter_is_healpix_clipped(&painter, FRAME_ICRF, order, pix, true))
@@ -584,17 +852,56 @@ static int render_visitor(int order, int pix, void *user)
 
     if (!tile) return 0;
     if (tile->mag_min > painter.stars_limit_mag + 1.5) return 0;
-
-    for (i = 0; i < tile->nb; i++) {
-        ret = dso_render_from_data(&tile->sources[i], &tile->sources_quick[i],
-                                   &painter);
-        if (ret)
-            break;
+    filtered = dsos->types[0];
+
+    // The sources are sorted by vmag, so we can find the number of visible
+    // ones with a binary search.
+    for (lo = 0, hi = tile->nb; lo < hi; ) {
+        i = (lo + hi) / 2;
+        if (tile->sources_quick[i].display_vmag > limit_mag) hi = i;
+        else lo = i + 1;
+    }
+    n = lo;
+
+    // Test the full tile, and only test each source if the tile is not
+    // entirely inside the viewport.
+    if (n && painter_is_cap_clipped(&painter, FRAME_ASTROM,
+                                    tile->bounding_cap))
+        n = 0;
+    // Skip the tile sources if none of them has a filtered type.  We still
+    // need to visit the children tiles.
+    if (filtered && !otype_mask_intersects(&tile->types, &dsos->types_mask))
+        n = 0;
+    never_clipped = is_cap_never_clipped(&painter, FRAME_ASTROM,
+                                         tile->bounding_cap);
+
+    // First do the clipping of a batch of sources using only the compact
+    // clip data, then render the ones that are visible.
+    for (i = 0; i < n; i += ARRAY_SIZE(visible)) {
+        nb_visible = 0;
+        for (j = i; j < min(n, i + (int)ARRAY_SIZE(visible)); j++) {
+            s = &tile->sources_quick[j];
+            if (filtered && !otype_mask_test(&dsos->types_mask, s->type_id))
+                continue;
+            if (never_clipped || !painter_is_cap_clipped(
+                        &painter, FRAME_ASTROM, s->bounding_cap))
+                visible[nb_visible++] = j;
+        }
+        for (j = 0; j < nb_visible; j++) {
+            dso_render_unclipped(&tile->sources[visible[j]],
+                                 &tile->sources_quick[visible[j]], &painter);
+        }
     }
     if (tile->mag_max > painter.stars_limit_mag + 1.5) return 0;
     return 1;
 }
 
+static void dsos_on_types_changed(obj_t *obj, const attribute_t *attr)
+{
+    dsos_t *dsos = (dsos_t*)obj;
+    otype_mask_parse(&dsos->types_mask, dsos->types);
+}
+
 static int dsos_update(obj_t *obj, double dt)
 {
     dsos_t *dsos = (dsos_t*)obj;
@@ -638,26 +945,25 @@ static int dsos_get_visitor(int order, int pix, void *user)
 
 static obj_t *dsos_get(const obj_t *obj, const char *id, int flags)
 {
-    int r, cat;
+    int r;
     uint64_t n;
     regmatch_t matches[3];
     dsos_t *dsos = (dsos_t*)obj;
+    char cat[8], name[32];
+    dso_index_t *entry;
 
     r = regexec(&dsos->search_reg, id, 3, matches, 0);
     if (r) return NULL;
     n = strtoull(id + matches[2].rm_so, NULL, 10);
-    if (strncasecmp(id, "m", 1) == 0) cat = 0;
-    if (strncasecmp(id, "ngc", 3) == 0) cat = 1;
-    if (strncasecmp(id, "ic", 2) == 0) cat = 2;
-
-    struct {
-        dsos_t      *dsos;
-        obj_t       *ret;
-        int         cat;
-        uint64_t    n;
-    } d = {.dsos=(void*)obj, .cat=cat, .n=n};
-    hips_traverse(&d, dsos_get_visitor);
-    return d.ret;
+    snprintf(cat, sizeof(cat), "%.*s",
+             (int)(matches[1].rm_eo - matches[1].rm_so),
+             id + matches[1].rm_so);
+    if (!index_name(cat, n, name)) return NULL;
+
+    // We can only find the DSOs from the tiles already loaded.
+    HASH_FIND_STR(dsos->index, name, entry);
+    if (!entry) return NULL;
+    return get_from_ndso_oid(dsos, entry->oid);
 }
 
 static obj_t *dsos_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint)
@@ -668,10 +974,13 @@ static obj_t *dsos_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint)
         int         cat;
         uint64_t    n;
     } d = {.dsos=(void*)obj, .cat=4, .n=oid};
+    obj_t *ret;
     if (    !oid_is_catalog(oid, "NGC") &&
             !oid_is_catalog(oid, "IC") &&
             !oid_is_catalog(oid, "NDSO"))
         return NULL;
+    // The NDSO oids directly give us the tile.
+    if ((ret = get_from_ndso_oid((dsos_t*)obj, oid))) return ret;
     hips_traverse(&d, dsos_get_visitor);
     return d.ret;
 }
@@ -702,6 +1011,63 @@ static int dsos_list(const obj_t *obj, observer_t *obs,
     return nb;
 }
 
+static int dsos_query_visitor(int order, int pix, void *user)
+{
+    int i, r;
+    double cap[4];
+    dso_t *dso;
+    struct {
+        dsos_t *dsos;
+        const obj_query_t *query;
+        int (*f)(void *user, obj_t *obj);
+        void *user;
+        bool stopped;
+    } *d = user;
+    const obj_query_t *query = d->query;
+    const dso_clip_data_t *s;
+    tile_t *tile;
+
+    healpix_get_bounding_cap(1 << order, pix, cap);
+    if (!cap_intersects_cap(cap, query->cap)) return 0;
+    tile = get_tile(d->dsos, order, pix, true, NULL);
+    if (!tile || tile->mag_min >= query->max_mag) return 0;
+    if (query->type[0] && !otype_mask_intersects(&tile->types, &query->types))
+        return 1;
+    for (i = 0; i < tile->nb; i++) {
+        // Filter on the packed clipping data first.
+        s = &tile->sources_quick[i];
+        if (s->display_vmag > query->max_mag) continue;
+        if (!cap_contains_vec3(query->cap, s->bounding_cap)) continue;
+        if (query->type[0] && !otype_mask_test(&query->types, s->type_id))
+            continue;
+        dso = dso_create(&tile->sources[i]);
+        r = d->f(d->user, (obj_t*)dso);
+        obj_release((obj_t*)dso);
+        if (r) {
+            d->stopped = true;
+            return -1;
+        }
+    }
+    return 1;
+}
+
+static int dsos_query(const obj_t *obj, observer_t *obs,
+                      const obj_query_t *query, void *user,
+                      int (*f)(void *user, obj_t *obj))
+{
+    struct {
+        dsos_t *dsos;
+        const obj_query_t *query;
+        int (*f)(void *user, obj_t *obj);
+        void *user;
+        bool stopped;
+    } d = {.dsos=(void*)obj, .query=query, .f=f, .user=user};
+
+    if (!d.dsos->survey) return 0;
+    hips_traverse(&d, dsos_query_visitor);
+    return d.stopped ? 1 : 0;
+}
+
 static int dsos_add_data_source(
         obj_t *obj, const char *url, const char *type, json_value *args)
 {
@@ -710,6 +1076,7 @@ static int dsos_add_data_source(
     hips_settings_t survey_settings = {
         .create_tile = dsos_create_tile,
         .delete_tile = del_tile,
+        .cache = HIPS_CACHE_DSOS,
     };
     if (!type || !args || strcmp(type, "hips")) return 1;
     args_type = json_get_attr_s(args, "type");
@@ -727,6 +1094,7 @@ static obj_klass_t dso_klass = {
     .id = "dso",
     .size = sizeof(dso_t),
     .init = dso_init,
+    .del = dso_del,
     .get_info = dso_get_info,
     .render = dso_render,
     .get_designations = dso_get_designations,
@@ -737,17 +1105,20 @@ OBJ_REGISTER(dso_klass)
 static obj_klass_t dsos_klass = {
     .id     = "dsos",
     .size   = sizeof(dsos_t),
-    .flags  = OBJ_IN_JSON_TREE | OBJ_MODULE,
+    .flags  = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_UPDATE_PARALLEL,
     .init   = dsos_init,
     .update = dsos_update,
     .render = dsos_render,
     .get    = dsos_get,
     .get_by_oid  = dsos_get_by_oid,
     .list   = dsos_list,
+    .query  = dsos_query,
     .add_data_source = dsos_add_data_source,
     .render_order = 25,
     .attributes = (attribute_t[]) {
         PROPERTY(visible, TYPE_BOOL, MEMBER(dsos_t, visible.target)),
+        PROPERTY(types, TYPE_STRING, MEMBER(dsos_t, types),
+                 .on_changed = dsos_on_types_changed),
         {}
     },
 };
@@ -15,6 +15,9 @@ typedef struct dss {
     obj_t       obj;
     fader_t     visible;
     hips_t      *hips;
+    // Set when the milky way module already rendered the survey in a
+    // shared pass this frame.  See <dss_get_layer>.
+    bool        shared;
 } dss_t;
 
 static int dss_init(obj_t *obj, json_value *args)
@@ -24,17 +27,18 @@ static int dss_init(obj_t *obj, json_value *args)
     return 0;
 }
 
-static int dss_render(const obj_t *obj, const painter_t *painter)
+// Compute the painter and split order used to render the survey.
+// Return false if the survey is not visible.
+static bool get_layer(const dss_t *dss, const painter_t *painter,
+                      painter_t *out, int *split_order_out)
 {
-    PROFILE(dss_render, 0);
     double visibility;
-    dss_t *dss = (dss_t*)obj;
     painter_t painter2 = *painter;
     double lum, c, sep;
     int render_order, split_order;
 
-    if (dss->visible.value == 0.0) return 0;
-    if (!dss->hips) return 0;
+    if (dss->visible.value == 0.0) return false;
+    if (!dss->hips) return false;
 
     // For large FOV we use the milky way texture
     visibility = smoothstep(20 * DD2R, 10 * DD2R, core->fov);
@@ -52,7 +56,7 @@ static int dss_render(const obj_t *obj, const painter_t *painter)
     vec4_mul(c, painter2.color, painter2.color);
 
     // Don't even try to display if the brightness is too low
-    if (painter2.color[3] < 3.0 / 255) return 0;
+    if (painter2.color[3] < 3.0 / 255) return false;
 
     /*
      * Compute split order.
@@ -69,8 +73,50 @@ static int dss_render(const obj_t *obj, const painter_t *painter)
                       VEC(0, 0, -1)));
     split_order = mix(11, 4, sep / (M_PI / 2));
     render_order = hips_get_render_order(dss->hips, painter, 2 * M_PI);
-    split_order = min(split_order, render_order + 4);
+    split_order = min(split_order, render_order + 4 -
+                                   (int)round(painter->degrade * 2));
+
+    *out = painter2;
+    *split_order_out = split_order;
+    return true;
+}
 
+/*
+ * Function: dss_get_layer
+ * Get the dss survey to render it in a shared pass with another survey.
+ *
+ * If this returns true, the caller is responsible for rendering the
+ * survey, and the dss module will skip it for the current frame.
+ *
+ * Parameters:
+ *   obj         - The dss module.
+ *   painter     - The current frame painter.
+ *   hips        - Output of the dss survey.
+ *   out         - Output of the painter to use for the survey.
+ *   split_order - Output of the split order to use for the survey.
+ */
+bool dss_get_layer(obj_t *obj, const painter_t *painter, hips_t **hips,
+                   painter_t *out, int *split_order)
+{
+    dss_t *dss = (dss_t*)obj;
+    if (!get_layer(dss, painter, out, split_order)) return false;
+    *hips = dss->hips;
+    dss->shared = true;
+    return true;
+}
+
+static int dss_render(const obj_t *obj, const painter_t *painter)
+{
+    PROFILE(dss_render, 0);
+    dss_t *dss = (dss_t*)obj;
+    painter_t painter2;
+    int split_order;
+
+    if (dss->shared) {
+        dss->shared = false;
+        return 0;
+    }
+    if (!get_layer(dss, painter, &painter2, &split_order)) return 0;
     hips_render(dss->hips, &painter2, 2 * M_PI, split_order);
     return 0;
 }
@@ -106,7 +152,7 @@ static int dss_add_data_source(
 static obj_klass_t dss_klass = {
     .id = "dss",
     .size = sizeof(dss_t),
-    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE,
+    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_UPDATE_PARALLEL,
     .init = dss_init,
     .update = dss_update,
     .render = dss_render,
@@ -11,24 +11,62 @@
 
 #include "earcut.h"
 #include "geojson_parser.h"
+#include "utils/json_expression.h"
+
+// Nside of the healpix cells used to index the meshes.
+#define INDEX_NSIDE 4
+#define INDEX_NB_CELLS (12 * INDEX_NSIDE * INDEX_NSIDE)
+
+// Meshes smaller than this radius (in pixels) are rendered with the low
+// resolution lines only.
+#define LOD_SIZE 0.5
+
+// Maximum number of vertices in each ring of the low resolution lines.
+#define LOD_RING_SIZE 5
+
+// Set in the retained buffer id of the low resolution meshes.
+#define LOD_ID_FLAG (1ULL << 63)
+
+// Number of jobs used to triangulate the polygons in the worker pool.
+#define TRIANGULATE_NB_JOBS 4
+
+// Maximum number of rings in a polygon.
+#define MAX_RINGS 8
+
+// Maximum number of vertices in a batch, so that we can still use 16 bits
+// indices.
+#define BATCH_MAX_VERTICES (1 << 16)
 
 typedef struct mesh mesh_t;
 typedef struct feature feature_t;
+typedef struct batch batch_t;
 
 struct mesh {
     mesh_t      *next, *prev;
+    uint64_t    id; // Uniq id, so that the renderer can retain the buffers.
     double      bounding_cap[4];
+    int         cell; // Index cell of the bounding cap center.
     int         vertices_count;
     double      (*vertices)[3];
     int         triangles_count; // Number of triangles * 3.
     uint16_t    *triangles;
     int         lines_count; // Number of lines * 2.
     uint16_t    *lines;
+    int         lod_lines_count; // Number of low resolution lines * 2.
+    uint16_t    *lod_lines;
+
+    // Polygon rings to triangulate.  See <mesh_triangulate>.
+    int         rings_count;
+    int         rings_ofs;
+    int         rings_size[MAX_RINGS];
+    bool        triangulated;
 };
 
 struct feature {
     obj_t       obj;
     feature_t   *next, *prev;
+    const json_value *json; // Feature data, used to evaluate the filter.
+    bool        hidden;     // Set if filtered out.
     mesh_t      *meshes;
     int         frame;
     float       fill_color[4];
@@ -40,15 +78,56 @@ struct feature {
     float       text_offset[2];
 };
 
+/*
+ * Type: batch_t
+ * All the visible meshes of a cell that share the same style, merged into
+ * a single mesh, so that we render them with only a few draw calls.
+ *
+ * See <image_update_batches>.
+ */
+struct batch {
+    batch_t     *next, *prev;
+    mesh_t      mesh;   // Merged meshes, with the same index cell.
+    struct {
+        int     cell;
+        float   fill_color[4];
+        float   stroke_color[4];
+        float   stroke_width;
+    } style;            // Hash key.
+    UT_hash_handle  hh; // Only used while we build the batches.
+};
+
 typedef struct image {
     obj_t       obj;
 
     json_value  *geojson;
     json_value  *filter;
+    json_expression_t *filter_expr; // Compiled filter.
     bool        dirty;
+    bool        filter_dirty;
 
     feature_t   *features;
     int         frame;
+
+    // Bounding cap of all the meshes in each healpix cell, so that we can
+    // skip the clipped cells without testing each mesh.
+    struct {
+        int     count;
+        double  cap[4];
+    } cells[INDEX_NB_CELLS];
+
+    // Triangulation of the polygons in the background after a data change.
+    struct {
+        bool    running;
+        int     nb_meshes;
+        mesh_t  **meshes;
+        job_t   jobs[TRIANGULATE_NB_JOBS];
+    } triangulate;
+
+    // Merged meshes actually rendered.
+    batch_t     *batches;
+    bool        batches_dirty;
+    bool        batches_triangulated; // Set if the batches have the fills.
 } image_t;
 
 
@@ -108,6 +187,28 @@ static int image_init(obj_t *obj, json_value *args)
     return 0;
 }
 
+// Return a new uniq id for the renderer retained buffers.
+static uint64_t mesh_gen_id(void)
+{
+    static uint64_t g_id = 1;
+    return g_id++;
+}
+
+static mesh_t *mesh_create(void)
+{
+    mesh_t *mesh = calloc(1, sizeof(*mesh));
+    mesh->id = mesh_gen_id();
+    return mesh;
+}
+
+static void mesh_free_buffers(mesh_t *mesh)
+{
+    free(mesh->vertices);
+    free(mesh->triangles);
+    free(mesh->lines);
+    free(mesh->lod_lines);
+}
+
 static int mesh_add_vertices(mesh_t *mesh, int count, double (*verts)[2])
 {
     int i, ofs;
@@ -127,7 +228,7 @@ static int mesh_add_vertices(mesh_t *mesh, int count, double (*verts)[2])
 
 static void mesh_add_line(mesh_t *mesh, int ofs, int size)
 {
-    int i;
+    int i, step, n;
     mesh->lines = realloc(mesh->lines, (mesh->lines_count + (size - 1) * 2) *
                           sizeof(*mesh->lines));
     for (i = 0; i < size - 1; i++) {
@@ -135,10 +236,30 @@ static void mesh_add_line(mesh_t *mesh, int ofs, int size)
         mesh->lines[mesh->lines_count + i * 2 + 1] = ofs + i + 1;
     }
     mesh->lines_count += (size - 1) * 2;
+
+    // Low resolution version, that only keeps some of the vertices, plus
+    // the last one.
+    step = (size + LOD_RING_SIZE - 3) / (LOD_RING_SIZE - 1);
+    step = max(step, 1);
+    n = (size - 2) / step + 1; // Number of lines.
+    mesh->lod_lines = realloc(mesh->lod_lines,
+            (mesh->lod_lines_count + n * 2) * sizeof(*mesh->lod_lines));
+    for (i = 0; i < n; i++) {
+        mesh->lod_lines[mesh->lod_lines_count + i * 2 + 0] = ofs + i * step;
+        mesh->lod_lines[mesh->lod_lines_count + i * 2 + 1] =
+            ofs + min((i + 1) * step, size - 1);
+    }
+    mesh->lod_lines_count += n * 2;
 }
 
-static void mesh_add_poly(mesh_t *mesh, int nb_rings,
-                          const int ofs, const int *size)
+/*
+ * Function: mesh_triangulate
+ * Triangulate the polygon rings of a mesh.
+ *
+ * This only uses the mesh data, so it can run in a worker thread.  The
+ * triangles buffer is allocated beforehand by <mesh_set_poly>.
+ */
+static void mesh_triangulate(mesh_t *mesh)
 {
     int r, i, j = 0, triangles_size;
     double rot[3][3], p[3];
@@ -146,38 +267,63 @@ static void mesh_add_poly(mesh_t *mesh, int nb_rings,
     const uint16_t *triangles;
     earcut_t *earcut;
 
+    if (mesh->triangulated) return;
     earcut = earcut_new();
     // Triangulate the shape.
     // First we rotate the points so that they are centered around the
     // origin.
     create_rotation_between_vecs(rot, mesh->bounding_cap, VEC(1, 0, 0));
 
-    for (r = 0; r < nb_rings; r++) {
-        centered_lonlat = calloc(size[r], sizeof(*centered_lonlat));
-        for (i = 0; i < size[r]; i++) {
-            mat3_mul_vec3(rot, mesh->vertices[j++], p);
+    for (r = 0; r < mesh->rings_count; r++) {
+        centered_lonlat = calloc(mesh->rings_size[r],
+                                 sizeof(*centered_lonlat));
+        for (i = 0; i < mesh->rings_size[r]; i++) {
+            mat3_mul_vec3(rot, mesh->vertices[mesh->rings_ofs + j++], p);
             c2lonlat(p, centered_lonlat[i]);
         }
-        earcut_add_poly(earcut, size[r], centered_lonlat);
+        earcut_add_poly(earcut, mesh->rings_size[r], centered_lonlat);
         free(centered_lonlat);
     }
 
     triangles = earcut_triangulate(earcut, &triangles_size);
-    mesh->triangles = realloc(mesh->triangles,
-            (mesh->triangles_count + triangles_size) *
-            sizeof(*mesh->triangles));
+    assert(triangles_size <= mesh->triangles_count);
+    triangles_size = min(triangles_size, mesh->triangles_count);
     for (i = 0; i < triangles_size; i++) {
-        mesh->triangles[mesh->triangles_count + i] = ofs + triangles[i];
+        mesh->triangles[i] = mesh->rings_ofs + triangles[i];
     }
-    mesh->triangles_count += triangles_size;
+    mesh->triangles_count = triangles_size;
+    mesh->triangulated = true;
     earcut_delete(earcut);
 }
 
+/*
+ * Function: mesh_set_poly
+ * Set the polygon rings of a mesh, to be triangulated later.
+ *
+ * We allocate the triangles buffer for the maximum number of triangles,
+ * that is n + 2h - 2, for n vertices and h holes.
+ */
+static void mesh_set_poly(mesh_t *mesh, int nb_rings,
+                          const int ofs, const int *size)
+{
+    int r, n = 0;
+    assert(nb_rings <= MAX_RINGS);
+    mesh->rings_count = nb_rings;
+    mesh->rings_ofs = ofs;
+    for (r = 0; r < nb_rings; r++) {
+        mesh->rings_size[r] = size[r];
+        n += size[r];
+    }
+    mesh->triangles_count = max(0, 3 * (n + 2 * (nb_rings - 1) - 2));
+    mesh->triangles = malloc(mesh->triangles_count *
+                             sizeof(*mesh->triangles));
+}
+
 static void feature_add_geo(feature_t *feature, const geojson_geometry_t *geo)
 {
     const double (*coordinates)[2];
     int i, size, ofs;
-    int rings_ofs = 0, rings_size[8];
+    int rings_ofs = 0, rings_size[MAX_RINGS];
     mesh_t *mesh;
     geojson_geometry_t poly;
 
@@ -187,7 +333,7 @@ static void feature_add_geo(feature_t *feature, const geojson_geometry_t *geo)
         size = geo->linestring.size;
         break;
     case GEOJSON_POLYGON:
-        mesh = calloc(1, sizeof(*mesh));
+        mesh = mesh_create();
         for (i = 0; i < geo->polygon.size; i++) {
             size = geo->polygon.rings[i].size;
             ofs = mesh_add_vertices(mesh, size,
@@ -196,7 +342,7 @@ static void feature_add_geo(feature_t *feature, const geojson_geometry_t *geo)
             mesh_add_line(mesh, ofs, size);
             rings_size[i] = size;
         }
-        mesh_add_poly(mesh, geo->polygon.size, rings_ofs, rings_size);
+        mesh_set_poly(mesh, geo->polygon.size, rings_ofs, rings_size);
         DL_APPEND(feature->meshes, mesh);
         return;
     case GEOJSON_POINT:
@@ -214,17 +360,32 @@ static void feature_add_geo(feature_t *feature, const geojson_geometry_t *geo)
         assert(false);
         return;
     }
-    mesh = calloc(1, sizeof(*mesh));
+    mesh = mesh_create();
     ofs = mesh_add_vertices(mesh, size, coordinates);
     mesh_add_line(mesh, ofs, size);
     DL_APPEND(feature->meshes, mesh);
 }
 
-static void add_geojson_feature(image_t *image,
-                                const geojson_feature_t *geo_feature)
+static void index_add_mesh(image_t *image, mesh_t *mesh);
+
+/*
+ * Function: create_feature
+ * Create a new feature and index its meshes.
+ *
+ * The feature is not added to the image features list.
+ *
+ * Parameters:
+ *   image       - The geojson image.
+ *   geo_feature - The parsed feature.
+ *   json        - The feature json data, owned by the image data.
+ */
+static feature_t *create_feature(image_t *image,
+                                 const geojson_feature_t *geo_feature,
+                                 const json_value *json)
 {
     static uint32_t g_id = 1;
     feature_t *feature;
+    mesh_t *mesh;
 
     feature = (void*)obj_create("geojson-feature", NULL, NULL, NULL);
     feature->frame = image->frame;
@@ -242,7 +403,12 @@ static void add_geojson_feature(image_t *image,
     vec2_copy(geo_feature->properties.text_offset, feature->text_offset);
 
     feature_add_geo(feature, &geo_feature->geometry);
-    DL_APPEND(image->features, feature);
+    feature->json = json;
+    feature->hidden = image->filter_expr &&
+        !json_expression_test(image->filter_expr, json);
+    for (mesh = feature->meshes; mesh; mesh = mesh->next)
+        index_add_mesh(image, mesh);
+    return feature;
 }
 
 static void feature_del(obj_t *obj)
@@ -253,9 +419,7 @@ static void feature_del(obj_t *obj)
     while (feature->meshes) {
         mesh = feature->meshes;
         DL_DELETE(feature->meshes, mesh);
-        free(mesh->vertices);
-        free(mesh->triangles);
-        free(mesh->lines);
+        mesh_free_buffers(mesh);
         free(mesh);
     }
     free(feature->title);
@@ -276,6 +440,17 @@ static int feature_get_info(const obj_t *obj, const observer_t *obs,
     }
 }
 
+// Remove a feature from the list and the index, and release it.
+static void remove_feature(image_t *image, feature_t *feature)
+{
+    mesh_t *mesh;
+    for (mesh = feature->meshes; mesh; mesh = mesh->next)
+        image->cells[mesh->cell].count--;
+    DL_DELETE(image->features, feature);
+    obj_release(&feature->obj);
+    image->batches_dirty = true;
+}
+
 static void remove_all_features(image_t *image)
 {
     feature_t *feature;
@@ -285,6 +460,7 @@ static void remove_all_features(image_t *image)
         DL_DELETE(image->features, feature);
         obj_release(&feature->obj);
     }
+    image->batches_dirty = true;
 }
 
 static json_value *data_fn(obj_t *obj, const attribute_t *attr,
@@ -304,69 +480,538 @@ static json_value *filter_fn(obj_t *obj, const attribute_t *attr,
     image_t *image = (void*)obj;
     if (!args) return json_copy(image->filter);
     if (image->filter) json_builder_free(image->filter);
+    json_expression_delete(image->filter_expr);
     image->filter = json_copy(args);
-    image->dirty = true;
+    image->filter_expr = json_expression_compile(image->filter);
+    image->filter_dirty = true;
     return NULL;
 }
 
+/*
+ * Function: image_apply_filter
+ * Update the visibility of all the features after a filter change.
+ *
+ * The features are kept in memory, so that we don't have to parse and
+ * triangulate the data again.
+ */
+static void image_apply_filter(image_t *image)
+{
+    feature_t *feature;
+
+    image->filter_dirty = false;
+    for (feature = image->features; feature; feature = feature->next) {
+        feature->hidden = image->filter_expr &&
+            !json_expression_test(image->filter_expr, feature->json);
+    }
+    image->batches_dirty = true;
+}
+
+// Add a mesh into the healpix cells index.
+static void index_add_mesh(image_t *image, mesh_t *mesh)
+{
+    double theta, phi, center[3], r;
+    typeof(image->cells[0]) *cell;
+
+    eraC2s(mesh->bounding_cap, &phi, &theta);
+    healpix_ang2pix(INDEX_NSIDE, M_PI / 2 - theta, eraAnp(phi), &mesh->cell);
+    cell = &image->cells[mesh->cell];
+    if (!cell->count) {
+        healpix_pix2vec(INDEX_NSIDE, mesh->cell, center);
+        vec4_set(cell->cap, VEC3_SPLIT(center), 1.0);
+    }
+    cell->count++;
+    // Extend the cell cap so that it contains the mesh cap.
+    r = eraSepp(cell->cap, mesh->bounding_cap) +
+        acos(clamp(mesh->bounding_cap[3], -1.0, 1.0));
+    cell->cap[3] = min(cell->cap[3], cos(min(r, M_PI)));
+}
+
+static int triangulate_job(job_t *job, double deadline)
+{
+    image_t *image = job->user;
+    int i, k, n = image->triangulate.nb_meshes;
+    k = job - image->triangulate.jobs;
+    for (i = k * n / TRIANGULATE_NB_JOBS;
+         i < (k + 1) * n / TRIANGULATE_NB_JOBS; i++)
+    {
+        mesh_triangulate(image->triangulate.meshes[i]);
+    }
+    return 1;
+}
+
+/*
+ * Function: image_triangulate_start
+ * Start the triangulation of all the polygons in the worker pool.
+ */
+static void image_triangulate_start(image_t *image)
+{
+    feature_t *feature;
+    mesh_t *mesh;
+    int i, n = 0;
+    typeof(image->triangulate) *tri = &image->triangulate;
+
+    assert(!tri->running);
+    for (feature = image->features; feature; feature = feature->next) {
+        for (mesh = feature->meshes; mesh; mesh = mesh->next)
+            if (mesh->rings_count) n++;
+    }
+    if (!n) return;
+    tri->meshes = malloc(n * sizeof(*tri->meshes));
+    tri->nb_meshes = 0;
+    for (feature = image->features; feature; feature = feature->next) {
+        for (mesh = feature->meshes; mesh; mesh = mesh->next)
+            if (mesh->rings_count) tri->meshes[tri->nb_meshes++] = mesh;
+    }
+    for (i = 0; i < TRIANGULATE_NB_JOBS; i++) {
+        job_init(&tri->jobs[i], triangulate_job, image, JOB_THREAD_SAFE);
+        job_iter(&tri->jobs[i]);
+    }
+    tri->running = true;
+}
+
+/*
+ * Function: image_triangulate_stop
+ * Stop the background triangulation.
+ *
+ * Parameters:
+ *   finish - If set, triangulate the remaining polygons synchronously.
+ *            Otherwise they are left without triangles.
+ */
+static void image_triangulate_stop(image_t *image, bool finish)
+{
+    int i;
+    typeof(image->triangulate) *tri = &image->triangulate;
+
+    if (!tri->running) return;
+    for (i = 0; i < TRIANGULATE_NB_JOBS; i++)
+        job_cancel(&tri->jobs[i]);
+    if (finish) {
+        for (i = 0; i < tri->nb_meshes; i++)
+            mesh_triangulate(tri->meshes[i]);
+    }
+    free(tri->meshes);
+    tri->meshes = NULL;
+    tri->nb_meshes = 0;
+    tri->running = false;
+}
+
+// Check if the background triangulation is done.
+static bool image_triangulate_iter(image_t *image)
+{
+    int i;
+    bool done = true;
+    typeof(image->triangulate) *tri = &image->triangulate;
+
+    if (!tri->running) return true;
+    for (i = 0; i < TRIANGULATE_NB_JOBS; i++)
+        done = job_iter(&tri->jobs[i]) && done;
+    if (done) image_triangulate_stop(image, false);
+    return done;
+}
+
 static int image_update(image_t *image)
 {
     geojson_t *geojson;
+    const json_value *features;
+    feature_t *feature;
     int i;
 
     if (!image->dirty) return 0;
     image->dirty = false;
+    image_triangulate_stop(image, false);
     remove_all_features(image);
-    geojson = geojson_parse(image->geojson, image->filter);
+    memset(image->cells, 0, sizeof(image->cells));
+    geojson = geojson_parse(image->geojson, NULL);
     assert(geojson);
+    features = json_get_attr(image->geojson, "features", json_array);
     for (i = 0; i < geojson->nb_features; i++) {
-        add_geojson_feature(image, &geojson->features[i]);
+        feature = create_feature(image, &geojson->features[i],
+                                 features ? features->u.array.values[i] :
+                                            image->geojson);
+        DL_APPEND(image->features, feature);
     }
     geojson_delete(geojson);
+    image->filter_dirty = false;
+    image_triangulate_start(image);
     return 0;
 }
 
+// Compare two geojson feature ids.
+static bool ids_equal(const json_value *a, const json_value *b)
+{
+    if (!a || !b || a->type != b->type) return false;
+    switch (a->type) {
+    case json_string:
+        return strcmp(a->u.string.ptr, b->u.string.ptr) == 0;
+    case json_integer:
+        return a->u.integer == b->u.integer;
+    case json_double:
+        return a->u.dbl == b->u.dbl;
+    default:
+        return false;
+    }
+}
+
+static feature_t *find_feature(const image_t *image, const json_value *id)
+{
+    feature_t *feature;
+    if (!id) return NULL;
+    for (feature = image->features; feature; feature = feature->next) {
+        if (ids_equal(json_get_attr((json_value*)feature->json, "id", 0), id))
+            return feature;
+    }
+    return NULL;
+}
+
+/*
+ * Function: get_features_array
+ * Return the features array of the image data.
+ *
+ * If the data is a single feature, or is not set, it is first converted to
+ * a FeatureCollection.
+ */
+static json_value *get_features_array(image_t *image)
+{
+    json_value *features, *data = image->geojson;
+    const char *type;
+
+    features = json_get_attr(data, "features", json_array);
+    if (features) return features;
+    image->geojson = json_object_new(0);
+    json_object_push(image->geojson, "type",
+                     json_string_new("FeatureCollection"));
+    features = json_object_push(image->geojson, "features",
+                                json_array_new(0));
+    type = json_get_attr_s(data, "type");
+    if (type && strcmp(type, "Feature") == 0)
+        json_array_push(features, data);
+    else if (data)
+        json_builder_free(data);
+    return features;
+}
+
+// Return the index of a value in a json array, or -1.
+static int array_index(const json_value *array, const json_value *value)
+{
+    int i;
+    for (i = 0; i < array->u.array.length; i++) {
+        if (array->u.array.values[i] == value) return i;
+    }
+    return -1;
+}
+
+// Add a single feature, or replace the feature with the same id.
+static void add_feature(image_t *image, json_value *json)
+{
+    geojson_t *geojson;
+    json_value *features, *copy;
+    feature_t *feature, *old;
+    mesh_t *mesh;
+    int i;
+
+    geojson = geojson_parse(json, NULL);
+    if (!geojson) return;
+    if (geojson->nb_features != 1) {
+        LOG_W("Expected a single geojson feature");
+        geojson_delete(geojson);
+        return;
+    }
+    features = get_features_array(image);
+    copy = json_copy(json);
+    old = find_feature(image, json_get_attr(json, "id", 0));
+    feature = create_feature(image, &geojson->features[0], copy);
+    for (mesh = feature->meshes; mesh; mesh = mesh->next)
+        mesh_triangulate(mesh);
+    geojson_delete(geojson);
+
+    image->batches_dirty = true;
+    if (!old) {
+        json_array_push(features, copy);
+        DL_APPEND(image->features, feature);
+        return;
+    }
+    i = array_index(features, old->json);
+    assert(i >= 0);
+    DL_PREPEND_ELEM(image->features, old, feature);
+    remove_feature(image, old);
+    json_builder_free(features->u.array.values[i]);
+    features->u.array.values[i] = copy;
+    copy->parent = features;
+}
+
+/*
+ * Function: add_features_fn
+ * Add some features to the data, without rebuilding the other ones.
+ *
+ * The argument can be a feature, an array of features, or a
+ * FeatureCollection.  Features with the same id as an existing feature
+ * replace it.
+ */
+static json_value *add_features_fn(obj_t *obj, const attribute_t *attr,
+                                   const json_value *args)
+{
+    image_t *image = (void*)obj;
+    json_value *list = (json_value*)args;
+    int i;
+
+    image_update(image);
+    image_triangulate_stop(image, true);
+    if (json_get_attr(list, "features", json_array))
+        list = json_get_attr(list, "features", json_array);
+    if (!list || list->type != json_array) {
+        add_feature(image, list);
+        return NULL;
+    }
+    for (i = 0; i < list->u.array.length; i++)
+        add_feature(image, list->u.array.values[i]);
+    return NULL;
+}
+
+// Remove the feature with the given id from the data.
+static void remove_feature_by_id(image_t *image, const json_value *id)
+{
+    feature_t *feature;
+    json_value *features;
+    int i;
+
+    feature = find_feature(image, id);
+    if (!feature) return;
+    features = get_features_array(image);
+    i = array_index(features, feature->json);
+    assert(i >= 0);
+    remove_feature(image, feature);
+    json_builder_free(features->u.array.values[i]);
+    memmove(features->u.array.values + i, features->u.array.values + i + 1,
+            (features->u.array.length - i - 1) * sizeof(json_value*));
+    features->u.array.length--;
+}
+
+/*
+ * Function: remove_features_fn
+ * Remove some features from the data, by id.
+ *
+ * The argument can be a single id or an array of ids.
+ */
+static json_value *remove_features_fn(obj_t *obj, const attribute_t *attr,
+                                      const json_value *args)
+{
+    image_t *image = (void*)obj;
+    int i;
+
+    image_update(image);
+    image_triangulate_stop(image, true);
+    if (!args) return NULL;
+    if (args->type != json_array) {
+        remove_feature_by_id(image, args);
+        return NULL;
+    }
+    for (i = 0; i < args->u.array.length; i++)
+        remove_feature_by_id(image, args->u.array.values[i]);
+    return NULL;
+}
+
+static void remove_all_batches(image_t *image)
+{
+    batch_t *batch;
+
+    while (image->batches) {
+        batch = image->batches;
+        DL_DELETE(image->batches, batch);
+        mesh_free_buffers(&batch->mesh);
+        free(batch);
+    }
+}
+
+// Append a mesh buffers into a batch mesh, with the indices offset.
+static void batch_add_mesh(batch_t *batch, const mesh_t *mesh,
+                           bool triangulated)
+{
+    mesh_t *dst = &batch->mesh;
+    int i, ofs = dst->vertices_count;
+
+    memcpy(dst->vertices + ofs, mesh->vertices,
+           mesh->vertices_count * sizeof(*mesh->vertices));
+    dst->vertices_count += mesh->vertices_count;
+    for (i = 0; triangulated && i < mesh->triangles_count; i++)
+        dst->triangles[dst->triangles_count++] = ofs + mesh->triangles[i];
+    for (i = 0; i < mesh->lines_count; i++)
+        dst->lines[dst->lines_count++] = ofs + mesh->lines[i];
+    for (i = 0; i < mesh->lod_lines_count; i++)
+        dst->lod_lines[dst->lod_lines_count++] = ofs + mesh->lod_lines[i];
+}
+
+/*
+ * Function: image_update_batches
+ * Merge the meshes of the visible features into batches.
+ *
+ * Each batch gets all the meshes of a cell with the same fill and stroke
+ * style, up to BATCH_MAX_VERTICES vertices.  This is done in two passes:
+ * first we assign each mesh to a batch and count the buffers sizes, then
+ * we copy the data.
+ *
+ * Parameters:
+ *   image        - The geojson image.
+ *   triangulated - Set if all the polygons are triangulated, in which case
+ *                  the batches also get the fill triangles.
+ */
+static void image_update_batches(image_t *image, bool triangulated)
+{
+    const feature_t *feature;
+    const mesh_t *mesh;
+    batch_t *batch, *hash = NULL, key, **map;
+    mesh_t *dst;
+    int n = 0, i;
+
+    remove_all_batches(image);
+    image->batches_dirty = false;
+    image->batches_triangulated = triangulated;
+
+    for (feature = image->features; feature; feature = feature->next) {
+        if (feature->hidden) continue;
+        DL_COUNT(feature->meshes, mesh, i);
+        n += i;
+    }
+    if (!n) return;
+    map = malloc(n * sizeof(*map));
+
+    // First pass: assign the meshes to the batches.
+    memset(&key, 0, sizeof(key)); // Make sure the padding is zero.
+    n = 0;
+    for (feature = image->features; feature; feature = feature->next) {
+        if (feature->hidden) continue;
+        vec4_copy(feature->fill_color, key.style.fill_color);
+        vec4_copy(feature->stroke_color, key.style.stroke_color);
+        key.style.stroke_width = feature->stroke_width;
+        for (mesh = feature->meshes; mesh; mesh = mesh->next) {
+            key.style.cell = mesh->cell;
+            HASH_FIND(hh, hash, &key.style, sizeof(key.style), batch);
+            if (batch && batch->mesh.vertices_count + mesh->vertices_count >
+                            BATCH_MAX_VERTICES) {
+                HASH_DELETE(hh, hash, batch);
+                batch = NULL;
+            }
+            if (!batch) {
+                batch = calloc(1, sizeof(*batch));
+                batch->style = key.style;
+                batch->mesh.id = mesh_gen_id();
+                batch->mesh.cell = mesh->cell;
+                HASH_ADD(hh, hash, style, sizeof(batch->style), batch);
+                DL_APPEND(image->batches, batch);
+            }
+            batch->mesh.vertices_count += mesh->vertices_count;
+            if (triangulated)
+                batch->mesh.triangles_count += mesh->triangles_count;
+            batch->mesh.lines_count += mesh->lines_count;
+            batch->mesh.lod_lines_count += mesh->lod_lines_count;
+            map[n++] = batch;
+        }
+    }
+    HASH_CLEAR(hh, hash);
+
+    // Second pass: copy the meshes data.
+    DL_FOREACH(image->batches, batch) {
+        dst = &batch->mesh;
+        dst->vertices = malloc(dst->vertices_count * sizeof(*dst->vertices));
+        dst->triangles = malloc(dst->triangles_count *
+                                sizeof(*dst->triangles));
+        dst->lines = malloc(dst->lines_count * sizeof(*dst->lines));
+        dst->lod_lines = malloc(dst->lod_lines_count *
+                                sizeof(*dst->lod_lines));
+        dst->vertices_count = 0;
+        dst->triangles_count = 0;
+        dst->lines_count = 0;
+        dst->lod_lines_count = 0;
+    }
+    n = 0;
+    for (feature = image->features; feature; feature = feature->next) {
+        if (feature->hidden) continue;
+        for (mesh = feature->meshes; mesh; mesh = mesh->next)
+            batch_add_mesh(map[n++], mesh, triangulated);
+    }
+    free(map);
+
+    DL_FOREACH(image->batches, batch) {
+        compute_bounding_cap(batch->mesh.vertices_count, batch->mesh.vertices,
+                             batch->mesh.bounding_cap);
+    }
+}
+
 static int image_render(const obj_t *obj, const painter_t *painter_)
 {
     const image_t *image = (void*)obj;
     painter_t painter = *painter_;
     const feature_t *feature;
-    double pos[2], ofs[2];
-    int frame = image->frame;
+    const batch_t *batch;
+    double pos[2], ofs[2], lod_cos;
+    int frame = image->frame, i;
     const mesh_t *mesh;
+    bool visible[INDEX_NB_CELLS], triangulated;
 
     if (image->dirty)
         image_update((image_t*) image);
+    if (image->filter_dirty)
+        image_apply_filter((image_t*) image);
+    // Until the polygons are triangulated we only render the lines.
+    triangulated = image_triangulate_iter((image_t*) image);
+    if (image->batches_dirty || triangulated != image->batches_triangulated)
+        image_update_batches((image_t*) image, triangulated);
+
+    for (i = 0; i < INDEX_NB_CELLS; i++) {
+        visible[i] = image->cells[i].count &&
+            !painter_is_cap_clipped(&painter, frame, image->cells[i].cap);
+    }
+    lod_cos = cos(core_get_apparent_angle_for_point(painter.proj, LOD_SIZE));
+
+    DL_FOREACH(image->batches, batch) {
+        mesh = &batch->mesh;
+        if (!visible[mesh->cell]) continue;
+
+        // Very small batch: only render the low resolution lines.
+        if (mesh->bounding_cap[3] > lod_cos) {
+            if (!batch->style.stroke_color[3]) continue;
+            vec4_copy(batch->style.stroke_color, painter.color);
+            painter.lines_width = batch->style.stroke_width;
+            paint_mesh_retained(&painter, frame, MODE_LINES,
+                                mesh->id | LOD_ID_FLAG, 0,
+                                mesh->vertices_count, mesh->vertices,
+                                mesh->lod_lines_count, mesh->lod_lines,
+                                mesh->bounding_cap, 0);
+            continue;
+        }
+
+        if (batch->style.fill_color[3] && mesh->triangles_count) {
+            vec4_copy(batch->style.fill_color, painter.color);
+            paint_mesh_retained(&painter, frame, MODE_TRIANGLES,
+                                mesh->id, 0,
+                                mesh->vertices_count, mesh->vertices,
+                                mesh->triangles_count, mesh->triangles,
+                                mesh->bounding_cap, 0);
+        }
+
+        if (batch->style.stroke_color[3]) {
+            vec4_copy(batch->style.stroke_color, painter.color);
+            painter.lines_width = batch->style.stroke_width;
+            paint_mesh_retained(&painter, frame, MODE_LINES,
+                                mesh->id, 0,
+                                mesh->vertices_count, mesh->vertices,
+                                mesh->lines_count, mesh->lines,
+                                mesh->bounding_cap, 0);
+        }
+    }
 
     for (feature = image->features; feature; feature = feature->next) {
+        if (feature->hidden || !feature->title) continue;
         for (mesh = feature->meshes; mesh; mesh = mesh->next) {
-            if (feature->fill_color[3]) {
-                vec4_copy(feature->fill_color, painter.color);
-                paint_mesh(&painter, frame, MODE_TRIANGLES,
-                           mesh->vertices_count, mesh->vertices,
-                           mesh->triangles_count, mesh->triangles,
-                           mesh->bounding_cap, 0);
-            }
-
-            if (feature->stroke_color[3]) {
-                vec4_copy(feature->stroke_color, painter.color);
-                painter.lines_width = feature->stroke_width;
-                paint_mesh(&painter, frame, MODE_LINES,
-                           mesh->vertices_count, mesh->vertices,
-                           mesh->lines_count, mesh->lines,
-                           mesh->bounding_cap, 0);
-            }
-            if (feature->title) {
-                painter_project(&painter, frame, mesh->bounding_cap,
-                                true, false, pos);
-                vec2_copy(feature->text_offset, ofs);
-                vec2_rotate(feature->text_rotate, ofs, ofs);
-                vec2_add(pos, ofs, pos);
-                paint_text(&painter, feature->title, pos, feature->text_anchor,
-                           0, FONT_SIZE_BASE,
-                           VEC(VEC4_SPLIT(feature->stroke_color)),
-                           feature->text_rotate);
-            }
+            if (!visible[mesh->cell]) continue;
+            painter_project(&painter, frame, mesh->bounding_cap,
+                            true, false, pos);
+            vec2_copy(feature->text_offset, ofs);
+            vec2_rotate(feature->text_rotate, ofs, ofs);
+            vec2_add(pos, ofs, pos);
+            paint_text(&painter, feature->title, pos, feature->text_anchor,
+                       0, FONT_SIZE_BASE,
+                       VEC(VEC4_SPLIT(feature->stroke_color)),
+                       feature->text_rotate);
         }
     }
     return 0;
@@ -375,8 +1020,11 @@ static int image_render(const obj_t *obj, const painter_t *painter_)
 static void image_del(obj_t *obj)
 {
     image_t *image = (void*)obj;
+    image_triangulate_stop(image, false);
     remove_all_features(image);
+    remove_all_batches(image);
     if (image->filter) json_builder_free(image->filter);
+    json_expression_delete(image->filter_expr);
     if (image->geojson) json_builder_free(image->geojson);
 }
 
@@ -419,6 +1067,8 @@ static obj_klass_t image_klass = {
         PROPERTY(data, TYPE_JSON, .fn = data_fn),
         PROPERTY(filter, TYPE_JSON, .fn = filter_fn),
         PROPERTY(frame, TYPE_ENUM, MEMBER(image_t, frame)),
+        FUNCTION(add_features, .fn = add_features_fn),
+        FUNCTION(remove_features, .fn = remove_features_fn),
         {}
     },
 };
@@ -215,6 +215,7 @@ static void menu_main(void *user)
         gui_double("dim factor", &core->point_dim_factor, 0, 5, 1, NAN);
         gui_double("hints rad", &core->show_hints_radius, 0.1, 10, 1, NAN);
         gui_double_log("log lmaxmin", &core->lwmax_min, -100, 100, 2, NAN);
+        gui_double("lmax weight", &core->lwmax_weight, 0, 100, 1, NAN);
         gui_float_log("log p", &core->tonemapper.p, -100, 100, 0, NAN);
 
         DL_FOREACH(core->obj.children, module) {
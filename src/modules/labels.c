@@ -10,13 +10,27 @@
 #include "swe.h"
 
 
+// Labels hash table key.  Two labels are the same if they have the same
+// oid, size and text.
+typedef struct {
+    uint64_t oid;
+    double   size;
+    char     text[];      // Null terminated.
+} label_key_t;
+
 typedef struct label label_t;
 struct label
 {
     label_t *next, *prev;
+    UT_hash_handle hh;    // For the hash table of the labels.
+    label_key_t *key;     // Hash key, also contains the text.
+    int     key_len;
+    int     key_allocated;
     uint64_t oid;         // Optional unique id for the label.
-    char    *text;        // Original passed text.
+    char    *text;        // Original passed text (points into key).
     char    *render_text; // Processed text (can point to text).
+    char    *upper_text;  // Buffer for the uppercase text.
+    int     upper_allocated;
     double  pos[3];       // 3D position in the given frame.
     double  win_pos[2];   // 2D position on screen (px).
     int     frame;        // One of FRAME_XXX or -1 for 2D win position.
@@ -28,16 +42,85 @@ struct label
     int     align;        // Union of <ALIGN_FLAGS>.
     int     effects;      // Union of <TEXT_EFFECT_FLAGS>.
     fader_t fader;        // Use for auto fade-in/out of labels.
-    bool    skipped;      // Set when the label cannot be rendered.
+    uint32_t id;          // Changes when the label struct gets reused.
+    uint32_t views;       // Mask of the views it was added to this frame.
+    uint32_t last_views;  // Mask of the views of the last frame it was in.
 
     double  priority;     // Priority used in case of positioning conflicts.
                           // Higher value means higher priority.
-    double  bounds[4];
+
+    // Text bounds relative to the anchor point for each possible anchor,
+    // measured when the text or style changes.
+    float   extents[4][4];
+    int     nb_anchors;
+    int     extents_align;
+    int     extents_effects;
+
+    // Last layout solution: index of the anchor, or -1 if the label cannot
+    // be rendered, and vertical offset (px).
+    int     anchor;
+    float   dy;
 };
 
+/*
+ * Type: layout_entry_t
+ * Copy of a label used by the layout worker.
+ */
+typedef struct {
+    label_t     *label;     // Only accessed from the main thread.
+    uint32_t    id;
+    float       win_pos[2];
+    float       radius;
+    int         align;
+    bool        fading_out;
+    float       extents[4][4];
+    int         nb_anchors;
+    // Result.
+    int         anchor;
+    float       dy;
+    float       bounds[4];
+} layout_entry_t;
+
+// Size in pixel of the cells of the overlap test grid.
+#define GRID_CELL_SIZE 64
+#define GRID_MAX_SIZE 128
+
 typedef struct labels {
     obj_t obj;
     label_t *labels;
+    label_t *hash;        // Same labels, indexed by key.
+    label_t *pool;        // Deleted labels kept for reuse.
+    label_key_t *key;     // Buffer for the lookup key.
+    int     key_allocated;
+    uint32_t next_id;
+    int     view;         // Current view, see <labels_set_view>.
+    int     nb_views;
+
+    // The placement of the labels is solved in a worker, from a snapshot
+    // of the labels.  Meanwhile we keep rendering the previous solution,
+    // using the current labels positions.
+    struct {
+        worker_t        worker;
+        bool            running;
+        layout_entry_t  *entries;
+        int             nb;
+        int             allocated;
+        double          window_size[2];
+    } layout;
+
+    // Screen space grid of the placed entries for the overlap tests.  Each
+    // cell is a linked list of indices into the entries array.  Rebuilt
+    // at each layout, reusing the buffers.  Only used by the layout worker.
+    struct {
+        int     size[2];
+        int     cells[GRID_MAX_SIZE * GRID_MAX_SIZE]; // First entry or -1.
+        struct {
+            const layout_entry_t *entry;
+            int next;
+        }       *entries;
+        int     nb;
+        int     allocated;
+    } grid;
 } labels_t;
 
 static labels_t *g_labels = NULL;
@@ -47,148 +130,482 @@ void labels_reset(void)
     label_t *label, *tmp;
     DL_FOREACH_SAFE(g_labels->labels, label, tmp) {
         if (label->fader.target == false && label->fader.value == 0) {
+            // Keep the label and its buffers in the pool.
             DL_DELETE(g_labels->labels, label);
-            if (label->render_text != label->text) free(label->render_text);
-            free(label->text);
-            free(label);
+            HASH_DEL(g_labels->hash, label);
+            DL_APPEND(g_labels->pool, label);
         } else {
+            if (label->fader.target) label->last_views = label->views;
+            label->views = 0;
             label->fader.target = false;
         }
     }
 }
 
-static label_t *label_get(label_t *list, const char *txt, double size,
-                          uint64_t oid)
+void labels_set_view(int view, int nb_views)
+{
+    assert(view >= 0 && view < 32);
+    g_labels->view = view;
+    g_labels->nb_views = nb_views;
+}
+
+// Check if a label belongs to the current view.  The labels fading out
+// stay in the views where they were last added.
+static bool label_is_in_view(const label_t *label)
+{
+    uint32_t views;
+    if (g_labels->nb_views <= 1) return true;
+    views = label->fader.target ? label->views : label->last_views;
+    return views & (1u << g_labels->view);
+}
+
+// Make sure a buffer has at least a given size, keeping its content.
+static void *buf_reserve(void *buf, int *allocated, int size)
+{
+    if (size <= *allocated) return buf;
+    *allocated = max(size, *allocated * 2);
+    return realloc(buf, *allocated);
+}
+
+// Build the hash key of a label into a buffer.  Return the key length.
+static int label_make_key(label_key_t **key, int *allocated, const char *txt,
+                          double size, uint64_t oid)
+{
+    int len = sizeof(label_key_t) + strlen(txt) + 1;
+    *key = buf_reserve(*key, allocated, len);
+    // Clear the padding, since the key is compared with memcmp.
+    memset(*key, 0, sizeof(label_key_t));
+    (*key)->oid = oid;
+    (*key)->size = size;
+    strcpy((*key)->text, txt);
+    return len;
+}
+
+static label_t *label_get(const char *txt, double size, uint64_t oid)
 {
     label_t *label;
-    DL_FOREACH(list, label) {
-        if (oid != label->oid) continue;
-        if (label->size == size && strcmp(txt, label->text) == 0)
-            return label;
+    int len;
+    len = label_make_key(&g_labels->key, &g_labels->key_allocated, txt,
+                         size, oid);
+    HASH_FIND(hh, g_labels->hash, g_labels->key, len, label);
+    return label;
+}
+
+// Create a new label, or reuse one from the pool.
+static label_t *label_create(const char *txt, double size, uint64_t oid,
+                             int effects)
+{
+    label_t *label = g_labels->pool;
+    int len;
+
+    if (label) {
+        DL_DELETE(g_labels->pool, label);
+        // Only keep the buffers.
+        *label = (label_t) {
+            .key = label->key,
+            .key_allocated = label->key_allocated,
+            .upper_text = label->upper_text,
+            .upper_allocated = label->upper_allocated,
+        };
+    } else {
+        label = calloc(1, sizeof(*label));
     }
-    return NULL;
+    label->oid = oid;
+    label->id = ++g_labels->next_id;
+    label->anchor = -1;
+    fader_init(&label->fader, false);
+    label->key_len = label_make_key(&label->key, &label->key_allocated,
+                                    txt, size, oid);
+    label->render_text = label->text = label->key->text;
+    // Note: should be done by the painter directly.
+    if (effects & TEXT_UPPERCASE) {
+        len = strlen(txt) + 64;
+        label->upper_text = buf_reserve(label->upper_text,
+                                        &label->upper_allocated, len);
+        u8_upper(label->upper_text, txt, len);
+        label->render_text = label->upper_text;
+    }
+    HASH_ADD_KEYPTR(hh, g_labels->hash, label->key, label->key_len, label);
+    DL_APPEND(g_labels->labels, label);
+    return label;
 }
 
-static void label_get_bounds(const painter_t *painter, const label_t *label,
-                             int align, int effects, double bounds[4])
+// Anchors tried, in order, for the LABEL_AROUND labels.
+static const int ANCHORS_AROUND[4] = {
+    ALIGN_LEFT   | ALIGN_BOTTOM,
+    ALIGN_LEFT   | ALIGN_TOP,
+    ALIGN_RIGHT  | ALIGN_BOTTOM,
+    ALIGN_RIGHT  | ALIGN_TOP,
+};
+
+// Vertical nudges tried around a position before giving up on an anchor.
+static const float NUDGES[5] = {0, -2, 2, -4, -6};
+
+static int label_get_anchor_align(int align, int anchor)
 {
-    double border;
-    double pos[2];
-    vec2_copy(label->win_pos, pos);
-    border = label->radius;
-    if (label->align & LABEL_AROUND) border /= sqrt(2.0);
-    if (align & ALIGN_LEFT)    pos[0] += border;
-    if (align & ALIGN_RIGHT)   pos[0] -= border;
-    if (align & ALIGN_BOTTOM)  pos[1] -= border;
-    if (align & ALIGN_TOP)     pos[1] += border;
-    paint_text_bounds(painter, label->render_text, pos, align, effects,
-                      label->size, bounds);
+    return (align & LABEL_AROUND) ? ANCHORS_AROUND[anchor] : align;
 }
 
-static bool label_get_possible_bounds(const painter_t *painter,
-        const label_t *label, int i, double bounds[4])
+/*
+ * Measure the text bounds of a label for each of its possible anchors,
+ * relative to the anchor point.
+ *
+ * This is the only part of the layout that needs the font system, so we do
+ * it on the main thread, and only when the label text or style changes.
+ */
+static void label_update_extents(const painter_t *painter, label_t *label)
 {
-    const int anchors_around[] = {
-        ALIGN_LEFT   | ALIGN_BOTTOM,
-        ALIGN_LEFT   | ALIGN_TOP,
-        ALIGN_RIGHT  | ALIGN_BOTTOM,
-        ALIGN_RIGHT  | ALIGN_TOP};
-
-    if (!(label->align & LABEL_AROUND)) {
-        if (i != 0) return false;
-        label_get_bounds(painter, label, label->align, label->effects, bounds);
-        return true;
-    }
-    if (label->align & LABEL_AROUND) {
-        if (i >= 4) return false;
-        label_get_bounds(painter, label, anchors_around[i], label->effects,
-                         bounds);
+    int i;
+    const double pos[2] = {0, 0};
+    double bounds[4];
+    if (    label->nb_anchors && label->extents_align == label->align &&
+            label->extents_effects == label->effects)
+        return;
+    label->nb_anchors = (label->align & LABEL_AROUND) ? 4 : 1;
+    for (i = 0; i < label->nb_anchors; i++) {
+        paint_text_bounds(painter, label->render_text, pos,
+                          label_get_anchor_align(label->align, i),
+                          label->effects, label->size, bounds);
+        vec4_to_float(bounds, label->extents[i]);
     }
-    return true;
+    label->extents_align = label->align;
+    label->extents_effects = label->effects;
 }
 
-static bool bounds_overlap(const double a[4], const double b[4])
+/*
+ * Compute the bounds of a label on screen for a given anchor.
+ *
+ * Can be called from any thread.  The layout is only screen space
+ * arithmetic, so it is done in single precision.
+ */
+static void get_anchor_bounds(const float win_pos[2], float radius,
+                              int align, int anchor, float dy,
+                              const float extents[4], float bounds[4])
 {
-    static const double margin = -5;
+    float border = radius, pos[2];
+    const int anchor_align = label_get_anchor_align(align, anchor);
+    vec2_copy(win_pos, pos);
+    if (align & LABEL_AROUND) border /= sqrtf(2.0f);
+    if (anchor_align & ALIGN_LEFT)    pos[0] += border;
+    if (anchor_align & ALIGN_RIGHT)   pos[0] -= border;
+    if (anchor_align & ALIGN_BOTTOM)  pos[1] -= border;
+    if (anchor_align & ALIGN_TOP)     pos[1] += border;
+    bounds[0] = pos[0] + extents[0];
+    bounds[1] = pos[1] + extents[1] + dy;
+    bounds[2] = pos[0] + extents[2];
+    bounds[3] = pos[1] + extents[3] + dy;
+}
+
+static bool bounds_overlap(const float a[4], const float b[4])
+{
+    static const float margin = -5;
     return a[2] > b[0] - margin &&
            a[0] < b[2] + margin &&
            a[3] > b[1] - margin &&
            a[1] < b[3] + margin;
 }
 
-static bool test_label_overlaps(const label_t *label)
+static void grid_reset(const double window_size[2])
 {
-    label_t *other;
-    if (!(label->align & LABEL_AROUND)) return false;
-    DL_FOREACH(g_labels->labels, other) {
-        if (other == label) break;
-        if (other->skipped) continue;
-        if (other->fader.target == false) continue;
-        if (bounds_overlap(other->bounds, label->bounds)) return true;
+    typeof(g_labels->grid) *grid = &g_labels->grid;
+    int i;
+    for (i = 0; i < 2; i++) {
+        grid->size[i] = window_size[i] / GRID_CELL_SIZE + 1;
+        grid->size[i] = clamp(grid->size[i], 1, GRID_MAX_SIZE);
+    }
+    for (i = 0; i < grid->size[0] * grid->size[1]; i++)
+        grid->cells[i] = -1;
+    grid->nb = 0;
+}
+
+static int grid_get_cell(float v, int size)
+{
+    v = floorf(v / GRID_CELL_SIZE);
+    if (!(v >= 0)) return 0; // Also catch NaN.
+    return min(v, size - 1);
+}
+
+// Compute the range of cells covered by some bounds.
+static void grid_get_range(const float bounds[4], int range[4])
+{
+    typeof(g_labels->grid) *grid = &g_labels->grid;
+    range[0] = grid_get_cell(bounds[0], grid->size[0]);
+    range[1] = grid_get_cell(bounds[1], grid->size[1]);
+    range[2] = grid_get_cell(bounds[2], grid->size[0]);
+    range[3] = grid_get_cell(bounds[3], grid->size[1]);
+}
+
+// Add a placed entry to all the cells its bounds cover.
+static void grid_add(const layout_entry_t *entry)
+{
+    typeof(g_labels->grid) *grid = &g_labels->grid;
+    int range[4], x, y, *cell;
+
+    grid_get_range(entry->bounds, range);
+    for (y = range[1]; y <= range[3]; y++)
+    for (x = range[0]; x <= range[2]; x++) {
+        if (grid->nb >= grid->allocated) {
+            grid->allocated = max(256, grid->allocated * 2);
+            grid->entries = realloc(grid->entries,
+                                    grid->allocated * sizeof(*grid->entries));
+        }
+        cell = &grid->cells[y * grid->size[0] + x];
+        grid->entries[grid->nb].entry = entry;
+        grid->entries[grid->nb].next = *cell;
+        *cell = grid->nb++;
+    }
+}
+
+// Test if an entry overlaps any of the entries already placed.
+static bool test_overlaps(const layout_entry_t *entry)
+{
+    typeof(g_labels->grid) *grid = &g_labels->grid;
+    int range[4], x, y, i;
+
+    if (!(entry->align & LABEL_AROUND)) return false;
+    grid_get_range(entry->bounds, range);
+    for (y = range[1]; y <= range[3]; y++)
+    for (x = range[0]; x <= range[2]; x++) {
+        for (i = grid->cells[y * grid->size[0] + x]; i != -1;
+             i = grid->entries[i].next) {
+            if (bounds_overlap(grid->entries[i].entry->bounds, entry->bounds))
+                return true;
+        }
     }
     return false;
 }
 
+// Try to place an entry, return false if all the positions overlap.
+static bool layout_place(layout_entry_t *entry)
+{
+    int i, j;
+    for (i = 0; i < entry->nb_anchors; i++) {
+        for (j = 0; j < ARRAY_SIZE(NUDGES); j++) {
+            get_anchor_bounds(entry->win_pos, entry->radius, entry->align,
+                              i, NUDGES[j], entry->extents[i],
+                              entry->bounds);
+            entry->anchor = i;
+            entry->dy = NUDGES[j];
+            // Don't try to fit label currently fading out.
+            if (entry->fading_out) return true;
+            if (!test_overlaps(entry)) return true;
+        }
+    }
+    // Like before, the last tested position is kept for the labels that
+    // don't try to avoid the others.
+    return !(entry->align & LABEL_AROUND);
+}
+
+/*
+ * Worker function that solves the layout of the snapshot entries.
+ *
+ * It only accesses the layout entries and the grid, that the main thread
+ * doesn't touch while the worker is running.
+ */
+static int layout_worker(worker_t *worker)
+{
+    typeof(g_labels->layout) *layout = &g_labels->layout;
+    layout_entry_t *entry;
+    int i;
+
+    grid_reset(layout->window_size);
+    for (i = 0; i < layout->nb; i++) {
+        entry = &layout->entries[i];
+        if (!layout_place(entry)) {
+            entry->anchor = -1;
+            continue;
+        }
+        // Labels fading out don't prevent others from being rendered.
+        if (!entry->fading_out) grid_add(entry);
+    }
+    return 0;
+}
+
+// Copy the result of the layout worker back into the labels.
+static void layout_apply(void)
+{
+    typeof(g_labels->layout) *layout = &g_labels->layout;
+    const layout_entry_t *entry;
+    int i;
+
+    for (i = 0; i < layout->nb; i++) {
+        entry = &layout->entries[i];
+        // The label might have been recycled in the meantime.
+        if (entry->label->id != entry->id) continue;
+        entry->label->anchor = entry->anchor;
+        entry->label->dy = entry->dy;
+    }
+}
+
+// Take a snapshot of the labels and start the layout worker.
+static void layout_start(const painter_t *painter)
+{
+    typeof(g_labels->layout) *layout = &g_labels->layout;
+    layout_entry_t *entry;
+    label_t *label;
+    int nb = 0;
+
+    DL_FOREACH(g_labels->labels, label) nb += label_is_in_view(label);
+    if (nb > layout->allocated) {
+        layout->allocated = max(nb, layout->allocated * 2);
+        layout->entries = realloc(layout->entries,
+                                  layout->allocated * sizeof(*entry));
+    }
+    layout->nb = 0;
+    DL_FOREACH(g_labels->labels, label) {
+        if (!label_is_in_view(label)) continue;
+        label_update_extents(painter, label);
+        entry = &layout->entries[layout->nb++];
+        entry->label = label;
+        entry->id = label->id;
+        vec2_to_float(label->win_pos, entry->win_pos);
+        entry->radius = label->radius;
+        entry->align = label->align;
+        entry->fading_out = !label->fader.target;
+        entry->nb_anchors = label->nb_anchors;
+        memcpy(entry->extents, label->extents, sizeof(entry->extents));
+    }
+    vec2_copy(painter->proj->window_size, layout->window_size);
+    worker_init(&layout->worker, layout_worker);
+    layout->running = true;
+}
+
+// Check if the layout worker is done, optionally waiting for it.
+static bool layout_iter(bool wait)
+{
+    worker_t *worker = &g_labels->layout.worker;
+    while (!worker_iter(worker)) {
+        if (!wait) return false;
+    }
+    return true;
+}
+
 static int label_cmp(void *a, void *b)
 {
     return cmp(((label_t*)b)->priority, ((label_t*)a)->priority);
 }
 
+/*
+ * Sort the labels by decreasing priority.
+ *
+ * The priorities barely change between frames, so we start with an
+ * insertion sort that is linear on an already sorted list, and only fall
+ * back to a merge sort if too many labels are out of order.  Both are
+ * stable, so the result is the same.
+ */
+static void labels_sort(label_t **list)
+{
+    label_t *label, *next, *pos;
+    int nb = 0, moves = 0;
+
+    for (label = *list; label; label = next) {
+        next = label->next;
+        nb++;
+        if (label == *list || label->prev->priority >= label->priority)
+            continue;
+        for (pos = label->prev; pos != *list; pos = pos->prev) {
+            if (pos->prev->priority >= label->priority) break;
+            if (++moves > 8 * nb) goto fallback;
+        }
+        DL_DELETE(*list, label);
+        DL_PREPEND_ELEM(*list, pos, label);
+    }
+    return;
+
+fallback:
+    DL_SORT(*list, label_cmp);
+}
+
 static int labels_init(obj_t *obj, json_value *args)
 {
     g_labels = (void*)obj;
     return 0;
 }
 
+/*
+ * Re-project all the 3d labels on screen.
+ *
+ * The labels at infinity are grouped by frame so that each group can be
+ * converted to the view frame and projected in a single batch.
+ */
+static void labels_project(const painter_t *painter)
+{
+    label_t *label, **list;
+    int i, f, n = 0, nb[FRAMES_NB] = {}, ofs[FRAMES_NB];
+    double (*pos)[3], (*win_pos)[2];
+
+    DL_FOREACH(g_labels->labels, label) {
+        if (label->frame == -1) continue;
+        if (!label->at_inf) {
+            painter_project(painter, label->frame, label->pos, false,
+                            false, label->win_pos);
+            continue;
+        }
+        nb[label->frame]++;
+        n++;
+    }
+    if (!n) return;
+
+    list = core_frame_alloc(n * sizeof(*list));
+    pos = core_frame_alloc(n * sizeof(*pos));
+    win_pos = core_frame_alloc(n * sizeof(*win_pos));
+    for (f = 0, i = 0; f < FRAMES_NB; i += nb[f++]) ofs[f] = i;
+    DL_FOREACH(g_labels->labels, label) {
+        if (label->frame == -1 || !label->at_inf) continue;
+        i = ofs[label->frame]++;
+        list[i] = label;
+        vec3_copy(label->pos, pos[i]);
+    }
+    for (f = 0, i = 0; f < FRAMES_NB; i += nb[f++]) {
+        convert_frame_n(painter->obs, f, FRAME_VIEW, true, nb[f],
+                        pos[i], pos[i], 0);
+    }
+    project_n(painter->proj, n, pos, win_pos, NULL);
+    for (i = 0; i < n; i++) vec2_copy(win_pos[i], list[i]->win_pos);
+}
+
 static int labels_render(const obj_t *obj, const painter_t *painter_)
 {
+    typeof(g_labels->layout) *layout = &g_labels->layout;
     label_t *label;
-    int i;
     double pos[2], color[4];
+    float win_pos[2], bounds[4];
     painter_t painter = *painter_;
-    DL_SORT(g_labels->labels, label_cmp);
-    DL_FOREACH(g_labels->labels, label) {
-        // Re-project label on screen
-        if (label->frame != -1) {
-            painter_project(painter_, label->frame, label->pos, label->at_inf,
-                            false, label->win_pos);
-        }
+    const bool wait = g_labels->nb_views > 1;
+
+    labels_sort(&g_labels->labels);
+    labels_project(painter_);
 
-        for (i = 0; ; i++) {
-            if (!label_get_possible_bounds(&painter, label, i, label->bounds)) {
-                label->skipped = true;
-                goto skip;
-            }
-
-            // Don't try to fit label currently fading out
-            if (label->fader.target == false) break;
-
-            if (!test_label_overlaps(label)) break;
-
-            // The label is colliding with another one, try to fit up and
-            // down around position before giving up
-            label->bounds[1] -= 2;
-            label->bounds[3] -= 2;
-            if (!test_label_overlaps(label)) break;
-            label->bounds[1] += 4;
-            label->bounds[3] += 4;
-            if (!test_label_overlaps(label)) break;
-            label->bounds[1] -= 6;
-            label->bounds[3] -= 6;
-            if (!test_label_overlaps(label)) break;
-            label->bounds[1] -= 2;
-            label->bounds[3] -= 2;
-            if (!test_label_overlaps(label)) break;
+    // Get the result of the previous layout if it is ready, and start a
+    // new one.  Without threads the worker runs immediately.  When we
+    // render several views, each one needs its own layout, so we wait.
+    if (layout->running && layout_iter(wait)) {
+        layout_apply();
+        layout->running = false;
+    }
+    if (!layout->running) {
+        layout_start(painter_);
+        if (layout_iter(wait)) {
+            layout_apply();
+            layout->running = false;
         }
-        pos[0] = label->bounds[0];
-        pos[1] = label->bounds[1];
+    }
+
+    DL_FOREACH(g_labels->labels, label) {
+        if (!label_is_in_view(label)) continue;
+        if (label->anchor < 0 || label->anchor >= label->nb_anchors)
+            continue;
+        vec2_to_float(label->win_pos, win_pos);
+        get_anchor_bounds(win_pos, label->radius, label->align,
+                          label->anchor, label->dy,
+                          label->extents[label->anchor], bounds);
+        pos[0] = bounds[0];
+        pos[1] = bounds[1];
         vec4_copy(label->color, color);
         color[3] *= label->fader.value;
         paint_text(&painter, label->render_text, pos,
                    ALIGN_LEFT | ALIGN_TOP, label->effects, label->size, color,
                    label->angle);
-        label->skipped = false;
-skip:;
     }
     return 0;
 }
@@ -196,10 +613,11 @@ skip:;
 static int labels_update(obj_t *obj, double dt)
 {
     label_t *label = (label_t *)obj;
+    bool changed = false;
     DL_FOREACH(g_labels->labels, label) {
-        fader_update(&label->fader, dt);
+        changed |= fader_update(&label->fader, dt);
     }
-    return 0;
+    return changed ? 1 : 0;
 }
 
 
@@ -226,19 +644,8 @@ void labels_add_3d(const char *text, int frame, const double pos[3],
 
     if (!text || !*text) return;
 
-    label = label_get(g_labels->labels, text, size, oid);
-    if (!label) {
-        label = calloc(1, sizeof(*label));
-        label->oid = oid;
-        fader_init(&label->fader, false);
-        label->render_text = label->text = strdup(text);
-        // Note: should be done by the painter directly.
-        if (effects & TEXT_UPPERCASE) {
-            label->render_text = malloc(strlen(text) + 64);
-            u8_upper(label->render_text, text, strlen(text) + 64);
-        }
-        DL_APPEND(g_labels->labels, label);
-    }
+    label = label_get(text, size, oid);
+    if (!label) label = label_create(text, size, oid, effects);
 
     if (frame == -1)
         vec2_copy(pos, label->win_pos);
@@ -255,6 +662,7 @@ void labels_add_3d(const char *text, int frame, const double pos[3],
     label->effects = effects;
     label->priority = priority;
     label->fader.target = true;
+    label->views |= 1u << g_labels->view;
 }
 
 /*
@@ -16,6 +16,23 @@ enum {
     LS_DESCRIPTION    = 1 << 1,
 };
 
+// Number of azimuth bins of the horizon mask.
+#define MASK_NB_BINS 180
+// Max order of the tiles we use to compute the horizon mask.
+#define MASK_MAX_ORDER 3
+// Margin removed from the horizon mask altitudes (rad), for the thin gaps
+// between the sampled pixels.
+#define MASK_MARGIN (2.0 * DD2R)
+
+/*
+ * Type: mask_tile_t
+ * The lowest altitude of the non opaque pixels of a landscape tile, for
+ * each azimuth bin.
+ */
+typedef struct {
+    double          alts[MASK_NB_BINS];
+} mask_tile_t;
+
 /*
  * Type: landscape_t
  * Represent an individual landscape.
@@ -33,6 +50,16 @@ typedef struct landscape {
     } info;
     int             parsed; // union of LS_ enum for each parsed file.
     char            *description;  // html description if any.
+
+    // Horizon mask computed from the alpha of the survey tiles, so that
+    // the painter can clip what is behind the terrain.
+    struct {
+        hips_t      *hips;  // Same survey, with mask_tile_t tiles.
+        int         order;  // Order of the tiles we use.
+        bool        ready;
+        bool        error;
+        double      alts[MASK_NB_BINS];
+    } mask;
 } landscape_t;
 
 /*
@@ -45,6 +72,12 @@ typedef struct landscapes {
     fader_t         fog_visible;
     landscape_t     *current; // The current landscape.
     int             loading_code; // Return code of the initial list loading.
+    // Cached value of get_global_brightness.
+    struct {
+        double      value;
+        double      tt;
+        uint64_t    obs_hash; // Observer partial hash.
+    } brightness;
 } landscapes_t;
 
 
@@ -56,6 +89,100 @@ static int landscape_init(obj_t *obj, json_value *args)
     return 0;
 }
 
+/*
+ * Compute the horizon mask of a landscape tile.  Called from the hips
+ * loading threads.
+ *
+ * Only the pixels with some transparency count, so that everything below
+ * the lowest of them in a bin is hidden by the terrain.
+ */
+static const void *mask_create_tile(void *user, int order, int pix,
+                                    void *data, int size, int *cost,
+                                    int *transparency)
+{
+    mask_tile_t *tile;
+    uint8_t *img;
+    int i, x, y, w, h, bpp, step;
+    double pos[4], az, alt;
+    uv_map_t map;
+
+    img = img_read_from_mem(data, size, &w, &h, &bpp);
+    if (!img) return NULL;
+    tile = calloc(1, sizeof(*tile));
+    *cost = sizeof(*tile);
+    // Without alpha channel we cannot tell where the terrain is.
+    for (i = 0; i < MASK_NB_BINS; i++)
+        tile->alts[i] = (bpp == 2 || bpp == 4) ? M_PI / 2 : -M_PI / 2;
+    if (bpp != 2 && bpp != 4) goto end;
+
+    uv_map_init_healpix(&map, order, pix, false, true);
+    step = max(1, w / 128);
+    for (y = 0; y < h; y += step) for (x = 0; x < w; x += step) {
+        if (img[(y * w + x) * bpp + bpp - 1] == 255) continue;
+        // The tiles textures are swapped, and the landscapes are rendered
+        // with the y axis flipped.
+        uv_map(&map, VEC((y + 0.5) / h, (x + 0.5) / w), pos);
+        pos[1] = -pos[1];
+        eraC2s(pos, &az, &alt);
+        i = (int)(eraAnp(az) / (2 * M_PI) * MASK_NB_BINS) % MASK_NB_BINS;
+        tile->alts[i] = min(tile->alts[i], alt);
+    }
+end:
+    free(img);
+    return tile;
+}
+
+static int mask_delete_tile(void *tile)
+{
+    free(tile);
+    return 0;
+}
+
+/*
+ * Compute the horizon mask once all the tiles of the lowest available
+ * order are loaded.
+ */
+static void update_mask(landscape_t *ls)
+{
+    const mask_tile_t *tile;
+    const hips_settings_t settings = {
+        .create_tile = mask_create_tile,
+        .delete_tile = mask_delete_tile,
+    };
+    int pix, i, code, nb_loading = 0;
+    double alts[MASK_NB_BINS];
+
+    if (!ls->hips || ls->mask.ready || ls->mask.error) return;
+    if (!ls->mask.hips) {
+        ls->mask.hips = hips_create(ls->uri, 0, &settings);
+        hips_set_frame(ls->mask.hips, FRAME_OBSERVED);
+    }
+    for (i = 0; i < MASK_NB_BINS; i++) alts[i] = M_PI / 2;
+    for (pix = 0; pix < 12 << (2 * ls->mask.order); pix++) {
+        tile = hips_get_tile(ls->mask.hips, ls->mask.order, pix,
+                             HIPS_LOAD_IN_THREAD, &code);
+        if (!code) {
+            nb_loading++;
+            continue;
+        }
+        // Below the survey min order.
+        if (code == 404 && pix == 0 && ls->mask.order < MASK_MAX_ORDER) {
+            ls->mask.order++;
+            return;
+        }
+        if (!tile) {
+            ls->mask.error = true;
+            return;
+        }
+        for (i = 0; i < MASK_NB_BINS; i++)
+            alts[i] = min(alts[i], tile->alts[i]);
+    }
+    if (nb_loading) return;
+    for (i = 0; i < MASK_NB_BINS; i++)
+        ls->mask.alts[i] = alts[i] - MASK_MARGIN;
+    ls->mask.ready = true;
+}
+
 static int landscape_update(obj_t *obj, double dt)
 {
     landscape_t *ls = (landscape_t*)obj;
@@ -72,6 +199,7 @@ static int landscape_update(obj_t *obj, double dt)
         ls->description = strdup(data);
         module_changed((obj_t*)ls, "description");
     }
+    if (ls->active) update_mask(ls);
 
     return fader_update(&ls->visible, dt);
 }
@@ -105,12 +233,26 @@ static double get_global_brightness(void)
     return min(brightness, 1.0);
 }
 
+// Same as get_global_brightness, but only recompute the value when the
+// observer location changed, or after one minute of simulation time.
+static double get_cached_brightness(landscapes_t *lss)
+{
+    const observer_t *obs = core->observer;
+    if (lss->brightness.obs_hash != obs->hash_partial ||
+            fabs(obs->tt - lss->brightness.tt) > 1.0 / 24 / 60) {
+        lss->brightness.value = get_global_brightness();
+        lss->brightness.tt = obs->tt;
+        lss->brightness.obs_hash = obs->hash_partial;
+    }
+    return lss->brightness.value;
+}
+
 /*
  * Render the fog using a healpix projection and opengl shader.
  */
 static void render_fog(const painter_t *painter_, double alpha)
 {
-    int pix, order = 1, split = 2;
+    int pix, order = 1, split = painter_->degrade < 0.5 ? 2 : 1;
     double theta, phi;
     painter_t painter = *painter_;
     uv_map_t map;
@@ -141,7 +283,7 @@ static int landscape_render(const obj_t *obj, const painter_t *painter_)
     painter_t painter = *painter_;
     double alpha, alt, az, direction[3];
     double brightness;
-    const int split_order = 3;
+    const int split_order = painter_->degrade < 0.5 ? 3 : 2;
     // Hack matrix to fix the hips survey orientation.
     const double rg2h[4][4] = {
         {1,  0,  0,  0},
@@ -159,7 +301,7 @@ static int landscape_render(const obj_t *obj, const painter_t *painter_)
     render_fog(&painter, lss->fog_visible.value);
 
     painter.color[3] *= lss->visible.value;
-    brightness = get_global_brightness();
+    brightness = get_cached_brightness(lss);
 
     // Adjust the alpha to make the landscape transparent when we look down
     // and when we zoom in.
@@ -237,16 +379,42 @@ static int landscapes_init(obj_t *obj, json_value *args)
     return 0;
 }
 
+/*
+ * Give the horizon mask of the current landscape to the painter, only when
+ * the landscape is rendered fully opaque.  See landscape_render.
+ */
+static void set_horizon_mask(const landscapes_t *lss)
+{
+    const landscape_t *ls = lss->current;
+    double direction[3], az, alt;
+
+    if (!ls || !ls->mask.ready || ls->visible.value < 1 ||
+            lss->visible.value < 1 || core->fov < 20 * DD2R) {
+        painter_set_horizon_mask(0, NULL);
+        return;
+    }
+    convert_frame(core->observer, FRAME_VIEW, FRAME_OBSERVED, true,
+                  VEC(0, 0, -1), direction);
+    eraC2s(direction, &az, &alt);
+    if (alt < 0) {
+        painter_set_horizon_mask(0, NULL);
+        return;
+    }
+    painter_set_horizon_mask(MASK_NB_BINS, ls->mask.alts);
+}
+
 static int landscapes_update(obj_t *obj, double dt)
 {
     landscapes_t *lss = (landscapes_t*)obj;
     obj_t *ls;
+    bool changed = false;
     MODULE_ITER((obj_t*)lss, ls, "landscape") {
-        landscape_update(ls, dt);
+        changed |= landscape_update(ls, dt) > 0;
     }
-    fader_update(&lss->visible, dt);
-    fader_update(&lss->fog_visible, dt);
-    return 0;
+    changed |= fader_update(&lss->visible, dt);
+    changed |= fader_update(&lss->fog_visible, dt);
+    set_horizon_mask(lss);
+    return changed ? 1 : 0;
 }
 
 static int landscapes_render(const obj_t *obj, const painter_t *painter)
@@ -143,8 +143,20 @@ struct line {
     char            format;     // 'd', 'h', or 0
     bool            grid;       // If true render the whole grid.
     double          color[4];
+
+    // Cached mesh of the full grid, projected by the GPU.
+    struct {
+        int         version;    // Depends on the steps.
+        int         verts_count;
+        double      (*verts)[3];
+        int         indices_count;
+        uint16_t    *indices;
+    } mesh;
 };
 
+// Number of segments per grid cell side in the meshes.
+#define MESH_SPLIT 8
+
 // Test if a shape in clipping coordinates is clipped or not.
 static bool is_clipped(const double pos[4][4], double clip[4][4])
 {
@@ -349,6 +361,9 @@ static void render_label(const double p[2], const double u[2],
 /*
  * Render a grid/line, by splitting the sphere into parts until we reach
  * the resolution of the grid.
+ *
+ * If labels_only is set, the lines are not rendered, only the labels on
+ * the screen borders.
  */
 static void render_recursion(
         const line_t *line, const painter_t *painter,
@@ -356,7 +371,8 @@ static void render_recursion(
         const int splits[2],
         const double mat[3][3],
         const step_t *steps[2],
-        int done_mask)
+        int done_mask,
+        bool labels_only)
 {
     int i, j, dir;
     int split_az, split_al, new_splits[2];
@@ -403,8 +419,10 @@ static void render_recursion(
         if (done_mask & (1 << dir)) continue; // Marked as done already.
         if (splits[dir] != steps[dir]->n / (dir ? 2 : 1)) continue;
         done_mask |= (1 << dir);
-        paint_lines(painter, line->frame, 2, lines + dir * 2,
-                    &map, 8, PAINTER_SKIP_DISCONTINUOUS);
+        if (!labels_only) {
+            paint_lines(painter, line->frame, 2, lines + dir * 2,
+                        &map, MESH_SPLIT, PAINTER_SKIP_DISCONTINUOUS);
+        }
         if (!line->format) continue;
         if (check_borders(pos[0], pos[2 - dir], painter->proj, p, u, v)) {
             render_label(p, u, v, uv[0], 1 - dir, line,
@@ -428,7 +446,7 @@ keep_going:
         mat3_iscale(new_mat, 1. / split_az, 1. / split_al, 1.0);
         mat3_itranslate(new_mat, j, i);
         render_recursion(line, painter, level + 1, new_splits, new_mat,
-                         steps, done_mask);
+                         steps, done_mask, labels_only);
     }
 }
 
@@ -487,6 +505,101 @@ static void get_steps(double fov, char type, int frame,
         steps[0]--;
 }
 
+/*
+ * Function: update_mesh
+ * Compute the mesh of the full grid for the given steps.
+ *
+ * The vertices are in the line frame (before the painter transform), and
+ * the lines follow the same path as in render_recursion: a meridian every
+ * 1 / steps[0]->n turn, and a parallel every 2 / steps[1]->n half turn.
+ *
+ * Return false if the mesh would be too large for 16 bits indices.
+ */
+static bool update_mesh(line_t *line, const step_t *steps[2])
+{
+    int n_az, n_al, nb_az, nb_al, verts_count, indices_count, i, j, k;
+    int version;
+    double az, al;
+    typeof(line->mesh) *mesh = &line->mesh;
+
+    n_az = steps[0]->n;
+    n_al = steps[1]->n / 2;
+    if (n_al < 1) return false;
+    version = n_az << 16 | n_al;
+    if (mesh->verts && mesh->version == version) return true;
+
+    // Number of lines in each direction.
+    nb_az = n_az;
+    nb_al = line->grid ? n_al - 1 : 0;
+    verts_count = nb_az * (n_al * MESH_SPLIT + 1) +
+                  nb_al * (n_az * MESH_SPLIT + 1);
+    if (verts_count > 0xffff) return false;
+    indices_count = nb_az * n_al * MESH_SPLIT * 2 +
+                    nb_al * n_az * MESH_SPLIT * 2;
+
+    free(mesh->verts);
+    free(mesh->indices);
+    mesh->verts = malloc(verts_count * sizeof(*mesh->verts));
+    mesh->indices = malloc(indices_count * sizeof(*mesh->indices));
+    mesh->version = version;
+    mesh->verts_count = 0;
+    mesh->indices_count = 0;
+
+    for (i = 0; i < nb_az + nb_al; i++) {
+        k = i < nb_az ? n_al * MESH_SPLIT : n_az * MESH_SPLIT;
+        for (j = 0; j <= k; j++) {
+            if (i < nb_az) { // Meridian.
+                az = 2 * M_PI * i / n_az;
+                al = M_PI * j / k - M_PI / 2;
+            } else { // Parallel.
+                az = 2 * M_PI * j / k;
+                al = M_PI * (i - nb_az + 1) / n_al - M_PI / 2;
+            }
+            if (j > 0) {
+                mesh->indices[mesh->indices_count++] = mesh->verts_count - 1;
+                mesh->indices[mesh->indices_count++] = mesh->verts_count;
+            }
+            eraS2c(az, al, mesh->verts[mesh->verts_count++]);
+        }
+    }
+    assert(mesh->verts_count == verts_count);
+    assert(mesh->indices_count == indices_count);
+    return true;
+}
+
+/*
+ * Function: render_mesh
+ * Render the lines with a mesh cached on the GPU.
+ *
+ * We only do it if the renderer can project the mesh itself, so that we
+ * avoid the recursion and the CPU tesselation of the lines.  Otherwise
+ * return false.
+ */
+static bool render_mesh(line_t *line, const painter_t *painter,
+                        const step_t *steps[2])
+{
+    const double cap[4] = {0, 0, 1, -1}; // Full sphere.
+    double rot[3][3];
+    uint64_t id;
+
+    // Same conditions as the renderer retained meshes.
+    if (    painter->proj->type != PROJ_PERSPECTIVE &&
+            painter->proj->type != PROJ_STEREOGRAPHIC)
+        return false;
+    if (!painter_get_frame_to_view_matrix(painter, line->frame, rot))
+        return false;
+    if (!update_mesh(line, steps)) return false;
+
+    id = oid_create("LINE", crc32(0, (void*)line->obj.id,
+                                  strlen(line->obj.id)));
+    paint_mesh_retained(painter, line->frame, MODE_LINES,
+                        id, line->mesh.version,
+                        line->mesh.verts_count, line->mesh.verts,
+                        line->mesh.indices_count, line->mesh.indices,
+                        cap, 0);
+    return true;
+}
+
 static int line_render(const obj_t *obj, const painter_t *painter_)
 {
     line_t *line = (line_t*)obj;
@@ -494,6 +607,7 @@ static int line_render(const obj_t *obj, const painter_t *painter_)
     const step_t *steps[2];
     int splits[2] = {1, 1};
     double mat[3][3];
+    bool labels_only;
     painter_t painter = *painter_;
     mat4_set_identity(transform);
 
@@ -519,11 +633,20 @@ static int line_render(const obj_t *obj, const painter_t *painter_)
         steps[0] = &STEPS_DEG[1]; // 180°
         steps[1] = &STEPS_DEG[4]; //  20°: enough to avoid clipping errors.
     }
+    labels_only = render_mesh(line, &painter, steps);
+    if (labels_only && !line->format) return 0;
     mat3_set_identity(mat);
-    render_recursion(line, &painter, 0, splits, mat, steps, 0);
+    render_recursion(line, &painter, 0, splits, mat, steps, 0, labels_only);
     return 0;
 }
 
+static void line_del(obj_t *obj)
+{
+    line_t *line = (line_t*)obj;
+    free(line->mesh.verts);
+    free(line->mesh.indices);
+}
+
 
 // Check if a line interect the normalized viewport.
 // If there is an intersection, `border` will be set with the border index
@@ -611,6 +734,7 @@ static obj_klass_t line_klass = {
     .flags = OBJ_IN_JSON_TREE,
     .update = line_update,
     .render = line_render,
+    .del = line_del,
     .attributes = (attribute_t[]) {
         PROPERTY(visible, TYPE_BOOL, MEMBER(line_t, visible.target)),
         {}
@@ -622,7 +746,7 @@ OBJ_REGISTER(line_klass)
 static obj_klass_t lines_klass = {
     .id = "lines",
     .size = sizeof(lines_t),
-    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE,
+    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_UPDATE_PARALLEL,
     .init = lines_init,
     .update = lines_update,
     .render = lines_render,
@@ -13,24 +13,30 @@
 #define MAX_ALTITUDE 120.0          // Max meteor altitude in km
 #define MIN_ALTITUDE 80.0           // Min meteor altitude in km
 
-/*
- * Type: meteor_t
- * Object that represents a single meteor
- */
-typedef struct {
-    obj_t       obj;
-    double      pvo[2][4];
-    double      duration; // Duration (sec).
-    double      time; // From 0 to duration.
-} meteor_t;
+// Capacity of the meteors pool.
+#define MAX_NB 4096
+
+// Number of alpha levels used to fade out the meteors.  All the meteors of
+// a level are rendered with a single mesh.
+#define NB_FADE_LEVELS 8
 
 /*
  * Type: meteors_t
  * Meteors module object
+ *
+ * The live meteors are stored as a fixed capacity pool of arrays, the dead
+ * ones are replaced by the last one of the pool.
  */
 typedef struct {
     obj_t   obj;
     double  zhr;
+    int     nb;
+    struct {
+        double pos[MAX_NB][3];
+        double speed[MAX_NB][3];
+        float  duration[MAX_NB]; // Duration (sec).
+        float  time[MAX_NB]; // From 0 to duration.
+    } pool;
 } meteors_t;
 
 static double frand(double from, double to)
@@ -38,98 +44,60 @@ static double frand(double from, double to)
     return from + (rand() / (double)RAND_MAX) * (to - from);
 }
 
-static int meteor_init(obj_t *obj, json_value *args)
+// Add a meteor with a random position and speed.
+static void meteor_add(meteors_t *ms)
 {
     double z, mat[3][3];
-    meteor_t *m = (meteor_t*)obj;
+    int i;
 
-    // Give the meteor a random position and speed.
+    if (ms->nb >= MAX_NB) return;
+    i = ms->nb++;
     z = (EARTH_RADIUS + MAX_ALTITUDE) * 1000 / DAU;
     mat3_set_identity(mat);
     mat3_rz(frand(0, 360 * DD2R), mat, mat);
     mat3_ry(frand(-90 * DD2R, +90 * DD2R), mat, mat);
-    mat3_mul_vec3(mat, VEC(1, 0, 0), m->pvo[0]);
-    vec3_mul(z, m->pvo[0], m->pvo[0]);
-    m->pvo[0][3] = 1.0;
-
-    vec4_set(m->pvo[1], frand(-1, 1), frand(-1, 1), frand(-1, 1), 1);
-    vec3_mul(0.00001, m->pvo[1], m->pvo[1]);
+    mat3_mul_vec3(mat, VEC(1, 0, 0), ms->pool.pos[i]);
+    vec3_mul(z, ms->pool.pos[i], ms->pool.pos[i]);
 
-    m->duration = 4.0;
+    vec3_set(ms->pool.speed[i], frand(-1, 1), frand(-1, 1), frand(-1, 1));
+    vec3_mul(0.00001, ms->pool.speed[i], ms->pool.speed[i]);
 
-    return 0;
+    ms->pool.duration[i] = 4.0;
+    ms->pool.time[i] = 0;
 }
 
-static int meteor_update(obj_t *obj, double dt)
+static void meteor_remove(meteors_t *ms, int i)
 {
-    meteor_t *m = (meteor_t*)obj;
-    vec3_addk(m->pvo[0], m->pvo[1], dt, m->pvo[0]);
-    m->time += dt;
-    return 0;
+    int last = --ms->nb;
+    if (i == last) return;
+    vec3_copy(ms->pool.pos[last], ms->pool.pos[i]);
+    vec3_copy(ms->pool.speed[last], ms->pool.speed[i]);
+    ms->pool.duration[i] = ms->pool.duration[last];
+    ms->pool.time[i] = ms->pool.time[last];
 }
 
 /*
- * Project UV coordinates into a tail shape.
- * For the moment this projects into a triangle.
+ * Compute the three vertices of a meteor tail triangle.
+ *
+ * The tail starts at the head position with a small width, and goes 10°
+ * along the direction opposite to the meteor motion.
  */
-static void tail_project(const uv_map_t *map, const double v[2], double out[4])
-{
-    double r, p[4] = {1, 0, 0, 0};
-    double m[3][3];
-    r = v[1];
-    r *= 1 - v[0]; // Triangle shape by scaling along U.
-    p[2] = (r - 0.5);
-    mat3_set_identity(m);
-    mat3_rz(v[0] * 10 * DD2R, m, m);
-    mat3_mul_vec3(m, p, p);
-    mat3_mul_vec3(map->mat, p, p);
-
-    p[3] = 1;
-    vec4_copy(p, out);
-}
-
-static void render_tail(const painter_t *painter,
-                        const double p1[4],
-                        const double p2[4])
+static void tail_get_verts(const double p1[3], const double p2[3],
+                           double out[3][3])
 {
+    const double half_width = 0.0005;
+    const double len = 10 * DD2R;
     double mat[3][3];
-    uv_map_t map;
-    /*
-     * Compute the rotation/scale matrix that transforms X into p1 and
-     * Y into p1 rotated 90° in the direction of p2.
-     */
-    vec3_copy(p1, mat[0]);
-    vec3_copy(p2, mat[1]);
-    vec3_cross(mat[0], mat[1], mat[2]);
-    vec3_normalize(mat[0], mat[0]);
+
+    vec3_normalize(p1, mat[0]);
+    vec3_cross(p1, p2, mat[2]);
     vec3_normalize(mat[2], mat[2]);
     vec3_cross(mat[2], mat[0], mat[1]);
 
-    // Scale along Z to specify the tail width.
-    mat3_iscale(mat, 1, 1, 0.001);
-
-    map = (uv_map_t) {
-        .map = tail_project,
-    };
-    mat3_copy(mat, map.mat); // XXX: remove that I guess.
-    paint_quad(painter, FRAME_ICRF, &map, 8);
-}
-
-static int meteor_render(const obj_t *obj, const painter_t *painter_)
-{
-    double p1[4]; // Head position (CIRS)
-    double p2[4]; // End of tail position (CIRS)
-    painter_t painter = *painter_;
-    meteor_t *m = (meteor_t*)obj;
-
-    // Very basic fade out.
-    painter.color[3] *= max(0.0, 1.0 - m->time / m->duration);
-
-    vec4_copy(m->pvo[0], p1);
-    vec3_addk(p1, m->pvo[1], -2, p2);
-
-    render_tail(&painter, p1, p2);
-    return 0;
+    vec3_addk(mat[0], mat[2], +half_width, out[0]);
+    vec3_addk(mat[0], mat[2], -half_width, out[1]);
+    vec3_mul(cos(len), mat[0], out[2]);
+    vec3_addk(out[2], mat[1], sin(len), out[2]);
 }
 
 static int meteors_init(obj_t *obj, json_value *args)
@@ -143,56 +111,74 @@ static int meteors_update(obj_t *obj, double dt)
 {
     PROFILE(meterors_update, 0);
     meteors_t *ms = (meteors_t*)obj;
-    meteor_t *m;
-    obj_t *child, *tmp;
-    int nb, max_nb = 100;
-    double proba;
-
-    DL_COUNT(obj->children, child, nb);
-    // Probabiliy of having a new shooting star at this frame.
-    proba = ms->zhr * dt / 3600;
-
-    if (nb < max_nb && frand(0, 1) < proba) {
-        obj_create("meteor", NULL, obj, NULL);
-    }
-
-    DL_FOREACH_SAFE(obj->children, child, tmp) {
-        m = (meteor_t*)child;
-        meteor_update(child, dt);
-        if (m->time > m->duration) {
-            module_remove(obj, child);
-            obj_release(child);
+    double nb_new;
+    int i;
+
+    // Expected number of new shooting stars at this frame.  For high rates
+    // we can have several per frame.
+    nb_new = ms->zhr * dt / 3600;
+    nb_new = floor(nb_new) + (frand(0, 1) < fmod(nb_new, 1.0) ? 1 : 0);
+    for (i = 0; i < nb_new && ms->nb < MAX_NB; i++)
+        meteor_add(ms);
+
+    for (i = 0; i < ms->nb; i++) {
+        ms->pool.time[i] += dt;
+        if (ms->pool.time[i] > ms->pool.duration[i]) {
+            meteor_remove(ms, i--);
+            continue;
         }
+        vec3_addk(ms->pool.pos[i], ms->pool.speed[i], dt, ms->pool.pos[i]);
     }
 
-    return 0;
+    // The meteors are always moving.
+    return ms->nb ? 1 : 0;
 }
 
-static int meteors_render(const obj_t *obj, const painter_t *painter)
+static int meteors_render(const obj_t *obj, const painter_t *painter_)
 {
     PROFILE(meterors_render, 0);
-    obj_t *child;
-    MODULE_ITER(obj, child, "meteor")
-        obj_render(child, painter);
+    const meteors_t *ms = (const meteors_t*)obj;
+    const double full_cap[4] = {0, 0, 1, -1};
+    painter_t painter;
+    double (*verts)[3], p2[3], fade;
+    uint16_t *indices;
+    int i, level, nb;
+
+    if (!ms->nb) return 0;
+    verts = core_frame_alloc(ms->nb * 3 * sizeof(*verts));
+    indices = core_frame_alloc(ms->nb * 3 * sizeof(*indices));
+
+    // Very basic fade out, with one mesh per alpha level.
+    for (level = 0; level < NB_FADE_LEVELS; level++) {
+        nb = 0;
+        for (i = 0; i < ms->nb; i++) {
+            fade = max(0.0, 1.0 - ms->pool.time[i] / ms->pool.duration[i]);
+            if (min((int)(fade * NB_FADE_LEVELS), NB_FADE_LEVELS - 1) !=
+                    level)
+                continue;
+            vec3_addk(ms->pool.pos[i], ms->pool.speed[i], -2, p2);
+            tail_get_verts(ms->pool.pos[i], p2, &verts[nb * 3]);
+            indices[nb * 3 + 0] = nb * 3 + 0;
+            indices[nb * 3 + 1] = nb * 3 + 1;
+            indices[nb * 3 + 2] = nb * 3 + 2;
+            nb++;
+        }
+        if (!nb) continue;
+        painter = *painter_;
+        painter.color[3] *= (level + 0.5) / NB_FADE_LEVELS;
+        paint_mesh(&painter, FRAME_ICRF, MODE_TRIANGLES, nb * 3, verts,
+                   nb * 3, indices, full_cap, 0);
+    }
     return 0;
 }
 
 /*
  * Meta class declarations.
  */
-static obj_klass_t meteor_klass = {
-    .id             = "meteor",
-    .size           = sizeof(meteor_t),
-    .init           = meteor_init,
-    .update         = meteor_update,
-    .render         = meteor_render,
-};
-OBJ_REGISTER(meteor_klass)
-
 static obj_klass_t meteors_klass = {
     .id             = "meteors",
     .size           = sizeof(meteors_t),
-    .flags          = OBJ_IN_JSON_TREE | OBJ_MODULE,
+    .flags          = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_UPDATE_PARALLEL,
     .render_order   = 20,
     .init           = meteors_init,
     .update         = meteors_update,
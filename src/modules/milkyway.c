@@ -9,6 +9,10 @@
 
 #include "swe.h"
 
+// Defined in dss.c
+bool dss_get_layer(obj_t *obj, const painter_t *painter, hips_t **hips,
+                   painter_t *out, int *split_order);
+
 typedef struct milkyway {
     obj_t           obj;
     fader_t         visible;
@@ -34,9 +38,12 @@ static int milkyway_render(const obj_t *obj, const painter_t *painter_)
 {
     PROFILE(milkyway_render, 0);
     double lum, c;
-    int split_order = 2;
+    int split_order = 2, dss_split_order;
     milkyway_t *mw = (milkyway_t*)obj;
     painter_t painter = *painter_;
+    painter_t painters[2];
+    hips_t *surveys[2];
+    obj_t *dss;
     double visibility;
 
     if (!mw->hips) return 0;
@@ -59,6 +66,19 @@ static int milkyway_render(const obj_t *obj, const painter_t *painter_)
     if (painter.color[3] < 1./255)
         return 0;
 
+    // In the zoom range where the DSS is also visible, render both surveys
+    // in a single pass so that we only traverse the tiles once.
+    dss = core_get_module("dss");
+    if (visibility < 1.0 && dss &&
+            dss_get_layer(dss, painter_, &surveys[1], &painters[1],
+                          &dss_split_order)) {
+        surveys[0] = mw->hips;
+        painters[0] = painter;
+        hips_render_multi(2, surveys, painters, 2 * M_PI,
+                          max(split_order, dss_split_order));
+        return 0;
+    }
+
     hips_render(mw->hips, &painter, 2 * M_PI, split_order);
     return 0;
 }
@@ -88,7 +108,7 @@ static int milkyway_add_data_source(
 static obj_klass_t milkyway_klass = {
     .id = "milkyway",
     .size = sizeof(milkyway_t),
-    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE,
+    .flags = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_UPDATE_PARALLEL,
     .init = milkyway_init,
     .update = milkyway_update,
     .render = milkyway_render,
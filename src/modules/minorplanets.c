@@ -8,6 +8,7 @@
  */
 
 #include "swe.h"
+#include "eph-file.h"
 #include "mpc.h"
 #include <zlib.h> // For crc32.
 
@@ -27,6 +28,9 @@ typedef struct orbit_t {
 /*
  * Type: mplanet_t
  * Object that represents a single minor planet.
+ *
+ * The module doesn't keep those objects, they are only created on demand
+ * from its flat storage.
  */
 typedef struct {
     obj_t       obj;
@@ -36,22 +40,79 @@ typedef struct {
     char        name[24];
     char        desig[24];  // Principal designation.
     int         mpl_number; // Minor planet number if one has been assigned.
-    bool        on_screen;  // Set once the object has been visible.
 
     // Cached values.
+    uint64_t    obs_hash; // Hash of the observer of the last update.
     float       vmag;
     double      pvo[2][4];
 } mplanet_t;
 
+// Static data of a minor planet in the module storage.
+typedef struct {
+    uint64_t    oid;
+    char        type[4];
+    int         mpl_number;
+    int         name;   // Offset in the names pool.
+    int         desig;  // Offset in the names pool.
+} mplanet_info_t;
+
 /*
  * Type: mplanets_t
  * Minor planets module object
+ *
+ * All the minor planets are stored as arrays of orbit elements, so that we
+ * can compute all their positions in batch at each frame.
  */
 typedef struct mplanets {
     obj_t   obj;
-    int     update_pos; // Index of the position for iterative update.
+    int     nb;
+    int     capacity;
+    struct {
+        float *d, *i, *o, *w, *a, *n, *e, *m;
+    } orbits;
+    float   *h;
+    float   *g;
+    mplanet_info_t *infos;
+    // Pool of all the names, zero terminated.  Most minor planets have no
+    // name, so we don't store them inline.
+    char    *names;
+    int     names_size;
+    int     names_capacity;
+
+    // Cached values, updated for all the objects when the observer changes.
+    uint64_t obs_hash;
+    float   *vmag;
+    double  (*pos)[3]; // Apparent position in ICRF (AU).
 } mplanets_t;
 
+// Precision of the Kepler equation solver (rad).
+#define KEPLER_PRECISION 1e-5
+
+// Number of minor planets per batch update call.
+#define UPDATE_BLOCK_SIZE 256
+
+// Size of the chunks of MPC text data we parse in parallel (bytes).
+#define PARSE_CHUNK_SIZE (64 * 1024)
+
+// A minor planet as parsed from the source data.  Values are stored as
+// float since this is what we use in the storage and eph tables.
+typedef struct {
+    int     number;
+    int     flags;
+    char    desig[24];
+    char    name[24];
+    float   h, g, epoch, m, w, o, i, e, n, a;
+} mpc_row_t;
+
+// A chunk of MPC text data and its parsed rows.
+typedef struct {
+    const char  *data;
+    int         size;
+    mpc_row_t   *rows;
+    int         nb;
+    int         nb_err;
+} parse_chunk_t;
+
 
 static uint64_t compute_oid(int number, const char desig[static 22])
 {
@@ -98,57 +159,225 @@ static const char *ORBIT_TYPES[] = {
 };
 
 
-static void load_data(mplanets_t *mplanets, const char *data, int size)
+// Make sure the storage can hold at least nb minor planets.
+static void mplanets_reserve(mplanets_t *mps, int nb)
+{
+    if (nb <= mps->capacity) return;
+    mps->capacity = max(nb, mps->capacity * 2);
+    #define GROW(a) a = realloc(a, mps->capacity * sizeof(*a))
+    GROW(mps->orbits.d);
+    GROW(mps->orbits.i);
+    GROW(mps->orbits.o);
+    GROW(mps->orbits.w);
+    GROW(mps->orbits.a);
+    GROW(mps->orbits.n);
+    GROW(mps->orbits.e);
+    GROW(mps->orbits.m);
+    GROW(mps->h);
+    GROW(mps->g);
+    GROW(mps->infos);
+    GROW(mps->vmag);
+    GROW(mps->pos);
+    #undef GROW
+}
+
+// Add a name to the pool and return its offset, 0 for an empty name.
+static int add_name(mplanets_t *mps, const char *name)
 {
-    const char *line = NULL;
-    int r, len, line_idx = 0, flags, orbit_type, number, nb_err, nb;
-    char desig[24], name[24];
+    int len = strlen(name) + 1, ret;
+    if (!mps->names_size) {
+        mps->names_capacity = 1024;
+        mps->names = calloc(mps->names_capacity, 1);
+        mps->names_size = 1; // Offset zero is the empty string.
+    }
+    if (!*name) return 0;
+    if (mps->names_size + len > mps->names_capacity) {
+        mps->names_capacity = max(mps->names_capacity * 2,
+                                  mps->names_size + len);
+        mps->names = realloc(mps->names, mps->names_capacity);
+    }
+    ret = mps->names_size;
+    memcpy(mps->names + ret, name, len);
+    mps->names_size += len;
+    return ret;
+}
+
+// Add a minor planet to the storage, angles in radians.
+static void add_mplanet(mplanets_t *mps, const mpc_row_t *row)
+{
+    int k;
+    mplanet_info_t *info;
+
+    mplanets_reserve(mps, mps->nb + 1);
+    k = mps->nb++;
+    mps->orbits.d[k] = row->epoch;
+    mps->orbits.m[k] = row->m;
+    mps->orbits.w[k] = row->w;
+    mps->orbits.o[k] = row->o;
+    mps->orbits.i[k] = row->i;
+    mps->orbits.e[k] = row->e;
+    mps->orbits.n[k] = row->n;
+    mps->orbits.a[k] = row->a;
+    mps->h[k] = row->h;
+    mps->g[k] = row->g;
+
+    info = &mps->infos[k];
+    memset(info, 0, sizeof(*info));
+    strncpy(info->type, ORBIT_TYPES[row->flags & 0x3f], 4);
+    info->mpl_number = row->number;
+    info->oid = compute_oid(row->number, row->desig);
+    info->name = add_name(mps, row->name);
+    info->desig = add_name(mps, row->desig);
+    module_register_oid(&mps->obj, info->oid, k + 1);
+    search_add(&mps->obj, mps->names + info->name, info->oid, k + 1);
+    search_add(&mps->obj, mps->names + info->desig, info->oid, k + 1);
+}
+
+// Parse a chunk of MPC text data.  Can run in any thread.
+static void parse_chunks(void *user, int start, int end)
+{
+    parse_chunk_t *chunks = user, *chunk;
+    const char *line;
+    int c, r, len;
     double h, g, m, w, o, i, e, n, a, epoch;
-    mplanet_t *mplanet;
-    obj_t *tmp;
-
-    line_idx = 0;
-    nb_err = 0;
-    while (iter_lines(data, size, &line, &len)) {
-        line_idx++;
-        if (len < 160) continue;
-        r = mpc_parse_line(line, len, &number, name, desig,
-                           &h, &g, &epoch, &m, &w, &o, &i, &e,
-                           &n, &a, &flags);
-        if (r) {
-            nb_err++;
-            continue;
-        }
-        mplanet = (void*)obj_create("asteroid", NULL, &mplanets->obj, NULL);
-        mplanet->orbit.d = epoch;
-        mplanet->orbit.m = m * DD2R;
-        mplanet->orbit.w = w * DD2R;
-        mplanet->orbit.o = o * DD2R;
-        mplanet->orbit.i = i * DD2R;
-        mplanet->orbit.e = e;
-        mplanet->orbit.n = n * DD2R;
-        mplanet->orbit.a = a;
-        mplanet->h = h;
-        mplanet->g = g;
-
-        orbit_type = flags & 0x3f;
-        strncpy(mplanet->obj.type, ORBIT_TYPES[orbit_type], 4);
-        mplanet->mpl_number = number;
-        mplanet->obj.oid = compute_oid(number, desig);
-        if (name[0]) {
-            _Static_assert(sizeof(name) == sizeof(mplanet->name), "");
-            memcpy(mplanet->name, name, sizeof(name));
-        }
-        if (desig[0]) {
-            _Static_assert(sizeof(desig) == sizeof(mplanet->desig), "");
-            memcpy(mplanet->desig, desig, sizeof(desig));
+    mpc_row_t *row;
+
+    for (c = start; c < end; c++) {
+        chunk = &chunks[c];
+        // All the valid lines are at least 160 chars long.
+        chunk->rows = malloc((chunk->size / 160 + 1) * sizeof(*chunk->rows));
+        line = NULL;
+        while (iter_lines(chunk->data, chunk->size, &line, &len)) {
+            if (len < 160) continue;
+            row = &chunk->rows[chunk->nb];
+            // Zero the buffers, since the designation crc covers the bytes
+            // after the end of the string.
+            memset(row->name, 0, sizeof(row->name));
+            memset(row->desig, 0, sizeof(row->desig));
+            r = mpc_parse_line(line, len, &row->number, row->name,
+                               row->desig, &h, &g, &epoch, &m, &w, &o, &i,
+                               &e, &n, &a, &row->flags);
+            if (r) {
+                chunk->nb_err++;
+                continue;
+            }
+            row->h = h;
+            row->g = g;
+            row->epoch = epoch;
+            row->m = m * DD2R;
+            row->w = w * DD2R;
+            row->o = o * DD2R;
+            row->i = i * DD2R;
+            row->e = e;
+            row->n = n * DD2R;
+            row->a = a;
+            chunk->nb++;
         }
     }
+}
+
+/*
+ * Parse MPC text data.
+ *
+ * The data is split into chunks on lines boundaries that we parse in
+ * parallel, then the results are added in order to the storage.
+ */
+static void load_data(mplanets_t *mplanets, const char *data, int size)
+{
+    int nb_chunks = 0, nb_err = 0, i, j, chunk_size;
+    const char *end;
+    parse_chunk_t *chunks;
+
+    chunks = calloc(size / PARSE_CHUNK_SIZE + 1, sizeof(*chunks));
+    while (size > 0) {
+        chunk_size = min(size, PARSE_CHUNK_SIZE);
+        end = memchr(data + chunk_size - 1, '\n', size - chunk_size + 1);
+        if (end) chunk_size = end - data + 1;
+        else chunk_size = size;
+        chunks[nb_chunks].data = data;
+        chunks[nb_chunks].size = chunk_size;
+        nb_chunks++;
+        data += chunk_size;
+        size -= chunk_size;
+    }
+    worker_parallel_for(nb_chunks, 1, chunks, parse_chunks);
+
+    for (i = 0; i < nb_chunks; i++) {
+        mplanets_reserve(mplanets, mplanets->nb + chunks[i].nb);
+        for (j = 0; j < chunks[i].nb; j++)
+            add_mplanet(mplanets, &chunks[i].rows[j]);
+        nb_err += chunks[i].nb_err;
+        free(chunks[i].rows);
+    }
+    free(chunks);
     if (nb_err) {
         LOG_W("Minor planet data got %d errors lines.", nb_err);
     }
-    DL_COUNT(mplanets->obj.children, tmp, nb);
-    LOG_I("Parsed %d asteroids", nb);
+    mplanets->obs_hash = 0;
+    LOG_I("Parsed %d asteroids", mplanets->nb);
+}
+
+// Load the table chunk of an eph minor planets file.
+static int on_eph_chunk(const char type[4], const void *data, int size,
+                        void *user)
+{
+    mplanets_t *mps = user;
+    int version, order, pix, data_ofs = 0, nb, row_size, flags, i, r = 0;
+    const void *table_data;
+    mpc_row_t *rows;
+    eph_table_column_t columns[] = {
+        {"num",  'i'},
+        {"flag", 'i'},
+        {"desi", 's'},
+        {"name", 's'},
+        {"h",    'f', EPH_VMAG},
+        {"g",    'f'},
+        {"epoc", 'f'},
+        {"m",    'f', EPH_RAD},
+        {"w",    'f', EPH_RAD},
+        {"o",    'f', EPH_RAD},
+        {"i",    'f', EPH_RAD},
+        {"e",    'f'},
+        {"n",    'f'},
+        {"a",    'f'},
+    };
+    // Corresponding fields of the rows.
+    const int ofs[] = {
+        offsetof(mpc_row_t, number), offsetof(mpc_row_t, flags),
+        offsetof(mpc_row_t, desig), offsetof(mpc_row_t, name),
+        offsetof(mpc_row_t, h), offsetof(mpc_row_t, g),
+        offsetof(mpc_row_t, epoch), offsetof(mpc_row_t, m),
+        offsetof(mpc_row_t, w), offsetof(mpc_row_t, o),
+        offsetof(mpc_row_t, i), offsetof(mpc_row_t, e),
+        offsetof(mpc_row_t, n), offsetof(mpc_row_t, a),
+    };
+
+    if (strncmp(type, "MPCO", 4) != 0) return 0;
+    eph_read_tile_header(data, size, &data_ofs, &version, &order, &pix);
+    nb = eph_read_table_header(version, data, size, &data_ofs, &row_size,
+                               &flags, ARRAY_SIZE(columns), columns);
+    if (nb < 0) goto error;
+    // The strings must fit into the rows buffers.
+    if (columns[2].size > 24 || columns[3].size > 24) goto error;
+    table_data = eph_read_compressed_block_tmp(data, size, &data_ofs, &size);
+    if (!table_data) goto error;
+
+    rows = calloc(nb, sizeof(*rows));
+    for (i = 0; i < ARRAY_SIZE(columns); i++) {
+        r |= eph_read_table_column(table_data, size, nb, flags, &columns[i],
+                                   (void*)rows + ofs[i], sizeof(*rows));
+    }
+    if (r == 0) {
+        mplanets_reserve(mps, mps->nb + nb);
+        for (i = 0; i < nb; i++) add_mplanet(mps, &rows[i]);
+    }
+    free(rows);
+    if (r) goto error;
+    return 0;
+
+error:
+    LOG_E("Cannot parse minor planets eph data");
+    return -1;
 }
 
 static int mplanets_add_data_source(
@@ -163,7 +392,13 @@ static int mplanets_add_data_source(
         LOG_W("Cannot read asteroids data (%s)", url);
         return 0;
     }
-    load_data(mplanets, data, size);
+    if (size >= 4 && strncmp(data, "EPHE", 4) == 0) {
+        eph_load(data, size, mplanets, on_eph_chunk);
+        mplanets->obs_hash = 0;
+        LOG_I("Loaded %d asteroids", mplanets->nb);
+    } else {
+        load_data(mplanets, data, size);
+    }
     asset_release(url);
     return 0;
 }
@@ -202,29 +437,119 @@ static int mplanet_init(obj_t *obj, json_value *args)
     return 0;
 }
 
+// Create a minor planet object from the module storage.
+static mplanet_t *mplanet_create(const mplanets_t *mps, int k)
+{
+    mplanet_t *mp;
+    const mplanet_info_t *info = &mps->infos[k];
+
+    mp = (void*)obj_create("asteroid", NULL, NULL, NULL);
+    mp->orbit = (orbit_t) {
+        .d = mps->orbits.d[k],
+        .i = mps->orbits.i[k],
+        .o = mps->orbits.o[k],
+        .w = mps->orbits.w[k],
+        .a = mps->orbits.a[k],
+        .n = mps->orbits.n[k],
+        .e = mps->orbits.e[k],
+        .m = mps->orbits.m[k],
+    };
+    mp->h = mps->h[k];
+    mp->g = mps->g[k];
+    strncpy(mp->obj.type, info->type, 4);
+    mp->obj.oid = info->oid;
+    mp->mpl_number = info->mpl_number;
+    snprintf(mp->name, sizeof(mp->name), "%s", mps->names + info->name);
+    snprintf(mp->desig, sizeof(mp->desig), "%s", mps->names + info->desig);
+    return mp;
+}
+
+/*
+ * Compute the apparent position and the magnitude of a minor planet from
+ * its heliocentric ecliptic position.
+ */
+static void compute_apparent(const observer_t *obs, double h, double g,
+                             double pvh[2][3], double pvo[2][3],
+                             double *vmag)
+{
+    mat3_mul_vec3(obs->re2i, pvh[0], pvh[0]);
+    mat3_mul_vec3(obs->re2i, pvh[1], pvh[1]);
+    position_to_apparent(obs, ORIGIN_HELIOCENTRIC, false, pvh, pvo);
+    // Compute vmag using algo from
+    // http://www.britastro.org/asteroids/dymock4.pdf
+    *vmag = compute_magnitude(h, g, pvh[0], pvo[0]);
+}
+
 static int mplanet_update(mplanet_t *mp, const observer_t *obs)
 {
-    double pvh[2][3], pvo[2][3];
+    double pvh[2][3], pvo[2][3], vmag;
 
-    orbit_compute_pv(0, obs->ut1, pvh[0], pvh[1],
+    if (mp->obs_hash == obs->hash_pos) return 0;
+    orbit_compute_pv(KEPLER_PRECISION, obs->ut1, pvh[0], pvh[1],
             mp->orbit.d, mp->orbit.i, mp->orbit.o, mp->orbit.w,
             mp->orbit.a, mp->orbit.n, mp->orbit.e, mp->orbit.m,
             0, 0);
-
-    mat3_mul_vec3(obs->re2i, pvh[0], pvh[0]);
-    mat3_mul_vec3(obs->re2i, pvh[1], pvh[1]);
-    position_to_apparent(obs, ORIGIN_HELIOCENTRIC, false, pvh, pvo);
+    compute_apparent(obs, mp->h, mp->g, pvh, pvo, &vmag);
     vec3_copy(pvo[0], mp->pvo[0]);
     vec3_copy(pvo[1], mp->pvo[1]);
     mp->pvo[0][3] = 1.0; // AU unit.
     mp->pvo[1][3] = 1.0;
-
-    // Compute vmag using algo from
-    // http://www.britastro.org/asteroids/dymock4.pdf
-    mp->vmag = compute_magnitude(mp->h, mp->g, pvh[0], pvo[0]);
+    mp->vmag = vmag;
+    mp->obs_hash = obs->hash_pos;
     return 0;
 }
 
+// Update a range of the module storage.  Can run in any thread.
+static void update_block(void *user, int start, int end)
+{
+    mplanets_t *mps = USER_GET(user, 0);
+    const observer_t *obs = USER_GET(user, 1);
+    int i, nb = end - start;
+    double pos[UPDATE_BLOCK_SIZE][3], speed[UPDATE_BLOCK_SIZE][3];
+    double pvh[2][3], pvo[2][3], vmag;
+
+    assert(nb <= UPDATE_BLOCK_SIZE);
+    orbit_compute_pv_batch(KEPLER_PRECISION, obs->ut1, nb,
+            mps->orbits.d + start, mps->orbits.i + start,
+            mps->orbits.o + start, mps->orbits.w + start,
+            mps->orbits.a + start, mps->orbits.n + start,
+            mps->orbits.e + start, mps->orbits.m + start,
+            pos, speed);
+    for (i = 0; i < nb; i++) {
+        vec3_copy(pos[i], pvh[0]);
+        vec3_copy(speed[i], pvh[1]);
+        compute_apparent(obs, mps->h[start + i], mps->g[start + i],
+                         pvh, pvo, &vmag);
+        vec3_copy(pvo[0], mps->pos[start + i]);
+        mps->vmag[start + i] = vmag;
+    }
+}
+
+// Update the positions of all the minor planets for a given observer.
+static void mplanets_update(mplanets_t *mps, const observer_t *obs)
+{
+    if (mps->obs_hash == obs->hash_pos) return;
+    worker_parallel_for(mps->nb, UPDATE_BLOCK_SIZE, USER_PASS(mps, obs),
+                        update_block);
+    mps->obs_hash = obs->hash_pos;
+}
+
+static int mplanets_prepare(const obj_t *obj, const painter_t *painter,
+                            render_task_t *task)
+{
+    mplanets_t *mps = (void*)obj;
+    const observer_t *obs = painter->obs;
+
+    if (mps->obs_hash == obs->hash_pos) return 0;
+    *task = (render_task_t) {
+        .n = mps->nb, .block = UPDATE_BLOCK_SIZE,
+        .args = {mps, (void*)obs}, .fn = update_block,
+    };
+    // All the tasks are done before the render.
+    mps->obs_hash = obs->hash_pos;
+    return 1;
+}
+
 static int mplanet_get_info(const obj_t *obj, const observer_t *obs, int info,
                             void *out)
 {
@@ -241,41 +566,53 @@ static int mplanet_get_info(const obj_t *obj, const observer_t *obs, int info,
     return 1;
 }
 
-static int mplanet_render(const obj_t *obj, const painter_t *painter)
+/*
+ * Compute the point of a minor planet and add its label if needed.
+ *
+ * Return false if the minor planet is not visible.
+ */
+static bool get_point(const painter_t *painter, uint64_t oid,
+                      const char *name, double vmag, const double pos[3],
+                      point_t *point)
 {
-    double pvo[2][4], win_pos[2], vmag, size, luminance;
+    double win_pos[2], size, luminance;
     double label_color[4] = RGBA(255, 124, 124, 255);
-    mplanet_t *mplanet = (mplanet_t*)obj;
-    point_t point;
-    const bool selected = core->selection && obj->oid == core->selection->oid;
+    const bool selected = core->selection && oid == core->selection->oid;
 
-    mplanet_update(mplanet, painter->obs);
-    vmag = mplanet->vmag;
-    if (vmag > painter->stars_limit_mag) return 0;
-    obj_get_pvo(obj, painter->obs, pvo);
-    if (!painter_project(painter, FRAME_ICRF, pvo[0], false, true, win_pos))
-        return 0;
+    if (vmag > painter->stars_limit_mag) return false;
+    if (!painter_project(painter, FRAME_ICRF, pos, false, true, win_pos))
+        return false;
 
-    mplanet->on_screen = true;
     core_get_point_for_mag(vmag, &size, &luminance);
-
-    point = (point_t) {
+    *point = (point_t) {
         .pos = {win_pos[0], win_pos[1]},
         .size = size,
         .color = {255, 255, 255, luminance * 255},
-        .oid = obj->oid,
+        .oid = oid,
     };
-    paint_2d_points(painter, 1, &point);
 
     // Render name if needed.
-    if (*mplanet->name && (selected || vmag <= painter->hints_limit_mag)) {
+    if (*name && (selected || vmag <= painter->hints_limit_mag)) {
         if (selected)
             vec4_set(label_color, 1, 1, 1, 1);
-        labels_add_3d(mplanet->name, FRAME_ICRF, pvo[0], false, size,
+        labels_add_3d(name, FRAME_ICRF, pos, false, size,
                       FONT_SIZE_BASE, label_color, 0, LABEL_AROUND,
                       selected ? TEXT_BOLD : 0,
-                      0, obj->oid);
+                      0, oid);
     }
+    return true;
+}
+
+static int mplanet_render(const obj_t *obj, const painter_t *painter)
+{
+    mplanet_t *mplanet = (mplanet_t*)obj;
+    point_t point;
+
+    mplanet_update(mplanet, painter->obs);
+    if (!get_point(painter, obj->oid, mplanet->name, mplanet->vmag,
+                   mplanet->pvo[0], &point))
+        return 0;
+    paint_2d_points(painter, 1, &point);
     return 0;
 }
 
@@ -299,56 +636,65 @@ void mplanet_get_designations(
     if (*mplanet->desig) f(obj, user, "NAME", mplanet->desig);
 }
 
-static bool range_contains(int range_start, int range_size, int nb, int i)
-{
-    if (i < range_start) i += nb;
-    return i > range_start && i < range_start + range_size;
-}
-
 static int mplanets_render(const obj_t *obj, const painter_t *painter)
 {
     PROFILE(mplanets_render, 0);
 
     mplanets_t *mps = (void*)obj;
-    int i, nb;
-    const int update_nb = 32;
-    mplanet_t *child;
-    obj_t *tmp;
-    uint64_t selection_oid = core->selection ? core->selection->oid : 0;
-
-    DL_COUNT(obj->children, tmp, nb);
-
-    /* To prevent spending too much time computing position of asteroids that
-     * are not visible, we only update a small number of them at each
-     * frame, using a moving range.  The asteroids who have been flagged as
-     * on screen get updated no matter what.  */
-    i = 0;
-    MODULE_ITER(obj, child, NULL) {
-        if (    !child->on_screen &&
-                child->obj.oid != selection_oid &&
-                !range_contains(mps->update_pos, update_nb, nb, i))
+    int i, nb = 0;
+    point_t points[UPDATE_BLOCK_SIZE];
+
+    mplanets_update(mps, painter->obs);
+    for (i = 0; i < mps->nb; i++) {
+        if (!get_point(painter, mps->infos[i].oid,
+                       mps->names + mps->infos[i].name,
+                       mps->vmag[i], mps->pos[i], &points[nb]))
             continue;
-        obj_render((obj_t*)child, painter);
+        if (++nb < ARRAY_SIZE(points)) continue;
+        paint_2d_points(painter, nb, points);
+        nb = 0;
     }
-    mps->update_pos = nb ? (mps->update_pos + update_nb) % nb : 0;
+    if (nb) paint_2d_points(painter, nb, points);
     return 0;
 }
 
 static obj_t *mplanets_get_by_oid(
         const obj_t *obj, uint64_t oid, uint64_t hint)
 {
-    obj_t *child;
+    const mplanets_t *mps = (void*)obj;
+    int i;
     if (    !oid_is_catalog(oid, "MPl") &&
             !oid_is_catalog(oid, "MPl*")) return NULL;
-    MODULE_ITER(obj, child, NULL) {
-        if (child->oid == oid) {
-            child->ref++;
-            return child;
-        }
+    // Hint from the oid index: minor planet index + 1.
+    if (hint && hint <= mps->nb && mps->infos[hint - 1].oid == oid)
+        return (obj_t*)mplanet_create(mps, hint - 1);
+    for (i = 0; i < mps->nb; i++) {
+        if (mps->infos[i].oid == oid)
+            return (obj_t*)mplanet_create(mps, i);
     }
     return NULL;
 }
 
+static int mplanets_list(const obj_t *obj, observer_t *obs,
+                         double max_mag, uint64_t hint, void *user,
+                         int (*f)(void *user, obj_t *obj))
+{
+    mplanets_t *mps = (void*)obj;
+    mplanet_t *mp;
+    int i, r;
+
+    mplanets_update(mps, obs);
+    for (i = 0; i < mps->nb; i++) {
+        if (mps->vmag[i] > max_mag) continue;
+        if (!f) continue;
+        mp = mplanet_create(mps, i);
+        r = f(user, &mp->obj);
+        obj_release(&mp->obj);
+        if (r) break;
+    }
+    return 0;
+}
+
 
 /*
  * Meta class declarations.
@@ -370,8 +716,10 @@ static obj_klass_t mplanets_klass = {
     .size           = sizeof(mplanets_t),
     .flags          = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_LISTABLE,
     .add_data_source    = mplanets_add_data_source,
+    .prepare        = mplanets_prepare,
     .render         = mplanets_render,
     .get_by_oid     = mplanets_get_by_oid,
+    .list           = mplanets_list,
     .render_order   = 20,
 };
 OBJ_REGISTER(mplanets_klass)
@@ -78,9 +78,22 @@ static int on_click(const gesture_t *gest, void *user)
     return 0;
 }
 
+// Minimum time between two hover lookups with the gpu picking (sec).
+#define HOVER_PICK_INTERVAL 0.1
+
 static int on_hover(const gesture_t *gest, void *user)
 {
     obj_t *obj;
+    static double last_pick = 0;
+    double t;
+
+    // Each gpu picking reads back from the gpu, so don't do it at every
+    // mouse move.
+    if (core->gpu_picking) {
+        t = sys_get_unix_time();
+        if (t - last_pick < HOVER_PICK_INTERVAL) return 0;
+        last_pick = t;
+    }
     obj = core_get_obj_at(gest->pos[0], gest->pos[1], 18);
     obj_set_attr(&core->obj, "hovered", obj);
     obj_release(obj);
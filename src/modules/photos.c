@@ -10,10 +10,53 @@
 #include "swe.h"
 
 // Support embedding online photos in the sky.
+//
+// The photos can be much larger than the max texture size, so once
+// decoded we split them into a pyramid of tiles: each level is half the
+// size of the previous one, up to a level that fits into a single tile.
+// We only create the textures of the visible tiles at the resolution of
+// the screen, and keep them in a cache.
+
+// Size of the tiles (px).
+#define TILE_SIZE 512
+// Max number of new tiles textures per frame.
+#define MAX_NEW_TILES 4
+// Max memory used by the tiles textures (bytes).
+#define TILES_CACHE_SIZE (128 * (1 << 20))
+
+#define MAX_LEVELS 16
+
+// A level of the pyramid.  Level zero is the full size image.
+typedef struct {
+    uint8_t     *data;
+    int         w, h;
+} level_t;
+
+// Decode an image and compute its pyramid in a thread.
+typedef struct {
+    worker_t    worker;
+    uint8_t     *src_data;  // Encoded image data.
+    int         size;
+    int         bpp;
+    int         nb_levels;
+    level_t     levels[MAX_LEVELS];
+} loader_t;
+
+typedef struct {
+    uint32_t    photo_id;
+    int         level;
+    int         x, y;
+} tile_key_t;
 
 typedef struct photo {
     obj_t       obj;
-    texture_t   *img;
+    char        *url;
+    uint32_t    id;     // Unique id of the loaded image, for the tiles cache.
+    loader_t    *loader;
+    bool        error;
+    int         bpp;
+    int         nb_levels;
+    level_t     levels[MAX_LEVELS];
     fader_t     visible;
     // Only render the shape if set.
     // Note: we could have more control, like rendering both the pic and
@@ -32,6 +75,110 @@ typedef struct photo {
     double      mat[4][4];
 } photo_t;
 
+// Cache of the tiles textures of all the photos.
+static cache_t *g_tiles = NULL;
+
+static void levels_release(level_t *levels, int nb)
+{
+    int i;
+    for (i = 0; i < nb; i++) free(levels[i].data);
+}
+
+static int load_worker(worker_t *worker)
+{
+    loader_t *loader = (void*)worker;
+    level_t *src, *dst;
+    int i, x, y, k, w, h, bpp, sx, sy, sum;
+
+    src = &loader->levels[0];
+    src->data = img_read_from_mem(loader->src_data, loader->size,
+                                  &src->w, &src->h, &loader->bpp);
+    free(loader->src_data);
+    loader->src_data = NULL;
+    if (!src->data) return 0;
+    loader->nb_levels = 1;
+    bpp = loader->bpp;
+
+    // Box filter each level into the next one, until it fits in a tile.
+    for (i = 1; i < MAX_LEVELS; i++) {
+        src = &loader->levels[i - 1];
+        if (src->w <= TILE_SIZE && src->h <= TILE_SIZE) break;
+        dst = &loader->levels[i];
+        w = dst->w = max(1, src->w / 2);
+        h = dst->h = max(1, src->h / 2);
+        dst->data = malloc(w * h * bpp);
+        for (y = 0; y < h; y++) for (x = 0; x < w; x++) {
+            sx = min(2 * x + 1, src->w - 1);
+            sy = min(2 * y + 1, src->h - 1);
+            for (k = 0; k < bpp; k++) {
+                sum = src->data[((2 * y) * src->w + 2 * x) * bpp + k] +
+                      src->data[((2 * y) * src->w + sx) * bpp + k] +
+                      src->data[(sy * src->w + 2 * x) * bpp + k] +
+                      src->data[(sy * src->w + sx) * bpp + k];
+                dst->data[(y * w + x) * bpp + k] = sum / 4;
+            }
+        }
+        loader->nb_levels++;
+    }
+    return 0;
+}
+
+static void photo_reset(photo_t *photo)
+{
+    if (photo->loader) {
+        if (!worker_cancel(&photo->loader->worker))
+            while (!worker_iter(&photo->loader->worker)) {}
+        free(photo->loader->src_data);
+        levels_release(photo->loader->levels, photo->loader->nb_levels);
+        free(photo->loader);
+        photo->loader = NULL;
+    }
+    levels_release(photo->levels, photo->nb_levels);
+    memset(photo->levels, 0, sizeof(photo->levels));
+    photo->nb_levels = 0;
+    photo->error = false;
+    photo->mat[3][3] = 0;
+}
+
+// Check if the image is loaded, and start its decoding if needed.
+static bool photo_update(photo_t *photo)
+{
+    static uint32_t g_last_id = 0;
+    const void *data;
+    int size, code;
+
+    if (photo->nb_levels) return true;
+    if (!photo->url || photo->error) return false;
+
+    if (!photo->loader) {
+        data = asset_get_data2(photo->url, ASSET_USED_ONCE, &size, &code);
+        if (!code) return false;
+        if (!data) {
+            LOG_E("Cannot get photo %s (%d)", photo->url, code);
+            photo->error = true;
+            return false;
+        }
+        photo->loader = calloc(1, sizeof(*photo->loader));
+        photo->loader->src_data = malloc(size);
+        photo->loader->size = size;
+        memcpy(photo->loader->src_data, data, size);
+        worker_init(&photo->loader->worker, load_worker);
+    }
+
+    if (!worker_iter(&photo->loader->worker)) return false;
+    if (!photo->loader->nb_levels) {
+        LOG_E("Cannot decode photo %s", photo->url);
+        photo->error = true;
+    }
+    photo->bpp = photo->loader->bpp;
+    photo->nb_levels = photo->loader->nb_levels;
+    memcpy(photo->levels, photo->loader->levels, sizeof(photo->levels));
+    free(photo->loader);
+    photo->loader = NULL;
+    photo->id = ++g_last_id;
+    return photo->nb_levels;
+}
+
 
 static json_value *photo_fn_url(obj_t *obj, const attribute_t *attr,
                                 const json_value *args)
@@ -39,12 +186,13 @@ static json_value *photo_fn_url(obj_t *obj, const attribute_t *attr,
     photo_t *photo = (void*)obj;
     char url[1024];
     if (args->u.array.length) {
-        texture_release(photo->img);
+        photo_reset(photo);
         args_get(args, TYPE_STRING, &url);
-        photo->img = texture_from_url(url, 0);
+        free(photo->url);
+        photo->url = strdup(url);
     }
-    if (!photo->img) return NULL;
-    return args_value_new(TYPE_STRING, photo->img->url);
+    if (!photo->url) return NULL;
+    return args_value_new(TYPE_STRING, photo->url);
 }
 
 static json_value *photo_fn_calibration(obj_t *obj, const attribute_t *attr,
@@ -86,19 +234,118 @@ static void photo_map(const uv_map_t *map, const double v[2], double out[4])
     vec3_copy(p, out);
 }
 
+static int del_tile(void *data)
+{
+    texture_release(data);
+    return 0;
+}
+
+// Return the texture of a tile, creating it if needed and allowed.
+static texture_t *get_tile(const photo_t *photo, int level, int x, int y,
+                           int *nb_new)
+{
+    const level_t *lev = &photo->levels[level];
+    const tile_key_t key = {photo->id, level, x, y};
+    texture_t *tex;
+    int w, h;
+
+    if (!g_tiles) g_tiles = cache_create(TILES_CACHE_SIZE);
+    tex = cache_get(g_tiles, &key, sizeof(key));
+    if (tex || *nb_new >= MAX_NEW_TILES) return tex;
+    (*nb_new)++;
+    w = min(TILE_SIZE, lev->w - x * TILE_SIZE);
+    h = min(TILE_SIZE, lev->h - y * TILE_SIZE);
+    tex = texture_from_data(lev->data, lev->w, lev->h, photo->bpp,
+                            x * TILE_SIZE, y * TILE_SIZE, w, h, 0);
+    cache_add(g_tiles, &key, sizeof(key), tex, texture_get_memory_size(tex),
+              del_tile);
+    return tex;
+}
+
+// Compute the uv mapping of a tile.
+static void get_tile_map(const photo_t *photo, int level, int x, int y,
+                         uv_map_t *map)
+{
+    const level_t *lev = &photo->levels[level];
+    double u0, v0, u1, v1;
+
+    u0 = (double)(x * TILE_SIZE) / lev->w;
+    v0 = (double)(y * TILE_SIZE) / lev->h;
+    u1 = min(1.0, (double)((x + 1) * TILE_SIZE) / lev->w);
+    v1 = min(1.0, (double)((y + 1) * TILE_SIZE) / lev->h);
+    *map = (uv_map_t) {.map = photo_map};
+    mat4_copy(photo->mat, map->mat4);
+    mat4_itranslate(map->mat4, u0, v0, 0.0);
+    mat4_iscale(map->mat4, u1 - u0, v1 - v0, 1.0);
+}
+
+/*
+ * Render a tile, or its children if we need a higher resolution.
+ *
+ * If some visible children are not ready yet, we render the tile itself
+ * instead.  Return false if the tile is not ready.
+ */
+static bool render_tile(const photo_t *photo, const painter_t *painter,
+                        int level, int x, int y, int render_level,
+                        int *nb_new)
+{
+    const level_t *child = &photo->levels[max(level - 1, 0)];
+    uv_map_t map;
+    texture_t *tex;
+    painter_t painter2 = *painter;
+    int i, cx, cy;
+    bool visible[4] = {}, ready = true;
+
+    get_tile_map(photo, level, x, y, &map);
+    if (painter_is_quad_clipped(painter, FRAME_ICRF, &map, true))
+        return true;
+
+    if (level > render_level) {
+        for (i = 0; i < 4; i++) {
+            cx = x * 2 + i % 2;
+            cy = y * 2 + i / 2;
+            if (cx * TILE_SIZE >= child->w || cy * TILE_SIZE >= child->h)
+                continue;
+            get_tile_map(photo, level - 1, cx, cy, &map);
+            visible[i] = !painter_is_quad_clipped(painter, FRAME_ICRF, &map,
+                                                  true);
+            if (visible[i] &&
+                    !get_tile(photo, level - 1, cx, cy, nb_new))
+                ready = false;
+        }
+        if (ready) {
+            for (i = 0; i < 4; i++) {
+                if (!visible[i]) continue;
+                render_tile(photo, painter, level - 1, x * 2 + i % 2,
+                            y * 2 + i / 2, render_level, nb_new);
+            }
+            return true;
+        }
+        get_tile_map(photo, level, x, y, &map);
+    }
+
+    tex = get_tile(photo, level, x, y, nb_new);
+    if (!tex) return false;
+    painter_set_texture(&painter2, PAINTER_TEX_COLOR, tex, NULL);
+    paint_quad(&painter2, FRAME_ICRF, &map, 4);
+    return true;
+}
+
 static int photo_render(const obj_t *obj, const painter_t *painter)
 {
     photo_t *photo = (photo_t*)obj;
     typeof(&photo->calibration) calibration = &photo->calibration;
     uv_map_t map = {};
     painter_t painter2 = *painter;
+    double pix_per_rad;
+    int render_level, nb_new = 0;
 
     fader_update(&photo->visible, 0.06);
     painter2.color[3] *= photo->visible.value;
     if (painter2.color[3] == 0.0) return 0;
 
-    // We can only compute the projection matrix once we get the texture?
-    if (!photo->img || !texture_load(photo->img, NULL)) return 0;
+    // We can only compute the projection matrix once we get the image size.
+    if (!photo_update(photo)) return 0;
 
     if (photo->mat[3][3] == 0) {
         mat4_set_identity(photo->mat);
@@ -106,8 +353,9 @@ static int photo_render(const obj_t *obj, const painter_t *painter)
         mat4_ry(90 * DD2R - calibration->dec, photo->mat, photo->mat);
         mat4_rz(-90 * DD2R, photo->mat, photo->mat);
         mat4_rz(calibration->orientation, photo->mat, photo->mat);
-        mat4_iscale(photo->mat, calibration->pixscale * photo->img->w,
-                                calibration->pixscale * photo->img->h, 1.0);
+        mat4_iscale(photo->mat, calibration->pixscale * photo->levels[0].w,
+                                calibration->pixscale * photo->levels[0].h,
+                                1.0);
         mat4_itranslate(photo->mat, -0.5, -0.5, 0.0);
     }
 
@@ -115,8 +363,14 @@ static int photo_render(const obj_t *obj, const painter_t *painter)
     map.map = photo_map;
 
     if (!photo->render_shape) {
-        painter_set_texture(&painter2, PAINTER_TEX_COLOR, photo->img, NULL);
-        paint_quad(&painter2, FRAME_ICRF, &map, 4);
+        // Use the level whose pixels are closest to the screen pixels.
+        pix_per_rad = painter->fb_size[0] / atan(painter->proj->scaling[0])
+                      / 2;
+        render_level = floor(-log2(calibration->pixscale * pix_per_rad) +
+                             painter->degrade);
+        render_level = clamp(render_level, 0, photo->nb_levels - 1);
+        render_tile(photo, &painter2, photo->nb_levels - 1, 0, 0,
+                    render_level, &nb_new);
     } else {
         paint_quad_contour(&painter2, FRAME_ICRF, &map, 8, 15);
         painter2.color[3] *= 0.25;
@@ -126,6 +380,13 @@ static int photo_render(const obj_t *obj, const painter_t *painter)
     return 0;
 }
 
+static void photo_del(obj_t *obj)
+{
+    photo_t *photo = (void*)obj;
+    photo_reset(photo);
+    free(photo->url);
+}
+
 /*
  * Meta class declarations.
  */
@@ -134,6 +395,7 @@ static obj_klass_t photo_klass = {
     .id         = "photo",
     .size       = sizeof(photo_t),
     .render     = photo_render,
+    .del        = photo_del,
     .attributes = (attribute_t[]) {
         PROPERTY(visible, TYPE_BOOL, MEMBER(photo_t, visible.target)),
         PROPERTY(url, TYPE_STRING_PTR, .fn = photo_fn_url),
@@ -19,6 +19,13 @@
 
 typedef struct planet planet_t;
 
+// Number of coefficients of the Chebyshev approximations of the positions.
+#define CHEB_SIZE 13
+
+// Disk size (px) under which we render the planets surface without
+// traversing their hips survey.
+#define PLANET_SMALL_DISK_SIZE 8
+
 // The planet object klass.
 struct planet {
     obj_t       obj;
@@ -37,6 +44,14 @@ struct planet {
     double last_full_update; // Time of last full orbit update (UT1)
     double last_full_pvh[2][3]; // equ, J2000.0, AU heliocentric pos and speed.
 
+    // Chebyshev approximation of the position given by the body theory
+    // (see get_theory_pos), over a time segment.
+    struct {
+        double start;   // Start of the segment (TT MJD).
+        double len;     // Length of the segment (day), zero if not set.
+        double coefs[3][CHEB_SIZE];
+    } cheb;
+
     // Cached values.
     double      pvh[2][3];   // equ, J2000.0, AU heliocentric pos and speed.
     double      hpos[3];     // ecl, heliocentric pos J2000.0
@@ -46,6 +61,13 @@ struct planet {
     double      radius;     // Apparent disk radius (rad)
     double      mass;       // kg (0 if unknown).
 
+    // Shadow spheres candidates, computed for all the planets once per
+    // observer state.  See <planets_update_shadows>.
+    struct {
+        int         nb;
+        double      spheres[4][4];
+    } shadows;
+
     // Rotation elements
     struct {
         double obliquity;   // (rad)
@@ -75,6 +97,8 @@ struct planet {
         double inner_radius; // (meter)
         double outer_radius; // (meter)
         texture_t *tex;
+        double mag_tt;  // Time of the cached magnitude adjustment (TT MJD).
+        double mag;     // Cached magnitude adjustment.
     } rings;
 
     hips_t      *hips;              // Hips survey of the planet.
@@ -95,6 +119,8 @@ typedef struct planets {
     texture_t *halo_tex;
     // Default HiPS survey.
     hips_t *default_hips;
+    // Observer position hash of the last shadows update.
+    uint64_t shadows_hash;
 } planets_t;
 
 
@@ -151,6 +177,100 @@ static const double VIS_ELEMENTS[][5] = {
             p; \
             p = (planet_t*)p->obj.next)
 
+// Length of the Chebyshev segments of a body (day).
+static double get_cheb_segment_len(const planet_t *planet)
+{
+    switch (planet->id) {
+    case MOON: return 4;
+    case IO: case EUROPA: case GANYMEDE: case CALLISTO: return 0.5;
+    case MERCURY: return 16;
+    default: return 32;
+    }
+}
+
+/*
+ * Compute the position given by the theory of a body at a given time.
+ *
+ * Equatorial J2000.0 position in AU, heliocentric for the planets (PLAN94),
+ * jovicentric for the Galilean moons (L1.2) and geocentric for the Moon.
+ */
+static void get_theory_pos(const planet_t *planet, double tt, double pos[3])
+{
+    double pv[2][3], lambda, beta, dist, obl;
+    double rmatecl[3][3], rmatp[3][3];
+
+    switch (planet->id) {
+    case MOON:
+        // Get ecliptic position of date.
+        moon_pos(DJM0 + tt, &lambda, &beta, &dist);
+        dist *= 1000.0 / DAU; // km to AU.
+        // Convert to equatorial.
+        obl = eraObl06(DJM0, tt); // Mean oblicity of ecliptic at J2000.
+        eraIr(rmatecl);
+        eraRx(-obl, rmatecl);
+        eraS2p(lambda, beta, dist, pos);
+        eraRxp(rmatecl, pos, pos);
+        // Precess back to J2000.
+        eraPmat76(DJM0, tt, rmatp);
+        eraTrxp(rmatp, pos, pos);
+        break;
+    case IO: case EUROPA: case GANYMEDE: case CALLISTO:
+        l12(DJM0, tt, planet->id - IO + 1, pv);
+        vec3_copy(pv[0], pos);
+        break;
+    default:
+        eraPlan94(DJM0, tt, (planet->id - MERCURY) / 100 + 1, pv);
+        vec3_copy(pv[0], pos);
+        break;
+    }
+}
+
+/*
+ * Get the position and speed given by the theory of a body.
+ *
+ * We evaluate a Chebyshev approximation of the theory, that we only fit
+ * again when the time gets out of its segment.  The segments are aligned
+ * on multiples of their length so that going back and forth in time
+ * reuses the same ones.
+ */
+static void get_theory_pv(planet_t *planet, double tt, double pv[2][3])
+{
+    int i, k;
+    double len, start, x, d, pos[3], f[3][CHEB_SIZE];
+    const double h = 0.01; // Step of the reference speed (day).
+
+    // Reference accuracy: the theory itself, with a numerical speed.
+    if (core && core->accuracy == ACCURACY_REFERENCE) {
+        get_theory_pos(planet, tt, pv[0]);
+        get_theory_pos(planet, tt + h, pos);
+        get_theory_pos(planet, tt - h, pv[1]);
+        vec3_sub(pos, pv[1], pv[1]);
+        vec3_mul(1.0 / (2 * h), pv[1], pv[1]);
+        return;
+    }
+
+    start = planet->cheb.start;
+    len = planet->cheb.len;
+    if (!len || tt < start || tt >= start + len) {
+        len = get_cheb_segment_len(planet);
+        start = floor(tt / len) * len;
+        for (i = 0; i < CHEB_SIZE; i++) {
+            x = chebyshev_node(CHEB_SIZE, i);
+            get_theory_pos(planet, start + (x + 1) / 2 * len, pos);
+            for (k = 0; k < 3; k++) f[k][i] = pos[k];
+        }
+        for (k = 0; k < 3; k++)
+            chebyshev_fit(CHEB_SIZE, f[k], planet->cheb.coefs[k]);
+        planet->cheb.start = start;
+        planet->cheb.len = len;
+    }
+    x = 2 * (tt - start) / len - 1;
+    for (k = 0; k < 3; k++) {
+        pv[0][k] = chebyshev_eval(CHEB_SIZE, planet->cheb.coefs[k], x, &d);
+        pv[1][k] = d * 2 / len;
+    }
+}
+
 static int earth_update(planet_t *planet, const observer_t *obs)
 {
     double pv[2][3];
@@ -229,28 +349,13 @@ static int sun_update(planet_t *planet, const observer_t *obs)
 static int moon_update(planet_t *planet, const observer_t *obs)
 {
     double i;   // Phase angle.
-    double lambda, beta, dist;
-    double rmatecl[3][3], rmatp[3][3];
-    double obl;
-    double pos[3], el;
+    double dist, el;
     double pv[2][3];
-    // Get ecliptic position of date.
-    moon_pos(DJM0 + obs->tt, &lambda, &beta, &dist);
-    dist *= 1000.0 / DAU; // km to AU.
-    // Convert to equatorial.
-    obl = eraObl06(DJM0, obs->tt); // Mean oblicity of ecliptic at J2000.
-    eraIr(rmatecl);
-    eraRx(-obl, rmatecl);
-    eraS2p(lambda, beta, dist, pos);
-    eraRxp(rmatecl, pos, pos);
-
-    // Precess back to J2000.
-    eraPmat76(DJM0, obs->tt, rmatp);
-    eraTrxp(rmatp, pos, pos);
-
-    eraCp(pos, pv[0]);
-    // We don't know the speed, set to zero as moon (geocentric) speed is too
-    // small for most effects anyway
+
+    get_theory_pv(planet, obs->tt, pv);
+    dist = vec3_norm(pv[0]);
+    // Ignore the speed, as moon (geocentric) speed is too small for most
+    // effects anyway
     pv[1][0] = 0;
     pv[1][1] = 0;
     pv[1][2] = 0;
@@ -287,15 +392,8 @@ static int plan94_update(planet_t *planet, const observer_t *obs)
     double i;   // Phase angle.
     double pv[2][3];
     int n = (planet->id - MERCURY) / 100 + 1;
-    const double dt = obs->tt - planet->last_full_update;
-    if (fabs(dt) < planet->update_delta_s / ERFA_DAYSEC) {
-        // Fast update from previous position
-        eraPvu(dt, planet->last_full_pvh, planet->pvh);
-    } else {
-        eraPlan94(DJM0, obs->tt, n, planet->last_full_pvh);
-        eraCpv(planet->last_full_pvh, planet->pvh);
-        planet->last_full_update = obs->tt;
-    }
+
+    get_theory_pv(planet, obs->tt, planet->pvh);
 
     position_to_apparent(obs, ORIGIN_HELIOCENTRIC, false, planet->pvh, pv);
     vec3_copy(pv[0], planet->pvo[0]);
@@ -324,16 +422,8 @@ static int l12_update(planet_t *planet, const observer_t *obs)
     double i;   // Phase angle.
     planet_t *jupiter = planet->parent;
     planet_update_(jupiter, obs);
-    const double dt = obs->ut1 - planet->last_full_update;
-    if (fabs(dt) < planet->update_delta_s / ERFA_DAYSEC) {
-        // Fast update from previous position
-        eraPvu(dt, planet->last_full_pvh, planet->pvh);
-    } else {
-        l12(DJM0, obs->tt, planet->id - IO + 1, pvj);
-        eraPvppv(pvj, jupiter->pvh, planet->last_full_pvh);
-        eraCpv(planet->last_full_pvh, planet->pvh);
-        planet->last_full_update = obs->ut1;
-    }
+    get_theory_pv(planet, obs->tt, pvj);
+    eraPvppv(pvj, jupiter->pvh, planet->pvh);
     position_to_apparent(obs, ORIGIN_HELIOCENTRIC, false, planet->pvh, pv);
     vec3_copy(pv[0], planet->pvo[0]);
     vec3_copy(pv[1], planet->pvo[1]);
@@ -444,8 +534,10 @@ static int planet_update_(planet_t *planet, const observer_t *obs)
 
     mat3_mul_vec3(obs->ri2e, planet->pvh[0], planet->hpos);
 
-    // Adjust vmag for saturn.
-    if (planet->id == SATURN) {
+    // Adjust vmag for saturn.  The rings orientation changes slowly, so we
+    // only recompute the adjustment once per day.
+    if (planet->id == SATURN && (!planet->rings.mag_tt ||
+                fabs(obs->tt - planet->rings.mag_tt) > 1.0)) {
         double hlon, hlat;
         double earth_hlon, earth_hlat;
         double et, st, set;
@@ -458,8 +550,10 @@ static int planet_update_(planet_t *planet, const observer_t *obs)
                  earth_hlon, vec3_norm(obs->earth_pvh[0]),
                  obs->ut1 + DJM0, &et, &st);
         set = sin(fabs(et));
-        planet->vmag += (-2.60 + 1.25 * set) * set;
+        planet->rings.mag = (-2.60 + 1.25 * set) * set;
+        planet->rings.mag_tt = obs->tt;
     }
+    if (planet->id == SATURN) planet->vmag += planet->rings.mag;
 
     planet->radius = planet->radius_m / DAU /
             eraPm((double*)planet->pvo[0]);
@@ -509,12 +603,18 @@ static int on_render_tile(hips_t *hips, const painter_t *painter_,
     texture_t *tex, *normalmap = NULL;
     uv_map_t map;
     double fade, uv[3][3] = MAT3_IDENTITY, normal_uv[3][3] = MAT3_IDENTITY;
+    double priority;
     bool loaded;
 
     (*nb_tot)++;
     flags |= HIPS_LOAD_IN_THREAD;
     tex = hips_get_tile_texture(hips, order, pix, flags, uv, &fade, &loaded);
     if (loaded) (*nb_loaded)++;
+    if (!loaded) {
+        priority = painter_get_healpix_priority(&painter, FRAME_ICRF,
+                                                order, pix, false);
+        hips_set_tile_priority(hips, order, pix, priority);
+    }
     if (planet->hips_normalmap) {
         (*nb_tot)++;
         normalmap = hips_get_tile_texture(planet->hips_normalmap,
@@ -616,11 +716,6 @@ static bool could_cast_shadow(const planet_t *a, const planet_t *b)
     return (vec3_norm(pp) < penumbra_r + b->radius_m / DAU);
 }
 
-static int sort_shadow_cmp(const void *a, const void *b)
-{
-    return -cmp(((const double*)a)[3], ((const double*)b)[3]);
-}
-
 /*
  * Compute the list of potential shadow spheres that should be considered
  * when rendering a planet.
@@ -633,30 +728,52 @@ static int sort_shadow_cmp(const void *a, const void *b)
 static int get_shadow_candidates(const planet_t *planet, int nb_max,
                                  double (*spheres)[4])
 {
-    int nb = 0;
+    int nb = 0, i;
     planets_t *planets = (planets_t*)planet->obj.parent;
     planet_t *other;
+    double r;
 
     if (!could_cast_shadow(NULL, planet)) return 0;
 
     PLANETS_ITER(planets, other) {
-        if (could_cast_shadow(other, planet)) {
-            // No more space: replace the smallest one in the list if
-            // we can.
-            if (nb >= nb_max) {
-                if (other->radius_m / DAU < spheres[nb_max - 1][3])
-                    continue;
-                nb--; // Remove the last one.
-            }
-            vec3_copy(other->pvo[0], spheres[nb]);
-            spheres[nb][3] = other->radius_m / DAU;
-            nb++;
-            qsort(spheres, nb, 4 * sizeof(double), sort_shadow_cmp);
+        if (!could_cast_shadow(other, planet)) continue;
+        r = other->radius_m / DAU;
+        // No more space: replace the smallest one in the list if we can.
+        if (nb >= nb_max) {
+            if (r < spheres[nb_max - 1][3]) continue;
+            nb--; // Remove the last one.
         }
+        // Insert sorted, the list is at most nb_max long.
+        for (i = nb; i > 0 && spheres[i - 1][3] < r; i--)
+            vec4_copy(spheres[i - 1], spheres[i]);
+        vec3_copy(other->pvo[0], spheres[i]);
+        spheres[i][3] = r;
+        nb++;
     }
     return nb;
 }
 
+/*
+ * Compute the shadow candidates of all the planets at once.
+ *
+ * The shadows only depend on the positions, so we only do it when the
+ * observer position or time changed.  Most of the planets can't receive
+ * any shadow, so we skip them before looking at the casters.
+ */
+static void planets_update_shadows(planets_t *planets, const observer_t *obs)
+{
+    planet_t *p;
+
+    if (planets->shadows_hash == obs->hash_pos) return;
+    planets->shadows_hash = obs->hash_pos;
+    PLANETS_ITER(planets, p) {
+        p->shadows.nb = 0;
+        if (!could_cast_shadow(NULL, p)) continue;
+        p->shadows.nb = get_shadow_candidates(
+                p, ARRAY_SIZE(p->shadows.spheres), p->shadows.spheres);
+    }
+}
+
 /*
  * Compute the rotation of a planet along its axis.
  *
@@ -692,17 +809,15 @@ static void planet_render_hips(const planet_t *planet,
     planets_t *planets = (planets_t*)planet->obj.parent;
     painter_t painter = *painter_;
     double depth_range[2];
-    double shadow_spheres[4][4];
     double pixel_size;
-    int split_order;
+    int split_order, pix;
 
     if (!hips) hips = planet->hips;
     assert(hips);
 
-    // Get potential shadow casting spheres.
-    painter.planet.shadow_spheres_nb =
-        get_shadow_candidates(planet, 4, shadow_spheres);
-    painter.planet.shadow_spheres = shadow_spheres;
+    // Potential shadow casting spheres.
+    painter.planet.shadow_spheres_nb = planet->shadows.nb;
+    painter.planet.shadow_spheres = planet->shadows.spheres;
 
     painter.color[3] *= alpha;
     painter.flags |= PAINTER_PLANET_SHADER;
@@ -747,9 +862,19 @@ static void planet_render_hips(const planet_t *planet,
                  painter.proj->scaling[0] / 2;
     split_order = ceil(mix(2, 5, smoothstep(100, 600, pixel_size)));
 
-    hips_render_traverse(hips, &painter, angle, split_order,
-                         USER_PASS(planet, &nb_tot, &nb_loaded),
-                         on_render_tile);
+    // When the disk is only a few pixels wide, directly render the order
+    // zero tiles (allsky textures when available) without traversing the
+    // survey: any visible planet is then fully on screen anyway.
+    if (pixel_size < PLANET_SMALL_DISK_SIZE) {
+        for (pix = 0; pix < 12; pix++) {
+            on_render_tile(hips, &painter, 0, pix, 1, 0,
+                           USER_PASS(planet, &nb_tot, &nb_loaded));
+        }
+    } else {
+        hips_render_traverse(hips, &painter, angle, split_order,
+                             USER_PASS(planet, &nb_tot, &nb_loaded),
+                             on_render_tile);
+    }
     if (planet->rings.tex)
         render_rings(planet, &painter);
     progressbar_report(planet->name, planet->name, nb_loaded, nb_tot, -1);
@@ -965,6 +1090,7 @@ static int planets_render(const obj_t *obj, const painter_t *painter)
         planet_update_(p, painter->obs);
     }
     DL_SORT(planets->obj.children, sort_cmp);
+    planets_update_shadows(planets, painter->obs);
 
     if (planets->visible.value <= 0) return 0;
     painter_t painter_ = *painter;
@@ -1055,6 +1181,8 @@ static int planets_ini_handler(void* user, const char* section,
     if (strcmp(attr, "horizons_id") == 0) {
         sscanf(value, "%d", &planet->id);
         planet->obj.oid = oid_create("HORI", planet->id);
+        module_register_oid(&planets->obj, planet->obj.oid, 0);
+        search_add(&planets->obj, planet->name, planet->obj.oid, 0);
     }
     if (strcmp(attr, "type") == 0) {
         strncpy(planet->obj.type, value, 4);
@@ -1230,7 +1358,8 @@ OBJ_REGISTER(planet_klass)
 static obj_klass_t planets_klass = {
     .id     = "planets",
     .size   = sizeof(planets_t),
-    .flags  = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_LISTABLE,
+    .flags  = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_LISTABLE |
+              OBJ_UPDATE_PARALLEL,
     .init   = planets_init,
     .update = planets_update,
     .render = planets_render,
@@ -10,6 +10,8 @@
 #include "swe.h"
 #include "sgp4.h"
 
+#include <zlib.h> // For crc32.
+
 #define SATELLITE_DEFAULT_MAG 7.0
 /*
  * Artificial satellites module
@@ -44,9 +46,74 @@ typedef struct satellite {
     double pvo[2][4];
     double vmag;
     bool error; // Set if we got an error computing the position.
+    uint64_t obs_hash; // Hash of the observer of the last update.
+    uint64_t culled_hash; // Hash of the observer if we culled the sat.
+    bool coarse; // Set if pvo was extrapolated at the render accuracy.
     json_value *data; // Data passed in the constructor.
+    char *data_src; // Source of the data, only parsed when needed.
+
+    // Last sgp4 state vector (TEME, km and km/s), used to extrapolate a
+    // coarse position for the culling.
+    struct {
+        double t;       // UTC MJD, zero if not set.
+        double r[3];
+        double v[3];
+        double refresh; // Max extrapolation time (day), 0 if not usable.
+    } state;
 } satellite_t;
 
+/*
+ * Type: sat_record_t
+ * A satellite parsed from a jsonl line, before we create its object.
+ */
+typedef struct {
+    int             number;
+    double          stdmag;
+    char            type[4];
+    char            name[26];
+    sgp4_elsetrec_t *elsetrec;
+    const char      *src;     // The json line.
+    int             src_len;
+} sat_record_t;
+
+/*
+ * Type: refresh_sat_t
+ * A satellite of the jsonl data, at the start of a refresh.
+ */
+typedef struct {
+    UT_hash_handle  hh;         // By source line.
+    UT_hash_handle  hh_number;  // By norad number.
+    satellite_t     *sat;
+    int             number;
+    bool            seen;       // Set if it is still in the new data.
+    sat_record_t    update;     // New data, if the source line changed.
+} refresh_sat_t;
+
+/*
+ * Type: refresh_t
+ * Incremental refresh of the jsonl satellites.
+ *
+ * The new data is compared to the source lines of the current satellites
+ * in a thread safe job, and only the new and changed lines are parsed.
+ * The result is then applied at once from the main thread, so that we
+ * keep the existing objects and never render a half updated catalogue.
+ * The satellites cannot be deleted while the job runs, since it uses
+ * their source lines.
+ */
+typedef struct {
+    job_t           job;
+    char            *url;
+    asset_buffer_t  *data;
+    z_lines_t       *lines;
+    refresh_sat_t   *sats;      // Snapshot of the current satellites.
+    int             nb_sats;
+    refresh_sat_t   *by_src;    // Hash tables of the snapshot.
+    refresh_sat_t   *by_number;
+    sat_record_t    *added;
+    int             nb_added;
+    int             nb_errors;
+} refresh_t;
+
 // Module class.
 typedef struct satellites {
     obj_t   obj;
@@ -55,9 +122,74 @@ typedef struct satellites {
     int     qsmags_status;
     char    *jsonl_url;   // jsonl file in noctuasky server format.
     bool    loaded;
+
+    // Parsing of the jsonl file, done as a background job so that creating
+    // thousands of satellites doesn't block a frame.  The lines are parsed
+    // by batches across the workers, and the result is saved in the disk
+    // cache so that we don't have to parse it again.
+    struct {
+        job_t       job;
+        asset_buffer_t *data; // Source data, kept until the job is done.
+        z_lines_t   *lines;
+        char        *cache_key;
+        const void  *cache;   // Cached satellites data.
+        int         cache_size;
+        int         cache_idx;
+        int         line_idx;
+        int         nb;
+        double      last_epoch;
+    } jsonl;
     double  hints_mag_offset;
+    refresh_t *refresh; // Pending refresh of the jsonl data.
+
+    // Flat arrays of all the satellites and their orbit elements, for the
+    // batch updates.
+    satellite_t     **list;
+    sgp4_elsetrec_t **elsetrecs;
+    int             nb;
+    bool            list_dirty;
+    bool            prepared; // Set if the positions are already updated.
 } satellites_t;
 
+// Number of satellites per batch update call.
+#define UPDATE_BLOCK_SIZE 64
+
+// Max number of points painted at once.
+#define RENDER_BLOCK_SIZE 256
+
+// Number of jsonl lines parsed at once across the workers.
+#define PARSE_BATCH_SIZE 1024
+
+// Header of the satellites binary cache, followed by the records, the
+// elsetrecs, and the json sources.
+#define CACHE_VERSION 1
+typedef struct {
+    char        magic[4]; // 'SATB'.
+    int32_t     version;
+    int32_t     elsetrec_size;
+    int32_t     nb;
+} cache_header_t;
+
+typedef struct {
+    int32_t     number;
+    float       stdmag;
+    char        type[4];
+    char        name[26];
+    int32_t     src_ofs; // Offset in the sources part.
+    int32_t     src_len;
+} cache_record_t;
+
+// Earth gravitational parameter (km^3/s^2).
+#define EARTH_MU 398600.4418
+
+static void update_list(satellites_t *sats);
+static void refresh_delete(refresh_t *r);
+static void update_block(void *user, int start, int end);
+static bool get_point(satellite_t *sat, const painter_t *painter,
+                      point_t *point, bool *symbol);
+static void paint_points(const painter_t *painter, int nb,
+                         const point_t *points, const bool *symbols);
+
 
 static int satellites_init(obj_t *obj, json_value *args)
 {
@@ -68,12 +200,18 @@ static int satellites_add_data_source(
         obj_t *obj, const char *url, const char *type, json_value *args)
 {
     satellites_t *sats = (void*)obj;
-    if (strcmp(type, "norad") == 0)
+    if (strcmp(type, "norad") == 0) {
         sats->norad_url = strdup(url);
-    else if (strcmp(type, "jsonl/sat") == 0)
+    } else if (strcmp(type, "jsonl/sat") == 0 && !sats->jsonl_url) {
         sats->jsonl_url = strdup(url);
-    else
+    } else if (strcmp(type, "jsonl/sat") == 0) {
+        // Adding a new jsonl source refreshes the current satellites.
+        refresh_delete(sats->refresh);
+        sats->refresh = calloc(1, sizeof(*sats->refresh));
+        sats->refresh->url = strdup(url);
+    } else {
         return 1;
+    }
     return 0;
 }
 
@@ -212,48 +350,422 @@ static bool load_norad_data(satellites_t *sats)
     }
     if (!data) return false;
     nb = parse_tle_file(sats, data, &last_epoch);
+    sats->list_dirty = true;
     LOG_D("Parsed %d satellites (latest epoch: %s)", nb,
           format_time(buf, last_epoch, 0, "YYYY-MM-DD"));
     sats->loaded = true;
     return true;
 }
 
-static int load_jsonl_data(satellites_t *sats, const char *data, int size,
-                           const char *url, double *last_epoch)
+/*
+ * Parse the json data of a satellite.  Can run in any thread.
+ */
+static int parse_sat_json(const json_value *json, sat_record_t *rec)
+{
+    const char *tle1, *tle2, *name = NULL, *type = "Asa";
+    double startmfe, stopmfe, deltamin;
+    int r;
+
+    rec->stdmag = SATELLITE_DEFAULT_MAG;
+    r = jcon_parse(json, "{",
+        "types", "[", JCON_STR(type), "]",
+        "!model_data", "{",
+            "!norad_number", JCON_INT(rec->number),
+            "mag", JCON_DOUBLE(rec->stdmag),
+            "!tle", "[", JCON_STR(tle1), JCON_STR(tle2), "]",
+        "}",
+        "short_name", JCON_STR(name),
+    "}");
+    if (r) return -1;
+    rec->elsetrec = sgp4_twoline2rv(tle1, tle2, 'c', 'm', 'i',
+                                    &startmfe, &stopmfe, &deltamin);
+    snprintf(rec->name, sizeof(rec->name), "%s", name ?: "");
+    strncpy(rec->type, type, 4);
+    return 0;
+}
+
+// Parse a block of jsonl lines, called from the workers.
+static void parse_lines_block(void *user, int start, int end)
 {
-    const char *line = NULL;
-    int len, line_idx = 0, nb = 0;
-    char *uncompressed_data;
+    sat_record_t *recs = user;
     json_value *json;
+    arena_t arena = {};
+    int i;
+
+    for (i = start; i < end; i++) {
+        json = json_parse_arena(&arena, recs[i].src, recs[i].src_len);
+        if (!json || parse_sat_json(json, &recs[i]) != 0)
+            recs[i].elsetrec = NULL;
+        arena_reset(&arena);
+    }
+    arena_release(&arena);
+}
+
+// Create a satellite object from a parsed record.
+static satellite_t *create_sat(satellites_t *sats, const sat_record_t *rec)
+{
+    satellite_t *sat;
+    sat = (void*)obj_create("tle_satellite", NULL, (void*)sats, NULL);
+    sat->number = rec->number;
+    sat->stdmag = rec->stdmag;
+    sat->obj.oid = oid_create("NORA", sat->number);
+    sat->elsetrec = rec->elsetrec;
+    snprintf(sat->name, sizeof(sat->name), "%s", rec->name);
+    strncpy(sat->obj.type, rec->type, 4);
+    sat->data_src = strndup(rec->src, rec->src_len);
+    sats->jsonl.last_epoch = max(sats->jsonl.last_epoch,
+                                 sgp4_get_satepoch(sat->elsetrec));
+    sats->jsonl.nb++;
+    sats->list_dirty = true;
+    return sat;
+}
+
+/*
+ * Save all the satellites created from the jsonl file into the disk cache.
+ */
+static void save_cache(satellites_t *sats)
+{
+    const int elsetrec_size = sgp4_get_elsetrec_size();
+    cache_header_t header = {{'S', 'A', 'T', 'B'}, CACHE_VERSION,
+                             elsetrec_size, 0};
+    cache_record_t rec;
     satellite_t *sat;
+    obj_t *child;
+    int size = sizeof(header), src_size = 0, i = 0, src_ofs = 0;
+    uint8_t *data, *recs, *elsetrecs, *srcs;
+
+    MODULE_ITER(sats, child, "tle_satellite") {
+        sat = (void*)child;
+        if (!sat->data_src) continue;
+        header.nb++;
+        src_size += strlen(sat->data_src);
+    }
+    size += header.nb * (sizeof(rec) + elsetrec_size) + src_size;
+    data = calloc(1, size);
+    memcpy(data, &header, sizeof(header));
+    recs = data + sizeof(header);
+    elsetrecs = recs + header.nb * sizeof(rec);
+    srcs = elsetrecs + header.nb * elsetrec_size;
+
+    MODULE_ITER(sats, child, "tle_satellite") {
+        sat = (void*)child;
+        if (!sat->data_src) continue;
+        memset(&rec, 0, sizeof(rec));
+        rec.number = sat->number;
+        rec.stdmag = sat->stdmag;
+        memcpy(rec.type, sat->obj.type, 4);
+        memcpy(rec.name, sat->name, sizeof(rec.name));
+        rec.src_ofs = src_ofs;
+        rec.src_len = strlen(sat->data_src);
+        memcpy(recs + i * sizeof(rec), &rec, sizeof(rec));
+        memcpy(elsetrecs + i * elsetrec_size, sat->elsetrec, elsetrec_size);
+        memcpy(srcs + src_ofs, sat->data_src, rec.src_len);
+        src_ofs += rec.src_len;
+        i++;
+    }
+    request_cache_put(sats->jsonl.cache_key, data, size);
+    free(data);
+}
 
-    // XXX: should use a more robust gz uncompression function for external
-    // data.
-    uncompressed_data = z_uncompress_gz(data, size, &size);
-    if (!uncompressed_data) {
-        LOG_E("Cannot uncompress gz file: %s", url);
+/*
+ * Check that the cached data is valid.
+ *
+ * Return:
+ *   The number of satellites in the cache, or -1 if it is not usable.
+ */
+static int check_cache(const void *data, int size)
+{
+    cache_header_t header;
+    const int elsetrec_size = sgp4_get_elsetrec_size();
+    if (size < sizeof(header)) return -1;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, "SATB", 4) != 0 ||
+        header.version != CACHE_VERSION ||
+        header.elsetrec_size != elsetrec_size ||
+        size < sizeof(header) + (int64_t)header.nb *
+               (sizeof(cache_record_t) + elsetrec_size))
         return -1;
+    return header.nb;
+}
+
+// Create the satellites from the binary cache.
+static int load_cache_job(job_t *job, double deadline)
+{
+    satellites_t *sats = job->user;
+    const int elsetrec_size = sgp4_get_elsetrec_size();
+    const uint8_t *data = sats->jsonl.cache, *srcs;
+    int nb, size = sats->jsonl.cache_size;
+    cache_record_t crec;
+    sat_record_t rec;
+
+    nb = check_cache(data, size);
+    srcs = data + sizeof(cache_header_t) +
+           nb * (sizeof(crec) + elsetrec_size);
+    for (; sats->jsonl.cache_idx < nb; sats->jsonl.cache_idx++) {
+        memcpy(&crec, data + sizeof(cache_header_t) +
+               sats->jsonl.cache_idx * sizeof(crec), sizeof(crec));
+        if (srcs + crec.src_ofs + crec.src_len > data + size) break;
+        memset(&rec, 0, sizeof(rec));
+        rec.number = crec.number;
+        rec.stdmag = crec.stdmag;
+        memcpy(rec.type, crec.type, 4);
+        memcpy(rec.name, crec.name, sizeof(rec.name));
+        rec.name[sizeof(rec.name) - 1] = '\0';
+        rec.src = (const char*)srcs + crec.src_ofs;
+        rec.src_len = crec.src_len;
+        rec.elsetrec = malloc(elsetrec_size);
+        memcpy(rec.elsetrec, data + sizeof(cache_header_t) +
+               nb * sizeof(crec) + sats->jsonl.cache_idx * elsetrec_size,
+               elsetrec_size);
+        create_sat(sats, &rec);
+        if (sys_get_unix_time() >= deadline) {
+            sats->jsonl.cache_idx++;
+            return 0;
+        }
     }
+    return 1;
+}
 
-    data = uncompressed_data;
+static int load_jsonl_job(job_t *job, double deadline)
+{
+    satellites_t *sats = job->user;
+    const char *line;
+    int len, i, nb;
+    sat_record_t *recs;
+    char buf[128];
 
-    *last_epoch = 0;
-    while (iter_lines(data, size, &line, &len)) {
-        line_idx++;
-        json = json_parse(line, len);
-        if (!json) goto error;
-        sat = (void*)obj_create("tle_satellite", NULL, (void*)sats, json);
-        json_value_free(json);
-        if (!sat) goto error;
-        *last_epoch = max(*last_epoch, sgp4_get_satepoch(sat->elsetrec));
-        nb++;
-        continue;
-error:
-        LOG_E("Cannot create sat from %s:%d", url, line_idx);
+    if (sats->jsonl.cache) {
+        if (!load_cache_job(job, deadline)) return 0;
+        goto end;
     }
 
-    free(uncompressed_data);
-    return nb;
+    recs = calloc(PARSE_BATCH_SIZE, sizeof(*recs));
+    while (true) {
+        // Get a batch of lines, parse them in parallel, then create the
+        // satellites.
+        for (nb = 0; nb < PARSE_BATCH_SIZE; nb++) {
+            if (!z_lines_next(sats->jsonl.lines, &line, &len)) break;
+            recs[nb].src = strndup(line, len);
+            recs[nb].src_len = len;
+        }
+        if (!nb) break;
+        worker_parallel_for(nb, 16, recs, parse_lines_block);
+        for (i = 0; i < nb; i++) {
+            sats->jsonl.line_idx++;
+            if (!recs[i].elsetrec) {
+                LOG_E("Cannot create sat from %s:%d", sats->jsonl_url,
+                      sats->jsonl.line_idx);
+            } else {
+                create_sat(sats, &recs[i]);
+            }
+            free((char*)recs[i].src);
+        }
+        memset(recs, 0, nb * sizeof(*recs));
+        if (sys_get_unix_time() >= deadline) {
+            free(recs);
+            return 0;
+        }
+    }
+    free(recs);
+    save_cache(sats);
+
+end:
+    if (sats->jsonl.lines) z_lines_close(sats->jsonl.lines);
+    sats->jsonl.lines = NULL;
+    free(sats->jsonl.cache_key);
+    sats->jsonl.cache_key = NULL;
+    asset_buffer_release(sats->jsonl.data);
+    sats->jsonl.data = NULL;
+    asset_release(sats->jsonl_url);
+    LOG_I("Parsed %d satellites (latest epoch: %s)", sats->jsonl.nb,
+          format_time(buf, sats->jsonl.last_epoch, 0, "YYYY-MM-DD"));
+    return 1;
+}
+
+static void refresh_delete(refresh_t *r)
+{
+    int i;
+    if (!r) return;
+    job_cancel(&r->job);
+    if (r->lines) z_lines_close(r->lines);
+    if (r->data) {
+        asset_buffer_release(r->data);
+        asset_release(r->url);
+    }
+    for (i = 0; i < r->nb_sats; i++) {
+        free(r->sats[i].update.elsetrec);
+        free((char*)r->sats[i].update.src);
+    }
+    for (i = 0; i < r->nb_added; i++) {
+        free(r->added[i].elsetrec);
+        free((char*)r->added[i].src);
+    }
+    HASH_CLEAR(hh, r->by_src);
+    HASH_CLEAR(hh_number, r->by_number);
+    free(r->sats);
+    free(r->added);
+    free(r->url);
+    free(r);
+}
+
+/*
+ * Compare the new jsonl data to the current satellites.  Runs in a worker.
+ *
+ * The unchanged lines are found by their text, so that we don't need to
+ * parse them.  The other ones are parsed and matched by norad number.
+ */
+static int refresh_job(job_t *job, double deadline)
+{
+    refresh_t *r = job->user;
+    refresh_sat_t *s;
+    sat_record_t rec;
+    const char *line;
+    int len;
+
+    while (z_lines_next(r->lines, &line, &len)) {
+        HASH_FIND(hh, r->by_src, line, len, s);
+        if (s) {
+            s->seen = true;
+            continue;
+        }
+        rec = (sat_record_t) {.src = strndup(line, len), .src_len = len};
+        parse_lines_block(&rec, 0, 1);
+        if (!rec.elsetrec) {
+            r->nb_errors++;
+            free((char*)rec.src);
+            continue;
+        }
+        HASH_FIND(hh_number, r->by_number, &rec.number, sizeof(rec.number),
+                  s);
+        if (s && !s->seen) {
+            s->seen = true;
+            s->update = rec;
+            continue;
+        }
+        if (r->nb_added % 64 == 0) {
+            r->added = realloc(r->added,
+                               (r->nb_added + 64) * sizeof(*r->added));
+        }
+        r->added[r->nb_added++] = rec;
+    }
+    return 1;
+}
+
+// Replace the orbit and data of a satellite, taking ownership of the
+// record elsetrec and source.
+static void satellite_set_record(satellite_t *sat, sat_record_t *rec)
+{
+    free(sat->elsetrec);
+    sat->elsetrec = rec->elsetrec;
+    rec->elsetrec = NULL;
+    free(sat->data_src);
+    sat->data_src = (char*)rec->src;
+    rec->src = NULL;
+    json_builder_free(sat->data);
+    sat->data = NULL;
+    sat->stdmag = rec->stdmag;
+    snprintf(sat->name, sizeof(sat->name), "%s", rec->name);
+    strncpy(sat->obj.type, rec->type, 4);
+    // Forget everything computed from the previous orbit.
+    memset(&sat->state, 0, sizeof(sat->state));
+    sat->obs_hash = 0;
+    sat->culled_hash = 0;
+    sat->error = false;
+}
+
+/*
+ * Start the refresh job, once we have the new data.
+ *
+ * Return:
+ *   false if the data is not available yet, true otherwise, even if the
+ *   refresh failed.
+ */
+static bool refresh_start(satellites_t *sats, refresh_t *r)
+{
+    const char *data;
+    int size, code, i = 0;
+    obj_t *child;
+    satellite_t *sat;
+    refresh_sat_t *s;
+
+    data = asset_get_data2(r->url, 0, &size, &code);
+    if (!code) return false;
+    if (data) {
+        r->data = asset_retain(r->url);
+        r->lines = z_lines_open(data, size);
+    }
+    if (!r->lines) {
+        LOG_E("Cannot load satellites data: %s", r->url);
+        asset_release(r->url);
+        return true;
+    }
+    MODULE_ITER(sats, child, "tle_satellite") r->nb_sats++;
+    r->sats = calloc(r->nb_sats, sizeof(*r->sats));
+    MODULE_ITER(sats, sat, "tle_satellite") {
+        if (!sat->data_src) continue;
+        s = &r->sats[i++];
+        s->sat = sat;
+        s->number = sat->number;
+        HASH_ADD_KEYPTR(hh, r->by_src, sat->data_src, strlen(sat->data_src),
+                        s);
+        HASH_ADD(hh_number, r->by_number, number, sizeof(s->number), s);
+    }
+    r->nb_sats = i;
+    job_init(&r->job, refresh_job, r, JOB_THREAD_SAFE);
+    return true;
+}
+
+// Apply the result of the refresh job.
+static void refresh_apply(satellites_t *sats, refresh_t *r)
+{
+    int i, nb_changed = 0, nb_removed = 0;
+    refresh_sat_t *s;
+    satellite_t *sat;
+    unsigned long crc;
+    char buf[128];
+
+    for (i = 0; i < r->nb_sats; i++) {
+        s = &r->sats[i];
+        if (s->update.elsetrec) {
+            satellite_set_record(s->sat, &s->update);
+            nb_changed++;
+        } else if (!s->seen) {
+            module_remove(&sats->obj, &s->sat->obj);
+            obj_release(&s->sat->obj);
+            nb_removed++;
+        }
+    }
+    for (i = 0; i < r->nb_added; i++) {
+        create_sat(sats, &r->added[i]);
+        free((char*)r->added[i].src);
+        r->added[i].src = NULL;
+        r->added[i].elsetrec = NULL;
+    }
+    sats->jsonl.nb -= nb_removed;
+    sats->jsonl.last_epoch = 0;
+    MODULE_ITER(sats, sat, "tle_satellite") {
+        if (!sat->data_src || !sat->elsetrec) continue;
+        sats->jsonl.last_epoch = max(sats->jsonl.last_epoch,
+                                     sgp4_get_satepoch(sat->elsetrec));
+    }
+    // The list still points to the removed satellites.
+    update_list(sats);
+
+    // The new data becomes the source, so save it in the cache too.
+    free(sats->jsonl_url);
+    sats->jsonl_url = strdup(r->url);
+    crc = crc32(0L, r->data->data, r->data->size);
+    asprintf(&sats->jsonl.cache_key, "cache://satellites/%08lx/%s",
+             crc, sats->jsonl_url);
+    save_cache(sats);
+    free(sats->jsonl.cache_key);
+    sats->jsonl.cache_key = NULL;
+
+    if (r->nb_errors)
+        LOG_E("Cannot parse %d satellites from %s", r->nb_errors, r->url);
+    LOG_I("Refreshed satellites: %d changed, %d added, %d removed "
+          "(latest epoch: %s)", nb_changed, r->nb_added, nb_removed,
+          format_time(buf, sats->jsonl.last_epoch, 0, "YYYY-MM-DD"));
 }
 
 static int satellites_update(obj_t *obj, double dt)
@@ -261,22 +773,50 @@ static int satellites_update(obj_t *obj, double dt)
     PROFILE(satellites_update, 0);
     satellites_t *sats = (satellites_t*)obj;
     const char *data;
-    double last_epoch = 0;
-    int size, code, nb;
-    char buf[128];
-
+    int size, code;
+
+    if (sats->loaded && sats->refresh) {
+        if (!sats->refresh->job.fn && !refresh_start(sats, sats->refresh))
+            return 0;
+        if (sats->refresh->job.fn && !job_iter(&sats->refresh->job))
+            return 0;
+        if (sats->refresh->job.fn) refresh_apply(sats, sats->refresh);
+        refresh_delete(sats->refresh);
+        sats->refresh = NULL;
+        return 0;
+    }
     if (sats->loaded) return 0;
 
     if (sats->jsonl_url) {
-        data = asset_get_data2(sats->jsonl_url, ASSET_USED_ONCE, &size, &code);
-        if (!code) return 0; // Sill loading.
-        if (data) {
-            nb = load_jsonl_data(sats, data, size, sats->jsonl_url,
-                                 &last_epoch);
-            LOG_I("Parsed %d satellites (latest epoch: %s)", nb,
-                  format_time(buf, last_epoch, 0, "YYYY-MM-DD"));
+        if (!sats->jsonl.job.fn) {
+            // Keep the data until the parsing job is done.
+            data = asset_get_data2(sats->jsonl_url, 0, &size, &code);
+            if (!code) return 0; // Sill loading.
+            if (data) {
+                sats->jsonl.data = asset_retain(sats->jsonl_url);
+                // The cache is keyed by the source data crc, so that it
+                // gets invalidated when the source changes.
+                asprintf(&sats->jsonl.cache_key, "cache://satellites/%08lx/%s",
+                         crc32(0L, (void*)data, size), sats->jsonl_url);
+                sats->jsonl.cache = request_cache_get(
+                        sats->jsonl.cache_key, &sats->jsonl.cache_size);
+                if (sats->jsonl.cache && check_cache(sats->jsonl.cache,
+                                            sats->jsonl.cache_size) < 0)
+                    sats->jsonl.cache = NULL;
+                if (!sats->jsonl.cache)
+                    sats->jsonl.lines = z_lines_open(data, size);
+            }
+            if (sats->jsonl.lines || sats->jsonl.cache) {
+                job_init(&sats->jsonl.job, load_jsonl_job, sats, 0);
+            } else {
+                if (data) LOG_E("Cannot uncompress gz file: %s",
+                                sats->jsonl_url);
+                asset_buffer_release(sats->jsonl.data);
+                sats->jsonl.data = NULL;
+                asset_release(sats->jsonl_url);
+            }
         }
-
+        if (sats->jsonl.job.fn && !job_iter(&sats->jsonl.job)) return 0;
         sats->loaded = true;
     }
 
@@ -288,20 +828,61 @@ static int satellites_update(obj_t *obj, double dt)
     return 0;
 }
 
+static int satellites_prepare(const obj_t *obj, const painter_t *painter,
+                              render_task_t *task)
+{
+    satellites_t *sats = (satellites_t*)obj;
+
+    if (sats->list_dirty) update_list(sats);
+    *task = (render_task_t) {
+        .n = sats->nb, .block = UPDATE_BLOCK_SIZE,
+        .args = {sats, (void*)painter}, .fn = update_block,
+    };
+    sats->prepared = true;
+    return 1;
+}
+
 static int satellites_render(const obj_t *obj, const painter_t *painter)
 {
     PROFILE(satellites_render, 0);
-    obj_t *child;
-    MODULE_ITER(obj, child, "tle_satellite")
-        obj_render(child, painter);
+    satellites_t *sats = (satellites_t*)obj;
+    point_t points[RENDER_BLOCK_SIZE];
+    bool symbols[RENDER_BLOCK_SIZE];
+    int i, nb = 0;
+
+    // Update all the positions at once, across the workers pool, unless
+    // it was done by the prepare task.
+    if (!sats->prepared) {
+        if (sats->list_dirty) update_list(sats);
+        worker_parallel_for(sats->nb, UPDATE_BLOCK_SIZE,
+                            USER_PASS(sats, painter), update_block);
+    }
+    sats->prepared = false;
+
+    // Submit the points and symbols by blocks rather than one at a time.
+    for (i = 0; i < sats->nb; i++) {
+        if (!get_point(sats->list[i], painter, &points[nb], &symbols[nb]))
+            continue;
+        if (++nb < RENDER_BLOCK_SIZE) continue;
+        paint_points(painter, nb, points, symbols);
+        nb = 0;
+    }
+    if (nb) paint_points(painter, nb, points, symbols);
     return 0;
 }
 
 static obj_t *satellites_get_by_oid(
         const obj_t *obj, uint64_t oid, uint64_t hint)
 {
+    const satellites_t *sats = (void*)obj;
     obj_t *child;
     if (!oid_is_catalog(oid, "NORA")) return NULL;
+    // Hint from the oid index: index in the update list + 1.
+    if (hint && hint <= sats->nb && sats->list[hint - 1]->obj.oid == oid) {
+        child = &sats->list[hint - 1]->obj;
+        child->ref++;
+        return child;
+    }
     MODULE_ITER(obj, child, "tle_satellite") {
         if (child->oid == oid) {
             child->ref++;
@@ -312,12 +893,16 @@ static obj_t *satellites_get_by_oid(
 }
 
 /*
- * Compute the amount of light the satellite receives from the Sun, taking
+ * Compute the amount of light a satellite receives from the Sun, taking
  * into account the Earth shadow.  Return a value from 0 (totally eclipsed)
  * to 1 (totally illuminated).
+ *
+ * Parameters:
+ *   pos     - Geocentric position of the satellite (AU).
+ *   sun_pos - Geocentric position of the Sun, in the same frame (AU).
  */
-static double satellite_compute_earth_shadow(const satellite_t *sat,
-                                             const observer_t *obs)
+static double compute_earth_shadow(const double pos[3],
+                                   const double sun_pos[3])
 {
     double e_pos[3]; // Earth position from sat.
     double s_pos[3]; // Sun position from sat.
@@ -326,10 +911,9 @@ static double satellite_compute_earth_shadow(const satellite_t *sat,
     const double SUN_RADIUS = 695508000; // (m).
     const double EARTH_RADIUS = 6371000; // (m).
 
-
-    vec3_mul(-DAU, sat->pvg, e_pos);
-    vec3_add(obs->earth_pvh[0], sat->pvg, s_pos);
-    vec3_mul(-DAU, s_pos, s_pos);
+    vec3_mul(-DAU, pos, e_pos);
+    vec3_sub(sun_pos, pos, s_pos);
+    vec3_mul(DAU, s_pos, s_pos);
     elong = eraSepp(e_pos, s_pos);
     e_r = asin(EARTH_RADIUS / vec3_norm(e_pos));
     s_r = asin(SUN_RADIUS / vec3_norm(s_pos));
@@ -340,6 +924,14 @@ static double satellite_compute_earth_shadow(const satellite_t *sat,
     return 0.0;
 }
 
+static double satellite_compute_earth_shadow(const satellite_t *sat,
+                                             const observer_t *obs)
+{
+    double sun_pos[3];
+    vec3_mul(-1, obs->earth_pvh[0], sun_pos);
+    return compute_earth_shadow(sat->pvg, sun_pos);
+}
+
 static double satellite_compute_vmag(const satellite_t *sat,
                                      const observer_t *obs)
 {
@@ -375,35 +967,23 @@ static int satellite_init(obj_t *obj, json_value *args)
 {
     // Support creating a satellite using noctuasky model data json values.
     satellite_t *sat = (satellite_t*)obj;
-    const char *tle1, *tle2, *name = NULL, *type = "Asa";
-    double startmfe, stopmfe, deltamin;
-    int r;
+    sat_record_t rec = {};
 
     sat->vmag = SATELLITE_DEFAULT_MAG;
     sat->stdmag = SATELLITE_DEFAULT_MAG;
 
     if (args) {
-        r = jcon_parse(args, "{",
-            "types", "[", JCON_STR(type), "]",
-            "!model_data", "{",
-                "!norad_number", JCON_INT(sat->number),
-                "mag", JCON_DOUBLE(sat->stdmag),
-                "!tle", "[", JCON_STR(tle1), JCON_STR(tle2), "]",
-            "}",
-            "short_name", JCON_STR(name),
-        "}");
-        if (r) {
+        if (parse_sat_json(args, &rec)) {
             LOG_E("Cannot parse satellite json data");
             assert(false);
             return -1;
         }
+        sat->number = rec.number;
+        sat->stdmag = rec.stdmag;
         sat->obj.oid = oid_create("NORA", sat->number);
-        sat->elsetrec = sgp4_twoline2rv(tle1, tle2, 'c', 'm', 'i',
-                                        &startmfe, &stopmfe, &deltamin);
-        if (name)
-            snprintf(sat->name, sizeof(sat->name), "%s", name);
-        strncpy(sat->obj.type, type, 4);
-
+        sat->elsetrec = rec.elsetrec;
+        snprintf(sat->name, sizeof(sat->name), "%s", rec.name);
+        strncpy(sat->obj.type, rec.type, 4);
         sat->data = json_copy(args);
     }
 
@@ -415,6 +995,19 @@ static void satellite_del(obj_t *obj)
     satellite_t *sat = (satellite_t*)obj;
     free(sat->elsetrec);
     json_builder_free(sat->data);
+    free(sat->data_src);
+}
+
+// Return the json data of a satellite, parsing it if needed.
+static json_value *satellite_get_data(satellite_t *sat)
+{
+    json_value *json;
+    if (!sat->data && sat->data_src) {
+        json = json_parse(sat->data_src, strlen(sat->data_src));
+        if (json) sat->data = json_copy(json);
+        json_value_free(json);
+    }
+    return sat->data;
 }
 
 /*
@@ -430,21 +1023,11 @@ static void true_equator_to_j2000(const observer_t *obs,
 }
 
 /*
- * Update an individual satellite.
+ * Update an individual satellite from its sgp4 position and velocity.
  */
-static int satellite_update(satellite_t *sat, const observer_t *obs)
+static void satellite_update_from_pv(satellite_t *sat, const observer_t *obs,
+                                     double pv[2][3])
 {
-    double pv[2][3];
-
-    if (sat->error) return 0;
-    assert(sat->elsetrec);
-    // Orbit computation.
-    if (!sgp4(sat->elsetrec, obs->utc, pv[0],  pv[1])) {
-        LOG_W("Cannot compute satellite position (%s, %d)",
-              sat->name, sat->number);
-        sat->error = true;
-        return 0;
-    }
     assert(!isnan(pv[0][0]) && !isnan(pv[0][1]));
 
     vec3_mul(1000.0 / DAU, pv[0], pv[0]);
@@ -460,9 +1043,218 @@ static int satellite_update(satellite_t *sat, const observer_t *obs)
     sat->pvo[1][3] = 0.0;
 
     sat->vmag = satellite_compute_vmag(sat, obs);
+    sat->obs_hash = obs->hash_pos;
+}
+
+/*
+ * Cache the sgp4 state vector of a satellite.
+ *
+ * We extrapolate it over 1/32 of the orbit at most, and not at all for
+ * eccentric orbits where the acceleration changes too fast.
+ */
+static void satellite_set_state(satellite_t *sat, double t,
+                                const double r[3], const double v[3])
+{
+    double rn, n, q;
+    sat->state.t = t;
+    vec3_copy(r, sat->state.r);
+    vec3_copy(v, sat->state.v);
+    rn = vec3_norm(r);
+    n = sqrt(EARTH_MU / (rn * rn * rn)); // Mean motion (rad/s).
+    // Ratio to the circular orbit speed, from the vis-viva equation.
+    q = vec3_norm2(v) * rn / EARTH_MU;
+    sat->state.refresh = fabs(q - 1) < 0.2 ? 2 * M_PI / n / 32 / 86400 : 0;
+}
+
+/*
+ * Extrapolate the sgp4 state vector of a satellite (TEME, km and km/s),
+ * with an estimation of the maximum error (km).
+ *
+ * Return false if the cached state cannot be used at this time.
+ */
+static bool satellite_extrapolate(const satellite_t *sat, double utc,
+                                  double pv[2][3], double *err)
+{
+    double dt, rn, a, n, acc[3];
+
+    if (!sat->state.t) return false;
+    dt = utc - sat->state.t;
+    if (fabs(dt) > sat->state.refresh) return false;
+    dt *= 86400;
+
+    // Second order extrapolation of the two bodies motion.
+    rn = vec3_norm(sat->state.r);
+    a = EARTH_MU / (rn * rn);
+    n = sqrt(EARTH_MU / (rn * rn * rn));
+    vec3_mul(-a / rn, sat->state.r, acc);
+    vec3_addk(sat->state.r, sat->state.v, dt, pv[0]);
+    vec3_addk(pv[0], acc, 0.5 * dt * dt, pv[0]);
+    vec3_addk(sat->state.v, acc, dt, pv[1]);
+    // The jerk of a circular orbit is a * n, we take three times that,
+    // plus some margin for the J2 and drag perturbations.
+    *err = 3 * a * n * fabs(dt * dt * dt) / 6 + 1e-3 * a * dt * dt;
+    return true;
+}
+
+/*
+ * Test if a satellite is surely not visible, using a position extrapolated
+ * from its cached state vector, with a conservative error radius.
+ *
+ * Return false if we cannot tell, and need to compute the actual position.
+ */
+static bool satellite_is_coarse_culled(const satellite_t *sat,
+                                       const painter_t *painter)
+{
+    const observer_t *obs = painter->obs;
+    double err, p[3], pv[2][3], topo[3], dist, angle, cap[4];
+
+    if (!satellite_extrapolate(sat, obs->utc, pv, &err)) return false;
+    err += 1.0;
+
+    vec3_mul(1000.0 / DAU, pv[0], p);
+    mat3_mul_vec3(obs->rnp, p, p);
+    vec3_sub(p, obs->obs_pvg[0], topo);
+    dist = vec3_norm(topo);
+    err *= 1000.0 / DAU;
+    if (err >= dist) return false;
+    // Extra margin for the aberration and refraction.
+    angle = asin(err / dist) + 1e-3;
+    if (angle >= M_PI / 2) return false;
+    vec3_mul(1.0 / dist, topo, cap);
+    cap[3] = cos(angle);
+
+    if (!cap_intersects_cap(painter->clip_info[FRAME_ICRF].sky_cap, cap))
+        return true;
+    return painter_is_cap_clipped(painter, FRAME_ICRF, cap);
+}
+
+/*
+ * Update a satellite with its extrapolated position if the error is below
+ * half a pixel on screen.
+ *
+ * Return false if we need to compute the actual position.
+ */
+static bool satellite_update_coarse(satellite_t *sat,
+                                    const painter_t *painter)
+{
+    const observer_t *obs = painter->obs;
+    double err, p[3], pv[2][3], topo[3];
+
+    if (!satellite_extrapolate(sat, obs->utc, pv, &err)) return false;
+    vec3_mul(1000.0 / DAU, pv[0], p);
+    mat3_mul_vec3(obs->rnp, p, p);
+    vec3_sub(p, obs->obs_pvg[0], topo);
+    if (err * 1000.0 / DAU / vec3_norm(topo) >
+            core_get_apparent_angle_for_point(painter->proj, 0.5))
+        return false;
+    satellite_update_from_pv(sat, obs, pv);
+    sat->coarse = true;
+    return true;
+}
+
+static void satellite_on_error(satellite_t *sat)
+{
+    LOG_W("Cannot compute satellite position (%s, %d)",
+          sat->name, sat->number);
+    sat->error = true;
+}
+
+/*
+ * Update an individual satellite.
+ */
+static int satellite_update(satellite_t *sat, const observer_t *obs)
+{
+    double pv[2][3];
+
+    if (sat->error) return 0;
+    // The extrapolated positions are only good enough for the rendering.
+    if (sat->obs_hash == obs->hash_pos &&
+            (!sat->coarse || core->accuracy == ACCURACY_RENDER))
+        return 0;
+    assert(sat->elsetrec);
+    // Orbit computation.
+    if (!sgp4(sat->elsetrec, obs->utc, pv[0],  pv[1])) {
+        satellite_on_error(sat);
+        return 0;
+    }
+    satellite_set_state(sat, obs->utc, pv[0], pv[1]);
+    satellite_update_from_pv(sat, obs, pv);
+    sat->coarse = false;
     return 0;
 }
 
+/*
+ * Update a range of the satellites list.  Can run in any thread.
+ *
+ * We first cull the satellites we know are not visible using their coarse
+ * position, and only compute the actual position of the others.
+ */
+static void update_block(void *user, int start, int end)
+{
+    satellites_t *sats = USER_GET(user, 0);
+    const painter_t *painter = USER_GET(user, 1);
+    const observer_t *obs = painter->obs;
+    satellite_t *sat;
+    sgp4_elsetrec_t *elsetrecs[UPDATE_BLOCK_SIZE];
+    satellite_t *list[UPDATE_BLOCK_SIZE];
+    double r[UPDATE_BLOCK_SIZE][3], v[UPDATE_BLOCK_SIZE][3];
+    double pv[2][3];
+    bool ok[UPDATE_BLOCK_SIZE];
+    int i, nb = 0;
+
+    assert(end - start <= UPDATE_BLOCK_SIZE);
+    for (i = start; i < end; i++) {
+        sat = sats->list[i];
+        if (sat->error) continue;
+        if (sat->obs_hash == obs->hash_pos) continue;
+        if (sat->culled_hash == obs->hash) continue;
+        if (satellite_is_coarse_culled(sat, painter)) {
+            sat->culled_hash = obs->hash;
+            continue;
+        }
+        if (core->accuracy == ACCURACY_RENDER &&
+                satellite_update_coarse(sat, painter))
+            continue;
+        list[nb] = sat;
+        elsetrecs[nb] = sats->elsetrecs[i];
+        nb++;
+    }
+    sgp4_batch(nb, elsetrecs, obs->utc, r, v, ok);
+    for (i = 0; i < nb; i++) {
+        if (!ok[i]) {
+            satellite_on_error(list[i]);
+            continue;
+        }
+        satellite_set_state(list[i], obs->utc, r[i], v[i]);
+        vec3_copy(r[i], pv[0]);
+        vec3_copy(v[i], pv[1]);
+        satellite_update_from_pv(list[i], obs, pv);
+        list[i]->coarse = false;
+    }
+}
+
+static void update_list(satellites_t *sats)
+{
+    obj_t *child;
+    satellite_t *sat;
+    int nb = 0;
+
+    sats->list_dirty = false;
+    MODULE_ITER(sats, child, "tle_satellite") nb++;
+    sats->list = realloc(sats->list, nb * sizeof(*sats->list));
+    sats->elsetrecs = realloc(sats->elsetrecs, nb * sizeof(*sats->elsetrecs));
+    sats->nb = 0;
+    search_remove_module(&sats->obj);
+    MODULE_ITER(sats, sat, "tle_satellite") {
+        if (!sat->elsetrec) continue;
+        sats->list[sats->nb] = sat;
+        sats->elsetrecs[sats->nb] = sat->elsetrec;
+        sats->nb++;
+        module_register_oid(&sats->obj, sat->obj.oid, sats->nb);
+        search_add_designations(&sats->obj, &sat->obj, sats->nb);
+    }
+}
+
 static int satellite_get_info(const obj_t *obj, const observer_t *obs, int info,
                               void *out)
 {
@@ -481,55 +1273,85 @@ static int satellite_get_info(const obj_t *obj, const observer_t *obs, int info,
 
 
 /*
- * Render an individual satellite.
+ * Compute the point of a satellite and add its label if needed.
+ *
+ * Parameters:
+ *   sat        - A satellite.
+ *   painter    - The painter.
+ *   point      - Receive the point.
+ *   symbol     - Set to true if we should also paint the satellite symbol
+ *                at the point position.
+ *
+ * Return:
+ *   false if the satellite is not visible.
  */
-static int satellite_render(const obj_t *obj, const painter_t *painter_)
+static bool get_point(satellite_t *sat, const painter_t *painter,
+                      point_t *point, bool *symbol)
 {
     double vmag, size, luminance, p_win[4];
-    painter_t painter = *painter_;
-    point_t point;
-    double color[4];
     const double label_color[4] = RGBA(124, 205, 124, 205);
     const double white[4] = RGBA(255, 255, 255, 255);
-    satellite_t *sat = (satellite_t*)obj;
-    const satellites_t *sats = (satellites_t*)obj->parent;
-    const bool selected = core->selection && obj->oid == core->selection->oid;
-    const double hints_limit_mag = painter.hints_limit_mag +
+    const satellites_t *sats = (satellites_t*)sat->obj.parent;
+    const uint64_t oid = sat->obj.oid;
+    const bool selected = core->selection && oid == core->selection->oid;
+    const double hints_limit_mag = painter->hints_limit_mag +
                                    sats->hints_mag_offset - 2.5;
 
-    satellite_update(sat, painter.obs);
+    // Culled by the batch update.
+    if (sat->culled_hash == painter->obs->hash) return false;
+    satellite_update(sat, painter->obs);
     vmag = sat->vmag;
-    if (sat->error) return 0;
-    if (vmag > painter.stars_limit_mag && vmag > hints_limit_mag) return 0;
+    if (sat->error) return false;
+    if (vmag > painter->stars_limit_mag && vmag > hints_limit_mag)
+        return false;
 
-    if (!painter_project(&painter, FRAME_ICRF, sat->pvo[0], false, true, p_win))
-        return 0;
+    if (!painter_project(painter, FRAME_ICRF, sat->pvo[0], false, true,
+                         p_win))
+        return false;
 
     core_get_point_for_mag(vmag, &size, &luminance);
-
-    // Render symbol if needed.
-    if (vmag <= hints_limit_mag) {
-        vec4_copy(label_color, color);
-        symbols_paint(&painter, SYMBOL_ARTIFICIAL_SATELLITE, p_win,
-                      VEC(24.0, 24.0), color, 0.0);
-    }
-
-    point = (point_t) {
+    *symbol = vmag <= hints_limit_mag;
+    *point = (point_t) {
         .pos = {p_win[0], p_win[1]},
         .size = size,
         .color = {255, 255, 255, luminance * 255},
-        .oid = obj->oid,
+        .oid = oid,
     };
-    paint_2d_points(&painter, 1, &point);
 
     // Render name if needed.
     size = max(8, size);
     if (*sat->name && (selected || vmag <= hints_limit_mag - 1.5)) {
         labels_add_3d(sat->name, FRAME_ICRF, sat->pvo[0], false, size,
                       FONT_SIZE_BASE - 1, selected ? white : label_color, 0,
-                      LABEL_AROUND, selected ? TEXT_BOLD : 0, 0, obj->oid);
+                      LABEL_AROUND, selected ? TEXT_BOLD : 0, 0, oid);
     }
+    return true;
+}
+
+// Paint the symbols first, so that the points end up on top of them.
+static void paint_points(const painter_t *painter, int nb,
+                         const point_t *points, const bool *symbols)
+{
+    int i;
+    const double color[4] = RGBA(124, 205, 124, 205);
+    for (i = 0; i < nb; i++) {
+        if (!symbols[i]) continue;
+        symbols_paint(painter, SYMBOL_ARTIFICIAL_SATELLITE, points[i].pos,
+                      VEC(24.0, 24.0), color, 0.0);
+    }
+    paint_2d_points(painter, nb, points);
+}
+
+/*
+ * Render an individual satellite.
+ */
+static int satellite_render(const obj_t *obj, const painter_t *painter)
+{
+    point_t point;
+    bool symbol;
 
+    if (!get_point((satellite_t*)obj, painter, &point, &symbol)) return 0;
+    paint_points(painter, 1, &point, &symbol);
     return 0;
 }
 
@@ -539,12 +1361,13 @@ static void satellite_get_designations(
              const char *cat, const char *str))
 {
     satellite_t *sat = (void*)obj;
-    json_value *names;
+    json_value *names, *data;
     char *name;
     int i;
     char buf[32];
-    if (sat->data) {
-        names = json_get_attr(sat->data, "names", json_array);
+    data = satellite_get_data(sat);
+    if (data) {
+        names = json_get_attr(data, "names", json_array);
         for (i = 0; i < names->u.array.length; ++i) {
             name = names->u.array.values[i]->u.string.ptr;
             if (strstr(name, "NAME "))
@@ -567,10 +1390,389 @@ static json_value *satellite_data_fn(obj_t *obj, const attribute_t *attr,
                                      const json_value *args)
 {
     satellite_t *sat = (void*)obj;
-    if (!args && sat->data) return json_copy(sat->data);
+    if (!args && satellite_get_data(sat)) return json_copy(sat->data);
     return NULL;
 }
 
+/*
+ * Passes prediction.
+ *
+ * The search is done in the TEME frame of the sgp4 model, where the
+ * observer position only depends on the sidereal time, so that all the
+ * satellites can be computed in parallel without any observer update.
+ */
+
+// Earth equatorial radius (km) and rotation rate (rad/s).
+#define EARTH_RADIUS_KM 6378.137
+#define EARTH_OMEGA 7.292115e-5
+
+// Precision of the passes times (day).
+#define PASS_PRECISION (1.0 / 86400)
+
+// Extra geocentric angle added to the visibility cap of the satellites, to
+// account for the Earth flattening and the mean elements approximation.
+#define PASS_MARGIN (1.0 * DD2R)
+
+// Max altitude of the Sun for the observer to see the satellites.
+#define PASS_SUN_MAX_ALT (-6.0 * DD2R)
+
+/*
+ * Type: sat_pass_t
+ * A pass of a satellite above the observer horizon.
+ */
+typedef struct {
+    int     sat;        // Index in the module list.
+    double  aos;        // Rise time (UTC MJD), NAN if before the start.
+    double  aos_az;     // Rise azimuth (rad).
+    double  tca;        // Culmination time (UTC MJD).
+    double  max_alt;    // Culmination altitude (rad).
+    double  los;        // Set time (UTC MJD), NAN if after the end.
+    double  los_az;     // Set azimuth (rad).
+    bool    visible;    // Sunlit while the observer is in the dark.
+} sat_pass_t;
+
+/*
+ * Type: passes_t
+ * State of a passes prediction, shared by all the workers.
+ */
+typedef struct {
+    satellites_t *sats;
+    double  start;          // UTC MJD.
+    double  end;            // UTC MJD.
+    double  min_alt;        // Min altitude of the passes (rad).
+    double  dut1;           // UT1 - UTC (day).
+    double  dtt;            // TT - UTC (day).
+    double  phi;            // Observer geodetic latitude (rad).
+    double  elong;          // Observer longitude (rad).
+    double  obs_pos[3];     // Observer Earth fixed position (km).
+    // Passes found for each satellite.
+    struct {
+        sat_pass_t  *passes;
+        int         nb;
+        int         allocated;
+    } *out;
+} passes_t;
+
+/*
+ * Type: sat_topo_t
+ * Topocentric state of a satellite at a given time.
+ */
+typedef struct {
+    double  pos[3];     // Geocentric TEME position (km).
+    double  up[3];      // Observer zenith direction in TEME.
+    double  alt;        // Altitude (rad).
+    double  az;         // Azimuth (rad).
+    double  angle;      // Geocentric angle to the observer (rad).
+} sat_topo_t;
+
+/*
+ * Approximate geocentric position of the Sun in the equatorial frame of
+ * date (AU), using the low precision formula of the Astronomical Almanac
+ * (0.01°).  Good enough for the shadow and twilight tests.
+ */
+static void sun_approx_pos(double tt, double out[3])
+{
+    double n, l, g, lambda, eps, r;
+    n = tt - DJM00;
+    l = (280.460 + 0.9856474 * n) * DD2R;
+    g = (357.528 + 0.9856003 * n) * DD2R;
+    lambda = l + (1.915 * sin(g) + 0.020 * sin(2 * g)) * DD2R;
+    eps = (23.439 - 0.0000004 * n) * DD2R;
+    r = 1.00014 - 0.01671 * cos(g) - 0.00014 * cos(2 * g);
+    out[0] = r * cos(lambda);
+    out[1] = r * cos(eps) * sin(lambda);
+    out[2] = r * sin(eps) * sin(lambda);
+}
+
+/*
+ * Compute the topocentric state of a satellite at a given time.  Can run
+ * in any thread, as long as each satellite record is only used by one.
+ *
+ * We don't take into account the refraction, nor the polar motion.
+ */
+static bool passes_get_topo(const passes_t *p, sgp4_elsetrec_t *rec,
+                            double t, sat_topo_t *out)
+{
+    double v[3], gmst, theta, obs[3], topo[3], east[3], north[3];
+
+    if (!sgp4(rec, t, out->pos, v)) return false;
+    gmst = eraGmst82(DJM0, t + p->dut1);
+    theta = gmst + p->elong;
+    obs[0] = cos(gmst) * p->obs_pos[0] - sin(gmst) * p->obs_pos[1];
+    obs[1] = sin(gmst) * p->obs_pos[0] + cos(gmst) * p->obs_pos[1];
+    obs[2] = p->obs_pos[2];
+    vec3_set(out->up, cos(p->phi) * cos(theta), cos(p->phi) * sin(theta),
+             sin(p->phi));
+    vec3_set(east, -sin(theta), cos(theta), 0);
+    vec3_set(north, -sin(p->phi) * cos(theta), -sin(p->phi) * sin(theta),
+             cos(p->phi));
+    vec3_sub(out->pos, obs, topo);
+    out->alt = asin(vec3_dot(topo, out->up) / vec3_norm(topo));
+    out->az = eraAnp(atan2(vec3_dot(topo, east), vec3_dot(topo, north)));
+    out->angle = eraSepp(out->pos, obs);
+    return true;
+}
+
+// Test if a satellite is sunlit while the observer is in the dark.
+static bool passes_is_visible(const passes_t *p, double t,
+                              const sat_topo_t *topo)
+{
+    double sun_pos[3], pos[3];
+    sun_approx_pos(t + p->dtt, sun_pos);
+    if (vec3_dot(sun_pos, topo->up) / vec3_norm(sun_pos) >
+            sin(PASS_SUN_MAX_ALT))
+        return false;
+    vec3_mul(1000.0 / DAU, topo->pos, pos);
+    return compute_earth_shadow(pos, sun_pos) > 0.0;
+}
+
+/*
+ * Find the time a satellite crosses the min altitude between t0 and t1,
+ * by bisection.
+ */
+static double passes_refine_crossing(const passes_t *p, sgp4_elsetrec_t *rec,
+                                     double t0, double t1, bool rising,
+                                     sat_topo_t *out)
+{
+    double t;
+    while (t1 - t0 > PASS_PRECISION) {
+        t = (t0 + t1) / 2;
+        if (!passes_get_topo(p, rec, t, out)) break;
+        if ((out->alt > p->min_alt) == rising)
+            t1 = t;
+        else
+            t0 = t;
+    }
+    t = (t0 + t1) / 2;
+    passes_get_topo(p, rec, t, out);
+    return t;
+}
+
+/*
+ * Refine the culmination of a pass around its highest sample, with a
+ * golden section search, and add it to the satellite output.
+ */
+static void passes_add(passes_t *p, sgp4_elsetrec_t *rec, sat_pass_t *pass,
+                       double step)
+{
+    const double g = (sqrt(5) - 1) / 2;
+    double a, b, c, d;
+    sat_topo_t tc, td;
+    typeof(*p->out) *out = &p->out[pass->sat];
+
+    a = max(pass->tca - step, isnan(pass->aos) ? p->start : pass->aos);
+    b = min(pass->tca + step, isnan(pass->los) ? p->end : pass->los);
+    c = b - g * (b - a);
+    d = a + g * (b - a);
+    if (passes_get_topo(p, rec, c, &tc) && passes_get_topo(p, rec, d, &td)) {
+        while (b - a > PASS_PRECISION) {
+            if (tc.alt > td.alt) {
+                b = d;
+                d = c;
+                td = tc;
+                c = b - g * (b - a);
+                if (!passes_get_topo(p, rec, c, &tc)) break;
+            } else {
+                a = c;
+                c = d;
+                tc = td;
+                d = a + g * (b - a);
+                if (!passes_get_topo(p, rec, d, &td)) break;
+            }
+        }
+        if (max(tc.alt, td.alt) > pass->max_alt) {
+            pass->tca = tc.alt > td.alt ? c : d;
+            pass->max_alt = max(tc.alt, td.alt);
+        }
+    }
+
+    if (out->nb >= out->allocated) {
+        out->allocated = max(8, out->allocated * 2);
+        out->passes = realloc(out->passes,
+                              out->allocated * sizeof(*out->passes));
+    }
+    out->passes[out->nb++] = *pass;
+}
+
+/*
+ * Search all the passes of a satellite.
+ *
+ * We first reject the satellites whose orbit never gets above the
+ * observer horizon.  Then we step along the orbit, jumping over the parts
+ * where the satellite is too far from the observer to be visible: the
+ * geocentric angle between them cannot decrease faster than the
+ * satellite angular speed at the perigee plus the Earth rotation.
+ */
+static void passes_compute_sat(passes_t *p, int idx)
+{
+    sgp4_elsetrec_t *rec = p->sats->elsetrecs[idx];
+    double inclo, ecco, no, a, rp, ra, lambda, rate, step, t, dt, last_t = 0;
+    sat_topo_t topo, tmp;
+    sat_pass_t pass = {};
+    bool in_pass = false;
+
+    sgp4_get_elements(rec, &inclo, &ecco, &no);
+    if (no <= 0 || ecco >= 1) return;
+    no /= 60; // rad/s.
+    a = cbrt(EARTH_MU / (no * no));
+    rp = a * (1 - ecco);
+    ra = a * (1 + ecco);
+    if (rp < EARTH_RADIUS_KM) return; // Decayed.
+    // Max geocentric angle between the observer and a visible satellite.
+    lambda = acos(EARTH_RADIUS_KM * cos(p->min_alt) / ra) - p->min_alt +
+             PASS_MARGIN;
+    // The sub satellite point never goes beyond the inclination latitude.
+    if (fabs(p->phi) > min(inclo, M_PI - inclo) + lambda) return;
+
+    rate = 1.1 * sqrt(EARTH_MU * (2 / rp - 1 / a)) / rp + EARTH_OMEGA;
+    step = clamp(2 * M_PI / no / 300, 10, 120) / 86400;
+
+    for (t = p->start; ; t = min(t + dt, p->end)) {
+        if (!passes_get_topo(p, rec, t, &topo)) break;
+        if (topo.alt > p->min_alt) {
+            if (!in_pass) {
+                in_pass = true;
+                pass = (sat_pass_t) {
+                    .sat = idx, .aos = NAN, .aos_az = NAN,
+                    .tca = t, .max_alt = topo.alt,
+                };
+                if (t > p->start) {
+                    pass.aos = passes_refine_crossing(
+                            p, rec, last_t, t, true, &tmp);
+                    pass.aos_az = tmp.az;
+                }
+            }
+            if (topo.alt > pass.max_alt) {
+                pass.tca = t;
+                pass.max_alt = topo.alt;
+            }
+            pass.visible = pass.visible || passes_is_visible(p, t, &topo);
+        } else if (in_pass) {
+            in_pass = false;
+            pass.los = passes_refine_crossing(p, rec, last_t, t, false, &tmp);
+            pass.los_az = tmp.az;
+            passes_add(p, rec, &pass, step);
+        }
+        if (t >= p->end) break;
+        last_t = t;
+        dt = step;
+        if (!in_pass && topo.angle > lambda)
+            dt = max(step, (topo.angle - lambda) / rate / 86400);
+    }
+    if (in_pass) {
+        pass.los = NAN;
+        pass.los_az = NAN;
+        passes_add(p, rec, &pass, step);
+    }
+}
+
+// Compute the passes of a range of satellites.  Can run in any thread.
+static void passes_block(void *user, int start, int end)
+{
+    passes_t *p = USER_GET(user, 0);
+    int i;
+    for (i = start; i < end; i++) passes_compute_sat(p, i);
+}
+
+static int pass_cmp(const void *a, const void *b)
+{
+    const sat_pass_t *pa = a, *pb = b;
+    double ta = isnan(pa->aos) ? pa->tca : pa->aos;
+    double tb = isnan(pb->aos) ? pb->tca : pb->aos;
+    return cmp(ta, tb);
+}
+
+// Return a time as a json TT MJD value, or null if not set.
+static json_value *pass_time_json(const passes_t *p, double t)
+{
+    return isnan(t) ? json_null_new() : json_double_new(t + p->dtt);
+}
+
+static json_value *pass_angle_json(double a)
+{
+    return isnan(a) ? json_null_new() : json_double_new(a * DR2D);
+}
+
+/*
+ * Function: compute_passes_fn
+ * Predict the passes of all the satellites above the observer horizon.
+ *
+ * The satellites are searched in parallel.  See <passes_compute_sat>.
+ *
+ * The argument is an object with the optional attributes:
+ *   start   - Start time (TT MJD), default to the observer time.
+ *   days    - Number of days, default to 1.
+ *   min_alt - Min altitude of the passes (deg), default to 10.
+ *   visible - If set, only return the passes where the satellite is sunlit
+ *             while the Sun is 6° below the observer horizon.
+ *
+ * Return:
+ *   An array of the passes sorted by time, of the form:
+ *   {norad, name, rise, rise_az, culmination, max_alt, set, set_az,
+ *   visible}, with the times in TT MJD and the angles in degrees.  The
+ *   rise and set are null for the passes in progress at the start and
+ *   at the end of the range.
+ */
+static json_value *compute_passes_fn(obj_t *obj, const attribute_t *attr,
+                                     const json_value *args)
+{
+    satellites_t *sats = (void*)obj;
+    const observer_t *obs = core->observer;
+    json_value *ret, *val, *jargs = (json_value*)args;
+    passes_t p = {.sats = sats};
+    sat_pass_t *passes;
+    const satellite_t *sat;
+    bool visible_only;
+    int i, nb = 0;
+
+    if (sats->list_dirty) update_list(sats);
+    p.dtt = obs->tt - obs->utc;
+    p.dut1 = obs->ut1 - obs->utc;
+    p.start = json_get_attr_f(jargs, "start", obs->tt) - p.dtt;
+    p.end = p.start + json_get_attr_f(jargs, "days", 1);
+    p.min_alt = json_get_attr_f(jargs, "min_alt", 10) * DD2R;
+    visible_only = json_get_attr_b(jargs, "visible", false);
+    p.phi = obs->phi;
+    p.elong = obs->elong;
+    eraGd2gc(1, obs->elong, obs->phi, obs->hm, p.obs_pos);
+    vec3_mul(1.0 / 1000, p.obs_pos, p.obs_pos);
+
+    p.out = calloc(sats->nb, sizeof(*p.out));
+    worker_parallel_for(sats->nb, 8, USER_PASS(&p), passes_block);
+
+    for (i = 0; i < sats->nb; i++) nb += p.out[i].nb;
+    passes = malloc(nb * sizeof(*passes));
+    nb = 0;
+    for (i = 0; i < sats->nb; i++) {
+        memcpy(passes + nb, p.out[i].passes,
+               p.out[i].nb * sizeof(*passes));
+        nb += p.out[i].nb;
+        free(p.out[i].passes);
+    }
+    free(p.out);
+    qsort(passes, nb, sizeof(*passes), pass_cmp);
+
+    ret = json_array_new(0);
+    for (i = 0; i < nb; i++) {
+        if (visible_only && !passes[i].visible) continue;
+        sat = sats->list[passes[i].sat];
+        val = json_object_new(0);
+        json_object_push(val, "norad", json_integer_new(sat->number));
+        json_object_push(val, "name", json_string_new(sat->name));
+        json_object_push(val, "rise", pass_time_json(&p, passes[i].aos));
+        json_object_push(val, "rise_az", pass_angle_json(passes[i].aos_az));
+        json_object_push(val, "culmination",
+                         pass_time_json(&p, passes[i].tca));
+        json_object_push(val, "max_alt", pass_angle_json(passes[i].max_alt));
+        json_object_push(val, "set", pass_time_json(&p, passes[i].los));
+        json_object_push(val, "set_az", pass_angle_json(passes[i].los_az));
+        json_object_push(val, "visible", json_boolean_new(passes[i].visible));
+        json_array_push(ret, val);
+    }
+    free(passes);
+    return ret;
+}
+
 /*
  * Meta class declarations.
  */
@@ -600,11 +1802,13 @@ static obj_klass_t satellites_klass = {
     .add_data_source = satellites_add_data_source,
     .render_order   = 30,
     .update         = satellites_update,
+    .prepare        = satellites_prepare,
     .render         = satellites_render,
     .get_by_oid     = satellites_get_by_oid,
     .attributes = (attribute_t[]) {
         PROPERTY(hints_mag_offset, TYPE_MAG,
                  MEMBER(satellites_t, hints_mag_offset)),
+        FUNCTION(compute_passes, .fn = compute_passes_fn),
         {}
     }
 };
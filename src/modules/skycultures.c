@@ -41,9 +41,30 @@ typedef struct skyculture {
     } info;
     int             nb_constellations;
     skyculture_name_t *names; // Hash table of oid -> names.
+    int             labels_version; // Translations version of the labels.
     constellation_infos_t *constellations;
     json_value      *imgs;
     int             parsed; // union of SK_ enum for each parsed file.
+    bool            ready;  // Set once all the data has been parsed.
+    // Parsing of the constellations data files in a background job.
+    struct {
+        job_t       job;
+        // Content of the files.
+        struct {
+            char    *constellations;
+            char    *names;
+            char    *star_names;
+            char    *edges;
+            char    *arts;
+        } src;
+        // Parsed values, published to the skyculture once the job is done.
+        struct {
+            constellation_infos_t *constellations;
+            int                   nb_constellations;
+            skyculture_name_t     *names;
+            json_value            *imgs;
+        } snapshot;
+    } parse;
     char            *description;  // html description if any.
 } skyculture_t;
 
@@ -76,6 +97,24 @@ static void skyculture_deactivate(skyculture_t *cult)
 // Defined in constellations.c
 int constellation_set_image(obj_t *obj, const json_value *args);
 
+/*
+ * Translate all the stars names of a skyculture, so that we don't have
+ * to do it for each label at each frame.
+ */
+static void skyculture_translate_names(skyculture_t *cult)
+{
+    skyculture_name_t *entry, *tmp;
+    const char *label;
+
+    HASH_ITER(hh, cult->names, entry, tmp) {
+        if (entry->label != entry->name) free((char*)entry->label);
+        label = sys_translate("skyculture", entry->name);
+        entry->label = strcmp(label, entry->name) == 0 ?
+            entry->name : strdup(label);
+    }
+    cult->labels_version = sys_get_translations_version();
+}
+
 static void skyculture_activate(skyculture_t *cult)
 {
     char id[32];
@@ -113,6 +152,8 @@ static void skyculture_activate(skyculture_t *cult)
         }
     }
 
+    skyculture_translate_names(cult);
+
     // Set the current attribute of the skycultures manager object.
     obj_set_attr(cult->obj.parent, "current", cult);
     module_changed(cult->obj.parent, "current_id");
@@ -202,17 +243,64 @@ static bool get_file(skyculture_t *cult, int file_id, const char *name,
     return *data;
 }
 
+static const int SK_ALL_DATA = SK_INFO | SK_DESCRIPTION_STEL |
+                               SK_CONSTELLATIONS_STEL |
+                               SK_CONSTELLATION_NAMES_STEL |
+                               SK_STAR_NAMES_STEL | SK_EDGES | SK_IMGS_STEL;
+
+/*
+ * Parse the constellations data files in a worker thread.
+ *
+ * The job only uses the files content copied in cult->parse, and puts
+ * the results in cult->parse.snapshot, so that the main thread can keep
+ * using the skyculture while we parse.
+ */
+static int skyculture_parse_job(job_t *job, double deadline)
+{
+    skyculture_t *cult = job->user;
+    typeof(cult->parse) *p = &cult->parse;
+    constellation_art_t *arts;
+
+    if (p->src.constellations) {
+        p->snapshot.constellations =
+            skyculture_parse_stellarium_constellations(
+                p->src.constellations, &p->snapshot.nb_constellations);
+    }
+    if (p->snapshot.constellations && p->src.names) {
+        skyculture_parse_stellarium_constellations_names(
+                p->src.names, p->snapshot.constellations);
+    }
+    if (p->src.star_names) {
+        p->snapshot.names = skyculture_parse_stellarium_star_names(
+                p->src.star_names);
+    }
+    if (p->snapshot.constellations && p->src.edges)
+        skyculture_parse_edges(p->src.edges, p->snapshot.constellations);
+    if (p->snapshot.constellations && p->src.arts) {
+        arts = skyculture_parse_stellarium_constellations_art(
+                p->src.arts, NULL);
+        if (arts) p->snapshot.imgs = make_imgs_json(arts, cult->uri);
+        free(arts);
+    }
+    return 1;
+}
+
+// Copy a data file content for the parse job.
+static void get_src(skyculture_t *cult, int file_id, const char *name,
+                    char **src, int extra_flags)
+{
+    const char *data;
+    if (get_file(cult, file_id, name, &data, extra_flags))
+        *src = strdup(data);
+}
+
 static int skyculture_update(obj_t *obj, double dt)
 {
     skyculture_t *cult = (skyculture_t*)obj;
     skycultures_t *cults = (skycultures_t*)obj->parent;
+    typeof(cult->parse) *p = &cult->parse;
     const char *data;
-    constellation_art_t *arts;
     bool active = (cult == cults->current);
-    const int all_data = SK_INFO | SK_DESCRIPTION_STEL |
-                         SK_CONSTELLATIONS_STEL |
-                         SK_CONSTELLATION_NAMES_STEL |
-                         SK_STAR_NAMES_STEL | SK_EDGES | SK_IMGS_STEL;
 
     /*
      * We parse all the data files of the skyculture.
@@ -225,7 +313,7 @@ static int skyculture_update(obj_t *obj, double dt)
      * that are needed for the GUI.
      */
 
-    if (cult->parsed == all_data)
+    if (cult->ready)
         return 0;
 
     if (get_file(cult, SK_INFO, "info.ini", &data, 0)) {
@@ -242,46 +330,35 @@ static int skyculture_update(obj_t *obj, double dt)
     // The rest of the data is not needed until the skyculture is activated.
     if (!active) return 0;
 
-    if (get_file(cult, SK_CONSTELLATIONS_STEL, "constellationship.fab",
-                 &data, 0))
-    {
-        cult->constellations = skyculture_parse_stellarium_constellations(
-                data, &cult->nb_constellations);
-    }
-
-    if (cult->constellations && get_file(cult, SK_CONSTELLATION_NAMES_STEL,
-                  "constellation_names.eng.fab", &data, 0))
-    {
-        skyculture_parse_stellarium_constellations_names(
-                data, cult->constellations);
-    }
-
-    if (get_file(cult, SK_STAR_NAMES_STEL, "star_names.fab", &data,
-                 ASSET_ACCEPT_404))
-    {
-        cult->names = skyculture_parse_stellarium_star_names(data);
-    }
-
-    if (cult->constellations &&
-            get_file(cult, SK_EDGES, "edges.txt", &data, ASSET_ACCEPT_404)) {
-        skyculture_parse_edges(data, cult->constellations);
-    }
-
-    if (cult->constellations && get_file(cult, SK_IMGS_STEL,
-                "constellationsart.fab", &data, ASSET_ACCEPT_404))
-    {
-        arts = skyculture_parse_stellarium_constellations_art(data, NULL);
-        if (arts) {
-            cult->imgs = make_imgs_json(arts, cult->uri);
-        }
-        free(arts);
-    }
+    get_src(cult, SK_CONSTELLATIONS_STEL, "constellationship.fab",
+            &p->src.constellations, 0);
+    get_src(cult, SK_CONSTELLATION_NAMES_STEL, "constellation_names.eng.fab",
+            &p->src.names, 0);
+    get_src(cult, SK_STAR_NAMES_STEL, "star_names.fab",
+            &p->src.star_names, ASSET_ACCEPT_404);
+    get_src(cult, SK_EDGES, "edges.txt", &p->src.edges, ASSET_ACCEPT_404);
+    get_src(cult, SK_IMGS_STEL, "constellationsart.fab", &p->src.arts,
+            ASSET_ACCEPT_404);
+    if (cult->parsed != SK_ALL_DATA) return 0;
+
+    // Parse all the files in a thread, and publish the result once done.
+    if (!p->job.fn)
+        job_init(&p->job, skyculture_parse_job, cult, JOB_THREAD_SAFE);
+    if (!job_iter(&p->job)) return 0;
+    cult->constellations = p->snapshot.constellations;
+    cult->nb_constellations = p->snapshot.nb_constellations;
+    cult->names = p->snapshot.names;
+    cult->imgs = p->snapshot.imgs;
+    free(p->src.constellations);
+    free(p->src.names);
+    free(p->src.star_names);
+    free(p->src.edges);
+    free(p->src.arts);
+    memset(p, 0, sizeof(*p));
+    cult->ready = true;
 
     // Once all has beed parsed, we can activate the skyculture.
-    if (cult->parsed == all_data) {
-        if (active) skyculture_activate(cult);
-    }
-
+    if (cult == cults->current) skyculture_activate(cult);
     return 0;
 }
 
@@ -351,19 +428,31 @@ static int skycultures_add_data_source(
  * Return:
  *   NULL if no name was found.  A pointer to the passed buffer otherwise.
  */
-const char *skycultures_get_name(obj_t *skycultures, uint64_t oid,
-                                 char buf[128])
+static const skyculture_name_t *get_name_entry(obj_t *skycultures,
+                                               uint64_t oid)
 {
     skyculture_t *cult;
     skyculture_name_t *entry;
     if (!skycultures) return NULL;
     assert(strcmp(skycultures->klass->id, "skycultures") == 0);
     cult = ((skycultures_t*)skycultures)->current;
-    if (!cult) return NULL;
+    if (!cult || !cult->names) return NULL;
+    if (cult->labels_version != sys_get_translations_version())
+        skyculture_translate_names(cult);
     HASH_FIND(hh, cult->names, &oid, sizeof(oid), entry);
-    if (!entry) return NULL;
-    strcpy(buf, entry->name);
-    return buf;
+    return entry;
+}
+
+const char *skycultures_get_name(obj_t *skycultures, uint64_t oid)
+{
+    const skyculture_name_t *entry = get_name_entry(skycultures, oid);
+    return entry ? entry->name : NULL;
+}
+
+const char *skycultures_get_label(obj_t *skycultures, uint64_t oid)
+{
+    const skyculture_name_t *entry = get_name_entry(skycultures, oid);
+    return entry ? entry->label : NULL;
 }
 
 // Set/Get the current skyculture by id.
@@ -20,6 +20,13 @@
  *
  * This could be done in the core, but it's easier to move this into a separate
  * module.
+ *
+ * The discovery of an online source can take many frames, since each level
+ * (index, hipslist, properties) waits for the previous one.  So the list of
+ * data sources we found from each online source is saved in the disk cache,
+ * and the next launch adds them all at once when the source is added.  The
+ * discovery still runs in the background to revalidate them: any new
+ * source is added, and the cache is updated for the next launch.
  */
 
 enum {
@@ -28,21 +35,118 @@ enum {
     SOURCE_HIPS,
 };
 
+// An online source added from outside of the module, and the data
+// sources we found from it.
+typedef struct root {
+    char            *url;
+    int             nb_pending; // Number of sources not processed yet.
+    json_value      *found;     // Array of [url, type, args].
+} root_t;
+
 typedef struct source source_t;
 struct source {
     char            *url;
     int             type;
     double          release_date;
+    root_t          *root;
     source_t        *next, *prev;
 };
 
+// Set of the data sources already added.
+typedef struct added {
+    UT_hash_handle  hh;
+    char            key[];
+} added_t;
+
 typedef struct sources {
     obj_t           obj;
     source_t        *sources;
+    added_t         *added;
 } sources_t;
 
+// Root of the source being processed, so that the sources found from it
+// get the same root.
+static root_t *g_current_root = NULL;
+
 static int process_source(sources_t *sources, source_t *source);
 
+static void get_cache_key(const char *url, char *key, int size)
+{
+    snprintf(key, size, "cache://sources/%s", url);
+}
+
+/*
+ * Add a data source found by the discovery, unless it was already added
+ * from the cache.
+ */
+static void add_found(sources_t *sources, root_t *root, const char *url,
+                      const char *type, json_value *args)
+{
+    added_t *added;
+    json_value *entry;
+    char key[1024];
+
+    if (root) {
+        entry = json_array_new(3);
+        json_array_push(entry, json_string_new(url));
+        json_array_push(entry, json_string_new(type));
+        json_array_push(entry, args ? json_copy(args) : json_null_new());
+        json_array_push(root->found, entry);
+    }
+    snprintf(key, sizeof(key), "%s %s", type, url);
+    HASH_FIND_STR(sources->added, key, added);
+    if (added) return;
+    added = calloc(1, sizeof(*added) + strlen(key) + 1);
+    strcpy(added->key, key);
+    HASH_ADD_STR(sources->added, key, added);
+    module_add_data_source(NULL, url, type, args);
+}
+
+// Add all the data sources found from an url the last time.
+static void add_cached(sources_t *sources, const char *url)
+{
+    char key[1024];
+    const char *data;
+    int i, size;
+    json_value *json, *entry;
+
+    get_cache_key(url, key, sizeof(key));
+    data = request_cache_get(key, &size);
+    if (!data) return;
+    json = json_parse(data, size);
+    if (!json || json->type != json_array) goto end;
+    for (i = 0; i < json->u.array.length; i++) {
+        entry = json->u.array.values[i];
+        if (    entry->type != json_array || entry->u.array.length != 3 ||
+                entry->u.array.values[0]->type != json_string ||
+                entry->u.array.values[1]->type != json_string)
+            continue;
+        add_found(sources, NULL, entry->u.array.values[0]->u.string.ptr,
+                  entry->u.array.values[1]->u.string.ptr,
+                  entry->u.array.values[2]->type == json_object ?
+                        entry->u.array.values[2] : NULL);
+    }
+end:
+    json_value_free(json);
+}
+
+// Save the sources found from a root, once they have all been processed.
+static void root_save(root_t *root)
+{
+    json_serialize_opts opts = {.mode = json_serialize_mode_packed};
+    char key[1024], *buf;
+    const char *data;
+    int size;
+
+    get_cache_key(root->url, key, sizeof(key));
+    buf = malloc(json_measure_ex(root->found, opts));
+    json_serialize_ex(buf, root->found, opts);
+    data = request_cache_get(key, &size);
+    if (!data || size != strlen(buf) || memcmp(data, buf, size) != 0)
+        request_cache_put(key, buf, strlen(buf));
+    free(buf);
+}
+
 static int add_data_source(obj_t *obj, const char *url, const char *type,
                            json_value *args)
 {
@@ -70,6 +174,17 @@ static int add_data_source(obj_t *obj, const char *url, const char *type,
         source->release_date = hips_parse_date(tmp + 3);
     }
 
+    // An online source added from outside: first add what we found from
+    // it the last time.
+    source->root = g_current_root;
+    if (!source->root && strncmp(url, "http", 4) == 0) {
+        source->root = calloc(1, sizeof(*source->root));
+        source->root->url = strdup(url);
+        source->root->found = json_array_new(0);
+        add_cached(sources, url);
+    }
+    if (source->root) source->root->nb_pending++;
+
     DL_APPEND(sources->sources, source);
     // Immediatly process only if offline source.
     if (strncmp(url, "http", 4) != 0)
@@ -96,7 +211,8 @@ static const char *get_data(const source_t *source, const char *file,
     return data;
 }
 
-static int parse_index(const char *base_url, const char *data)
+static int parse_index(sources_t *sources, root_t *root,
+                       const char *base_url, const char *data)
 {
     json_value *json;
     const char *key, *type;
@@ -113,7 +229,12 @@ static int parse_index(const char *base_url, const char *data)
         key = json->u.object.values[i].name;
         type = json_get_attr_s(json->u.object.values[i].value, "type");
         snprintf(url, sizeof(url), "%s/%s", base_url, key);
-        module_add_data_source(NULL, url, type, NULL);
+        // The sub directories and surveys are discovered again.
+        if (!type || strcmp(type, "hips") == 0 ||
+                strcmp(type, "hipslist") == 0)
+            module_add_data_source(NULL, url, type, NULL);
+        else
+            add_found(sources, root, url, type, NULL);
     }
 
     json_value_free(json);
@@ -128,6 +249,8 @@ static int on_hips(void *user, const char *url, double release_date)
     source->url = strdup(url);
     source->type = SOURCE_HIPS;
     source->release_date = release_date;
+    source->root = g_current_root;
+    if (source->root) source->root->nb_pending++;
     DL_APPEND(sources->sources, source);
     return 0;
 }
@@ -147,7 +270,7 @@ static int on_sub_dir(void *user, const char *path, int is_dir)
     return 0;
 }
 
-static int process_dir(source_t *source)
+static int process_dir(sources_t *sources, source_t *source)
 {
     const char *data;
     int code;
@@ -156,7 +279,7 @@ static int process_dir(source_t *source)
     data = get_data(source, "index.json", ASSET_ACCEPT_404, &code);
     if (!code) return 0;
     if (data) {
-        parse_index(source->url, data);
+        parse_index(sources, source->root, source->url, data);
         return 1;
     }
 
@@ -165,7 +288,7 @@ static int process_dir(source_t *source)
                     ASSET_ACCEPT_404 | ASSET_USED_ONCE, &code);
     if (!code) return 0;
     if (data) {
-        module_add_data_source(NULL, source->url, "skyculture", NULL);
+        add_found(sources, source->root, source->url, "skyculture", NULL);
         return 1;
     }
 
@@ -190,33 +313,48 @@ static int process_source(sources_t *sources, source_t *source)
     const char *data;
     json_value *args;
     int code;
+    root_t *root = source->root, *prev_root = g_current_root;
 
+    g_current_root = root;
     switch (source->type) {
     case SOURCE_DIR:
-        if (!process_dir(source)) return 0;
+        if (!process_dir(sources, source)) goto not_ready;
         break;
     case SOURCE_HIPSLIST:
         data = get_data(source, "hipslist", 0, &code);
         if (!data && code) break; // Error.
-        if (!data) return 0;
+        if (!data) goto not_ready;
         hips_parse_hipslist(data, sources, on_hips);
         break;
     case SOURCE_HIPS:
         data = get_data(source, "properties", 0, &code);
         if (!data && code) break; // Error.
-        if (!data) return 0;
+        if (!data) goto not_ready;
         args = json_object_new(0);
         ini_parse_string(data, hips_property_handler, args);
-        module_add_data_source(NULL, source->url, "hips", args);
+        add_found(sources, root, source->url, "hips", args);
         json_builder_free(args);
         break;
     default:
         assert(false);
     }
+    g_current_root = prev_root;
     DL_DELETE(sources->sources, source);
     free(source->url);
     free(source);
+
+    // All the sources found from the root have been processed.
+    if (root && --root->nb_pending == 0) {
+        root_save(root);
+        json_builder_free(root->found);
+        free(root->url);
+        free(root);
+    }
     return 1;
+
+not_ready:
+    g_current_root = prev_root;
+    return 0;
 }
 
 static int sources_update(obj_t *obj, double dt)
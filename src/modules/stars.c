@@ -19,6 +19,23 @@
 
 static const double LABEL_SPACING = 4;
 
+// Layout of the tiles magnitude histogram: bin k counts all the stars
+// fainter than HIST_MIN + (k - 1) * HIST_STEP and brighter than
+// HIST_MIN + k * HIST_STEP.
+#define HIST_MIN    -2.0
+#define HIST_STEP   0.5
+#define HIST_NB     48
+
+// Size of the epoch buckets used to apply the proper motions to the tiles.
+#define PM_EPOCH_STEP 1.0 // (years)
+
+// Aggregation of the faint stars: when the sub cells of a tile are smaller
+// than AGG_CELL_SIZE on screen, the stars that would be rendered as dim
+// points are replaced by a single point per cell.  See
+// <render_tile_clusters>.
+#define AGG_SPLIT       3   // Order of the cells relative to the tile.
+#define AGG_CELL_SIZE   2.0 // (px)
+
 // Indices of the two surveys we use.
 enum {
     SURVEY_DEFAULT  = 0,
@@ -26,6 +43,17 @@ enum {
 };
 
 typedef struct stars stars_t;
+
+/*
+ * Type: star_index_t
+ * Entry of the oid to tile index.
+ */
+typedef struct {
+    UT_hash_handle  hh;
+    uint64_t        oid;
+    uint64_t        nuniq; // Tile containing the star.
+} star_index_t;
+
 typedef struct {
     uint64_t oid;
     uint64_t gaia;  // Gaia source id (0 if none)
@@ -71,22 +99,94 @@ struct stars {
         double  min_vmag; // Don't render survey below this mag.
     } surveys[2];
 
+    // Index of the tiles containing the HIP stars, built as the tiles get
+    // loaded, so that we don't have to search for them again.
+    star_index_t    *index;
+
     bool            visible;
+    bool            aggregate; // Aggregate the faint stars of small tiles.
 };
 
+/*
+ * Type: star_info_t
+ * Part of the star data that is only used to create star objects.
+ */
+typedef struct {
+    uint64_t    gaia;
+    uint32_t    tyc;
+    int         hip;
+    char        type[4];
+    float       ra;
+    float       de;
+    float       pra;
+    float       pde;
+    float       plx;
+    char        *names; // Points into the tile names block.
+} star_info_t;
+
 /*
  * Type: tile_t
  * Custom tile structure for the stars hips survey.
+ *
+ * The data used for rendering is stored as arrays of attributes, apart from
+ * the rest of the stars data, so that the render loop only touches the
+ * memory it needs.  All the arrays are sorted by vmag.
+ *
+ * A tile file can contain several stars chunks, each one a magnitude
+ * slice of the tile, sorted from the brightest to the faintest.  Only the
+ * first slice is decoded when the tile is created, the others are kept
+ * compressed and decoded as the limit magnitude increases (see
+ * <tile_extend>).
  */
 typedef struct tile {
+    uint64_t    id;             // Uniq id used to retain the render buffers.
+    int         version;        // Increased each time we add stars.
     int         flags;
     double      mag_min;
     double      mag_max;
     double      illuminance; // Totall illuminance (lux).
     int         nb;
-    star_data_t *sources;
+
+    float       (*pos)[3];      // Normalized astrometric direction.
+    float       *vmag;
+    float       *bv;
+    uint8_t     (*colors)[4];   // Colors computed from the bv.
+    float       *illuminances;  // (lux)
+    uint64_t    *oids;
+
+    // Index of the stars aggregation cell in the tile, only computed for
+    // the first nb_cells stars.  See <tile_compute_cells>.
+    uint8_t     *cells;
+    int         nb_cells;
+
+    star_info_t *infos;
+    otype_mask_t types;         // Types of all the stars.
+    char        *names;         // All the stars extra names.
+    // Single memory block holding all the per star arrays above and the
+    // names, see <tile_alloc_data>.
+    char        *data;
+    int         names_size;
+    bool        indexed;        // Set once the stars are in the index.
+
+    // Cumulated magnitude histogram: hist[k] is the number of stars with
+    // vmag < HIST_MIN + k * HIST_STEP.
+    int         hist[HIST_NB + 1];
+
+    // Not yet decoded magnitude slices chunks, each one stored as:
+    // 4 bytes type, 4 bytes size, data.
+    uint8_t     *slices;
+    int         slices_size;
+    int         slices_ofs;
+
+    // Proper motions, only set if some stars of the tile have some.  The
+    // pos array then contains the directions at the epoch bucket.
+    float       (*pos0)[3];     // Astrometric direction at J2000.0.
+    float       (*pm)[3];       // Direction change per year.
+    int         epoch_bucket;   // Epoch of pos, in PM_EPOCH_STEP from J2000.
 } tile_t;
 
+typedef typeof(((stars_t*)0)->surveys[0]) survey_t;
+
 static uint64_t pix_to_nuniq(int order, int pix)
 {
     return pix + 4 * (1L << (2 * order));
@@ -209,7 +309,7 @@ static int star_get_info(const obj_t *obj, const observer_t *obs, int info,
     }
 }
 
-static void star_render_name(const painter_t *painter, const star_data_t *s,
+static void star_render_name(const painter_t *painter, uint64_t oid, int hip,
                              int frame, const double pos[3], double radius,
                              double vmag, double color[3])
 {
@@ -220,13 +320,13 @@ static void star_render_name(const painter_t *painter, const star_data_t *s,
     const char *name = NULL;
     double label_color[4] = {color[0], color[1], color[2], 0.5};
     static const double white[4] = {1, 1, 1, 1};
-    const bool selected = core->selection && s->oid == core->selection->oid;
+    const bool selected = core->selection && oid == core->selection->oid;
     int effects = 0;
     char buf[128];
     char cst[5];
     obj_t *skycultures;
 
-    //if (!s->hip) return;
+    //if (!hip) return;
     if (selected) {
         vec4_copy(white, label_color);
         effects = TEXT_BOLD;
@@ -238,13 +338,13 @@ static void star_render_name(const painter_t *painter, const star_data_t *s,
     // Names for fainter stars tend to be suspiscious, and just
     // pollute the screen space.
     // For those, we rather display bayer name below.
-    if (s->vmag < max(3, painter->hints_limit_mag - 8.0)) {
+    if (vmag < max(3, painter->hints_limit_mag - 8.0)) {
         skycultures = core_get_module("skycultures");
-        name = skycultures_get_name(skycultures, s->oid, buf);
+        name = skycultures_get_label(skycultures, oid);
     }
 
     if (!name && selected) {
-        bayer_get(s->hip, cst, &bayer, &bayer_n);
+        bayer_get(hip, cst, &bayer, &bayer_n);
         if (bayer) {
             snprintf(buf, sizeof(buf), "%s%.*d %s",
                      greek[bayer - 1], bayer_n ? 1 : 0, bayer_n, cst);
@@ -253,19 +353,18 @@ static void star_render_name(const painter_t *painter, const star_data_t *s,
     }
 
     if (name) {
-        labels_add_3d(sys_translate("skyculture", name), frame, pos, true,
-                      radius, FONT_SIZE_BASE, label_color, 0, LABEL_AROUND,
-                      effects, -vmag, s->oid);
+        labels_add_3d(name, frame, pos, true, radius, FONT_SIZE_BASE,
+                      label_color, 0, LABEL_AROUND, effects, -vmag, oid);
         return;
     }
 
     // Still no name, maybe we can show a bayer id.
-    bayer_get(s->hip, NULL, &bayer, &bayer_n);
+    bayer_get(hip, NULL, &bayer, &bayer_n);
     if (bayer) {
         snprintf(buf, sizeof(buf), "%s%.*d",
                  greek[bayer - 1], bayer_n ? 1 : 0, bayer_n);
         labels_add_3d(buf, frame, pos, true, radius, FONT_SIZE_BASE,
-                      label_color, 0, LABEL_AROUND, effects, -vmag, s->oid);
+                      label_color, 0, LABEL_AROUND, effects, -vmag, oid);
     }
 }
 
@@ -299,7 +398,7 @@ static int star_render(const obj_t *obj, const painter_t *painter_)
     paint_2d_points(&painter, 1, &point);
 
     if (selected || (s->vmag <= painter.hints_limit_mag - 4.0)) {
-        star_render_name(&painter, s, FRAME_ICRF, pvo[0], size,
+        star_render_name(&painter, s->oid, s->hip, FRAME_ICRF, pvo[0], size,
                 s->vmag, color);
     }
     return 0;
@@ -325,7 +424,7 @@ void star_get_designations(
      */
     if (!names) {
         skycultures = core_get_module("skycultures");
-        name = skycultures_get_name(skycultures, obj->oid, buf);
+        name = skycultures_get_name(skycultures, obj->oid);
         if (name) f(obj, user, "NAME", name);
         if (s->hip) {
             snprintf(buf, sizeof(buf), "%d", s->hip);
@@ -349,6 +448,28 @@ void star_get_designations(
     }
 }
 
+// Rebuild the full data of a star of a tile.
+static void tile_get_star(const tile_t *tile, int i, star_data_t *s)
+{
+    const star_info_t *info = &tile->infos[i];
+    memset(s, 0, sizeof(*s));
+    s->oid = tile->oids[i];
+    s->gaia = info->gaia;
+    s->tyc = info->tyc;
+    memcpy(s->type, info->type, 4);
+    s->hip = info->hip;
+    s->vmag = tile->vmag[i];
+    s->ra = info->ra;
+    s->de = info->de;
+    s->pra = info->pra;
+    s->pde = info->pde;
+    s->plx = info->plx;
+    s->bv = tile->bv[i];
+    s->illuminance = tile->illuminances[i];
+    s->names = info->names;
+    compute_pv(s->ra, s->de, s->pra, s->pde, s->plx, s);
+}
+
 static star_t *star_create(const star_data_t *data)
 {
     star_t *star;
@@ -359,33 +480,199 @@ static star_t *star_create(const star_data_t *data)
     return star;
 }
 
+static star_t *star_create_from_tile(const tile_t *tile, int i)
+{
+    star_data_t data;
+    tile_get_star(tile, i, &data);
+    return star_create(&data);
+}
+
 // Used by the cache.
 static int del_tile(void *data)
 {
-    int i;
     tile_t *tile = data;
-    for (i = 0; i < tile->nb; i++) free(tile->sources[i].names);
-    free(tile->sources);
+    free(tile->data);
+    free(tile->cells);
+    free(tile->slices);
+    free(tile->pos0);
+    free(tile->pm);
     free(tile);
     return 0;
 }
 
+static uint64_t new_tile_id(void)
+{
+    static uint64_t g_id = 0;
+    // The tiles are loaded by the worker threads.
+    return __atomic_add_fetch(&g_id, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Allocate the per star arrays and the names of a tile in a single block.
+ *
+ * The previous block is not released, nor its content copied.
+ *
+ * Parameters:
+ *   tile       - A tile.
+ *   nb         - Number of stars.
+ *   names_size - Size of the names block.
+ */
+static void tile_alloc_data(tile_t *tile, int nb, int names_size)
+{
+    size_t size = 0;
+    char *data;
+
+    // Keep all the arrays 8 bytes aligned.
+#define ARRAYS(X) X(oids) X(infos) X(pos) X(vmag) X(bv) X(illuminances) \
+                  X(colors)
+#define X(attr) size += (nb * sizeof(*tile->attr) + 7) & ~7;
+    ARRAYS(X)
+#undef X
+    data = tile->data = malloc(size + names_size);
+#define X(attr) tile->attr = (void*)data; \
+                data += (nb * sizeof(*tile->attr) + 7) & ~7;
+    ARRAYS(X)
+#undef X
+#undef ARRAYS
+    tile->names = names_size ? data : NULL;
+    tile->names_size = names_size;
+}
+
+// Split the sorted stars data into the tile arrays.
+static void tile_set_sources(tile_t *tile, const star_data_t *sources)
+{
+    int i, len, names_size = 0;
+    double color[3];
+    const star_data_t *s;
+    star_info_t *info;
+    char *names;
+
+    tile->id = new_tile_id();
+
+    // Put all the names into a single block.
+    for (i = 0; i < tile->nb; i++) {
+        for (len = 0; sources[i].names && sources[i].names[len];)
+            len += strlen(sources[i].names + len) + 1;
+        if (len) names_size += len + 1;
+    }
+    tile_alloc_data(tile, tile->nb, names_size);
+    memset(tile->infos, 0, tile->nb * sizeof(*tile->infos));
+    names = tile->names;
+
+    for (i = 0; i < tile->nb; i++) {
+        s = &sources[i];
+        vec3_to_float(s->pos, tile->pos[i]);
+        tile->vmag[i] = s->vmag;
+        tile->bv[i] = s->bv;
+        bv_to_rgb(s->bv, color);
+        tile->colors[i][0] = color[0] * 255;
+        tile->colors[i][1] = color[1] * 255;
+        tile->colors[i][2] = color[2] * 255;
+        tile->colors[i][3] = 255;
+        tile->illuminances[i] = s->illuminance;
+        tile->oids[i] = s->oid;
+        info = &tile->infos[i];
+        info->gaia = s->gaia;
+        info->tyc = s->tyc;
+        info->hip = s->hip;
+        memcpy(info->type, s->type, 4);
+        otype_mask_add_id(&tile->types, otype_get_id(s->type));
+        info->ra = s->ra;
+        info->de = s->de;
+        info->pra = s->pra;
+        info->pde = s->pde;
+        info->plx = s->plx;
+        for (len = 0; s->names && s->names[len];)
+            len += strlen(s->names + len) + 1;
+        if (!len) continue;
+        info->names = names;
+        memcpy(names, s->names, len + 1);
+        names += len + 1;
+    }
+}
+
+// Compute the cumulated magnitude histogram of a tile sorted by vmag.
+static void tile_compute_hist(tile_t *tile)
+{
+    int i = 0, k;
+    for (k = 0; k <= HIST_NB; k++) {
+        while (i < tile->nb && tile->vmag[i] < HIST_MIN + k * HIST_STEP) i++;
+        tile->hist[k] = i;
+    }
+}
+
+// Return the number of stars of a tile with vmag <= limit.
+static int tile_count_brighter(const tile_t *tile, double limit)
+{
+    int nb;
+    double k = floor((limit - HIST_MIN) / HIST_STEP);
+    nb = (k < 0) ? 0 : tile->hist[(int)min(k, HIST_NB)];
+    while (nb < tile->nb && tile->vmag[nb] <= limit) nb++;
+    return nb;
+}
+
+// Decode the quantized unit vectors of a STRP chunk.
+static int read_quantized_pos(const void *table_data, int size, int nb,
+                              int flags, const eph_table_column_t *columns,
+                              int bits, star_data_t *sources)
+{
+    int i, j, r = 0;
+    int32_t *v = calloc(nb, sizeof(*v));
+    const int16_t *h = (const int16_t*)v;
+    const double scale = (bits == 16) ? 1.0 / INT16_MAX : 1.0 / INT32_MAX;
+
+    for (j = 0; j < 3; j++) {
+        r |= eph_read_table_column(table_data, size, nb, flags, &columns[j],
+                                   v, bits / 8);
+        for (i = 0; i < nb; i++)
+            sources[i].pos[j] = ((bits == 16) ? h[i] : v[i]) * scale;
+    }
+    for (i = 0; i < nb; i++) {
+        vec3_normalize(sources[i].pos, sources[i].pos);
+        sources[i].distance = NAN;
+    }
+    free(v);
+    return r;
+}
+
 static int star_data_cmp(const void *a, const void *b)
 {
     return cmp(((const star_data_t*)a)->vmag, ((const star_data_t*)b)->vmag);
 }
 
+/*
+ * Load a STAR, GAIA or STRP chunk.
+ *
+ * STRP chunks are render ready tiles created offline by
+ * 'tools/make-stars.py --render'.  After the tile header they have:
+ *
+ *   4 bytes: reference epoch of the positions (julian year, float)
+ *   4 bytes: number of bits of the quantized positions (16 or 32)
+ *   4 bytes: histogram min mag (float)
+ *   4 bytes: histogram step (float)
+ *   4 bytes: histogram number of bins n
+ *   (n + 1) * 4 bytes: cumulated histogram values
+ *
+ * Then the same table as the STAR chunks, already sorted by vmag, with the
+ * extra columns 'x', 'y', 'z' (quantized astrometric unit vector) and 'illu'
+ * (illuminance in lux), so that we don't need any ERFA call to load them.
+ */
 static int on_file_tile_loaded(const char type[4],
                                const void *data, int size, void *user)
 {
-    int version, nb, data_ofs = 0, row_size, flags, i, j, order, pix;
-    double vmag, gmag, ra, de, pra, pde, plx, bv;
+    int version, nb, data_ofs = 0, row_size, flags, i, j, order, pix, r = 0;
+    int bits = 0, hist_nb = 0;
+    float epoch = 0, hist_min = 0, hist_step = 0;
+    bool prepared;
+    const void *hist_data = NULL;
     char ids[256] = {};
-    typeof(((stars_t*)0)->surveys[0]) *survey = USER_GET(user, 0);
+    survey_t *survey = USER_GET(user, 0);
     tile_t **out = USER_GET(user, 1); // Receive the tile.
     tile_t *tile;
-    void *table_data;
-    star_data_t *s;
+    const void *table_data;
+    star_data_t *s, *sources;
+    float *gmags;
+    UT_string names;
 
     // All the columns we care about in the source file.
     eph_table_column_t columns[] = {
@@ -402,15 +689,63 @@ static int on_file_tile_loaded(const char type[4],
         {"pde",  'f', EPH_RAD_PER_YEAR},
         {"bv",   'f'},
         {"ids",  's', .size=256},
+        {"illu", 'f'},
+        {"x",    'i'},
+        {"y",    'i'},
+        {"z",    'i'},
+    };
+    // Where to decode each column (but gmag and ids) in a star_data_t.
+    const int offsets[] = {
+        offsetof(star_data_t, type),
+        offsetof(star_data_t, gaia),
+        offsetof(star_data_t, hip),
+        offsetof(star_data_t, tyc),
+        offsetof(star_data_t, vmag),
+        -1,
+        offsetof(star_data_t, ra),
+        offsetof(star_data_t, de),
+        offsetof(star_data_t, plx),
+        offsetof(star_data_t, pra),
+        offsetof(star_data_t, pde),
+        offsetof(star_data_t, bv),
+        -1,
+        offsetof(star_data_t, illuminance),
+        -1, -1, -1,
     };
 
-    *out = NULL;
-    // Only support STAR and GAIA chunks.  Ignore anything else.
+    // Only support STAR, GAIA and STRP chunks.  Ignore anything else.
+    prepared = strncmp(type, "STRP", 4) == 0;
     if (strncmp(type, "STAR", 4) != 0 &&
-        strncmp(type, "GAIA", 4) != 0) return 0;
+        strncmp(type, "GAIA", 4) != 0 && !prepared) return 0;
+
+    // If we already got the first slice of the tile, keep the next ones
+    // for later.
+    if (*out) {
+        tile = *out;
+        tile->slices = realloc(tile->slices, tile->slices_size + 8 + size);
+        memcpy(tile->slices + tile->slices_size, type, 4);
+        memcpy(tile->slices + tile->slices_size + 4, &size, 4);
+        memcpy(tile->slices + tile->slices_size + 8, data, size);
+        tile->slices_size += 8 + size;
+        return 0;
+    }
 
     eph_read_tile_header(data, size, &data_ofs, &version, &order, &pix);
     assert(version >= 3); // No more support for old style format.
+    if (prepared) {
+        memcpy(&epoch, data + data_ofs + 0, 4);
+        memcpy(&bits, data + data_ofs + 4, 4);
+        memcpy(&hist_min, data + data_ofs + 8, 4);
+        memcpy(&hist_step, data + data_ofs + 12, 4);
+        memcpy(&hist_nb, data + data_ofs + 16, 4);
+        hist_data = data + data_ofs + 20;
+        data_ofs += 20 + (hist_nb + 1) * 4;
+        if (bits != 16 && bits != 32) {
+            LOG_E("Wrong quantization bits: %d", bits);
+            return -1;
+        }
+        for (i = 14; i < 17; i++) columns[i].type = (bits == 16) ? 'h' : 'i';
+    }
     nb = eph_read_table_header(version, data, size,
                                &data_ofs, &row_size, &flags,
                                ARRAY_SIZE(columns), columns);
@@ -419,75 +754,272 @@ static int on_file_tile_loaded(const char type[4],
         return -1;
     }
 
-    table_data = eph_read_compressed_block(data, size, &data_ofs, &size);
+    table_data = eph_read_compressed_block_tmp(data, size, &data_ofs, &size);
     if (!table_data) {
         LOG_E("Cannot get table data");
         return -1;
     }
-    data_ofs = 0;
-    if (flags & 1) eph_shuffle_bytes(table_data, row_size, nb);
+
+    // Decode the table column by column, straight into the sources.
+    sources = calloc(nb, sizeof(*sources));
+    gmags = calloc(nb, sizeof(*gmags));
+    for (i = 0; i < ARRAY_SIZE(columns); i++) {
+        if (offsets[i] < 0) continue;
+        r |= eph_read_table_column(table_data, size, nb, flags, &columns[i],
+                                   (void*)sources + offsets[i],
+                                   sizeof(*sources));
+    }
+    r |= eph_read_table_column(table_data, size, nb, flags, &columns[5],
+                               gmags, sizeof(*gmags));
+    // Only use the precomputed values if the file has all of them, at the
+    // catalog epoch used by compute_pv.
+    prepared = prepared && epoch == 2000.0f && columns[13].got &&
+               columns[14].got && columns[15].got && columns[16].got;
+    if (prepared)
+        r |= read_quantized_pos(table_data, size, nb, flags, &columns[14],
+                                bits, sources);
+    if (r) {
+        LOG_E("Cannot parse file");
+        free(sources);
+        free(gmags);
+        return -1;
+    }
 
     tile = calloc(1, sizeof(*tile));
-    tile->sources = calloc(nb, sizeof(*tile->sources));
     tile->mag_min = DBL_MAX;
     tile->mag_max = -DBL_MAX;
 
+    // All the names go into a single temporary pool.  Since the pool can
+    // be reallocated, we first store the offsets (plus one) in the names
+    // pointers, and only set the real pointers at the end.
+    utstring_init(&names);
+
     for (i = 0; i < nb; i++) {
-        s = &tile->sources[tile->nb];
-        eph_read_table_row(
-                table_data, size, &data_ofs, ARRAY_SIZE(columns), columns,
-                s->type, &s->gaia, &s->hip, &s->tyc, &vmag, &gmag,
-                &ra, &de, &plx, &pra, &pde, &bv, ids);
-        assert(!isnan(ra));
-        assert(!isnan(de));
-        if (isnan(vmag)) vmag = gmag;
-        assert(!isnan(vmag));
-
-        if (!isnan(survey->min_vmag) && (vmag < survey->min_vmag)) continue;
+        s = &sources[i];
+        assert(!isnan(s->ra));
+        assert(!isnan(s->de));
+        if (isnan(s->vmag)) s->vmag = gmags[i];
+        assert(!isnan(s->vmag));
+
+        if (!isnan(survey->min_vmag) && (s->vmag < survey->min_vmag))
+            continue;
         if (!*s->type) strncpy(s->type, "*", 4); // Default type.
-        s->vmag = vmag;
-        s->ra = ra;
-        s->de = de;
-        s->pra = pra;
-        s->pde = pde;
-        s->plx = plx;
-        s->bv = isnan(bv) ? 0 : bv;
+        if (isnan(s->bv)) s->bv = 0;
         s->oid = s->hip ? oid_create("HIP", s->hip) :
                  s->tyc ? oid_create("TYC", s->tyc) :
                  s->gaia;
         assert(s->oid);
-        compute_pv(ra, de, pra, pde, plx, s);
-        s->illuminance = core_mag_to_illuminance(vmag);
+        if (!prepared) {
+            compute_pv(s->ra, s->de, s->pra, s->pde, s->plx, s);
+            s->illuminance = core_mag_to_illuminance(s->vmag);
+        }
 
         // Turn '|' separated ids into '\0' separated values.
+        eph_read_table_value(table_data, size, nb, flags, &columns[12], i,
+                             ids);
         if (*ids) {
-            s->names = calloc(1, 2 + strlen(ids));
             for (j = 0; ids[j]; j++)
-                s->names[j] = ids[j] != '|' ? ids[j] : '\0';
+                if (ids[j] == '|') ids[j] = '\0';
+            s->names = (char*)(uintptr_t)(utstring_len(&names) + 1);
+            utstring_bincpy(&names, ids, j + 1);
+            utstring_bincpy(&names, "", 1);
         }
 
         tile->illuminance += s->illuminance;
-        tile->mag_min = min(tile->mag_min, vmag);
-        tile->mag_max = max(tile->mag_max, vmag);
-        tile->nb++;
+        tile->mag_min = min(tile->mag_min, s->vmag);
+        tile->mag_max = max(tile->mag_max, s->vmag);
+        sources[tile->nb++] = *s;
+    }
+    free(gmags);
+    for (i = 0; i < tile->nb; i++) {
+        if (!sources[i].names) continue;
+        sources[i].names = utstring_body(&names) +
+                           (uintptr_t)sources[i].names - 1;
     }
 
     // Sort the data by vmag, so that we can early exit during render.
-    qsort(tile->sources, tile->nb, sizeof(*tile->sources), star_data_cmp);
-    free(table_data);
+    // The prepared tiles are already sorted.
+    if (!prepared)
+        qsort(sources, tile->nb, sizeof(*sources), star_data_cmp);
+    tile_set_sources(tile, sources);
+    // The stored histogram is only valid if we didn't skip any star.
+    if (prepared && tile->nb == nb && hist_nb == HIST_NB &&
+            hist_min == (float)HIST_MIN && hist_step == (float)HIST_STEP)
+        memcpy(tile->hist, hist_data, sizeof(tile->hist));
+    else
+        tile_compute_hist(tile);
+    utstring_done(&names);
+    free(sources);
 
     *out = tile;
     return 0;
 }
 
+// Compute the proper motions of the tile stars as a change of their
+// direction vector, so that we can propagate them without any ERFA call.
+static void tile_init_pm(tile_t *tile)
+{
+    int i;
+    double x, y, z, cd;
+    const star_info_t *info;
+
+    for (i = 0; i < tile->nb; i++)
+        if (tile->infos[i].pra || tile->infos[i].pde) break;
+    if (i == tile->nb) return;
+
+    tile->pos0 = malloc(tile->nb * sizeof(*tile->pos0));
+    tile->pm = calloc(tile->nb, sizeof(*tile->pm));
+    memcpy(tile->pos0, tile->pos, tile->nb * sizeof(*tile->pos0));
+    tile->epoch_bucket = 0;
+    for (i = 0; i < tile->nb; i++) {
+        info = &tile->infos[i];
+        x = tile->pos0[i][0];
+        y = tile->pos0[i][1];
+        z = tile->pos0[i][2];
+        cd = sqrt(x * x + y * y); // cos(de)
+        if (cd < 1e-9) continue; // At the poles.
+        // Derivatives of the direction along ra and de.
+        tile->pm[i][0] = -y * info->pra - z * x / cd * info->pde;
+        tile->pm[i][1] =  x * info->pra - z * y / cd * info->pde;
+        tile->pm[i][2] = cd * info->pde;
+    }
+}
+
+/*
+ * Function: tile_propagate
+ * Apply the proper motions to the tile stars positions.
+ *
+ * The positions are only updated when the epoch moves to a new bucket of
+ * PM_EPOCH_STEP years, with a single batch pass over the tile.
+ *
+ * Parameters:
+ *   tile   - A tile.
+ *   tt     - TT time (MJD).
+ */
+static void tile_propagate(tile_t *tile, double tt)
+{
+    int i, bucket;
+    double dt, p[3];
+
+    if (!tile->pm) return;
+    bucket = round((tt - DJM00) / ERFA_DJY / PM_EPOCH_STEP);
+    if (bucket == tile->epoch_bucket) return;
+    tile->epoch_bucket = bucket;
+    tile->version++;
+    dt = bucket * PM_EPOCH_STEP;
+    for (i = 0; i < tile->nb; i++) {
+        p[0] = tile->pos0[i][0] + tile->pm[i][0] * dt;
+        p[1] = tile->pos0[i][1] + tile->pm[i][1] * dt;
+        p[2] = tile->pos0[i][2] + tile->pm[i][2] * dt;
+        vec3_normalize(p, p);
+        vec3_to_float(p, tile->pos[i]);
+    }
+}
+
+// Add the stars of a following magnitude slice to a tile.
+static void tile_append(tile_t *tile, const tile_t *part)
+{
+    int i, n = tile->nb + part->nb;
+    tile_t old = *tile;
+    star_info_t *info;
+
+    // Go back to the J2000 positions, tile_init_pm is called again after.
+    if (tile->pm) {
+        memcpy(tile->pos, tile->pos0, tile->nb * sizeof(*tile->pos));
+        free(tile->pos0);
+        free(tile->pm);
+        tile->pos0 = NULL;
+        tile->pm = NULL;
+    }
+
+    tile_alloc_data(tile, n, old.names_size + part->names_size);
+#define APPEND(attr) do { \
+        memcpy(tile->attr, old.attr, old.nb * sizeof(*tile->attr)); \
+        memcpy(tile->attr + old.nb, part->attr, \
+               part->nb * sizeof(*tile->attr)); \
+    } while (0)
+    APPEND(pos);
+    APPEND(vmag);
+    APPEND(bv);
+    APPEND(colors);
+    APPEND(illuminances);
+    APPEND(oids);
+    APPEND(infos);
+#undef APPEND
+
+    // Merge the names blocks and relocate the infos names pointers.
+    if (old.names_size) memcpy(tile->names, old.names, old.names_size);
+    if (part->names_size)
+        memcpy(tile->names + old.names_size, part->names, part->names_size);
+    for (i = 0; i < n; i++) {
+        info = &tile->infos[i];
+        if (!info->names) continue;
+        if (i < old.nb)
+            info->names = tile->names + (info->names - old.names);
+        else
+            info->names = tile->names + old.names_size +
+                          (info->names - part->names);
+    }
+    free(old.data);
+
+    for (i = 0; i < OTYPE_MASK_SIZE; i++)
+        tile->types.v[i] |= part->types.v[i];
+    tile->nb = n;
+    tile->illuminance += part->illuminance;
+    tile->mag_min = min(tile->mag_min, part->mag_min);
+    tile->mag_max = max(tile->mag_max, part->mag_max);
+    tile->indexed = false;
+    tile->version++;
+    tile_compute_hist(tile);
+    tile_init_pm(tile);
+}
+
+/*
+ * Function: tile_extend
+ * Decode the pending magnitude slices of a tile up to a given magnitude.
+ *
+ * After this, all the stars of the tile brighter than max_mag are decoded,
+ * or tile->mag_max is above max_mag.
+ */
+static void tile_extend(tile_t *tile, survey_t *survey, double max_mag)
+{
+    char type[4];
+    int size;
+    tile_t *part;
+
+    while (tile->slices_ofs < tile->slices_size && tile->mag_max <= max_mag) {
+        memcpy(type, tile->slices + tile->slices_ofs, 4);
+        memcpy(&size, tile->slices + tile->slices_ofs + 4, 4);
+        part = NULL;
+        on_file_tile_loaded(type, tile->slices + tile->slices_ofs + 8, size,
+                            USER_PASS(survey, &part));
+        tile->slices_ofs += 8 + size;
+        if (!part) continue;
+        tile_append(tile, part);
+        del_tile(part);
+    }
+    if (tile->slices && tile->slices_ofs >= tile->slices_size) {
+        free(tile->slices);
+        tile->slices = NULL;
+        tile->slices_size = tile->slices_ofs = 0;
+    }
+}
+
 static const void *stars_create_tile(
         void *user, int order, int pix, void *data, int size,
         int *cost, int *transparency)
 {
-    tile_t *tile;
-    typeof(((stars_t*)0)->surveys[0]) *survey = user;
+    tile_t *tile = NULL;
+    survey_t *survey = user;
     eph_load(data, size, USER_PASS(survey, &tile), on_file_tile_loaded);
-    if (tile) *cost = tile->nb * sizeof(*tile->sources);
+    if (!tile) return NULL;
+    tile_init_pm(tile);
+    *cost = sizeof(*tile) + tile->names_size + tile->slices_size +
+            (tile->pm ? tile->nb * 2 * sizeof(*tile->pm) : 0) +
+            tile->nb * (sizeof(*tile->pos) + sizeof(*tile->vmag) +
+                        sizeof(*tile->bv) + sizeof(*tile->colors) +
+                        sizeof(*tile->illuminances) +
+                        sizeof(*tile->oids) + sizeof(*tile->infos));
     return tile;
 }
 
@@ -495,6 +1027,7 @@ static int stars_init(obj_t *obj, json_value *args)
 {
     stars_t *stars = (stars_t*)obj;
     stars->visible = true;
+    stars->aggregate = true;
     regcomp(&stars->search_reg, "(hip|gaia) *([0-9]+)",
             REG_EXTENDED | REG_ICASE);
     return 0;
@@ -511,10 +1044,51 @@ static int stars_init(obj_t *obj, json_value *args)
  *   pix    - Healpix pix.
  *   sync   - If set, don't load in a thread.  This will block the main
  *            loop so should be avoided.
+ *   max_mag - Make sure all the stars of the tile brighter than this are
+ *            decoded.  Use INFINITY to get all the stars.
+ *
+ * The positions of the returned tile stars are at the current observer
+ * epoch.
  *   code   - http return code (0 if still loading).
  */
+/*
+ * Add the HIP stars of a tile to the index.
+ *
+ * Gaia stars are not indexed since their id already gives us their tile,
+ * and there would be way too many of them.
+ */
+static void index_tile(stars_t *stars, tile_t *tile, int order, int pix)
+{
+    int i;
+    star_index_t *entry;
+    uint64_t oid;
+    const char *names;
+    char buf[32];
+
+    tile->indexed = true;
+    for (i = 0; i < tile->nb; i++) {
+        if (!tile->infos[i].hip) continue;
+        oid = tile->oids[i];
+        HASH_FIND(hh, stars->index, &oid, sizeof(oid), entry);
+        if (!entry) {
+            entry = calloc(1, sizeof(*entry));
+            entry->oid = oid;
+            HASH_ADD(hh, stars->index, oid, sizeof(entry->oid), entry);
+            // Also add the names to the search index.
+            snprintf(buf, sizeof(buf), "HIP %d", tile->infos[i].hip);
+            search_add(&stars->obj, buf, oid, pix_to_nuniq(order, pix));
+            for (names = tile->infos[i].names; names && *names;
+                 names += strlen(names) + 1) {
+                search_add(&stars->obj, names, oid,
+                           pix_to_nuniq(order, pix));
+            }
+        }
+        entry->nuniq = pix_to_nuniq(order, pix);
+    }
+}
+
 static tile_t *get_tile(stars_t *stars, int survey, int order, int pix,
-                        bool sync, int *code)
+                        bool sync, double max_mag, int *code)
 {
     int flags = 0;
     tile_t *tile;
@@ -526,9 +1100,205 @@ static tile_t *get_tile(stars_t *stars, int survey, int order, int pix,
     }
     tile = hips_get_tile(stars->surveys[survey].hips,
                          order, pix, flags, code);
+    if (tile && tile->slices)
+        tile_extend(tile, &stars->surveys[survey], max_mag);
+    if (tile) tile_propagate(tile, core->observer->tt);
+    if (tile && !tile->indexed) index_tile(stars, tile, order, pix);
     return tile;
 }
 
+// Find a star tile from the index.  Return NULL if we didn't find it.
+static obj_t *get_from_index(stars_t *stars, uint64_t oid)
+{
+    star_index_t *entry;
+    tile_t *tile;
+    int s, i, order, pix, code;
+
+    HASH_FIND(hh, stars->index, &oid, sizeof(oid), entry);
+    if (!entry) return NULL;
+    nuniq_to_pix(entry->nuniq, &order, &pix);
+    // Try both surveys (bundled and gaia).
+    for (s = 0; s < 2; s++) {
+        tile = get_tile(stars, s, order, pix, s == SURVEY_DEFAULT, INFINITY,
+                        &code);
+        if (!tile) continue;
+        for (i = 0; i < tile->nb; i++) {
+            if (tile->oids[i] == oid)
+                return (obj_t*)star_create_from_tile(tile, i);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function: render_tile_bright_stars
+ * Process the stars of a tile rendered by the GPU that still need some work
+ * on the CPU: the labels, and the shape areas of the selectable stars.
+ *
+ * Since the stars are sorted by vmag, this only concerns the first stars
+ * of the tile, plus the selected star.
+ */
+static void render_tile_bright_stars(const painter_t *painter, int survey,
+                                     const tile_t *tile, int order, int pix,
+                                     int nb)
+{
+    int i, sel = -1;
+    double size, luminance, pos[3], win_pos[2], color[3];
+    bool selectable, label;
+
+    if (core->selection) {
+        for (i = 0; i < nb; i++) {
+            if (tile->oids[i] == core->selection->oid) sel = i;
+        }
+    }
+
+    for (i = 0; i < nb; i++) {
+        core_get_point_for_mag(tile->vmag[i], &size, &luminance);
+        // This makes very faint stars not selectable
+        selectable = luminance > 0.5;
+        label = i == sel || (tile->vmag[i] <= painter->hints_limit_mag - 4.0 &&
+                             survey != SURVEY_GAIA);
+        if (!selectable && !label) {
+            // All the next stars are fainter, only the selection is left.
+            if (sel <= i) break;
+            i = sel - 1;
+            continue;
+        }
+        vec3_set(pos, tile->pos[i][0], tile->pos[i][1], tile->pos[i][2]);
+        vec3_normalize(pos, pos); // Fix float precision.
+        if (!painter_project(painter, FRAME_ASTROM, pos, true, true, win_pos))
+            continue;
+        if (selectable) {
+            areas_add_circle(core->areas, win_pos, size, tile->oids[i],
+                             pix_to_nuniq(order, pix));
+        }
+        if (label) {
+            bv_to_rgb(tile->bv[i], color);
+            star_render_name(painter, tile->oids[i], tile->infos[i].hip,
+                             FRAME_ASTROM, pos, size, tile->vmag[i], color);
+        }
+    }
+}
+
+/*
+ * Function: tile_compute_cells
+ * Make sure the aggregation cells of the first stars of a tile are known.
+ *
+ * The new stars of the tile are always appended, so we only compute the
+ * cells of the stars we didn't see yet.
+ */
+static void tile_compute_cells(tile_t *tile, int order, int pix, int nb)
+{
+    const int nb_cells = 1 << (2 * AGG_SPLIT);
+    int i, n = nb - tile->nb_cells, *subpix;
+    double (*pos)[3];
+
+    if (n <= 0) return;
+    tile->cells = realloc(tile->cells, tile->nb * sizeof(*tile->cells));
+    pos = core_frame_alloc(n * sizeof(*pos));
+    subpix = core_frame_alloc(n * sizeof(*subpix));
+    for (i = 0; i < n; i++) {
+        vec3_set(pos[i], tile->pos[tile->nb_cells + i][0],
+                         tile->pos[tile->nb_cells + i][1],
+                         tile->pos[tile->nb_cells + i][2]);
+    }
+    healpix_vec2pix_n(1 << (order + AGG_SPLIT), n, pos, subpix);
+    // The nested sub pixels of the tile start at pix * 4^AGG_SPLIT.  The
+    // proper motions can move a few stars out of the tile.
+    for (i = 0; i < n; i++) {
+        tile->cells[tile->nb_cells + i] =
+            clamp(subpix[i] - (pix << (2 * AGG_SPLIT)), 0, nb_cells - 1);
+    }
+    tile->nb_cells = nb;
+}
+
+// Return the size in pixels of the aggregation cells of a tile order.
+static double get_cell_size(const painter_t *painter, int order)
+{
+    double pix_per_rad, angle;
+    pix_per_rad = painter->fb_size[0] / atan(painter->proj->scaling[0]) / 2;
+    angle = sqrt(4 * M_PI / 12) / (1 << (order + AGG_SPLIT));
+    return angle * pix_per_rad;
+}
+
+// Return the magnitude above which the stars are rendered as dim points,
+// that are not selectable (see <render_tile_bright_stars>).
+static double get_faint_mag(void)
+{
+    double lo = HIST_MIN, hi = HIST_MIN + HIST_NB * HIST_STEP, mid;
+    double size, luminance;
+    int i;
+
+    core_get_point_for_mag(hi, &size, &luminance);
+    if (luminance > 0.5) return INFINITY;
+    for (i = 0; i < 16; i++) {
+        mid = (lo + hi) / 2;
+        core_get_point_for_mag(mid, &size, &luminance);
+        if (luminance > 0.5) lo = mid;
+        else hi = mid;
+    }
+    return hi;
+}
+
+/*
+ * Function: render_tile_clusters
+ * Render a range of faint stars of a tile as one point per cell.
+ *
+ * Each point has the total illuminance of the stars of its cell, at their
+ * illuminance weighted mean position and color.  Since the cells are
+ * about a pixel wide, this bounds the number of points by the screen area
+ * instead of the catalog density.
+ *
+ * Return:
+ *   The total illuminance of the stars.
+ */
+static double render_tile_clusters(const painter_t *painter, tile_t *tile,
+                                   int order, int pix, int start, int end)
+{
+    const int nb_cells = 1 << (2 * AGG_SPLIT);
+    struct {
+        double pos[3];
+        double illuminance;
+        double bv;
+    } cells[1 << (2 * AGG_SPLIT)] = {}, *cell;
+    int i, n = 0;
+    double w, total = 0, vmag, size, luminance, color[3], win_pos[2];
+    point_t *points;
+
+    tile_compute_cells(tile, order, pix, end);
+    for (i = start; i < end; i++) {
+        cell = &cells[tile->cells[i]];
+        w = tile->illuminances[i];
+        cell->pos[0] += tile->pos[i][0] * w;
+        cell->pos[1] += tile->pos[i][1] * w;
+        cell->pos[2] += tile->pos[i][2] * w;
+        cell->bv += tile->bv[i] * w;
+        cell->illuminance += w;
+        total += w;
+    }
+
+    points = core_frame_alloc(nb_cells * sizeof(*points));
+    for (i = 0; i < nb_cells; i++) {
+        cell = &cells[i];
+        if (!cell->illuminance) continue;
+        vec3_normalize(cell->pos, cell->pos);
+        if (!painter_project(painter, FRAME_ASTROM, cell->pos, true, true,
+                             win_pos))
+            continue;
+        vmag = -2.5 * log10(cell->illuminance / core_mag_to_illuminance(0));
+        core_get_point_for_mag(vmag, &size, &luminance);
+        bv_to_rgb(cell->bv / cell->illuminance, color);
+        points[n++] = (point_t) {
+            .pos = {win_pos[0], win_pos[1]},
+            .size = size,
+            .color = {color[0] * 255, color[1] * 255, color[2] * 255,
+                      luminance * 255},
+        };
+    }
+    paint_2d_points(painter, n, points);
+    return total;
+}
+
 static int render_visitor(int order, int pix, void *user)
 {
     PROFILE(stars_render_visitor, PROFILE_AGGREGATE);
@@ -538,13 +1308,14 @@ static int render_visitor(int order, int pix, void *user)
     int *nb_tot = USER_GET(user, 3);
     int *nb_loaded = USER_GET(user, 4);
     double *illuminance = USER_GET(user, 5);
+    double faint_mag = *(double*)USER_GET(user, 6);
     tile_t *tile;
-    int i, n = 0, code;
-    star_data_t *s;
-    double p_win[4], size, luminance;
-    double color[3];
+    int i, n = 0, nb, code;
+    double size, luminance, vmag;
+    double color[3], (*pos)[3], (*win_pos)[2];
     double limit_mag = min(painter.stars_limit_mag, painter.hard_limit_mag);
-    bool selected;
+    bool selected, *visible;
+    point_t *points;
 
     // Early exit if the tile is clipped.
     if (painter_is_healpix_clipped(&painter, FRAME_ASTROM, order, pix, true))
@@ -552,41 +1323,74 @@ static int render_visitor(int order, int pix, void *user)
     if (order < stars->surveys[survey].min_order) return 1;
 
     (*nb_tot)++;
-    tile = get_tile(stars, survey, order, pix, false, &code);
+    tile = get_tile(stars, survey, order, pix, false, limit_mag, &code);
     if (code) (*nb_loaded)++;
+    if (!code) {
+        hips_set_tile_priority(stars->surveys[survey].hips, order, pix,
+                painter_get_healpix_priority(&painter, FRAME_ASTROM,
+                                             order, pix, true));
+    }
 
     if (!tile) goto end;
     if (tile->mag_min > limit_mag) goto end;
+    nb = tile_count_brighter(tile, limit_mag);
+
+    // Aggregate the faint stars if the tile is small enough on screen.
+    if (stars->aggregate && faint_mag < limit_mag &&
+            get_cell_size(&painter, order) < AGG_CELL_SIZE) {
+        i = tile_count_brighter(tile, faint_mag);
+        (*illuminance) += render_tile_clusters(&painter, tile, order, pix,
+                                               i, nb);
+        nb = i;
+    }
 
-    point_t *points = malloc(tile->nb * sizeof(*points));
-    for (i = 0; i < tile->nb; i++) {
-        s = &tile->sources[i];
-        if (s->vmag > limit_mag) break;
+    // Let the renderer project all the stars on the GPU if it can.  In that
+    // case we don't know which stars are visible, so the illuminance
+    // includes all the stars of the tile brighter than the limit.
+    if (paint_3d_points(&painter, FRAME_ASTROM, tile->id, tile->version,
+                        tile->nb,
+                        tile->pos, tile->vmag, tile->colors, nb) == 0) {
+        for (i = 0; i < nb; i++) (*illuminance) += tile->illuminances[i];
+        render_tile_bright_stars(&painter, survey, tile, order, pix, nb);
+        goto end;
+    }
 
-        if (!painter_project(&painter, FRAME_ASTROM, s->pos, true, true, p_win))
-            continue;
+    // Project all the stars brighter than the limit mag at once.
+    pos = core_frame_alloc(nb * sizeof(*pos));
+    win_pos = core_frame_alloc(nb * sizeof(*win_pos));
+    visible = core_frame_alloc(nb * sizeof(*visible));
+    for (i = 0; i < nb; i++) {
+        pos[i][0] = tile->pos[i][0];
+        pos[i][1] = tile->pos[i][1];
+        pos[i][2] = tile->pos[i][2];
+        vec3_normalize(pos[i], pos[i]); // Fix float precision.
+    }
+    painter_project_n(&painter, FRAME_ASTROM, nb, pos, win_pos, visible);
 
-        (*illuminance) += s->illuminance;
-        core_get_point_for_mag(s->vmag, &size, &luminance);
-        bv_to_rgb(s->bv, color);
+    points = core_frame_alloc(nb * sizeof(*points));
+    for (i = 0; i < nb; i++) {
+        if (!visible[i]) continue;
+        vmag = tile->vmag[i];
+        (*illuminance) += tile->illuminances[i];
+        core_get_point_for_mag(vmag, &size, &luminance);
+        bv_to_rgb(tile->bv[i], color);
         points[n] = (point_t) {
-            .pos = {p_win[0], p_win[1]},
+            .pos = {win_pos[i][0], win_pos[i][1]},
             .size = size,
             .color = {color[0] * 255, color[1] * 255, color[2] * 255,
                       luminance * 255},
             // This makes very faint stars not selectable
-            .oid = luminance > 0.5 ? s->oid : 0,
+            .oid = luminance > 0.5 ? tile->oids[i] : 0,
             .hint = pix_to_nuniq(order, pix),
         };
         n++;
-        selected = core->selection && s->oid == core->selection->oid;
-        if (selected || (s->vmag <= painter.hints_limit_mag - 4.0 &&
+        selected = core->selection && tile->oids[i] == core->selection->oid;
+        if (selected || (vmag <= painter.hints_limit_mag - 4.0 &&
             survey != SURVEY_GAIA))
-            star_render_name(&painter, s, FRAME_ASTROM, s->pos, size,
-                             s->vmag, color);
+            star_render_name(&painter, tile->oids[i], tile->infos[i].hip,
+                             FRAME_ASTROM, pos[i], size, vmag, color);
     }
     paint_2d_points(&painter, n, points);
-    free(points);
 
 end:
     // Test if we should go into higher order tiles.
@@ -602,9 +1406,11 @@ static int stars_render(const obj_t *obj, const painter_t *painter_)
     stars_t *stars = (stars_t*)obj;
     int i, nb_tot = 0, nb_loaded = 0;
     double illuminance = 0; // Totall illuminance
+    double faint_mag;
     painter_t painter = *painter_;
 
     if (!stars->visible) return 0;
+    faint_mag = get_faint_mag();
 
     for (i = 0; i < ARRAY_SIZE(stars->surveys); i++) {
         if (!stars->surveys[i].hips) break;
@@ -614,7 +1420,7 @@ static int stars_render(const obj_t *obj, const painter_t *painter_)
                 stars->surveys[i].min_vmag > painter.stars_limit_mag)
             continue;
         hips_traverse(USER_PASS(stars, &i, &painter,
-                      &nb_tot, &nb_loaded, &illuminance),
+                      &nb_tot, &nb_loaded, &illuminance, &faint_mag),
                       render_visitor);
     }
 
@@ -661,17 +1467,17 @@ static int stars_get_visitor(int order, int pix, void *user)
     // don't load in a thread.  This is a fix for the constellations!
     for (i = 0; !tile && i < 2; i++) {
         sync = i == SURVEY_DEFAULT;
-        tile = get_tile(d->stars, i, order, pix, sync, &code);
+        tile = get_tile(d->stars, i, order, pix, sync, INFINITY, &code);
     }
 
     // Gaia survey has a min order of 3.
     // XXX: read the survey properties file instead of hard coding!
     if (!tile) return order < 3 ? 1 : 0;
     for (i = 0; i < tile->nb; i++) {
-        if (    (d->cat == 0 && tile->sources[i].hip == d->n) ||
-                (d->cat == 2 && tile->sources[i].gaia == d->n) ||
-                (d->cat == 3 && tile->sources[i].oid  == d->n)) {
-            d->ret = &star_create(&tile->sources[i])->obj;
+        if (    (d->cat == 0 && tile->infos[i].hip == d->n) ||
+                (d->cat == 2 && tile->infos[i].gaia == d->n) ||
+                (d->cat == 3 && tile->oids[i] == d->n)) {
+            d->ret = &star_create_from_tile(tile, i)->obj;
             return -1; // Stop the search.
         }
     }
@@ -698,6 +1504,8 @@ static obj_t *stars_get(const obj_t *obj, const char *id, int flags)
         uint64_t n;
     } d = {.stars=(void*)obj, .cat=cat, .n=n};
 
+    if (cat == 0 && (d.ret = get_from_index(stars, oid_create("HIP", n))))
+        return d.ret;
     hips_traverse(&d, stars_get_visitor);
     return d.ret;
 }
@@ -719,6 +1527,7 @@ static obj_t *stars_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint)
         if (    !oid_is_catalog(oid, "HIP") &&
                 !oid_is_catalog(oid, "TYC") &&
                 !oid_is_gaia(oid)) return NULL;
+        if ((d.ret = get_from_index(stars, oid))) return d.ret;
         hips_traverse(&d, stars_get_visitor);
         return d.ret;
     }
@@ -727,11 +1536,11 @@ static obj_t *stars_get_by_oid(const obj_t *obj, uint64_t oid, uint64_t hint)
     nuniq_to_pix(hint, &order, &pix);
     // Try both surveys (bundled and gaia).
     for (s = 0; s < 2; s++) {
-        tile = get_tile(stars, s, order, pix, false, &code);
+        tile = get_tile(stars, s, order, pix, false, INFINITY, &code);
         if (!tile) continue;
         for (i = 0; i < tile->nb; i++) {
-            if (tile->sources[i].oid == oid) {
-                return (obj_t*)star_create(&tile->sources[i]);
+            if (tile->oids[i] == oid) {
+                return (obj_t*)star_create_from_tile(tile, i);
             }
         }
     }
@@ -751,13 +1560,13 @@ static int stars_list_visitor(int order, int pix, void *user)
         void *user;
     } *d = user;
     tile_t *tile;
-    tile = get_tile(d->stars, 0, order, pix, false, &code);
+    tile = get_tile(d->stars, 0, order, pix, false, d->max_mag, &code);
     if (!tile || tile->mag_min >= d->max_mag) return 0;
     for (i = 0; i < tile->nb; i++) {
-        if (tile->sources[i].vmag > d->max_mag) continue;
+        if (tile->vmag[i] > d->max_mag) continue;
         d->nb++;
         if (!d->f) continue;
-        star = star_create(&tile->sources[i]);
+        star = star_create_from_tile(tile, i);
         r = d->f(d->user, (obj_t*)star);
         obj_release((obj_t*)star);
         if (r) break;
@@ -789,14 +1598,14 @@ static int stars_list(const obj_t *obj, observer_t *obs,
 
     // Get tile from hint (as nuniq).
     nuniq_to_pix(hint, &order, &pix);
-    tile = get_tile(stars, 0, order, pix, false, &code);
+    tile = get_tile(stars, 0, order, pix, false, INFINITY, &code);
     if (!tile) {
         if (!code) return OBJ_AGAIN; // Try again later.
         return -1;
     }
     for (i = 0; i < tile->nb; i++) {
         if (!f) continue;
-        star = star_create(&tile->sources[i]);
+        star = star_create_from_tile(tile, i);
         r = f(user, (obj_t*)star);
         obj_release((obj_t*)star);
         if (r) break;
@@ -804,6 +1613,62 @@ static int stars_list(const obj_t *obj, observer_t *obs,
     return 0;
 }
 
+static int stars_query_visitor(int order, int pix, void *user)
+{
+    int i, r, code;
+    double cap[4], pos[3];
+    star_t *star;
+    struct {
+        stars_t *stars;
+        const obj_query_t *query;
+        int (*f)(void *user, obj_t *obj);
+        void *user;
+        bool stopped;
+    } *d = user;
+    const obj_query_t *query = d->query;
+    tile_t *tile;
+
+    healpix_get_bounding_cap(1 << order, pix, cap);
+    if (!cap_intersects_cap(cap, query->cap)) return 0;
+    tile = get_tile(d->stars, 0, order, pix, false, query->max_mag, &code);
+    if (!tile || tile->mag_min >= query->max_mag) return 0;
+    if (query->type[0] && !otype_mask_intersects(&tile->types, &query->types))
+        return 1;
+    // The stars are sorted by vmag, so we can stop at the first one
+    // too faint.
+    for (i = 0; i < tile->nb && tile->vmag[i] <= query->max_mag; i++) {
+        vec3_copy(tile->pos[i], pos);
+        if (!cap_contains_vec3(query->cap, pos)) continue;
+        if (query->type[0] && !otype_mask_test(
+                    &query->types, otype_get_id(tile->infos[i].type)))
+            continue;
+        star = star_create_from_tile(tile, i);
+        r = d->f(d->user, (obj_t*)star);
+        obj_release((obj_t*)star);
+        if (r) {
+            d->stopped = true;
+            return -1;
+        }
+    }
+    return 1;
+}
+
+static int stars_query(const obj_t *obj, observer_t *obs,
+                       const obj_query_t *query, void *user,
+                       int (*f)(void *user, obj_t *obj))
+{
+    struct {
+        stars_t *stars;
+        const obj_query_t *query;
+        int (*f)(void *user, obj_t *obj);
+        void *user;
+        bool stopped;
+    } d = {.stars=(void*)obj, .query=query, .f=f, .user=user};
+
+    hips_traverse(&d, stars_query_visitor);
+    return d.stopped ? 1 : 0;
+}
+
 static int stars_add_data_source(
         obj_t *obj, const char *url, const char *type, json_value *args)
 {
@@ -813,6 +1678,7 @@ static int stars_add_data_source(
     hips_settings_t survey_settings = {
         .create_tile = stars_create_tile,
         .delete_tile = del_tile,
+        .cache = HIPS_CACHE_STARS,
     };
     int survey = SURVEY_DEFAULT;
     double release_date = 0;
@@ -878,10 +1744,12 @@ static obj_klass_t stars_klass = {
     .get            = stars_get,
     .get_by_oid     = stars_get_by_oid,
     .list           = stars_list,
+    .query          = stars_query,
     .add_data_source = stars_add_data_source,
     .render_order   = 20,
     .attributes = (attribute_t[]) {
         PROPERTY(visible, TYPE_BOOL, MEMBER(stars_t, visible)),
+        PROPERTY(aggregate, TYPE_BOOL, MEMBER(stars_t, aggregate)),
         {},
     },
 };
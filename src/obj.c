@@ -99,6 +99,12 @@ void obj_release(obj_t *obj)
     assert(obj->ref);
     obj->ref--;
     if (obj->ref == 0) {
+        // Clear the children hash first, since del might release them.
+        HASH_CLEAR(hh, obj->children_hash);
+        if (obj->klass->flags & OBJ_MODULE) {
+            module_unregister_oids(obj);
+            search_remove_module(obj);
+        }
         if (obj->klass->del) obj->klass->del(obj);
         free(obj->id);
         free(obj);
@@ -198,10 +204,14 @@ int obj_get_info(obj_t *obj, observer_t *obs, int info,
     double pvo[2][4], pos[3], ra, dec;
     int ret;
 
+    // The observer is owned by the caller, so we can update it outside of
+    // the core lock.
     observer_update(obs, true);
 
     if (obj->klass->get_info) {
+        core_lock();
         ret = obj->klass->get_info(obj, obs, info, out);
+        core_unlock();
         if (!ret) return ret;
         if (ret != 1) return ret; // An actual error
     }
@@ -222,7 +232,7 @@ int obj_get_info(obj_t *obj, observer_t *obs, int info,
         *(double*)out = eraAnpm(obs->astrom.eral - ra);
         return 0;
     case INFO_DISTANCE:
-        obj_get_pvo(obj, obs, pvo);
+        obj_get_info(obj, obs, INFO_PVO, pvo);
         *(double*)out = pvo[0][3] ? vec3_norm(pvo[0]) : NAN;
         return 0;
     default:
@@ -232,6 +242,99 @@ int obj_get_info(obj_t *obj, observer_t *obs, int info,
     return 1;
 }
 
+_Static_assert(sizeof(obj_record_t) == 56, "");
+
+void obj_get_record(obj_t *obj, observer_t *obs, obj_record_t *out,
+                    char *names, int names_size, int *names_ofs)
+{
+    double pos[4];
+    char buf[128];
+    int len;
+
+    memset(out, 0, sizeof(*out));
+    out->oid = obj->oid;
+    if (obj_get_info(obj, obs, INFO_TYPE, out->type)) memset(out->type, 0, 4);
+    if (obj_get_info(obj, obs, INFO_VMAG, &out->vmag)) out->vmag = NAN;
+
+    obj_get_pos(obj, obs, FRAME_ICRF, pos);
+    eraC2s(pos, &out->ra, &out->dec);
+    out->ra = eraAnp(out->ra);
+    obj_get_pos(obj, obs, FRAME_OBSERVED, pos);
+    eraC2s(pos, &out->az, &out->alt);
+    out->az = eraAnp(out->az);
+
+    obj_get_name(obj, buf);
+    len = strlen(buf) + 1;
+    out->name_ofs = -1;
+    if (*names_ofs + len <= names_size) {
+        memcpy(names + *names_ofs, buf, len);
+        out->name_ofs = *names_ofs;
+        *names_ofs += len;
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+int obj_get_records(int nb, obj_t *const *objs, observer_t *obs,
+                    obj_record_t *out, char *names, int names_size)
+{
+    int i, names_ofs = 0;
+    for (i = 0; i < nb; i++)
+        obj_get_record(objs[i], obs, &out[i], names, names_size, &names_ofs);
+    return names_ofs;
+}
+
+// Max interval between two accurate observer updates in the ephemeris.
+#define EPH_KNOT_STEP (1.0 / 24)
+
+EMSCRIPTEN_KEEPALIVE
+int obj_get_ephemeris(int nb, obj_t *const *objs, const observer_t *obs,
+                      double start, double end, double step, int fields,
+                      double *out)
+{
+    int i, j, nb_steps;
+    double pvo[2][4], pos[4], ra, dec, az, alt, v, last_knot = -INFINITY;
+    observer_t o = *obs;
+
+    if (!(step > 0) || end < start) return 0;
+    nb_steps = (int)floor((end - start) / step + 1e-9) + 1;
+    if (!out) return nb_steps;
+
+    core_lock();
+    for (i = 0; i < nb_steps; i++) {
+        o.tt = start + i * step;
+        // observer_update computes the other times from the TT.
+        if (fabs(o.tt - last_knot) >= EPH_KNOT_STEP) {
+            observer_update(&o, false);
+            last_knot = o.tt;
+        } else {
+            observer_update(&o, true);
+        }
+        for (j = 0; j < nb; j++) {
+            if (fields & (EPHEMERIS_RA | EPHEMERIS_DEC |
+                          EPHEMERIS_AZ | EPHEMERIS_ALT)) {
+                obj_get_pvo(objs[j], &o, pvo);
+                eraC2s(pvo[0], &ra, &dec);
+                convert_framev4(&o, FRAME_ICRF, FRAME_OBSERVED, pvo[0], pos);
+                eraC2s(pos, &az, &alt);
+            }
+            if (fields & EPHEMERIS_RA) *out++ = eraAnp(ra);
+            if (fields & EPHEMERIS_DEC) *out++ = dec;
+            if (fields & EPHEMERIS_AZ) *out++ = eraAnp(az);
+            if (fields & EPHEMERIS_ALT) *out++ = alt;
+            if (fields & EPHEMERIS_VMAG) {
+                if (obj_get_info(objs[j], &o, INFO_VMAG, &v)) v = NAN;
+                *out++ = v;
+            }
+            if (fields & EPHEMERIS_DISTANCE) {
+                if (obj_get_info(objs[j], &o, INFO_DISTANCE, &v)) v = NAN;
+                *out++ = v;
+            }
+        }
+    }
+    core_unlock();
+    return nb_steps;
+}
+
 EMSCRIPTEN_KEEPALIVE
 char *obj_get_info_json(const obj_t *obj, observer_t *obs,
                         const char *info_str)
@@ -339,6 +442,65 @@ int obj_get_designations(const obj_t *obj, void *user,
     return nb;
 }
 
+/*
+ * Return the number of doubles used by the binary representation of an
+ * attribute value, or zero if it has no binary representation.
+ */
+static int attr_get_dim(const attribute_t *attr)
+{
+    switch (attr->type % 16) {
+    case TYPE_BOOL:
+    case TYPE_INT:
+    case TYPE_FLOAT:
+        return 1;
+    case TYPE_V2: return 2;
+    case TYPE_V3: return 3;
+    case TYPE_V4: return 4;
+    default: return 0;
+    }
+}
+
+/*
+ * Check if we can directly read and write an attribute struct member,
+ * bypassing the json conversion.
+ */
+static bool attr_is_direct(const attribute_t *attr)
+{
+    if (attr->fn || !attr->member.size) return false;
+    switch (attr->type % 16) {
+    case TYPE_BOOL: return attr->member.size == sizeof(bool);
+    case TYPE_INT: return attr->member.size == sizeof(int);
+    case TYPE_FLOAT:
+    case TYPE_V2:
+    case TYPE_V3:
+    case TYPE_V4:
+        return attr->member.size == attr_get_dim(attr) * sizeof(double);
+    default:
+        return false;
+    }
+}
+
+// Set a member attribute value and notify the change.
+static void attr_set_member(obj_t *obj, const attribute_t *attr,
+                            const void *value)
+{
+    void *p = ((void*)obj) + attr->member.offset;
+    obj_t *o;
+
+    if (memcmp(p, value, attr->member.size) == 0) return;
+    // If we override an object, don't forget to release the
+    // previous value and increment the ref to the new one.
+    if (attr->type == TYPE_OBJ) {
+        o = *(obj_t**)p;
+        obj_release(o);
+        memcpy(&o, value, sizeof(o));
+        if (o) o->ref++;
+    }
+    memcpy(p, value, attr->member.size);
+    if (attr->on_changed) attr->on_changed(obj, attr);
+    module_changed(obj, attr->name);
+}
+
 // XXX: cleanup this code.
 static json_value *obj_fn_default(obj_t *obj, const attribute_t *attr,
                                   const json_value *args)
@@ -348,7 +510,6 @@ static json_value *obj_fn_default(obj_t *obj, const attribute_t *attr,
     // Buffer large enough to contain any kind of property data, including
     // static strings.
     char buf[4096] __attribute__((aligned(8)));
-    obj_t *o;
 
     // If no input arguents, return the value.
     if (!args || (args->type == json_array && !args->u.array.length)) {
@@ -375,19 +536,7 @@ static json_value *obj_fn_default(obj_t *obj, const attribute_t *attr,
     } else { // Set the value.
         assert(attr->member.size <= sizeof(buf));
         args_get(args, attr->type, buf);
-        if (memcmp(p, buf, attr->member.size) != 0) {
-            // If we override an object, don't forget to release the
-            // previous value and increment the ref to the new one.
-            if (attr->type == TYPE_OBJ) {
-                o = *(obj_t**)p;
-                obj_release(o);
-                memcpy(&o, buf, sizeof(o));
-                if (o) o->ref++;
-            }
-            memcpy(p, buf, attr->member.size);
-            if (attr->on_changed) attr->on_changed(obj, attr);
-            module_changed(obj, attr->name);
-        }
+        attr_set_member(obj, attr, buf);
         return NULL;
     }
 }
@@ -462,32 +611,90 @@ json_value *obj_call_json(obj_t *obj, const char *name,
 EMSCRIPTEN_KEEPALIVE
 char *obj_call_json_str(obj_t *obj, const char *attr, const char *args)
 {
+    // The attributes functions copy the arguments they keep, so we can
+    // parse them into an arena.  The calls can be nested if they trigger
+    // some js callbacks, so we only reset it from the outer call.
+    static arena_t arena = {};
+    static int depth = 0;
     json_value *jargs, *jret;
     char *ret;
     int size;
 
-    jargs = args ? json_parse(args, strlen(args)) : NULL;
+    depth++;
+    jargs = args ? json_parse_arena(&arena, args, strlen(args)) : NULL;
+    if (jargs && recorder_is_active() && obj_get_attr_(obj, attr))
+        recorder_on_attr(obj, obj_get_attr_(obj, attr), jargs);
+    recorder_push(NULL);
     jret = obj_call_json(obj, attr, jargs);
+    recorder_pop();
     size = json_measure(jret);
     ret = calloc(1, size);
     json_serialize(ret, jret);
-    json_value_free(jargs);
     json_builder_free(jret);
+    if (--depth == 0) arena_reset(&arena);
     return ret;
 }
 
-int obj_get_attr(const obj_t *obj, const char *name, ...)
+int obj_attr_get(const obj_t *obj, const attribute_t *attr, void *out)
 {
     json_value *ret;
+    const void *p = ((const void*)obj) + attr->member.offset;
+
+    if (attr_is_direct(attr)) {
+        memcpy(out, p, attr->member.size);
+        return 0;
+    }
+    ret = (attr->fn ?: obj_fn_default)((obj_t*)obj, attr, NULL);
+    assert(ret);
+    args_get(ret, attr->type, out);
+    json_builder_free(ret);
+    return 0;
+}
+
+int obj_attr_set(const obj_t *obj, const attribute_t *attr,
+                 const void *value)
+{
+    json_value *arg, *ret;
+
+    if (attr_is_direct(attr)) {
+        attr_set_member((obj_t*)obj, attr, value);
+        return 0;
+    }
+    switch (attr->type % 16) {
+    case TYPE_BOOL:
+        arg = args_value_new(attr->type, *(const bool*)value);
+        break;
+    case TYPE_INT:
+        arg = args_value_new(attr->type, *(const int*)value);
+        break;
+    case TYPE_FLOAT:
+        arg = args_value_new(attr->type, *(const double*)value);
+        break;
+    case TYPE_PTR:
+        arg = args_value_new(attr->type, *(void* const*)value);
+        break;
+    default: // Strings and vectors are passed by pointer.
+        arg = args_value_new(attr->type, value);
+        break;
+    }
+    ret = (attr->fn ?: obj_fn_default)((obj_t*)obj, attr, arg);
+    json_builder_free(arg);
+    json_builder_free(ret);
+    return 0;
+}
+
+int obj_get_attr(const obj_t *obj, const char *name, ...)
+{
     const attribute_t *attr;
     va_list ap;
 
     attr = obj_get_attr_(obj, name);
+    if (!attr) {
+        LOG_E("Cannot find attribute %s of object %s", name, obj->id);
+        return -1;
+    }
     va_start(ap, name);
-    ret = obj_call_json(obj, name, NULL);
-    assert(ret);
-    args_vget(ret, attr->type, &ap);
-    json_builder_free(ret);
+    obj_attr_get(obj, attr, va_arg(ap, void*));
     va_end(ap);
     return 0;
 }
@@ -495,19 +702,113 @@ int obj_get_attr(const obj_t *obj, const char *name, ...)
 int obj_set_attr(const obj_t *obj, const char *name, ...)
 {
     json_value *arg, *ret;
-    va_list ap;
+    va_list ap, ap2;
     const attribute_t *attr;
+    union {
+        bool b;
+        int i;
+        double f;
+    } v;
 
     attr = obj_get_attr_(obj, name);
+    if (!attr) {
+        LOG_E("Cannot find attribute %s of object %s", name, obj->id);
+        return -1;
+    }
     va_start(ap, name);
+    if (recorder_is_active()) {
+        va_copy(ap2, ap);
+        arg = args_vvalue_new(attr->type, &ap2);
+        va_end(ap2);
+        recorder_on_attr(obj, attr, arg);
+        json_builder_free(arg);
+    }
+    recorder_push(NULL);
+    if (attr_is_direct(attr)) {
+        switch (attr->type % 16) {
+        case TYPE_BOOL: v.b = va_arg(ap, int); break;
+        case TYPE_INT: v.i = va_arg(ap, int); break;
+        case TYPE_FLOAT: v.f = va_arg(ap, double); break;
+        }
+        // Vectors are passed by pointer.
+        attr_set_member((obj_t*)obj, attr, attr_get_dim(attr) > 1 ?
+                        va_arg(ap, const double*) : (const void*)&v);
+        va_end(ap);
+        recorder_pop();
+        return 0;
+    }
     arg = args_vvalue_new(attr->type, &ap);
-    ret = obj_call_json(obj, name, arg);
+    ret = (attr->fn ?: obj_fn_default)((obj_t*)obj, attr, arg);
     json_builder_free(arg);
     json_builder_free(ret);
     va_end(ap);
+    recorder_pop();
     return 0;
 }
 
+EMSCRIPTEN_KEEPALIVE
+int obj_get_attrs_values(const obj_t *obj, int n,
+                         const attribute_t *const *attrs, double *out)
+{
+    int i, j, dim, nb = 0;
+    union {
+        bool b;
+        int i;
+        double v[4];
+    } v;
+
+    for (i = 0; i < n; i++) {
+        dim = attr_get_dim(attrs[i]);
+        if (!dim) {
+            out[nb++] = NAN;
+            continue;
+        }
+        obj_attr_get(obj, attrs[i], &v);
+        switch (attrs[i]->type % 16) {
+        case TYPE_BOOL: out[nb] = v.b; break;
+        case TYPE_INT: out[nb] = v.i; break;
+        default:
+            for (j = 0; j < dim; j++) out[nb + j] = v.v[j];
+        }
+        nb += dim;
+    }
+    return nb;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int obj_set_attrs_values(const obj_t *obj, int n,
+                         const attribute_t *const *attrs,
+                         const double *values)
+{
+    int i, dim, nb = 0;
+    union {
+        bool b;
+        int i;
+    } v;
+
+    for (i = 0; i < n; i++) {
+        dim = attr_get_dim(attrs[i]);
+        if (!dim) {
+            nb++;
+            continue;
+        }
+        switch (attrs[i]->type % 16) {
+        case TYPE_BOOL:
+            v.b = values[nb];
+            obj_attr_set(obj, attrs[i], &v.b);
+            break;
+        case TYPE_INT:
+            v.i = values[nb];
+            obj_attr_set(obj, attrs[i], &v.i);
+            break;
+        default:
+            obj_attr_set(obj, attrs[i], values + nb);
+        }
+        nb += dim;
+    }
+    return nb;
+}
+
 void obj_register_(obj_klass_t *klass)
 {
     assert(klass->size);
@@ -661,6 +962,67 @@ static void test_simple(void)
     assert(test.nb_changes == 2);
 }
 
+static void test_attr_handles(void)
+{
+    test_t test = {};
+    const attribute_t *attrs[3];
+    double alt, values[3];
+    int proj = 2;
+
+    test.obj.klass = &test_klass;
+    attrs[0] = obj_get_attr_(&test.obj, "altitude");
+    attrs[1] = obj_get_attr_(&test.obj, "my_attr");
+    attrs[2] = obj_get_attr_(&test.obj, "projection");
+
+    alt = 10.0;
+    obj_attr_set(&test.obj, attrs[0], &alt);
+    assert(test.alt == 10.0);
+    obj_attr_set(&test.obj, attrs[2], &proj);
+    assert(test.proj == 2);
+    alt = 0;
+    obj_attr_get(&test.obj, attrs[0], &alt);
+    assert(alt == 10.0);
+
+    assert(obj_set_attrs_values(&test.obj, 3, attrs,
+                                (double[]){1.0, 2.0, 3.0}) == 3);
+    assert(test.alt == 1.0 && test.my_attr == 2.0 && test.proj == 3);
+    assert(test.nb_changes == 1);
+    assert(obj_get_attrs_values(&test.obj, 3, attrs, values) == 3);
+    assert(values[0] == 1.0 && values[1] == 2.0 && values[2] == 3.0);
+}
+
+static void test_ephemeris_table(void)
+{
+    obj_t *jupiter;
+    observer_t obs;
+    double table[25][4], pos[4], az, alt, tt;
+    int i, n, fields;
+
+    core_init(100, 100, 1.0);
+    fields = EPHEMERIS_RA | EPHEMERIS_DEC | EPHEMERIS_AZ | EPHEMERIS_ALT;
+    jupiter = obj_get_by_oid(NULL, oid_create("HORI", 599), 0);
+    assert(jupiter);
+    obs = *core->observer;
+    n = obj_get_ephemeris(1, &jupiter, &obs, 59000, 59001, 1.0 / 24,
+                          fields, NULL);
+    assert(n == 25);
+    obj_get_ephemeris(1, &jupiter, &obs, 59000, 59001, 1.0 / 24,
+                      fields, (double*)table);
+    // Compare with a direct accurate computation.
+    for (i = 0; i < n; i += 7) {
+        tt = 59000 + i / 24.0;
+        obj_set_attr(&obs.obj, "tt", tt);
+        observer_update(&obs, false);
+        obj_get_pos(jupiter, &obs, FRAME_OBSERVED, pos);
+        eraC2s(pos, &az, &alt);
+        assert(eraSeps(eraAnp(az), alt, table[i][2], table[i][3]) <
+               1.0 * ERFA_DAS2R);
+    }
+    obj_release(jupiter);
+}
+
 TEST_REGISTER(NULL, test_simple, TEST_AUTO);
+TEST_REGISTER(NULL, test_attr_handles, TEST_AUTO);
+TEST_REGISTER(NULL, test_ephemeris_table, TEST_AUTO);
 
 #endif
@@ -15,6 +15,7 @@
 #include <stdlib.h>
 
 #include "obj_info.h"
+#include "uthash.h"
 
 // S macro for C99 static argument array size.
 #ifndef __cplusplus
@@ -46,11 +47,16 @@
  * OBJ_LISTABLE         - For modules that maintain a list of children objects,
  *                        like comets, this allows obj_list to directly do
  *                        the listing.
+ * OBJ_UPDATE_PARALLEL  - For modules whose update only changes their own
+ *                        data, so that it can run concurrently with the
+ *                        other such modules.  The modules without the flag
+ *                        act as barriers.  See <core_update>.
  */
 enum {
-    OBJ_IN_JSON_TREE = 1 << 0,
-    OBJ_MODULE       = 1 << 1,
-    OBJ_LISTABLE     = 1 << 2,
+    OBJ_IN_JSON_TREE    = 1 << 0,
+    OBJ_MODULE          = 1 << 1,
+    OBJ_LISTABLE        = 1 << 2,
+    OBJ_UPDATE_PARALLEL = 1 << 3,
 };
 
 enum {
@@ -64,6 +70,25 @@ typedef struct observer observer_t;
 typedef struct projection projection_t;
 typedef struct painter painter_t;
 typedef struct obj_klass obj_klass_t;
+typedef struct obj_query obj_query_t;
+
+/*
+ * Type: render_task_t
+ * Some work a module needs done before its render, split in blocks of
+ * indices that can run in any thread.  See the klass prepare method.
+ *
+ * Attributes:
+ *   n      - Number of indices.
+ *   block  - Number of indices per call to fn.
+ *   args   - Passed as user data to fn, to be read with USER_GET.
+ *   fn     - Called with a range of indices [start, end).
+ */
+typedef struct render_task {
+    int     n;
+    int     block;
+    void    *args[4];
+    void    (*fn)(void *user, int start, int end);
+} render_task_t;
 
 /*
  * Type: obj_klass
@@ -100,9 +125,21 @@ typedef struct obj_klass obj_klass_t;
  *
  * Module Methods:
  *   update  - Update the module.
+ *   prepare - Optional.  Called before the render of all the modules, can
+ *             return 1 and set a <render_task_t> for the work that should
+ *             be done before the module render.  The tasks of all the
+ *             modules run together on the worker pool.
  *   list    - List all the sky objects children from this module.
+ *   query   - List the sky objects matching a cone query.  Optional, the
+ *             default is to filter the output of list.
  *   get_render_order - Return the render order.
  *   on_mouse   - Called when there is a mouse event.
+ *   load    - Optional.  Load the module data, so that modules can delay
+ *             the parsing of their data after startup.  Called by the core
+ *             before the first access to the module with
+ *             <core_get_module>, before each render, and in the background
+ *             after the first frames.  Should return 1 if the data got
+ *             loaded by the call, 0 if it was already loaded.
  */
 struct obj_klass
 {
@@ -127,6 +164,9 @@ struct obj_klass
     int (*on_mouse)(obj_t *obj, int id, int state, double x, double y);
 
     int (*update)(obj_t *module, double dt);
+    int (*prepare)(const obj_t *module, const painter_t *painter,
+                   render_task_t *task);
+    int (*load)(obj_t *module);
     // Find a sky object given an id.
     obj_t *(*get)(const obj_t *obj, const char *id, int flags);
     // Find a sky object given an oid
@@ -144,6 +184,9 @@ struct obj_klass
     int (*list)(const obj_t *obj, observer_t *obs, double max_mag,
                 uint64_t hint, void *user,
                 int (*f)(void *user, obj_t *obj));
+    // List the sky objects matching a query (see module_query).
+    int (*query)(const obj_t *obj, observer_t *obs, const obj_query_t *query,
+                 void *user, int (*f)(void *user, obj_t *obj));
 
     // Add a source of data.
     int (*add_data_source)(obj_t *obj, const char *url, const char *type,
@@ -185,6 +228,8 @@ struct obj_klass
  *   children   - Pointer to the list of children.
  *   prev       - Pointer to the previous sibling.
  *   next       - Pointer to the next sibling.
+ *   children_hash - Hash table of the children, indexed by id.
+ *   hh         - Handle used in the parent children_hash.
  *   observer_hash - Hash of the observer the last time obj_update was called.
  *                   Can be used to skip update.
  *   vmag       - Visual magnitude.
@@ -202,6 +247,10 @@ struct obj
     char        type_padding_; // Ensure that type is null terminated.
     obj_t       *parent;
     obj_t       *children, *prev, *next;
+    obj_t       *children_hash;
+    UT_hash_handle hh;
+    uint32_t    version;        // Tree version of the last change.
+    uint32_t    tree_version;   // Same, including the descendants.
 };
 
 /*
@@ -365,6 +414,109 @@ int obj_get_info(obj_t *obj, observer_t *obs, int info, void *out);
  */
 char *obj_get_info_json(const obj_t *obj, observer_t *obs, const char *info);
 
+/*
+ * Type: obj_record_t
+ * Fixed layout summary of a sky object, used for bulk queries from js.
+ *
+ * The layout doesn't depend on the pointer size, so that the js code can
+ * read the records directly from the wasm heap with typed arrays.
+ *
+ * Attributes:
+ *   oid        - Object oid.
+ *   type       - Four bytes object type (not null terminated).
+ *   name_ofs   - Offset of the object name in the names buffer, or -1.
+ *   ra         - ICRF right ascension (rad).
+ *   dec        - ICRF declination (rad).
+ *   az         - Azimuth, including refraction (rad).
+ *   alt        - Altitude, including refraction (rad).
+ *   vmag       - Visual magnitude, or NAN.
+ */
+typedef struct obj_record {
+    uint64_t    oid;
+    char        type[4];
+    int32_t     name_ofs;
+    double      ra;
+    double      dec;
+    double      az;
+    double      alt;
+    double      vmag;
+} obj_record_t;
+
+/*
+ * Function: obj_get_record
+ * Fill an <obj_record_t> for an object.
+ *
+ * Parameters:
+ *   obj        - A sky object.
+ *   obs        - An observer.
+ *   out        - Output record.
+ *   names      - Buffer where the null terminated names are written.
+ *   names_size - Size of the names buffer.
+ *   names_ofs  - Current offset in the names buffer, updated.  If the
+ *                names buffer is full, the record name_ofs is set to -1.
+ */
+void obj_get_record(obj_t *obj, observer_t *obs, obj_record_t *out,
+                    char *names, int names_size, int *names_ofs);
+
+/*
+ * Function: obj_get_records
+ * Fill the records of a list of objects.
+ *
+ * Return:
+ *   The number of bytes used in the names buffer.
+ */
+int obj_get_records(int nb, obj_t *const *objs, observer_t *obs,
+                    obj_record_t *out, char *names, int names_size);
+
+/*
+ * Enum: EPHEMERIS_FIELD
+ * Flags of the values computed by <obj_get_ephemeris>.
+ *
+ * The values are always written in this order.
+ *
+ *   EPHEMERIS_RA       - ICRF right ascension (rad).
+ *   EPHEMERIS_DEC      - ICRF declination (rad).
+ *   EPHEMERIS_AZ       - Azimuth, including refraction (rad).
+ *   EPHEMERIS_ALT      - Altitude, including refraction (rad).
+ *   EPHEMERIS_VMAG     - Visual magnitude, or NAN.
+ *   EPHEMERIS_DISTANCE - Distance to the observer (AU), or NAN.
+ */
+enum {
+    EPHEMERIS_RA        = 1 << 0,
+    EPHEMERIS_DEC       = 1 << 1,
+    EPHEMERIS_AZ        = 1 << 2,
+    EPHEMERIS_ALT       = 1 << 3,
+    EPHEMERIS_VMAG      = 1 << 4,
+    EPHEMERIS_DISTANCE  = 1 << 5,
+};
+
+/*
+ * Function: obj_get_ephemeris
+ * Compute an ephemeris table for a list of objects.
+ *
+ * The observer is only used as a template: a copy of it is moved along
+ * the time range.  The observer is updated in fast mode between knots
+ * every hour, and accurately at each knot.
+ *
+ * Parameters:
+ *   nb     - Number of objects.
+ *   objs   - Array of objects.
+ *   obs    - An observer.
+ *   start  - Start time (TT MJD).
+ *   end    - End time (TT MJD), included if it falls on a step.
+ *   step   - Time step (day).
+ *   fields - Union of <EPHEMERIS_FIELD> flags.
+ *   out    - Output buffer, large enough for nb_steps * nb * nb_fields
+ *            doubles, ordered by time, then object, then field.  Can be
+ *            NULL to only get the number of steps.
+ *
+ * Return:
+ *   The number of time steps.
+ */
+int obj_get_ephemeris(int nb, obj_t *const *objs, const observer_t *obs,
+                      double start, double end, double step, int fields,
+                      double *out);
+
 /*
  * Function: obj_get_2d_ellipse
  * Return the ellipse containing the rendered object in screen coordinates (px).
@@ -454,10 +606,77 @@ char *obj_call_json_str(obj_t *obj, const char *attr, const char *args);
  * Function: obj_get_attr_
  * Return the actual <attribute_t> pointer for a given attr name
  *
+ * The returned pointer is valid for all the objects of the same klass,
+ * and can be cached as an attribute handle by the code that accesses
+ * the same attribute often, to avoid the string lookup.
+ *
  * XXX: need to use a proper name!
  */
 const attribute_t *obj_get_attr_(const obj_t *obj, const char *attr);
 
+/*
+ * Function: obj_attr_get
+ * Get an attribute value from an attribute handle.
+ *
+ * Properties stored as plain struct members of type bool, int, float or
+ * vector are read directly, other attributes go through the json path.
+ *
+ * Parameters:
+ *   obj    - An object.
+ *   attr   - An attribute of the object klass, as returned by
+ *            <obj_get_attr_>.
+ *   out    - Pointer to the output value (bool, int, double, double[n],
+ *            same as <obj_get_attr>).
+ */
+int obj_attr_get(const obj_t *obj, const attribute_t *attr, void *out);
+
+/*
+ * Function: obj_attr_set
+ * Set an attribute value from an attribute handle.
+ *
+ * Parameters:
+ *   obj    - An object.
+ *   attr   - An attribute of the object klass, as returned by
+ *            <obj_get_attr_>.
+ *   value  - Pointer to the new value (bool, int, double, double[n]...).
+ */
+int obj_attr_set(const obj_t *obj, const attribute_t *attr,
+                 const void *value);
+
+/*
+ * Function: obj_get_attrs_values
+ * Get several numerical attributes values at once into a double array.
+ *
+ * This is used by the js bindings to read the values without any json
+ * conversion.  Bool, int and float values take one double, vectors take
+ * as many doubles as their size, other attribute types take one NAN
+ * value.
+ *
+ * Parameters:
+ *   obj    - An object.
+ *   n      - Number of attributes.
+ *   attrs  - Attribute handles, as returned by <obj_get_attr_>.
+ *   out    - Output values.
+ *
+ * Return:
+ *   The number of doubles written.
+ */
+int obj_get_attrs_values(const obj_t *obj, int n,
+                         const attribute_t *const *attrs, double *out);
+
+/*
+ * Function: obj_set_attrs_values
+ * Set several numerical attributes values at once from a double array.
+ *
+ * The values use the same layout as <obj_get_attrs_values>.
+ *
+ * Return:
+ *   The number of doubles read.
+ */
+int obj_set_attrs_values(const obj_t *obj, int n,
+                         const attribute_t *const *attrs,
+                         const double *values);
+
 
 // Register an object klass, so that we can create instances dynamically
 #define OBJ_REGISTER(klass) \
@@ -25,18 +25,13 @@ static uint32_t hash_xor(uint32_t v, const char *data, int len)
     return v;
 }
 
-static void update_matrices(observer_t *obs)
+// Update the matrices that only depend on the view orientation.
+static void update_view_matrices(observer_t *obs)
 {
-    eraASTROM *astrom = &obs->astrom;
     // We work with 3x3 matrices, so that we can use the erfa functions.
     double rm2v[3][3];  // Rotate from mount to view.
     double ro2m[3][3];  // Rotate from observed to mount.
     double ro2v[3][3];  // Rotate from observed to view.
-    double ri2h[3][3];  // Equatorial J2000 (ICRF) to horizontal.
-    double rh2i[3][3];  // Horizontal to Equatorial J2000 (ICRF).
-    double ri2v[3][3];  // Equatorial J2000 (ICRF) to view.
-    double ri2e[3][3];  // Equatorial J2000 (ICRF) to ecliptic.
-    double re2i[3][3];  // Eclipic to Equatorial J2000 (ICRF).
     double view_rot[3][3];
 
     quat_to_mat3(obs->mount_quat, ro2m);
@@ -57,6 +52,20 @@ static void update_matrices(observer_t *obs)
     mat3_rx(obs->view_offset_alt, view_rot, view_rot);
     mat3_mul(view_rot, ro2v, ro2v);
 
+    mat3_copy(ro2m, obs->ro2m);
+    mat3_copy(ro2v, obs->ro2v);
+    mat3_invert(obs->ro2v, obs->rv2o);
+    mat3_mul(obs->ro2v, obs->ri2h, obs->ri2v);
+}
+
+// Update the matrices that depend on the time and location.
+static void update_matrices(observer_t *obs)
+{
+    eraASTROM *astrom = &obs->astrom;
+    double ri2h[3][3];  // Equatorial J2000 (ICRF) to horizontal.
+    double ri2e[3][3];  // Equatorial J2000 (ICRF) to ecliptic.
+    double re2i[3][3];  // Eclipic to Equatorial J2000 (ICRF).
+
     // Compute rotation matrix from CIRS to horizontal.
     mat3_set_identity(ri2h);
     // Earth rotation.
@@ -72,28 +81,45 @@ static void update_matrices(observer_t *obs)
     mat3_mul(ri2h, rsx, ri2h);
     mat3_transpose(ri2h, ri2h);
 
-    // Also store its inverse.
-    mat3_invert(ri2h, rh2i);
-    mat3_mul(ro2v, ri2h, ri2v);
-
     // Equatorial to ecliptic
     mat3_set_identity(re2i);
     mat3_rx(eraObl80(DJM0, obs->ut1), re2i, re2i);
     mat3_invert(re2i, ri2e);
 
-    // Copy all
-    mat3_copy(ro2m, obs->ro2m);
-    mat3_copy(ro2v, obs->ro2v);
-    mat3_invert(obs->ro2v, obs->rv2o);
+    // Copy all, also store the inverse of ri2h.
     mat3_copy(ri2h, obs->ri2h);
-    mat3_copy(rh2i, obs->rh2i);
-    mat3_copy(ri2v, obs->ri2v);
+    mat3_invert(ri2h, obs->rh2i);
     mat3_copy(ri2e, obs->ri2e);
     mat3_copy(re2i, obs->re2i);
 }
 
+// Compose the rotations between all the frames.
+static void update_frames_matrices(observer_t *obs)
+{
+    int i, j;
+    double m[FRAMES_NB][3][3]; // Rotation from ICRF to each frame.
+    double inv[3][3];
+
+    mat3_set_identity(m[FRAME_ICRF]);
+    mat3_set_identity(m[FRAME_ASTROM]);
+    // Erfa matrices are row major.
+    mat3_transpose(obs->astrom.bpn, m[FRAME_CIRS]);
+    mat3_set_identity(m[FRAME_JNOW]);
+    mat3_rz(-obs->eo, m[FRAME_JNOW], m[FRAME_JNOW]);
+    mat3_mul(m[FRAME_JNOW], m[FRAME_CIRS], m[FRAME_JNOW]);
+    mat3_mul(obs->ri2h, m[FRAME_CIRS], m[FRAME_OBSERVED]);
+    mat3_mul(obs->ro2m, m[FRAME_OBSERVED], m[FRAME_MOUNT]);
+    mat3_mul(obs->ro2v, m[FRAME_OBSERVED], m[FRAME_VIEW]);
+
+    for (i = 0; i < FRAMES_NB; i++) {
+        mat3_transpose(m[i], inv);
+        for (j = 0; j < FRAMES_NB; j++)
+            mat3_mul(m[j], inv, obs->rframes[i][j]);
+    }
+}
+
 static void observer_compute_hash(observer_t *obs, uint64_t* hash_partial,
-                                  uint64_t* hash)
+                                  uint64_t *hash_pos, uint64_t* hash)
 {
     uint32_t v = 1;
     #define H(a) v = hash_xor(v, (const char*)&obs->a, sizeof(obs->a))
@@ -104,12 +130,13 @@ static void observer_compute_hash(observer_t *obs, uint64_t* hash_partial,
     H(pressure);
     H(refraction);
     *hash_partial = v;
+    H(tt);
+    *hash_pos = v;
     H(mount_quat);
     H(pitch);
     H(yaw);
     H(roll);
     H(view_offset_alt);
-    H(tt);
     #undef H
     *hash = v;
 }
@@ -120,37 +147,186 @@ static void correct_speed_of_light(double pv[2][3]) {
 }
 
 
-static void update_nutation_precession_mat(observer_t *obs)
+static void compute_nutation_precession_mat(double tt, double rnp[3][3])
 {
     // XXX: we can maybe optimize this, since eraPn00a is very slow!
     double dpsi, deps, epsa, rb[3][3], rp[3][3], rbp[3][3], rn[3][3],
            rbpn[3][3];
-    eraPn00a(obs->tt, DJM0, &dpsi, &deps, &epsa, rb, rp, rbp, rn, rbpn);
-    mat3_mul(rn, rp, obs->rnp);
+    eraPn00a(tt, DJM0, &dpsi, &deps, &epsa, rb, rp, rbp, rn, rbpn);
+    mat3_mul(rn, rp, rnp);
+}
+
+static void compute_astrom(const observer_t *obs, double utc1, double utc2,
+                           eraASTROM *astrom, double *eo)
+{
+    eraApco13(utc1, utc2, 0,
+            obs->elong, obs->phi,
+            obs->hm,
+            0, 0,
+            obs->refraction ? obs->pressure : 0,
+            15,       // Temperature (dec C)
+            0.5,      // Relative humidity (0-1)
+            0.55,     // Effective color (micron),
+            astrom,
+            eo);
+}
+
+/*
+ * Time between two interpolation knots (day) for the observer max error.
+ *
+ * The linear interpolation of the nutation gives an error of about
+ * A * (w * h)^2 / 8, where the fastest significant term has an amplitude
+ * A of 0.2 arcsec and a period of 13.66 days.  The cubic interpolation of
+ * the earth position gives an error of about h^4 / 384 times its fourth
+ * derivative, mostly due to the orbit and the Moon wobble.  We bound the
+ * later for an object at 0.3 AU.
+ */
+static double get_interp_step(const observer_t *obs)
+{
+    const double amp = 0.2 * ERFA_DAS2R, w = 2 * M_PI / 13.66;
+    const double wy = 2 * M_PI / 365.25, wm = 2 * M_PI / 27.32;
+    const double k = pow(wy, 4) + pow(wm, 4) * 3.1e-5;
+    double h1, h2;
+    h1 = sqrt(8 * obs->interp_max_error / amp) / w;
+    h2 = pow(384 * obs->interp_max_error * 0.3 / k, 0.25);
+    return clamp(min(h1, h2), 1.0 / 24, 30.0);
+}
+
+static void compute_knot(const observer_t *obs, double tt,
+                         observer_knot_t *knot)
+{
+    double tai1, tai2, utc1, utc2;
+    eraTttai(DJM0, tt, &tai1, &tai2);
+    eraTaiutc(tai1, tai2, &utc1, &utc2);
+    compute_astrom(obs, utc1, utc2, &knot->astrom, &knot->eo);
+    eraEpv00(DJM0, tt, knot->earth_pvh, knot->earth_pvb);
+    compute_nutation_precession_mat(tt, knot->rnp);
+    knot->tt = tt;
+}
+
+// Cubic Hermite interpolation of a position and speed.
+static void hermite_pv(const double a[2][3], const double b[2][3], double h,
+                       double u, double out[2][3])
+{
+    int i;
+    double u2 = u * u, u3 = u2 * u;
+    for (i = 0; i < 3; i++) {
+        out[0][i] = (2 * u3 - 3 * u2 + 1) * a[0][i] +
+                    (u3 - 2 * u2 + u) * h * a[1][i] +
+                    (-2 * u3 + 3 * u2) * b[0][i] +
+                    (u3 - u2) * h * b[1][i];
+        out[1][i] = ((6 * u2 - 6 * u) * a[0][i] +
+                     (3 * u2 - 4 * u + 1) * h * a[1][i] +
+                     (-6 * u2 + 6 * u) * b[0][i] +
+                     (3 * u2 - 2 * u) * h * b[1][i]) / h;
+    }
+}
+
+/*
+ * Update the observer from values interpolated between two accurate knots.
+ *
+ * Only the slowly changing values are interpolated: the earth position,
+ * the precession-nutation and the location part of astrom.  The observer
+ * geocentric position and the earth rotation are still computed exactly.
+ */
+static void update_interpolated(observer_t *obs, uint64_t hash_partial)
+{
+    int i, j;
+    double h, t0, t, u, theta, pvc[2][3], bpn[3][3];
+    observer_knot_t old[2], *k = obs->knots;
+    const bool valid = obs->knots_hash == hash_partial;
+    eraASTROM astrom;
+
+    h = get_interp_step(obs);
+    t0 = floor(obs->tt / h) * h;
+    // Compute the knots, reusing the previous ones if possible.
+    if (!valid || k[0].tt != t0 || k[1].tt != t0 + h) {
+        memcpy(old, k, sizeof(old));
+        for (i = 0; i < 2; i++) {
+            t = t0 + i * h;
+            if (valid && old[0].tt == t) k[i] = old[0];
+            else if (valid && old[1].tt == t) k[i] = old[1];
+            else compute_knot(obs, t, &k[i]);
+        }
+        obs->knots_hash = hash_partial;
+    }
+
+    u = (obs->tt - t0) / h;
+    hermite_pv(k[0].earth_pvh, k[1].earth_pvh, h, u, obs->earth_pvh);
+    hermite_pv(k[0].earth_pvb, k[1].earth_pvb, h, u, obs->earth_pvb);
+    for (i = 0; i < 3; i++) for (j = 0; j < 3; j++) {
+        obs->rnp[i][j] = mix(k[0].rnp[i][j], k[1].rnp[i][j], u);
+        bpn[i][j] = mix(k[0].astrom.bpn[i][j], k[1].astrom.bpn[i][j], u);
+    }
+    obs->eo = mix(k[0].eo, k[1].eo, u);
+
+    // Same as eraApco, with the observer position from the current time.
+    astrom = k[0].astrom;
+    theta = eraEra00(DJM0, obs->ut1);
+    eraPvtob(obs->elong, obs->phi, obs->hm, 0, 0, 0, theta, pvc);
+    eraTrxpv(bpn, pvc, pvc);
+    eraApcs(DJM0, obs->tt, pvc, obs->earth_pvb, obs->earth_pvh[0], &astrom);
+    eraCr(bpn, astrom.bpn);
+    astrom.along = mix(k[0].astrom.along, k[1].astrom.along, u);
+    eraAper13(DJM0, obs->ut1, &astrom);
+    obs->astrom = astrom;
+
+    eraCp(obs->astrom.eb, obs->obs_pvb[0]);
+    vec3_mul(ERFA_DC, obs->astrom.v, obs->obs_pvb[1]);
+    eraPvmpv(obs->obs_pvb, obs->earth_pvb, obs->obs_pvg);
+}
+
+/*
+ * Update the state that depends on the view orientation, once the
+ * positions are up to date.
+ */
+static void update_view(observer_t *obs, uint64_t hash)
+{
+    double p[3];
+
+    update_view_matrices(obs);
+    update_frames_matrices(obs);
+    obs->hash = hash;
+    if (obs->hash_pos == obs->hash_pos_accurate) obs->hash_accurate = hash;
 
+    // Compute pointed at constellation, only if we moved by more than
+    // about 20 arcsec since the last search.
+    eraS2c(obs->yaw, obs->pitch, p);
+    mat3_mul_vec3(obs->rh2i, p, p);
+    if (!obs->cst[0] || vec3_dot(p, obs->cst_pos) < cos(1e-4)) {
+        find_constellation_at(p, obs->cst);
+        vec3_copy(p, obs->cst_pos);
+    }
 }
 
 void observer_update(observer_t *obs, bool fast)
 {
     double utc1, utc2, ut11, ut12, tai1, tai2;
-    double dt, dut1 = 0;
-    double p[3] = {0};
+    double dt;
+    bool interp;
 
-    uint64_t hash, hash_partial;
-    observer_compute_hash(obs, &hash_partial, &hash);
+    uint64_t hash, hash_partial, hash_pos;
+    observer_compute_hash(obs, &hash_partial, &hash_pos, &hash);
     // Check if we have computed accurate positions already
     if (hash == obs->hash_accurate)
         return;
     // Check if we have computed 'fast' positions already
     if (fast && hash == obs->hash)
         return;
+    // If only the view orientation changed, the positions are still valid.
+    if (hash_pos == obs->hash_pos &&
+            (fast || hash_pos == obs->hash_pos_accurate)) {
+        update_view(obs, hash);
+        return;
+    }
+    interp = fast && obs->interp_max_error > 0 &&
+             hash_partial == obs->hash_partial;
     fast = fast && hash_partial == obs->hash_partial &&
             fabs(obs->last_accurate_update - obs->tt) < 1.0;
 
     // Compute UT1 and UTC time.
     if (obs->last_update != obs->tt) {
         dt = deltat(obs->tt);
-        dut1 = 0;
         eraTtut1(DJM0, obs->tt, dt, &ut11, &ut12);
         eraTttai(DJM0, obs->tt, &tai1, &tai2);
         eraTaiutc(tai1, tai2, &utc1, &utc2);
@@ -158,23 +334,17 @@ void observer_update(observer_t *obs, bool fast)
         obs->utc = utc1 - DJM0 + utc2;
     }
 
-    if (fast) {
+    if (interp) {
+        if (obs->last_update != obs->tt)
+            update_interpolated(obs, hash_partial);
+    } else if (fast) {
         if (obs->last_update != obs->tt) {
             eraAper13(DJM0, obs->ut1, &obs->astrom);
             eraPvu(obs->tt - obs->last_update, obs->earth_pvh, obs->earth_pvh);
             eraPvu(obs->tt - obs->last_update, obs->earth_pvb, obs->earth_pvb);
         }
     } else {
-        eraApco13(DJM0, obs->utc, dut1,
-                obs->elong, obs->phi,
-                obs->hm,
-                0, 0,
-                obs->refraction ? obs->pressure : 0,
-                15,       // Temperature (dec C)
-                0.5,      // Relative humidity (0-1)
-                0.55,     // Effective color (micron),
-                &obs->astrom,
-                &obs->eo);
+        compute_astrom(obs, DJM0, obs->utc, &obs->astrom, &obs->eo);
         // Update earth position.
         eraEpv00(DJM0, obs->tt, obs->earth_pvh, obs->earth_pvb);
         eraCp(obs->astrom.eb, obs->obs_pvb[0]);
@@ -183,7 +353,7 @@ void observer_update(observer_t *obs, bool fast)
     }
     eraPvmpv(obs->earth_pvb, obs->earth_pvh, obs->sun_pvb);
 
-    if (fast && obs->last_update != obs->tt) {
+    if (!interp && fast && obs->last_update != obs->tt) {
         // Update observer geocentric position obs_pvg. We can't use eraPvu here
         // as the movement is a rotation about the earth center and can't
         // be approximated by a linear velocity  on a 24h time span
@@ -202,7 +372,11 @@ void observer_update(observer_t *obs, bool fast)
     }
 
     update_matrices(obs);
-    if (!fast) update_nutation_precession_mat(obs);
+    if (obs->refraction_table.pressure != obs->pressure ||
+            obs->refraction_table.temperature != 15.0) {
+        refraction_table_prepare(&obs->refraction_table, obs->pressure, 15.0);
+    }
+    if (!fast && !interp) compute_nutation_precession_mat(obs->tt, obs->rnp);
 
     // Compute sun's apparent position in observer reference frame
     eraPvmpv(obs->sun_pvb, obs->obs_pvb, obs->sun_pvo);
@@ -211,24 +385,22 @@ void observer_update(observer_t *obs, bool fast)
 
     obs->last_update = obs->tt;
     obs->hash_partial = hash_partial;
-    obs->hash = hash;
-    if (!fast) {
-        obs->hash_accurate = hash;
+    obs->hash_pos = hash_pos;
+    if (!fast && !interp) {
+        obs->hash_pos_accurate = hash_pos;
         obs->last_accurate_update = obs->tt;
     }
-
-    // Compute pointed at constellation.
-    eraS2c(obs->yaw, obs->pitch, p);
-    mat3_mul_vec3(obs->rh2i, p, p);
-    find_constellation_at(p, obs->cst);
+    update_view(obs, hash);
 }
 
 static int observer_init(obj_t *obj, json_value *args)
 {
     observer_t*  obs = (observer_t*)obj;
     quat_set_identity(obs->mount_quat);
-    observer_compute_hash(obs, &obs->hash_partial, &obs->hash_accurate);
+    observer_compute_hash(obs, &obs->hash_partial, &obs->hash_pos,
+                          &obs->hash_accurate);
     obs->hash = obs->hash_accurate;
+    obs->hash_pos_accurate = obs->hash_pos;
     return 0;
 }
 
@@ -288,6 +460,8 @@ static obj_klass_t observer_klass = {
         PROPERTY(latitude, TYPE_ANGLE, MEMBER(observer_t, phi)),
         PROPERTY(elevation, TYPE_FLOAT, MEMBER(observer_t, hm)),
         PROPERTY(refraction, TYPE_BOOL, MEMBER(observer_t, refraction)),
+        PROPERTY(interp_max_error, TYPE_ANGLE,
+                 MEMBER(observer_t, interp_max_error)),
         PROPERTY(tt, TYPE_MJD, MEMBER(observer_t, tt),
                  .on_changed = observer_on_timeattr_changed),
         PROPERTY(ut1, TYPE_MJD, MEMBER(observer_t, ut1),
@@ -305,3 +479,47 @@ static obj_klass_t observer_klass = {
 };
 OBJ_REGISTER(observer_klass)
 
+
+#if COMPILE_TESTS
+
+static void test_observer_interp(void)
+{
+    observer_t *obs, *ref;
+    double t, ra, de, p1[3], p2[3], err, max_err = 0;
+    const double max_error = 1.0 * ERFA_DAS2R;
+
+    obs = (observer_t*)obj_create("observer", NULL, NULL, NULL);
+    obs->elong = 1.0;
+    obs->phi = 0.5;
+    obs->tt = 58000;
+    observer_update(obs, false);
+    ref = (observer_t*)obs->obj.klass->clone(&obs->obj);
+    obs->interp_max_error = max_error;
+
+    for (t = 58000; t < 58100; t += 0.37) {
+        obs->tt = t;
+        observer_update(obs, true);
+        ref->tt = t;
+        observer_update(ref, false);
+        // Star apparent direction.
+        eraAtciqz(1.0, 0.3, &obs->astrom, &ra, &de);
+        eraS2c(ra, de, p1);
+        eraAtciqz(1.0, 0.3, &ref->astrom, &ra, &de);
+        eraS2c(ra, de, p2);
+        max_err = max(max_err, eraSepp(p1, p2));
+        // Observer position error seen from a body at 0.3 AU.
+        err = vec3_dist(obs->obs_pvb[0], ref->obs_pvb[0]) / 0.3;
+        max_err = max(max_err, err);
+    }
+    if (max_err > max_error) {
+        LOG_E("Observer interpolation error: %g arcsec",
+              max_err * ERFA_DR2AS);
+        assert(false);
+    }
+    obj_release(&obs->obj);
+    obj_release(&ref->obj);
+}
+
+TEST_REGISTER(NULL, test_observer_interp, TEST_AUTO)
+
+#endif
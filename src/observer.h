@@ -12,6 +12,22 @@
 
 #include "obj.h"
 #include "erfa.h"
+#include "frames.h"
+#include "algos/algos.h"
+
+/*
+ * Type: observer_knot_t
+ * Accurate observer values computed at a given time, used to interpolate
+ * the fast updates.
+ */
+typedef struct observer_knot {
+    double      tt;
+    eraASTROM   astrom;
+    double      eo;
+    double      earth_pvh[2][3];
+    double      earth_pvb[2][3];
+    double      rnp[3][3];
+} observer_knot_t;
 
 /*
  * Type: observer_t
@@ -45,6 +61,12 @@ struct observer
     double view_offset_alt;
     double tt;          // TT time in MJD
 
+    // Max error (rad) allowed when interpolating the fast updates between
+    // accurate knots.  Zero to disable the interpolation.
+    double interp_max_error;
+    observer_knot_t knots[2];
+    uint64_t knots_hash; // Partial hash of the observer for the knots.
+
     double last_update;
     double last_accurate_update;
 
@@ -62,6 +84,14 @@ struct observer
     // safe to use make fast update.
     uint64_t hash_partial;
 
+    // Hash of the state that affects the objects positions, that is
+    // without the view orientation.  Used to share the positions between
+    // several views of the same frame.
+    uint64_t hash_pos;
+
+    // Value of hash_pos for which the accurate values have been computed.
+    uint64_t hash_pos_accurate;
+
     // Different times, all in MJD.
     double ut1;
     double utc;
@@ -87,6 +117,7 @@ struct observer
 
     // The pointed constellation.
     char cst[5];
+    double cst_pos[3]; // Pointed ICRF direction of the last cst search.
 
     // Frame rotation matrices.
     // h: Horizontal (RA/DE, left handed, X->N, Y->E, Z->up).
@@ -104,6 +135,14 @@ struct observer
     double ri2e[3][3];  // Equatorial J2000 (ICRF) to ecliptic.
     double re2i[3][3];  // Eclipic to Equatorial J2000 (ICRF).
     double rnp[3][3];   // Nutation/Precession rotation.
+
+    // Rotation between each pair of frames, indexed as [origin][dest],
+    // without refraction nor aberration (FRAME_ASTROM is the same as
+    // FRAME_ICRF).  See <convert_frame_fast>.
+    double rframes[FRAMES_NB][FRAMES_NB][3][3];
+
+    // Refraction lookup tables for the current pressure.
+    refraction_table_t refraction_table;
 };
 
 void observer_update(observer_t *obs, bool fast);
@@ -0,0 +1,257 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "swe.h"
+
+#define DHOUR (1.0 / 24.0)
+
+// Duration of the Moon path segments (day).  The Moon moves about 1° in
+// two hours.
+#define SEGMENT (2 * DHOUR)
+// Step used to find the min separation of a candidate (day).
+#define SCAN_STEP (DHOUR / 6)
+// Precision of the results (day).
+#define PRECISION (1.0 / 86400)
+// Max duration of an occultation (day).
+#define MAX_DURATION (2 * DHOUR)
+// Max apparent radius of the Moon (rad).
+#define MOON_MAX_RADIUS (0.28 * DD2R)
+// Margin of the cones around the path segments (rad), for the curvature
+// of the topocentric path, and the difference between the catalogs and
+// the apparent positions.
+#define PATH_MARGIN (0.5 * DD2R)
+
+typedef struct {
+    obj_t   *obj;
+    double  t0;     // Range of the segments close to the object.
+    double  t1;
+} candidate_t;
+
+typedef struct {
+    double  tt;
+    double  start;
+    double  end;
+    double  sep;
+    obj_t   *obj;
+} occultation_t;
+
+typedef struct {
+    observer_t  obs;
+    obj_t       *moon;
+    double      t0;         // Current segment.
+    double      t1;
+    candidate_t *candidates;
+    int         nb;
+    int         allocated;
+} search_t;
+
+static void update_obs(search_t *s, double tt)
+{
+    s->obs.tt = tt;
+    observer_update(&s->obs, true);
+}
+
+// Apparent direction of the Moon.
+static void get_moon_pos(search_t *s, double tt, double out[3])
+{
+    double pvo[2][4];
+    update_obs(s, tt);
+    obj_get_pvo(s->moon, &s->obs, pvo);
+    vec3_normalize(pvo[0], out);
+}
+
+// Separation between the Moon limb and an object center.
+static double get_limb_sep(search_t *s, obj_t *obj, double tt)
+{
+    double pm[2][4], po[2][4], radius;
+    update_obs(s, tt);
+    obj_get_pvo(s->moon, &s->obs, pm);
+    obj_get_pvo(obj, &s->obs, po);
+    if (obj_get_info(s->moon, &s->obs, INFO_RADIUS, &radius))
+        radius = 0;
+    return eraSepp(pm[0], po[0]) - radius;
+}
+
+static int on_candidate(void *user, obj_t *obj)
+{
+    search_t *s = user;
+    candidate_t *c;
+    int i;
+
+    if (obj->oid == s->moon->oid || obj->oid == oid_create("HORI", 399))
+        return 0;
+    // The objects close to the previous segment just extend their range.
+    for (i = s->nb - 1; i >= 0; i--) {
+        c = &s->candidates[i];
+        if (c->obj->oid != obj->oid || c->t1 < s->t0) continue;
+        c->t1 = s->t1;
+        return 0;
+    }
+    if (s->nb >= s->allocated) {
+        s->allocated = max(64, s->allocated * 2);
+        s->candidates = realloc(s->candidates,
+                                s->allocated * sizeof(*s->candidates));
+    }
+    obj->ref++;
+    s->candidates[s->nb++] = (candidate_t) {obj, s->t0, s->t1};
+    return 0;
+}
+
+// Query the objects close to each segment of the Moon path.
+static void find_candidates(search_t *s, double start, double end,
+                            double max_vmag, double max_sep)
+{
+    const char *modules[] = {"stars", "planets"};
+    double p0[3], p1[3], c[3], ra, dec, radius;
+    obj_query_t query;
+    obj_t *module;
+    int i;
+
+    get_moon_pos(s, start, p1);
+    for (s->t1 = start; s->t1 < end; ) {
+        s->t0 = s->t1;
+        s->t1 = min(s->t0 + SEGMENT, end);
+        vec3_copy(p1, p0);
+        get_moon_pos(s, s->t1, p1);
+        vec3_add(p0, p1, c);
+        eraC2s(c, &ra, &dec);
+        radius = eraSepp(p0, p1) / 2 + MOON_MAX_RADIUS + max_sep +
+                 PATH_MARGIN;
+        obj_query_init(&query, ra, dec, radius, max_vmag, NULL);
+        // Query at the middle of the segment, for the planets.
+        update_obs(s, (s->t0 + s->t1) / 2);
+        for (i = 0; i < ARRAY_SIZE(modules); i++) {
+            module = core_get_module(modules[i]);
+            if (module) module_query(module, &s->obs, &query, s,
+                                     on_candidate);
+        }
+    }
+}
+
+// Find the time at which the limb separation crosses zero, between a time
+// where it is positive and a time where it is negative.
+static double find_contact(search_t *s, obj_t *obj, double out, double in)
+{
+    double t;
+    while (fabs(in - out) > PRECISION) {
+        t = (in + out) / 2;
+        if (get_limb_sep(s, obj, t) > 0)
+            out = t;
+        else
+            in = t;
+    }
+    return (in + out) / 2;
+}
+
+/*
+ * Compute the min separation of a candidate, and the contact times if it
+ * is occulted.
+ *
+ * Return:
+ *   false if the object never gets within max_sep of the Moon limb.
+ */
+static bool refine(search_t *s, const candidate_t *c, double start,
+                   double end, double max_sep, occultation_t *out)
+{
+    const double g = (sqrt(5) - 1) / 2;
+    double t, a, b, x1, x2, f1, f2, v, best = DBL_MAX, best_t;
+
+    // Sample the separation to bracket the minimum.
+    a = max(c->t0 - SEGMENT, start);
+    b = min(c->t1 + SEGMENT, end);
+    best_t = a;
+    for (t = a; t <= b; t += SCAN_STEP) {
+        v = get_limb_sep(s, c->obj, t);
+        if (v < best) {
+            best = v;
+            best_t = t;
+        }
+    }
+
+    // Golden section search of the minimum.
+    a = max(best_t - SCAN_STEP, start);
+    b = min(best_t + SCAN_STEP, end);
+    x1 = b - g * (b - a);
+    x2 = a + g * (b - a);
+    f1 = get_limb_sep(s, c->obj, x1);
+    f2 = get_limb_sep(s, c->obj, x2);
+    while (b - a > PRECISION) {
+        if (f1 < f2) {
+            b = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = b - g * (b - a);
+            f1 = get_limb_sep(s, c->obj, x1);
+        } else {
+            a = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = a + g * (b - a);
+            f2 = get_limb_sep(s, c->obj, x2);
+        }
+    }
+    t = (a + b) / 2;
+    *out = (occultation_t) {
+        .tt = t,
+        .sep = get_limb_sep(s, c->obj, t),
+        .start = NAN,
+        .end = NAN,
+        .obj = c->obj,
+    };
+    if (out->sep > max_sep) return false;
+    if (out->sep < 0) {
+        a = t - MAX_DURATION;
+        b = t + MAX_DURATION;
+        if (get_limb_sep(s, c->obj, a) > 0)
+            out->start = find_contact(s, c->obj, a, t);
+        if (get_limb_sep(s, c->obj, b) > 0)
+            out->end = find_contact(s, c->obj, b, t);
+    }
+    return true;
+}
+
+static int occultation_cmp(const void *a, const void *b)
+{
+    return cmp(((const occultation_t*)a)->tt, ((const occultation_t*)b)->tt);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int occultations_search(const observer_t *obs, double start, double end,
+                        double max_vmag, double max_sep, void *user,
+                        int (*callback)(double tt, double start, double end,
+                                        double sep, obj_t *obj, void *user))
+{
+    search_t s = {.obs = *obs};
+    occultation_t *events;
+    int i, nb = 0;
+
+    s.moon = obj_get_by_oid(&core->obj, oid_create("HORI", 301), 0);
+    if (!s.moon) return 0;
+    // Accurate update at mid time, so that we can do fast updates after.
+    s.obs.tt = (start + end) / 2;
+    observer_update(&s.obs, false);
+
+    find_candidates(&s, start, end, max_vmag, max_sep);
+    events = calloc(s.nb, sizeof(*events));
+    for (i = 0; i < s.nb; i++) {
+        if (refine(&s, &s.candidates[i], start, end, max_sep, &events[nb]))
+            nb++;
+    }
+    qsort(events, nb, sizeof(*events), occultation_cmp);
+    for (i = 0; i < nb; i++) {
+        callback(events[i].tt, events[i].start, events[i].end,
+                 events[i].sep, events[i].obj, user);
+    }
+
+    for (i = 0; i < s.nb; i++) obj_release(s.candidates[i].obj);
+    free(s.candidates);
+    free(events);
+    obj_release(s.moon);
+    return nb;
+}
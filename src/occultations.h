@@ -0,0 +1,61 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef OCCULTATIONS_H
+#define OCCULTATIONS_H
+
+typedef struct observer observer_t;
+typedef struct obj obj_t;
+
+/*
+ * File: occultations.h
+ * Search of the occultations and close approaches of the stars and planets
+ * by the Moon.
+ */
+
+/*
+ * Function: occultations_search
+ * Find the stars and planets that pass behind or close to the Moon.
+ *
+ * Instead of checking every object at each step, we follow the Moon path
+ * by segments, and only query the objects in a cone around each segment.
+ * For the stars this only visits the few HiPS tiles along the path.  The
+ * times of the candidates are then refined with the topocentric apparent
+ * positions.
+ *
+ * The stars tiles still loading are skipped, so the result can miss some
+ * faint stars if the function is called too early.
+ *
+ * Parameters:
+ *   obs        - The observer.
+ *   start      - Start time (TT MJD).
+ *   end        - End time (TT MJD).
+ *   max_vmag   - Only consider the objects brighter than this.
+ *   max_sep    - Max separation between the Moon limb and the object
+ *                center (rad), zero to only get the occultations.
+ *   user       - Data passed to the callback.
+ *   callback   - Called for each event, sorted by time, with:
+ *                  tt    - Time of the min separation (TT MJD).
+ *                  start - Time the object goes behind the Moon limb, or
+ *                          NAN if it is not occulted.
+ *                  end   - Time the object reappears, or NAN.
+ *                  sep   - Min separation between the Moon limb and the
+ *                          object center (rad), negative for an
+ *                          occultation.
+ *                  obj   - The object.
+ *
+ * Return:
+ *   The number of events.
+ */
+int occultations_search(const observer_t *obs, double start, double end,
+                        double max_vmag, double max_sep, void *user,
+                        int (*callback)(double tt, double start, double end,
+                                        double sep, obj_t *obj, void *user));
+
+#endif // OCCULTATIONS_H
@@ -84,6 +84,61 @@ void otype_get_digits(const char *id, uint8_t out[4])
     memcpy(out, e->n, 4);
 }
 
+int otype_get_id(const char *otype)
+{
+    const entry_t *e = otype_get(otype);
+    return e ? e - ENTRIES : -1;
+}
+
+// Check if an entry digits start with the parent digits.
+static bool entry_match(const entry_t *e, const entry_t *parent)
+{
+    int i;
+    for (i = 0; i < 4 && parent->n[i]; i++) {
+        if (e->n[i] != parent->n[i]) return false;
+    }
+    return true;
+}
+
+void otype_mask_add(otype_mask_t *mask, const char *otype)
+{
+    const entry_t *e, *p;
+    p = otype_get(otype);
+    if (!p) return;
+    for (e = &ENTRIES[0]; e->id[0]; e++) {
+        if (entry_match(e, p)) otype_mask_add_id(mask, e - ENTRIES);
+    }
+}
+
+int otype_mask_parse(otype_mask_t *mask, const char *str)
+{
+    char id[4];
+    int len, ret = 0;
+
+    memset(mask, 0, sizeof(*mask));
+    while (*str) {
+        len = strcspn(str, ", ");
+        if (len > 0 && len <= 4) {
+            memset(id, 0, sizeof(id));
+            memcpy(id, str, len);
+            if (otype_get_id(id) >= 0) ret++;
+            otype_mask_add(mask, id);
+        }
+        str += len;
+        str += strspn(str, ", ");
+    }
+    return ret;
+}
+
+bool otype_match(const char *otype, const char *parent)
+{
+    const entry_t *e, *p;
+    e = otype_get(otype);
+    p = otype_get(parent);
+    if (!e || !p) return false;
+    return entry_match(e, p);
+}
+
 // STYLE-CHECK OFF
 
 // The actual database.  See 'tools/makeotype.py'.
@@ -363,3 +418,6 @@ T(17, 2, 0, 0, "Ast",   N_("Asterism"))
 
 {}
 };
+
+_Static_assert(sizeof(ENTRIES) / sizeof(ENTRIES[0]) <= OTYPE_MASK_SIZE * 64,
+               "OTYPE_MASK_SIZE too small");
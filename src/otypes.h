@@ -7,12 +7,27 @@
  * repository.
  */
 
+#ifndef OTYPES_H
+#define OTYPES_H
+
+#include <stdbool.h>
 #include <stdint.h>
 
 /*
  * Simad otype helper functions.
  */
 
+// Number of 64 bits words in an otype mask, enough for all the otypes.
+#define OTYPE_MASK_SIZE 5
+
+/*
+ * Type: otype_mask_t
+ * A set of otypes, as a bitmask of their ids.  See <otype_get_id>.
+ */
+typedef struct otype_mask {
+    uint64_t v[OTYPE_MASK_SIZE];
+} otype_mask_t;
+
 /*
  * Function: otype_get_str
  * Get long name of a given otype.
@@ -50,3 +65,76 @@ const char *otype_get_parent(const char *otype);
  *   out    - 4 bytes buffer that get the otype digits.
  */
 void otype_get_digits(const char *otype, uint8_t out[4]);
+
+/*
+ * Function: otype_match
+ * Check if an otype is equal to, or a descendant of another otype.
+ *
+ * For example otype_match("PM*", "*") returns true.
+ *
+ * Parameters:
+ *   otype  - An otype condensed id string.
+ *   parent - An otype condensed id string.
+ */
+bool otype_match(const char *otype, const char *parent);
+
+/*
+ * Function: otype_get_id
+ * Return the compact integer id of an otype.
+ *
+ * The ids are small integers, so that we can resolve the type of each
+ * source once at load time and then use <otype_mask_t> masks.
+ *
+ * Parameters:
+ *   otype  - An otype condensed id string (e.g '**').  Can be shorter than
+ *            4 bytes.  Doesn't have to be NULL terminated if exactly 4 bytes.
+ *
+ * Return:
+ *   The id, or -1 if the otype doesn't exists.
+ */
+int otype_get_id(const char *otype);
+
+/*
+ * Function: otype_mask_add
+ * Add an otype and all its descendants to a mask.
+ *
+ * Once done, testing an id against the mask is equivalent to calling
+ * <otype_match> with the otype as parent.
+ */
+void otype_mask_add(otype_mask_t *mask, const char *otype);
+
+/*
+ * Function: otype_mask_parse
+ * Set a mask from a list of otypes and their descendants.
+ *
+ * Parameters:
+ *   mask   - The mask to set.
+ *   str    - Comma or space separated condensed ids, e.g. 'G, GlC'.
+ *
+ * Return:
+ *   The number of valid otypes in the list.
+ */
+int otype_mask_parse(otype_mask_t *mask, const char *str);
+
+static inline void otype_mask_add_id(otype_mask_t *mask, int id)
+{
+    if (id < 0) return;
+    mask->v[id / 64] |= 1ULL << (id % 64);
+}
+
+static inline bool otype_mask_test(const otype_mask_t *mask, int id)
+{
+    return id >= 0 && (mask->v[id / 64] & (1ULL << (id % 64)));
+}
+
+static inline bool otype_mask_intersects(const otype_mask_t *a,
+                                         const otype_mask_t *b)
+{
+    int i;
+    for (i = 0; i < OTYPE_MASK_SIZE; i++) {
+        if (a->v[i] & b->v[i]) return true;
+    }
+    return false;
+}
+
+#endif // OTYPES_H
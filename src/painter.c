@@ -15,6 +15,34 @@
 
 static bool g_debug = false;
 
+// Direct mapped cache of the healpix tiles clipping tests, shared by all the
+// modules and kept between frames as long as the view doesn't change.
+#define CLIP_CACHE_SIZE (1 << 13)
+
+typedef struct {
+    uint32_t    gen;    // Generation of the entry, 0 for empty.
+    uint32_t    pix;
+    uint8_t     order;
+    uint8_t     frame;
+    uint8_t     flags;  // outside | hide below horizon << 1.
+    bool        clipped;
+} clip_cache_item_t;
+
+static struct {
+    uint32_t            gen;
+    const observer_t    *obs;
+    uint64_t            obs_hash;
+    const projection_t  *proj_ptr;
+    projection_t        proj;
+    clip_cache_item_t   items[CLIP_CACHE_SIZE];
+} *g_clip_cache = NULL;
+
+// Altitude of the terrain per azimuth bin.  See painter_set_horizon_mask.
+static struct {
+    int     nb;
+    double  *alts;
+} g_horizon_mask = {};
+
 #define REND(rend, f, ...) do { \
         if ((rend)->f) (rend)->f((rend), ##__VA_ARGS__); \
     } while (0)
@@ -124,10 +152,28 @@ static void compute_sky_cap(const observer_t *obs, int frame, double cap[4])
 void painter_update_clip_info(painter_t *painter)
 {
     int i;
+    typeof(g_clip_cache) cache;
+
     for (i = 0; i < FRAMES_NB ; ++i) {
         compute_viewport_cap(painter, i);
         compute_sky_cap(painter->obs, i, painter->clip_info[i].sky_cap);
     }
+
+    // Invalidate the clipping cache if the view changed.
+    if (!g_clip_cache) g_clip_cache = calloc(1, sizeof(*g_clip_cache));
+    cache = g_clip_cache;
+    if (painter->transform != &mat4_identity) return;
+    if (cache->gen && cache->obs == painter->obs &&
+            cache->obs_hash == painter->obs->hash &&
+            memcmp(&cache->proj, painter->proj, sizeof(cache->proj)) == 0) {
+        cache->proj_ptr = painter->proj;
+        return;
+    }
+    cache->gen++;
+    cache->obs = painter->obs;
+    cache->obs_hash = painter->obs->hash;
+    cache->proj = *painter->proj;
+    cache->proj_ptr = painter->proj;
 }
 
 int paint_prepare(painter_t *painter, double win_w, double win_h,
@@ -139,7 +185,6 @@ int paint_prepare(painter_t *painter, double win_w, double win_h,
 
     for (i = 0; i < ARRAY_SIZE(painter->textures); i++)
         mat3_set_identity(painter->textures[i].mat);
-    areas_clear_all(core->areas);
 
     cull_flipped = (bool)(painter->proj->flags & PROJ_FLIP_HORIZONTAL) !=
                    (bool)(painter->proj->flags & PROJ_FLIP_VERTICAL);
@@ -154,6 +199,59 @@ int paint_finish(const painter_t *painter)
     return 0;
 }
 
+int paint_barrier(const painter_t *painter)
+{
+    REND(painter->rend, barrier);
+    return 0;
+}
+
+bool paint_layer_capture(const painter_t *painter)
+{
+    if (!painter->rend->layer_capture) return false;
+    return painter->rend->layer_capture(painter->rend);
+}
+
+bool paint_layer_draw(const painter_t *painter)
+{
+    if (!painter->rend->layer_draw) return false;
+    return painter->rend->layer_draw(painter->rend);
+}
+
+bool paint_scaled_begin(const painter_t *painter, double scale)
+{
+    if (!painter->rend->scaled_begin) return false;
+    return painter->rend->scaled_begin(painter->rend, scale);
+}
+
+void paint_scaled_end(const painter_t *painter)
+{
+    REND(painter->rend, scaled_end);
+}
+
+void paint_set_viewport(const painter_t *painter, const double rect[4])
+{
+    REND(painter->rend, viewport, rect);
+}
+
+void paint_cubemap_face(const painter_t *painter, int face)
+{
+    REND(painter->rend, cubemap_face, face);
+}
+
+void paint_cubemap_warp(const painter_t *painter,
+                        const double faces[6][3][3])
+{
+    const projection_t *proj = painter->proj;
+    double scale[2];
+
+    assert(proj->type == PROJ_FISHEYE);
+    scale[0] = proj->scaling[0];
+    scale[1] = proj->scaling[1];
+    if (proj->flags & PROJ_FLIP_HORIZONTAL) scale[0] = -scale[0];
+    if (proj->flags & PROJ_FLIP_VERTICAL) scale[1] = -scale[1];
+    REND(painter->rend, cubemap_warp, scale, faces);
+}
+
 /*
  * Set the current painter texture.
  *
@@ -182,6 +280,19 @@ int paint_2d_points(const painter_t *painter, int n, const point_t *points)
     return 0;
 }
 
+int paint_3d_points(const painter_t *painter, int frame,
+                    uint64_t id, int version, int size,
+                    const float (*pos)[3], const float *vmag,
+                    const uint8_t (*colors)[4], int n)
+{
+    PROFILE(paint_3d_points, PROFILE_AGGREGATE);
+    if (!painter->rend->points_3d) return -1;
+    if (!painter->rend->points_3d(painter->rend, painter, frame, id, version,
+                                  size, pos, vmag, colors, n))
+        return -1;
+    return 0;
+}
+
 int paint_quad(const painter_t *painter,
                int frame,
                const uv_map_t *map,
@@ -238,6 +349,19 @@ int paint_texture(const painter_t *painter,
 }
 
 
+// Project a uv mapped line point into window space.
+static void line_project(const painter_t *painter, int frame,
+                         const double p[4], double out[2])
+{
+    double pos[4];
+    mat4_mul_vec4(*painter->transform, p, pos);
+    vec3_normalize(pos, pos);
+    convert_frame(painter->obs, frame, FRAME_VIEW, true, pos, pos);
+    pos[3] = 0.0;
+    project(painter->proj, PROJ_ALREADY_NORMALIZED | PROJ_TO_WINDOW_SPACE, 2,
+            pos, out);
+}
+
 static void line_func(void *user, double t, double out[2])
 {
     double pos[4];
@@ -248,12 +372,95 @@ static void line_func(void *user, double t, double out[2])
 
     vec4_mix(line[0], line[1], t, pos);
     if (map) uv_map(map, pos, pos);
-    mat4_mul_vec4(*painter->transform, pos, pos);
-    vec3_normalize(pos, pos);
-    convert_frame(painter->obs, frame, FRAME_VIEW, true, pos, pos);
-    pos[3] = 0.0;
-    project(painter->proj, PROJ_ALREADY_NORMALIZED | PROJ_TO_WINDOW_SPACE, 2,
-            pos, out);
+    line_project(painter, frame, pos, out);
+}
+
+/*
+ * Cache of the lines tesselation.
+ *
+ * For each line we keep the uv mapped positions of the tesselated points,
+ * so that at each frame we only need to convert and project them.  The
+ * adaptive tesselation depends on the projection, so in that case the
+ * projection type and scale are part of the key.  Lines using a map with
+ * user data cannot be cached, since we cannot compare the data, and lines
+ * without a map are cheap enough to compute directly.
+ */
+#define LINES_CACHE_SIZE (4 * (1 << 20))
+
+typedef struct {
+    int         frame;
+    int         split;
+    int         proj_type;
+    int         proj_scale;     // log2 of the scale in 1/4 steps.
+    double      line[2][4];
+    void        (*map)(const uv_map_t *t, const double v[2], double out[4]);
+    int         map_type;
+    int         map_order;
+    int         map_pix;
+    int         map_flags;
+    double      map_mat[4][4];
+} line_key_t;
+
+typedef struct {
+    int         size;
+    double      (*pos)[4];
+} line_points_t;
+
+static cache_t *g_lines_cache = NULL;
+
+static int line_points_del(void *data)
+{
+    line_points_t *points = data;
+    free(points->pos);
+    free(points);
+    return 0;
+}
+
+static const line_points_t *get_line_points(
+        const painter_t *painter, int frame, double line[2][4],
+        const uv_map_t *map, int split)
+{
+    line_key_t key;
+    line_points_t *points;
+    double (*win_line)[2], *ts;
+    int i;
+
+    if (!map || map->user) return NULL;
+    memset(&key, 0, sizeof(key));
+    key.frame = frame;
+    key.split = split;
+    memcpy(key.line, line, sizeof(key.line));
+    key.map = map->map;
+    key.map_type = map->type;
+    key.map_order = map->order;
+    key.map_pix = map->pix;
+    key.map_flags = map->swapped | map->at_infinity << 1;
+    memcpy(key.map_mat, map->mat4, sizeof(key.map_mat));
+    if (!split) {
+        key.proj_type = painter->proj->type;
+        key.proj_scale = (int)floor(4 * log2(
+                painter->proj->scaling[0] / painter->proj->window_size[0]));
+    }
+
+    if (!g_lines_cache) g_lines_cache = cache_create(LINES_CACHE_SIZE);
+    points = cache_get(g_lines_cache, &key, sizeof(key));
+    if (points) return points;
+
+    points = calloc(1, sizeof(*points));
+    points->size = line_tesselate(line_func,
+                                  USER_PASS(painter, &frame, line, map),
+                                  split, &win_line, &ts);
+    free(win_line);
+    points->pos = malloc(points->size * sizeof(*points->pos));
+    for (i = 0; i < points->size; i++) {
+        vec4_mix(line[0], line[1], ts[i], points->pos[i]);
+        uv_map(map, points->pos[i], points->pos[i]);
+    }
+    free(ts);
+    cache_add(g_lines_cache, &key, sizeof(key), points,
+              sizeof(*points) + points->size * sizeof(*points->pos),
+              line_points_del);
+    return points;
 }
 
 static int paint_line(const painter_t *painter,
@@ -262,8 +469,9 @@ static int paint_line(const painter_t *painter,
                       int split, int flags)
 {
     int r, i, size;
-    double view_pos[2][4];
-    double (*win_line)[2];
+    double view_pos[2][4], pos[4];
+    double (*win_line)[2], (*view_line)[3];
+    const line_points_t *points;
 
     assert((flags & PAINTER_SKIP_DISCONTINUOUS) == flags);
     if (    (flags & PAINTER_SKIP_DISCONTINUOUS) &&
@@ -286,10 +494,26 @@ static int paint_line(const painter_t *painter,
             return r;
         }
     }
-    size = line_tesselate(line_func, USER_PASS(painter, &frame, line, map),
-                          split, &win_line);
-    REND(painter->rend, line, painter, win_line, size);
-    free(win_line);
+
+    points = get_line_points(painter, frame, line, map, split);
+    if (!points) {
+        size = line_tesselate(line_func, USER_PASS(painter, &frame, line, map),
+                              split, &win_line, NULL);
+        REND(painter->rend, line, painter, win_line, size);
+        free(win_line);
+        return 0;
+    }
+
+    win_line = core_frame_alloc(points->size * sizeof(*win_line));
+    view_line = core_frame_alloc(points->size * sizeof(*view_line));
+    for (i = 0; i < points->size; i++) {
+        mat4_mul_vec4(*painter->transform, points->pos[i], pos);
+        vec3_normalize(pos, pos);
+        convert_frame(painter->obs, frame, FRAME_VIEW, true, pos,
+                      view_line[i]);
+    }
+    project_n(painter->proj, points->size, view_line, win_line, NULL);
+    REND(painter->rend, line, painter, win_line, points->size);
     return 0;
 }
 
@@ -325,7 +549,7 @@ int paint_lines(const painter_t *painter,
  *   oid            - If set, add the mesh in the render shape areas so that
  *                    we can select this mesh.
  */
-int paint_mesh(const painter_t *painter_,
+int paint_mesh(const painter_t *painter,
                int frame,
                int mode,
                int verts_count,
@@ -334,6 +558,22 @@ int paint_mesh(const painter_t *painter_,
                const uint16_t indices[],
                const double bounding_cap[4],
                uint64_t oid)
+{
+    return paint_mesh_retained(painter, frame, mode, 0, 0, verts_count, verts,
+                               indices_count, indices, bounding_cap, oid);
+}
+
+int paint_mesh_retained(const painter_t *painter_,
+                        int frame,
+                        int mode,
+                        uint64_t id,
+                        int version,
+                        int verts_count,
+                        const double verts[][3],
+                        int indices_count,
+                        const uint16_t indices[],
+                        const double bounding_cap[4],
+                        uint64_t oid)
 {
     painter_t painter = *painter_;
 
@@ -363,7 +603,7 @@ int paint_mesh(const painter_t *painter_,
     */
 
     REND(painter.rend, mesh, &painter, frame, mode,
-         verts_count, verts, indices_count, indices, oid);
+         verts_count, verts, indices_count, indices, oid, id, version);
     return 0;
 
 }
@@ -373,6 +613,48 @@ void paint_debug(bool value)
     g_debug = value;
 }
 
+void painter_set_horizon_mask(int nb, const double *alts)
+{
+    if (nb == g_horizon_mask.nb && (!nb || memcmp(alts, g_horizon_mask.alts,
+                                                  nb * sizeof(*alts)) == 0))
+        return;
+    free(g_horizon_mask.alts);
+    g_horizon_mask.alts = NULL;
+    g_horizon_mask.nb = nb;
+    if (nb) {
+        g_horizon_mask.alts = malloc(nb * sizeof(*alts));
+        memcpy(g_horizon_mask.alts, alts, nb * sizeof(*alts));
+    }
+    // The cached tiles clipping tests are not valid anymore.
+    if (g_clip_cache) g_clip_cache->gen++;
+}
+
+// Test if a cap is fully behind the terrain of the horizon mask.
+static bool is_cap_below_horizon_mask(const painter_t *painter, int frame,
+                                      const double cap[4])
+{
+    const int nb = g_horizon_mask.nb;
+    double v[3], az, alt, r, daz;
+    int i, start, end;
+
+    if (!nb || cap[3] <= 0) return false;
+    convert_frame(painter->obs, frame, FRAME_OBSERVED, true, cap, v);
+    eraC2s(v, &az, &alt);
+    r = acos(cap[3]);
+    // The cap contains the zenith or the nadir.
+    if (cos(alt) <= sin(r)) return false;
+    // Azimuth range of the cap.
+    daz = asin(sin(r) / cos(alt));
+    az = eraAnp(az);
+    start = floor((az - daz) / (2 * M_PI) * nb);
+    end = floor((az + daz) / (2 * M_PI) * nb);
+    for (i = start; i <= end; i++) {
+        if (alt + r >= g_horizon_mask.alts[(i % nb + nb) % nb])
+            return false;
+    }
+    return true;
+}
+
 bool painter_is_cap_clipped(const painter_t *painter, int frame,
                             const double cap[4])
 {
@@ -396,6 +678,9 @@ bool painter_is_cap_clipped(const painter_t *painter, int frame,
             }
         }
     }
+    if ((painter->flags & PAINTER_HIDE_BELOW_HORIZON) &&
+            is_cap_below_horizon_mask(painter, frame, cap))
+        return true;
     return false;
 }
 
@@ -421,6 +706,9 @@ bool painter_is_point_clipped_fast(const painter_t *painter, int frame,
             }
         }
     }
+    if ((painter->flags & PAINTER_HIDE_BELOW_HORIZON) &&
+            is_cap_below_horizon_mask(painter, frame, VEC(v[0], v[1], v[2], 1)))
+        return true;
     return false;
 }
 
@@ -438,8 +726,13 @@ bool painter_is_2d_circle_clipped(const painter_t *painter, const double p[2],
     return !intersect_circle_rect(rect, p, radius);
 }
 
-bool painter_is_quad_clipped(const painter_t *painter, int frame,
-                             const uv_map_t *map, bool outside)
+/*
+ * Same as painter_is_quad_clipped, but we can pass the bounding cap of the
+ * quad if we already know it.
+ */
+static bool is_quad_clipped(const painter_t *painter, int frame,
+                            const uv_map_t *map, bool outside,
+                            const double cap[4])
 {
     double corners[4][4];
     double quad[4][4], normal[4];
@@ -450,7 +743,10 @@ bool painter_is_quad_clipped(const painter_t *painter, int frame,
     int order = map->order;
 
     if (outside) {
-        uv_map_get_bounding_cap(map, bounding_cap);
+        if (cap)
+            vec4_copy(cap, bounding_cap);
+        else
+            uv_map_get_bounding_cap(map, bounding_cap);
         mat4_mul_vec3_dir(*painter->transform, bounding_cap, bounding_cap);
         assert(vec3_is_normalized(bounding_cap));
         if (painter_is_cap_clipped(painter, frame, bounding_cap))
@@ -466,8 +762,8 @@ bool painter_is_quad_clipped(const painter_t *painter, int frame,
         assert(!outside);
         uv_map_subdivide(map, children);
         for (i = 0; i < 4; i++) {
-            if (!painter_is_quad_clipped(
-                        painter, frame, &children[i], outside))
+            if (!is_quad_clipped(painter, frame, &children[i], outside,
+                                 NULL))
                 return false;
         }
         return true;
@@ -513,12 +809,98 @@ bool painter_is_quad_clipped(const painter_t *painter, int frame,
     return false;
 }
 
+bool painter_is_quad_clipped(const painter_t *painter, int frame,
+                             const uv_map_t *map, bool outside)
+{
+    return is_quad_clipped(painter, frame, map, outside, NULL);
+}
+
+/*
+ * Bounding caps of the healpix tiles up to HEALPIX_CAPS_MAX_ORDER.
+ *
+ * The caps of an order are allocated the first time we need one of them,
+ * and each cap is computed the first time it's used (until then its cosine
+ * is set to a value above one).  For order 6 this takes 1.5 MiB.
+ */
+#define HEALPIX_CAPS_MAX_ORDER 6
+static double (*g_healpix_caps[HEALPIX_CAPS_MAX_ORDER + 1])[4];
+
+static const double *get_healpix_cap(int order, int pix)
+{
+    int i, nb;
+    double *cap;
+    if (order > HEALPIX_CAPS_MAX_ORDER) return NULL;
+    if (!g_healpix_caps[order]) {
+        nb = 12 << (2 * order);
+        g_healpix_caps[order] = malloc(nb * sizeof(*g_healpix_caps[order]));
+        for (i = 0; i < nb; i++) g_healpix_caps[order][i][3] = 2;
+    }
+    cap = g_healpix_caps[order][pix];
+    if (cap[3] > 1) healpix_get_bounding_cap(1 << order, pix, cap);
+    return cap;
+}
+
+// Return the clipping cache entry for a tile, or NULL if the painter
+// doesn't use the cached view.
+static clip_cache_item_t *get_clip_cache_item(
+        const painter_t *painter, int frame, int order, int pix, int flags)
+{
+    uint32_t h;
+    typeof(g_clip_cache) cache = g_clip_cache;
+
+    if (!cache || !cache->gen) return NULL;
+    if (painter->transform != &mat4_identity) return NULL;
+    if (painter->obs != cache->obs || painter->proj != cache->proj_ptr)
+        return NULL;
+    if (painter->obs->hash != cache->obs_hash) return NULL;
+    h = (uint32_t)pix * 2654435761u;
+    h ^= (order * 31 + frame) * 0x9e3779b9u + flags;
+    return &cache->items[(h ^ (h >> 15)) % CLIP_CACHE_SIZE];
+}
+
 bool painter_is_healpix_clipped(const painter_t *painter, int frame,
                                 int order, int pix, bool outside)
 {
     uv_map_t map;
+    clip_cache_item_t *item;
+    int flags;
+    bool ret;
+
+    flags = (outside ? 1 : 0) |
+            ((painter->flags & PAINTER_HIDE_BELOW_HORIZON) ? 2 : 0);
+    item = get_clip_cache_item(painter, frame, order, pix, flags);
+    if (item && item->gen == g_clip_cache->gen && item->pix == pix &&
+            item->order == order && item->frame == frame &&
+            item->flags == flags)
+        return item->clipped;
+
     uv_map_init_healpix(&map, order, pix, false, false);
-    return painter_is_quad_clipped(painter, frame, &map, outside);
+    ret = is_quad_clipped(painter, frame, &map, outside,
+                          outside ? get_healpix_cap(order, pix) : NULL);
+    if (item) {
+        *item = (clip_cache_item_t) {
+            .gen = g_clip_cache->gen, .pix = pix, .order = order,
+            .frame = frame, .flags = flags, .clipped = ret,
+        };
+    }
+    return ret;
+}
+
+double painter_get_healpix_priority(const painter_t *painter, int frame,
+                                    int order, int pix, bool outside)
+{
+    uv_map_t map;
+    double pos[4], sep, fov;
+    uv_map_init_healpix(&map, order, pix, false, outside);
+    uv_map(&map, VEC(0.5, 0.5), pos);
+    if (outside) mat4_mul_vec3_dir(*painter->transform, pos, pos);
+    else mat4_mul_vec4(*painter->transform, pos, pos);
+    convert_framev4(painter->obs, frame, FRAME_VIEW, pos, pos);
+    vec3_normalize(pos, pos);
+    // Angle between the tile center and the view direction (-z).
+    sep = acos(clamp(-pos[2], -1.0, 1.0));
+    fov = max(painter->proj->scaling[0], DBL_EPSILON);
+    return -order + 1.0 / (1.0 + sep / fov);
 }
 
 /* Draw the contour lines of a shape.
@@ -565,16 +947,61 @@ int paint_tile_contour(const painter_t *painter, int frame,
     return paint_quad_contour(painter, frame, &map, split, 15);
 }
 
-static void orbit_map(const uv_map_t *map, const double v[2], double out[4])
+/*
+ * Orbits paths cache.
+ *
+ * In the orbital plane, an elliptic orbit is an affine transformation of
+ * the unit circle parametrized by the eccentric anomaly E:
+ *
+ *   x = a (cos(E) - e), y = a sqrt(1 - e²) sin(E)
+ *
+ * So we only cache the (cos(E), sin(E)) samples, that only depend on the
+ * eccentricity, and at each frame we transform them with a single matrix
+ * built from the elements.  The eccentricity is quantized, so that
+ * osculating elements that slightly change at each frame still hit the
+ * cache: this only affects the sampling, the points are always exactly on
+ * the orbit.
+ */
+#define ORBITS_CACHE_SIZE (256 * 1024)
+#define ORBIT_EC_STEPS 256
+#define ORBIT_SPLIT 128
+
+static cache_t *g_orbits_cache = NULL;
+
+static const line_points_t *get_orbit_points(double ec)
 {
-    const double *o = map->user;
-    double pos[4];
-    double period = 2 * M_PI / o[5]; // Period in day.
-    double mjd = o[0] + period * v[0];
-    orbit_compute_pv(0, mjd, pos, NULL,
-                     o[0], o[1], o[2], o[3], o[4], o[5], o[6], o[7], 0.0, 0.0);
-    vec3_copy(pos, out);
-    out[3] = 1.0; // AU.
+    int ec_step = (int)round(ec * ORBIT_EC_STEPS);
+    int allocated = ORBIT_SPLIT * 2;
+    double e, b, de, step, ea = 0;
+    line_points_t *points;
+
+    if (!g_orbits_cache) g_orbits_cache = cache_create(ORBITS_CACHE_SIZE);
+    points = cache_get(g_orbits_cache, &ec_step, sizeof(ec_step));
+    if (points) return points;
+
+    e = (double)ec_step / ORBIT_EC_STEPS;
+    b = sqrt(1 - e * e);
+    points = calloc(1, sizeof(*points));
+    points->pos = malloc(allocated * sizeof(*points->pos));
+    // Adaptive sampling: the tangent turns by b / (1 - e² cos²(E)) per
+    // unit of E, so we take smaller steps near the perihelion to keep
+    // the same angle between all the segments.
+    step = 2 * M_PI / ORBIT_SPLIT;
+    while (true) {
+        if (points->size >= allocated) {
+            allocated *= 2;
+            points->pos = realloc(points->pos,
+                                  allocated * sizeof(*points->pos));
+        }
+        vec4_set(points->pos[points->size++], cos(ea), sin(ea), 0, 1);
+        if (ea >= 2 * M_PI) break;
+        de = min(step, step * (1 - e * e * cos(ea) * cos(ea)) / b);
+        ea = min(ea + de, 2 * M_PI);
+    }
+    cache_add(g_orbits_cache, &ec_step, sizeof(ec_step), points,
+              sizeof(*points) + points->size * sizeof(*points->pos),
+              line_points_del);
+    return points;
 }
 
 /*
@@ -603,15 +1030,36 @@ int paint_orbit(const painter_t *painter, int frame,
                 double k_ec,      // Eccentricity.
                 double k_ma)      // Mean Anomaly (rad).
 {
-    const double orbit[8] = {k_jd, k_in, k_om, k_w, k_a, k_n, k_ec, k_ma};
-    uv_map_t map = {
-        .map        = orbit_map,
-        .user       = (void*)orbit,
-    };
-    double line[2][4] = {{0}, {1}};
+    const line_points_t *points;
+    double mat[4][4], pos[4], (*view_line)[3], (*win_line)[2];
+    int i;
+
     // We only support ICRF for the moment to make things simpler.
     assert(frame == FRAME_ICRF);
-    paint_line(painter, frame, line, &map, 128, 1);
+    // Only elliptic orbits can be drawn as closed paths.
+    if (!(k_ec >= 0 && k_ec < 1)) return 0;
+    points = get_orbit_points(k_ec);
+
+    // Orbital plane to frame matrix.  The position along the orbit doesn't
+    // change the path, so the epoch, daily motion and mean anomaly are not
+    // used.
+    mat4_copy(*painter->transform, mat);
+    mat4_rz(k_om, mat, mat);
+    mat4_rx(k_in, mat, mat);
+    mat4_rz(k_w, mat, mat);
+    mat4_itranslate(mat, -k_a * k_ec, 0, 0);
+    mat4_iscale(mat, k_a, k_a * sqrt(1 - k_ec * k_ec), 1);
+
+    win_line = core_frame_alloc(points->size * sizeof(*win_line));
+    view_line = core_frame_alloc(points->size * sizeof(*view_line));
+    for (i = 0; i < points->size; i++) {
+        mat4_mul_vec4(mat, points->pos[i], pos);
+        vec3_normalize(pos, view_line[i]);
+    }
+    convert_frame_n(painter->obs, frame, FRAME_VIEW, true, points->size,
+                    view_line[0], view_line[0], 0);
+    project_n(painter->proj, points->size, view_line, win_line, NULL);
+    REND(painter->rend, line, painter, win_line, points->size);
     return 0;
 }
 
@@ -826,6 +1274,70 @@ bool painter_project(const painter_t *painter, int frame,
                    PROJ_TO_WINDOW_SPACE, 2, v, win_pos);
 }
 
+// Compute the rotation from a frame to the view frame for points at
+// infinity, not including the FRAME_ASTROM to FRAME_ICRF conversion.
+// Return false if the conversion is not linear (with refraction).
+static bool get_frame_to_view_matrix(const observer_t *obs, int frame,
+                                     double mat[3][3])
+{
+    if (frame < FRAME_OBSERVED && obs->refraction) return false;
+    mat3_copy(obs->rframes[frame][FRAME_VIEW], mat);
+    return true;
+}
+
+int painter_project_n(const painter_t *painter, int frame, int n,
+                      const double (*pos)[3], double (*win_pos)[2],
+                      bool *visible)
+{
+    PROFILE(painter_project_n, PROFILE_AGGREGATE);
+    const observer_t *obs = painter->obs ?: core->observer;
+    double mat[3][3], (*v)[3];
+    bool linear, *projected;
+    int i, nb = 0;
+
+    assert(mat4_is_identity(*painter->transform)); // Not supported yet.
+    if (n <= 0) return 0;
+    v = core_frame_alloc(n * sizeof(*v));
+    projected = core_frame_alloc(n * sizeof(*projected));
+    linear = get_frame_to_view_matrix(obs, frame, mat);
+
+    // Each step is done in a separate loop over all the points, so that the
+    // compiler can vectorize the simple ones.
+    for (i = 0; i < n; i++)
+        visible[i] = !painter_is_point_clipped_fast(painter, frame, pos[i],
+                                                    true);
+    if (!linear) {
+        for (i = 0; i < n; i++) {
+            if (visible[i])
+                convert_frame(obs, frame, FRAME_VIEW, true, pos[i], v[i]);
+            else
+                vec3_copy(pos[i], v[i]);
+        }
+    } else {
+        memcpy(v, pos, n * sizeof(*v));
+        if (frame == FRAME_ASTROM) {
+            for (i = 0; i < n; i++) {
+                if (visible[i]) astrometric_to_apparent(obs, v[i], true, v[i]);
+            }
+        }
+        for (i = 0; i < n; i++) mat3_mul_vec3(mat, v[i], v[i]);
+    }
+    project_n(painter->proj, n, v, win_pos, projected);
+    for (i = 0; i < n; i++) {
+        visible[i] = visible[i] && projected[i];
+        nb += visible[i];
+    }
+    return nb;
+}
+
+bool painter_get_frame_to_view_matrix(const painter_t *painter, int frame,
+                                      double mat[3][3])
+{
+    const observer_t *obs = painter->obs ?: core->observer;
+    if (frame == FRAME_ASTROM) return false;
+    return get_frame_to_view_matrix(obs, frame, mat);
+}
+
 bool painter_unproject(const painter_t *painter, int frame,
                      const double win_pos[2], double pos[3]) {
     double p[4];
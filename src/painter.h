@@ -21,6 +21,7 @@ typedef struct renderer renderer_t;
 typedef struct painter painter_t;
 typedef struct point point_t;
 typedef struct texture texture_t;
+typedef struct _json_value json_value;
 
 // Base font size in pixels
 #define FONT_SIZE_BASE 15
@@ -65,12 +66,55 @@ struct renderer
                     double win_w, double win_h, double scale,
                     bool cull_flipped);
     void (*finish)(renderer_t *rend);
+    // Optional: prevent the renderer from reordering the items painted
+    // after this call before the items painted before.
+    void (*barrier)(renderer_t *rend);
+    // Optional: render the items painted so far into an offscreen layer,
+    // and draw it.  Return false if not supported.
+    bool (*layer_capture)(renderer_t *rend);
+    // Optional: draw the last captured layer.  Return false if there is
+    // none of the current frame buffer size.
+    bool (*layer_draw)(renderer_t *rend);
+    // Optional: render the items painted so far, and render the next ones
+    // at a fraction of the frame buffer resolution, until scaled_end.
+    // Return false if not supported.
+    bool (*scaled_begin)(renderer_t *rend, double scale);
+    // Render the items painted since scaled_begin, and draw them upscaled
+    // on the frame buffer.
+    void (*scaled_end)(renderer_t *rend);
+    // Optional: render the items painted so far, and render the next ones
+    // into a rectangle of the window (x, y, w, h with the origin at the
+    // top left, in window pixels).
+    void (*viewport)(renderer_t *rend, const double rect[4]);
+    // Optional: allocate the offscreen cube map used to render the dome,
+    // with faces of up to a given size (px).  Return the actual size of
+    // the faces, or zero if not supported.
+    int (*cubemap_init)(renderer_t *rend, int size);
+    // Render the items painted so far, and render the next ones into a
+    // face (0 to 5) of the cube map.
+    void (*cubemap_face)(renderer_t *rend, int face);
+    // Render the last face, and draw the cube map on the whole frame
+    // buffer with the fisheye projection.
+    void (*cubemap_warp)(renderer_t *rend, const double scale[2],
+                         const double faces[6][3][3]);
 
     void (*points_2d)(renderer_t        *rend,
                    const painter_t      *painter,
                    int                  n,
                    const point_t        *points);
 
+    // Optional: return false if the points cannot be rendered this way.
+    bool (*points_3d)(renderer_t        *rend,
+                      const painter_t   *painter,
+                      int               frame,
+                      uint64_t          buf_id,
+                      int               buf_version,
+                      int               size,
+                      const float       (*pos)[3],
+                      const float       *vmag,
+                      const uint8_t     (*colors)[4],
+                      int               n);
+
     void (*quad)(renderer_t          *rend,
                  const painter_t     *painter,
                  int                 frame,
@@ -115,7 +159,9 @@ struct renderer
                  const double        verts[][3],
                  int                 indices_count,
                  const uint16_t      indices[],
-                 uint64_t            oid);
+                 uint64_t            oid,
+                 uint64_t            buf_id,     // 0 if not retained.
+                 int                 buf_version);
 
     void (*ellipse_2d)(renderer_t       *rend,
                        const painter_t  *painter,
@@ -133,11 +179,81 @@ struct renderer
                     const painter_t     *painter,
                     const double        p1[2],
                     const double        p2[2]);
+
+    // Optional: return the rendering statistics of the last frame as json.
+    json_value *(*get_stats)(renderer_t *rend);
+
+    // Optional: forget the selectable meshes kept for the picking.
+    void (*pick_clear)(renderer_t *rend);
+    // Optional: render the selectable meshes kept since the last
+    // pick_clear into an offscreen id buffer around a window position, and
+    // get the oid of the closest one.  Return false if there is none.
+    bool (*pick)(renderer_t *rend, const double pos[2], double max_dist,
+                 uint64_t *oid);
 };
 
 renderer_t* render_gl_create(void);
 renderer_t* render_svg_create(const char *out);
 
+/*
+ * Function: render_capture_create
+ * Create a renderer that forwards all the calls to an other one, and that
+ * can save all the calls of a frame into a file.
+ *
+ * See <render_capture_frame>.
+ */
+renderer_t *render_capture_create(renderer_t *rend);
+
+/*
+ * Function: render_capture_frame
+ * Save all the calls of the next frame into a file.
+ *
+ * The file can then be replayed with <render_capture_replay>, by the
+ * same build only.
+ *
+ * Parameters:
+ *   rend   - A renderer created with <render_capture_create>.
+ *   path   - The output file.
+ */
+void render_capture_frame(renderer_t *rend, const char *path);
+
+/*
+ * Type: render_capture_t
+ * A frame captured by a <render_capture_create> renderer.
+ */
+typedef struct render_capture render_capture_t;
+
+/*
+ * Function: render_capture_load
+ * Load a captured frame.  Return NULL in case of error.
+ */
+render_capture_t *render_capture_load(const char *path);
+
+/*
+ * Function: render_capture_get_size
+ * Get the window size and pixel scale of a captured frame.
+ */
+void render_capture_get_size(const render_capture_t *cap,
+                             int win_size[2], double *scale);
+
+/*
+ * Function: render_capture_replay
+ * Issue all the calls of a captured frame to a renderer.
+ *
+ * The textures are replaced by blank textures of the same size, created
+ * the first time and reused by the next replays.
+ *
+ * Return:
+ *   0 on success, -1 if the capture is invalid.
+ */
+int render_capture_replay(render_capture_t *cap, renderer_t *rend);
+
+/*
+ * Function: render_capture_delete
+ * Release a captured frame and its textures.
+ */
+void render_capture_delete(render_capture_t *cap);
+
 
 struct point
 {
@@ -197,6 +313,10 @@ struct painter
     double          lines_glow;
     // Point halo / core ratio (zero for no halo).
     double          points_halo;
+    // Quality reduction in [0, 1] set by the core adaptive quality
+    // controller, 0 for full quality.  The modules use it to lower their
+    // tiles order, grid splits and number of items.
+    double          degrade;
     double          (*depth_range)[2]; // If set use depth test.
 
     struct {
@@ -205,6 +325,10 @@ struct painter
         double mat[3][3];
     } textures[2];
 
+    // Optional painter for the view we expect in a few hundred ms, if we
+    // are moving.  Only used to prefetch the tiles.
+    const painter_t *prefetch;
+
     struct {
         // Viewport caps for fast clipping test.
         double bounding_cap[4];
@@ -238,9 +362,12 @@ struct painter
             //   Ay, By, Cy, Dy, Ey, ky,
             float p[12];
             float sun[3]; // Sun position.
-            // Callback to compute the luminosity at a given point.
-            float (*compute_lum)(void *user, const float pos[3]);
-            void *user;
+            float moon[3]; // Moon position.
+            // The skybrightness model terms (see skybrightness_t):
+            //   b_night_term, K, b_moon_term, C3, b_twilight_term, C4,
+            // followed by the luminance scale and the max cosine of the
+            // distance to the sun and moon.
+            float sb[8];
         } atm;
     };
 };
@@ -249,6 +376,108 @@ int paint_prepare(painter_t *painter, double win_w, double win_h,
                   double scale);
 int paint_finish(const painter_t *painter);
 
+/*
+ * Function: paint_barrier
+ * Make sure that everything painted before is rendered before what we
+ * paint next.
+ *
+ * The renderer is free to reorder the items painted between two barriers
+ * to reduce the number of draw calls.
+ */
+int paint_barrier(const painter_t *painter);
+
+/*
+ * Function: paint_layer_capture
+ * Render everything painted so far into the renderer static layer.
+ *
+ * The layer is drawn in place of the painted items, and it can be drawn
+ * again in the next frames with <paint_layer_draw>, without painting its
+ * content again.
+ *
+ * Return:
+ *   False if the renderer doesn't support layers.  In that case the items
+ *   are kept and rendered normally.
+ */
+bool paint_layer_capture(const painter_t *painter);
+
+/*
+ * Function: paint_layer_draw
+ * Draw the last layer captured with <paint_layer_capture>.
+ *
+ * Return:
+ *   False if there is no layer of the current frame buffer size.
+ */
+bool paint_layer_draw(const painter_t *painter);
+
+/*
+ * Function: paint_scaled_begin
+ * Render what we paint next at a lower resolution.
+ *
+ * Used to make the frames cheaper while the view moves fast.  The items
+ * keep the same sizes in window pixels, only the number of rendered pixels
+ * changes.  Should be called before anything else is painted, since the
+ * result of <paint_scaled_end> replaces the frame buffer content.
+ *
+ * Parameters:
+ *   painter    - A painter struct.
+ *   scale      - Fraction of the frame buffer resolution, in (0, 1].
+ *
+ * Return:
+ *   False if the renderer doesn't support it.  In that case the items are
+ *   rendered normally, and <paint_scaled_end> should not be called.
+ */
+bool paint_scaled_begin(const painter_t *painter, double scale);
+
+/*
+ * Function: paint_scaled_end
+ * Draw everything painted since <paint_scaled_begin> upscaled on the
+ * window, and go back to the full resolution.
+ */
+void paint_scaled_end(const painter_t *painter);
+
+/*
+ * Function: paint_set_viewport
+ * Render what we paint next into a part of the window.
+ *
+ * Everything painted before is rendered first, so that several views can
+ * be rendered in the same frame, between a single <paint_prepare> and
+ * <paint_finish>.  The painter fb_size and projection should match the
+ * viewport size.
+ *
+ * Parameters:
+ *   painter    - A painter struct.
+ *   rect       - The viewport (x, y, w, h) in window pixels, with the
+ *                origin at the top left of the window.
+ */
+void paint_set_viewport(const painter_t *painter, const double rect[4]);
+
+/*
+ * Function: paint_cubemap_face
+ * Render what we paint next into a face of the renderer cube map.
+ *
+ * Used to render the fisheye projection of a dome: each face is rendered
+ * with a cheap 90° perspective projection, then <paint_cubemap_warp>
+ * draws them in a single pass.  The renderer cube map must have been
+ * allocated with its cubemap_init method.
+ *
+ * Parameters:
+ *   painter    - A painter struct, with the projection of the face.
+ *   face       - Index of the face (0 to 5).
+ */
+void paint_cubemap_face(const painter_t *painter, int face);
+
+/*
+ * Function: paint_cubemap_warp
+ * Draw the cube map faces on the whole window with the painter projection.
+ *
+ * Parameters:
+ *   painter    - A painter struct, with the fisheye projection.
+ *   faces      - Rotation from the painter view frame to the view frame of
+ *                each face.
+ */
+void paint_cubemap_warp(const painter_t *painter,
+                        const double faces[6][3][3]);
+
 /*
  * Set the current painter texture.
  *
@@ -274,6 +503,40 @@ void painter_set_texture(painter_t *painter, int slot, texture_t *tex,
  */
 int paint_2d_points(const painter_t *painter, int n, const point_t *points);
 
+/* Function: paint_3d_points
+ *
+ * Render a list of star-like points at infinity.
+ *
+ * Contrary to <paint_2d_points>, the projection and the computation of the
+ * points radius and luminance from their magnitudes are done by the
+ * renderer.  The points data is retained by the renderer across frames, and
+ * only uploaded again if the version changes.
+ *
+ * The points don't get added to the shape areas, so the caller has to do
+ * it for the points that can be selected.
+ *
+ * Parameters:
+ *  painter       - The painter.
+ *  frame         - Frame of the points positions.
+ *  id            - Uniq id of the points data, must never be reused for
+ *                  different data.
+ *  version       - Must be changed each time the points data changes.
+ *  size          - The number of points in the arrays.
+ *  pos           - The points normalized positions.
+ *  vmag          - The points magnitudes.
+ *  colors        - The points colors.
+ *  n             - The number of points to render, starting from the
+ *                  first one.
+ *
+ * Return:
+ *  0 on success, or -1 if the renderer doesn't support it with the current
+ *  painter, in which case the caller has to use <paint_2d_points> instead.
+ */
+int paint_3d_points(const painter_t *painter, int frame,
+                    uint64_t id, int version, int size,
+                    const float (*pos)[3], const float *vmag,
+                    const uint8_t (*colors)[4], int n);
+
 /*
  * Function: paint_quad
  *
@@ -369,6 +632,33 @@ int paint_mesh(const painter_t *painter,
                const double bounding_cap[4],
                uint64_t oid);
 
+/*
+ * Function: paint_mesh_retained
+ * Render a 3d mesh whose data stays the same between frames.
+ *
+ * Same as <paint_mesh>, but the renderer can keep the vertex and index
+ * buffers on the GPU across frames, and only upload them again when the
+ * version changes.
+ *
+ * Parameters:
+ *   id             - Uniq id of the mesh data, must never be reused for a
+ *                    different mesh.
+ *   version        - Must be changed each time the mesh data changes.
+ *
+ * For the other parameters, see <paint_mesh>.
+ */
+int paint_mesh_retained(const painter_t *painter,
+                        int frame,
+                        int mode,
+                        uint64_t id,
+                        int version,
+                        int vert_count,
+                        const double verts[][3],
+                        int indices_count,
+                        const uint16_t indices[],
+                        const double bounding_cap[4],
+                        uint64_t oid);
+
 
 int paint_text_bounds(const painter_t *painter, const char *text,
                       const double pos[2], int align, int effects,
@@ -446,9 +736,31 @@ bool painter_is_quad_clipped(const painter_t *painter, int frame,
 //  A clipped tile is guaranteed to be not visible, but it is not guaranteed
 //  that a non visible tile is clipped.  So this function can return false
 //  even though a tile is not actually visible.
+//
+//  For outside tiles, if the painter has the PAINTER_HIDE_BELOW_HORIZON
+//  flag, the tiles fully below the horizon are also clipped, so that the
+//  traversals never visit nor request them.
 bool painter_is_healpix_clipped(const painter_t *painter, int frame,
                                 int order, int pix, bool outside);
 
+/*
+ * Function: painter_get_healpix_priority
+ * Compute the loading priority of an healpix tile.
+ *
+ * Tiles of lower order get a higher priority, and for a given order the
+ * tiles closer to the center of the screen come first.  The returned value
+ * is always between -order and -order + 1.
+ *
+ * Parameters:
+ *  painter   - The painter.
+ *  frame     - One of the <FRAME> enum frame.
+ *  order     - Healpix order.
+ *  pix       - Healpix pix.
+ *  outside   - Set whether the tile is an outside (not planet) tile.
+ */
+double painter_get_healpix_priority(const painter_t *painter, int frame,
+                                    int order, int pix, bool outside);
+
 // Function: painter_is_point_clipped_fast
 //
 // Convenience function that checks if a 3D point is visible.
@@ -517,6 +829,23 @@ bool painter_is_2d_circle_clipped(const painter_t *painter, const double p[2],
 bool painter_is_cap_clipped(const painter_t *painter, int frame,
                             const double cap[4]);
 
+/*
+ * Function: painter_set_horizon_mask
+ * Set the altitude of the opaque terrain around the observer.
+ *
+ * With the PAINTER_HIDE_BELOW_HORIZON flag, the clipping tests then also
+ * clip the caps and points that are fully below the terrain, and not only
+ * below the flat horizon.
+ *
+ * Parameters:
+ *   nb     - Number of azimuth bins, or zero to remove the mask.
+ *   alts   - Altitude in the OBSERVED frame (rad) below which the sky is
+ *            hidden, for each bin.  The bins split the longitude of the
+ *            OBSERVED frame directions (as given by eraC2s) evenly from 0
+ *            to 2π.
+ */
+void painter_set_horizon_mask(int nb, const double *alts);
+
 // Function: painter_update_caps
 //
 // Update the bounding caps for each reference frames.
@@ -647,6 +976,40 @@ void painter_project_ellipse(const painter_t *painter, int frame,
 bool painter_project(const painter_t *painter, int frame, const double pos[3],
                      bool at_inf, bool clip_first, double win_pos[2]);
 
+/*
+ * Function: painter_project_n
+ * Project a batch of points at infinity to the screen.
+ *
+ * Same as calling <painter_project> with at_inf and clip_first set for each
+ * point, but much faster for large batches, since we only compute the frame
+ * rotation once, and process the points in tight loops.
+ *
+ * Parameters:
+ *   painter    - The painter.
+ *   frame      - The frame in which the points are defined.
+ *   n          - Number of points.
+ *   pos        - The normalized points 3D coordinates.
+ *   win_pos    - Get the points positions in screen coordinates (px).
+ *   visible    - Get the visibility of each point.  If false, the
+ *                corresponding win_pos is undefined.
+ *
+ * Returns:
+ *   The number of visible points.
+ */
+int painter_project_n(const painter_t *painter, int frame, int n,
+                      const double (*pos)[3], double (*win_pos)[2],
+                      bool *visible);
+
+/*
+ * Function: painter_get_frame_to_view_matrix
+ * Get the rotation from a frame to the view frame, for points at infinity.
+ *
+ * Return false if the conversion is not a simple rotation, for example with
+ * refraction, or from FRAME_ASTROM.
+ */
+bool painter_get_frame_to_view_matrix(const painter_t *painter, int frame,
+                                      double mat[3][3]);
+
 
 /*
  * Function: painter_unproject
@@ -25,6 +25,7 @@ void proj_perspective_init(projection_t *p, double fov, double aspect);
 void proj_stereographic_init(projection_t *p, double fov, double aspect);
 void proj_mercator_init(projection_t *p, double fov, double aspect);
 void proj_hammer_init(projection_t *p, double fov, double aspect);
+void proj_fisheye_init(projection_t *p, double fov, double aspect);
 
 void proj_stereographic_compute_fov(double fov, double aspect,
                                     double *fovx, double *fovy);
@@ -32,6 +33,8 @@ void proj_mercator_compute_fov(double fov, double aspect,
                                double *fovx, double *fovy);
 void proj_hammer_compute_fov(double fov, double aspect,
                              double *fovx, double *fovy);
+void proj_fisheye_compute_fov(double fov, double aspect,
+                              double *fovx, double *fovy);
 
 void projection_compute_fovs(int type, double fov, double aspect,
                              double *fovx, double *fovy)
@@ -46,6 +49,9 @@ void projection_compute_fovs(int type, double fov, double aspect,
         case PROJ_HAMMER:
             proj_hammer_compute_fov(fov, aspect, fovx, fovy);
             break;
+        case PROJ_FISHEYE:
+            proj_fisheye_compute_fov(fov, aspect, fovx, fovy);
+            break;
         default:
             assert(false);
     }
@@ -71,6 +77,9 @@ void projection_init(projection_t *p, int type, double fov,
         case PROJ_HAMMER:
             proj_hammer_init(p, fov, aspect);
             break;
+        case PROJ_FISHEYE:
+            proj_fisheye_init(p, fov, aspect);
+            break;
         default:
             assert(false);
     }
@@ -118,6 +127,50 @@ bool project(const projection_t *proj, int flags, int out_dim,
     return visible;
 }
 
+// Size of the blocks of points we project at once in project_n.
+#define PROJECT_N_BLOCK 256
+
+int project_n(const projection_t *proj, int n, const double (*v)[3],
+              double (*out)[2], bool *visible)
+{
+    PROFILE(project_n, PROFILE_AGGREGATE);
+    double p[PROJECT_N_BLOCK][4], w, fx, fy;
+    const double sx = proj->window_size[0] / 2,
+                 sy = proj->window_size[1] / 2;
+    int i, k, nb, ret = 0;
+    bool vis;
+
+    assert(!(proj->flags & PROJ_NO_CLIP));
+    fx = (proj->flags & PROJ_FLIP_HORIZONTAL) ? -1 : +1;
+    fy = (proj->flags & PROJ_FLIP_VERTICAL) ? -1 : +1;
+
+    for (k = 0; k < n; k += PROJECT_N_BLOCK) {
+        nb = n - k < PROJECT_N_BLOCK ? n - k : PROJECT_N_BLOCK;
+        for (i = 0; i < nb; i++) {
+            p[i][0] = p[i][1] = p[i][2] = 0;
+            p[i][3] = 1;
+        }
+        if (proj->project_n) {
+            proj->project_n(proj, nb, v + k, p);
+        } else {
+            for (i = 0; i < nb; i++)
+                proj->project(proj, PROJ_ALREADY_NORMALIZED, v[k + i], p[i]);
+        }
+        for (i = 0; i < nb; i++) {
+            w = p[i][3];
+            vis = (p[i][0] >= -w && p[i][0] <= +w &&
+                   p[i][1] >= -w && p[i][1] <= +w &&
+                   p[i][2] >= -w && p[i][2] <= +w);
+            if (w) w = 1.0 / w; else w = 1.0;
+            out[k + i][0] = (+fx * p[i][0] * w + 1) * sx;
+            out[k + i][1] = (-fy * p[i][1] * w + 1) * sy;
+            if (visible) visible[k + i] = vis;
+            ret += vis;
+        }
+    }
+    return ret;
+}
+
 // n can be 2 (for a line) or 4 (for a quad).
 int projection_intersect_discontinuity(const projection_t *proj,
                                         double (*pos)[4], int n)
@@ -151,8 +204,45 @@ static void test_projs(void)
     project(&proj, PROJ_BACKWARD, 4, b, c);
     vec3_normalize(a, b);
     assert(vec2_dist(c, b) < 0.0001);
+
+    // The fisheye can project points behind the viewer.
+    projection_init(&proj, PROJ_FISHEYE, 360 * DD2R, 1, 1);
+    vec3_normalize(VEC(1, 0, 1), a);
+    project(&proj, 0, 3, a, b);
+    assert(fabs(b[0] - 0.75) < 0.0001 && fabs(b[1]) < 0.0001);
+    project(&proj, PROJ_BACKWARD, 4, b, c);
+    assert(vec3_dist(c, a) < 0.0001);
+}
+
+// Check that project_n gives the same results as project.
+static void test_project_n(void)
+{
+    const int types[] = {PROJ_PERSPECTIVE, PROJ_STEREOGRAPHIC,
+                         PROJ_MERCATOR, PROJ_HAMMER, PROJ_FISHEYE};
+    double v[64][3], out[64][2], p[2];
+    bool visible[64], vis;
+    projection_t proj;
+    int i, t;
+
+    for (i = 0; i < 64; i++) {
+        vec3_set(v[i], sin(i * 0.7), cos(i * 0.3), -1 + (i % 7) * 0.1);
+        vec3_normalize(v[i], v[i]);
+    }
+    for (t = 0; t < 5; t++) {
+        projection_init(&proj, types[t], 90 * DD2R, 800, 600);
+        proj.flags |= (t % 2) ? PROJ_FLIP_HORIZONTAL : 0;
+        project_n(&proj, 64, v, out, visible);
+        for (i = 0; i < 64; i++) {
+            vis = project(&proj,
+                          PROJ_ALREADY_NORMALIZED | PROJ_TO_WINDOW_SPACE,
+                          2, v[i], p);
+            assert(vis == visible[i]);
+            assert(vec2_dist(p, out[i]) < 1e-6);
+        }
+    }
 }
 
 TEST_REGISTER(NULL, test_projs, TEST_AUTO);
+TEST_REGISTER(NULL, test_project_n, TEST_AUTO);
 
 #endif
@@ -23,6 +23,7 @@ enum {
     PROJ_STEREOGRAPHIC,
     PROJ_MERCATOR,
     PROJ_HAMMER,
+    PROJ_FISHEYE,
     PROJ_COUNT,
 };
 
@@ -71,6 +72,10 @@ struct projection
 
     void (*project)(const projection_t *proj, int flags,
                     const double *v, double *out);
+    // Batch version of project for normalized inputs, used by <project_n>.
+    // The outputs are initialized to (0, 0, 0, 1).
+    void (*project_n)(const projection_t *proj, int n,
+                      const double (*v)[3], double (*out)[4]);
     bool (*backward)(const projection_t *proj, int flags,
                      const double *v, double *out);
     int (*intersect_discontinuity)(const projection_t *proj,
@@ -127,6 +132,27 @@ void projection_init(projection_t *proj, int type, double fovx,
 bool project(const projection_t *proj, int flags,
              int out_dim, const double *v, double *out);
 
+/*
+ * Function: project_n
+ * Project an array of normalized view vectors into window coordinates
+ *
+ * Same as calling <project> with the PROJ_ALREADY_NORMALIZED and
+ * PROJ_TO_WINDOW_SPACE flags on each vector, but the projection kernel is
+ * only selected once for the whole array.
+ *
+ * Parameters:
+ *   proj    - A projection.
+ *   n       - Number of vectors.
+ *   v       - Input normalized vectors in view frame.
+ *   out     - Output window coordinates.
+ *   visible - Optional output visibility of each point.
+ *
+ * Return:
+ *   The number of visible points.
+ */
+int project_n(const projection_t *proj, int n, const double (*v)[3],
+              double (*out)[2], bool *visible);
+
 // n can be 2 (for a line) or 4 (for a quad).
 int projection_intersect_discontinuity(const projection_t *proj,
                                        double (*p)[4], int n);
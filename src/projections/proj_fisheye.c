@@ -0,0 +1,94 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "projection.h"
+#include "utils/vec.h"
+
+/* Degrees to radians */
+#define DD2R (1.745329251994329576923691e-2)
+
+/*
+ * Azimuthal equidistant (fisheye) projection, as used for the dome
+ * masters.
+ *
+ * The distance to the center of the screen is proportional to the angle
+ * θ to the view direction:
+ *
+ *   x' = θ * x / sin(θ)
+ *   y' = θ * y / sin(θ)
+ *
+ * It can show the full sphere, the only discontinuity being the point
+ * opposite to the view direction (0, 0, 1).
+ */
+
+static void proj_fisheye_project(
+        const projection_t *proj, int flags, const double *v, double *out)
+{
+    double p[3], r, k;
+    vec3_copy(v, p);
+    if (!(flags & PROJ_ALREADY_NORMALIZED)) vec3_normalize(p, p);
+    r = sqrt(p[0] * p[0] + p[1] * p[1]);
+    // Discontinuity case.
+    if (r == 0 && p[2] > 0) {
+        memset(out, 0, 4 * sizeof(double));
+        return;
+    }
+    k = r ? atan2(r, -p[2]) / r : 1.0;
+    out[0] = p[0] * k / proj->scaling[0];
+    out[1] = p[1] * k / proj->scaling[1];
+    out[2] = 0.0;
+    out[3] = 1.0;
+}
+
+static void proj_fisheye_project_n(
+        const projection_t *proj, int n, const double (*v)[3],
+        double (*out)[4])
+{
+    int i;
+    for (i = 0; i < n; i++)
+        proj_fisheye_project(proj, PROJ_ALREADY_NORMALIZED, v[i], out[i]);
+}
+
+static bool proj_fisheye_backward(const projection_t *proj, int flags,
+                                  const double *v, double *out)
+{
+    double x, y, r, k;
+    x = v[0] * proj->scaling[0];
+    y = v[1] * proj->scaling[1];
+    r = sqrt(x * x + y * y);
+    k = r ? sin(r) / r : 1.0;
+    out[0] = x * k;
+    out[1] = y * k;
+    out[2] = -cos(r);
+    return r <= M_PI;
+}
+
+void proj_fisheye_compute_fov(double fov, double aspect,
+                              double *fovx, double *fovy)
+{
+    if (aspect < 1) {
+        *fovx = fov;
+        *fovy = fov / aspect;
+    } else {
+        *fovy = fov;
+        *fovx = fov * aspect;
+    }
+}
+
+void proj_fisheye_init(projection_t *p, double fovx, double aspect)
+{
+    p->name          = "fisheye";
+    p->type          = PROJ_FISHEYE;
+    p->max_fov       = 360. * DD2R;
+    p->project       = proj_fisheye_project;
+    p->project_n     = proj_fisheye_project_n;
+    p->backward      = proj_fisheye_backward;
+    p->scaling[0]    = fovx / 2;
+    p->scaling[1]    = p->scaling[0] / aspect;
+}
@@ -26,6 +26,15 @@ static void proj_hammer_project(
     out[3] = 1;
 }
 
+static void proj_hammer_project_n(
+        const projection_t *proj, int n, const double (*v)[3],
+        double (*out)[4])
+{
+    int i;
+    for (i = 0; i < n; i++)
+        proj_hammer_project(proj, PROJ_ALREADY_NORMALIZED, v[i], out[i]);
+}
+
 static bool proj_hammer_backward(const projection_t *proj, int flags,
             const double *v, double *out)
 {
@@ -85,6 +94,7 @@ void proj_hammer_init(projection_t *p, double fov, double aspect)
     p->type                      = PROJ_HAMMER;
     p->max_fov                   = 360 * DD2R;
     p->project                   = proj_hammer_project;
+    p->project_n                 = proj_hammer_project_n;
     p->backward                  = proj_hammer_backward;
     p->intersect_discontinuity   = proj_hammer_intersect_discontinuity;
     p->scaling[0]                = aspect < 1 ? fov / 2 : fov / aspect / 2;
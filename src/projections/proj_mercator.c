@@ -36,6 +36,15 @@ static void proj_mercator_project(
     vec3_copy(p, out);
 }
 
+static void proj_mercator_project_n(
+        const projection_t *proj, int n, const double (*v)[3],
+        double (*out)[4])
+{
+    int i;
+    for (i = 0; i < n; i++)
+        proj_mercator_project(proj, PROJ_ALREADY_NORMALIZED, v[i], out[i]);
+}
+
 static bool proj_mercator_backward(const projection_t *proj, int flags,
             const double *v, double *out)
 {
@@ -110,6 +119,7 @@ void proj_mercator_init(projection_t *p, double fov, double aspect)
     p->type                      = PROJ_MERCATOR;
     p->max_fov                   = 175.0 * aspect * DD2R;
     p->project                   = proj_mercator_project;
+    p->project_n                 = proj_mercator_project_n;
     p->backward                  = proj_mercator_backward;
     p->intersect_discontinuity   = proj_mercator_intersect_discontinuity;
     p->split                     = proj_mercator_split;
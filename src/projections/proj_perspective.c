@@ -20,6 +20,20 @@ static void proj_perspective_project(
     mat4_mul_vec4((void*)proj->mat, v4, out);
 }
 
+static void proj_perspective_project_n(
+        const projection_t *proj, int n, const double (*v)[3],
+        double (*out)[4])
+{
+    int i, j;
+    const double (*m)[4] = proj->mat;
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < 4; j++) {
+            out[i][j] = m[0][j] * v[i][0] + m[1][j] * v[i][1] +
+                        m[2][j] * v[i][2] + m[3][j];
+        }
+    }
+}
+
 static bool proj_perspective_backward(const projection_t *proj, int flags,
         const double *v, double *out)
 {
@@ -47,6 +61,7 @@ void proj_perspective_init(projection_t *p, double fov, double aspect)
     p->type = PROJ_PERSPECTIVE;
     p->max_fov = 120. * DD2R;
     p->project = proj_perspective_project;
+    p->project_n = proj_perspective_project_n;
     p->backward = proj_perspective_backward;
     p->scaling[0] = tan(fov / 2);
     p->scaling[1] = p->scaling[0] / aspect;
@@ -56,6 +56,24 @@ static void proj_stereographic_project(
     out[3] = 1.0; // w value.
 }
 
+static void proj_stereographic_project_n(
+        const projection_t *proj, int n, const double (*v)[3],
+        double (*out)[4])
+{
+    int i;
+    double h;
+    const double kx = 2.0 / proj->scaling[0], ky = 2.0 / proj->scaling[1];
+    for (i = 0; i < n; i++) {
+        if (v[i][2] == 1.0) { // Discontinuity case.
+            out[i][3] = 0;
+            continue;
+        }
+        h = 1.0 / (1.0 - v[i][2]);
+        out[i][0] = v[i][0] * h * kx;
+        out[i][1] = v[i][1] * h * ky;
+    }
+}
+
 static bool proj_stereographic_backward(const projection_t *proj, int flags,
                                         const double *v, double *out)
 {
@@ -88,6 +106,7 @@ void proj_stereographic_init(projection_t *p, double fovx, double aspect)
     p->type          = PROJ_STEREOGRAPHIC;
     p->max_fov       = 185. * DD2R;
     p->project       = proj_stereographic_project;
+    p->project_n     = proj_stereographic_project_n;
     p->backward      = proj_stereographic_backward;
     p->scaling[0]    = 2 * tan(fovx / 4);
     p->scaling[1]    = p->scaling[0] / aspect;
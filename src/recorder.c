@@ -0,0 +1,270 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "swe.h"
+
+#include <stdarg.h>
+
+// Number of entry points we are currently inside of.
+static int g_depth = 0;
+
+static struct {
+    FILE    *file;
+    double  start_time;
+} g_rec = {};
+
+typedef struct {
+    UT_hash_handle  hh;
+    int             update;     // Number of updates before the arrival.
+    char            url[];
+} playback_asset_t;
+
+struct playback
+{
+    char                *data;      // The lines, '\0' terminated.
+    char                *end;
+    char                *line;      // Next line to parse.
+    int                 nb_updates; // Number of updates done so far.
+    playback_asset_t    *assets;
+};
+
+static void write_line(const char *fmt, va_list ap)
+{
+    fprintf(g_rec.file, "%.6f ", sys_get_unix_time() - g_rec.start_time);
+    vfprintf(g_rec.file, fmt, ap);
+    fputc('\n', g_rec.file);
+}
+
+static void record(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    write_line(fmt, ap);
+    va_end(ap);
+}
+
+bool recorder_is_active(void)
+{
+    return g_rec.file && g_depth == 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void recorder_start(const char *path)
+{
+    const char *attrs[][2] = {
+        {"core.observer", "utc"},
+        {"core.observer", "latitude"},
+        {"core.observer", "longitude"},
+        {"core.observer", "elevation"},
+        {"core.observer", "yaw"},
+        {"core.observer", "pitch"},
+        {"core", "fov"},
+    };
+    int i;
+    obj_t *obj;
+    const attribute_t *attr;
+    json_value *val;
+
+    recorder_stop();
+    g_rec.file = fopen(path, "w");
+    if (!g_rec.file) {
+        LOG_E("Cannot open recording file %s", path);
+        return;
+    }
+    g_rec.start_time = sys_get_unix_time();
+    // Record the initial state as attributes sets.
+    for (i = 0; i < ARRAY_SIZE(attrs); i++) {
+        obj = core_get_module(attrs[i][0]);
+        attr = obj ? obj_get_attr_(obj, attrs[i][1]) : NULL;
+        if (!attr) continue;
+        val = obj_call_json(obj, attrs[i][1], NULL);
+        recorder_on_attr(obj, attr, val);
+        json_builder_free(val);
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+void recorder_stop(void)
+{
+    if (!g_rec.file) return;
+    fclose(g_rec.file);
+    g_rec.file = NULL;
+}
+
+void recorder_push(const char *fmt, ...)
+{
+    va_list ap;
+    if (fmt && recorder_is_active()) {
+        va_start(ap, fmt);
+        write_line(fmt, ap);
+        va_end(ap);
+    }
+    g_depth++;
+}
+
+void recorder_pop(void)
+{
+    assert(g_depth > 0);
+    g_depth--;
+}
+
+void recorder_on_attr(const obj_t *obj, const attribute_t *attr,
+                      const json_value *args)
+{
+    json_serialize_opts opts = {.mode = json_serialize_mode_single_line};
+    char *path, *buf;
+
+    if (!recorder_is_active() || !args) return;
+    if (!attr->is_prop || attr->type % 16 == TYPE_PTR) return;
+    if (obj == &core->obj)
+        path = strdup("core");
+    else
+        path = module_get_path(obj, &core->obj);
+    if (!path) return;
+    buf = malloc(json_measure_ex((json_value*)args, opts));
+    json_serialize_ex(buf, (json_value*)args, opts);
+    record("a %s %s %s", path, attr->name, buf);
+    free(buf);
+    free(path);
+}
+
+void recorder_on_asset(const char *url, int code)
+{
+    // Not affected by the depth, since the assets mostly arrive during the
+    // updates.
+    if (!g_rec.file) return;
+    record("l %d %s", code, url);
+}
+
+void recorder_on_render(double w, double h, double scale)
+{
+    if (!recorder_is_active()) return;
+    record("r %.17g %.17g %.17g", w, h, scale);
+}
+
+playback_t *playback_load(const char *path)
+{
+    playback_t *pb;
+    playback_asset_t *asset;
+    char *line, type;
+    int size, code, ofs, nb_updates = 0;
+    double t;
+
+    pb = calloc(1, sizeof(*pb));
+    pb->data = read_file(path, &size);
+    if (!pb->data) {
+        LOG_E("Cannot read recording %s", path);
+        free(pb);
+        return NULL;
+    }
+    pb->line = pb->data;
+    pb->end = pb->data + size;
+    for (line = pb->data; line < pb->end; line++) {
+        if (*line == '\n') *line = '\0';
+    }
+
+    // Find at which update each asset arrived.
+    for (line = pb->data; line < pb->end; line += strlen(line) + 1) {
+        if (sscanf(line, "%lf %c", &t, &type) == 2 && type == 'u')
+            nb_updates++;
+        if (sscanf(line, "%lf l %d %n", &t, &code, &ofs) != 2) continue;
+        HASH_FIND_STR(pb->assets, line + ofs, asset);
+        if (asset) continue;
+        asset = calloc(1, sizeof(*asset) + strlen(line + ofs) + 1);
+        strcpy(asset->url, line + ofs);
+        asset->update = nb_updates;
+        HASH_ADD_STR(pb->assets, url, asset);
+    }
+    return pb;
+}
+
+// Apply an attribute set line: <path> <attr> <json>.
+static void playback_attr(const char *line)
+{
+    char path[128], name[128];
+    int ofs;
+    obj_t *obj;
+    json_value *args, *ret;
+
+    if (sscanf(line, "%127s %127s %n", path, name, &ofs) != 2) return;
+    obj = core_get_module(path);
+    if (!obj) {
+        LOG_W("Playback: cannot find object %s", path);
+        return;
+    }
+    args = json_parse(line + ofs, strlen(line + ofs));
+    if (!args) return;
+    ret = obj_call_json(obj, name, args);
+    json_builder_free(ret);
+    json_value_free(args);
+}
+
+int playback_step(playback_t *pb, double v[3])
+{
+    char *line, type;
+    double t, a[4];
+    int n, ofs;
+
+    while (pb->line < pb->end) {
+        line = pb->line;
+        pb->line += strlen(line) + 1;
+        if (sscanf(line, "%lf %c %n", &t, &type, &ofs) != 2) continue;
+        line += ofs;
+        switch (type) {
+        case 'u':
+            if (sscanf(line, "%lf", &v[0]) != 1) break;
+            pb->nb_updates++;
+            return 'u';
+        case 'r':
+            if (sscanf(line, "%lf %lf %lf", &v[0], &v[1], &v[2]) != 3) break;
+            return 'r';
+        case 'm':
+            n = sscanf(line, "%lf %lf %lf %lf", &a[0], &a[1], &a[2], &a[3]);
+            if (n == 4) core_on_mouse(a[0], a[1], a[2], a[3]);
+            break;
+        case 'z':
+            n = sscanf(line, "%lf %lf %lf", &a[0], &a[1], &a[2]);
+            if (n == 3) core_on_zoom(a[0], a[1], a[2]);
+            break;
+        case 'k':
+            n = sscanf(line, "%lf %lf", &a[0], &a[1]);
+            if (n == 2) core_on_key(a[0], a[1]);
+            break;
+        case 'c':
+            n = sscanf(line, "%lf", &a[0]);
+            if (n == 1) core_on_char(a[0]);
+            break;
+        case 'a':
+            playback_attr(line);
+            break;
+        default: // The assets are handled by playback_is_asset_ready.
+            break;
+        }
+    }
+    return 0;
+}
+
+bool playback_is_asset_ready(const playback_t *pb, const char *url)
+{
+    playback_asset_t *asset;
+    HASH_FIND_STR(pb->assets, url, asset);
+    return !asset || pb->nb_updates >= asset->update;
+}
+
+void playback_delete(playback_t *pb)
+{
+    playback_asset_t *asset, *tmp;
+    if (!pb) return;
+    HASH_ITER(hh, pb->assets, asset, tmp) {
+        HASH_DEL(pb->assets, asset);
+        free(asset);
+    }
+    free(pb->data);
+    free(pb);
+}
@@ -0,0 +1,160 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdbool.h>
+
+typedef struct obj obj_t;
+typedef struct attribute attribute_t;
+typedef struct _json_value json_value;
+
+/*
+ * File: recorder.h
+ * Record the inputs of a session, so that we can play the same workload
+ * again later.
+ *
+ * The recording is a text file with one event per line, each line starting
+ * with the time since the start of the recording (sec), the event type and
+ * its arguments:
+ *
+ *   u <dt>                  - core_update call.
+ *   r <w> <h> <scale>       - core_render call.
+ *   m <id> <state> <x> <y>  - core_on_mouse call.
+ *   z <k> <x> <y>           - core_on_zoom call.
+ *   k <key> <action>        - core_on_key call.
+ *   c <char>                - core_on_char call.
+ *   a <path> <attr> <json>  - Attribute set, with the json arguments.
+ *   l <code> <url>          - An asset got its first data or error.
+ *
+ * Only the calls made from outside of the engine are recorded: the calls
+ * made while we are already inside a recorded entry point (for example
+ * the attributes set during a core_update) are not, since the playback
+ * will do them again.  The objects attributes sets are recorded from
+ * <obj_set_attr> and from the javascript calls, except for the objects
+ * pointers and the functions calls, that cannot be played back.
+ *
+ * All the functions should be called from the main thread.
+ */
+
+/*
+ * Function: recorder_start
+ * Start to record all the inputs into a file.
+ *
+ * The current observer time, location and orientation, and the core fov
+ * are recorded first, so that the playback starts from the same state.
+ */
+void recorder_start(const char *path);
+
+/*
+ * Function: recorder_stop
+ * Stop the current recording, if any.
+ */
+void recorder_stop(void);
+
+/*
+ * Function: recorder_push
+ * Mark the start of an engine entry point, and record it unless we are
+ * already inside one.
+ *
+ * Must be balanced with a call to <recorder_pop>.
+ *
+ * Parameters:
+ *   fmt    - The event line format, without the time, or NULL if the
+ *            entry point is not recorded itself.
+ */
+void recorder_push(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+/*
+ * Function: recorder_pop
+ * Mark the end of an engine entry point.
+ */
+void recorder_pop(void);
+
+/*
+ * Function: recorder_on_attr
+ * Record an attribute set, if we are recording and not inside an entry
+ * point.
+ *
+ * Parameters:
+ *   obj    - The object.
+ *   attr   - The attribute.
+ *   args   - The json arguments passed to the attribute function.
+ */
+void recorder_on_attr(const obj_t *obj, const attribute_t *attr,
+                      const json_value *args);
+
+/*
+ * Function: recorder_is_active
+ * Return true if the calls made now should be recorded.
+ *
+ * This allows to skip the arguments serialization when not needed.
+ */
+bool recorder_is_active(void);
+
+/*
+ * Function: recorder_on_render
+ * Record a core_render call.
+ */
+void recorder_on_render(double w, double h, double scale);
+
+/*
+ * Function: recorder_on_asset
+ * Record the arrival of an asset data.
+ */
+void recorder_on_asset(const char *url, int code);
+
+/*
+ * Type: playback_t
+ * A recorded session loaded for playback.
+ */
+typedef struct playback playback_t;
+
+/*
+ * Function: playback_load
+ * Load a recording.  Return NULL in case of error.
+ */
+playback_t *playback_load(const char *path);
+
+/*
+ * Function: playback_step
+ * Apply all the recorded events up to the next core update or render.
+ *
+ * The update and render calls are left to the caller, so that it can
+ * time them.
+ *
+ * Parameters:
+ *   pb     - A playback.
+ *   v      - Get the dt for an update, or the window size and pixel
+ *            scale for a render.
+ *
+ * Return:
+ *   'u' for an update, 'r' for a render, or zero at the end of the
+ *   recording.
+ */
+int playback_step(playback_t *pb, double v[3]);
+
+/*
+ * Function: playback_is_asset_ready
+ * Return whether an asset was already received at this point of the
+ * recording.
+ *
+ * The assets that never arrived during the recording are always ready.
+ */
+bool playback_is_asset_ready(const playback_t *pb, const char *url);
+
+/*
+ * Function: playback_delete
+ * Release a playback.
+ */
+void playback_delete(playback_t *pb);
+
+#endif // RECORDER_H
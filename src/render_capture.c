@@ -0,0 +1,1084 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "swe.h"
+
+#include "utils/gl.h"
+
+/*
+ * Capture and replay of the renderer calls.
+ *
+ * The capture renderer forwards all the calls to a real renderer, and when
+ * asked to, also serializes all the calls of the next frame into a file.
+ * The file can then be replayed against a renderer any number of times,
+ * without any catalog or tile loaded, so that we can profile the rendering
+ * of a given view in isolation.
+ *
+ * The file is a list of records, each starting with the record type as
+ * an int.  All the values are written in the native layout, and padded to
+ * 8 bytes so that the replay can use the arrays directly from the loaded
+ * file: the captures can only be replayed by the same build.
+ *
+ * We don't save the textures content, only their size and format: the
+ * replay uses blank textures instead, which doesn't change the rendering
+ * cost.  The quads uv maps are saved as their grid of mapped positions,
+ * except for the healpix maps that are created again from their pixel.
+ */
+
+#define CAPTURE_MAGIC 0x50414345u // 'ECAP'
+#define CAPTURE_VERSION 1
+
+enum {
+    REC_END = 0,
+    REC_PREPARE,
+    REC_FINISH,
+    REC_BARRIER,
+    REC_LAYER_CAPTURE,
+    REC_LAYER_DRAW,
+    REC_VIEWPORT,
+    REC_CUBEMAP_INIT,
+    REC_CUBEMAP_FACE,
+    REC_CUBEMAP_WARP,
+    REC_OBSERVER,
+    REC_TEXTURE_DEF,
+    REC_POINTS_2D,
+    REC_POINTS_3D,
+    REC_QUAD,
+    REC_QUAD_WIREFRAME,
+    REC_TEXTURE,
+    REC_TEXT,
+    REC_LINE,
+    REC_MESH,
+    REC_ELLIPSE_2D,
+    REC_RECT_2D,
+    REC_LINE_2D,
+    REC_SCALED_BEGIN,
+    REC_SCALED_END,
+};
+
+/*
+ * Type: painter_rec_t
+ * Serialized painter, with only the attributes used by the renderers.
+ */
+typedef struct {
+    double  color[4];
+    int     fb_size[2];
+    double  pixel_scale;
+    int     flags;
+    double  contrast;
+    double  lines_width;
+    double  lines_stripes;
+    double  lines_glow;
+    double  points_halo;
+    bool    has_transform;
+    double  transform[4][4];
+    bool    has_depth_range;
+    double  depth_range[2];
+    struct {
+        int     type;
+        int     tex; // Index of the texture, -1 for none.
+        double  mat[3][3];
+    } textures[2];
+    struct {
+        int     type;
+        int     flags;
+        double  scaling[2];
+        double  mat[4][4];
+        double  window_size[2];
+        double  max_fov;
+        int     shift;
+    } proj;
+    // Only set for the planet and ring shaders.
+    struct {
+        double  sun[4];
+        bool    has_light_emit;
+        double  light_emit[3];
+        int     shadow_spheres_nb;
+        double  shadow_spheres[4][4];
+        int     shadow_color_tex;
+        float   scale;
+    } planet;
+    // Only set for the atmosphere shader.
+    struct {
+        float   p[12];
+        float   sun[3];
+        float   moon[3];
+        float   sb[8];
+    } atm;
+} painter_rec_t;
+
+/*
+ * Type: uv_map_rec_t
+ * Serialized uv map.  For non healpix maps the record is followed by the
+ * (grid_size + 1)^2 mapped positions.
+ */
+typedef struct {
+    int         type;
+    int         order;
+    int         pix;
+    bool        swapped;
+    bool        at_infinity;
+    uint64_t    id;
+    int         version;
+} uv_map_rec_t;
+
+typedef struct {
+    renderer_t  rend;
+    renderer_t  *real;      // The renderer we forward the calls to.
+    char        *path;      // Set when the next frame should be captured.
+    FILE        *out;       // Set while we capture a frame.
+    const observer_t *obs;  // Last observer written.
+    uint64_t    obs_hash;
+    const texture_t **textures; // All the textures written so far.
+    int         nb_textures;
+    int         textures_allocated;
+} renderer_capture_t;
+
+struct render_capture
+{
+    char        *data;
+    int         size;
+    int         win_size[2];
+    double      scale;
+    observer_t  obs;
+    texture_t   **textures;
+    int         nb_textures;
+};
+
+/******** Section: Capture *********************************************/
+
+// Write some data, padded to 8 bytes.
+static void w(renderer_capture_t *rend, const void *data, size_t size)
+{
+    const uint8_t zero[8] = {};
+    fwrite(data, 1, size, rend->out);
+    if (size % 8) fwrite(zero, 1, 8 - size % 8, rend->out);
+}
+
+static void w_int(renderer_capture_t *rend, int v)
+{
+    w(rend, &v, sizeof(v));
+}
+
+static void w_double(renderer_capture_t *rend, double v)
+{
+    w(rend, &v, sizeof(v));
+}
+
+static void w_u64(renderer_capture_t *rend, uint64_t v)
+{
+    w(rend, &v, sizeof(v));
+}
+
+/*
+ * Return the index of a texture in the capture, writing its definition
+ * the first time we see it.  Return -1 for NULL.
+ */
+static int w_texture_def(renderer_capture_t *rend, const texture_t *tex)
+{
+    int i;
+    if (!tex) return -1;
+    for (i = 0; i < rend->nb_textures; i++) {
+        if (rend->textures[i] == tex) return i;
+    }
+    if (rend->nb_textures >= rend->textures_allocated) {
+        rend->textures_allocated = max(64, rend->textures_allocated * 2);
+        rend->textures = realloc(rend->textures,
+                rend->textures_allocated * sizeof(*rend->textures));
+    }
+    rend->textures[rend->nb_textures] = tex;
+    w_int(rend, REC_TEXTURE_DEF);
+    w_int(rend, rend->nb_textures);
+    w(rend, (int[]){tex->w, tex->h, tex->format, tex->flags},
+      4 * sizeof(int));
+    return rend->nb_textures++;
+}
+
+// Write the painter observer if it changed since the last call.
+static void w_observer(renderer_capture_t *rend, const painter_t *painter)
+{
+    const observer_t *obs = painter->obs ?: core->observer;
+    if (obs == rend->obs && obs->hash == rend->obs_hash) return;
+    rend->obs = obs;
+    rend->obs_hash = obs->hash;
+    w_int(rend, REC_OBSERVER);
+    w(rend, obs, sizeof(*obs));
+}
+
+/*
+ * Get the serialized version of a painter.  The observer and the textures
+ * definitions records are written if needed, so this must be called before
+ * we write the record type.
+ */
+static painter_rec_t get_painter_rec(renderer_capture_t *rend,
+                                     const painter_t *painter)
+{
+    int i;
+    painter_rec_t rec;
+
+    // Zero everything, including the padding, so that the files of two
+    // identical frames are the same.
+    memset(&rec, 0, sizeof(rec));
+    w_observer(rend, painter);
+    memcpy(rec.color, painter->color, sizeof(rec.color));
+    memcpy(rec.fb_size, painter->fb_size, sizeof(rec.fb_size));
+    rec.pixel_scale = painter->pixel_scale;
+    rec.flags = painter->flags;
+    rec.contrast = painter->contrast;
+    rec.lines_width = painter->lines_width;
+    rec.lines_stripes = painter->lines_stripes;
+    rec.lines_glow = painter->lines_glow;
+    rec.points_halo = painter->points_halo;
+    if (painter->transform) {
+        rec.has_transform = true;
+        mat4_copy(*painter->transform, rec.transform);
+    }
+    if (painter->depth_range) {
+        rec.has_depth_range = true;
+        memcpy(rec.depth_range, *painter->depth_range,
+               sizeof(rec.depth_range));
+    }
+    for (i = 0; i < 2; i++) {
+        rec.textures[i].type = painter->textures[i].type;
+        rec.textures[i].tex = w_texture_def(rend, painter->textures[i].tex);
+        mat3_copy(painter->textures[i].mat, rec.textures[i].mat);
+    }
+    if (painter->proj) {
+        rec.proj.type = painter->proj->type;
+        rec.proj.flags = painter->proj->flags;
+        memcpy(rec.proj.scaling, painter->proj->scaling,
+               sizeof(rec.proj.scaling));
+        mat4_copy(painter->proj->mat, rec.proj.mat);
+        memcpy(rec.proj.window_size, painter->proj->window_size,
+               sizeof(rec.proj.window_size));
+        rec.proj.max_fov = painter->proj->max_fov;
+        rec.proj.shift = painter->proj->shift;
+    }
+    if (painter->flags & (PAINTER_PLANET_SHADER | PAINTER_RING_SHADER)) {
+        if (painter->planet.sun)
+            vec4_copy(*painter->planet.sun, rec.planet.sun);
+        if (painter->planet.light_emit) {
+            rec.planet.has_light_emit = true;
+            vec3_copy(*painter->planet.light_emit, rec.planet.light_emit);
+        }
+        rec.planet.shadow_spheres_nb =
+            min(painter->planet.shadow_spheres_nb,
+                ARRAY_SIZE(rec.planet.shadow_spheres));
+        for (i = 0; i < rec.planet.shadow_spheres_nb; i++) {
+            vec4_copy(painter->planet.shadow_spheres[i],
+                      rec.planet.shadow_spheres[i]);
+        }
+        rec.planet.shadow_color_tex =
+            w_texture_def(rend, painter->planet.shadow_color_tex);
+        rec.planet.scale = painter->planet.scale;
+    }
+    if (painter->flags & PAINTER_ATMOSPHERE_SHADER) {
+        memcpy(rec.atm.p, painter->atm.p, sizeof(rec.atm.p));
+        memcpy(rec.atm.sun, painter->atm.sun, sizeof(rec.atm.sun));
+        memcpy(rec.atm.moon, painter->atm.moon, sizeof(rec.atm.moon));
+        memcpy(rec.atm.sb, painter->atm.sb, sizeof(rec.atm.sb));
+    }
+    return rec;
+}
+
+// Write the record type followed by the painter.
+static void w_painter_rec(renderer_capture_t *rend, int type,
+                          const painter_t *painter)
+{
+    painter_rec_t rec = get_painter_rec(rend, painter);
+    w_int(rend, type);
+    w(rend, &rec, sizeof(rec));
+}
+
+static void prepare(renderer_t *rend_, double win_w, double win_h,
+                    double scale, bool cull_flipped)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    const int header[4] = {CAPTURE_MAGIC, CAPTURE_VERSION,
+                           sizeof(observer_t), sizeof(painter_rec_t)};
+
+    if (rend->path && !rend->out) {
+        rend->out = fopen(rend->path, "wb");
+        if (!rend->out) LOG_E("Cannot open capture file %s", rend->path);
+        free(rend->path);
+        rend->path = NULL;
+        rend->obs = NULL;
+        rend->nb_textures = 0;
+        if (rend->out) {
+            w(rend, header, sizeof(header));
+            w_int(rend, REC_PREPARE);
+            w(rend, (double[]){win_w, win_h, scale}, 3 * sizeof(double));
+            w_int(rend, cull_flipped);
+        }
+    }
+    rend->real->prepare(rend->real, win_w, win_h, scale, cull_flipped);
+}
+
+static void finish(renderer_t *rend_)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    rend->real->finish(rend->real);
+    if (!rend->out) return;
+    w_int(rend, REC_FINISH);
+    w_int(rend, REC_END);
+    fclose(rend->out);
+    rend->out = NULL;
+    LOG_I("Captured frame (%d textures)", rend->nb_textures);
+}
+
+static void barrier(renderer_t *rend_)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) w_int(rend, REC_BARRIER);
+    rend->real->barrier(rend->real);
+}
+
+static bool layer_capture(renderer_t *rend_)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) w_int(rend, REC_LAYER_CAPTURE);
+    return rend->real->layer_capture(rend->real);
+}
+
+static bool layer_draw(renderer_t *rend_)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) w_int(rend, REC_LAYER_DRAW);
+    return rend->real->layer_draw(rend->real);
+}
+
+static bool scaled_begin(renderer_t *rend_, double scale)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (!rend->real->scaled_begin(rend->real, scale)) return false;
+    if (rend->out) {
+        w_int(rend, REC_SCALED_BEGIN);
+        w(rend, &scale, sizeof(scale));
+    }
+    return true;
+}
+
+static void scaled_end(renderer_t *rend_)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) w_int(rend, REC_SCALED_END);
+    rend->real->scaled_end(rend->real);
+}
+
+static void viewport(renderer_t *rend_, const double rect[4])
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) {
+        w_int(rend, REC_VIEWPORT);
+        w(rend, rect, 4 * sizeof(double));
+    }
+    rend->real->viewport(rend->real, rect);
+}
+
+static int cubemap_init(renderer_t *rend_, int size)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) {
+        w_int(rend, REC_CUBEMAP_INIT);
+        w_int(rend, size);
+    }
+    return rend->real->cubemap_init(rend->real, size);
+}
+
+static void cubemap_face(renderer_t *rend_, int face)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) {
+        w_int(rend, REC_CUBEMAP_FACE);
+        w_int(rend, face);
+    }
+    rend->real->cubemap_face(rend->real, face);
+}
+
+static void cubemap_warp(renderer_t *rend_, const double scale[2],
+                         const double faces[6][3][3])
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) {
+        w_int(rend, REC_CUBEMAP_WARP);
+        w(rend, scale, 2 * sizeof(double));
+        w(rend, faces, 6 * sizeof(*faces));
+    }
+    rend->real->cubemap_warp(rend->real, scale, faces);
+}
+
+static void points_2d(renderer_t *rend_, const painter_t *painter,
+                      int n, const point_t *points)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) {
+        w_painter_rec(rend, REC_POINTS_2D, painter);
+        w_int(rend, n);
+        w(rend, points, n * sizeof(*points));
+    }
+    rend->real->points_2d(rend->real, painter, n, points);
+}
+
+static bool points_3d(renderer_t *rend_, const painter_t *painter,
+                      int frame, uint64_t buf_id, int buf_version,
+                      int size, const float (*pos)[3], const float *vmag,
+                      const uint8_t (*colors)[4], int n)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    bool ret;
+    ret = rend->real->points_3d(rend->real, painter, frame, buf_id,
+                                buf_version, size, pos, vmag, colors, n);
+    // Only capture the points that were actually rendered this way, the
+    // others are passed again to points_2d.
+    if (rend->out && ret) {
+        w_painter_rec(rend, REC_POINTS_3D, painter);
+        w(rend, (int[]){frame, buf_version, size, n}, 4 * sizeof(int));
+        w_u64(rend, buf_id);
+        w(rend, pos, size * sizeof(*pos));
+        w(rend, vmag, size * sizeof(*vmag));
+        w(rend, colors, size * sizeof(*colors));
+    }
+    return ret;
+}
+
+static void w_quad(renderer_capture_t *rend, int type,
+                   const painter_t *painter, int frame, int grid_size,
+                   const uv_map_t *map)
+{
+    uv_map_rec_t rec = {};
+    double (*grid)[4];
+    int n = grid_size + 1;
+
+    w_painter_rec(rend, type, painter);
+    w_int(rend, frame);
+    w_int(rend, grid_size);
+    rec.type = map->type;
+    rec.order = map->order;
+    rec.pix = map->pix;
+    rec.swapped = map->swapped;
+    rec.at_infinity = map->at_infinity;
+    rec.id = map->id;
+    rec.version = map->version;
+    w(rend, &rec, sizeof(rec));
+    if (map->type == UV_MAP_HEALPIX) return;
+    grid = malloc(n * n * sizeof(*grid));
+    uv_map_grid(map, grid_size, grid);
+    w(rend, grid, n * n * sizeof(*grid));
+    free(grid);
+}
+
+static void quad(renderer_t *rend_, const painter_t *painter,
+                 int frame, int grid_size, const uv_map_t *map)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) w_quad(rend, REC_QUAD, painter, frame, grid_size, map);
+    rend->real->quad(rend->real, painter, frame, grid_size, map);
+}
+
+static void quad_wireframe(renderer_t *rend_, const painter_t *painter,
+                           int frame, int grid_size, const uv_map_t *map)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out)
+        w_quad(rend, REC_QUAD_WIREFRAME, painter, frame, grid_size, map);
+    rend->real->quad_wireframe(rend->real, painter, frame, grid_size, map);
+}
+
+static void texture(renderer_t *rend_, const texture_t *tex,
+                    double uv[4][2], const double pos[2], double size,
+                    const double color[4], double angle)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    int idx;
+    if (rend->out) {
+        idx = w_texture_def(rend, tex);
+        w_int(rend, REC_TEXTURE);
+        w_int(rend, idx);
+        w(rend, uv, 4 * sizeof(*uv));
+        w(rend, pos, 2 * sizeof(double));
+        w_double(rend, size);
+        w(rend, color, 4 * sizeof(double));
+        w_double(rend, angle);
+    }
+    rend->real->texture(rend->real, tex, uv, pos, size, color, angle);
+}
+
+static void text(renderer_t *rend_, const char *text, const double pos[2],
+                 int align, int effects, double size, const double color[4],
+                 double angle, double bounds[4])
+{
+    renderer_capture_t *rend = (void*)rend_;
+    // With the bounds set, we only compute the text size.
+    if (rend->out && !bounds) {
+        w_int(rend, REC_TEXT);
+        w_int(rend, strlen(text) + 1);
+        w(rend, text, strlen(text) + 1);
+        w(rend, pos, 2 * sizeof(double));
+        w_int(rend, align);
+        w_int(rend, effects);
+        w_double(rend, size);
+        w(rend, color, 4 * sizeof(double));
+        w_double(rend, angle);
+    }
+    rend->real->text(rend->real, text, pos, align, effects, size, color,
+                     angle, bounds);
+}
+
+static void line(renderer_t *rend_, const painter_t *painter,
+                 const double (*line)[2], int size)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) {
+        w_painter_rec(rend, REC_LINE, painter);
+        w_int(rend, size);
+        w(rend, line, size * sizeof(*line));
+    }
+    rend->real->line(rend->real, painter, line, size);
+}
+
+static void mesh(renderer_t *rend_, const painter_t *painter,
+                 int frame, int mode, int verts_count,
+                 const double verts[][3], int indices_count,
+                 const uint16_t indices[], uint64_t oid,
+                 uint64_t buf_id, int buf_version)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) {
+        w_painter_rec(rend, REC_MESH, painter);
+        w(rend, (int[]){frame, mode, verts_count, indices_count,
+                        buf_version}, 5 * sizeof(int));
+        w_u64(rend, oid);
+        w_u64(rend, buf_id);
+        w(rend, verts, verts_count * sizeof(*verts));
+        w(rend, indices, indices_count * sizeof(*indices));
+    }
+    rend->real->mesh(rend->real, painter, frame, mode, verts_count, verts,
+                     indices_count, indices, oid, buf_id, buf_version);
+}
+
+static void ellipse_2d(renderer_t *rend_, const painter_t *painter,
+                       const double pos[2], const double size[2],
+                       double angle)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) {
+        w_painter_rec(rend, REC_ELLIPSE_2D, painter);
+        w(rend, (double[]){pos[0], pos[1], size[0], size[1], angle},
+          5 * sizeof(double));
+    }
+    rend->real->ellipse_2d(rend->real, painter, pos, size, angle);
+}
+
+static void rect_2d(renderer_t *rend_, const painter_t *painter,
+                    const double pos[2], const double size[2],
+                    double angle)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) {
+        w_painter_rec(rend, REC_RECT_2D, painter);
+        w(rend, (double[]){pos[0], pos[1], size[0], size[1], angle},
+          5 * sizeof(double));
+    }
+    rend->real->rect_2d(rend->real, painter, pos, size, angle);
+}
+
+static void line_2d(renderer_t *rend_, const painter_t *painter,
+                    const double p1[2], const double p2[2])
+{
+    renderer_capture_t *rend = (void*)rend_;
+    if (rend->out) {
+        w_painter_rec(rend, REC_LINE_2D, painter);
+        w(rend, (double[]){p1[0], p1[1], p2[0], p2[1]}, 4 * sizeof(double));
+    }
+    rend->real->line_2d(rend->real, painter, p1, p2);
+}
+
+static json_value *get_stats(renderer_t *rend_)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    return rend->real->get_stats(rend->real);
+}
+
+static void pick_clear(renderer_t *rend_)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    rend->real->pick_clear(rend->real);
+}
+
+static bool pick(renderer_t *rend_, const double pos[2], double max_dist,
+                 uint64_t *oid)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    return rend->real->pick(rend->real, pos, max_dist, oid);
+}
+
+renderer_t *render_capture_create(renderer_t *real)
+{
+    renderer_capture_t *rend = calloc(1, sizeof(*rend));
+    rend->real = real;
+
+    // Only expose the optional functions supported by the real renderer.
+#define SET(f) rend->rend.f = real->f ? f : NULL
+    SET(prepare);
+    SET(finish);
+    SET(barrier);
+    SET(layer_capture);
+    SET(layer_draw);
+    SET(scaled_begin);
+    SET(scaled_end);
+    SET(viewport);
+    SET(cubemap_init);
+    SET(cubemap_face);
+    SET(cubemap_warp);
+    SET(points_2d);
+    SET(points_3d);
+    SET(quad);
+    SET(quad_wireframe);
+    SET(texture);
+    SET(text);
+    SET(line);
+    SET(mesh);
+    SET(ellipse_2d);
+    SET(rect_2d);
+    SET(line_2d);
+    SET(get_stats);
+    SET(pick_clear);
+    SET(pick);
+#undef SET
+    return &rend->rend;
+}
+
+void render_capture_frame(renderer_t *rend_, const char *path)
+{
+    renderer_capture_t *rend = (void*)rend_;
+    free(rend->path);
+    rend->path = strdup(path);
+}
+
+/******** Section: Replay **********************************************/
+
+typedef struct {
+    const char  *data;
+    int         size;
+    int         ofs;
+    bool        error;
+} reader_t;
+
+// Return a pointer to the next data in the capture, or NULL if the file
+// is too short.
+static const void *r_ptr(reader_t *r, int size)
+{
+    const void *ret;
+    if (r->error || size < 0 || size > r->size - r->ofs) {
+        r->error = true;
+        return NULL;
+    }
+    ret = r->data + r->ofs;
+    r->ofs += (size + 7) & ~7;
+    r->ofs = min(r->ofs, r->size);
+    return ret;
+}
+
+static void r(reader_t *r, void *out, int size)
+{
+    const void *p = r_ptr(r, size);
+    if (p) memcpy(out, p, size);
+    else memset(out, 0, size);
+}
+
+static int r_int(reader_t *rd)
+{
+    int v;
+    r(rd, &v, sizeof(v));
+    return v;
+}
+
+static double r_double(reader_t *rd)
+{
+    double v;
+    r(rd, &v, sizeof(v));
+    return v;
+}
+
+static uint64_t r_u64(reader_t *rd)
+{
+    uint64_t v;
+    r(rd, &v, sizeof(v));
+    return v;
+}
+
+static texture_t *get_texture(render_capture_t *cap, int idx)
+{
+    if (idx < 0 || idx >= cap->nb_textures) return NULL;
+    return cap->textures[idx];
+}
+
+static void read_texture_def(reader_t *rd, render_capture_t *cap)
+{
+    int idx, v[4], bpp;
+    uint8_t *img;
+
+    idx = r_int(rd);
+    r(rd, v, sizeof(v));
+    if (rd->error || idx < 0 || v[0] <= 0 || v[1] <= 0) {
+        rd->error = true;
+        return;
+    }
+    if (idx < cap->nb_textures && cap->textures[idx]) return;
+    if (idx >= cap->nb_textures) {
+        cap->textures = realloc(cap->textures,
+                                (idx + 1) * sizeof(*cap->textures));
+        memset(cap->textures + cap->nb_textures, 0,
+               (idx + 1 - cap->nb_textures) * sizeof(*cap->textures));
+        cap->nb_textures = idx + 1;
+    }
+    switch (v[2]) {
+    case GL_LUMINANCE:          bpp = 1; break;
+    case GL_LUMINANCE_ALPHA:    bpp = 2; break;
+    case GL_RGB:                bpp = 3; break;
+    default:                    bpp = 4; break; // Also compressed formats.
+    }
+    img = calloc(v[0] * v[1], bpp);
+    cap->textures[idx] = texture_from_data(img, v[0], v[1], bpp,
+                                           0, 0, v[0], v[1],
+                                           v[3] & TF_MIPMAP);
+    free(img);
+}
+
+/*
+ * Read a painter into a painter_t.  The painter attributes point into
+ * the record and projection, that should stay alive while the painter is
+ * used.
+ */
+static void read_painter(reader_t *rd, render_capture_t *cap,
+                         renderer_t *rend, painter_rec_t *rec,
+                         projection_t *proj, painter_t *painter)
+{
+    int i;
+
+    r(rd, rec, sizeof(*rec));
+    memset(painter, 0, sizeof(*painter));
+    if (rd->error) return;
+    painter->rend = rend;
+    painter->obs = &cap->obs;
+    memcpy(painter->color, rec->color, sizeof(rec->color));
+    memcpy(painter->fb_size, rec->fb_size, sizeof(rec->fb_size));
+    painter->pixel_scale = rec->pixel_scale;
+    painter->flags = rec->flags;
+    painter->contrast = rec->contrast;
+    painter->lines_width = rec->lines_width;
+    painter->lines_stripes = rec->lines_stripes;
+    painter->lines_glow = rec->lines_glow;
+    painter->points_halo = rec->points_halo;
+    painter->transform = rec->has_transform ? &rec->transform : NULL;
+    painter->depth_range = rec->has_depth_range ? &rec->depth_range : NULL;
+    for (i = 0; i < 2; i++) {
+        painter->textures[i].type = rec->textures[i].type;
+        painter->textures[i].tex = get_texture(cap, rec->textures[i].tex);
+        mat3_copy(rec->textures[i].mat, painter->textures[i].mat);
+    }
+
+    if (rec->proj.type <= PROJ_NULL || rec->proj.type >= PROJ_COUNT) {
+        rd->error = true;
+        return;
+    }
+    // Init the projection functions, and then set back all the values.
+    projection_init(proj, rec->proj.type, 1.0,
+                    rec->proj.window_size[0], rec->proj.window_size[1]);
+    proj->flags = rec->proj.flags;
+    memcpy(proj->scaling, rec->proj.scaling, sizeof(proj->scaling));
+    mat4_copy(rec->proj.mat, proj->mat);
+    proj->max_fov = rec->proj.max_fov;
+    proj->shift = rec->proj.shift;
+    painter->proj = proj;
+
+    if (rec->flags & (PAINTER_PLANET_SHADER | PAINTER_RING_SHADER)) {
+        painter->planet.sun = &rec->planet.sun;
+        painter->planet.light_emit = rec->planet.has_light_emit ?
+                                     &rec->planet.light_emit : NULL;
+        painter->planet.shadow_spheres_nb = rec->planet.shadow_spheres_nb;
+        painter->planet.shadow_spheres = rec->planet.shadow_spheres;
+        painter->planet.shadow_color_tex =
+            get_texture(cap, rec->planet.shadow_color_tex);
+        painter->planet.scale = rec->planet.scale;
+    }
+    if (rec->flags & PAINTER_ATMOSPHERE_SHADER) {
+        memcpy(painter->atm.p, rec->atm.p, sizeof(rec->atm.p));
+        memcpy(painter->atm.sun, rec->atm.sun, sizeof(rec->atm.sun));
+        memcpy(painter->atm.moon, rec->atm.moon, sizeof(rec->atm.moon));
+        memcpy(painter->atm.sb, rec->atm.sb, sizeof(rec->atm.sb));
+    }
+}
+
+// Map used for the non healpix quads: return the captured grid values.
+static void grid_map(const uv_map_t *map, const double v[2], double out[4])
+{
+    const double (*grid)[4] = map->user;
+    int n = map->order + 1; // We store the grid size in the order.
+    int i = round(v[1] * map->order);
+    int j = round(v[0] * map->order);
+    i = clamp(i, 0, n - 1);
+    j = clamp(j, 0, n - 1);
+    vec4_copy(grid[i * n + j], out);
+}
+
+static void read_quad(reader_t *rd, render_capture_t *cap,
+                      renderer_t *rend, bool wireframe)
+{
+    painter_rec_t rec;
+    projection_t proj;
+    painter_t painter;
+    uv_map_t map;
+    uv_map_rec_t map_rec;
+    int frame, grid_size, n;
+
+    read_painter(rd, cap, rend, &rec, &proj, &painter);
+    frame = r_int(rd);
+    grid_size = r_int(rd);
+    r(rd, &map_rec, sizeof(map_rec));
+    if (rd->error || grid_size <= 0) {
+        rd->error = true;
+        return;
+    }
+    if (map_rec.type == UV_MAP_HEALPIX) {
+        uv_map_init_healpix(&map, map_rec.order, map_rec.pix,
+                            map_rec.swapped, map_rec.at_infinity);
+    } else {
+        n = grid_size + 1;
+        memset(&map, 0, sizeof(map));
+        map.type = map_rec.type;
+        map.order = grid_size;
+        map.swapped = map_rec.swapped;
+        map.at_infinity = map_rec.at_infinity;
+        map.map = grid_map;
+        map.user = (void*)r_ptr(rd, n * n * 4 * sizeof(double));
+        if (!map.user) return;
+    }
+    map.id = map_rec.id;
+    map.version = map_rec.version;
+    if (wireframe)
+        rend->quad_wireframe(rend, &painter, frame, grid_size, &map);
+    else
+        rend->quad(rend, &painter, frame, grid_size, &map);
+}
+
+render_capture_t *render_capture_load(const char *path)
+{
+    render_capture_t *cap;
+    reader_t rd = {};
+    int header[4];
+    double v[3];
+
+    cap = calloc(1, sizeof(*cap));
+    cap->data = read_file(path, &cap->size);
+    if (!cap->data) {
+        LOG_E("Cannot read capture file %s", path);
+        goto error;
+    }
+    rd.data = cap->data;
+    rd.size = cap->size;
+    r(&rd, header, sizeof(header));
+    if (    header[0] != CAPTURE_MAGIC ||
+            header[1] != CAPTURE_VERSION ||
+            header[2] != sizeof(observer_t) ||
+            header[3] != sizeof(painter_rec_t)) {
+        LOG_E("Capture file %s not supported by this build", path);
+        goto error;
+    }
+    if (r_int(&rd) != REC_PREPARE) goto error;
+    r(&rd, v, sizeof(v));
+    cap->win_size[0] = v[0];
+    cap->win_size[1] = v[1];
+    cap->scale = v[2];
+    return cap;
+
+error:
+    render_capture_delete(cap);
+    return NULL;
+}
+
+void render_capture_get_size(const render_capture_t *cap,
+                             int win_size[2], double *scale)
+{
+    win_size[0] = cap->win_size[0];
+    win_size[1] = cap->win_size[1];
+    *scale = cap->scale;
+}
+
+int render_capture_replay(render_capture_t *cap, renderer_t *rend)
+{
+    reader_t rd = {.data = cap->data, .size = cap->size};
+    painter_rec_t rec;
+    projection_t proj;
+    painter_t painter;
+    int type, n, size, v[5];
+    bool scaled = false;
+    double d[5], uv[4][2], scale[2], color[4], angle;
+    const void *p1, *p2, *p3;
+    const char *str;
+    uint64_t id, oid;
+    texture_t *tex;
+
+    r_ptr(&rd, 4 * sizeof(int)); // Header.
+    while (!rd.error) {
+        type = r_int(&rd);
+        switch (type) {
+        case REC_END:
+            return 0;
+        case REC_PREPARE:
+            r(&rd, d, 3 * sizeof(double));
+            n = r_int(&rd);
+            rend->prepare(rend, d[0], d[1], d[2], n);
+            break;
+        case REC_FINISH:
+            rend->finish(rend);
+            break;
+        case REC_BARRIER:
+            if (rend->barrier) rend->barrier(rend);
+            break;
+        case REC_LAYER_CAPTURE:
+            if (rend->layer_capture) rend->layer_capture(rend);
+            break;
+        case REC_LAYER_DRAW:
+            if (rend->layer_draw) rend->layer_draw(rend);
+            break;
+        case REC_SCALED_BEGIN:
+            r(&rd, d, sizeof(double));
+            scaled = rend->scaled_begin && rend->scaled_begin(rend, d[0]);
+            break;
+        case REC_SCALED_END:
+            if (scaled) rend->scaled_end(rend);
+            scaled = false;
+            break;
+        case REC_VIEWPORT:
+            r(&rd, d, 4 * sizeof(double));
+            if (rend->viewport) rend->viewport(rend, d);
+            break;
+        case REC_CUBEMAP_INIT:
+            n = r_int(&rd);
+            if (rend->cubemap_init) rend->cubemap_init(rend, n);
+            break;
+        case REC_CUBEMAP_FACE:
+            n = r_int(&rd);
+            if (rend->cubemap_face) rend->cubemap_face(rend, n);
+            break;
+        case REC_CUBEMAP_WARP:
+            r(&rd, scale, sizeof(scale));
+            p1 = r_ptr(&rd, 6 * 9 * sizeof(double));
+            if (p1 && rend->cubemap_warp) rend->cubemap_warp(rend, scale, p1);
+            break;
+        case REC_OBSERVER:
+            r(&rd, &cap->obs, sizeof(cap->obs));
+            // The object part is meaningless outside of the captured core.
+            memset(&cap->obs.obj, 0, sizeof(cap->obs.obj));
+            break;
+        case REC_TEXTURE_DEF:
+            read_texture_def(&rd, cap);
+            break;
+        case REC_POINTS_2D:
+            read_painter(&rd, cap, rend, &rec, &proj, &painter);
+            n = r_int(&rd);
+            p1 = r_ptr(&rd, n * sizeof(point_t));
+            if (p1) rend->points_2d(rend, &painter, n, p1);
+            break;
+        case REC_POINTS_3D:
+            read_painter(&rd, cap, rend, &rec, &proj, &painter);
+            r(&rd, v, 4 * sizeof(int));
+            id = r_u64(&rd);
+            size = v[2];
+            p1 = r_ptr(&rd, size * 3 * sizeof(float));
+            p2 = r_ptr(&rd, size * sizeof(float));
+            p3 = r_ptr(&rd, size * 4);
+            if (p3 && rend->points_3d) {
+                rend->points_3d(rend, &painter, v[0], id, v[1], size,
+                                p1, p2, p3, v[3]);
+            }
+            break;
+        case REC_QUAD:
+        case REC_QUAD_WIREFRAME:
+            read_quad(&rd, cap, rend, type == REC_QUAD_WIREFRAME);
+            break;
+        case REC_TEXTURE:
+            tex = get_texture(cap, r_int(&rd));
+            r(&rd, uv, sizeof(uv));
+            r(&rd, d, 2 * sizeof(double));
+            d[2] = r_double(&rd);
+            r(&rd, color, sizeof(color));
+            angle = r_double(&rd);
+            if (tex && !rd.error)
+                rend->texture(rend, tex, uv, d, d[2], color, angle);
+            break;
+        case REC_TEXT:
+            n = r_int(&rd);
+            str = r_ptr(&rd, n);
+            if (!str || n <= 0 || str[n - 1] != '\0') {
+                rd.error = true;
+                break;
+            }
+            r(&rd, d, 2 * sizeof(double));
+            v[0] = r_int(&rd);
+            v[1] = r_int(&rd);
+            d[2] = r_double(&rd);
+            r(&rd, color, sizeof(color));
+            angle = r_double(&rd);
+            if (!rd.error)
+                rend->text(rend, str, d, v[0], v[1], d[2], color, angle, NULL);
+            break;
+        case REC_LINE:
+            read_painter(&rd, cap, rend, &rec, &proj, &painter);
+            n = r_int(&rd);
+            p1 = r_ptr(&rd, n * 2 * sizeof(double));
+            if (p1 && rend->line) rend->line(rend, &painter, p1, n);
+            break;
+        case REC_MESH:
+            read_painter(&rd, cap, rend, &rec, &proj, &painter);
+            r(&rd, v, 5 * sizeof(int));
+            oid = r_u64(&rd);
+            id = r_u64(&rd);
+            p1 = r_ptr(&rd, v[2] * 3 * sizeof(double));
+            p2 = r_ptr(&rd, v[3] * sizeof(uint16_t));
+            if (p2) {
+                rend->mesh(rend, &painter, v[0], v[1], v[2], p1, v[3], p2,
+                           oid, id, v[4]);
+            }
+            break;
+        case REC_ELLIPSE_2D:
+        case REC_RECT_2D:
+            read_painter(&rd, cap, rend, &rec, &proj, &painter);
+            r(&rd, d, 5 * sizeof(double));
+            if (rd.error) break;
+            if (type == REC_ELLIPSE_2D)
+                rend->ellipse_2d(rend, &painter, d, d + 2, d[4]);
+            else
+                rend->rect_2d(rend, &painter, d, d + 2, d[4]);
+            break;
+        case REC_LINE_2D:
+            read_painter(&rd, cap, rend, &rec, &proj, &painter);
+            r(&rd, d, 4 * sizeof(double));
+            if (!rd.error) rend->line_2d(rend, &painter, d, d + 2);
+            break;
+        default:
+            rd.error = true;
+            break;
+        }
+    }
+    LOG_E("Invalid capture file");
+    return -1;
+}
+
+void render_capture_delete(render_capture_t *cap)
+{
+    int i;
+    if (!cap) return;
+    for (i = 0; i < cap->nb_textures; i++)
+        texture_release(cap->textures[i]);
+    free(cap->textures);
+    free(cap->data);
+    free(cap);
+}
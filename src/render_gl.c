@@ -9,7 +9,6 @@
 
 #include "swe.h"
 
-#include "line_mesh.h"
 #include "shader_cache.h"
 #include "utils/gl.h"
 
@@ -21,6 +20,50 @@
 
 #define GRID_CACHE_SIZE (2 * (1 << 20))
 
+// Max split of the quads that use the shared grid index buffers.
+#define MAX_GRID_SPLIT 64
+
+// Number of frames after which we delete an unused retained buffer.
+#define RETAINED_BUF_MAX_AGE 60
+
+// Max number of bytes of textures data we upload per frame.
+#define TEXTURE_UPLOAD_BUDGET (8 * (1 << 20))
+
+// Number of frames of statistics we keep while waiting for the gpu timer
+// queries results.
+#define STATS_FRAMES 4
+// Max number of gpu timer queries per frame.
+#define STATS_MAX_QUERIES 64
+
+// GPU timer queries, from GL_EXT_disjoint_timer_query with OpenGL ES and
+// WebGL, or from OpenGL 3.3 / GL_ARB_timer_query on desktop.
+#if defined(GLES2) && defined(GL_EXT_disjoint_timer_query)
+#   define HAS_TIMER_QUERIES 1
+#   define TIMER_QUERIES_EXTENSION "GL_EXT_disjoint_timer_query"
+#   define GL_TIME_ELAPSED_ GL_TIME_ELAPSED_EXT
+#   define GL_QUERY_RESULT_AVAILABLE_ GL_QUERY_RESULT_AVAILABLE_EXT
+#   define GL_QUERY_RESULT_ GL_QUERY_RESULT_EXT
+#   define GL_GPU_DISJOINT_ GL_GPU_DISJOINT_EXT
+#   define glGenQueries_ glGenQueriesEXT
+#   define glBeginQuery_ glBeginQueryEXT
+#   define glEndQuery_ glEndQueryEXT
+#   define glGetQueryObjectuiv_ glGetQueryObjectuivEXT
+#   define glGetQueryObjectui64v_ glGetQueryObjectui64vEXT
+#elif !defined(GLES2) && defined(GL_TIME_ELAPSED)
+#   define HAS_TIMER_QUERIES 1
+#   define TIMER_QUERIES_EXTENSION "GL_ARB_timer_query"
+#   define GL_TIME_ELAPSED_ GL_TIME_ELAPSED
+#   define GL_QUERY_RESULT_AVAILABLE_ GL_QUERY_RESULT_AVAILABLE
+#   define GL_QUERY_RESULT_ GL_QUERY_RESULT
+#   define glGenQueries_ glGenQueries
+#   define glBeginQuery_ glBeginQuery
+#   define glEndQuery_ glEndQuery
+#   define glGetQueryObjectuiv_ glGetQueryObjectuiv
+#   define glGetQueryObjectui64v_ glGetQueryObjectui64v
+#else
+#   define HAS_TIMER_QUERIES 0
+#endif
+
 // All the shader attribute locations.
 enum {
     ATTR_POS,
@@ -30,8 +73,8 @@ enum {
     ATTR_TANGENT,
     ATTR_COLOR,
     ATTR_SKY_POS,
-    ATTR_LUMINANCE,
     ATTR_SIZE,
+    ATTR_VMAG,
 };
 
 static const char *ATTR_NAMES[] = {
@@ -42,23 +85,64 @@ static const char *ATTR_NAMES[] = {
     [ATTR_TANGENT]      = "a_tangent",
     [ATTR_COLOR]        = "a_color",
     [ATTR_SKY_POS]      = "a_sky_pos",
-    [ATTR_LUMINANCE]    = "a_luminance",
     [ATTR_SIZE]         = "a_size",
+    [ATTR_VMAG]         = "a_vmag",
     NULL,
 };
 
-// We keep all the text textures in a cache so that we don't have to recreate
-// them each time.
+// We keep all the rendered texts in a cache so that we don't have to
+// recreate them each time.  The images are packed into a shared atlas
+// texture, so that all the labels can be drawn in a single call.  Only the
+// texts too big for the atlas get their own texture.
 typedef struct tex_cache tex_cache_t;
 struct tex_cache {
-    tex_cache_t *next, *prev;
-    double      size;
-    char        *text;
-    int         effects;
+    UT_hash_handle  hh;
+    char        *key;   // Size, effects and text.
     bool        in_use;
     int         xoff;
     int         yoff;
+    int         x, y;   // Position of the text image in the texture.
+    int         w, h;   // Size of the text image.
+    texture_t   *tex;   // Either the atlas or a texture for this text only.
+};
+
+// Cached bounds of a text measured with nanovg, relative to the anchor
+// point, so that we only need to measure each text once.
+typedef struct text_metrics text_metrics_t;
+struct text_metrics {
+    UT_hash_handle  hh;
+    char        *key;   // Size, effects, align and text.
+    float       bounds[4];
+    int         frame;  // Last frame the metrics were used.
+};
+
+// Number of frames we keep the unused text metrics.
+#define TEXT_METRICS_MAX_AGE 600
+
+// Size of the text atlas texture.
+#define TEXT_ATLAS_SIZE 2048
+
+// The text atlas is filled by rows from the top, and fully reset once full.
+typedef struct text_atlas {
     texture_t   *tex;
+    int         row_x;
+    int         row_y;
+    int         row_h;
+    bool        full;
+} text_atlas_t;
+
+// Vertex and index buffers of a mesh or a list of points that we keep on the
+// GPU between frames.  The vertices are stored in their original frame, and
+// projected in the shader.
+typedef struct retained_buf retained_buf_t;
+struct retained_buf {
+    UT_hash_handle  hh;
+    uint64_t        key[2];             // Item type and id.
+    int             version;
+    GLuint          array_buffer;
+    GLuint          index_buffers[2];   // One per mesh mode.
+    int             indices_count[2];
+    int             last_used;          // Frame of the last use.
 };
 
 enum {
@@ -70,14 +154,57 @@ enum {
     ITEM_ATMOSPHERE,
     ITEM_FOG,
     ITEM_PLANET,
-    ITEM_VG_ELLIPSE,
-    ITEM_VG_RECT,
-    ITEM_VG_LINE,
     ITEM_TEXT,
     ITEM_QUAD_WIREFRAME,
     ITEM_LINES_GLOW,
+    ITEM_DOME,
+    ITEM_COUNT
 };
 
+static const char *ITEM_NAMES[] = {
+    [ITEM_LINES]            = "lines",
+    [ITEM_MESH]             = "mesh",
+    [ITEM_POINTS]           = "points",
+    [ITEM_ALPHA_TEXTURE]    = "alpha_texture",
+    [ITEM_TEXTURE]          = "texture",
+    [ITEM_ATMOSPHERE]       = "atmosphere",
+    [ITEM_FOG]              = "fog",
+    [ITEM_PLANET]           = "planet",
+    [ITEM_TEXT]             = "text",
+    [ITEM_QUAD_WIREFRAME]   = "quad_wireframe",
+    [ITEM_LINES_GLOW]       = "lines_glow",
+    [ITEM_DOME]             = "dome",
+};
+
+/*
+ * Type: frame_stats_t
+ * Rendering statistics of a frame.
+ *
+ * The gpu times are measured with timer queries around each group of items
+ * of the same type, and only read a few frames later, so that we never
+ * wait for the gpu.  All the nanovg items of a nanovg frame are drawn
+ * together when the frame ends, so they are measured as a single group.
+ */
+typedef struct {
+    struct {
+        int     draw_calls;
+        int     vertices;   // Indices count for indexed draws.
+        double  gpu_time;   // In seconds.
+    } items[ITEM_COUNT];
+    double  vg_gpu_time;    // GPU time of the nanovg frames.
+    int     tex_uploads;
+    int64_t tex_bytes;
+
+    int     frame;
+    int     nb_queries;
+#if HAS_TIMER_QUERIES
+    GLuint  queries[STATS_MAX_QUERIES];
+#endif
+    int     queries_type[STATS_MAX_QUERIES]; // Item type, or 0 for nanovg.
+    bool    query_active;
+    bool    pending;        // Set while waiting for the queries results.
+} frame_stats_t;
+
 typedef struct item item_t;
 struct item
 {
@@ -89,6 +216,17 @@ struct item
     texture_t   *tex;
     int         flags;
     float       depth_range[2];
+    bool        barrier;    // Set if a barrier was added after the item.
+    int         batch;      // Sort key for the batching, set at flush.
+
+    // Only for the items rendered from retained buffers.
+    struct {
+        const retained_buf_t *buf;
+        int   proj_type;
+        float mv[16];
+        float proj_mat[16];
+        float proj_scale[2];
+    } retained;
 
     union {
         struct {
@@ -99,6 +237,9 @@ struct item
 
         struct {
             float halo;
+            // Only for retained points.
+            int   count;
+            float aberration[3];
         } points;
 
         struct {
@@ -115,18 +256,11 @@ struct item
             float normal_tex_transf[9];
         } planet;
 
-        struct {
-            float pos[2];
-            float pos2[2];
-            float size[2];
-            float angle;
-            float dashes;
-            float stroke_width;
-        } vg;
-
         struct {
             float p[12];    // Color computation coefs.
             float sun[3];   // Sun position.
+            float moon[3];  // Moon position.
+            float sb[8];    // Luminance computation coefs.
         } atm;
 
         struct {
@@ -142,99 +276,250 @@ struct item
             int mode;
             float stroke_width;
         } mesh;
+
+        struct {
+            int   grid_split;       // If set, use the shared grid indices.
+            // Only for retained quads.
+            float tex_transf[9];    // Grid uv to texture uv.
+        } quad;
+
+        struct {
+            float scale[2];         // Fisheye scaling and flips.
+            float faces[6][9];      // Rotation from view to each face.
+            float face_uv[2];       // Size of a face in the texture uv.
+            float margin;           // Half a texel in a face uv.
+        } dome;
     };
 
     item_t *next, *prev;
 };
 
+/*
+ * Vertex layouts of the buffers.  The gl_buf_info_t below are computed from
+ * them, so that we can write the vertices directly with <gl_buf_push>
+ * instead of going through the per attribute gl_buf functions.
+ */
+
+typedef struct {
+    float       pos[2];
+} mesh_vertex_t;
+
+typedef struct {
+    float       pos[3];
+} retained_mesh_vertex_t;
+
+typedef struct {
+    float       pos[3];
+    float       vmag;
+    uint8_t     color[4];
+} retained_point_vertex_t;
+
+typedef struct {
+    float       pos[3];
+    float       tex_pos[2];
+} retained_grid_vertex_t;
+
+typedef struct {
+    float       pos[4];
+    float       tex_pos[2];
+    uint8_t     color[4];
+} line_vertex_t;
+
+// Each point of a wide line is sent twice, and moved to each side of the
+// line in the vertex shader.
+typedef struct {
+    float       pos[2];
+    float       tangent[2]; // Line direction at the point.
+    float       tex_pos[2]; // Line width and distance to the line (px).
+    uint8_t     color[4];
+} line_glow_vertex_t;
+
+typedef struct {
+    float       pos[2];
+    float       size;
+    uint8_t     color[4];
+} point_vertex_t;
+
+typedef struct {
+    float       pos[2];
+    float       tex_pos[2];
+    uint8_t     color[4];
+} texture_vertex_t;
+
+typedef struct {
+    float       pos[4];
+    float       mpos[4];
+    float       tex_pos[2];
+    uint8_t     color[4];
+    float       normal[3];
+    float       tangent[3];
+} planet_vertex_t;
+
+// Used by both the atmosphere and the fog.
+typedef struct {
+    float       pos[2];
+    float       sky_pos[3];
+} sky_vertex_t;
+
 static const gl_buf_info_t INDICES_BUF = {
-    .size = 2,
+    .size = sizeof(uint16_t),
     .attrs = {
         {GL_UNSIGNED_SHORT, 1, false, 0},
     },
 };
 
 static const gl_buf_info_t MESH_BUF = {
-    .size = 8,
+    .size = sizeof(mesh_vertex_t),
+    .attrs = {
+        [ATTR_POS] = {GL_FLOAT, 2, false, offsetof(mesh_vertex_t, pos)},
+    },
+};
+
+static const gl_buf_info_t RETAINED_MESH_BUF = {
+    .size = sizeof(retained_mesh_vertex_t),
+    .attrs = {
+        [ATTR_POS] = {GL_FLOAT, 3, false,
+                      offsetof(retained_mesh_vertex_t, pos)},
+    },
+};
+
+static const gl_buf_info_t RETAINED_POINTS_BUF = {
+    .size = sizeof(retained_point_vertex_t),
+    .attrs = {
+        [ATTR_POS]      = {GL_FLOAT, 3, false,
+                           offsetof(retained_point_vertex_t, pos)},
+        [ATTR_VMAG]     = {GL_FLOAT, 1, false,
+                           offsetof(retained_point_vertex_t, vmag)},
+        [ATTR_COLOR]    = {GL_UNSIGNED_BYTE, 4, true,
+                           offsetof(retained_point_vertex_t, color)},
+    },
+};
+
+static const gl_buf_info_t RETAINED_GRID_BUF = {
+    .size = sizeof(retained_grid_vertex_t),
     .attrs = {
-        [ATTR_POS] = {GL_FLOAT, 2, false, 0},
+        [ATTR_POS]      = {GL_FLOAT, 3, false,
+                           offsetof(retained_grid_vertex_t, pos)},
+        [ATTR_TEX_POS]  = {GL_FLOAT, 2, false,
+                           offsetof(retained_grid_vertex_t, tex_pos)},
     },
 };
 
 static const gl_buf_info_t LINES_BUF = {
-    .size = 28,
+    .size = sizeof(line_vertex_t),
     .attrs = {
-        [ATTR_POS]      = {GL_FLOAT, 4, false, 0},
-        [ATTR_TEX_POS]  = {GL_FLOAT, 2, false, 16},
-        [ATTR_COLOR]    = {GL_UNSIGNED_BYTE, 4, true, 24},
+        [ATTR_POS]      = {GL_FLOAT, 4, false, offsetof(line_vertex_t, pos)},
+        [ATTR_TEX_POS]  = {GL_FLOAT, 2, false,
+                           offsetof(line_vertex_t, tex_pos)},
+        [ATTR_COLOR]    = {GL_UNSIGNED_BYTE, 4, true,
+                           offsetof(line_vertex_t, color)},
     },
 };
 
 static const gl_buf_info_t LINES_GLOW_BUF = {
-    .size = 16,
+    .size = sizeof(line_glow_vertex_t),
     .attrs = {
-        [ATTR_POS]      = {GL_FLOAT, 2, false, 0},
-        [ATTR_TEX_POS]  = {GL_FLOAT, 2, false, 8},
+        [ATTR_POS]      = {GL_FLOAT, 2, false,
+                           offsetof(line_glow_vertex_t, pos)},
+        [ATTR_TANGENT]  = {GL_FLOAT, 2, false,
+                           offsetof(line_glow_vertex_t, tangent)},
+        [ATTR_TEX_POS]  = {GL_FLOAT, 2, false,
+                           offsetof(line_glow_vertex_t, tex_pos)},
+        [ATTR_COLOR]    = {GL_UNSIGNED_BYTE, 4, true,
+                           offsetof(line_glow_vertex_t, color)},
     },
 };
 
 static const gl_buf_info_t POINTS_BUF = {
-    .size = 16,
+    .size = sizeof(point_vertex_t),
     .attrs = {
-        [ATTR_POS]      = {GL_FLOAT, 2, false, 0},
-        [ATTR_SIZE]     = {GL_FLOAT, 1, false, 8},
-        [ATTR_COLOR]    = {GL_UNSIGNED_BYTE, 4, true, 12},
+        [ATTR_POS]      = {GL_FLOAT, 2, false, offsetof(point_vertex_t, pos)},
+        [ATTR_SIZE]     = {GL_FLOAT, 1, false,
+                           offsetof(point_vertex_t, size)},
+        [ATTR_COLOR]    = {GL_UNSIGNED_BYTE, 4, true,
+                           offsetof(point_vertex_t, color)},
     },
 };
 
 static const gl_buf_info_t TEXTURE_BUF = {
-    .size = 20,
+    .size = sizeof(texture_vertex_t),
     .attrs = {
-        [ATTR_POS]      = {GL_FLOAT, 2, false, 0},
-        [ATTR_TEX_POS]  = {GL_FLOAT, 2, false, 8},
-        [ATTR_COLOR]    = {GL_UNSIGNED_BYTE, 4, true, 16},
+        [ATTR_POS]      = {GL_FLOAT, 2, false,
+                           offsetof(texture_vertex_t, pos)},
+        [ATTR_TEX_POS]  = {GL_FLOAT, 2, false,
+                           offsetof(texture_vertex_t, tex_pos)},
+        [ATTR_COLOR]    = {GL_UNSIGNED_BYTE, 4, true,
+                           offsetof(texture_vertex_t, color)},
     },
 };
 
 static const gl_buf_info_t PLANET_BUF = {
-    .size = 68,
+    .size = sizeof(planet_vertex_t),
     .attrs = {
-        [ATTR_POS]      = {GL_FLOAT, 4, false, 0},
-        [ATTR_MPOS]     = {GL_FLOAT, 4, false, 16},
-        [ATTR_TEX_POS]  = {GL_FLOAT, 2, false, 32},
-        [ATTR_COLOR]    = {GL_UNSIGNED_BYTE, 4, true, 40},
-        [ATTR_NORMAL]   = {GL_FLOAT, 3, false, 44},
-        [ATTR_TANGENT]  = {GL_FLOAT, 3, false, 56},
+        [ATTR_POS]      = {GL_FLOAT, 4, false, offsetof(planet_vertex_t, pos)},
+        [ATTR_MPOS]     = {GL_FLOAT, 4, false,
+                           offsetof(planet_vertex_t, mpos)},
+        [ATTR_TEX_POS]  = {GL_FLOAT, 2, false,
+                           offsetof(planet_vertex_t, tex_pos)},
+        [ATTR_COLOR]    = {GL_UNSIGNED_BYTE, 4, true,
+                           offsetof(planet_vertex_t, color)},
+        [ATTR_NORMAL]   = {GL_FLOAT, 3, false,
+                           offsetof(planet_vertex_t, normal)},
+        [ATTR_TANGENT]  = {GL_FLOAT, 3, false,
+                           offsetof(planet_vertex_t, tangent)},
     },
 };
 
 static const gl_buf_info_t ATMOSPHERE_BUF = {
-    .size = 24,
+    .size = sizeof(sky_vertex_t),
     .attrs = {
-        [ATTR_POS]       = {GL_FLOAT, 2, false, 0},
-        [ATTR_SKY_POS]   = {GL_FLOAT, 3, false, 8},
-        [ATTR_LUMINANCE] = {GL_FLOAT, 1, false, 20},
+        [ATTR_POS]       = {GL_FLOAT, 2, false, offsetof(sky_vertex_t, pos)},
+        [ATTR_SKY_POS]   = {GL_FLOAT, 3, false,
+                            offsetof(sky_vertex_t, sky_pos)},
     },
 };
 
 static const gl_buf_info_t FOG_BUF = {
-    .size = 20,
+    .size = sizeof(sky_vertex_t),
     .attrs = {
-        [ATTR_POS]       = {GL_FLOAT, 2, false, 0},
-        [ATTR_SKY_POS]   = {GL_FLOAT, 3, false, 8},
+        [ATTR_POS]       = {GL_FLOAT, 2, false, offsetof(sky_vertex_t, pos)},
+        [ATTR_SKY_POS]   = {GL_FLOAT, 3, false,
+                            offsetof(sky_vertex_t, sky_pos)},
     },
 };
 
+// An offscreen frame buffer, with a color texture and a depth buffer.
+typedef struct {
+    GLuint      fbo;
+    GLuint      depth;
+    texture_t   *tex;
+} offscreen_t;
+
+// A selectable mesh kept for the picking, with the vertices in window
+// space.  See <pick>.
+typedef struct {
+    uint64_t    oid;
+    int         mode;
+    gl_buf_t    buf;
+    gl_buf_t    indices;
+} pick_mesh_t;
+
 typedef struct renderer_gl {
     renderer_t  rend;
 
     int     fb_size[2];
     double  scale;
+    // Size of the whole frame buffer, and current viewport in it (x, y,
+    // w, h with the origin at the bottom left), in pixels.
+    int     screen_size[2];
+    int     viewport[4];
     bool    cull_flipped;
     double  depth_range[2];
 
     texture_t   *white_tex;
     tex_cache_t *tex_cache;
+    text_metrics_t *text_metrics;
+    text_atlas_t text_atlas;
     NVGcontext *vg;
     // Map font handle -> font scale to fix nanovg font sizes.
     float       font_scales[8];
@@ -242,17 +527,148 @@ typedef struct renderer_gl {
     item_t  *items;
     cache_t *grid_cache;
 
+    retained_buf_t *retained_bufs;
+    int     frame; // Incremented at each flush.
+
+    // Index buffers of the quad grids, for each split.
+    GLuint  grid_indices[MAX_GRID_SPLIT + 1];
+
+    // Offscreen static layer.  See <layer_capture>.
+    offscreen_t layer;
+
+    // Offscreen target of the reduced resolution rendering, with the
+    // frame buffer state to restore after.  See <scaled_begin>.
+    struct {
+        offscreen_t off;
+        bool        active;
+        double      scale;
+        int         fb_size[2];
+        int         screen_size[2];
+        int         viewport[4];
+    } scaled;
+
+    // Offscreen dome cube map, with the six faces side by side in a 3x2
+    // grid.  See <cubemap_warp>.
+    struct {
+        offscreen_t off;
+        int         size;       // Size of a face (px).
+        bool        active;     // Set while we render the faces.
+        GLint       prev_fbo;   // Frame buffer to restore after the faces.
+    } cubemap;
+
+    // Selectable meshes, and offscreen id buffer, for the gpu picking.
+    struct {
+        pick_mesh_t *meshes;
+        int         nb;
+        int         allocated;
+        offscreen_t off;
+    } pick;
+
+    // Last GL state set by the items, so that we can skip the redundant
+    // calls, that are expensive with WebGL.  See <state_reset>.
+    struct {
+        GLuint  prog;
+        int8_t  caps[3];        // Blend, cull face, depth test, -1 if unknown.
+        GLenum  blend_func[4];
+        GLenum  cull_face;
+    } state;
+
+    // Rendering statistics.
+    struct {
+        frame_stats_t frames[STATS_FRAMES];
+        const frame_stats_t *last; // Last frame with complete stats.
+        bool    timer_queries;  // Set if the gpu timer queries are supported.
+        bool    queries_created;
+        int     tex_uploads;    // Texture uploads counter at last flush.
+        int64_t tex_bytes;
+    } stats;
+
 } renderer_gl_t;
 
 static void init_shader(gl_shader_t *shader)
 {
     // Set some common uniforms.
-    GL(glUseProgram(shader->prog));
+    GL(glUseProgram(shader->prog)); // Not cached, see <state_reset>.
     gl_update_uniform(shader, "u_tex", 0);
     gl_update_uniform(shader, "u_normal_tex", 1);
     gl_update_uniform(shader, "u_shadow_color_tex", 2);
 }
 
+// Start the compilation of all the shaders variants that can be used, so
+// that they don't block the rendering the first time they are needed.
+static void preload_shaders(void)
+{
+    int i;
+    const char *names[] = {"points", "mesh", "blit"};
+    const shader_define_t projs[][2] = {
+        {{"PROJ_PERSPECTIVE", true}, {}},
+        {{"PROJ_STEREOGRAPHIC", true}, {}},
+    };
+    const shader_define_t shadow[] = {{"HAS_SHADOW", true}, {}};
+
+    for (i = 0; i < ARRAY_SIZE(names); i++) {
+        shader_preload(names[i], NULL, ATTR_NAMES, init_shader);
+        shader_preload(names[i], projs[0], ATTR_NAMES, init_shader);
+        shader_preload(names[i], projs[1], ATTR_NAMES, init_shader);
+    }
+    shader_preload("lines", NULL, ATTR_NAMES, init_shader);
+    shader_preload("fog", NULL, ATTR_NAMES, init_shader);
+    shader_preload("blit_tag", NULL, ATTR_NAMES, init_shader);
+    shader_preload("atmosphere", NULL, ATTR_NAMES, init_shader);
+    shader_preload("planet", NULL, ATTR_NAMES, init_shader);
+    shader_preload("planet", shadow, ATTR_NAMES, init_shader);
+}
+
+/*
+ * Function: state_reset
+ * Forget the cached GL state.
+ *
+ * Must be called when some code we don't control (nanovg, or the
+ * application between two frames) might have changed the state.  The
+ * shaders compilation also changes the current program, but a new shader
+ * is always used right after, so it's not a problem.
+ */
+static void state_reset(renderer_gl_t *rend)
+{
+    memset(&rend->state, 0, sizeof(rend->state));
+    memset(rend->state.caps, -1, sizeof(rend->state.caps));
+}
+
+static void state_use_program(renderer_gl_t *rend, GLuint prog)
+{
+    if (rend->state.prog == prog) return;
+    GL(glUseProgram(prog));
+    rend->state.prog = prog;
+}
+
+static void state_enable(renderer_gl_t *rend, GLenum cap, bool value)
+{
+    int8_t *cached = &rend->state.caps[
+        cap == GL_BLEND ? 0 : cap == GL_CULL_FACE ? 1 : 2];
+    assert(cap == GL_BLEND || cap == GL_CULL_FACE || cap == GL_DEPTH_TEST);
+    if (*cached == value) return;
+    if (value) GL(glEnable(cap));
+    else GL(glDisable(cap));
+    *cached = value;
+}
+
+static void state_blend_func(renderer_gl_t *rend,
+                             GLenum src_rgb, GLenum dst_rgb,
+                             GLenum src_alpha, GLenum dst_alpha)
+{
+    const GLenum func[4] = {src_rgb, dst_rgb, src_alpha, dst_alpha};
+    if (memcmp(rend->state.blend_func, func, sizeof(func)) == 0) return;
+    GL(glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha));
+    memcpy(rend->state.blend_func, func, sizeof(func));
+}
+
+static void state_cull_face(renderer_gl_t *rend, GLenum mode)
+{
+    if (rend->state.cull_face == mode) return;
+    GL(glCullFace(mode));
+    rend->state.cull_face = mode;
+}
+
 static bool color_is_white(const float c[4])
 {
     return c[0] == 1.0f && c[1] == 1.0f && c[2] == 1.0f && c[3] == 1.0f;
@@ -265,19 +681,135 @@ static void window_to_ndc(renderer_gl_t *rend,
     ndc[1] = 1 - (win[1] * rend->scale / rend->fb_size[1]) * 2;
 }
 
+static void tex_cache_delete(renderer_gl_t *rend, tex_cache_t *ctex)
+{
+    HASH_DEL(rend->tex_cache, ctex);
+    texture_release(ctex->tex);
+    free(ctex->key);
+    free(ctex);
+}
+
+/*
+ * Function: text_atlas_reset
+ * Remove all the texts from the atlas.
+ */
+static void text_atlas_reset(renderer_gl_t *rend)
+{
+    text_atlas_t *atlas = &rend->text_atlas;
+    tex_cache_t *ctex, *tmp;
+    uint8_t *data;
+
+    HASH_ITER(hh, rend->tex_cache, ctex, tmp) {
+        if (ctex->tex == atlas->tex) tex_cache_delete(rend, ctex);
+    }
+    // Clear the texture, so that the padding around the texts stays empty.
+    data = calloc(TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE);
+    texture_set_sub_data(atlas->tex, data, 0, 0,
+                         TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE);
+    free(data);
+    atlas->row_x = 0;
+    atlas->row_y = 0;
+    atlas->row_h = 0;
+    atlas->full = false;
+}
+
+/*
+ * Function: text_atlas_add
+ * Try to copy a text image into the atlas.
+ *
+ * Return:
+ *   false if the text is too big or the atlas is full, in which case the
+ *   text needs its own texture.
+ */
+static bool text_atlas_add(renderer_gl_t *rend, tex_cache_t *ctex,
+                           const uint8_t *img)
+{
+    text_atlas_t *atlas = &rend->text_atlas;
+    uint8_t *data;
+    const int pad = 1; // Keep the linear filtering from mixing two texts.
+
+    if (ctex->w > TEXT_ATLAS_SIZE / 2 || ctex->h > TEXT_ATLAS_SIZE / 16)
+        return false;
+    if (atlas->full) return false;
+
+    if (!atlas->tex) {
+        data = calloc(TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE);
+        atlas->tex = texture_from_data(data, TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE,
+                                       1, 0, 0, TEXT_ATLAS_SIZE,
+                                       TEXT_ATLAS_SIZE, 0);
+        free(data);
+    }
+
+    if (atlas->row_x + ctex->w + pad > TEXT_ATLAS_SIZE) {
+        atlas->row_x = 0;
+        atlas->row_y += atlas->row_h;
+        atlas->row_h = 0;
+    }
+    if (atlas->row_y + ctex->h + pad > TEXT_ATLAS_SIZE) {
+        atlas->full = true;
+        return false;
+    }
+
+    ctex->x = atlas->row_x;
+    ctex->y = atlas->row_y;
+    atlas->row_x += ctex->w + pad;
+    atlas->row_h = max(atlas->row_h, ctex->h + pad);
+    if (ctex->w && ctex->h)
+        texture_set_sub_data(atlas->tex, img, ctex->x, ctex->y,
+                             ctex->w, ctex->h);
+    ctex->tex = atlas->tex;
+    ctex->tex->ref++;
+    return true;
+}
+
 static void prepare(renderer_t *rend_, double win_w, double win_h,
                     double scale, bool cull_flipped)
 {
     renderer_gl_t *rend = (void*)rend_;
-    tex_cache_t *ctex;
+    tex_cache_t *ctex, *tmp;
+    text_metrics_t *metrics, *metrics_tmp;
 
     rend->fb_size[0] = win_w * scale;
     rend->fb_size[1] = win_h * scale;
     rend->scale = scale;
+    rend->screen_size[0] = rend->fb_size[0];
+    rend->screen_size[1] = rend->fb_size[1];
+    memcpy(rend->viewport, (int[]){0, 0, rend->fb_size[0], rend->fb_size[1]},
+           sizeof(rend->viewport));
     rend->cull_flipped = cull_flipped;
+    core->prof.draw_calls = 0;
+
+    // The texts that have their own texture are deleted as soon as they
+    // are not used anymore, the ones in the atlas when it gets full.
+    HASH_ITER(hh, rend->tex_cache, ctex, tmp) {
+        if (!ctex->in_use && ctex->tex != rend->text_atlas.tex)
+            tex_cache_delete(rend, ctex);
+        else
+            ctex->in_use = false;
+    }
+    if (rend->text_atlas.full) text_atlas_reset(rend);
+    HASH_ITER(hh, rend->text_metrics, metrics, metrics_tmp) {
+        if (rend->frame - metrics->frame < TEXT_METRICS_MAX_AGE) continue;
+        HASH_DEL(rend->text_metrics, metrics);
+        free(metrics->key);
+        free(metrics);
+    }
+    shader_cache_update();
+    texture_update(TEXTURE_UPLOAD_BUDGET);
+}
 
-    DL_FOREACH(rend->tex_cache, ctex)
-        ctex->in_use = false;
+/*
+ * Function: item_new
+ * Create a new zero initialized render item.
+ *
+ * The items only live until the end of the frame, so we allocate them in
+ * the core frame memory, and they don't need to be freed.
+ */
+static item_t *item_new(void)
+{
+    item_t *item = core_frame_alloc(sizeof(*item));
+    memset(item, 0, sizeof(*item));
+    return item;
 }
 
 /*
@@ -305,6 +837,130 @@ static item_t *get_item(renderer_gl_t *rend, int type,
     return NULL;
 }
 
+static void retained_buf_delete(renderer_gl_t *rend, retained_buf_t *ret)
+{
+    HASH_DEL(rend->retained_bufs, ret);
+    GL(glDeleteBuffers(1, &ret->array_buffer));
+    GL(glDeleteBuffers(2, ret->index_buffers));
+    free(ret);
+}
+
+static bool retained_proj_supported(const projection_t *proj)
+{
+    return proj->type == PROJ_PERSPECTIVE || proj->type == PROJ_STEREOGRAPHIC;
+}
+
+/*
+ * Function: get_retained_buf
+ * Get a retained buffer, or create a new empty one.
+ *
+ * If the version doesn't match, the old buffer is deleted, so that the
+ * caller uploads the new data.
+ */
+static retained_buf_t *get_retained_buf(renderer_gl_t *rend, int type,
+                                        uint64_t id, int version)
+{
+    uint64_t key[2] = {type, id};
+    retained_buf_t *ret;
+
+    HASH_FIND(hh, rend->retained_bufs, key, sizeof(key), ret);
+    if (ret && ret->version != version) {
+        retained_buf_delete(rend, ret);
+        ret = NULL;
+    }
+    if (!ret) {
+        ret = calloc(1, sizeof(*ret));
+        memcpy(ret->key, key, sizeof(key));
+        ret->version = version;
+        HASH_ADD(hh, rend->retained_bufs, key, sizeof(key), ret);
+    }
+    ret->last_used = rend->frame;
+    return ret;
+}
+
+// Set the retained buffer of an item, and the uniforms values to project
+// its vertices in the shader.
+static void set_retained_item(item_t *item, const retained_buf_t *ret,
+                              const painter_t *painter,
+                              const double rot[3][3])
+{
+    const projection_t *proj = painter->proj;
+    double mv[4][4];
+
+    item->retained.buf = ret;
+    mat3_to_mat4(rot, mv);
+    mat4_mul(mv, *painter->transform, mv);
+    mat4_to_float(mv, item->retained.mv);
+    item->retained.proj_type = proj->type;
+    mat4_to_float(proj->mat, item->retained.proj_mat);
+    item->retained.proj_scale[0] = item->retained.proj_scale[1] = 1.0;
+    if (proj->type == PROJ_STEREOGRAPHIC) {
+        item->retained.proj_scale[0] = 1.0 / proj->scaling[0];
+        item->retained.proj_scale[1] = 1.0 / proj->scaling[1];
+    }
+    if (proj->flags & PROJ_FLIP_HORIZONTAL) item->retained.proj_scale[0] *= -1;
+    if (proj->flags & PROJ_FLIP_VERTICAL)   item->retained.proj_scale[1] *= -1;
+}
+
+static void set_retained_uniforms(gl_shader_t *shader, const item_t *item)
+{
+    gl_update_uniform(shader, "u_mv", item->retained.mv);
+    gl_update_uniform(shader, "u_proj", item->retained.proj_mat);
+    gl_update_uniform(shader, "u_proj_scale", item->retained.proj_scale);
+}
+
+static bool points_3d(renderer_t *rend_, const painter_t *painter,
+                      int frame, uint64_t buf_id, int buf_version,
+                      int size, const float (*pos)[3], const float *vmag,
+                      const uint8_t (*colors)[4], int n)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    const observer_t *obs = painter->obs ?: core->observer;
+    double rot[3][3];
+    item_t *item;
+    retained_buf_t *ret;
+    gl_buf_t buf;
+    retained_point_vertex_t *v;
+    int i;
+
+    if (!retained_proj_supported(painter->proj)) return false;
+    // Astrometric positions: we only use the first order of the aberration
+    // in the shader, and ignore the light deflection.
+    if (!painter_get_frame_to_view_matrix(
+                painter, frame == FRAME_ASTROM ? FRAME_ICRF : frame, rot))
+        return false;
+    if (n <= 0) return true;
+
+    ret = get_retained_buf(rend, ITEM_POINTS, buf_id, buf_version);
+    if (!ret->array_buffer) {
+        gl_buf_alloc(&buf, &RETAINED_POINTS_BUF, size);
+        v = gl_buf_push(&buf, size);
+        for (i = 0; i < size; i++) {
+            memcpy(v[i].pos, pos[i], sizeof(v[i].pos));
+            v[i].vmag = vmag[i];
+            memcpy(v[i].color, colors[i], sizeof(v[i].color));
+        }
+        GL(glGenBuffers(1, &ret->array_buffer));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, ret->array_buffer));
+        GL(glBufferData(GL_ARRAY_BUFFER, size * buf.info->size, buf.data,
+                        GL_STATIC_DRAW));
+        gl_buf_release(&buf);
+    }
+
+    item = item_new();
+    item->type = ITEM_POINTS;
+    vec4_to_float(painter->color, item->color);
+    item->points.halo = painter->points_halo;
+    item->points.count = min(n, size);
+    if (frame == FRAME_ASTROM)
+        vec3_to_float(obs->astrom.v, item->points.aberration);
+    // Empty buffer, only used to enable the attributes.
+    item->buf.info = &RETAINED_POINTS_BUF;
+    set_retained_item(item, ret, painter, rot);
+    DL_APPEND(rend->items, item);
+    return true;
+}
+
 static void points(renderer_t *rend_,
                    const painter_t *painter,
                    int n,
@@ -313,34 +969,30 @@ static void points(renderer_t *rend_,
     renderer_gl_t *rend = (void*)rend_;
     item_t *item;
     int i;
-    const int MAX_POINTS = 4096;
+    const int BUF_SIZE = 4096;
     point_t p;
-
-    if (n > MAX_POINTS) {
-        LOG_E("Try to render more than %d points: %d", MAX_POINTS, n);
-        n = MAX_POINTS;
-    }
+    point_vertex_t *v;
 
     item = get_item(rend, ITEM_POINTS, n, 0, NULL);
     if (item && item->points.halo != painter->points_halo)
         item = NULL;
     if (!item) {
-        item = calloc(1, sizeof(*item));
+        item = item_new();
         item->type = ITEM_POINTS;
-        gl_buf_alloc(&item->buf, &POINTS_BUF, MAX_POINTS);
+        gl_buf_alloc(&item->buf, &POINTS_BUF, max(BUF_SIZE, n + 1));
         vec4_to_float(painter->color, item->color);
         item->points.halo = painter->points_halo;
         DL_APPEND(rend->items, item);
     }
 
+    v = gl_buf_push(&item->buf, n);
     for (i = 0; i < n; i++) {
         p = points[i];
         window_to_ndc(rend, p.pos, p.pos);
 
-        gl_buf_2f(&item->buf, -1, ATTR_POS, VEC2_SPLIT(p.pos));
-        gl_buf_1f(&item->buf, -1, ATTR_SIZE, p.size * rend->scale);
-        gl_buf_4i(&item->buf, -1, ATTR_COLOR, VEC4_SPLIT(p.color));
-        gl_buf_next(&item->buf);
+        vec2_to_float(p.pos, v[i].pos);
+        v[i].size = p.size * rend->scale;
+        memcpy(v[i].color, p.color, sizeof(v[i].color));
 
         // Add the point int the global list of rendered points.
         // XXX: could be done in the painter.
@@ -366,11 +1018,12 @@ static const double (*get_grid(renderer_gl_t *rend,
         int order;
         int pix;
         int split;
-        int pad_;
-    } key = { map->order, map->pix, split };
+        int flags;
+    } key = { map->order, map->pix, split,
+              (map->swapped ? 1 : 0) | (map->at_infinity ? 2 : 0) };
     _Static_assert(sizeof(key) == 16, "");
-    bool can_cache = map->type == UV_MAP_HEALPIX &&
-                     map->at_infinity && map->swapped;
+    // The healpix maps only depend on the values of the key.
+    bool can_cache = map->type == UV_MAP_HEALPIX;
 
     *should_delete = !can_cache;
     if (can_cache) {
@@ -392,26 +1045,130 @@ static const double (*get_grid(renderer_gl_t *rend,
     return grid;
 }
 
-static void compute_tangent(const double uv[2], const uv_map_t *map,
-                            double out[3])
+/*
+ * Function: get_grid_indices
+ * Return the index buffer of the triangles of a quad grid.
+ *
+ * All the quads with the same split share the same buffer, that we only
+ * upload once.
+ */
+static GLuint get_grid_indices(renderer_gl_t *rend, int split)
+{
+    const int INDICES[6][2] = {
+        {0, 0}, {0, 1}, {1, 0}, {1, 1}, {1, 0}, {0, 1} };
+    int i, j, k, n = split + 1;
+    gl_buf_t buf;
+    uint16_t *indices;
+
+    assert(split > 0 && split <= MAX_GRID_SPLIT);
+    if (rend->grid_indices[split]) return rend->grid_indices[split];
+
+    gl_buf_alloc(&buf, &INDICES_BUF, split * split * 6);
+    indices = gl_buf_push(&buf, split * split * 6);
+    for (i = 0; i < split; i++)
+    for (j = 0; j < split; j++) {
+        for (k = 0; k < 6; k++)
+            *indices++ = (INDICES[k][1] + i) * n + (INDICES[k][0] + j);
+    }
+    GL(glGenBuffers(1, &rend->grid_indices[split]));
+    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rend->grid_indices[split]));
+    GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, buf.nb * buf.info->size,
+                    buf.data, GL_STATIC_DRAW));
+    gl_buf_release(&buf);
+    return rend->grid_indices[split];
+}
+
+/*
+ * Function: quad_retained
+ * Try to render a textured quad from a retained grid buffer.
+ *
+ * This is only possible for the maps at infinity that are either healpix,
+ * since the grid is then fully defined by the healpix pixel and the split,
+ * or that have an id, and if the conversion to the view frame is a
+ * rotation.  The grid vertices are uploaded once, and projected in the
+ * shader.
+ */
+static bool quad_retained(renderer_gl_t *rend, const painter_t *painter,
+                          int frame, int grid_size, const uv_map_t *map,
+                          texture_t *tex)
+{
+    int i, j, n = grid_size + 1;
+    uint64_t id;
+    double rot[3][3], p[3], tex_mat[3][3];
+    const double (*grid)[4];
+    bool should_delete_grid;
+    item_t *item;
+    retained_buf_t *ret;
+    gl_buf_t buf;
+    retained_grid_vertex_t *v;
+
+    if (map->type != UV_MAP_HEALPIX && !map->id) return false;
+    if (!map->at_infinity) return false;
+    if (grid_size > MAX_GRID_SPLIT) return false;
+    if (!retained_proj_supported(painter->proj)) return false;
+    if (!painter_get_frame_to_view_matrix(painter, frame, rot)) return false;
+
+    if (map->id) {
+        // Oids start with four ascii chars, so they cannot collide with
+        // the healpix ids, whose first byte is the order.
+        id = map->id;
+    } else {
+        // The healpix pix uses at most 44 bits up to order 20.
+        assert(map->order <= 20);
+        id = (uint64_t)map->order << 56 | (uint64_t)grid_size << 48 |
+             (uint64_t)map->swapped << 47 | (uint64_t)map->pix;
+    }
+    ret = get_retained_buf(rend, ITEM_TEXTURE, id, map->version);
+    if (!ret->array_buffer) {
+        grid = get_grid(rend, map, grid_size, &should_delete_grid);
+        gl_buf_alloc(&buf, &RETAINED_GRID_BUF, n * n);
+        v = gl_buf_push(&buf, n * n);
+        for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++, v++) {
+            vec3_normalize(grid[i * n + j], p);
+            vec3_to_float(p, v->pos);
+            v->tex_pos[0] = (double)j / grid_size;
+            v->tex_pos[1] = (double)i / grid_size;
+        }
+        if (should_delete_grid) free((void*)grid);
+        GL(glGenBuffers(1, &ret->array_buffer));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, ret->array_buffer));
+        GL(glBufferData(GL_ARRAY_BUFFER, buf.nb * buf.info->size,
+                        buf.data, GL_STATIC_DRAW));
+        gl_buf_release(&buf);
+    }
+
+    item = item_new();
+    item->type = ITEM_TEXTURE;
+    item->tex = tex;
+    item->tex->ref++;
+    vec4_to_float(painter->color, item->color);
+    item->flags = painter->flags;
+    item->quad.grid_split = grid_size;
+    // Same uv transformation as in quad, including the power of two padding.
+    mat3_set_identity(tex_mat);
+    tex_mat[0][0] = (double)tex->w / tex->tex_w;
+    tex_mat[1][1] = (double)tex->h / tex->tex_h;
+    mat3_mul(tex_mat, painter->textures[PAINTER_TEX_COLOR].mat, tex_mat);
+    mat3_to_float(tex_mat, item->quad.tex_transf);
+    // Empty buffer, only used to enable the attributes.
+    item->buf.info = &RETAINED_GRID_BUF;
+    set_retained_item(item, ret, painter, rot);
+    DL_APPEND(rend->items, item);
+    return true;
+}
+
+/*
+ * Compute the tangent of a sphere map at a given model position.
+ *
+ * The tangent follows the parallels, so it's simply the derivative of the
+ * position along the longitude, that we get analytically.
+ */
+static void compute_tangent(const double pos[3], double out[3])
 {
-    // XXX: this is what the algo should look like, except the normal map
+    // Note: we don't derive it from the uv map, since the normal map
     // texture we use (for the Moon) doesn't follow the healpix projection.
-    /*
-    double uv1[2], uv2[2], p1[4], p2[4], tangent[3];
-    const double delta = 0.1;
-    vec2_copy(uv, uv1);
-    vec2_copy(uv, uv2);
-    uv2[0] += delta;
-    project(tex_proj, PROJ_BACKWARD, 4, uv1, p1);
-    project(tex_proj, PROJ_BACKWARD, 4, uv2, p2);
-    vec3_sub(p2, p1, tangent);
-    vec3_normalize(tangent, out);
-    */
-
-    double p[4] = {0};
-    uv_map(map, uv, p);
-    vec3_cross(VEC(0, 0, 1), p, out);
+    vec3_cross(VEC(0, 0, 1), pos, out);
 }
 
 static void quad_planet(
@@ -424,14 +1181,17 @@ static void quad_planet(
     renderer_gl_t *rend = (void*)rend_;
     item_t *item;
     int n, i, j, k;
-    double p[4], mpos[4], normal[4] = {0}, tangent[4] = {0}, z, mv[4][4];
+    double p[4], mpos[4], tangent[3], z, mv[4][4];
+    float transf[4][4], dir[3];
+    planet_vertex_t *v;
+    uint16_t *indices;
 
     // Positions of the triangles in the quads.
     const int INDICES[6][2] = { {0, 0}, {0, 1}, {1, 0},
                                 {1, 1}, {1, 0}, {0, 1} };
     n = grid_size + 1;
 
-    item = calloc(1, sizeof(*item));
+    item = item_new();
     item->type = ITEM_PLANET;
     gl_buf_alloc(&item->buf, &PLANET_BUF, n * n * 4);
     gl_buf_alloc(&item->indices, &INDICES_BUF, n * n * 6);
@@ -456,6 +1216,9 @@ static void quad_planet(
         mat3_to_mat4(painter->obs->ri2v, mv);
     mat4_mul(mv, *painter->transform, mv);
     mat4_to_float(mv, item->planet.mv);
+    // The normals and tangents are only used for the shading, so we can
+    // transform them in single precision.
+    mat4_to_float(*painter->transform, (float*)transf);
 
     // Set material
     if (painter->planet.light_emit)
@@ -479,29 +1242,29 @@ static void quad_planet(
     assert(item->tex->w == item->tex->tex_w &&
            item->tex->h == item->tex->tex_h);
 
+    v = gl_buf_push(&item->buf, n * n);
     for (i = 0; i < n; i++)
-    for (j = 0; j < n; j++) {
-        vec3_set(p, (double)j / grid_size, (double)i / grid_size, 1.0);
-        gl_buf_2f(&item->buf, -1, ATTR_TEX_POS, p[0], p[1]);
-        if (item->planet.normalmap) {
-            compute_tangent(p, map, tangent);
-            mat4_mul_vec4(*painter->transform, tangent, tangent);
-            gl_buf_3f(&item->buf, -1, ATTR_TANGENT, VEC3_SPLIT(tangent));
-        }
-
+    for (j = 0; j < n; j++, v++) {
         vec3_set(p, (double)j / grid_size, (double)i / grid_size, 1.0);
+        vec2_to_float(p, v->tex_pos);
         uv_map(map, p, p);
         assert(p[3] == 1.0); // Planet can never be at infinity.
+        if (item->planet.normalmap) {
+            compute_tangent(p, tangent);
+            vec3_to_float(tangent, dir);
+            mat4f_mul_vec3_dir(transf, dir, v->tangent);
+        } else {
+            vec3_set(v->tangent, 0, 0, 0);
+        }
 
-        vec3_copy(p, normal);
-        mat4_mul_vec4(*painter->transform, normal, normal);
-        gl_buf_3f(&item->buf, -1, ATTR_NORMAL, VEC3_SPLIT(normal));
+        vec3_to_float(p, dir);
+        mat4f_mul_vec3_dir(transf, dir, v->normal);
 
         // Model position (without scaling applied).
         vec4_copy(p, mpos);
         vec3_mul(1.0 / painter->planet.scale, mpos, mpos);
         mat4_mul_vec4(*painter->transform, mpos, mpos);
-        gl_buf_4f(&item->buf, -1, ATTR_MPOS, VEC4_SPLIT(mpos));
+        vec4_to_float(mpos, v->mpos);
 
         // Rendering position (with scaling applied).
         mat4_mul_vec4(*painter->transform, p, p);
@@ -512,18 +1275,15 @@ static void quad_planet(
             vec2_to_float(*painter->depth_range, item->depth_range);
             p[2] = -z;
         }
-        gl_buf_4f(&item->buf, -1, ATTR_POS, VEC4_SPLIT(p));
-        gl_buf_4i(&item->buf, -1, ATTR_COLOR, 255, 255, 255, 255);
-        gl_buf_next(&item->buf);
+        vec4_to_float(p, v->pos);
+        memset(v->color, 255, sizeof(v->color));
     }
 
+    indices = gl_buf_push(&item->indices, grid_size * grid_size * 6);
     for (i = 0; i < grid_size; i++)
     for (j = 0; j < grid_size; j++) {
-        for (k = 0; k < 6; k++) {
-            gl_buf_1i(&item->indices, -1, 0,
-                      (INDICES[k][1] + i) * n + (INDICES[k][0] + j));
-            gl_buf_next(&item->indices);
-        }
+        for (k = 0; k < 6; k++)
+            *indices++ = (INDICES[k][1] + i) * n + (INDICES[k][0] + j);
     }
     DL_APPEND(rend->items, item);
 }
@@ -540,10 +1300,12 @@ static void quad(renderer_t          *rend_,
     const int INDICES[6][2] = {
         {0, 0}, {0, 1}, {1, 0}, {1, 1}, {1, 0}, {0, 1} };
     double p[4], tex_pos[2], ndc_p[4];
-    float lum;
     const double (*grid)[4] = NULL;
-    bool should_delete_grid;
+    bool should_delete_grid, shared_indices = false;
     texture_t *tex = painter->textures[PAINTER_TEX_COLOR].tex;
+    texture_vertex_t *v = NULL;
+    sky_vertex_t *sky_v = NULL;
+    uint16_t *indices;
 
     // Special case for planet shader.
     if (painter->flags & (PAINTER_PLANET_SHADER | PAINTER_RING_SHADER))
@@ -552,34 +1314,48 @@ static void quad(renderer_t          *rend_,
     if (!tex) tex = rend->white_tex;
     n = grid_size + 1;
 
+    if (!(painter->flags & (PAINTER_ATMOSPHERE_SHADER | PAINTER_FOG_SHADER)) &&
+            quad_retained(rend, painter, frame, grid_size, map, tex))
+        return;
+
     if (painter->flags & PAINTER_ATMOSPHERE_SHADER) {
         item = get_item(rend, ITEM_ATMOSPHERE,
                         n * n, grid_size * grid_size * 6, tex);
         if (item && (
                 memcmp(item->atm.p, painter->atm.p, sizeof(item->atm.p)) ||
-                memcmp(item->atm.sun, painter->atm.sun, sizeof(item->atm.sun))))
+                memcmp(item->atm.sun, painter->atm.sun,
+                       sizeof(item->atm.sun)) ||
+                memcmp(item->atm.moon, painter->atm.moon,
+                       sizeof(item->atm.moon)) ||
+                memcmp(item->atm.sb, painter->atm.sb, sizeof(item->atm.sb))))
             item = NULL;
         if (!item) {
-            item = calloc(1, sizeof(*item));
+            item = item_new();
             item->type = ITEM_ATMOSPHERE;
             gl_buf_alloc(&item->buf, &ATMOSPHERE_BUF, 256);
             gl_buf_alloc(&item->indices, &INDICES_BUF, 256 * 6);
             memcpy(item->atm.p, painter->atm.p, sizeof(item->atm.p));
             memcpy(item->atm.sun, painter->atm.sun, sizeof(item->atm.sun));
+            memcpy(item->atm.moon, painter->atm.moon, sizeof(item->atm.moon));
+            memcpy(item->atm.sb, painter->atm.sb, sizeof(item->atm.sb));
         }
     } else if (painter->flags & PAINTER_FOG_SHADER) {
         item = get_item(rend, ITEM_FOG, n * n, grid_size * grid_size * 6, tex);
         if (!item) {
-            item = calloc(1, sizeof(*item));
+            item = item_new();
             item->type = ITEM_FOG;
             gl_buf_alloc(&item->buf, &FOG_BUF, 256);
             gl_buf_alloc(&item->indices, &INDICES_BUF, 256 * 6);
         }
     } else {
-        item = calloc(1, sizeof(*item));
+        item = item_new();
         item->type = ITEM_TEXTURE;
         gl_buf_alloc(&item->buf, &TEXTURE_BUF, n * n);
-        gl_buf_alloc(&item->indices, &INDICES_BUF, n * n * 6);
+        shared_indices = grid_size <= MAX_GRID_SPLIT;
+        if (shared_indices)
+            item->quad.grid_split = grid_size;
+        else
+            gl_buf_alloc(&item->indices, &INDICES_BUF, n * n * 6);
     }
 
     ofs = item->buf.nb;
@@ -588,43 +1364,45 @@ static void quad(renderer_t          *rend_,
     vec4_to_float(painter->color, item->color);
     item->flags = painter->flags;
 
+    // The atmosphere and fog luminance and color are computed in the
+    // shader from the sky position.
+    if (painter->flags & (PAINTER_ATMOSPHERE_SHADER | PAINTER_FOG_SHADER))
+        sky_v = gl_buf_push(&item->buf, n * n);
+    else
+        v = gl_buf_push(&item->buf, n * n);
+
     grid = get_grid(rend, map, grid_size, &should_delete_grid);
     for (i = 0; i < n; i++)
     for (j = 0; j < n; j++) {
-        vec3_set(p, (double)j / grid_size, (double)i / grid_size, 1.0);
-        mat3_mul_vec3(painter->textures[PAINTER_TEX_COLOR].mat, p, p);
-        tex_pos[0] = p[0] * tex->w / tex->tex_w;
-        tex_pos[1] = p[1] * tex->h / tex->tex_h;
-        gl_buf_2f(&item->buf, -1, ATTR_TEX_POS, tex_pos[0], tex_pos[1]);
-
         vec4_set(p, VEC4_SPLIT(grid[i * n + j]));
         mat4_mul_vec4(*painter->transform, p, p);
         convert_framev4(painter->obs, frame, FRAME_VIEW, p, ndc_p);
         project(painter->proj, PROJ_TO_NDC_SPACE, 4, ndc_p, ndc_p);
-        gl_buf_2f(&item->buf, -1, ATTR_POS, ndc_p[0], ndc_p[1]);
-        gl_buf_4i(&item->buf, -1, ATTR_COLOR, 255, 255, 255, 255);
-        // For atmosphere shader, in the first pass we do not compute the
-        // luminance yet, only if the point is visible.
-        if (painter->flags & PAINTER_ATMOSPHERE_SHADER) {
-            gl_buf_3f(&item->buf, -1, ATTR_SKY_POS, VEC3_SPLIT(p));
-            lum = painter->atm.compute_lum(painter->atm.user,
-                    (float[3]){p[0], p[1], p[2]});
-            gl_buf_1f(&item->buf, -1, ATTR_LUMINANCE, lum);
-        }
-        if (painter->flags & PAINTER_FOG_SHADER) {
-            gl_buf_3f(&item->buf, -1, ATTR_SKY_POS, VEC3_SPLIT(p));
+        if (sky_v) {
+            vec2_to_float(ndc_p, sky_v[i * n + j].pos);
+            vec3_to_float(p, sky_v[i * n + j].sky_pos);
+            continue;
         }
-        gl_buf_next(&item->buf);
+        vec2_to_float(ndc_p, v[i * n + j].pos);
+        memset(v[i * n + j].color, 255, sizeof(v->color));
+
+        vec3_set(p, (double)j / grid_size, (double)i / grid_size, 1.0);
+        mat3_mul_vec3(painter->textures[PAINTER_TEX_COLOR].mat, p, p);
+        tex_pos[0] = p[0] * tex->w / tex->tex_w;
+        tex_pos[1] = p[1] * tex->h / tex->tex_h;
+        vec2_to_float(tex_pos, v[i * n + j].tex_pos);
     }
     if (should_delete_grid) free(grid);
 
     // Set the index buffer.
-    for (i = 0; i < grid_size; i++)
-    for (j = 0; j < grid_size; j++) {
-        for (k = 0; k < 6; k++) {
-            gl_buf_1i(&item->indices, -1, 0,
-                      ofs + (INDICES[k][1] + i) * n + (INDICES[k][0] + j));
-            gl_buf_next(&item->indices);
+    if (!shared_indices) {
+        indices = gl_buf_push(&item->indices, grid_size * grid_size * 6);
+        for (i = 0; i < grid_size; i++)
+        for (j = 0; j < grid_size; j++) {
+            for (k = 0; k < 6; k++) {
+                *indices++ = ofs + (INDICES[k][1] + i) * n +
+                             (INDICES[k][0] + j);
+            }
         }
     }
     DL_APPEND(rend->items, item);
@@ -643,8 +1421,10 @@ static void quad_wireframe(renderer_t          *rend_,
     double p[4], ndc_p[4];
     const double (*grid)[4] = NULL;
     bool should_delete_grid;
+    texture_vertex_t *v;
+    uint16_t *indices;
 
-    item = calloc(1, sizeof(*item));
+    item = item_new();
     item->type = ITEM_QUAD_WIREFRAME;
     gl_buf_alloc(&item->buf, &TEXTURE_BUF, n * n);
     gl_buf_alloc(&item->indices, &INDICES_BUF, grid_size * n * 4);
@@ -652,33 +1432,30 @@ static void quad_wireframe(renderer_t          *rend_,
 
     // Generate grid position.
     grid = get_grid(rend, map, grid_size, &should_delete_grid);
+    v = gl_buf_push(&item->buf, n * n);
     for (i = 0; i < n; i++)
-    for (j = 0; j < n; j++) {
-        gl_buf_2f(&item->buf, -1, ATTR_TEX_POS, 0.5, 0.5);
+    for (j = 0; j < n; j++, v++) {
         vec4_set(p, VEC4_SPLIT(grid[i * n + j]));
         mat4_mul_vec4(*painter->transform, p, p);
         convert_framev4(painter->obs, frame, FRAME_VIEW, p, ndc_p);
         project(painter->proj, PROJ_TO_NDC_SPACE, 4, ndc_p, ndc_p);
-        gl_buf_2f(&item->buf, -1, ATTR_POS, ndc_p[0], ndc_p[1]);
-        gl_buf_4i(&item->buf, -1, ATTR_COLOR, 255, 255, 255, 255);
-        gl_buf_next(&item->buf);
+        vec2_to_float(ndc_p, v->pos);
+        v->tex_pos[0] = v->tex_pos[1] = 0.5;
+        memset(v->color, 255, sizeof(v->color));
     }
     if (should_delete_grid) free(grid);
 
     /* Set the index buffer.
      * We render a set of horizontal and vertical lines.  */
+    indices = gl_buf_push(&item->indices, grid_size * n * 4);
     for (i = 0; i < n; i++)
     for (j = 0; j < grid_size; j++) {
         // Vertical.
-        gl_buf_1i(&item->indices, -1, 0, (j + 0) * n + i);
-        gl_buf_next(&item->indices);
-        gl_buf_1i(&item->indices, -1, 0, (j + 1) * n + i);
-        gl_buf_next(&item->indices);
+        *indices++ = (j + 0) * n + i;
+        *indices++ = (j + 1) * n + i;
         // Horizontal.
-        gl_buf_1i(&item->indices, -1, 0, i * n + j + 0);
-        gl_buf_next(&item->indices);
-        gl_buf_1i(&item->indices, -1, 0, i * n + j + 1);
-        gl_buf_next(&item->indices);
+        *indices++ = i * n + j + 0;
+        *indices++ = i * n + j + 1;
     }
     DL_APPEND(rend->items, item);
 }
@@ -690,38 +1467,37 @@ static void texture2(renderer_gl_t *rend, texture_t *tex,
     int i, ofs;
     item_t *item;
     const int16_t INDICES[6] = {0, 1, 2, 3, 2, 1 };
-    float color[4];
+    uint8_t color[4];
+    texture_vertex_t *v;
+    uint16_t *indices;
 
-    vec4_to_float(color_, color);
+    // The color is set per vertex, so that we can batch all the quads that
+    // use the same texture.
+    for (i = 0; i < 4; i++) color[i] = clamp(color_[i], 0.0, 1.0) * 255;
     item = get_item(rend, ITEM_ALPHA_TEXTURE, 4, 6, tex);
-    if (item && memcmp(item->color, color, sizeof(color))) item = NULL;
 
     if (!item) {
-        item = calloc(1, sizeof(*item));
+        item = item_new();
         item->type = ITEM_ALPHA_TEXTURE;
         gl_buf_alloc(&item->buf, &TEXTURE_BUF, 64 * 4);
         gl_buf_alloc(&item->indices, &INDICES_BUF, 64 * 6);
         item->tex = tex;
         item->tex->ref++;
-        memcpy(item->color, color, sizeof(color));
+        memcpy(item->color, (float[]){1, 1, 1, 1}, sizeof(item->color));
         DL_APPEND(rend->items, item);
     }
 
     ofs = item->buf.nb;
 
+    v = gl_buf_push(&item->buf, 4);
     for (i = 0; i < 4; i++) {
-        gl_buf_2f(&item->buf, -1, ATTR_POS, pos[i][0], pos[i][1]);
-        gl_buf_2f(&item->buf, -1, ATTR_TEX_POS, uv[i][0], uv[i][1]);
-        gl_buf_4i(&item->buf, -1, ATTR_COLOR, 255, 255, 255, 255);
-        gl_buf_next(&item->buf);
-    }
-    for (i = 0; i < 6; i++) {
-        if (swap_indices)
-            gl_buf_1i(&item->indices, -1, 0, ofs + INDICES[5 - i]);
-        else
-            gl_buf_1i(&item->indices, -1, 0, ofs + INDICES[i]);
-        gl_buf_next(&item->indices);
+        vec2_to_float(pos[i], v[i].pos);
+        vec2_to_float(uv[i], v[i].tex_pos);
+        memcpy(v[i].color, color, sizeof(color));
     }
+    indices = gl_buf_push(&item->indices, 6);
+    for (i = 0; i < 6; i++)
+        indices[i] = ofs + INDICES[swap_indices ? 5 - i : i];
 }
 
 static void texture(renderer_t *rend_,
@@ -759,34 +1535,36 @@ static void text_using_texture(renderer_gl_t *rend,
     double s[2], ofs[2] = {0, 0}, bounds[4];
     const double scale = rend->scale;
     uint8_t *img;
-    int i, w, h, xoff, yoff;
+    int i;
+    char *key;
     tex_cache_t *ctex;
     texture_t *tex;
 
-    DL_FOREACH(rend->tex_cache, ctex) {
-        if (ctex->size == size && ctex->effects == effects &&
-                strcmp(ctex->text, text) == 0) break;
-    }
+    asprintf(&key, "%g %d %s", size * scale, effects, text);
+    HASH_FIND_STR(rend->tex_cache, key, ctex);
 
     if (!ctex) {
-        img = (void*)sys_render_text(text, size * scale, effects, &w, &h,
-                                     &xoff, &yoff);
         ctex = calloc(1, sizeof(*ctex));
-        ctex->size = size;
-        ctex->effects = effects;
-        ctex->xoff = xoff;
-        ctex->yoff = yoff;
-        ctex->text = strdup(text);
-        ctex->tex = texture_from_data(img, w, h, 1, 0, 0, w, h, 0);
+        ctex->key = key;
+        key = NULL;
+        img = (void*)sys_render_text(text, size * scale, effects,
+                                     &ctex->w, &ctex->h,
+                                     &ctex->xoff, &ctex->yoff);
+        if (!text_atlas_add(rend, ctex, img)) {
+            ctex->tex = texture_from_data(img, ctex->w, ctex->h, 1,
+                                          0, 0, ctex->w, ctex->h, 0);
+        }
         free(img);
-        DL_APPEND(rend->tex_cache, ctex);
+        HASH_ADD_KEYPTR(hh, rend->tex_cache, ctex->key, strlen(ctex->key),
+                        ctex);
     }
+    free(key);
 
     ctex->in_use = true;
 
     // Compute bounds taking alignment into account.
-    s[0] = ctex->tex->w / scale;
-    s[1] = ctex->tex->h / scale;
+    s[0] = ctex->w / scale;
+    s[1] = ctex->h / scale;
     if (align & ALIGN_LEFT)     ofs[0] = +s[0] / 2;
     if (align & ALIGN_RIGHT)    ofs[0] = -s[0] / 2;
     if (align & ALIGN_TOP)      ofs[1] = +s[1] / 2;
@@ -809,10 +1587,10 @@ static void text_using_texture(renderer_gl_t *rend,
      * the anchor point.
      */
     for (i = 0; i < 4; i++) {
-        uv[i][0] = ((i % 2) * tex->w) / (double)tex->tex_w;
-        uv[i][1] = ((i / 2) * tex->h) / (double)tex->tex_h;
-        verts[i][0] = (i % 2 - 0.5) * tex->w / scale;
-        verts[i][1] = (0.5 - i / 2) * tex->h / scale;
+        uv[i][0] = (ctex->x + (i % 2) * ctex->w) / (double)tex->tex_w;
+        uv[i][1] = (ctex->y + (i / 2) * ctex->h) / (double)tex->tex_h;
+        verts[i][0] = (i % 2 - 0.5) * ctex->w / scale;
+        verts[i][1] = (0.5 - i / 2) * ctex->h / scale;
         verts[i][0] += ofs[0];
         verts[i][1] += ofs[1];
         vec2_rotate(angle, verts[i], verts[i]);
@@ -826,6 +1604,49 @@ static void text_using_texture(renderer_gl_t *rend,
     texture2(rend, tex, uv, verts, color, rend->cull_flipped);
 }
 
+/*
+ * Get the bounds of a text rendered with nanovg.
+ *
+ * The bounds relative to the anchor point only depend on the text, size,
+ * effects and alignment, so we measure each text only once, and after that
+ * it's just a hash lookup.
+ */
+static void text_nanovg_get_bounds(renderer_gl_t *rend, const char *text,
+                                   const double pos[2], int align,
+                                   int effects, double size,
+                                   double bounds[4])
+{
+    text_metrics_t *metrics;
+    char *key;
+    int font_handle = 0;
+
+    asprintf(&key, "%g %d %d %s", size, effects, align, text);
+    HASH_FIND_STR(rend->text_metrics, key, metrics);
+    if (!metrics) {
+        metrics = calloc(1, sizeof(*metrics));
+        metrics->key = key;
+        key = NULL;
+        nvgSave(rend->vg);
+        if (effects & TEXT_BOLD) {
+            font_handle = nvgFindFont(rend->vg, "bold");
+            if (font_handle != -1) nvgFontFaceId(rend->vg, font_handle);
+            else font_handle = 0;
+        }
+        nvgFontSize(rend->vg, size * rend->font_scales[font_handle]);
+        nvgTextAlign(rend->vg, align);
+        nvgTextBounds(rend->vg, 0, 0, text, NULL, metrics->bounds);
+        nvgRestore(rend->vg);
+        HASH_ADD_KEYPTR(hh, rend->text_metrics, metrics->key,
+                        strlen(metrics->key), metrics);
+    }
+    free(key);
+    metrics->frame = rend->frame;
+    bounds[0] = pos[0] + metrics->bounds[0];
+    bounds[1] = pos[1] + metrics->bounds[1];
+    bounds[2] = pos[0] + metrics->bounds[2];
+    bounds[3] = pos[1] + metrics->bounds[3];
+}
+
 // Render text using nanovg.
 static void text_using_nanovg(renderer_gl_t *rend, const char *text,
                               const double pos[2], int align, int effects,
@@ -833,8 +1654,6 @@ static void text_using_nanovg(renderer_gl_t *rend, const char *text,
                               double bounds[4])
 {
     item_t *item;
-    float fbounds[4];
-    int font_handle = 0;
 
     if (strlen(text) >= sizeof(item->text.text)) {
         LOG_W("Text too large: %s", text);
@@ -842,7 +1661,7 @@ static void text_using_nanovg(renderer_gl_t *rend, const char *text,
     }
 
     if (!bounds) {
-        item = calloc(1, sizeof(*item));
+        item = item_new();
         item->type = ITEM_TEXT;
         vec4_to_float(color, item->color);
         vec2_to_float(pos, item->text.pos);
@@ -858,22 +1677,8 @@ static void text_using_nanovg(renderer_gl_t *rend, const char *text,
         }
         DL_APPEND(rend->items, item);
     }
-    if (bounds) {
-        nvgSave(rend->vg);
-        if (effects & TEXT_BOLD) {
-            font_handle = nvgFindFont(rend->vg, "bold");
-            if (font_handle != -1) nvgFontFaceId(rend->vg, font_handle);
-            else font_handle = 0;
-        }
-        nvgFontSize(rend->vg, size * rend->font_scales[font_handle]);
-        nvgTextAlign(rend->vg, align);
-        nvgTextBounds(rend->vg, pos[0], pos[1], text, NULL, fbounds);
-        bounds[0] = fbounds[0];
-        bounds[1] = fbounds[1];
-        bounds[2] = fbounds[2];
-        bounds[3] = fbounds[3];
-        nvgRestore(rend->vg);
-    }
+    if (bounds)
+        text_nanovg_get_bounds(rend, text, pos, align, effects, size, bounds);
 }
 
 static void text(renderer_t *rend_, const char *text, const double pos[2],
@@ -899,23 +1704,54 @@ static void item_points_render(renderer_gl_t *rend, const item_t *item)
     gl_shader_t *shader;
     GLuint  array_buffer;
     double core_size;
+    point_params_t params;
+    shader_define_t defines[] = {
+        {"PROJ_PERSPECTIVE", item->retained.buf &&
+                             item->retained.proj_type == PROJ_PERSPECTIVE},
+        {"PROJ_STEREOGRAPHIC", item->retained.buf &&
+                               item->retained.proj_type == PROJ_STEREOGRAPHIC},
+        {}
+    };
 
-    shader = shader_get("points", NULL, ATTR_NAMES, init_shader);
-    GL(glUseProgram(shader->prog));
+    shader = shader_get("points", defines, ATTR_NAMES, init_shader);
+    state_use_program(rend, shader->prog);
 
-    GL(glEnable(GL_BLEND));
-    GL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ZERO, GL_ONE));
-    GL(glDisable(GL_DEPTH_TEST));
-
-    GL(glGenBuffers(1, &array_buffer));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, array_buffer));
-    GL(glBufferData(GL_ARRAY_BUFFER, item->buf.nb * item->buf.info->size,
-                    item->buf.data, GL_DYNAMIC_DRAW));
+    state_enable(rend, GL_BLEND, true);
+    state_blend_func(rend, GL_SRC_ALPHA, GL_ONE, GL_ZERO, GL_ONE);
+    state_enable(rend, GL_DEPTH_TEST, false);
 
     gl_update_uniform(shader, "u_color", item->color);
     core_size = 1.0 / item->points.halo;
     gl_update_uniform(shader, "u_core_size", core_size);
 
+    // Retained points: project them and compute their radius and luminance
+    // in the shader.
+    if (item->retained.buf) {
+        core_get_point_params(&params);
+        GL(glBindBuffer(GL_ARRAY_BUFFER, item->retained.buf->array_buffer));
+        set_retained_uniforms(shader, item);
+        gl_update_uniform(shader, "u_aberration", item->points.aberration);
+        gl_update_uniform(shader, "u_win_scale", rend->scale);
+        gl_update_uniform(shader, "u_lum_scale", params.lum_scale);
+        gl_update_uniform(shader, "u_tonemapper",
+                          (float[]){params.tm_p, params.tm_scale});
+        gl_update_uniform(shader, "u_star_scale",
+                          (float[]){params.linear_scale,
+                                    params.relative_scale});
+        gl_update_uniform(shader, "u_radius",
+                          (float[]){params.skip_radius, params.min_radius,
+                                    params.max_radius, params.dim_factor});
+        gl_buf_enable(&item->buf);
+        GL(glDrawArrays(GL_POINTS, 0, item->points.count));
+        gl_buf_disable(&item->buf);
+        return;
+    }
+
+    GL(glGenBuffers(1, &array_buffer));
+    GL(glBindBuffer(GL_ARRAY_BUFFER, array_buffer));
+    GL(glBufferData(GL_ARRAY_BUFFER, item->buf.nb * item->buf.info->size,
+                    item->buf.data, GL_DYNAMIC_DRAW));
+
     gl_buf_enable(&item->buf);
     GL(glDrawArrays(GL_POINTS, 0, item->buf.nb));
     gl_buf_disable(&item->buf);
@@ -930,17 +1766,17 @@ static void item_lines_render(renderer_gl_t *rend, const item_t *item)
     GLuint  index_buffer;
 
     shader = shader_get("blit", NULL, ATTR_NAMES, init_shader);
-    GL(glUseProgram(shader->prog));
+    state_use_program(rend, shader->prog);
 
     GL(glLineWidth(item->lines.width * rend->scale));
 
     GL(glActiveTexture(GL_TEXTURE0));
     GL(glBindTexture(GL_TEXTURE_2D, rend->white_tex->id));
 
-    GL(glEnable(GL_BLEND));
-    GL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
-                           GL_ZERO, GL_ONE));
-    GL(glDisable(GL_DEPTH_TEST));
+    state_enable(rend, GL_BLEND, true);
+    state_blend_func(rend, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                     GL_ZERO, GL_ONE);
+    state_enable(rend, GL_DEPTH_TEST, false);
 
     GL(glGenBuffers(1, &index_buffer));
     GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer));
@@ -973,25 +1809,50 @@ static void item_mesh_render(renderer_gl_t *rend, const item_t *item)
     float fbo_size[2] = {rend->fb_size[0] / rend->scale,
                          rend->fb_size[1] / rend->scale};
 
+    shader_define_t defines[] = {
+        {"PROJ_PERSPECTIVE", item->retained.buf &&
+                             item->retained.proj_type == PROJ_PERSPECTIVE},
+        {"PROJ_STEREOGRAPHIC", item->retained.buf &&
+                               item->retained.proj_type == PROJ_STEREOGRAPHIC},
+        {}
+    };
+
     gl_mode = item->mesh.mode == 0 ? GL_TRIANGLES : GL_LINES;
 
-    shader = shader_get("mesh", NULL, ATTR_NAMES, init_shader);
-    GL(glUseProgram(shader->prog));
+    shader = shader_get("mesh", defines, ATTR_NAMES, init_shader);
+    state_use_program(rend, shader->prog);
 
     GL(glLineWidth(item->mesh.stroke_width));
 
     // For the moment we disable culling for mesh.  We should reintroduce it
     // by making sure we use the proper value depending on the render
     // culling and frame.
-    GL(glDisable(GL_CULL_FACE));
-    GL(glDisable(GL_DEPTH_TEST));
+    state_enable(rend, GL_CULL_FACE, false);
+    state_enable(rend, GL_DEPTH_TEST, false);
 
     if (item->color[3] == 1) {
-        GL(glDisable(GL_BLEND));
+        state_enable(rend, GL_BLEND, false);
     } else {
-        GL(glEnable(GL_BLEND));
-        GL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
-                               GL_ZERO, GL_ONE));
+        state_enable(rend, GL_BLEND, true);
+        state_blend_func(rend, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                         GL_ZERO, GL_ONE);
+    }
+
+    gl_update_uniform(shader, "u_color", item->color);
+
+    // Retained mesh: the buffers are already on the GPU, we only have to
+    // set the projection uniforms.
+    if (item->retained.buf) {
+        GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                        item->retained.buf->index_buffers[item->mesh.mode]));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, item->retained.buf->array_buffer));
+        set_retained_uniforms(shader, item);
+        gl_buf_enable(&item->buf);
+        GL(glDrawElements(gl_mode,
+                          item->retained.buf->indices_count[item->mesh.mode],
+                          GL_UNSIGNED_SHORT, 0));
+        gl_buf_disable(&item->buf);
+        return;
     }
 
     GL(glGenBuffers(1, &index_buffer));
@@ -1005,7 +1866,6 @@ static void item_mesh_render(renderer_gl_t *rend, const item_t *item)
     GL(glBufferData(GL_ARRAY_BUFFER, item->buf.nb * item->buf.info->size,
                     item->buf.data, GL_DYNAMIC_DRAW));
 
-    gl_update_uniform(shader, "u_color", item->color);
     gl_update_uniform(shader, "u_fbo_size", fbo_size);
 
     gl_buf_enable(&item->buf);
@@ -1026,12 +1886,12 @@ static void item_lines_glow_render(renderer_gl_t *rend, const item_t *item)
                          rend->fb_size[1] / rend->scale};
 
     shader = shader_get("lines", NULL, ATTR_NAMES, init_shader);
-    GL(glUseProgram(shader->prog));
+    state_use_program(rend, shader->prog);
 
-    GL(glDisable(GL_DEPTH_TEST));
-    GL(glEnable(GL_BLEND));
-    GL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
-                           GL_ZERO, GL_ONE));
+    state_enable(rend, GL_DEPTH_TEST, false);
+    state_enable(rend, GL_BLEND, true);
+    state_blend_func(rend, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                     GL_ZERO, GL_ONE);
 
     GL(glGenBuffers(1, &index_buffer));
     GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer));
@@ -1044,7 +1904,6 @@ static void item_lines_glow_render(renderer_gl_t *rend, const item_t *item)
     GL(glBufferData(GL_ARRAY_BUFFER, item->buf.nb * item->buf.info->size,
                     item->buf.data, GL_DYNAMIC_DRAW));
 
-    gl_update_uniform(shader, "u_line_width", item->lines.width);
     gl_update_uniform(shader, "u_line_glow", item->lines.glow);
     gl_update_uniform(shader, "u_color", item->color);
     gl_update_uniform(shader, "u_win_size", win_size);
@@ -1057,54 +1916,9 @@ static void item_lines_glow_render(renderer_gl_t *rend, const item_t *item)
     GL(glDeleteBuffers(1, &index_buffer));
 }
 
-static void item_vg_render(renderer_gl_t *rend, const item_t *item)
-{
-    double a, da;
-    nvgBeginFrame(rend->vg, rend->fb_size[0] / rend->scale,
-                            rend->fb_size[1] / rend->scale, rend->scale);
-    nvgSave(rend->vg);
-    nvgTranslate(rend->vg, item->vg.pos[0], item->vg.pos[1]);
-    nvgRotate(rend->vg, item->vg.angle);
-    nvgBeginPath(rend->vg);
-
-    if (item->type == ITEM_VG_ELLIPSE && !item->vg.dashes)
-        nvgEllipse(rend->vg, 0, 0, item->vg.size[0], item->vg.size[1]);
-
-    if (item->type == ITEM_VG_ELLIPSE && item->vg.dashes) {
-        da = 2 * M_PI / item->vg.dashes;
-        for (a = 0; a < 2 * M_PI; a += da) {
-            nvgMoveTo(rend->vg, item->vg.size[0] * cos(a),
-                                item->vg.size[1] * sin(a));
-            nvgLineTo(rend->vg, item->vg.size[0] * cos(a + da / 2),
-                                item->vg.size[1] * sin(a + da / 2));
-        }
-    }
-
-    if (item->type == ITEM_VG_RECT)
-        nvgRect(rend->vg, -item->vg.size[0], -item->vg.size[1],
-                2 * item->vg.size[0], 2 * item->vg.size[1]);
-
-    if (item->type == ITEM_VG_LINE) {
-        nvgMoveTo(rend->vg, 0, 0);
-        nvgLineTo(rend->vg, item->vg.pos2[0] - item->vg.pos[0],
-                            item->vg.pos2[1] - item->vg.pos[1]);
-    }
-
-    nvgStrokeColor(rend->vg, nvgRGBA(item->color[0] * 255,
-                                     item->color[1] * 255,
-                                     item->color[2] * 255,
-                                     item->color[3] * 255));
-    nvgStrokeWidth(rend->vg, item->vg.stroke_width);
-    nvgStroke(rend->vg);
-    nvgRestore(rend->vg);
-    nvgEndFrame(rend->vg);
-}
-
 static void item_text_render(renderer_gl_t *rend, const item_t *item)
 {
     int font_handle = 0;
-    nvgBeginFrame(rend->vg, rend->fb_size[0] / rend->scale,
-                            rend->fb_size[1] / rend->scale, rend->scale);
     nvgSave(rend->vg);
     nvgTranslate(rend->vg, item->text.pos[0], item->text.pos[1]);
     nvgRotate(rend->vg, item->text.angle);
@@ -1136,7 +1950,6 @@ static void item_text_render(renderer_gl_t *rend, const item_t *item)
     }
 
     nvgRestore(rend->vg);
-    nvgEndFrame(rend->vg);
 }
 
 static void item_alpha_texture_render(renderer_gl_t *rend, const item_t *item)
@@ -1157,17 +1970,17 @@ static void item_alpha_texture_render(renderer_gl_t *rend, const item_t *item)
         return;
     }
 
-    GL(glUseProgram(shader->prog));
+    state_use_program(rend, shader->prog);
 
     GL(glActiveTexture(GL_TEXTURE0));
     GL(glBindTexture(GL_TEXTURE_2D, item->tex->id));
-    GL(glEnable(GL_CULL_FACE));
-    GL(glCullFace(rend->cull_flipped ? GL_FRONT : GL_BACK));
+    state_enable(rend, GL_CULL_FACE, true);
+    state_cull_face(rend, rend->cull_flipped ? GL_FRONT : GL_BACK);
 
-    GL(glEnable(GL_BLEND));
-    GL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
-                           GL_ZERO, GL_ONE));
-    GL(glDisable(GL_DEPTH_TEST));
+    state_enable(rend, GL_BLEND, true);
+    state_blend_func(rend, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                     GL_ZERO, GL_ONE);
+    state_enable(rend, GL_DEPTH_TEST, false);
 
     GL(glGenBuffers(1, &index_buffer));
     GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer));
@@ -1188,50 +2001,58 @@ static void item_alpha_texture_render(renderer_gl_t *rend, const item_t *item)
 
     GL(glDeleteBuffers(1, &array_buffer));
     GL(glDeleteBuffers(1, &index_buffer));
-    GL(glCullFace(GL_BACK));
 }
 
 static void item_texture_render(renderer_gl_t *rend, const item_t *item)
 {
     gl_shader_t *shader;
-    GLuint  array_buffer;
-    GLuint  index_buffer;
+    GLuint  array_buffer = 0;
+    GLuint  index_buffer = 0;
+    int     indices_count;
     float tm[3];
+    shader_define_t defines[] = {
+        {"PROJ_PERSPECTIVE", item->retained.buf &&
+                             item->retained.proj_type == PROJ_PERSPECTIVE},
+        {"PROJ_STEREOGRAPHIC", item->retained.buf &&
+                               item->retained.proj_type == PROJ_STEREOGRAPHIC},
+        {}
+    };
 
     switch (item->type) {
     case ITEM_ATMOSPHERE:
         shader = shader_get("atmosphere", NULL, ATTR_NAMES, init_shader);
         break;
     case ITEM_TEXTURE:
-        shader = shader_get("blit", NULL, ATTR_NAMES, init_shader);
+        shader = shader_get("blit", defines, ATTR_NAMES, init_shader);
         break;
     default:
         assert(false);
         return;
     }
 
-    GL(glUseProgram(shader->prog));
+    state_use_program(rend, shader->prog);
 
     GL(glActiveTexture(GL_TEXTURE0));
     GL(glBindTexture(GL_TEXTURE_2D, item->tex->id));
-    GL(glEnable(GL_CULL_FACE));
-    GL(glCullFace(rend->cull_flipped ? GL_FRONT : GL_BACK));
+    state_enable(rend, GL_CULL_FACE, true);
+    state_cull_face(rend, rend->cull_flipped ? GL_FRONT : GL_BACK);
 
     if (item->tex->format == GL_RGB && item->color[3] == 1.0) {
-        GL(glDisable(GL_BLEND));
+        state_enable(rend, GL_BLEND, false);
     } else {
-        GL(glEnable(GL_BLEND));
-        GL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
-                               GL_ZERO, GL_ONE));
+        state_enable(rend, GL_BLEND, true);
+        state_blend_func(rend, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                         GL_ZERO, GL_ONE);
     }
-    GL(glDisable(GL_DEPTH_TEST));
+    state_enable(rend, GL_DEPTH_TEST, false);
 
     if (item->flags & PAINTER_ADD) {
-        GL(glEnable(GL_BLEND));
+        state_enable(rend, GL_BLEND, true);
         if (color_is_white(item->color))
-            GL(glBlendFunc(GL_ONE, GL_ONE));
+            state_blend_func(rend, GL_ONE, GL_ONE, GL_ONE, GL_ONE);
         else {
-            GL(glBlendFunc(GL_CONSTANT_COLOR, GL_ONE));
+            state_blend_func(rend, GL_CONSTANT_COLOR, GL_ONE,
+                             GL_CONSTANT_COLOR, GL_ONE);
             GL(glBlendColor(item->color[0] * item->color[3],
                             item->color[1] * item->color[3],
                             item->color[2] * item->color[3],
@@ -1243,6 +2064,8 @@ static void item_texture_render(renderer_gl_t *rend, const item_t *item)
     if (item->type == ITEM_ATMOSPHERE) {
         gl_update_uniform(shader, "u_atm_p", item->atm.p);
         gl_update_uniform(shader, "u_sun", item->atm.sun);
+        gl_update_uniform(shader, "u_moon", item->atm.moon);
+        gl_update_uniform(shader, "u_sb", item->atm.sb);
         // XXX: the tonemapping args should be copied before rendering!
         tm[0] = core->tonemapper.p;
         tm[1] = core->tonemapper.lwmax;
@@ -1250,12 +2073,64 @@ static void item_texture_render(renderer_gl_t *rend, const item_t *item)
         gl_update_uniform(shader, "u_tm", tm);
     }
 
+    if (item->type == ITEM_TEXTURE && item->quad.grid_split) {
+        GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                        get_grid_indices(rend, item->quad.grid_split)));
+        indices_count = item->quad.grid_split * item->quad.grid_split * 6;
+    } else {
+        GL(glGenBuffers(1, &index_buffer));
+        GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer));
+        GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                        item->indices.nb * item->indices.info->size,
+                        item->indices.data, GL_DYNAMIC_DRAW));
+        indices_count = item->indices.nb;
+    }
+
+    // Retained quad: the grid is already on the GPU, we only have to set
+    // the projection uniforms.
+    if (item->retained.buf) {
+        GL(glBindBuffer(GL_ARRAY_BUFFER, item->retained.buf->array_buffer));
+        set_retained_uniforms(shader, item);
+        gl_update_uniform(shader, "u_tex_transf", item->quad.tex_transf);
+    } else {
+        GL(glGenBuffers(1, &array_buffer));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, array_buffer));
+        GL(glBufferData(GL_ARRAY_BUFFER, item->buf.nb * item->buf.info->size,
+                        item->buf.data, GL_DYNAMIC_DRAW));
+    }
+
+    gl_buf_enable(&item->buf);
+    GL(glDrawElements(GL_TRIANGLES, indices_count, GL_UNSIGNED_SHORT, 0));
+    gl_buf_disable(&item->buf);
+
+    // Deleting the buffer 0 is silently ignored.
+    GL(glDeleteBuffers(1, &array_buffer));
+    GL(glDeleteBuffers(1, &index_buffer));
+}
+
+static void item_dome_render(renderer_gl_t *rend, const item_t *item)
+{
+    GLuint  array_buffer;
+    GLuint  index_buffer;
+    gl_shader_t *shader;
+
+    shader = shader_get("dome", NULL, ATTR_NAMES, init_shader);
+    state_use_program(rend, shader->prog);
+    GL(glActiveTexture(GL_TEXTURE0));
+    GL(glBindTexture(GL_TEXTURE_2D, item->tex->id));
+    state_enable(rend, GL_CULL_FACE, false);
+    state_enable(rend, GL_BLEND, false);
+    state_enable(rend, GL_DEPTH_TEST, false);
+    gl_update_uniform(shader, "u_scale", item->dome.scale);
+    gl_update_uniform(shader, "u_faces", item->dome.faces);
+    gl_update_uniform(shader, "u_face_uv", item->dome.face_uv);
+    gl_update_uniform(shader, "u_margin", item->dome.margin);
+
     GL(glGenBuffers(1, &index_buffer));
     GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer));
     GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                     item->indices.nb * item->indices.info->size,
                     item->indices.data, GL_DYNAMIC_DRAW));
-
     GL(glGenBuffers(1, &array_buffer));
     GL(glBindBuffer(GL_ARRAY_BUFFER, array_buffer));
     GL(glBufferData(GL_ARRAY_BUFFER, item->buf.nb * item->buf.info->size,
@@ -1267,7 +2142,6 @@ static void item_texture_render(renderer_gl_t *rend, const item_t *item)
 
     GL(glDeleteBuffers(1, &array_buffer));
     GL(glDeleteBuffers(1, &index_buffer));
-    GL(glCullFace(GL_BACK));
 }
 
 static void item_quad_wireframe_render(renderer_gl_t *rend, const item_t *item)
@@ -1277,15 +2151,15 @@ static void item_quad_wireframe_render(renderer_gl_t *rend, const item_t *item)
     gl_shader_t *shader;
 
     shader = shader_get("blit", NULL, ATTR_NAMES, init_shader);
-    GL(glUseProgram(shader->prog));
+    state_use_program(rend, shader->prog);
 
     gl_update_uniform(shader, "u_color", item->color);
     GL(glActiveTexture(GL_TEXTURE0));
     GL(glBindTexture(GL_TEXTURE_2D, rend->white_tex->id));
-    GL(glDisable(GL_DEPTH_TEST));
-    GL(glEnable(GL_BLEND));
-    GL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
-                           GL_ZERO, GL_ONE));
+    state_enable(rend, GL_DEPTH_TEST, false);
+    state_enable(rend, GL_BLEND, true);
+    state_blend_func(rend, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                     GL_ZERO, GL_ONE);
 
     GL(glGenBuffers(1, &index_buffer));
     GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer));
@@ -1319,7 +2193,7 @@ static void item_planet_render(renderer_gl_t *rend, const item_t *item)
     };
     shader = shader_get("planet", defines, ATTR_NAMES, init_shader);
 
-    GL(glUseProgram(shader->prog));
+    state_use_program(rend, shader->prog);
 
     GL(glActiveTexture(GL_TEXTURE0));
     GL(glBindTexture(GL_TEXTURE_2D, item->tex->id));
@@ -1341,23 +2215,23 @@ static void item_planet_render(renderer_gl_t *rend, const item_t *item)
         GL(glBindTexture(GL_TEXTURE_2D, rend->white_tex->id));
 
     if (item->flags & PAINTER_RING_SHADER) {
-        GL(glDisable(GL_CULL_FACE));
+        state_enable(rend, GL_CULL_FACE, false);
     } else {
-        GL(glEnable(GL_CULL_FACE));
-        GL(glCullFace(rend->cull_flipped ? GL_FRONT : GL_BACK));
+        state_enable(rend, GL_CULL_FACE, true);
+        state_cull_face(rend, rend->cull_flipped ? GL_FRONT : GL_BACK);
     }
 
     if (item->tex->format == GL_RGB && item->color[3] == 1.0) {
-        GL(glDisable(GL_BLEND));
+        state_enable(rend, GL_BLEND, false);
     } else {
-        GL(glEnable(GL_BLEND));
-        GL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
-                               GL_ZERO, GL_ONE));
+        state_enable(rend, GL_BLEND, true);
+        state_blend_func(rend, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                         GL_ZERO, GL_ONE);
     }
     if (item->depth_range[0] || item->depth_range[1])
-        GL(glEnable(GL_DEPTH_TEST));
+        state_enable(rend, GL_DEPTH_TEST, true);
     else
-        GL(glDisable(GL_DEPTH_TEST));
+        state_enable(rend, GL_DEPTH_TEST, false);
 
     GL(glGenBuffers(1, &index_buffer));
     GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer));
@@ -1393,12 +2267,276 @@ static void item_planet_render(renderer_gl_t *rend, const item_t *item)
 
     GL(glDeleteBuffers(1, &array_buffer));
     GL(glDeleteBuffers(1, &index_buffer));
-    GL(glCullFace(GL_BACK));
+}
+
+/*
+ * Function: item_is_reorderable
+ * Return whether an item can be rendered out of its submission order
+ *
+ * The textures, atmosphere, fog and planets usually cover a large part of
+ * the screen, so we never move anything across them.
+ */
+static bool item_is_reorderable(const item_t *item)
+{
+    switch (item->type) {
+    case ITEM_TEXTURE:
+    case ITEM_ATMOSPHERE:
+    case ITEM_FOG:
+    case ITEM_PLANET:
+    case ITEM_DOME:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Return whether an item is rendered with nanovg.
+static bool item_is_vg(const item_t *item)
+{
+    return item->type == ITEM_TEXT;
+}
+
+// Return whether two items use the same render state, so that they can be
+// drawn in a single call.
+static bool items_same_state(const item_t *a, const item_t *b)
+{
+    // All the consecutive nanovg items are rendered in the same nanovg
+    // frame, so we only need to group them.
+    if (item_is_vg(a)) return item_is_vg(b);
+    if (a->type != b->type || a->tex != b->tex || a->flags != b->flags)
+        return false;
+    if (a->retained.buf || b->retained.buf) return false;
+    if (memcmp(a->color, b->color, sizeof(a->color))) return false;
+    switch (a->type) {
+    case ITEM_LINES:
+        return a->lines.width == b->lines.width;
+    case ITEM_LINES_GLOW:
+        return a->lines.glow == b->lines.glow;
+    case ITEM_POINTS:
+        return a->points.halo == b->points.halo;
+    case ITEM_MESH:
+        return a->mesh.mode == b->mesh.mode &&
+               a->mesh.stroke_width == b->mesh.stroke_width;
+    case ITEM_ALPHA_TEXTURE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static int item_sort_cmp(void *a, void *b)
+{
+    return cmp(((item_t*)a)->batch, ((item_t*)b)->batch);
+}
+
+/*
+ * Function: sort_items
+ * Reorder the items so that the ones with the same render state follow
+ * each other.
+ *
+ * The items are split into bands, delimited by the renderer barriers and
+ * by the items that cannot be reordered.  Inside a band, every item is
+ * moved just after the first item with the same state, so the order of
+ * the first item of each state is preserved.
+ */
+static void sort_items(renderer_gl_t *rend)
+{
+    item_t *item, *firsts[32];
+    int i, nb = 0, order = 0;
+
+    DL_FOREACH(rend->items, item) {
+        item->batch = order++;
+        if (!item_is_reorderable(item)) {
+            nb = 0;
+            continue;
+        }
+        for (i = 0; i < nb; i++) {
+            if (items_same_state(firsts[i], item)) {
+                item->batch = firsts[i]->batch;
+                break;
+            }
+        }
+        if (i == nb && nb < ARRAY_SIZE(firsts)) firsts[nb++] = item;
+        if (item->barrier) nb = 0;
+    }
+    // DL_SORT is a merge sort, so the items of a batch keep their order.
+    DL_SORT(rend->items, item_sort_cmp);
+}
+
+static void buf_reserve(gl_buf_t *buf, int capacity)
+{
+    if (buf->capacity >= capacity) return;
+    capacity = max(capacity, buf->capacity * 2);
+    buf->data = realloc(buf->data, capacity * buf->info->size);
+    buf->capacity = capacity;
+}
+
+/*
+ * Function: item_merge
+ * Try to append the vertices of an item to an other item.
+ *
+ * Return:
+ *   true if the items have been merged, in which case the second item
+ *   doesn't have to be rendered anymore.
+ */
+static bool item_merge(item_t *item, const item_t *other)
+{
+    int i, ofs;
+    const uint16_t *src;
+    uint16_t *dst;
+
+    if (item_is_vg(item) || !items_same_state(item, other)) return false;
+    // Make sure we can still address all the vertices with the indices.
+    if (item->buf.nb + other->buf.nb > 1 << 16) return false;
+
+    ofs = item->buf.nb;
+    buf_reserve(&item->buf, item->buf.nb + other->buf.nb);
+    memcpy(gl_buf_push(&item->buf, other->buf.nb), other->buf.data,
+           other->buf.nb * other->buf.info->size);
+
+    if (!other->indices.nb) return true;
+    buf_reserve(&item->indices, item->indices.nb + other->indices.nb);
+    src = (const uint16_t*)other->indices.data;
+    dst = gl_buf_push(&item->indices, other->indices.nb);
+    for (i = 0; i < other->indices.nb; i++)
+        dst[i] = src[i] + ofs;
+    return true;
+}
+
+static void item_delete(item_t *item)
+{
+    texture_release(item->tex);
+    if (item->type == ITEM_PLANET)
+        texture_release(item->planet.normalmap);
+    gl_buf_release(&item->buf);
+    gl_buf_release(&item->indices);
+}
+
+// Get the results of the gpu timer queries of the previous frames.
+static void stats_poll_queries(renderer_gl_t *rend)
+{
+#if HAS_TIMER_QUERIES
+    int i, j, type;
+    GLuint available = 0;
+    GLint disjoint = 0;
+    GLuint64 t;
+    frame_stats_t *stats;
+
+#ifdef GL_GPU_DISJOINT_
+    // If something happened that made the timers invalid, drop all the
+    // pending results.
+    GL(glGetIntegerv(GL_GPU_DISJOINT_, &disjoint));
+#endif
+    for (i = 0; i < STATS_FRAMES; i++) {
+        stats = &rend->stats.frames[i];
+        if (!stats->pending) continue;
+        if (disjoint) {
+            stats->pending = false;
+            continue;
+        }
+        // The queries end in order, so we only check the last one.
+        if (stats->nb_queries) {
+            GL(glGetQueryObjectuiv_(stats->queries[stats->nb_queries - 1],
+                                    GL_QUERY_RESULT_AVAILABLE_, &available));
+            if (!available) continue;
+        }
+        for (j = 0; j < stats->nb_queries; j++) {
+            GL(glGetQueryObjectui64v_(stats->queries[j], GL_QUERY_RESULT_,
+                                      &t));
+            type = stats->queries_type[j];
+            if (type) stats->items[type].gpu_time += t / 1e9;
+            else stats->vg_gpu_time += t / 1e9;
+        }
+        stats->pending = false;
+        if (!rend->stats.last || rend->stats.last->frame < stats->frame)
+            rend->stats.last = stats;
+    }
+#endif
+}
+
+// Start the stats of a new frame.
+static frame_stats_t *stats_begin_frame(renderer_gl_t *rend)
+{
+    frame_stats_t *stats;
+    int tex_uploads;
+    int64_t tex_bytes;
+    bool queries = rend->stats.timer_queries && core->prof.gpu_timers;
+
+    stats_poll_queries(rend);
+    stats = &rend->stats.frames[rend->frame % STATS_FRAMES];
+    // Too slow to get the results, we drop them.
+    if (rend->stats.last == stats) rend->stats.last = NULL;
+    memset(stats->items, 0, sizeof(stats->items));
+    stats->vg_gpu_time = 0;
+    stats->frame = rend->frame;
+    stats->nb_queries = 0;
+    stats->pending = queries;
+
+#if HAS_TIMER_QUERIES
+    if (queries && !rend->stats.queries_created) {
+        for (int i = 0; i < STATS_FRAMES; i++) {
+            GL(glGenQueries_(STATS_MAX_QUERIES,
+                             rend->stats.frames[i].queries));
+        }
+        rend->stats.queries_created = true;
+    }
+#endif
+
+    // The textures uploads since the last frame.
+    texture_get_uploads(&tex_uploads, &tex_bytes);
+    stats->tex_uploads = tex_uploads - rend->stats.tex_uploads;
+    stats->tex_bytes = tex_bytes - rend->stats.tex_bytes;
+    rend->stats.tex_uploads = tex_uploads;
+    rend->stats.tex_bytes = tex_bytes;
+    return stats;
+}
+
+// Update the stats before rendering an item, and start a new timer query
+// if the item is not in the same group as the previous one.
+static void stats_add_item(frame_stats_t *stats, const item_t *item)
+{
+    int n, type;
+
+    n = item->indices.nb ?: item->buf.nb;
+    if (item->type == ITEM_POINTS && item->retained.buf)
+        n = item->points.count;
+    else if (item->retained.buf)
+        n = item->retained.buf->indices_count[0];
+    stats->items[item->type].draw_calls++;
+    stats->items[item->type].vertices += n;
+
+#if HAS_TIMER_QUERIES
+    if (!stats->pending) return;
+    type = item_is_vg(item) ? 0 : item->type;
+    if (stats->nb_queries &&
+            stats->queries_type[stats->nb_queries - 1] == type) return;
+    if (stats->query_active) GL(glEndQuery_(GL_TIME_ELAPSED_));
+    stats->query_active = stats->nb_queries < STATS_MAX_QUERIES;
+    if (!stats->query_active) return;
+    stats->queries_type[stats->nb_queries] = type;
+    GL(glBeginQuery_(GL_TIME_ELAPSED_,
+                     stats->queries[stats->nb_queries++]));
+#else
+    (void)type;
+#endif
+}
+
+static void stats_end_frame(renderer_gl_t *rend, frame_stats_t *stats)
+{
+#if HAS_TIMER_QUERIES
+    if (stats->query_active) GL(glEndQuery_(GL_TIME_ELAPSED_));
+    stats->query_active = false;
+#endif
+    // Without the gpu times, the stats are complete already.
+    if (!stats->pending) rend->stats.last = stats;
 }
 
 static void rend_flush(renderer_gl_t *rend)
 {
-    item_t *item, *tmp;
+    item_t *item, *tmp, *other;
+    retained_buf_t *ret, *ret_tmp;
+    bool in_vg_frame = false;
+    frame_stats_t *stats;
 
     // Compute depth range.
     rend->depth_range[0] = DBL_MAX;
@@ -1416,9 +2554,17 @@ static void rend_flush(renderer_gl_t *rend)
         rend->depth_range[1] = 1;
     }
 
+    // Only clear the current viewport, the other views of the frame might
+    // have been rendered already.
     GL(glClearColor(0.0, 0.0, 0.0, 1.0));
+    GL(glEnable(GL_SCISSOR_TEST));
+    GL(glScissor(rend->viewport[0], rend->viewport[1],
+                 rend->viewport[2], rend->viewport[3]));
     GL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-    GL(glViewport(0, 0, rend->fb_size[0], rend->fb_size[1]));
+    GL(glDisable(GL_SCISSOR_TEST));
+    GL(glViewport(rend->viewport[0], rend->viewport[1],
+                  rend->viewport[2], rend->viewport[3]));
+    state_reset(rend);
 
     // On OpenGL Desktop, we have to enable point sprite support.
 #ifndef GLES2
@@ -1426,7 +2572,28 @@ static void rend_flush(renderer_gl_t *rend)
     GL(glEnable(GL_POINT_SPRITE));
 #endif
 
+    // Group the items by render state, and merge the ones we can draw in a
+    // single call.
+    sort_items(rend);
+    DL_FOREACH(rend->items, item) {
+        while (item->next && item_merge(item, item->next)) {
+            other = item->next;
+            DL_DELETE(rend->items, other);
+            item_delete(other);
+        }
+    }
+
+    // The nanovg items are all drawn when we end the nanovg frame, so we
+    // only count one draw call per frame.
+    stats = stats_begin_frame(rend);
     DL_FOREACH_SAFE(rend->items, item, tmp) {
+        if (!item_is_vg(item) || !in_vg_frame) core->prof.draw_calls++;
+        stats_add_item(stats, item);
+        if (item_is_vg(item) && !in_vg_frame) {
+            nvgBeginFrame(rend->vg, rend->fb_size[0] / rend->scale,
+                          rend->fb_size[1] / rend->scale, rend->scale);
+            in_vg_frame = true;
+        }
         if (item->type == ITEM_LINES) item_lines_render(rend, item);
         if (item->type == ITEM_LINES_GLOW) item_lines_glow_render(rend, item);
         if (item->type == ITEM_MESH) item_mesh_render(rend, item);
@@ -1436,20 +2603,25 @@ static void rend_flush(renderer_gl_t *rend)
         if (item->type == ITEM_TEXTURE || item->type == ITEM_ATMOSPHERE)
             item_texture_render(rend, item);
         if (item->type == ITEM_PLANET) item_planet_render(rend, item);
-        if (item->type == ITEM_VG_ELLIPSE) item_vg_render(rend, item);
-        if (item->type == ITEM_VG_RECT) item_vg_render(rend, item);
-        if (item->type == ITEM_VG_LINE) item_vg_render(rend, item);
         if (item->type == ITEM_TEXT) item_text_render(rend, item);
         if (item->type == ITEM_QUAD_WIREFRAME)
             item_quad_wireframe_render(rend, item);
+        if (item->type == ITEM_DOME) item_dome_render(rend, item);
+        if (in_vg_frame && (!item->next || !item_is_vg(item->next))) {
+            nvgEndFrame(rend->vg);
+            in_vg_frame = false;
+            state_reset(rend);
+        }
         DL_DELETE(rend->items, item);
-        texture_release(item->tex);
-        if (item->type == ITEM_PLANET)
-            texture_release(item->planet.normalmap);
-        gl_buf_release(&item->buf);
-        gl_buf_release(&item->indices);
-        free(item);
+        item_delete(item);
+    }
+    stats_end_frame(rend, stats);
+
+    HASH_ITER(hh, rend->retained_bufs, ret, ret_tmp) {
+        if (rend->frame - ret->last_used > RETAINED_BUF_MAX_AGE)
+            retained_buf_delete(rend, ret);
     }
+    rend->frame++;
 }
 
 static void finish(renderer_t *rend_)
@@ -1458,56 +2630,538 @@ static void finish(renderer_t *rend_)
     rend_flush(rend);
 }
 
-static void line_glow(renderer_t           *rend_,
-                      const painter_t      *painter,
-                      const double         (*line)[2],
-                      int                  size)
+static void viewport(renderer_t *rend_, const double rect[4])
 {
     renderer_gl_t *rend = (void*)rend_;
-    line_mesh_t *mesh;
-    int i, ofs;
-    float color[4];
+    if (rend->items) rend_flush(rend);
+    rend->viewport[0] = round(rect[0] * rend->scale);
+    rend->viewport[2] = round(rect[2] * rend->scale);
+    rend->viewport[3] = round(rect[3] * rend->scale);
+    rend->viewport[1] = rend->screen_size[1] - rend->viewport[3] -
+                        round(rect[1] * rend->scale);
+    rend->fb_size[0] = rend->viewport[2];
+    rend->fb_size[1] = rend->viewport[3];
+}
+
+static void barrier(renderer_t *rend_)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    if (rend->items) rend->items->prev->barrier = true;
+}
+
+static void offscreen_release(offscreen_t *off)
+{
+    GL(glDeleteFramebuffers(1, &off->fbo));
+    GL(glDeleteRenderbuffers(1, &off->depth));
+    texture_release(off->tex);
+    memset(off, 0, sizeof(*off));
+}
+
+/*
+ * Make sure an offscreen frame buffer has a given size.
+ *
+ * The frame buffer might be left bound, so the caller has to bind the one
+ * it wants to use after.
+ */
+static bool offscreen_init(offscreen_t *off, int w, int h, GLint filter)
+{
+    texture_t *tex = off->tex;
+
+    if (tex && tex->w == w && tex->h == h)
+        return true;
+    offscreen_release(off);
+    tex = texture_create(w, h, 4);
+    off->tex = tex;
+    GL(glBindTexture(GL_TEXTURE_2D, tex->id));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->tex_w, tex->tex_h, 0,
+                    GL_RGBA, GL_UNSIGNED_BYTE, NULL));
+    // The planets use the depth buffer.
+    GL(glGenRenderbuffers(1, &off->depth));
+    GL(glBindRenderbuffer(GL_RENDERBUFFER, off->depth));
+    GL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16,
+                             tex->tex_w, tex->tex_h));
+    GL(glGenFramebuffers(1, &off->fbo));
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, off->fbo));
+    GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_TEXTURE_2D, tex->id, 0));
+    GL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                 GL_RENDERBUFFER, off->depth));
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LOG_W("Cannot create an offscreen framebuffer of %dx%d", w, h);
+        offscreen_release(off);
+        return false;
+    }
+    return true;
+}
+
+// Make sure the layer framebuffer has the size of the current frame buffer.
+static bool layer_init(renderer_gl_t *rend)
+{
+    return offscreen_init(&rend->layer, rend->fb_size[0], rend->fb_size[1],
+                          GL_NEAREST);
+}
+
+/*
+ * Draw the bottom left w x h pixels of an offscreen texture on the whole
+ * frame buffer.
+ *
+ * This is an opaque quad: the offscreen framebuffers are cleared with an
+ * opaque color and the items don't change the destination alpha, so it
+ * simply replaces the frame buffer content.
+ */
+static void screen_quad(renderer_gl_t *rend, texture_t *tex, int w, int h)
+{
+    const int16_t INDICES[6] = {0, 1, 2, 3, 2, 1 };
     item_t *item;
+    texture_vertex_t *v;
+    uint16_t *indices;
+    int i;
 
-    vec4_to_float(painter->color, color);
-    mesh = line_to_mesh(line, size, 10);
+    item = item_new();
+    item->type = ITEM_TEXTURE;
+    gl_buf_alloc(&item->buf, &TEXTURE_BUF, 4);
+    gl_buf_alloc(&item->indices, &INDICES_BUF, 6);
+    item->tex = tex;
+    item->tex->ref++;
+    memcpy(item->color, (float[]){1, 1, 1, 1}, sizeof(item->color));
+    v = gl_buf_push(&item->buf, 4);
+    for (i = 0; i < 4; i++) {
+        v[i].pos[0] = (i % 2) * 2 - 1;
+        v[i].pos[1] = (i / 2) * 2 - 1;
+        v[i].tex_pos[0] = (i % 2) * (double)w / tex->tex_w;
+        v[i].tex_pos[1] = (i / 2) * (double)h / tex->tex_h;
+        memset(v[i].color, 255, sizeof(v[i].color));
+    }
+    indices = gl_buf_push(&item->indices, 6);
+    for (i = 0; i < 6; i++)
+        indices[i] = rend->cull_flipped ? INDICES[5 - i] : INDICES[i];
+    DL_APPEND(rend->items, item);
+}
+
+static bool layer_draw(renderer_t *rend_)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    texture_t *tex = rend->layer.tex;
+
+    if (!tex || tex->w != rend->fb_size[0] || tex->h != rend->fb_size[1])
+        return false;
+    screen_quad(rend, tex, tex->w, tex->h);
+    return true;
+}
+
+/*
+ * Function: layer_capture
+ * Flush all the current items into the layer framebuffer.
+ *
+ * The texture has the size of the frame buffer, and is kept until the
+ * next capture, so that the core can draw it again instead of the static
+ * modules.  We don't know what framebuffer the embedder uses, so we
+ * restore the one bound before.
+ */
+static bool layer_capture(renderer_t *rend_)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    GLint fbo;
+
+    GL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo));
+    if (!layer_init(rend)) {
+        GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+        return false;
+    }
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, rend->layer.fbo));
+    rend_flush(rend);
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+    return layer_draw(rend_);
+}
+
+/*
+ * Function: scaled_begin
+ * Render the next items into an offscreen frame buffer with a fraction of
+ * the current resolution, until <scaled_end>.
+ *
+ * The offscreen frame buffer has the full resolution, so that we don't
+ * need a new one each time the scale changes, and we only use its bottom
+ * left part.  We scale the frame buffer size and the pixel scale the same
+ * way, so that the items sizes in window pixels stay the same.
+ */
+static bool scaled_begin(renderer_t *rend_, double scale)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    GLint fbo;
+    bool ok;
+    int w, h;
+
+    assert(!rend->scaled.active && !rend->cubemap.active);
+    GL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo));
+    ok = offscreen_init(&rend->scaled.off, rend->fb_size[0],
+                        rend->fb_size[1], GL_LINEAR);
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+    if (!ok) return false;
+    if (rend->items) rend_flush(rend);
+
+    rend->scaled.active = true;
+    rend->scaled.scale = rend->scale;
+    memcpy(rend->scaled.fb_size, rend->fb_size, sizeof(rend->fb_size));
+    memcpy(rend->scaled.screen_size, rend->screen_size,
+           sizeof(rend->screen_size));
+    memcpy(rend->scaled.viewport, rend->viewport, sizeof(rend->viewport));
+    w = max(1, round(rend->fb_size[0] * scale));
+    h = max(1, round(rend->fb_size[1] * scale));
+    rend->scale *= scale;
+    rend->fb_size[0] = rend->screen_size[0] = w;
+    rend->fb_size[1] = rend->screen_size[1] = h;
+    memcpy(rend->viewport, (int[]){0, 0, w, h}, sizeof(rend->viewport));
+    return true;
+}
+
+/*
+ * Function: scaled_end
+ * Render the items painted since <scaled_begin> into the offscreen frame
+ * buffer, and draw it upscaled with a linear filter.
+ */
+static void scaled_end(renderer_t *rend_)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    GLint fbo;
+    const int w = rend->fb_size[0], h = rend->fb_size[1];
+
+    assert(rend->scaled.active);
+    GL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo));
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, rend->scaled.off.fbo));
+    rend_flush(rend);
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+
+    rend->scaled.active = false;
+    rend->scale = rend->scaled.scale;
+    memcpy(rend->fb_size, rend->scaled.fb_size, sizeof(rend->fb_size));
+    memcpy(rend->screen_size, rend->scaled.screen_size,
+           sizeof(rend->screen_size));
+    memcpy(rend->viewport, rend->scaled.viewport, sizeof(rend->viewport));
+    screen_quad(rend, rend->scaled.off.tex, w, h);
+}
+
+static int cubemap_init(renderer_t *rend_, int size)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    GLint fbo, max_size;
+
+    GL(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size));
+    size = min(size, max_size / 3);
+    GL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo));
+    if (!offscreen_init(&rend->cubemap.off, size * 3, size * 2, GL_LINEAR))
+        size = 0;
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+    rend->cubemap.size = size;
+    return size;
+}
+
+static void cubemap_face(renderer_t *rend_, int face)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    const int size = rend->cubemap.size;
+
+    assert(rend->cubemap.off.fbo && face >= 0 && face < 6);
+    // Flush the previous face, even if empty, so that it gets cleared.
+    if (rend->cubemap.active) {
+        rend_flush(rend);
+    } else {
+        GL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &rend->cubemap.prev_fbo));
+        GL(glBindFramebuffer(GL_FRAMEBUFFER, rend->cubemap.off.fbo));
+        rend->cubemap.active = true;
+    }
+    memcpy(rend->viewport,
+           (int[]){(face % 3) * size, (face / 3) * size, size, size},
+           sizeof(rend->viewport));
+    rend->fb_size[0] = rend->fb_size[1] = size;
+}
+
+/*
+ * Function: cubemap_warp
+ * Render the last cube map face, and draw the cube map on the whole frame
+ * buffer with the fisheye projection.
+ *
+ * We only need a single full screen pass: for each pixel the shader
+ * computes the direction with the inverse of the fisheye projection, and
+ * looks it up in the face that contains it.
+ */
+static void cubemap_warp(renderer_t *rend_, const double scale[2],
+                         const double faces[6][3][3])
+{
+    renderer_gl_t *rend = (void*)rend_;
+    const texture_t *tex = rend->cubemap.off.tex;
+    const int16_t INDICES[6] = {0, 1, 2, 3, 2, 1 };
+    item_t *item;
+    texture_vertex_t *v;
+    uint16_t *indices;
+    int i;
+
+    assert(rend->cubemap.active);
+    rend_flush(rend);
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, rend->cubemap.prev_fbo));
+    rend->cubemap.active = false;
+    memcpy(rend->viewport,
+           (int[]){0, 0, rend->screen_size[0], rend->screen_size[1]},
+           sizeof(rend->viewport));
+    rend->fb_size[0] = rend->screen_size[0];
+    rend->fb_size[1] = rend->screen_size[1];
+
+    item = item_new();
+    item->type = ITEM_DOME;
+    gl_buf_alloc(&item->buf, &TEXTURE_BUF, 4);
+    gl_buf_alloc(&item->indices, &INDICES_BUF, 6);
+    item->tex = rend->cubemap.off.tex;
+    item->tex->ref++;
+    v = gl_buf_push(&item->buf, 4);
+    for (i = 0; i < 4; i++) {
+        v[i].pos[0] = (i % 2) * 2 - 1;
+        v[i].pos[1] = (i / 2) * 2 - 1;
+        v[i].tex_pos[0] = v[i].tex_pos[1] = 0;
+        memset(v[i].color, 255, sizeof(v[i].color));
+    }
+    indices = gl_buf_push(&item->indices, 6);
+    for (i = 0; i < 6; i++)
+        indices[i] = INDICES[i];
+    item->dome.scale[0] = scale[0];
+    item->dome.scale[1] = scale[1];
+    for (i = 0; i < 6; i++) mat3_to_float(faces[i], item->dome.faces[i]);
+    item->dome.face_uv[0] = (double)rend->cubemap.size / tex->tex_w;
+    item->dome.face_uv[1] = (double)rend->cubemap.size / tex->tex_h;
+    item->dome.margin = 0.5 / rend->cubemap.size;
+    DL_APPEND(rend->items, item);
+}
+
+// Keep a copy of a mesh item for the picking, moved into window space.
+static void pick_add_mesh(renderer_gl_t *rend, const item_t *item,
+                          uint64_t oid)
+{
+    const mesh_vertex_t *src = (const mesh_vertex_t*)item->buf.data;
+    pick_mesh_t *mesh;
+    mesh_vertex_t *v;
+    double ofs[2];
+    int i;
+
+    // The dome faces are not in window space.
+    if (rend->cubemap.active || !item->indices.nb) return;
+    if (rend->pick.nb >= rend->pick.allocated) {
+        rend->pick.allocated = max(16, rend->pick.allocated * 2);
+        rend->pick.meshes = realloc(rend->pick.meshes,
+                rend->pick.allocated * sizeof(*rend->pick.meshes));
+    }
+    // Position of the current view in the window.
+    ofs[0] = rend->viewport[0] / rend->scale;
+    ofs[1] = (rend->screen_size[1] - rend->viewport[1] -
+              rend->viewport[3]) / rend->scale;
+
+    mesh = &rend->pick.meshes[rend->pick.nb++];
+    memset(mesh, 0, sizeof(*mesh));
+    mesh->oid = oid;
+    mesh->mode = item->mesh.mode;
+    gl_buf_alloc(&mesh->buf, &MESH_BUF, item->buf.nb);
+    v = gl_buf_push(&mesh->buf, item->buf.nb);
+    for (i = 0; i < item->buf.nb; i++) {
+        v[i].pos[0] = src[i].pos[0] + ofs[0];
+        v[i].pos[1] = src[i].pos[1] + ofs[1];
+    }
+    gl_buf_alloc(&mesh->indices, &INDICES_BUF, item->indices.nb);
+    memcpy(gl_buf_push(&mesh->indices, item->indices.nb),
+           item->indices.data, item->indices.nb * sizeof(uint16_t));
+}
+
+static void pick_clear(renderer_t *rend_)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    int i;
+    for (i = 0; i < rend->pick.nb; i++) {
+        gl_buf_release(&rend->pick.meshes[i].buf);
+        gl_buf_release(&rend->pick.meshes[i].indices);
+    }
+    rend->pick.nb = 0;
+}
+
+/*
+ * Function: pick
+ * Get the closest selectable mesh to a window position.
+ *
+ * Only called on demand, so there is no cost during the frames: we render
+ * all the kept meshes into a small offscreen buffer centered on the
+ * position, each one with its index encoded in the color, and read it
+ * back.  The meshes are drawn in the rendering order, so the one on top
+ * wins.  WebGL 1 doesn't support integer render targets, so the ids are
+ * stored in the rgb channels of a normal texture (up to 2^24 meshes).
+ */
+static bool pick(renderer_t *rend_, const double pos[2], double max_dist,
+                 uint64_t *oid)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    const int r = ceil(max_dist), size = 2 * r + 1;
+    const pick_mesh_t *mesh;
+    gl_shader_t *shader;
+    GLuint array_buffer, index_buffer;
+    GLint fbo, viewport[4];
+    gl_buf_t buf;
+    mesh_vertex_t *v;
+    uint8_t *pixels, *p;
+    float color[4], fbo_size[2] = {size, size};
+    int i, j, id, dist, best = 0, best_dist = r * r + 1;
+
+    if (!rend->pick.nb) return false;
+    GL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo));
+    GL(glGetIntegerv(GL_VIEWPORT, viewport));
+    if (!offscreen_init(&rend->pick.off, size, size, GL_NEAREST)) {
+        GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+        return false;
+    }
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, rend->pick.off.fbo));
+    GL(glViewport(0, 0, size, size));
+    GL(glClearColor(0.0, 0.0, 0.0, 0.0));
+    GL(glClear(GL_COLOR_BUFFER_BIT));
+
+    state_reset(rend);
+    state_enable(rend, GL_BLEND, false);
+    state_enable(rend, GL_CULL_FACE, false);
+    state_enable(rend, GL_DEPTH_TEST, false);
+    shader = shader_get("mesh", NULL, ATTR_NAMES, init_shader);
+    state_use_program(rend, shader->prog);
+    gl_update_uniform(shader, "u_fbo_size", fbo_size);
+    GL(glLineWidth(1));
+
+    for (i = 0; i < rend->pick.nb; i++) {
+        mesh = &rend->pick.meshes[i];
+        // Move the vertices so that the position is at the center of the
+        // buffer middle pixel.
+        gl_buf_alloc(&buf, &MESH_BUF, mesh->buf.nb);
+        v = gl_buf_push(&buf, mesh->buf.nb);
+        for (j = 0; j < mesh->buf.nb; j++) {
+            v[j].pos[0] = ((mesh_vertex_t*)mesh->buf.data)[j].pos[0] -
+                          pos[0] + r + 0.5;
+            v[j].pos[1] = ((mesh_vertex_t*)mesh->buf.data)[j].pos[1] -
+                          pos[1] + r + 0.5;
+        }
+        id = i + 1;
+        color[0] = ((id >> 0) & 0xff) / 255.0;
+        color[1] = ((id >> 8) & 0xff) / 255.0;
+        color[2] = ((id >> 16) & 0xff) / 255.0;
+        color[3] = 1.0;
+        gl_update_uniform(shader, "u_color", color);
+
+        GL(glGenBuffers(1, &index_buffer));
+        GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer));
+        GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                        mesh->indices.nb * mesh->indices.info->size,
+                        mesh->indices.data, GL_STREAM_DRAW));
+        GL(glGenBuffers(1, &array_buffer));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, array_buffer));
+        GL(glBufferData(GL_ARRAY_BUFFER, buf.nb * buf.info->size,
+                        buf.data, GL_STREAM_DRAW));
+        gl_buf_enable(&buf);
+        GL(glDrawElements(mesh->mode == 0 ? GL_TRIANGLES : GL_LINES,
+                          mesh->indices.nb, GL_UNSIGNED_SHORT, 0));
+        gl_buf_disable(&buf);
+        GL(glDeleteBuffers(1, &array_buffer));
+        GL(glDeleteBuffers(1, &index_buffer));
+        gl_buf_release(&buf);
+    }
 
-    if (mesh->indices_count >= 1024) {
+    pixels = malloc(size * size * 4);
+    GL(glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+    for (j = 0; j < size; j++)
+    for (i = 0; i < size; i++) {
+        p = pixels + (j * size + i) * 4;
+        id = p[0] | (p[1] << 8) | (p[2] << 16);
+        dist = (i - r) * (i - r) + (j - r) * (j - r);
+        if (id && id <= rend->pick.nb && dist < best_dist) {
+            best = id;
+            best_dist = dist;
+        }
+    }
+    free(pixels);
+
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+    GL(glViewport(viewport[0], viewport[1], viewport[2], viewport[3]));
+    state_reset(rend);
+    if (!best) return false;
+    *oid = rend->pick.meshes[best - 1].oid;
+    return true;
+}
+
+/*
+ * Function: wide_line
+ * Add a 2d line in window coordinates, rendered as an anti-aliased quads
+ * mesh with the lines shader.
+ *
+ * We only compute the line direction at each point, the quads are
+ * expanded in the vertex shader.
+ *
+ * The color and width are set per vertex, so that all the consecutive
+ * lines with the same glow share the same item, and are rendered in a
+ * single draw call.
+ */
+static void wide_line(renderer_gl_t *rend, const float color[4],
+                      float width, float glow,
+                      const double (*line)[2], int size)
+{
+    int i, k, ofs;
+    item_t *item;
+    uint16_t *indices;
+    uint8_t c[4];
+    double tangent[2];
+    line_glow_vertex_t *v;
+    // The quads have to cover the anti-aliasing and the 5px glow.
+    const float half_size = max(10, width + 4) / 2;
+
+    if (size < 2) return;
+    if (6 * (size - 1) >= 1024) {
         LOG_W("Too many points in lines! (size: %d)", size);
-        goto end;
+        return;
     }
 
     // Get the item.
-    item = get_item(rend, ITEM_LINES_GLOW, mesh->verts_count,
-                    mesh->indices_count, NULL);
-    if (item && memcmp(item->color, color, sizeof(color))) item = NULL;
-
+    item = get_item(rend, ITEM_LINES_GLOW, size * 2, 6 * (size - 1), NULL);
+    if (item && item->lines.glow != glow) item = NULL;
 
     if (!item) {
-        item = calloc(1, sizeof(*item));
+        item = item_new();
         item->type = ITEM_LINES_GLOW;
         gl_buf_alloc(&item->buf, &LINES_GLOW_BUF, 1024);
         gl_buf_alloc(&item->indices, &INDICES_BUF, 1024);
-        item->lines.width = painter->lines_width;
-        item->lines.glow = painter->lines_glow;
-        memcpy(item->color, color, sizeof(color));
+        item->lines.glow = glow;
+        memcpy(item->color, (float[]){1, 1, 1, 1}, sizeof(item->color));
         DL_APPEND(rend->items, item);
     }
 
-    // Append the mesh to the buffer.
+    for (i = 0; i < 4; i++) c[i] = clamp(color[i], 0.0, 1.0) * 255;
     ofs = item->buf.nb;
-    for (i = 0; i < mesh->verts_count; i++) {
-        gl_buf_2f(&item->buf, -1, ATTR_POS, VEC2_SPLIT(mesh->verts[i].pos));
-        gl_buf_2f(&item->buf, -1, ATTR_TEX_POS, VEC2_SPLIT(mesh->verts[i].uv));
-        gl_buf_next(&item->buf);
+    v = gl_buf_push(&item->buf, size * 2);
+    for (i = 0; i < size; i++) {
+        // Sum of the segments before and after the point.
+        vec2_sub(line[min(i + 1, size - 1)], line[max(i - 1, 0)], tangent);
+        for (k = 0; k < 2; k++) {
+            vec2_to_float(line[i], v[i * 2 + k].pos);
+            vec2_to_float(tangent, v[i * 2 + k].tangent);
+            vec2_set(v[i * 2 + k].tex_pos, width, k ? half_size : -half_size);
+            memcpy(v[i * 2 + k].color, c, sizeof(c));
+        }
     }
-    for (i = 0; i < mesh->indices_count; i++) {
-        gl_buf_1i(&item->indices, -1, 0, mesh->indices[i] + ofs);
-        gl_buf_next(&item->indices);
+    indices = gl_buf_push(&item->indices, 6 * (size - 1));
+    for (i = 0; i < size - 1; i++) {
+        for (k = 0; k < 6; k++)
+            indices[i * 6 + k] = ofs + i * 2 + (int[]){0, 1, 2, 3, 2, 1}[k];
     }
+}
 
-end:
-    line_mesh_delete(mesh);
+static void line_glow(renderer_t           *rend_,
+                      const painter_t      *painter,
+                      const double         (*line)[2],
+                      int                  size)
+{
+    float color[4];
+    vec4_to_float(painter->color, color);
+    wide_line((void*)rend_, color, painter->lines_width, painter->lines_glow,
+              line, size);
 }
 
 static void line(renderer_t           *rend_,
@@ -1520,6 +3174,8 @@ static void line(renderer_t           *rend_,
     item_t *item;
     float color[4];
     double pos[2];
+    line_vertex_t *v;
+    uint16_t *indices;
 
     if (painter->lines_glow) {
         line_glow(rend_, painter, line, size);
@@ -1532,7 +3188,7 @@ static void line(renderer_t           *rend_,
     if (item && item->lines.width != painter->lines_width) item = NULL;
 
     if (!item) {
-        item = calloc(1, sizeof(*item));
+        item = item_new();
         item->type = ITEM_LINES;
         gl_buf_alloc(&item->buf, &LINES_BUF, 1024);
         gl_buf_alloc(&item->indices, &INDICES_BUF, 1024);
@@ -1543,19 +3199,73 @@ static void line(renderer_t           *rend_,
 
     ofs = item->buf.nb;
 
+    v = gl_buf_push(&item->buf, size);
     for (i = 0; i < size; i++) {
         window_to_ndc(rend, line[i], pos);
-        gl_buf_2f(&item->buf, -1, ATTR_TEX_POS, (double)i / (size - 1), 0);
-        gl_buf_4f(&item->buf, -1, ATTR_POS, VEC2_SPLIT(pos), 0.0, 1.0);
-        gl_buf_4i(&item->buf, -1, ATTR_COLOR, 255, 255, 255, 255);
-        gl_buf_next(&item->buf);
-        if (i < size - 1) {
-            gl_buf_1i(&item->indices, -1, 0, ofs + i);
-            gl_buf_next(&item->indices);
-            gl_buf_1i(&item->indices, -1, 0, ofs + i + 1);
-            gl_buf_next(&item->indices);
-        }
+        vec4_to_float(VEC(pos[0], pos[1], 0.0, 1.0), v[i].pos);
+        v[i].tex_pos[0] = (double)i / (size - 1);
+        v[i].tex_pos[1] = 0;
+        memset(v[i].color, 255, sizeof(v[i].color));
+    }
+    indices = gl_buf_push(&item->indices, max(size - 1, 0) * 2);
+    for (i = 0; i < size - 1; i++) {
+        indices[i * 2 + 0] = ofs + i;
+        indices[i * 2 + 1] = ofs + i + 1;
+    }
+}
+
+/*
+ * Function: mesh_retained
+ * Try to render a mesh from retained GPU buffers.
+ *
+ * This is only possible if the conversion to the view frame is a rotation,
+ * and the shader supports the projection.  Otherwise return false, and the
+ * mesh has to be projected on the CPU.
+ */
+static bool mesh_retained(renderer_gl_t *rend, const painter_t *painter,
+                          int frame, int mode, int verts_count,
+                          const double verts[][3], int indices_count,
+                          const uint16_t indices[],
+                          uint64_t buf_id, int buf_version)
+{
+    int i;
+    double rot[3][3];
+    float (*data)[3];
+    item_t *item;
+    retained_buf_t *ret;
+
+    if (!retained_proj_supported(painter->proj)) return false;
+    if (!painter_get_frame_to_view_matrix(painter, frame, rot)) return false;
+
+    ret = get_retained_buf(rend, ITEM_MESH, buf_id, buf_version);
+    if (!ret->array_buffer) {
+        data = malloc(verts_count * sizeof(*data));
+        for (i = 0; i < verts_count; i++) vec3_to_float(verts[i], data[i]);
+        GL(glGenBuffers(1, &ret->array_buffer));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, ret->array_buffer));
+        GL(glBufferData(GL_ARRAY_BUFFER, verts_count * sizeof(*data),
+                        data, GL_STATIC_DRAW));
+        free(data);
+    }
+    if (!ret->index_buffers[mode]) {
+        GL(glGenBuffers(1, &ret->index_buffers[mode]));
+        GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ret->index_buffers[mode]));
+        GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                        indices_count * sizeof(*indices), indices,
+                        GL_STATIC_DRAW));
+        ret->indices_count[mode] = indices_count;
     }
+
+    item = item_new();
+    item->type = ITEM_MESH;
+    vec4_to_float(painter->color, item->color);
+    item->mesh.mode = mode;
+    item->mesh.stroke_width = painter->lines_width;
+    // Empty buffer, only used to enable the attributes.
+    item->buf.info = &RETAINED_MESH_BUF;
+    set_retained_item(item, ret, painter, rot);
+    DL_APPEND(rend->items, item);
+    return true;
 }
 
 static void mesh(renderer_t          *rend_,
@@ -1566,14 +3276,24 @@ static void mesh(renderer_t          *rend_,
                  const double        verts[][3],
                  int                 indices_count,
                  const uint16_t      indices[],
-                 uint64_t            oid)
+                 uint64_t            oid,
+                 uint64_t            buf_id,
+                 int                 buf_version)
 {
     int i;
     double pos[4];
     item_t *item;
     renderer_gl_t *rend = (void*)rend_;
+    mesh_vertex_t *v;
 
-    item = calloc(1, sizeof(*item));
+    // The shape areas need the projected vertices, so we can only use the
+    // retained buffers for meshes that cannot be selected.
+    if (buf_id && !oid &&
+            mesh_retained(rend, painter, frame, mode, verts_count, verts,
+                          indices_count, indices, buf_id, buf_version))
+        return;
+
+    item = item_new();
     item->type = ITEM_MESH;
     vec4_to_float(painter->color, item->color);
     item->mesh.mode = mode;
@@ -1582,6 +3302,7 @@ static void mesh(renderer_t          *rend_,
     gl_buf_alloc(&item->indices, &INDICES_BUF, indices_count);
 
     // Project the vertices.
+    v = gl_buf_push(&item->buf, verts_count);
     for (i = 0; i < verts_count; i++) {
         vec3_copy(verts[i], pos);
         pos[3] = 0.0;
@@ -1591,17 +3312,16 @@ static void mesh(renderer_t          *rend_,
         pos[3] = 0.0;
         project(painter->proj, PROJ_ALREADY_NORMALIZED | PROJ_TO_WINDOW_SPACE,
                 4, pos, pos);
-        gl_buf_2f(&item->buf, -1, ATTR_POS, VEC2_SPLIT(pos));
-        gl_buf_next(&item->buf);
+        vec2_to_float(pos, v[i].pos);
     }
 
     // Fill the indice buffer.
-    for (i = 0; i < indices_count; i++) {
-        gl_buf_1i(&item->indices, -1, 0, indices[i]);
-        gl_buf_next(&item->indices);
-    }
+    memcpy(gl_buf_push(&item->indices, indices_count), indices,
+           indices_count * sizeof(*indices));
 
-    if (oid) {
+    if (oid && core->gpu_picking) {
+        pick_add_mesh(rend, item, oid);
+    } else if (oid) {
         areas_add_triangles_mesh(core->areas, verts_count,
                 item->buf.data, indices_count, item->indices.data,
                 oid, 0);
@@ -1610,50 +3330,85 @@ static void mesh(renderer_t          *rend_,
     DL_APPEND(rend->items, item);
 }
 
+// Max number of segments of the 2d ellipses.
+#define ELLIPSE_MAX_SEGS 128
+
+// Compute a point of a rotated 2d ellipse at a given parametric angle.
+static void ellipse_2d_point(const double pos[2], const double size[2],
+                             double angle, double a, double out[2])
+{
+    double x = size[0] * cos(a), y = size[1] * sin(a);
+    out[0] = pos[0] + x * cos(angle) - y * sin(angle);
+    out[1] = pos[1] + x * sin(angle) + y * cos(angle);
+}
+
+/*
+ * The 2d shapes are tessellated into wide lines, so that all the shapes
+ * of the same color end up in a single draw call instead of one nanovg
+ * path each.
+ */
 static void ellipse_2d(renderer_t *rend_, const painter_t *painter,
                        const double pos[2], const double size[2],
                        double angle)
 {
     renderer_gl_t *rend = (void*)rend_;
-    item_t *item;
-    item = calloc(1, sizeof(*item));
-    item->type = ITEM_VG_ELLIPSE;
-    vec2_to_float(pos, item->vg.pos);
-    vec2_to_float(size, item->vg.size);
-    vec4_to_float(painter->color, item->color);
-    item->vg.angle = angle;
-    item->vg.dashes = painter->lines_stripes;
-    item->vg.stroke_width = painter->lines_width;
-    DL_APPEND(rend->items, item);
+    double line[ELLIPSE_MAX_SEGS + 1][2], a0, da;
+    float color[4];
+    int i, k, n, nb, dashes = painter->lines_stripes;
+
+    vec4_to_float(painter->color, color);
+    // Keep the chords within a quarter of pixel from the ellipse.
+    n = clamp(ceil(4.5 * sqrt(max(size[0], size[1]))), 8, ELLIPSE_MAX_SEGS);
+    if (!dashes) {
+        for (i = 0; i <= n; i++)
+            ellipse_2d_point(pos, size, angle, 2 * M_PI * i / n, line[i]);
+        wide_line(rend, color, painter->lines_width, 0, line, n + 1);
+        return;
+    }
+    // Each dash covers the first half of its part of the ellipse.
+    nb = max(1, n / dashes / 2);
+    da = M_PI / dashes / nb;
+    for (k = 0; k < dashes; k++) {
+        a0 = 2 * M_PI * k / dashes;
+        for (i = 0; i <= nb; i++)
+            ellipse_2d_point(pos, size, angle, a0 + i * da, line[i]);
+        wide_line(rend, color, painter->lines_width, 0, line, nb + 1);
+    }
 }
 
 static void rect_2d(renderer_t *rend_, const painter_t *painter,
                     const double pos[2], const double size[2], double angle)
 {
     renderer_gl_t *rend = (void*)rend_;
-    item_t *item;
-    item = calloc(1, sizeof(*item));
-    item->type = ITEM_VG_RECT;
-    vec2_to_float(pos, item->vg.pos);
-    vec2_to_float(size, item->vg.size);
-    vec4_to_float(painter->color, item->color);
-    item->vg.angle = angle;
-    item->vg.stroke_width = painter->lines_width;
-    DL_APPEND(rend->items, item);
+    double corners[4][2], dir[2], line[2][2];
+    float color[4];
+    const double w = painter->lines_width;
+    int i;
+
+    vec4_to_float(painter->color, color);
+    for (i = 0; i < 4; i++) {
+        ellipse_2d_point(pos, VEC(size[0] * M_SQRT2, size[1] * M_SQRT2),
+                         angle, M_PI / 4 + i * M_PI / 2, corners[i]);
+    }
+    // Each side is extended by half the width to fill the corners.
+    for (i = 0; i < 4; i++) {
+        vec2_sub(corners[(i + 1) % 4], corners[i], dir);
+        if (vec2_norm2(dir) == 0) continue;
+        vec2_normalize(dir, dir);
+        vec2_addk(corners[i], dir, -w / 2, line[0]);
+        vec2_addk(corners[(i + 1) % 4], dir, w / 2, line[1]);
+        wide_line(rend, color, w, 0, line, 2);
+    }
 }
 
 static void line_2d(renderer_t *rend_, const painter_t *painter,
                     const double p1[2], const double p2[2])
 {
     renderer_gl_t *rend = (void*)rend_;
-    item_t *item;
-    item = calloc(1, sizeof(*item));
-    item->type = ITEM_VG_LINE;
-    vec2_to_float(p1, item->vg.pos);
-    vec2_to_float(p2, item->vg.pos2);
-    vec4_to_float(painter->color, item->color);
-    item->vg.stroke_width = painter->lines_width;
-    DL_APPEND(rend->items, item);
+    float color[4];
+    vec4_to_float(painter->color, color);
+    wide_line(rend, color, painter->lines_width, 0,
+              (const double[][2]){{p1[0], p1[1]}, {p2[0], p2[1]}}, 2);
 }
 
 static texture_t *create_white_texture(int w, int h)
@@ -1691,6 +3446,39 @@ static int on_font(void *user, const char *path,
     return 0;
 }
 
+static json_value *get_stats(renderer_t *rend_)
+{
+    renderer_gl_t *rend = (void*)rend_;
+    const frame_stats_t *stats = rend->stats.last;
+    json_value *ret, *items, *item;
+    bool gpu;
+    int i;
+
+    if (!stats) return json_null_new();
+    gpu = stats->nb_queries > 0;
+    ret = json_object_new(0);
+    json_object_push(ret, "frame", json_integer_new(stats->frame));
+    json_object_push(ret, "texture_uploads",
+                     json_integer_new(stats->tex_uploads));
+    json_object_push(ret, "texture_bytes",
+                     json_integer_new(stats->tex_bytes));
+    json_object_push(ret, "vg_gpu_time",
+            gpu ? json_double_new(stats->vg_gpu_time) : json_null_new());
+    items = json_object_push(ret, "items", json_object_new(0));
+    for (i = 1; i < ITEM_COUNT; i++) {
+        if (!stats->items[i].draw_calls) continue;
+        item = json_object_push(items, ITEM_NAMES[i], json_object_new(0));
+        json_object_push(item, "draw_calls",
+                         json_integer_new(stats->items[i].draw_calls));
+        json_object_push(item, "vertices",
+                         json_integer_new(stats->items[i].vertices));
+        json_object_push(item, "gpu_time",
+            gpu ? json_double_new(stats->items[i].gpu_time) :
+                  json_null_new());
+    }
+    return ret;
+}
+
 renderer_t* render_gl_create(void)
 {
     renderer_gl_t *rend;
@@ -1712,9 +3500,27 @@ renderer_t* render_gl_create(void)
     if (range[1] < 32)
         LOG_W("OpenGL Doesn't support large point size!");
 
+    preload_shaders();
+
+#if HAS_TIMER_QUERIES
+    const char *extensions = (const char*)glGetString(GL_EXTENSIONS);
+    rend->stats.timer_queries =
+        extensions && strstr(extensions, TIMER_QUERIES_EXTENSION);
+#endif
+
     rend->rend.prepare = prepare;
     rend->rend.finish = finish;
+    rend->rend.barrier = barrier;
+    rend->rend.layer_capture = layer_capture;
+    rend->rend.layer_draw = layer_draw;
+    rend->rend.scaled_begin = scaled_begin;
+    rend->rend.scaled_end = scaled_end;
+    rend->rend.viewport = viewport;
+    rend->rend.cubemap_init = cubemap_init;
+    rend->rend.cubemap_face = cubemap_face;
+    rend->rend.cubemap_warp = cubemap_warp;
     rend->rend.points_2d = points;
+    rend->rend.points_3d = points_3d;
     rend->rend.quad = quad;
     rend->rend.quad_wireframe = quad_wireframe;
     rend->rend.texture = texture;
@@ -1724,6 +3530,9 @@ renderer_t* render_gl_create(void)
     rend->rend.ellipse_2d = ellipse_2d;
     rend->rend.rect_2d = rect_2d;
     rend->rend.line_2d = line_2d;
+    rend->rend.get_stats = get_stats;
+    rend->rend.pick_clear = pick_clear;
+    rend->rend.pick = pick;
 
     return &rend->rend;
 }
@@ -0,0 +1,405 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "swe.h"
+
+/*
+ * The names are normalized to lower case letters and digits, and prefixed
+ * by a start symbol, so that 'M 31' gives the trigrams '^m3' and 'm31'.
+ * Each trigram has a posting list of the indices of the entries that
+ * contain it, sorted since we only ever append entries.
+ */
+
+// Start symbol, then the digits, then the letters.
+#define NB_SYMBOLS 37
+#define NB_TRIGRAMS (NB_SYMBOLS * NB_SYMBOLS * NB_SYMBOLS)
+
+// Max length of a normalized name, longer names are truncated.
+#define NAME_MAX_LEN 63
+
+// The fuzzy search ignores the trigrams with longer posting lists, since
+// they are too common to tell anything about the matches.
+#define FUZZY_MAX_POSTING 65536
+
+typedef struct {
+    obj_t       *module;
+    uint64_t    oid;
+    uint64_t    hint;
+    uint32_t    name;   // Offset of the name in the names buffer.
+    uint8_t     len;    // Length of the normalized name.
+} entry_t;
+
+typedef struct {
+    int         nb;
+    int         allocated;
+    uint32_t    *v;
+} posting_t;
+
+static struct {
+    int         nb;
+    int         allocated;
+    entry_t     *entries;
+    char        *names;
+    int         names_size;
+    int         names_allocated;
+    posting_t   *postings; // NB_TRIGRAMS lists.
+} g = {};
+
+static int symbol(char c)
+{
+    if (c >= '0' && c <= '9') return 1 + c - '0';
+    if (c >= 'a' && c <= 'z') return 11 + c - 'a';
+    if (c >= 'A' && c <= 'Z') return 11 + c - 'A';
+    return 0;
+}
+
+// Turn a name into a list of symbols.  Return the length.
+static int normalize(const char *name, uint8_t out[NAME_MAX_LEN])
+{
+    int len = 0, s;
+    if (strncmp(name, "NAME ", 5) == 0) name += 5;
+    for (; *name && len < NAME_MAX_LEN; name++) {
+        if ((s = symbol(*name))) out[len++] = s;
+    }
+    return len;
+}
+
+static int trigrams_cmp(const void *a, const void *b)
+{
+    return cmp(*(const int*)a, *(const int*)b);
+}
+
+/*
+ * Compute the sorted unique trigrams of a normalized name.
+ *
+ * Parameters:
+ *   s      - The normalized name.
+ *   len    - Length of the normalized name.
+ *   start  - If set, include the trigram with the start symbol.
+ *   out    - Receive the trigrams.
+ *
+ * Return:
+ *   The number of trigrams.
+ */
+static int get_trigrams(const uint8_t *s, int len, bool start,
+                        int out[NAME_MAX_LEN])
+{
+    int i, j, nb = 0;
+    if (start && len >= 2) out[nb++] = s[0] * NB_SYMBOLS + s[1];
+    for (i = 0; i + 2 < len; i++)
+        out[nb++] = (s[i] * NB_SYMBOLS + s[i + 1]) * NB_SYMBOLS + s[i + 2];
+    qsort(out, nb, sizeof(*out), trigrams_cmp);
+    for (i = 0, j = 0; i < nb; i++) {
+        if (j && out[j - 1] == out[i]) continue;
+        out[j++] = out[i];
+    }
+    return j;
+}
+
+static void posting_add(posting_t *p, uint32_t v)
+{
+    if (p->nb >= p->allocated) {
+        p->allocated = max(4, p->allocated * 2);
+        p->v = realloc(p->v, p->allocated * sizeof(*p->v));
+    }
+    p->v[p->nb++] = v;
+}
+
+static bool posting_contains(const posting_t *p, uint32_t v)
+{
+    int lo = 0, hi = p->nb - 1, mid;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (p->v[mid] == v) return true;
+        if (p->v[mid] < v) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return false;
+}
+
+void search_add(obj_t *module, const char *name, uint64_t oid,
+                uint64_t hint)
+{
+    uint8_t s[NAME_MAX_LEN];
+    int i, len, size, nb, trigrams[NAME_MAX_LEN];
+    entry_t *e;
+
+    if (!name) return;
+    len = normalize(name, s);
+    if (len < 2) return;
+
+    if (!g.postings) g.postings = calloc(NB_TRIGRAMS, sizeof(*g.postings));
+    if (g.nb >= g.allocated) {
+        g.allocated = max(1024, g.allocated * 2);
+        g.entries = realloc(g.entries, g.allocated * sizeof(*g.entries));
+    }
+    size = strlen(name) + 1;
+    if (g.names_size + size > g.names_allocated) {
+        g.names_allocated = max(g.names_size + size,
+                                max(1 << 16, g.names_allocated * 2));
+        g.names = realloc(g.names, g.names_allocated);
+    }
+    e = &g.entries[g.nb];
+    e->module = module;
+    e->oid = oid;
+    e->hint = hint;
+    e->name = g.names_size;
+    e->len = len;
+    memcpy(g.names + g.names_size, name, size);
+    g.names_size += size;
+
+    nb = get_trigrams(s, len, true, trigrams);
+    for (i = 0; i < nb; i++) posting_add(&g.postings[trigrams[i]], g.nb);
+    g.nb++;
+}
+
+static void add_designation_callback(const obj_t *obj, void *user,
+                                     const char *cat, const char *value)
+{
+    obj_t *module = USER_GET(user, 0);
+    uint64_t hint = *(uint64_t*)USER_GET(user, 1);
+    char buf[128];
+
+    if (!*cat || strcmp(cat, "NAME") == 0) {
+        search_add(module, value, obj->oid, hint);
+        return;
+    }
+    snprintf(buf, sizeof(buf), "%s %s", cat, value);
+    search_add(module, buf, obj->oid, hint);
+}
+
+void search_add_designations(obj_t *module, const obj_t *obj, uint64_t hint)
+{
+    obj_get_designations(obj, USER_PASS(module, &hint),
+                         add_designation_callback);
+}
+
+void search_remove_module(const obj_t *module)
+{
+    int i, j, size, names_size = 0, nb = 0;
+    int32_t *map;
+    posting_t *p;
+    entry_t *e;
+
+    for (i = 0; i < g.nb; i++) {
+        if (g.entries[i].module == module) break;
+    }
+    if (i == g.nb) return;
+
+    // Compact the entries and the names, keeping their order so that the
+    // posting lists stay sorted.
+    map = malloc(g.nb * sizeof(*map));
+    for (i = 0; i < g.nb; i++) {
+        e = &g.entries[i];
+        if (e->module == module) {
+            map[i] = -1;
+            continue;
+        }
+        size = strlen(g.names + e->name) + 1;
+        memmove(g.names + names_size, g.names + e->name, size);
+        e->name = names_size;
+        names_size += size;
+        g.entries[nb] = *e;
+        map[i] = nb++;
+    }
+    for (i = 0; i < NB_TRIGRAMS; i++) {
+        p = &g.postings[i];
+        for (j = 0, size = 0; j < p->nb; j++) {
+            if (map[p->v[j]] >= 0) p->v[size++] = map[p->v[j]];
+        }
+        p->nb = size;
+    }
+    free(map);
+    g.nb = nb;
+    g.names_size = names_size;
+}
+
+// Add a result, keeping the list sorted and only one result per object.
+static int results_add(search_result_t *out, int nb, int max_nb,
+                       const entry_t *e, double score)
+{
+    int i;
+    search_result_t r = {e->module, e->oid, e->hint, g.names + e->name,
+                         score};
+
+    for (i = 0; i < nb; i++) {
+        if (out[i].oid == e->oid && out[i].module == e->module) break;
+    }
+    if (i < nb) {
+        if (out[i].score >= score) return nb;
+        memmove(&out[i], &out[i + 1], (nb - i - 1) * sizeof(*out));
+        nb--;
+    }
+    if (nb == max_nb && out[nb - 1].score >= score) return nb;
+    for (i = min(nb, max_nb - 1); i > 0 && out[i - 1].score < score; i--)
+        out[i] = out[i - 1];
+    out[i] = r;
+    return min(nb + 1, max_nb);
+}
+
+// Return the position of a normalized string in another one, or -1.
+static int find_symbols(const uint8_t *s, int len, const uint8_t *q, int qlen)
+{
+    int i;
+    for (i = 0; i + qlen <= len; i++) {
+        if (memcmp(s + i, q, qlen) == 0) return i;
+    }
+    return -1;
+}
+
+// Search the entries containing all the query symbols in order.
+static int query_substrings(const uint8_t *q, int qlen, int max_nb,
+                            search_result_t *out)
+{
+    int i, j, k, nb_trigrams, nb = 0, trigrams[NAME_MAX_LEN], len, pos;
+    const posting_t *lists[NAME_MAX_LEN], *tmp;
+    uint8_t s[NAME_MAX_LEN];
+    const entry_t *e;
+    double score;
+
+    // Two symbols queries only match the start of the names.
+    nb_trigrams = get_trigrams(q, qlen, qlen == 2, trigrams);
+    if (!nb_trigrams) return 0;
+    for (i = 0; i < nb_trigrams; i++)
+        lists[i] = &g.postings[trigrams[i]];
+    // Start from the shortest list.
+    for (i = 1; i < nb_trigrams; i++) {
+        if (lists[i]->nb < lists[0]->nb) {
+            tmp = lists[0]; lists[0] = lists[i]; lists[i] = tmp;
+        }
+    }
+
+    for (i = 0; i < lists[0]->nb; i++) {
+        k = lists[0]->v[i];
+        for (j = 1; j < nb_trigrams; j++) {
+            if (!posting_contains(lists[j], k)) break;
+        }
+        if (j < nb_trigrams) continue;
+        e = &g.entries[k];
+        if (qlen == 2) {
+            pos = 0;
+        } else {
+            len = normalize(g.names + e->name, s);
+            pos = find_symbols(s, len, q, qlen);
+            if (pos < 0) continue;
+        }
+        score = (pos == 0) ? (e->len == qlen ? 3 : 2) : 1;
+        // Favor the short names.
+        score += (double)qlen / e->len;
+        nb = results_add(out, nb, max_nb, e, min(score, 3.999));
+    }
+    return nb;
+}
+
+// Search the entries that share most of the query trigrams.
+static int query_fuzzy(const uint8_t *q, int qlen, int max_nb, int nb,
+                       search_result_t *out)
+{
+    int i, j, k, nb_trigrams, trigrams[NAME_MAX_LEN], nb_touched = 0;
+    const posting_t *p;
+    uint8_t *counts;
+    uint32_t *touched = NULL;
+    int touched_allocated = 0;
+
+    nb_trigrams = get_trigrams(q, qlen, true, trigrams);
+    if (nb_trigrams < 3) return nb;
+    counts = calloc(g.nb, 1);
+    for (i = 0; i < nb_trigrams; i++) {
+        p = &g.postings[trigrams[i]];
+        if (p->nb > FUZZY_MAX_POSTING) continue;
+        for (j = 0; j < p->nb; j++) {
+            k = p->v[j];
+            if (counts[k]++) continue;
+            if (nb_touched >= touched_allocated) {
+                touched_allocated = max(256, touched_allocated * 2);
+                touched = realloc(touched,
+                                  touched_allocated * sizeof(*touched));
+            }
+            touched[nb_touched++] = k;
+        }
+    }
+    // One typo changes up to three trigrams.
+    for (i = 0; i < nb_touched; i++) {
+        k = touched[i];
+        if (counts[k] * 2 < nb_trigrams) continue;
+        if (counts[k] + 3 < nb_trigrams) continue;
+        nb = results_add(out, nb, max_nb, &g.entries[k],
+                         0.9 * counts[k] / max(nb_trigrams,
+                                               g.entries[k].len - 1));
+    }
+    free(touched);
+    free(counts);
+    return nb;
+}
+
+int search_query(const char *query, int max_nb, search_result_t *out)
+{
+    uint8_t q[NAME_MAX_LEN];
+    int qlen, nb;
+
+    if (!g.nb || max_nb <= 0) return 0;
+    qlen = normalize(query, q);
+    if (qlen < 2) return 0;
+    nb = query_substrings(q, qlen, max_nb, out);
+    if (nb < max_nb) nb = query_fuzzy(q, qlen, max_nb, nb, out);
+    return nb;
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static void test_search(void)
+{
+    obj_t module = {};
+    search_result_t res[8];
+    int i, nb;
+    typeof(g) saved = g;
+
+    // Don't mix up the test with the names added by the modules.
+    memset(&g, 0, sizeof(g));
+
+    search_add(&module, "NAME Polaris", 1, 10);
+    search_add(&module, "* alf UMi", 1, 10);
+    search_add(&module, "M 31", 2, 0);
+    search_add(&module, "NAME Andromeda Galaxy", 2, 0);
+    search_add(&module, "M 3", 3, 0);
+    search_add(&module, "NAME Polaris Australis", 4, 0);
+
+    // Exact match first, then the prefix matches.
+    nb = search_query("m3", 8, res);
+    assert(nb == 2 && res[0].oid == 3 && res[1].oid == 2);
+    assert(res[0].score >= 3 && res[1].score >= 2 && res[1].score < 3);
+
+    // Only one result per object.
+    nb = search_query("polaris", 8, res);
+    assert(nb == 2 && res[0].oid == 1 && res[0].hint == 10);
+    assert(strcmp(res[0].name, "NAME Polaris") == 0);
+
+    // Substring match.
+    nb = search_query("galaxy", 8, res);
+    assert(nb == 1 && res[0].oid == 2 && res[0].score < 2);
+
+    // Typo.
+    nb = search_query("Andromedda", 8, res);
+    assert(nb == 1 && res[0].oid == 2 && res[0].score < 1);
+
+    search_remove_module(&module);
+    assert(search_query("polaris", 8, res) == 0);
+
+    for (i = 0; i < NB_TRIGRAMS; i++) free(g.postings[i].v);
+    free(g.postings);
+    free(g.entries);
+    free(g.names);
+    g = saved;
+}
+
+TEST_REGISTER(NULL, test_search, TEST_AUTO);
+
+#endif
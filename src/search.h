@@ -0,0 +1,101 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdint.h>
+
+typedef struct obj obj_t;
+
+/*
+ * File: search.h
+ * Global full text index of the objects designations.
+ *
+ * The modules add the names of their objects as they get them, and the
+ * index returns ranked oids and hints that can then be passed to
+ * <obj_get_by_oid>.  The names are indexed by trigrams of their normalized
+ * form (lower case letters and digits only), so that we can find partial
+ * matches, and also names with a typo.
+ *
+ * All the functions should be called from the main thread.
+ */
+
+/*
+ * Type: search_result_t
+ * A result of <search_query>.
+ *
+ * Attributes:
+ *   module - The module that added the name.
+ *   oid    - The object oid.
+ *   hint   - The hint to pass to <obj_get_by_oid>.
+ *   name   - The matching name, valid until the index changes.
+ *   score  - Higher is better: 3 and above for an exact match, 2 and
+ *            above for a prefix match, 1 and above for a substring match,
+ *            and below 1 for a fuzzy match.
+ */
+typedef struct {
+    obj_t       *module;
+    uint64_t    oid;
+    uint64_t    hint;
+    const char  *name;
+    double      score;
+} search_result_t;
+
+/*
+ * Function: search_add
+ * Add an object name to the index.
+ *
+ * Parameters:
+ *   module - The module owning the object.
+ *   name   - A name or designation of the object, e.g. 'NGC 224'.  The
+ *            'NAME ' prefix is ignored.
+ *   oid    - The object oid.
+ *   hint   - Hint value passed to the module get_by_oid method.
+ */
+void search_add(obj_t *module, const char *name, uint64_t oid,
+                uint64_t hint);
+
+/*
+ * Function: search_add_designations
+ * Add all the designations of an object to the index.
+ *
+ * Parameters:
+ *   module - The module owning the object.
+ *   obj    - The object.
+ *   hint   - Hint value passed to the module get_by_oid method.
+ */
+void search_add_designations(obj_t *module, const obj_t *obj, uint64_t hint);
+
+/*
+ * Function: search_remove_module
+ * Remove all the names added by a module.
+ *
+ * This is automatically called when a module is destroyed.
+ */
+void search_remove_module(const obj_t *module);
+
+/*
+ * Function: search_query
+ * Search the index for the objects matching a string.
+ *
+ * Each object is returned at most once, with its best matching name.
+ * Queries shorter than two letters or digits return no results.
+ *
+ * Parameters:
+ *   query  - The searched string, e.g. 'andromeda', 'M 3', 'polaris'.
+ *   max_nb - Max number of results.
+ *   out    - Receive the results, sorted by decreasing score.
+ *
+ * Return:
+ *   The number of results.
+ */
+int search_query(const char *query, int max_nb, search_result_t *out);
+
+#endif // SEARCH_H
@@ -61,6 +61,26 @@ bool sgp4(sgp4_elsetrec_t *satrec, double utc_mjd, double r[3], double v[3])
     return SGP4Funcs::sgp4(*((elsetrec*)satrec), tsince, r, v);
 }
 
+void sgp4_batch(int n, sgp4_elsetrec_t *const *satrecs, double utc_mjd,
+                double (*r)[3], double (*v)[3], bool *ok)
+{
+    int i;
+    double tsince;
+    elsetrec *elrec;
+    for (i = 0; i < n; i++) {
+        elrec = (elsetrec*)satrecs[i];
+        tsince = utc_mjd - (elrec->jdsatepoch - 2400000.5 +
+                            elrec->jdsatepochF);
+        tsince *= 24 * 60; // Put in min.
+        ok[i] = SGP4Funcs::sgp4(*elrec, tsince, r[i], v[i]);
+    }
+}
+
+int sgp4_get_elsetrec_size(void)
+{
+    return sizeof(elsetrec);
+}
+
 /*
  * Function: sgp4_get_satepoch
  * Return the reference epoch of a sat (UTC MJD)
@@ -70,3 +90,12 @@ double sgp4_get_satepoch(const sgp4_elsetrec_t *satrec)
     elsetrec *elrec = (elsetrec*)satrec;
     return (elrec->jdsatepoch + elrec->jdsatepochF) - 2400000.5;
 }
+
+void sgp4_get_elements(const sgp4_elsetrec_t *satrec,
+                       double *inclo, double *ecco, double *no)
+{
+    elsetrec *elrec = (elsetrec*)satrec;
+    *inclo = elrec->inclo;
+    *ecco = elrec->ecco;
+    *no = elrec->no_unkozai;
+}
@@ -23,8 +23,49 @@ sgp4_elsetrec_t *sgp4_twoline2rv(
 
 bool sgp4(sgp4_elsetrec_t *satrec, double utc_mjd, double r[3], double v[3]);
 
+/*
+ * Function: sgp4_batch
+ * Compute the positions of several satellites at the same time.
+ *
+ * Same as calling <sgp4> for each satellite.  Each record is only
+ * accessed by its own computation, so different batches can run in
+ * parallel.
+ *
+ * Parameters:
+ *   n        - Number of satellites.
+ *   satrecs  - Array of n satellites records.
+ *   utc_mjd  - Time of the computation.
+ *   r        - Output positions (km).
+ *   v        - Output velocities (km/s).
+ *   ok       - Set to false for the satellites we couldn't compute.
+ */
+void sgp4_batch(int n, sgp4_elsetrec_t *const *satrecs, double utc_mjd,
+                double (*r)[3], double (*v)[3], bool *ok);
+
+/*
+ * Function: sgp4_get_elsetrec_size
+ * Return the size of the satellites records.
+ *
+ * The records don't contain any pointer, so they can be copied and saved
+ * as plain data.
+ */
+int sgp4_get_elsetrec_size(void);
+
 /*
  * Function: sgp4_get_satepoch
  * Return the reference epoch of a sat (UTC MJD)
  */
 double sgp4_get_satepoch(const sgp4_elsetrec_t *satrec);
+
+/*
+ * Function: sgp4_get_elements
+ * Return the mean orbital elements of a sat.
+ *
+ * Parameters:
+ *   satrec - A satellite record.
+ *   inclo  - Output inclination (rad).
+ *   ecco   - Output eccentricity.
+ *   no     - Output mean motion (rad/min).
+ */
+void sgp4_get_elements(const sgp4_elsetrec_t *satrec,
+                       double *inclo, double *ecco, double *no);
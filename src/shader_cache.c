@@ -9,46 +9,70 @@
 
 #include "shader_cache.h"
 
-#define MAX_NB_SHADERS 16
+#include "utils/diskcache.h"
+
+#include <zlib.h> // For crc32.
 
 typedef struct {
-    char key[256];
-    gl_shader_t *shader;
+    UT_hash_handle  hh;
+    char            key[256];
+    gl_shader_t     *shader;
+    void            (*on_created)(gl_shader_t *s);
+    char            binary_key[300]; // Key in the binaries cache.
+    bool            save_binary;
 } shader_t;
 
-static shader_t g_shaders[MAX_NB_SHADERS] = {};
+static shader_t *g_shaders = NULL;
 
-gl_shader_t *shader_get(const char *name, const shader_define_t *defines,
-                        const char **attr_names,
-                        void (*on_created)(gl_shader_t *s))
-{
-    int i;
-    shader_t *s = NULL;
-    const char *code;
-    char key[256];
-    char path[128];
-    char pre[256] = {};
-    const shader_define_t *define;
+// Program binaries saved between runs, only on native builds.
+static struct {
+    bool        opened;
+    diskcache_t *cache;
+} g_binaries = {};
 
+static diskcache_t *get_binaries_cache(void)
+{
+#ifndef __EMSCRIPTEN__
+    char path[1024];
+    if (g_binaries.opened) return g_binaries.cache;
+    g_binaries.opened = true;
+    snprintf(path, sizeof(path), "%s/.cache/shaders/", sys_get_user_dir());
+    sys_make_dir(path);
+    path[strlen(path) - 1] = '\0';
+    g_binaries.cache = diskcache_open(path);
+#endif
+    return g_binaries.cache;
+}
 
-    // Create the key of the form:
-    // <name>_define1_define2
-    strcpy(key, name);
+// Create the key of the form:
+// <name>_define1_define2
+static void get_key(const char *name, const shader_define_t *defines,
+                    char key[256])
+{
+    const shader_define_t *define;
+    snprintf(key, 256, "%s", name);
     for (define = defines; define && define->name; define++) {
         if (define->set) {
-            strcat(key, "_");
-            strcat(key, define->name);
+            snprintf(key + strlen(key), 256 - strlen(key), "_%s",
+                     define->name);
         }
     }
+}
 
-    for (i = 0; i < ARRAY_SIZE(g_shaders); i++) {
-        s = &g_shaders[i];
-        if (!*s->key) break;
-        if (strcmp(s->key, key) == 0)
-            return s->shader;
-    }
-    assert(i < ARRAY_SIZE(g_shaders));
-    strcpy(s->key, key);
+static shader_t *shader_create(const char *key, const char *name,
+                               const shader_define_t *defines,
+                               const char **attr_names,
+                               void (*on_created)(gl_shader_t *s))
+{
+    shader_t *s;
+    const char *code, *data;
+    char path[128];
+    char pre[256] = {};
+    const char *gl_id[2];
+    uint32_t hash;
+    int i, size, format;
+    const shader_define_t *define;
+    diskcache_t *cache;
 
     snprintf(path, sizeof(path), "asset://shaders/%s.glsl", name);
     code = asset_get_data2(path, ASSET_USED_ONCE, NULL, NULL);
@@ -60,7 +84,94 @@ gl_shader_t *shader_get(const char *name, const shader_define_t *defines,
                      "#define %s\n", define->name);
         }
     }
-    s->shader = gl_shader_create(code, code, pre, attr_names);
-    if (on_created) on_created(s->shader);
+
+    s = calloc(1, sizeof(*s));
+    snprintf(s->key, sizeof(s->key), "%s", key);
+    s->on_created = on_created;
+    HASH_ADD_STR(g_shaders, key, s);
+
+    cache = get_binaries_cache();
+    if (cache) {
+        // The binaries depend on the sources and on the driver.
+        gl_id[0] = (const char*)glGetString(GL_RENDERER) ?: "";
+        gl_id[1] = (const char*)glGetString(GL_VERSION) ?: "";
+        hash = crc32(0, (void*)code, strlen(code));
+        hash = crc32(hash, (void*)pre, strlen(pre));
+        for (i = 0; i < 2; i++)
+            hash = crc32(hash, (void*)gl_id[i], strlen(gl_id[i]));
+        snprintf(s->binary_key, sizeof(s->binary_key), "%s_%08x", key, hash);
+        data = diskcache_get(cache, s->binary_key, &size, NULL, 0, NULL);
+        if (data && size > 4) {
+            memcpy(&format, data, 4);
+            s->shader = gl_shader_create_from_binary(format, data + 4,
+                                                     size - 4);
+        }
+        s->save_binary = !s->shader;
+    }
+
+    if (!s->shader)
+        s->shader = gl_shader_create_async(code, code, pre, attr_names);
+    return s;
+}
+
+static void shader_finish(shader_t *s)
+{
+    void *data;
+    char *buf;
+    int format, size;
+
+    if (!s->shader->pending) return;
+    if (gl_shader_finish(s->shader)) return;
+    if (s->on_created) s->on_created(s->shader);
+    if (!s->save_binary) return;
+    s->save_binary = false;
+    if (gl_shader_get_binary(s->shader, &format, &data, &size)) return;
+    buf = malloc(4 + size);
+    memcpy(buf, &format, 4);
+    memcpy(buf + 4, data, size);
+    diskcache_put(g_binaries.cache, s->binary_key, buf, 4 + size, "", 0);
+    free(buf);
+    free(data);
+}
+
+gl_shader_t *shader_get(const char *name, const shader_define_t *defines,
+                        const char **attr_names,
+                        void (*on_created)(gl_shader_t *s))
+{
+    shader_t *s;
+    char key[256];
+
+    get_key(name, defines, key);
+    HASH_FIND_STR(g_shaders, key, s);
+    if (!s) s = shader_create(key, name, defines, attr_names, on_created);
+    shader_finish(s);
     return s->shader;
 }
+
+void shader_preload(const char *name, const shader_define_t *defines,
+                    const char **attr_names,
+                    void (*on_created)(gl_shader_t *s))
+{
+    shader_t *s;
+    char key[256];
+
+    get_key(name, defines, key);
+    HASH_FIND_STR(g_shaders, key, s);
+    if (s) return;
+    shader_create(key, name, defines, attr_names, on_created);
+}
+
+int shader_cache_update(void)
+{
+    shader_t *s, *tmp;
+    int nb = 0;
+
+    HASH_ITER(hh, g_shaders, s, tmp) {
+        if (!s->shader->pending) continue;
+        if (gl_shader_is_ready(s->shader))
+            shader_finish(s);
+        else
+            nb++;
+    }
+    return nb;
+}
@@ -31,3 +31,27 @@ typedef struct {
 gl_shader_t *shader_get(const char *name, const shader_define_t *defines,
                         const char **attr_names,
                         void (*on_created)(gl_shader_t *s));
+
+/*
+ * Function: shader_preload
+ * Start the compilation of a shader, without waiting for it to be done.
+ *
+ * Use this during the startup, so that the first call to <shader_get> with
+ * the same arguments doesn't block the rendering.  If the driver supports
+ * KHR_parallel_shader_compile, the compilations happen in the background
+ * and are finished by <shader_cache_update>.
+ */
+void shader_preload(const char *name, const shader_define_t *defines,
+                    const char **attr_names,
+                    void (*on_created)(gl_shader_t *s));
+
+/*
+ * Function: shader_cache_update
+ * Finish the preloaded shaders whose compilation is done.
+ *
+ * Should be called once per frame.
+ *
+ * Return:
+ *   The number of shaders still compiling.
+ */
+int shader_cache_update(void);
@@ -102,21 +102,12 @@ void skybrightness_prepare(skybrightness_t *sb,
     sb->C4 = exp10f(-0.4f * sb->K * sb->airmass_sun);
 }
 
-float skybrightness_get_luminance(
-        const skybrightness_t *sb,
-        float cos_moon_dist, float cos_sun_dist, float cos_zenith_dist)
+// Brightness due to the sun (daylight or twilight).
+static float get_sun_brightness(const skybrightness_t *sb, float bKX,
+                                float cos_sun_dist, float cos_zenith_dist)
 {
-    // This avoid issues in the algo
-    cos_moon_dist = min(cos_moon_dist, cosf(1.f * D2R));
-    cos_sun_dist  = min(cos_sun_dist, cosf(1.f * D2R));
-
-    const float moon_dist = acosf(cos_moon_dist);
     const float sun_dist = acosf(cos_sun_dist);
 
-    // Air mass
-    const float bKX = fast_exp10f(-0.4f * sb->K *
-        1.f / (cos_zenith_dist + 0.025f * fast_expf(-11.f * cos_zenith_dist)));
-
     // Daylight brightness
     const float FS = 18886.28f / (sun_dist * sun_dist) +
                    fast_exp10f(6.15f - (sun_dist + 0.001f) * 1.43239f) +
@@ -129,18 +120,33 @@ float skybrightness_get_luminance(
         fast_acosf(cos_zenith_dist) / (sb->K > 0.05f ? sb->K : 0.05f)) *
         (1.7453293f / sun_dist) * (1.f - bKX);
 
-    // Total sky brightness
-    float b_total = ((b_twilight < b_daylight) ? b_twilight : b_daylight);
+    return (b_twilight < b_daylight) ? b_twilight : b_daylight;
+}
 
-    // Moonlight brightness
+// Brightness due to the moon.
+static float get_moon_brightness(const skybrightness_t *sb, float bKX,
+                                 float cos_moon_dist)
+{
+    const float moon_dist = acosf(cos_moon_dist);
     const float FM = 18886.28f / (moon_dist * moon_dist)
         + fast_exp10f(6.15f - moon_dist * 1.43239f)
         + 229086.77f * (1.06f + cos_moon_dist * cos_moon_dist);
-    float b_moon = sb->b_moon_term * (1.f - bKX) *
+    return sb->b_moon_term * (1.f - bKX) *
             (FM * sb->C3 + 440000.f * (1.f - sb->C3)) / 1000000.f;
+}
 
-    b_total += b_moon;
+// Extinction factor for a given zenith distance.
+static float get_bKX(const skybrightness_t *sb, float cos_zenith_dist)
+{
+    return fast_exp10f(-0.4f * sb->K *
+        1.f / (cos_zenith_dist + 0.025f * fast_expf(-11.f * cos_zenith_dist)));
+}
 
+// Add the dark night sky brightness and light pollution, and convert the
+// brightness to a luminance.
+static float get_final_luminance(const skybrightness_t *sb, float b_total,
+                                 float bKX, float cos_zenith_dist)
+{
     // Dark night sky brightness, don't compute if less than 1% daylight
     if ((sb->b_night_term * bKX) / b_total > 0.01f)
     {
@@ -157,3 +163,105 @@ float skybrightness_get_luminance(
     // Convert to nano lambert then cd/m2
     return b_total / 1.11E-15f * NLAMBERT_TO_CDM2;
 }
+
+float skybrightness_get_luminance(
+        const skybrightness_t *sb,
+        float cos_moon_dist, float cos_sun_dist, float cos_zenith_dist)
+{
+    float bKX, b_total;
+
+    // This avoid issues in the algo
+    cos_moon_dist = min(cos_moon_dist, cosf(1.f * D2R));
+    cos_sun_dist  = min(cos_sun_dist, cosf(1.f * D2R));
+
+    // Air mass
+    bKX = get_bKX(sb, cos_zenith_dist);
+    b_total = get_sun_brightness(sb, bKX, cos_sun_dist, cos_zenith_dist) +
+              get_moon_brightness(sb, bKX, cos_moon_dist);
+    return get_final_luminance(sb, b_total, bKX, cos_zenith_dist);
+}
+
+/*
+ * The tables are indexed by the cosine of the zenith distance, and by
+ * s = sin(d / 2) = sqrt((1 - cos(d)) / 2), with d the distance to the sun
+ * or moon, so that we get more samples close to the bodies.  Like in the
+ * full computation, the distance is clamped to 1°.
+ *
+ * The brightness falls in 1/d² close to the bodies, so we store the log of
+ * the brightness multiplied by s², and interpolate that instead.
+ */
+static const float TABLE_MIN_S = 0.0087265f; // sin(0.5°)
+
+static inline float table_s(float cos_dist)
+{
+    return max(sqrtf(max(0.f, (1.f - cos_dist) / 2.f)), TABLE_MIN_S);
+}
+
+static inline float table_dist_coord(float s)
+{
+    return (s - TABLE_MIN_S) / (1.f - TABLE_MIN_S) * (SB_TABLE_DIST - 1);
+}
+
+static inline float table_zenith_coord(float cos_zenith_dist)
+{
+    return clamp(cos_zenith_dist, 0.f, 1.f) * (SB_TABLE_ZENITH - 1);
+}
+
+static inline float table_value(float v, float s)
+{
+    // The moon brightness can be zero.
+    return logf(max(v * s * s, 1e-30f));
+}
+
+// Bilinear interpolation in a table.
+static float table_lookup(const float t[SB_TABLE_ZENITH][SB_TABLE_DIST],
+                          float z, float cos_dist)
+{
+    float s = table_s(cos_dist);
+    float d = table_dist_coord(s);
+    int iz = min((int)z, SB_TABLE_ZENITH - 2);
+    int id = min((int)d, SB_TABLE_DIST - 2);
+    float fz = z - iz, fd = d - id;
+    return expf(mix(mix(t[iz][id], t[iz][id + 1], fd),
+                    mix(t[iz + 1][id], t[iz + 1][id + 1], fd), fz)) /
+           (s * s);
+}
+
+void skybrightness_table_prepare(skybrightness_table_t *table,
+                                 const skybrightness_t *sb)
+{
+    int i, j;
+    float cos_zenith_dist, cos_dist, s, bKX;
+
+    table->sb = *sb;
+    for (i = 0; i < SB_TABLE_ZENITH; i++) {
+        cos_zenith_dist = (float)i / (SB_TABLE_ZENITH - 1);
+        bKX = get_bKX(sb, cos_zenith_dist);
+        table->bKX[i] = bKX;
+        for (j = 0; j < SB_TABLE_DIST; j++) {
+            s = mix(TABLE_MIN_S, 1.f, (float)j / (SB_TABLE_DIST - 1));
+            cos_dist = 1.f - 2.f * s * s;
+            table->sun[i][j] = table_value(get_sun_brightness(
+                    sb, bKX, cos_dist, cos_zenith_dist), s);
+            table->moon[i][j] = table_value(
+                    get_moon_brightness(sb, bKX, cos_dist), s);
+        }
+    }
+}
+
+float skybrightness_table_get_luminance(
+        const skybrightness_table_t *table,
+        float cos_moon_dist, float cos_sun_dist, float cos_zenith_dist)
+{
+    float z, fz, bKX, b_total;
+    int iz;
+
+    z = table_zenith_coord(cos_zenith_dist);
+    iz = min((int)z, SB_TABLE_ZENITH - 2);
+    fz = z - iz;
+    bKX = mix(table->bKX[iz], table->bKX[iz + 1], fz);
+    b_total = table_lookup(table->sun, z, cos_sun_dist) +
+              table_lookup(table->moon, z, cos_moon_dist);
+    return get_final_luminance(&table->sb, b_total, bKX,
+                               max(cos_zenith_dist, 0.f));
+}
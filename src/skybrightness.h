@@ -46,4 +46,46 @@ float skybrightness_get_luminance(
         const skybrightness_t *sb,
         float cos_moon_dist, float cos_sun_dist, float cos_zenith_dist);
 
+// Size of the precomputed brightness tables.
+#define SB_TABLE_ZENITH 32
+#define SB_TABLE_DIST 64
+
+/*
+ * Type: skybrightness_table_t
+ * Precomputed sky brightness for a given <skybrightness_t>.
+ *
+ * The sun and moon brightness are tabulated against the zenith distance
+ * and the distance to the body.
+ */
+typedef struct skybrightness_table
+{
+    skybrightness_t sb;
+    float sun[SB_TABLE_ZENITH][SB_TABLE_DIST];
+    float moon[SB_TABLE_ZENITH][SB_TABLE_DIST];
+    float bKX[SB_TABLE_ZENITH];
+} skybrightness_table_t;
+
+/*
+ * Function: skybrightness_table_prepare
+ * Compute the tables for a prepared <skybrightness_t>.
+ *
+ * This costs about four thousand evaluations of
+ * <skybrightness_get_luminance>, so it is only worth it when we need a
+ * lot of samples for the same conditions.
+ */
+void skybrightness_table_prepare(skybrightness_table_t *table,
+                                 const skybrightness_t *sb);
+
+/*
+ * Function: skybrightness_table_get_luminance
+ * Same as <skybrightness_get_luminance>, but using bilinear interpolation
+ * of the precomputed tables.
+ *
+ * The relative error is below 2%.  The zenith distance is clamped to the
+ * horizon.
+ */
+float skybrightness_table_get_luminance(
+        const skybrightness_table_t *table,
+        float cos_moon_dist, float cos_sun_dist, float cos_zenith_dist);
+
 #endif // SKYBRIGHTNESS_H
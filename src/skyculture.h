@@ -65,6 +65,9 @@ typedef struct skyculture_name
     UT_hash_handle  hh;
     uint64_t        oid;
     char            name[128];
+    // Translated name, either pointing to name, or to an allocated copy
+    // of the translation.  Only set for the active skyculture.
+    const char      *label;
 } skyculture_name_t;
 
 /*
@@ -9,6 +9,7 @@
 
 #include "swe.h"
 #include <sys/time.h>
+#include <zlib.h>
 
 #ifndef LOG_TIME
 #   define LOG_TIME 1
@@ -350,6 +351,20 @@ static void test_clipping(void)
         assert(!r);
         pix /= 4;
     }
+
+    // Looking at the horizon, a tile below the horizon is in the viewport,
+    // but should be clipped when the painter hides the below horizon.
+    obj_set_attr((obj_t*)&obs, "pitch", 0.0);
+    observer_update(&obs, false);
+    projection_init(&proj, PROJ_STEREOGRAPHIC, 90 * DD2R, 800, 600);
+    painter_update_clip_info(&painter);
+    eraS2c(az, -20 * DD2R, pos);
+    convert_frame(&obs, FRAME_OBSERVED, FRAME_ICRF, true, pos, pos);
+    eraC2s(pos, &ra, &de);
+    healpix_ang2pix(1 << 4, M_PI / 2 - de, eraAnp(ra), &pix);
+    assert(!painter_is_healpix_clipped(&painter, FRAME_ICRF, 4, pix, true));
+    painter.flags |= PAINTER_HIDE_BELOW_HORIZON;
+    assert(painter_is_healpix_clipped(&painter, FRAME_ICRF, 4, pix, true));
 }
 
 static void test_iter_lines(void)
@@ -385,6 +400,54 @@ static void test_iter_lines(void)
     assert(!iter_lines(data, strlen(data) - 1, &line, &len));
 }
 
+static void test_z_lines(void)
+{
+    UT_string src;
+    z_stream stream = {};
+    uint8_t *comp;
+    const char *line, *line2;
+    int i, j, len, len2, comp_size;
+    z_lines_t *lines;
+
+    // Some short lines, and one longer than the iterator buffer.
+    utstring_init(&src);
+    for (i = 0; i < 10000; i++) {
+        if (i == 500) {
+            for (j = 0; j < 100000; j++) utstring_printf(&src, "%d", j % 10);
+            utstring_printf(&src, "\n");
+        }
+        utstring_printf(&src, "line %d\n", i);
+    }
+    utstring_printf(&src, "last line");
+
+    // gzip compress the data.
+    comp_size = utstring_len(&src) + 1024;
+    comp = malloc(comp_size);
+    deflateInit2(&stream, 9, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                 Z_DEFAULT_STRATEGY);
+    stream.next_in = (void*)utstring_body(&src);
+    stream.avail_in = utstring_len(&src);
+    stream.next_out = comp;
+    stream.avail_out = comp_size;
+    assert(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+    comp_size = stream.total_out;
+    deflateEnd(&stream);
+
+    lines = z_lines_open(comp, comp_size);
+    assert(lines);
+    line2 = NULL;
+    while (iter_lines(utstring_body(&src), utstring_len(&src),
+                      &line2, &len2)) {
+        assert(z_lines_next(lines, &line, &len));
+        assert(len == len2 && memcmp(line, line2, len) == 0);
+        assert(line[len] == '\0');
+    }
+    assert(!z_lines_next(lines, &line, &len));
+    z_lines_close(lines);
+    free(comp);
+    utstring_done(&src);
+}
+
 static void test_jcon(void)
 {
     const char *str;
@@ -418,6 +481,7 @@ TEST_REGISTER(NULL, test_events, 0);
 TEST_REGISTER(NULL, test_ephemeris, TEST_AUTO);
 TEST_REGISTER(NULL, test_clipping, TEST_AUTO);
 TEST_REGISTER(NULL, test_iter_lines, TEST_AUTO);
+TEST_REGISTER(NULL, test_z_lines, TEST_AUTO);
 TEST_REGISTER(NULL, test_jcon, TEST_AUTO);
 
 #endif
@@ -34,12 +34,16 @@
 #include "profiler.h"
 #include "tests.h"
 
+#include "utils/allocs.h"
+#include "utils/arena.h"
 #include "utils/cache.h"
 #include "utils/color.h"
 #include "utils/fader.h"
 #include "utils/gesture.h"
+#include "utils/jobs.h"
 #include "utils/progressbar.h"
 #include "utils/texture.h"
+#include "utils/trace.h"
 #include "utils/utils.h"
 #include "utils/utils_json.h"
 #include "utils/utf8.h"
@@ -99,6 +103,7 @@ void swe_gen_doc(void);
 #include "obj.h"
 #include "core.h"
 #include "gui.h"
+#include "recorder.h"
 #include "symbols.h"
 #include "system.h"
 
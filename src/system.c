@@ -96,6 +96,20 @@ const char *sys_translate(const char *domain, const char *str)
     return sys_callbacks.translate(sys_callbacks.user, domain, str);
 }
 
+// Incremented each time the translations change.
+static int g_translations_version = 0;
+
+EMSCRIPTEN_KEEPALIVE
+void sys_translations_changed(void)
+{
+    g_translations_version++;
+}
+
+int sys_get_translations_version(void)
+{
+    return g_translations_version;
+}
+
 int sys_list_dir(const char *dirpath, void *user,
                  int (*f)(void *user, const char *path, int is_dir))
 {
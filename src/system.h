@@ -87,6 +87,22 @@ int sys_get_position(double *lat, double *lon, double *alt, double *accuracy);
  */
 const char *sys_translate(const char *domain, const char *str);
 
+/*
+ * Function: sys_translations_changed
+ * Notify that the translations changed, for example after a change of
+ * language.
+ *
+ * The modules that cache translated strings check
+ * <sys_get_translations_version> to know when to translate them again.
+ */
+void sys_translations_changed(void);
+
+/*
+ * Function: sys_get_translations_version
+ * Return a number that changes each time the translations change.
+ */
+int sys_get_translations_version(void);
+
 /*
  * Function: sys_list_dir
  * List all the files and directories in a local directory.
@@ -85,3 +85,70 @@ bool tests_compare_pv(const double pv[2][3], const double ref[2][3],
 }
 
 #endif
+
+#if COMPILE_BENCHS
+
+// Minimum duration of a benchmark measure (sec).
+#define BENCH_MIN_TIME 0.2
+
+typedef struct bench {
+    struct bench *next;
+    const char *name;
+    const char *file;
+    void (*setup)(void);
+    void (*func)(int n);
+} bench_t;
+
+static bench_t *g_benchs = NULL;
+
+void benchs_register(const char *name, const char *file,
+                     void (*setup)(void),
+                     void (*func)(int n))
+{
+    bench_t *bench;
+    bench = calloc(1, sizeof(*bench));
+    bench->name = name;
+    bench->file = file;
+    bench->setup = setup;
+    bench->func = func;
+    LL_APPEND(g_benchs, bench);
+}
+
+static bool filter_bench(const char *filter, const bench_t *bench)
+{
+    if (!filter) return true;
+    return strstr(bench->name, filter) || strstr(bench->file, filter);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void benchs_run(const char *filter)
+{
+    bench_t *bench;
+    int n;
+    int64_t allocs;
+    double t;
+
+    LOG_I("Run benchmarks: %s", filter);
+    LL_FOREACH(g_benchs, bench) {
+        if (!filter_bench(filter, bench)) continue;
+        if (bench->setup) bench->setup();
+        bench->func(1); // Warm up.
+        // Double the number of iterations until the measure is long enough.
+        for (n = 1;; n *= 2) {
+            allocs = allocs_get_count();
+            t = sys_get_unix_time();
+            bench->func(n);
+            t = sys_get_unix_time() - t;
+            allocs = allocs_get_count() - allocs;
+            if (t >= BENCH_MIN_TIME) break;
+        }
+        if (allocs_get_count() >= 0) {
+            LOG_I("Bench %-30s %12.1f ns/op %8.2f allocs/op",
+                  bench->name, t * 1e9 / n, (double)allocs / n);
+        } else {
+            LOG_I("Bench %-30s %12.1f ns/op", bench->name, t * 1e9 / n);
+        }
+    }
+}
+
+#endif
@@ -48,3 +48,31 @@ bool tests_compare_pv(const double pv[2][3], const double ref[2][3],
 static inline void tests_run(const char *filter) {}
 
 #endif
+
+#if COMPILE_BENCHS
+
+/*
+ * Benchmarks.
+ *
+ * A benchmark function runs the measured code n times.  They are
+ * registered with <BENCH_REGISTER> and run with <benchs_run>, that
+ * reports the time and the number of allocations per iteration.
+ */
+
+void benchs_register(const char *name, const char *file,
+                     void (*setup)(void),
+                     void (*func)(int n));
+
+void benchs_run(const char *filter);
+
+#define BENCH_REGISTER(setup_, func_) \
+    static void register_bench_##func_() __attribute__((constructor)); \
+    static void register_bench_##func_() { \
+        benchs_register(#func_, __FILE__, setup_, func_); }
+
+#else // COMPILE_BENCHS
+
+#define BENCH_REGISTER(...)
+static inline void benchs_run(const char *filter) {}
+
+#endif
@@ -0,0 +1,99 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "allocs.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if COUNT_ALLOCS && !defined(__SANITIZE_ADDRESS__) && \
+    (defined(__GLIBC__) || defined(__EMSCRIPTEN__))
+
+static int64_t g_allocs = 0;
+
+#ifdef __EMSCRIPTEN__
+
+extern void *emscripten_builtin_malloc(size_t size);
+extern void emscripten_builtin_free(void *ptr);
+extern size_t malloc_usable_size(void *ptr);
+
+void *malloc(size_t size)
+{
+    g_allocs++;
+    return emscripten_builtin_malloc(size);
+}
+
+void free(void *ptr)
+{
+    emscripten_builtin_free(ptr);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *ret = malloc(n * size);
+    if (ret) memset(ret, 0, n * size);
+    return ret;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *ret;
+    size_t old_size;
+    if (!ptr) return malloc(size);
+    if (!size) {
+        free(ptr);
+        return NULL;
+    }
+    old_size = malloc_usable_size(ptr);
+    if (old_size >= size) return ptr;
+    ret = malloc(size);
+    if (ret) memcpy(ret, ptr, old_size);
+    free(ptr);
+    return ret;
+}
+
+#else // glibc
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    __atomic_add_fetch(&g_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    __atomic_add_fetch(&g_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&g_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+#endif
+
+int64_t allocs_get_count(void)
+{
+    return __atomic_load_n(&g_allocs, __ATOMIC_RELAXED);
+}
+
+#else
+
+int64_t allocs_get_count(void)
+{
+    return -1;
+}
+
+#endif
@@ -0,0 +1,33 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * File: allocs.h
+ *
+ * Count of the heap allocations, for debugging.
+ *
+ * The counting is only enabled when compiled with COUNT_ALLOCS (scons
+ * allocs=1, or bench=1), by overriding the malloc functions.  This is
+ * only possible with glibc or emscripten, and not with the address
+ * sanitizer.
+ */
+
+#ifndef ALLOCS_H
+#define ALLOCS_H
+
+#include <stdint.h>
+
+/*
+ * Function: allocs_get_count
+ * Return the number of calls to malloc, calloc and realloc so far, or -1
+ * if we don't count the allocations.
+ */
+int64_t allocs_get_count(void);
+
+#endif // ALLOCS_H
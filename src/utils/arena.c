@@ -0,0 +1,108 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "arena.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tests.h"
+
+#define ALIGN 16
+#define ALIGN_UP(x) (((x) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+// Header of the blocks allocated outside of the main block.
+typedef struct extra {
+    struct extra *next;
+} extra_t;
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    extra_t *extra;
+    uintptr_t start;
+
+    size = ALIGN_UP(size ?: 1);
+    // malloc doesn't always align to 16 bytes, so align the addresses.
+    start = ALIGN_UP((uintptr_t)arena->data + arena->used);
+    if (arena->data && start + size <= (uintptr_t)arena->data + arena->size) {
+        arena->used = start + size - (uintptr_t)arena->data;
+        return (void*)start;
+    }
+    extra = malloc(ALIGN + size + ALIGN);
+    extra->next = arena->extra;
+    arena->extra = extra;
+    arena->overflow += size + ALIGN;
+    return (void*)ALIGN_UP((uintptr_t)extra + sizeof(*extra));
+}
+
+void *arena_calloc(arena_t *arena, size_t n, size_t size)
+{
+    void *ret = arena_alloc(arena, n * size);
+    memset(ret, 0, n * size);
+    return ret;
+}
+
+void arena_reset(arena_t *arena)
+{
+    extra_t *extra, *next;
+    size_t size;
+
+    if (arena->extra) {
+        for (extra = arena->extra; extra; extra = next) {
+            next = extra->next;
+            free(extra);
+        }
+        arena->extra = NULL;
+        // Grow with some margin, to avoid growing again on every frame
+        // if the usage increases slowly.
+        size = arena->used + arena->overflow;
+        size = ALIGN_UP(size + size / 2);
+        free(arena->data);
+        arena->data = malloc(size);
+        arena->size = size;
+    }
+    arena->used = 0;
+    arena->overflow = 0;
+}
+
+void arena_release(arena_t *arena)
+{
+    arena_reset(arena);
+    free(arena->data);
+    memset(arena, 0, sizeof(*arena));
+}
+
+#if COMPILE_TESTS
+
+static void test_arena(void)
+{
+    arena_t arena = {};
+    char *a, *b;
+    // First allocations go outside of the main block.
+    a = arena_alloc(&arena, 10);
+    b = arena_calloc(&arena, 3, 100);
+    assert((uintptr_t)a % ALIGN == 0 && (uintptr_t)b % ALIGN == 0);
+    assert(b[299] == 0);
+    assert(arena.overflow >= 310);
+    arena_reset(&arena);
+    // Now the same allocations fit in the main block.
+    assert(arena.size >= 310);
+    a = arena_alloc(&arena, 10);
+    b = arena_alloc(&arena, 300);
+    assert(b == a + ALIGN);
+    assert(!arena.extra);
+    arena_release(&arena);
+}
+
+TEST_REGISTER(NULL, test_arena, TEST_AUTO);
+
+#endif
@@ -0,0 +1,70 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * File: arena.h
+ *
+ * Linear allocator for short lived temporary memory.
+ *
+ * All the allocations are released at once with <arena_reset>.  When the
+ * main block is too small, the extra allocations fall back to malloc, and
+ * the next reset grows the main block, so that once the memory usage is
+ * stable we don't do any heap allocations anymore.
+ *
+ * An arena is not thread safe.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Type: arena_t
+ * A linear allocator.  Zero initialize to create an empty arena.
+ */
+typedef struct arena {
+    char    *data;      // Main block.
+    size_t  size;       // Size of the main block.
+    size_t  used;       // Bytes used in the main block.
+    size_t  overflow;   // Bytes allocated outside of the main block.
+    void    *extra;     // List of the blocks allocated outside.
+} arena_t;
+
+/*
+ * Function: arena_alloc
+ * Allocate memory from an arena.
+ *
+ * The memory is aligned to 16 bytes, and stays valid until the next call
+ * to <arena_reset>.
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/*
+ * Function: arena_calloc
+ * Same as <arena_alloc>, but initialize the memory to zero.
+ */
+void *arena_calloc(arena_t *arena, size_t n, size_t size);
+
+/*
+ * Function: arena_reset
+ * Release all the memory allocated from an arena.
+ *
+ * The main block is kept, and grown to fit all the memory used since the
+ * previous reset.
+ */
+void arena_reset(arena_t *arena);
+
+/*
+ * Function: arena_release
+ * Free all the memory owned by an arena.
+ */
+void arena_release(arena_t *arena);
+
+#endif // ARENA_H
@@ -9,7 +9,22 @@
 
 #include "cache.h"
 #include "uthash.h"
+#include "utlist.h"
+
 #include <assert.h>
+#include <stdbool.h>
+
+#include "tests.h"
+
+/*
+ * The items are stored in a hash table for the lookup, and in two linked
+ * lists for the eviction:
+ *
+ *   lru  - All the items sorted by last use, the least recently used first.
+ *   kept - The items whose delete function returned CACHE_KEEP.  We only
+ *          retry to delete them if we cannot free enough space from the lru
+ *          list, or after they get used again.
+ */
 
 typedef struct item item_t;
 struct item {
@@ -17,15 +32,20 @@ struct item {
     char            key[256];
     void            *data;
     int             cost;
-    uint64_t        last_used;
+    bool            kept; // Set if the item is in the kept list.
     int             (*delfunc)(void *data);
+    item_t          *prev, *next;
 };
 
 struct cache {
     item_t *items;
-    uint64_t clock;
+    item_t *lru;
+    item_t *kept;
     int size;
     int max_size;
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
 };
 
 cache_t *cache_create(int size)
@@ -35,17 +55,36 @@ cache_t *cache_create(int size)
     return cache;
 }
 
-static void cleanup(cache_t *cache)
+// Remove an item from a list and try to delete it.  If the item cannot be
+// deleted yet it is moved to the kept list.
+static void try_delete(cache_t *cache, item_t **list, item_t *item)
 {
-    item_t *item, *tmp;
-    HASH_ITER(hh, cache->items, item, tmp) {
-        if (item->delfunc(item->data) == CACHE_KEEP) continue;
-        HASH_DEL(cache->items, item);
-        assert(item != cache->items);
-        cache->size -= item->cost;
-        free(item);
-        if (cache->size < cache->max_size) return;
+    DL_DELETE(*list, item);
+    if (item->delfunc(item->data) == CACHE_KEEP) {
+        item->kept = true;
+        DL_APPEND(cache->kept, item);
+        return;
     }
+    HASH_DEL(cache->items, item);
+    cache->size -= item->cost;
+    cache->evictions++;
+    free(item);
+}
+
+static void cleanup(cache_t *cache)
+{
+    item_t *retry;
+    while (cache->lru && cache->size >= cache->max_size)
+        try_delete(cache, &cache->lru, cache->lru);
+    if (cache->size < cache->max_size) return;
+
+    // Not enough space freed, give a new chance to the kept items.
+    retry = cache->kept;
+    cache->kept = NULL;
+    while (retry && cache->size >= cache->max_size)
+        try_delete(cache, &retry, retry);
+    DL_CONCAT(retry, cache->kept);
+    cache->kept = retry;
 }
 
 void cache_add(cache_t *cache, const void *key, int len, void *data,
@@ -59,20 +98,28 @@ void cache_add(cache_t *cache, const void *key, int len, void *data,
     memcpy(item->key, key, len);
     item->data = data;
     item->cost = cost;
-    item->last_used = cache->clock++;
     item->delfunc = delfunc;
     HASH_ADD(hh, cache->items, key, len, item);
+    DL_APPEND(cache->lru, item);
 }
 
 void *cache_get(cache_t *cache, const void *key, int keylen)
 {
     item_t *item;
     HASH_FIND(hh, cache->items, key, keylen, item);
-    if (!item) return NULL;
-    item->last_used = cache->clock++;
-    // Reinsert item on top of the hash list so that it stays sorted.
-    HASH_DEL(cache->items, item);
-    HASH_ADD(hh, cache->items, key, keylen, item);
+    if (!item) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    // Move the item at the end of the lru list.
+    if (item->kept) {
+        DL_DELETE(cache->kept, item);
+        item->kept = false;
+    } else {
+        DL_DELETE(cache->lru, item);
+    }
+    DL_APPEND(cache->lru, item);
     return item->data;
 }
 
@@ -95,3 +142,64 @@ int cache_get_current_size(const cache_t *cache)
 {
     return cache->size;
 }
+
+void cache_set_max_size(cache_t *cache, int size)
+{
+    cache->max_size = size;
+    if (cache->size >= cache->max_size) cleanup(cache);
+}
+
+int cache_get_max_size(const cache_t *cache)
+{
+    return cache->max_size;
+}
+
+void cache_get_stats(const cache_t *cache, cache_stats_t *stats)
+{
+    stats->nb = HASH_COUNT(cache->items);
+    stats->size = cache->size;
+    stats->max_size = cache->max_size;
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static int test_cache_del(void *data)
+{
+    return *(int*)data ? CACHE_KEEP : 0;
+}
+
+static void test_cache(void)
+{
+    cache_t *cache;
+    cache_stats_t stats;
+    int i, keep[8] = {0};
+    cache = cache_create(4);
+    keep[0] = 1; // Item 0 cannot be deleted.
+    for (i = 0; i < 3; i++)
+        cache_add(cache, &i, sizeof(i), &keep[i], 1, test_cache_del);
+    // Use item 1 so that item 2 becomes the least recently used one.
+    assert(cache_get(cache, &(int){1}, sizeof(int)) == &keep[1]);
+    i = 3;
+    cache_add(cache, &i, sizeof(i), &keep[i], 1, test_cache_del);
+    assert(cache_get(cache, &(int){0}, sizeof(int)) == &keep[0]);
+    assert(cache_get(cache, &(int){1}, sizeof(int)) == &keep[1]);
+    assert(cache_get(cache, &(int){2}, sizeof(int)) == NULL);
+    assert(cache_get(cache, &(int){3}, sizeof(int)) == &keep[3]);
+    assert(cache_get_current_size(cache) == 3);
+    // Shrinking the cache only leaves the item that cannot be deleted.
+    cache_set_max_size(cache, 1);
+    assert(cache_get_current_size(cache) == 1);
+    assert(cache_get(cache, &(int){0}, sizeof(int)) == &keep[0]);
+    cache_get_stats(cache, &stats);
+    assert(stats.nb == 1 && stats.hits == 5 && stats.misses == 1);
+    assert(stats.evictions == 3);
+}
+
+TEST_REGISTER(NULL, test_cache, TEST_AUTO);
+
+#endif
@@ -13,6 +13,8 @@
  * Utils to store values in cache.
  */
 
+#include <stdint.h>
+
 /*
  * Enum: CACHE_KEEP
  * The cache delete function callback can return this value to tell the
@@ -26,6 +28,30 @@
  */
 typedef struct cache cache_t;
 
+/*
+ * Type: cache_stats_t
+ * Usage statistics of a cache, as returned by <cache_get_stats>.
+ *
+ * The hits, misses and evictions counters are cumulated since the creation
+ * of the cache.
+ *
+ * Attributes:
+ *   nb        - Number of items currently in the cache.
+ *   size      - Total cost of the items.
+ *   max_size  - Maximum size of the cache.
+ *   hits      - Number of <cache_get> calls that found their item.
+ *   misses    - Number of <cache_get> calls that didn't.
+ *   evictions - Number of items deleted to free some space.
+ */
+typedef struct cache_stats {
+    int     nb;
+    int     size;
+    int     max_size;
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+} cache_stats_t;
+
 /*
  * Function: cache_create
  * Create a new cache with a given max size.
@@ -79,3 +105,24 @@ void cache_set_cost(cache_t *cache, const void *key, int keylen, int cost);
  */
 int cache_get_current_size(const cache_t *cache);
 
+/*
+ * Function: cache_set_max_size
+ * Change the maximum size of a cache.
+ *
+ * If the cache is already larger than the new size, we try to delete
+ * items immediately.
+ */
+void cache_set_max_size(cache_t *cache, int size);
+
+/*
+ * Function: cache_get_max_size
+ * Return the maximum size of a cache.
+ */
+int cache_get_max_size(const cache_t *cache);
+
+/*
+ * Function: cache_get_stats
+ * Get the current usage statistics of a cache.
+ */
+void cache_get_stats(const cache_t *cache, cache_stats_t *stats);
+
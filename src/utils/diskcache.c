@@ -0,0 +1,566 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef NO_LIBCURL
+
+#include "diskcache.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+#ifndef LOG_E
+#   define LOG_E
+#endif
+
+#ifndef PATH_MAX
+#   define PATH_MAX 1024
+#endif
+
+/*
+ * Files layout:
+ *
+ *   <dir>/index        - index_header_t followed by index_entry_t values.
+ *   <dir>/<gen>-<n>    - The segments of the current generation.  Each
+ *                        segment is a list of records, aligned to 8 bytes.
+ *
+ * The index and the segments are only ever appended to, so that a crash can
+ * at worst lose the last records.  A compaction writes all the live records
+ * into the segments of a new generation, and atomically replaces the index.
+ *
+ * When the cache gets bigger than its max size we delete the oldest
+ * segment.  The records of that segment that have been used since it was
+ * written get a second chance and are appended again first, so that the
+ * eviction approximates a LRU.  The access times are kept in the index
+ * entries, and a new entry is appended when a record is used again after
+ * TOUCH_INTERVAL.
+ */
+
+#define INDEX_MAGIC     0x31584449 // "IDX1"
+#define RECORD_MAGIC    0x31434552 // "REC1"
+
+// Maximum size of a segment.  We always map this size, so that the
+// pointers stay valid when the segments grow.
+#define SEGMENT_SIZE    (64 * (1 << 20))
+#define MAX_SEGMENTS    1024
+
+// Min time between two updates of a record access time in the index (sec).
+#define TOUCH_INTERVAL  (60 * 60)
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    generation;
+} index_header_t;
+
+typedef struct {
+    uint64_t    hash;       // Hash of the key, zero for empty slots.
+    uint32_t    segment;
+    uint32_t    offset;     // Offset of the record in the segment.
+    uint32_t    size;       // Total size of the record.
+    uint32_t    atime;      // Unix time of the last access.
+} index_entry_t;
+
+// Header of the records, followed by the key, etag and data.
+typedef struct {
+    uint32_t    magic;
+    uint32_t    key_len;    // Including the null byte.
+    uint32_t    etag_len;   // Including the null byte.
+    uint32_t    data_len;   // Not including the null byte.
+    double      expiration;
+} record_t;
+
+typedef struct {
+    int         fd;         // -1 once the segment has been evicted.
+    int         size;
+    uint8_t     *map;
+    uint32_t    mtime;      // Unix time of the last write.
+} segment_t;
+
+struct diskcache {
+    char        *dir;
+    uint32_t    generation;
+    int         index_fd;
+    int         first_segment; // Oldest segment not evicted yet.
+    int         nb_segments;
+    segment_t   segments[MAX_SEGMENTS];
+    int64_t     max_size;   // Zero for no limit.
+    int         nb_index_entries; // Number of entries in the index file.
+
+    // Open addressing hash table of all the live records.
+    index_entry_t *table;
+    int         table_size; // Always a power of two.
+    int         nb_entries;
+    int64_t     live_size;
+    int64_t     dead_size;
+};
+
+// FNV-1a hash.
+static uint64_t hash_key(const char *key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (; *key; key++) {
+        h ^= (uint8_t)*key;
+        h *= 1099511628211ULL;
+    }
+    return h ?: 1; // Zero is used for the empty slots.
+}
+
+static index_entry_t *table_find(const diskcache_t *dc, uint64_t hash)
+{
+    int i = hash & (dc->table_size - 1);
+    while (dc->table[i].hash && dc->table[i].hash != hash)
+        i = (i + 1) & (dc->table_size - 1);
+    return &dc->table[i];
+}
+
+static void table_add(diskcache_t *dc, const index_entry_t *entry)
+{
+    index_entry_t *old_table = dc->table, *slot;
+    int i, old_size = dc->table_size;
+
+    // Keep the load factor under 1/2.
+    if ((dc->nb_entries + 1) * 2 > dc->table_size) {
+        dc->table_size = dc->table_size ? dc->table_size * 2 : 1024;
+        dc->table = calloc(dc->table_size, sizeof(*dc->table));
+        for (i = 0; i < old_size; i++) {
+            if (old_table[i].hash)
+                *table_find(dc, old_table[i].hash) = old_table[i];
+        }
+        free(old_table);
+    }
+    slot = table_find(dc, entry->hash);
+    // Same record, only the access time changed.
+    if (    slot->hash && slot->segment == entry->segment &&
+            slot->offset == entry->offset) {
+        if (entry->atime > slot->atime) slot->atime = entry->atime;
+        return;
+    }
+    if (slot->hash) {
+        dc->live_size -= slot->size;
+        dc->dead_size += slot->size;
+    } else {
+        dc->nb_entries++;
+    }
+    *slot = *entry;
+    dc->live_size += entry->size;
+}
+
+static void get_segment_path(const diskcache_t *dc, uint32_t generation,
+                             int n, char *path)
+{
+    snprintf(path, PATH_MAX, "%s/%u-%04d", dc->dir, generation, n);
+}
+
+static int segment_open(diskcache_t *dc, int n, bool create)
+{
+    char path[PATH_MAX];
+    segment_t *seg = &dc->segments[n];
+    struct stat st;
+
+    get_segment_path(dc, dc->generation, n, path);
+    seg->fd = open(path, O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644);
+    if (seg->fd == -1) return -1;
+    if (fstat(seg->fd, &st) != 0 || st.st_size > SEGMENT_SIZE) goto error;
+    seg->size = st.st_size;
+    seg->mtime = st.st_mtime;
+    seg->map = mmap(NULL, SEGMENT_SIZE, PROT_READ, MAP_SHARED, seg->fd, 0);
+    if (seg->map == MAP_FAILED) goto error;
+    dc->nb_segments = n + 1;
+    return 0;
+
+error:
+    close(seg->fd);
+    seg->fd = -1;
+    seg->map = NULL;
+    return -1;
+}
+
+static void segments_close(diskcache_t *dc, bool delete)
+{
+    int i;
+    char path[PATH_MAX];
+    for (i = 0; i < dc->nb_segments; i++) {
+        // The evicted segments are still mapped.
+        if (dc->segments[i].map)
+            munmap(dc->segments[i].map, SEGMENT_SIZE);
+        if (dc->segments[i].fd == -1) continue;
+        close(dc->segments[i].fd);
+        if (delete) {
+            get_segment_path(dc, dc->generation, i, path);
+            unlink(path);
+        }
+    }
+    dc->first_segment = 0;
+    dc->nb_segments = 0;
+}
+
+// Total size of the segments files.
+static int64_t get_total_size(const diskcache_t *dc)
+{
+    int i;
+    int64_t ret = 0;
+    for (i = dc->first_segment; i < dc->nb_segments; i++)
+        ret += dc->segments[i].size;
+    return ret;
+}
+
+static const record_t *get_record(const diskcache_t *dc,
+                                  const index_entry_t *entry)
+{
+    const record_t *rec;
+    rec = (void*)(dc->segments[entry->segment].map + entry->offset);
+    if (rec->magic != RECORD_MAGIC) return NULL;
+    if (sizeof(*rec) + rec->key_len + rec->etag_len + rec->data_len + 1 >
+            entry->size) return NULL;
+    return rec;
+}
+
+// Append a full record to the last segment, and add it to the index.
+static int append_record(diskcache_t *dc, uint64_t hash,
+                         const void *rec, int size, uint32_t atime)
+{
+    segment_t *seg;
+    index_entry_t entry = {.hash = hash, .size = size, .atime = atime};
+
+    assert(size % 8 == 0);
+    if (size > SEGMENT_SIZE) return -1;
+    seg = dc->nb_segments ? &dc->segments[dc->nb_segments - 1] : NULL;
+    if (!seg || seg->size + size > SEGMENT_SIZE) {
+        if (dc->nb_segments >= MAX_SEGMENTS) return -1;
+        if (segment_open(dc, dc->nb_segments, true) != 0) return -1;
+        seg = &dc->segments[dc->nb_segments - 1];
+    }
+    if (pwrite(seg->fd, rec, size, seg->size) != size) return -1;
+    entry.segment = dc->nb_segments - 1;
+    entry.offset = seg->size;
+    seg->size += size;
+    seg->mtime = time(NULL);
+    // The record is only visible once the index entry is written.
+    if (write(dc->index_fd, &entry, sizeof(entry)) != sizeof(entry))
+        return -1;
+    dc->nb_index_entries++;
+    table_add(dc, &entry);
+    return 0;
+}
+
+/*
+ * Delete the oldest segment.
+ *
+ * The records used since the segment was last written are appended again,
+ * the others are removed from the table.  The segment file is deleted but
+ * stays mapped until the cache is closed, since the pointers returned by
+ * diskcache_get must stay valid.
+ */
+static void evict_segment(diskcache_t *dc)
+{
+    int i, nb_kept = 0, n = dc->first_segment;
+    segment_t *seg = &dc->segments[n];
+    index_entry_t *old_table = dc->table, *entry, *kept;
+    int64_t live_size = 0;
+    char path[PATH_MAX];
+
+    assert(n < dc->nb_segments - 1);
+    dc->first_segment++;
+    // Rebuild the table without the records of the segment, since removing
+    // entries would break the probe sequences of the open addressing.
+    kept = calloc(dc->table_size, sizeof(*kept));
+    dc->table = calloc(dc->table_size, sizeof(*dc->table));
+    for (i = 0; i < dc->table_size; i++) {
+        entry = &old_table[i];
+        if (!entry->hash) continue;
+        if (entry->segment != n) {
+            *table_find(dc, entry->hash) = *entry;
+            continue;
+        }
+        live_size += entry->size;
+        dc->nb_entries--;
+        if (entry->atime > seg->mtime) kept[nb_kept++] = *entry;
+    }
+    free(old_table);
+    dc->live_size -= live_size;
+    dc->dead_size -= seg->size - live_size;
+
+    // Second chance for the records used since the segment was written.
+    for (i = 0; i < nb_kept; i++) {
+        append_record(dc, kept[i].hash, seg->map + kept[i].offset,
+                      kept[i].size, kept[i].atime);
+    }
+    free(kept);
+
+    close(seg->fd);
+    seg->fd = -1;
+    get_segment_path(dc, dc->generation, n, path);
+    unlink(path);
+}
+
+// Evict the oldest segments until the cache fits in its max size.
+static void evict(diskcache_t *dc)
+{
+    if (!dc->max_size) return;
+    while (get_total_size(dc) > dc->max_size &&
+           dc->first_segment < dc->nb_segments - 1) {
+        evict_segment(dc);
+    }
+}
+
+static int index_create(diskcache_t *dc, const char *path)
+{
+    index_header_t header = {INDEX_MAGIC, dc->generation};
+    dc->index_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (dc->index_fd == -1) return -1;
+    if (write(dc->index_fd, &header, sizeof(header)) != sizeof(header)) {
+        close(dc->index_fd);
+        return -1;
+    }
+    return 0;
+}
+
+// Load all the records listed in the index file.
+static int index_load(diskcache_t *dc, const char *path)
+{
+    FILE *file;
+    index_header_t header;
+    index_entry_t entry;
+
+    file = fopen(path, "rb");
+    if (!file) return -1;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+            header.magic != INDEX_MAGIC) {
+        fclose(file);
+        return -1;
+    }
+    dc->generation = header.generation;
+    // The first segments might have been evicted.
+    while (dc->first_segment < MAX_SEGMENTS &&
+           segment_open(dc, dc->first_segment, false) != 0)
+        dc->first_segment++;
+    if (dc->first_segment == MAX_SEGMENTS) dc->first_segment = 0;
+    while (segment_open(dc, dc->nb_segments, false) == 0) {}
+    while (fread(&entry, sizeof(entry), 1, file) == 1) {
+        dc->nb_index_entries++;
+        // Ignore the records we failed to write completely, and the ones
+        // of the evicted segments.
+        if (!entry.hash || entry.segment >= dc->nb_segments ||
+            entry.segment < dc->first_segment ||
+            entry.offset + entry.size > dc->segments[entry.segment].size)
+            continue;
+        table_add(dc, &entry);
+    }
+    fclose(file);
+    return 0;
+}
+
+// Rewrite all the live records into the segments of a new generation.
+static void compact(diskcache_t *dc)
+{
+    diskcache_t *new;
+    char path[PATH_MAX], tmp_path[PATH_MAX];
+    const index_entry_t *entry;
+    const record_t *rec;
+    int i;
+
+    new = calloc(1, sizeof(*new));
+    new->dir = dc->dir;
+    new->generation = dc->generation + 1;
+    new->max_size = dc->max_size;
+    snprintf(path, sizeof(path), "%s/index", dc->dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/index.tmp", dc->dir);
+    if (index_create(new, tmp_path) != 0) goto error;
+    for (i = 0; i < dc->table_size; i++) {
+        entry = &dc->table[i];
+        if (!entry->hash) continue;
+        rec = get_record(dc, entry);
+        if (!rec) continue;
+        if (append_record(new, entry->hash, rec, entry->size,
+                          entry->atime) != 0) {
+            close(new->index_fd);
+            goto error;
+        }
+    }
+    close(new->index_fd);
+    if (rename(tmp_path, path) != 0) goto error;
+
+    // From now on the new generation is the valid one.
+    segments_close(dc, true);
+    close(dc->index_fd);
+    free(dc->table);
+    *dc = *new;
+    dc->index_fd = open(path, O_WRONLY | O_APPEND);
+    free(new);
+    return;
+
+error:
+    LOG_E("Cannot compact disk cache %s", dc->dir);
+    segments_close(new, true);
+    unlink(tmp_path);
+    free(new->table);
+    free(new);
+}
+
+diskcache_t *diskcache_open(const char *dir)
+{
+    diskcache_t *dc;
+    char path[PATH_MAX];
+
+    if (mkdir(dir, S_IRWXU) != 0 && errno != EEXIST) return NULL;
+    dc = calloc(1, sizeof(*dc));
+    dc->dir = strdup(dir);
+    snprintf(path, sizeof(path), "%s/index", dir);
+    if (index_load(dc, path) == 0) {
+        dc->index_fd = open(path, O_WRONLY | O_APPEND);
+    } else {
+        segments_close(dc, false);
+        dc->generation = 0;
+        index_create(dc, path);
+    }
+    if (dc->index_fd == -1) {
+        LOG_E("Cannot open disk cache %s", dir);
+        diskcache_close(dc);
+        return NULL;
+    }
+    // Only compact when it can free at least a full segment, or when the
+    // index or the segments numbers grew too much.
+    if (    (dc->dead_size > dc->live_size && dc->dead_size > SEGMENT_SIZE) ||
+            dc->nb_index_entries > 4 * dc->nb_entries + 1024 ||
+            dc->nb_segments > MAX_SEGMENTS / 2)
+        compact(dc);
+    return dc;
+}
+
+void diskcache_set_max_size(diskcache_t *dc, int64_t size)
+{
+    dc->max_size = size;
+    evict(dc);
+}
+
+void diskcache_close(diskcache_t *dc)
+{
+    if (!dc) return;
+    segments_close(dc, false);
+    if (dc->index_fd != -1) close(dc->index_fd);
+    free(dc->table);
+    free(dc->dir);
+    free(dc);
+}
+
+const void *diskcache_get(diskcache_t *dc, const char *key, int *size,
+                          char *etag, int etag_size, double *expiration)
+{
+    index_entry_t *entry;
+    const record_t *rec;
+    const char *rec_key;
+    uint32_t now;
+
+    if (!dc->table_size) return NULL;
+    entry = table_find(dc, hash_key(key));
+    if (!entry->hash) return NULL;
+    rec = get_record(dc, entry);
+    if (!rec) return NULL;
+    // Make sure this is not a hash collision.
+    rec_key = (const char*)(rec + 1);
+    if (rec->key_len != strlen(key) + 1 || strcmp(rec_key, key) != 0)
+        return NULL;
+    if (etag) snprintf(etag, etag_size, "%s", rec_key + rec->key_len);
+    if (expiration) *expiration = rec->expiration;
+    *size = rec->data_len;
+
+    // Update the access time.
+    now = time(NULL);
+    if (now > entry->atime + TOUCH_INTERVAL) {
+        entry->atime = now;
+        if (write(dc->index_fd, entry, sizeof(*entry)) == sizeof(*entry))
+            dc->nb_index_entries++;
+    }
+    return rec_key + rec->key_len + rec->etag_len;
+}
+
+int diskcache_put(diskcache_t *dc, const char *key, const void *data,
+                  int size, const char *etag, double expiration)
+{
+    record_t *rec;
+    char *p;
+    int r, total;
+    int key_len = strlen(key) + 1, etag_len = strlen(etag ?: "") + 1;
+
+    total = sizeof(*rec) + key_len + etag_len + size + 1;
+    total = (total + 7) & ~7;
+    if (total > SEGMENT_SIZE) return -1;
+    rec = calloc(1, total);
+    *rec = (record_t) {
+        .magic = RECORD_MAGIC,
+        .key_len = key_len,
+        .etag_len = etag_len,
+        .data_len = size,
+        .expiration = expiration,
+    };
+    p = (char*)(rec + 1);
+    memcpy(p, key, key_len);
+    memcpy(p + key_len, etag ?: "", etag_len);
+    memcpy(p + key_len + etag_len, data, size);
+    r = append_record(dc, hash_key(key), rec, total, time(NULL));
+    free(rec);
+    if (r == 0) evict(dc);
+    return r;
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static void test_diskcache(void)
+{
+    char dir[] = "/tmp/swe-diskcache-XXXXXX";
+    char path[PATH_MAX], etag[64];
+    diskcache_t *dc;
+    const char *data;
+    double expiration;
+    int size;
+
+    if (!mkdtemp(dir)) return;
+    dc = diskcache_open(dir);
+    assert(dc);
+    assert(diskcache_put(dc, "a", "AAA", 3, "etag-a", 10) == 0);
+    assert(diskcache_put(dc, "b", "BBB", 3, "etag-b", 20) == 0);
+    assert(diskcache_put(dc, "a", "AAAA", 4, "etag-a2", 30) == 0);
+    assert(!diskcache_get(dc, "c", &size, NULL, 0, NULL));
+    diskcache_close(dc);
+
+    // Reopen the cache.
+    dc = diskcache_open(dir);
+    data = diskcache_get(dc, "a", &size, etag, sizeof(etag), &expiration);
+    assert(data && size == 4 && data[size] == '\0');
+    test_str(data, "AAAA");
+    test_str(etag, "etag-a2");
+    assert(expiration == 30);
+    data = diskcache_get(dc, "b", &size, NULL, 0, NULL);
+    test_str(data, "BBB");
+    diskcache_close(dc);
+
+    snprintf(path, sizeof(path), "%s/index", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/0-0000", dir);
+    unlink(path);
+    rmdir(dir);
+}
+
+TEST_REGISTER(NULL, test_diskcache, TEST_AUTO);
+
+#endif
+
+#endif // NO_LIBCURL
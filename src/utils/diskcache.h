@@ -0,0 +1,105 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * File: diskcache.h
+ *
+ * Persistent key/value store used to cache many small files on disk.
+ *
+ * All the values are packed into a few large append-only segment files that
+ * are memory mapped, so that reading a value doesn't need any copy or file
+ * system access.  A separate index file lists the position of each record,
+ * and is loaded into a compact hash table when we open the cache.
+ *
+ * Overwritten values stay in the segments until the next compaction, that
+ * happens when we open a cache that contains too much dead data.
+ *
+ * The cache can have a max size, in which case the least recently used
+ * values are evicted, a full segment at a time.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Type: diskcache_t
+ * Represent an opened disk cache.
+ */
+typedef struct diskcache diskcache_t;
+
+/*
+ * Function: diskcache_open
+ * Open or create a disk cache.
+ *
+ * Parameters:
+ *   dir    - Directory where the cache files are stored.  Created if it
+ *            doesn't exist.
+ *
+ * Return:
+ *   The cache, or NULL in case of error.
+ */
+diskcache_t *diskcache_open(const char *dir);
+
+/*
+ * Function: diskcache_close
+ * Close a disk cache.
+ *
+ * All the pointers returned by <diskcache_get> become invalid.
+ */
+void diskcache_close(diskcache_t *dc);
+
+/*
+ * Function: diskcache_set_max_size
+ * Set the max size of the cache files.
+ *
+ * Parameters:
+ *   dc     - A disk cache.
+ *   size   - Max size in bytes, or zero for no limit.  The actual size can
+ *            be larger by up to one segment.
+ */
+void diskcache_set_max_size(diskcache_t *dc, int64_t size);
+
+/*
+ * Function: diskcache_get
+ * Get a value from a disk cache.
+ *
+ * Parameters:
+ *   dc         - A disk cache.
+ *   key        - Null terminated key of the value.
+ *   size       - Get the size of the data.
+ *   etag       - If not NULL, get the etag saved with the value.
+ *   etag_size  - Size of the etag buffer.
+ *   expiration - If not NULL, get the expiration saved with the value.
+ *
+ * Return:
+ *   A pointer to the data in the mapped file, or NULL if the key is not in
+ *   the cache.  The data is always followed by a null byte, and stays
+ *   valid until the cache is closed.
+ */
+const void *diskcache_get(diskcache_t *dc, const char *key, int *size,
+                          char *etag, int etag_size, double *expiration);
+
+/*
+ * Function: diskcache_put
+ * Add or replace a value in a disk cache.
+ *
+ * Parameters:
+ *   dc         - A disk cache.
+ *   key        - Null terminated key of the value.
+ *   data       - The data to store.
+ *   size       - Size of the data.
+ *   etag       - Etag to save with the value.
+ *   expiration - Unix time expiration to save with the value.
+ *
+ * Return:
+ *   0 on success, or -1 if the value could not be added (for example if it
+ *   is too big to fit in a segment).
+ */
+int diskcache_put(diskcache_t *dc, const char *key, const void *data,
+                  int size, const char *etag, double expiration);
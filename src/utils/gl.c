@@ -50,12 +50,37 @@ int gl_check_errors(const char *file, int line)
     }
 }
 
-static int compile_shader(int shader, const char *code,
-                          const char *include1,
-                          const char *include2)
+// KHR_parallel_shader_compile, not defined in all the headers.
+#ifndef GL_COMPLETION_STATUS_KHR
+#   define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Program binaries, only on desktop OpenGL.
+#if !defined(GLES2) && defined(GL_PROGRAM_BINARY_LENGTH)
+#   define HAS_PROGRAM_BINARY 1
+#else
+#   define HAS_PROGRAM_BINARY 0
+#endif
+
+static bool has_extension(const char *name)
+{
+    const char *extensions = (const char*)glGetString(GL_EXTENSIONS);
+    return extensions && strstr(extensions, name);
+}
+
+#if HAS_PROGRAM_BINARY
+static bool has_program_binary(void)
+{
+    static int ret = -1;
+    if (ret == -1) ret = has_extension("GL_ARB_get_program_binary");
+    return ret;
+}
+#endif
+
+static void compile_shader(int shader, const char *code,
+                           const char *include1,
+                           const char *include2)
 {
-    int status, len;
-    char *log;
 #ifndef GLES2
     // We need GLSL version 1.2 to have gl_PointCoord support in desktop OpenGL
     // It's already included in GLES 2.0
@@ -67,17 +92,21 @@ static int compile_shader(int shader, const char *code,
     const char *sources[] = {pre, include1, include2, code};
     glShaderSource(shader, 4, (const char**)&sources, NULL);
     glCompileShader(shader);
+}
+
+static void log_compile_errors(int shader)
+{
+    int status, len;
+    char *log;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-    if (status != GL_TRUE) {
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
-        log = malloc(len + 1);
-        LOG_E("Compile shader error:");
-        glGetShaderInfoLog(shader, len, &len, log);
-        LOG_E("%s", log);
-        free(log);
-        assert(false);
-    }
-    return 0;
+    if (status == GL_TRUE) return;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+    log = malloc(len + 1);
+    LOG_E("Compile shader error:");
+    glGetShaderInfoLog(shader, len, &len, log);
+    LOG_E("%s", log);
+    free(log);
+    assert(false);
 }
 
 /*
@@ -96,24 +125,32 @@ static int compile_shader(int shader, const char *code,
 gl_shader_t *gl_shader_create(const char *vert, const char *frag,
                               const char *include, const char **attr_names)
 {
-    int i, status, len, count;
+    gl_shader_t *shader;
+    shader = gl_shader_create_async(vert, frag, include, attr_names);
+    if (gl_shader_finish(shader)) {
+        gl_shader_delete(shader);
+        return NULL;
+    }
+    return shader;
+}
+
+gl_shader_t *gl_shader_create_async(const char *vert, const char *frag,
+                                    const char *include,
+                                    const char **attr_names)
+{
+    int i;
     int vertex_shader, fragment_shader;
-    char log[1024];
     gl_shader_t *shader;
     GLint prog;
-    gl_uniform_t *uni;
 
     vertex_shader = glCreateShader(GL_VERTEX_SHADER);
     include = include ? : "";
     assert(vertex_shader);
-    if (compile_shader(vertex_shader, vert,
-                       "#define VERTEX_SHADER\n", include))
-        return NULL;
+    compile_shader(vertex_shader, vert, "#define VERTEX_SHADER\n", include);
     fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
     assert(fragment_shader);
-    if (compile_shader(fragment_shader, frag,
-                       "#define FRAGMENT_SHADER\n", include))
-        return NULL;
+    compile_shader(fragment_shader, frag, "#define FRAGMENT_SHADER\n",
+                   include);
     prog = glCreateProgram();
     glAttachShader(prog, vertex_shader);
     glAttachShader(prog, fragment_shader);
@@ -125,18 +162,76 @@ gl_shader_t *gl_shader_create(const char *vert, const char *frag,
         }
     }
 
+#if HAS_PROGRAM_BINARY
+    if (has_program_binary())
+        glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
     glLinkProgram(prog);
+
+    shader = calloc(1, sizeof(*shader));
+    shader->prog = prog;
+    shader->pending = true;
+    return shader;
+}
+
+gl_shader_t *gl_shader_create_from_binary(int format, const void *data,
+                                          int size)
+{
+#if HAS_PROGRAM_BINARY
+    gl_shader_t *shader;
+    GLint status;
+    GLint prog;
+
+    if (!has_program_binary()) return NULL;
+    prog = glCreateProgram();
+    glProgramBinary(prog, format, data, size);
     glGetProgramiv(prog, GL_LINK_STATUS, &status);
+    // Not an error: the binary can be rejected after a driver update.
     if (status != GL_TRUE) {
-        LOG_E("Link Error");
-        glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &len);
-        glGetProgramInfoLog(prog, sizeof(log), NULL, log);
-        LOG_E("%s", log);
+        glDeleteProgram(prog);
         return NULL;
     }
-
     shader = calloc(1, sizeof(*shader));
     shader->prog = prog;
+    shader->pending = true;
+    return shader;
+#else
+    return NULL;
+#endif
+}
+
+bool gl_shader_is_ready(const gl_shader_t *shader)
+{
+    static int parallel_compile = -1;
+    GLint status;
+
+    if (!shader->pending) return true;
+    if (parallel_compile == -1)
+        parallel_compile = has_extension("GL_KHR_parallel_shader_compile");
+    if (!parallel_compile) return true;
+    glGetProgramiv(shader->prog, GL_COMPLETION_STATUS_KHR, &status);
+    return status == GL_TRUE;
+}
+
+int gl_shader_finish(gl_shader_t *shader)
+{
+    int i, status, len, count;
+    GLuint shaders[2];
+    char log[1024];
+    gl_uniform_t *uni;
+
+    if (!shader->pending) return 0;
+    shader->pending = false;
+    glGetProgramiv(shader->prog, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        glGetAttachedShaders(shader->prog, 2, &count, shaders);
+        for (i = 0; i < count; i++) log_compile_errors(shaders[i]);
+        LOG_E("Link Error");
+        glGetProgramiv(shader->prog, GL_INFO_LOG_LENGTH, &len);
+        glGetProgramInfoLog(shader->prog, sizeof(log), NULL, log);
+        LOG_E("%s", log);
+        return -1;
+    }
 
     GL(glGetProgramiv(shader->prog, GL_ACTIVE_UNIFORMS, &count));
     for (i = 0; i < count; i++) {
@@ -145,14 +240,36 @@ gl_shader_t *gl_shader_create(const char *vert, const char *frag,
                               NULL, &uni->size, &uni->type, uni->name));
         // Special case for array uniforms: remove the '[0]'
         if (uni->size > 1) {
-            assert(uni->type == GL_FLOAT);
+            assert(uni->type == GL_FLOAT || uni->type == GL_FLOAT_MAT3);
             if (strchr(uni->name, '['))
                 *strchr(uni->name, '[') = '\0';
         }
         GL(uni->loc = glGetUniformLocation(shader->prog, uni->name));
     }
 
-    return shader;
+    return 0;
+}
+
+int gl_shader_get_binary(const gl_shader_t *shader, int *format,
+                         void **data, int *size)
+{
+#if HAS_PROGRAM_BINARY
+    GLint len = 0, nb_formats = 0;
+    GLenum fmt;
+
+    if (!has_program_binary()) return -1;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nb_formats);
+    if (nb_formats == 0) return -1;
+    glGetProgramiv(shader->prog, GL_PROGRAM_BINARY_LENGTH, &len);
+    if (len <= 0) return -1;
+    *data = malloc(len);
+    glGetProgramBinary(shader->prog, len, &len, &fmt, *data);
+    *format = fmt;
+    *size = len;
+    return 0;
+#else
+    return -1;
+#endif
 }
 
 void gl_shader_delete(gl_shader_t *shader)
@@ -188,6 +305,14 @@ void gl_buf_next(gl_buf_t *buf)
     buf->nb++;
 }
 
+void *gl_buf_push(gl_buf_t *buf, int n)
+{
+    void *ret = buf->data + buf->nb * buf->info->size;
+    assert(buf->nb + n <= buf->capacity);
+    buf->nb += n;
+    return ret;
+}
+
 static int gl_size_for_type(int type)
 {
     switch (type) {
@@ -332,7 +457,8 @@ void gl_update_uniform(gl_shader_t *shader, const char *name, ...)
         GL(glUniform4fv(uni->loc, 1, va_arg(args, const float*)));
         break;
     case GL_FLOAT_MAT3:
-        GL(glUniformMatrix3fv(uni->loc, 1, 0, va_arg(args, const float*)));
+        GL(glUniformMatrix3fv(uni->loc, uni->size, 0,
+                              va_arg(args, const float*)));
         break;
     case GL_FLOAT_MAT4:
         GL(glUniformMatrix4fv(uni->loc, 1, 0, va_arg(args, const float*)));
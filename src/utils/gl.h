@@ -73,7 +73,9 @@ typedef struct gl_buf_info
  * the structure of the data it contains.
  *
  * The helper functions can be used to fill the buffer data without having
- * to use an explicit C struct for it.
+ * to use an explicit C struct for it.  For the hot paths it is faster to
+ * use a struct matching the layout, and write the rows returned by
+ * <gl_buf_push> directly.
  */
 typedef struct gl_buf
 {
@@ -123,6 +125,14 @@ void *gl_buf_at(gl_buf_t *buf, int idx, int attr);
  */
 void gl_buf_next(gl_buf_t *buf);
 
+/*
+ * Function: gl_buf_push
+ * Add rows at the end of a buffer, and return a pointer to the first one.
+ *
+ * The rows are not initialized.  The buffer must have enough capacity.
+ */
+void *gl_buf_push(gl_buf_t *buf, int n);
+
 /*
  * Function: gl_buf_enable
  * Enable the buffer for an opengl draw call.
@@ -153,6 +163,7 @@ typedef struct gl_uniform {
 typedef struct gl_shader {
     GLint           prog;
     gl_uniform_t    uniforms[32];
+    bool            pending; // Set until gl_shader_finish is called.
 } gl_shader_t;
 
 /*
@@ -171,6 +182,64 @@ typedef struct gl_shader {
 gl_shader_t *gl_shader_create(const char *vert, const char *frag,
                               const char *include, const char **attr_names);
 
+/*
+ * Function: gl_shader_create_async
+ * Start the compilation of an opengl shader.
+ *
+ * Same as <gl_shader_create>, but we don't wait for the compilation to be
+ * done.  The shader cannot be used before <gl_shader_finish> is called.
+ * If the driver supports KHR_parallel_shader_compile, the compilation
+ * happens in the background and <gl_shader_is_ready> tells when it is
+ * done.
+ */
+gl_shader_t *gl_shader_create_async(const char *vert, const char *frag,
+                                    const char *include,
+                                    const char **attr_names);
+
+/*
+ * Function: gl_shader_create_from_binary
+ * Create a shader from a binary returned by <gl_shader_get_binary>.
+ *
+ * Return:
+ *   A new gl_shader_t instance that still needs <gl_shader_finish>, or NULL
+ *   if the binary is not supported (for example after a driver update).
+ */
+gl_shader_t *gl_shader_create_from_binary(int format, const void *data,
+                                          int size);
+
+/*
+ * Function: gl_shader_is_ready
+ * Check if calling <gl_shader_finish> would not block.
+ */
+bool gl_shader_is_ready(const gl_shader_t *shader);
+
+/*
+ * Function: gl_shader_finish
+ * Wait for a shader compilation and get its uniforms locations.
+ *
+ * Return:
+ *   0 on success, -1 if the compilation failed.
+ */
+int gl_shader_finish(gl_shader_t *shader);
+
+/*
+ * Function: gl_shader_get_binary
+ * Get the binary of a linked shader, so that it can be saved on disk.
+ *
+ * Only supported with desktop OpenGL (4.1 or ARB_get_program_binary).
+ *
+ * Parameters:
+ *   shader - A shader.
+ *   format - Output binary format.
+ *   data   - Output allocated binary data.  The caller must free it.
+ *   size   - Output size of the binary.
+ *
+ * Return:
+ *   0 on success, -1 if not supported.
+ */
+int gl_shader_get_binary(const gl_shader_t *shader, int *format,
+                         void **data, int *size);
+
 void gl_shader_delete(gl_shader_t *shader);
 
 bool gl_has_uniform(gl_shader_t *shader, const char *name);
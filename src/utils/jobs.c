@@ -0,0 +1,120 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "jobs.h"
+
+#include "tests.h"
+#include "utlist.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+enum {
+    JOB_INIT = 0,
+    JOB_QUEUED,
+    JOB_DONE,
+};
+
+static job_t *g_queue = NULL;
+
+static double get_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000. / 1000.;
+}
+
+static int job_worker(worker_t *worker)
+{
+    job_t *job = (void*)worker;
+    while (!job->fn(job, INFINITY)) {}
+    return 0;
+}
+
+void job_init(job_t *job, int (*fn)(job_t *job, double deadline),
+              void *user, int flags)
+{
+    *job = (job_t) {
+        .fn = fn,
+        .user = user,
+        .flags = flags,
+    };
+    if (flags & JOB_THREAD_SAFE) worker_init(&job->worker, job_worker);
+}
+
+int job_iter(job_t *job)
+{
+    if (job->flags & JOB_THREAD_SAFE) {
+        if (job->state != JOB_DONE && worker_iter(&job->worker))
+            job->state = JOB_DONE;
+        return job->state == JOB_DONE;
+    }
+    if (job->state == JOB_INIT) {
+        DL_APPEND(g_queue, job);
+        job->state = JOB_QUEUED;
+    }
+    return job->state == JOB_DONE;
+}
+
+void job_cancel(job_t *job)
+{
+    if (job->flags & JOB_THREAD_SAFE) {
+        if (worker_is_running(&job->worker) && !worker_cancel(&job->worker))
+            while (!worker_iter(&job->worker)) {}
+    } else if (job->state == JOB_QUEUED) {
+        DL_DELETE(g_queue, job);
+    }
+    job->state = JOB_INIT;
+}
+
+bool jobs_run(double budget)
+{
+    job_t *job;
+    double deadline;
+
+    if (!g_queue) return false;
+    deadline = get_time() + budget;
+    do {
+        job = g_queue;
+        DL_DELETE(g_queue, job);
+        if (job->fn(job, deadline)) {
+            job->state = JOB_DONE;
+        } else {
+            // Put it back at the end so that all the jobs progress.
+            DL_APPEND(g_queue, job);
+        }
+    } while (g_queue && get_time() < deadline);
+    return true;
+}
+
+#if COMPILE_TESTS
+
+static int test_job_fn(job_t *job, double deadline)
+{
+    int *n = job->user;
+    return ++(*n) >= 3;
+}
+
+static void test_jobs(void)
+{
+    job_t job;
+    int n = 0;
+    job_init(&job, test_job_fn, &n, 0);
+    assert(!job_iter(&job));
+    // Each run calls the job at least once.
+    while (!job_iter(&job)) jobs_run(0);
+    assert(n == 3);
+    assert(!jobs_run(0));
+}
+
+TEST_REGISTER(NULL, test_jobs, TEST_AUTO);
+
+#endif
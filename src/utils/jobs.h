@@ -0,0 +1,105 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * File: jobs.h
+ * Time sliced background jobs.
+ *
+ * A job is a resumable task, like the parsing of a large file, that is run
+ * a bit at each frame by <jobs_run>, so that it doesn't make a single frame
+ * take too long.  Like for the workers, we create a job with <job_init>,
+ * then call <job_iter> as many times as we want, until it returns a non
+ * zero value.
+ *
+ * The jobs that don't touch any shared state can set the JOB_THREAD_SAFE
+ * flag, in which case they run in the worker pool instead.
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+
+#include "worker.h"
+
+enum {
+    JOB_THREAD_SAFE = 1 << 0, // Run the job in the worker pool.
+};
+
+typedef struct job job_t;
+
+struct job
+{
+    worker_t worker; // Used by the thread safe jobs.
+    /*
+     * Job function.  Should do some work and return as soon as possible
+     * after the deadline (unix time in sec).
+     *
+     * Return:
+     *   0 if the job is not finished yet, in which case the function will
+     *   be called again at the next frame.
+     */
+    int (*fn)(job_t *job, double deadline);
+    void *user;
+    int flags;
+    int state;
+    job_t *prev, *next; // Used by the jobs queue.
+};
+
+/*
+ * Function: job_init
+ * Initialize a job struct.
+ *
+ * Parameters:
+ *   job   - The job.
+ *   fn    - The job function.
+ *   user  - User data, accessible in the function as job->user.
+ *   flags - Union of <JOB_THREAD_SAFE>.
+ */
+void job_init(job_t *job, int (*fn)(job_t *job, double deadline),
+              void *user, int flags);
+
+/*
+ * Function: job_iter
+ * Queue a job and check if it has finished.
+ *
+ * The first call adds the job to the queue, the following calls just
+ * check if the job has finished.
+ *
+ * Return:
+ *   0 if the job has not finished yet.
+ */
+int job_iter(job_t *job);
+
+/*
+ * Function: job_cancel
+ * Remove a job from the queue.
+ *
+ * Must be called before releasing a job that didn't finish.  For thread
+ * safe jobs this waits until the worker is done.
+ */
+void job_cancel(job_t *job);
+
+/*
+ * Function: jobs_run
+ * Run the queued jobs for a given time.
+ *
+ * The jobs are run in turn, until the time budget has elapsed.  We always
+ * call at least one job function, so that the jobs progress even with a
+ * zero budget.
+ *
+ * Parameters:
+ *   budget - Maximum time to spend in the jobs (sec).
+ *
+ * Return:
+ *   true if any job function has been called.
+ */
+bool jobs_run(double budget);
+
+#endif // JOBS_H
@@ -8,10 +8,12 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "json-builder.h"
 #include "json_expression.h"
+#include "tests.h"
 
 static bool json_equals(const json_value *a, const json_value *b)
 {
@@ -102,10 +104,183 @@ end:
 
 bool json_expression_eval_bool(const json_value* ctx, const json_value *expr)
 {
-    json_value *val;
-    bool ret, should_delete;
-    val = json_expression_eval(ctx, expr, &should_delete);
-    ret = val && val->type == json_boolean && val->u.boolean;
-    if (should_delete) json_builder_free(val);
+    json_expression_t *compiled;
+    bool ret;
+    compiled = json_expression_compile(expr);
+    ret = json_expression_test(compiled, ctx);
+    json_expression_delete(compiled);
     return ret;
 }
+
+enum {
+    OP_ERROR = 0,
+    OP_CONST,
+    OP_EQUAL,
+    OP_GET,
+};
+
+// A compiled expression node.  The arguments are indices in the nodes
+// array.
+typedef struct {
+    int                 op;
+    int                 nb_args;
+    int                 args[2];
+    const json_value    *value; // Only for OP_CONST.
+    const char          *key;   // Only for OP_GET with a constant key.
+    unsigned int        key_len;
+    int                 hint;   // Index of the last found attribute.
+} node_t;
+
+struct json_expression {
+    int         nb_nodes;
+    node_t      *nodes;
+};
+
+static const json_value g_true = {.type = json_boolean, .u.boolean = 1};
+static const json_value g_false = {.type = json_boolean, .u.boolean = 0};
+
+static int count_nodes(const json_value *expr)
+{
+    int i, ret = 1;
+    if (expr->type != json_array) return 1;
+    for (i = 1; i < expr->u.array.length; i++)
+        ret += count_nodes(expr->u.array.values[i]);
+    return ret;
+}
+
+// Compile an expression into the nodes array, and return the node index.
+static int compile(json_expression_t *ret, const json_value *expr)
+{
+    int i, idx = ret->nb_nodes++;
+    node_t *node = &ret->nodes[idx];
+    const json_value *op;
+
+    if (expr->type != json_array) {
+        node->op = OP_CONST;
+        node->value = expr;
+        return idx;
+    }
+    if (expr->u.array.length == 0) return idx;
+    node->nb_args = expr->u.array.length - 1;
+    // Note: the nodes array is never reallocated, so node stays valid.
+    for (i = 0; i < node->nb_args && i < 2; i++)
+        node->args[i] = compile(ret, expr->u.array.values[i + 1]);
+    for (; i < node->nb_args; i++)
+        compile(ret, expr->u.array.values[i + 1]);
+
+    op = expr->u.array.values[0];
+    if (op->type != json_string || node->nb_args > 2) return idx;
+    if (strcmp(op->u.string.ptr, "==") == 0 && node->nb_args == 2)
+        node->op = OP_EQUAL;
+    if (strcmp(op->u.string.ptr, "get") == 0 && node->nb_args >= 1) {
+        node->op = OP_GET;
+        op = ret->nodes[node->args[0]].value;
+        if (op && op->type == json_string) {
+            node->key = op->u.string.ptr;
+            node->key_len = op->u.string.length;
+        }
+    }
+    return idx;
+}
+
+json_expression_t *json_expression_compile(const json_value *expr)
+{
+    json_expression_t *ret = calloc(1, sizeof(*ret));
+    ret->nodes = calloc(count_nodes(expr), sizeof(*ret->nodes));
+    compile(ret, expr);
+    return ret;
+}
+
+void json_expression_delete(json_expression_t *expr)
+{
+    if (!expr) return;
+    free(expr->nodes);
+    free(expr);
+}
+
+static const json_value *node_get(node_t *node, const json_value *obj)
+{
+    const json_object_entry *entries;
+    int i, n;
+
+    if (!node->key || !obj || obj->type != json_object) return NULL;
+    entries = obj->u.object.values;
+    n = obj->u.object.length;
+    // Most of the time all the values have the same keys layout.
+    i = node->hint;
+    if (i < n && entries[i].name_length == node->key_len &&
+            memcmp(entries[i].name, node->key, node->key_len) == 0)
+        return entries[i].value;
+    for (i = 0; i < n; i++) {
+        if (entries[i].name_length == node->key_len &&
+                memcmp(entries[i].name, node->key, node->key_len) == 0) {
+            node->hint = i;
+            return entries[i].value;
+        }
+    }
+    return NULL;
+}
+
+// Evaluate a node, returns NULL for a null value.
+static const json_value *eval(json_expression_t *expr, int idx,
+                              const json_value *ctx)
+{
+    node_t *node = &expr->nodes[idx];
+    const json_value *a, *b;
+
+    switch (node->op) {
+    case OP_CONST:
+        return node->value;
+    case OP_EQUAL:
+        a = eval(expr, node->args[0], ctx);
+        b = eval(expr, node->args[1], ctx);
+        return (a && b && json_equals(a, b)) ? &g_true : &g_false;
+    case OP_GET:
+        return node_get(node, node->nb_args == 2 ?
+                        eval(expr, node->args[1], ctx) : ctx);
+    default:
+        return NULL;
+    }
+}
+
+bool json_expression_test(json_expression_t *expr, const json_value *ctx)
+{
+    const json_value *val = eval(expr, 0, ctx);
+    return val && val->type == json_boolean && val->u.boolean;
+}
+
+#if COMPILE_TESTS
+
+static void test_json_expression(void)
+{
+    const char *filter_str =
+        "[\"==\", [\"get\", \"name\", [\"get\", \"properties\"]],"
+        " \"Orion\"]";
+    const char *values[] = {
+        "{\"properties\": {\"id\": 1, \"name\": \"Orion\"}}",
+        "{\"properties\": {\"id\": 2, \"name\": \"Lyra\"}}",
+        // Different keys layout.
+        "{\"type\": 0, \"properties\": {\"name\": \"Orion\"}}",
+        "{\"properties\": {\"id\": 3}}",
+        "{}",
+    };
+    const bool expected[] = {true, false, true, false, false};
+    json_value *filter, *val;
+    json_expression_t *expr;
+    int i;
+
+    filter = json_parse(filter_str, strlen(filter_str));
+    expr = json_expression_compile(filter);
+    for (i = 0; i < 5; i++) {
+        val = json_parse(values[i], strlen(values[i]));
+        assert(json_expression_test(expr, val) == expected[i]);
+        assert(json_expression_eval_bool(val, filter) == expected[i]);
+        json_value_free(val);
+    }
+    json_expression_delete(expr);
+    json_value_free(filter);
+}
+
+TEST_REGISTER(NULL, test_json_expression, TEST_AUTO);
+
+#endif
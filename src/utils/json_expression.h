@@ -25,3 +25,35 @@ json_value *json_expression_eval(const json_value *ctx,
                                  bool *should_delete);
 
 bool json_expression_eval_bool(const json_value* ctx, const json_value *expr);
+
+/*
+ * Type: json_expression_t
+ * A json expression compiled once, to be tested quickly against many
+ * values.
+ */
+typedef struct json_expression json_expression_t;
+
+/*
+ * Function: json_expression_compile
+ * Compile a json expression.
+ *
+ * The operators are resolved once, and the evaluation doesn't allocate
+ * anything.
+ *
+ * Return:
+ *   A new json_expression_t instance, to delete with
+ *   <json_expression_delete>.
+ */
+json_expression_t *json_expression_compile(const json_value *expr);
+
+/*
+ * Function: json_expression_test
+ * Evaluate a compiled expression as a boolean.
+ *
+ * Same as <json_expression_eval_bool>.  The expression keeps the index of
+ * the last attributes found, so that values with the same keys layout are
+ * fast to test, this is why it is not const.
+ */
+bool json_expression_test(json_expression_t *expr, const json_value *ctx);
+
+void json_expression_delete(json_expression_t *expr);
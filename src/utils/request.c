@@ -10,17 +10,26 @@
 #ifndef NO_LIBCURL
 
 #include "request.h"
+#include "diskcache.h"
+#include "uthash.h"
+#include "utlist.h"
 #include "utstring.h"
 
 #include <assert.h>
 #include <curl/curl.h>
 #include <errno.h>
+#include <float.h>
+#include <limits.h>
 #include <regex.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 
+#ifdef HAVE_PTHREAD
+#   include <pthread.h>
+#endif
+
 #ifndef LOG_E
 #   define LOG_E
 #endif
@@ -29,14 +38,101 @@
 #   define PATH_MAX 1024
 #endif
 
-#define MAX_NB  16
+// Bounds of the per host number of concurrent requests.
+#define HOST_MIN_NB     4
+#define HOST_START_NB   8
+#define HOST_MAX_NB     16  // With HTTP/1, one connection per request.
+#define HOST_MAX_NB_H2  64  // With HTTP/2, one stream per request.
+
+// Min time between two calls to curl_multi_perform (sec), since the
+// update is called for each request we check.
+#define UPDATE_INTERVAL (1.0 / 1000)
+
+// Max size of the packed disk cache.
+#define DISK_CACHE_MAX_SIZE ((int64_t)2 << 30)
+
+// Max number of background revalidations pending at the same time.
+#define MAX_REVALIDATIONS 1024
+
+/*
+ * Type: host_t
+ * Per host state, used to limit the number of concurrent requests.
+ *
+ * The limit adapts to the server latency: as long as the time to first
+ * byte stays close to the lowest one we have seen, we allow more
+ * requests.  When it increases, the server or the link is saturated and
+ * we reduce the limit.
+ */
+typedef struct host {
+    UT_hash_handle  hh;
+    char            *name;    // 'scheme://host:port' part of the urls.
+    int             nb;       // Number of running requests.
+    int             max_nb;   // Current concurrency limit.
+    bool            h2;       // Set once the server answered with HTTP/2.
+    double          rtt_min;  // Lowest time to first byte (sec).
+    double          rtt;      // Smoothed time to first byte (sec).
+    // Highest priority of the requests waiting for a slot, during the
+    // current and the previous updates.  Only the requests with at least
+    // the previous value can start.
+    double          wait_prio;
+    double          min_prio;
+} host_t;
+
+/*
+ * Type: revalidation_t
+ * Background revalidation of an expired value of the disk cache.
+ *
+ * We keep them after they are done, so that each url is only revalidated
+ * once per session.
+ */
+typedef struct revalidation {
+    UT_hash_handle  hh;
+    request_t       *req; // NULL once done.
+    char            url[];
+} revalidation_t;
+
+/*
+ * Type: cache_write_t
+ * A file of the disk cache to be written by the I/O thread.
+ */
+typedef struct cache_write cache_write_t;
+struct cache_write {
+    char            *path;
+    void            *data;
+    int             size;
+    char            *etag;
+    double          expiration;
+    cache_write_t   *prev, *next;
+};
 
 // static data.
 static struct {
     CURLM        *curlm;
+    CURLSH       *share; // DNS, TLS sessions and connections cache.
     char         *cache_dir;
+    diskcache_t  *disk_cache; // Packed cache for all the responses.
+    host_t       *hosts;
+    revalidation_t *revalidations;
+    int          nb_revalidating; // Number of pending revalidations.
     int          nb; // Number of current running handles.
-} g = {};
+    int          nb_done; // Number of completed handles.
+    int64_t      cache_max_size; // Zero for DISK_CACHE_MAX_SIZE.
+#ifdef HAVE_PTHREAD
+    // Queue of the disk cache writes, processed in the I/O thread.
+    struct {
+        pthread_mutex_t lock;
+        pthread_cond_t  cond;
+        pthread_t       thread;
+        bool            started;
+        cache_write_t   *queue;
+    } io;
+#endif
+} g = {
+#ifdef HAVE_PTHREAD
+    .io.lock = PTHREAD_MUTEX_INITIALIZER,
+    .io.cond = PTHREAD_COND_INITIALIZER,
+#endif
+};
 
 struct request
 {
@@ -49,13 +145,25 @@ struct request
     int         size;
     bool        done;           // Request finished
     char        *local_path;    // Data saved to this file
+    const void  *packed_data;   // Data in the packed disk cache.
+    bool        data_detached;  // Data ownership given to the caller.
+    int         packed_size;
 
     struct curl_slist *headers;
     char        *etag;
     double      expiration;     // Unix time expiration date.
+    host_t      *host;          // Set when the request is running.
+    double      priority;
+
+    // Streaming function, and size of the body already passed to it.
+    struct {
+        void    (*fn)(void *user, const void *data, int size);
+        void    *user;
+        int     ofs;
+    } stream;
 };
 
-static const char *request_get_file(request_t *req, int *status_code);
+static void req_start(request_t *req);
 
 static void *read_file(const char *path, int *size)
 {
@@ -113,7 +221,7 @@ static int ensure_dir(const char *path)
     return 0;
 }
 
-static char *create_local_path(const char *url, const char *suffix)
+static char *get_local_path(const char *url, const char *suffix)
 {
     char *ret;
     int i, r;
@@ -123,16 +231,98 @@ static char *create_local_path(const char *url, const char *suffix)
         if (ret[i] == '/' || ret[i] == ':')
             ret[i] = '_';
     }
+    return ret;
+}
+
+static char *create_local_path(const char *url, const char *suffix)
+{
+    char *ret = get_local_path(url, suffix);
     ensure_dir(ret);
     return ret;
 }
 
 void request_init(const char *cache_dir)
 {
+    char *path;
+    int r;
     assert(cache_dir);
-    if (!g.curlm) g.curlm = curl_multi_init();
+    if (!g.curlm) {
+        g.curlm = curl_multi_init();
+        curl_multi_setopt(g.curlm, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        // Everything runs in the main thread, so no need for locks.
+        g.share = curl_share_init();
+        curl_share_setopt(g.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(g.share, CURLSHOPT_SHARE,
+                          CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(g.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
     free(g.cache_dir);
     g.cache_dir = strdup(cache_dir);
+    // The requests can keep pointers to the mapped data, so we never close
+    // the disk cache.  It is still in the 'tiles' directory, since it
+    // used to only contain the hips tiles.
+    if (g.disk_cache) return;
+    r = asprintf(&path, "%s/tiles", cache_dir);
+    if (r == -1) LOG_E("Error");
+    ensure_dir(path);
+    g.disk_cache = diskcache_open(path);
+    if (g.disk_cache)
+        diskcache_set_max_size(g.disk_cache,
+                               g.cache_max_size ?: DISK_CACHE_MAX_SIZE);
+    free(path);
+}
+
+/*
+ * Start a background revalidation of an expired value of the disk cache.
+ *
+ * The revalidations have the lowest priority, so they only run when no
+ * other request is waiting.  Their result is only used to update the
+ * cache.
+ */
+static void revalidate(const request_t *req)
+{
+    revalidation_t *rev;
+    request_t *rev_req;
+
+    HASH_FIND_STR(g.revalidations, req->url, rev);
+    if (rev || g.nb_revalidating >= MAX_REVALIDATIONS) return;
+    rev = calloc(1, sizeof(*rev) + strlen(req->url) + 1);
+    strcpy(rev->url, req->url);
+    HASH_ADD_STR(g.revalidations, url, rev);
+    rev_req = calloc(1, sizeof(*rev_req));
+    rev_req->url = strdup(req->url);
+    rev_req->etag = req->etag ? strdup(req->etag) : NULL;
+    rev_req->packed_data = req->packed_data;
+    rev_req->packed_size = req->packed_size;
+    rev_req->priority = -DBL_MAX;
+    rev->req = rev_req;
+    g.nb_revalidating++;
+}
+
+/*
+ * Check for a value in the packed disk cache.
+ *
+ * Expired values are still returned immediately (stale-while-revalidate),
+ * and revalidated in the background.
+ */
+static bool create_from_disk_cache(request_t *req)
+{
+    char etag[128];
+    double expiration;
+    if (!g.disk_cache) return false;
+    req->packed_data = diskcache_get(g.disk_cache, req->url,
+                                     &req->packed_size, etag, sizeof(etag),
+                                     &expiration);
+    if (!req->packed_data) return false;
+    if (*etag) req->etag = strdup(etag);
+    req->expiration = expiration;
+    req->data = (void*)req->packed_data;
+    req->size = req->packed_size;
+    req->status_code = 200;
+    req->done = true;
+    if (!req->expiration || req->expiration <= get_unix_time())
+        revalidate(req);
+    return true;
 }
 
 request_t *request_create(const char *url)
@@ -147,9 +337,11 @@ request_t *request_create(const char *url)
 
     assert(strchr(url, ':')); // Make sure we have a protocol.
 
-    // Check for cache info.
-    local_path = create_local_path(url, NULL);
-    info_path = create_local_path(url, ".info");
+    if (create_from_disk_cache(req)) return req;
+
+    // Check for the files too large for the packed cache.
+    local_path = get_local_path(url, NULL);
+    info_path = get_local_path(url, ".info");
     if (file_exists(local_path) && file_exists(info_path)) {
         file = fopen(info_path, "r");
         r = fscanf(file, "etag: %s\n", etag);
@@ -171,11 +363,42 @@ request_t *request_create(const char *url)
     return req;
 }
 
+void request_cancel(request_t *req)
+{
+    if (!req->handle) return;
+    curl_multi_remove_handle(g.curlm, req->handle);
+    curl_easy_cleanup(req->handle);
+    req->handle = NULL;
+    if (req->stream.ofs) {
+        req->stream.ofs = 0;
+        req->stream.fn(req->stream.user, NULL, 0);
+    }
+    g.nb--;
+    req->host->nb--;
+    utstring_done(&req->data_buf);
+    utstring_done(&req->header_buf);
+    req->data_buf.d = NULL;
+    req->header_buf.d = NULL;
+    if (req->headers) curl_slist_free_all(req->headers);
+    req->headers = NULL;
+}
+
+void request_set_priority(request_t *req, double priority)
+{
+    req->priority = priority;
+}
+
 void request_delete(request_t *req)
 {
     if (!req) return;
-    if (req->handle) LOG_E("Aborting request not implemented yet!");
-    if (req->data != utstring_body(&req->data_buf)) free(req->data);
+    req->stream.fn = NULL;
+    req->stream.ofs = 0;
+    request_cancel(req);
+    if (req->data_detached && req->data == utstring_body(&req->data_buf))
+        req->data_buf.d = NULL;
+    if (!req->data_detached && req->data != utstring_body(&req->data_buf) &&
+        req->data != req->packed_data)
+        free(req->data);
     utstring_done(&req->data_buf);
     utstring_done(&req->header_buf);
     free(req->url);
@@ -185,19 +408,105 @@ void request_delete(request_t *req)
     free(req);
 }
 
-static void save_cache(const char *url, const char *path, const char *etag,
-                       double expiration)
+/*
+ * Write a file of the disk cache and its info file.
+ *
+ * Since this can run in the I/O thread while the main thread checks the
+ * cache, the files are first written to a temporary path then renamed,
+ * and the info file comes last, so that a file with an info file is
+ * always complete.
+ */
+static void cache_write(const cache_write_t *w)
 {
-    char *info_path;
+    char *info_path, *tmp_path;
     FILE *file;
     int r;
-    r = asprintf(&info_path, "%s.info", path);
+
+    ensure_dir(w->path);
+    r = asprintf(&tmp_path, "%s.tmp", w->path);
     if (r == -1) LOG_E("Error");
-    file = fopen(info_path, "w");
-    fprintf(file, "etag: %s\n", etag);
-    fprintf(file, "expiration: %.0f\n", expiration);
+    file = fopen(tmp_path, "wb");
+    if (!file) {
+        perror(NULL);
+        free(tmp_path);
+        return;
+    }
+    fwrite(w->data, 1, w->size, file);
     fclose(file);
+    rename(tmp_path, w->path);
+
+    r = asprintf(&info_path, "%s.info", w->path);
+    if (r == -1) LOG_E("Error");
+    file = fopen(tmp_path, "w");
+    fprintf(file, "etag: %s\n", w->etag);
+    fprintf(file, "expiration: %.0f\n", w->expiration);
+    fclose(file);
+    rename(tmp_path, info_path);
     free(info_path);
+    free(tmp_path);
+}
+
+static void cache_write_delete(cache_write_t *w)
+{
+    free(w->path);
+    free(w->data);
+    free(w->etag);
+    free(w);
+}
+
+#ifdef HAVE_PTHREAD
+static void *io_thread_func(void *args)
+{
+    cache_write_t *w;
+    while (true) {
+        pthread_mutex_lock(&g.io.lock);
+        while (!g.io.queue) pthread_cond_wait(&g.io.cond, &g.io.lock);
+        w = g.io.queue;
+        DL_DELETE(g.io.queue, w);
+        pthread_mutex_unlock(&g.io.lock);
+        cache_write(w);
+        cache_write_delete(w);
+    }
+    return NULL;
+}
+#endif
+
+/*
+ * Save some data into the disk cache.
+ *
+ * The data is copied, and written in the I/O thread if we have threads
+ * support.  Pending writes are lost if the program exits, which is fine
+ * for a cache.
+ */
+static void save_cache(const char *url, const void *data, int size,
+                       const char *etag, double expiration)
+{
+    cache_write_t *w = calloc(1, sizeof(*w));
+    w->path = get_local_path(url, NULL);
+    w->data = malloc(size);
+    memcpy(w->data, data, size);
+    w->size = size;
+    w->etag = strdup(etag);
+    w->expiration = expiration;
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&g.io.lock);
+    if (!g.io.started) {
+        if (pthread_create(&g.io.thread, NULL, io_thread_func, NULL) == 0) {
+            pthread_detach(g.io.thread);
+            g.io.started = true;
+        }
+    }
+    if (g.io.started) {
+        DL_APPEND(g.io.queue, w);
+        pthread_cond_signal(&g.io.cond);
+        pthread_mutex_unlock(&g.io.lock);
+        return;
+    }
+    pthread_mutex_unlock(&g.io.lock);
+#endif
+    cache_write(w);
+    cache_write_delete(w);
 }
 
 static bool header_find(const char *header, const char *re,
@@ -227,11 +536,23 @@ static void on_done(request_t *req)
 {
     char buf[128] = {};
     const char *header;
-    const char *path;
 
     assert(!req->local_path);
 
-    // The resource didn't change.
+    // The resource didn't change.  If we got a new expiration date, save
+    // it in the cache.
+    if (req->status_code / 100 == 3 && req->packed_data) {
+        req->data = (void*)req->packed_data;
+        req->size = req->packed_size;
+        header = utstring_body(&req->header_buf);
+        if (header_find(header, "Cache-Control: max-age=([0-9]+)\r\n",
+                        buf, sizeof(buf))) {
+            req->expiration = get_unix_time() + atof(buf);
+            diskcache_put(g.disk_cache, req->url, req->data, req->size,
+                          req->etag, req->expiration);
+        }
+        goto end;
+    }
     if (req->status_code / 100 == 3) {
         req->local_path = create_local_path(req->url, NULL);
         assert(file_exists(req->local_path));
@@ -249,27 +570,104 @@ static void on_done(request_t *req)
                     buf, sizeof(buf))) {
         req->expiration = get_unix_time() + atof(buf);
     }
-    // For the moment we save all the files in the cache as long as they
-    // have an etag.  We also never clean the cache!
-    if (req->etag) {
-        path = request_get_file(req, NULL);
-        save_cache(req->url, path, req->etag, req->expiration);
-    }
+    // We save all the files in the cache as long as they have an etag.
+    // Only the files too large for the packed cache get saved as
+    // individual files, and those are never cleaned.
+    if (req->etag && g.disk_cache &&
+        diskcache_put(g.disk_cache, req->url, req->data, req->size,
+                      req->etag, req->expiration) == 0)
+        goto end;
+    if (req->etag)
+        save_cache(req->url, req->data, req->size, req->etag, req->expiration);
 
 end:
     return;
 }
 
+static host_t *get_host(const char *url)
+{
+    host_t *host;
+    const char *start, *end;
+    int len;
+
+    start = strstr(url, "://");
+    start = start ? start + 3 : url;
+    end = strchr(start, '/');
+    len = end ? end - url : strlen(url);
+    HASH_FIND(hh, g.hosts, url, len, host);
+    if (host) return host;
+    host = calloc(1, sizeof(*host));
+    host->name = strndup(url, len);
+    host->max_nb = HOST_START_NB;
+    host->wait_prio = -DBL_MAX;
+    host->min_prio = -DBL_MAX;
+    HASH_ADD_KEYPTR(hh, g.hosts, host->name, len, host);
+    return host;
+}
+
+// Adjust the host concurrency limit after a request finished.
+static void host_on_done(host_t *host, CURL *handle)
+{
+    double pretransfer = 0, starttransfer = 0, rtt;
+    long version = 0;
+    int max_nb;
+
+    host->nb--;
+    curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &version);
+    if (version >= CURL_HTTP_VERSION_2_0) host->h2 = true;
+    curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+    curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &starttransfer);
+    rtt = starttransfer - pretransfer;
+    if (rtt <= 0) return;
+
+    // Let the min rtt slowly increase, in case the conditions change.
+    if (host->rtt_min) host->rtt_min *= 1.01;
+    if (!host->rtt_min || rtt < host->rtt_min) host->rtt_min = rtt;
+    host->rtt = host->rtt ? host->rtt * 0.875 + rtt * 0.125 : rtt;
+    max_nb = host->h2 ? HOST_MAX_NB_H2 : HOST_MAX_NB;
+    if (host->rtt < 2 * host->rtt_min && host->max_nb < max_nb)
+        host->max_nb++;
+    else if (host->rtt > 4 * host->rtt_min)
+        host->max_nb = host->max_nb * 3 / 4 > HOST_MIN_NB ?
+                       host->max_nb * 3 / 4 : HOST_MIN_NB;
+}
+
+static void update_revalidations(void)
+{
+    revalidation_t *rev, *tmp;
+    if (!g.nb_revalidating) return;
+    HASH_ITER(hh, g.revalidations, rev, tmp) {
+        if (!rev->req) continue;
+        if (rev->req->done) {
+            request_delete(rev->req);
+            rev->req = NULL;
+            g.nb_revalidating--;
+            continue;
+        }
+        req_start(rev->req);
+    }
+}
+
 static void update(void)
 {
     int nb, msgs_in_queue;
     CURLMsg *msg;
     CURL *handle;
     request_t *req;
+    host_t *host, *tmp;
     static double last = 0;
 
-    // Avoid loading too many resources too fast to keep a good framerate.
-    if ((get_unix_time() - last) < 16.0 / 1000) return;
+    // We don't limit the number of completed requests: the frame time is
+    // protected on the consumer side (tiles creation and texture upload
+    // budgets).
+    if ((get_unix_time() - last) < UPDATE_INTERVAL) return;
+    last = get_unix_time();
+
+    HASH_ITER(hh, g.hosts, host, tmp) {
+        host->min_prio = host->wait_prio;
+        host->wait_prio = -DBL_MAX;
+    }
+    update_revalidations();
 
     assert(g.curlm);
     curl_multi_perform(g.curlm, &nb);
@@ -284,6 +682,8 @@ static void update(void)
             if (!req->status_code && msg->data.result)
                 req->status_code = 598;
             g.nb--;
+            g.nb_done++;
+            host_on_done(req->host, handle);
             curl_multi_remove_handle(g.curlm, handle);
             curl_easy_cleanup(handle);
             req->handle = NULL;
@@ -296,33 +696,68 @@ static void update(void)
                 req->data = utstring_body(&req->data_buf);
             }
             on_done(req);
-            last = get_unix_time();
-            break;
         }
     }
 }
 
+// Pass the new part of the body to the streaming function.
+static void stream_update(request_t *req)
+{
+    const char *data;
+    int size;
+
+    if (!req->stream.fn) return;
+    if (req->done) {
+        data = req->data;
+        size = req->size;
+    } else {
+        data = utstring_body(&req->data_buf);
+        size = utstring_len(&req->data_buf);
+    }
+    if (!data || size <= req->stream.ofs) return;
+    req->stream.fn(req->stream.user, data + req->stream.ofs,
+                   size - req->stream.ofs);
+    req->stream.ofs = size;
+}
+
 static size_t write_callback(
         char *ptr, size_t size, size_t nmemb, void *userdata)
 {
-    UT_string *buf = userdata;
+    request_t *req = userdata;
     size_t len = size * nmemb;
-    utstring_bincpy(buf, ptr, len);
+    curl_off_t content_length = 0;
+
+    // Allocate the full buffer at once if we know its size, including the
+    // zero byte we add at the end.
+    if (!utstring_len(&req->data_buf)) {
+        curl_easy_getinfo(req->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                          &content_length);
+        if (content_length > 0 && content_length < INT_MAX)
+            utstring_reserve(&req->data_buf, content_length + 1);
+    }
+    utstring_bincpy(&req->data_buf, ptr, len);
+    stream_update(req);
     return len;
 }
 
-static void req_update(request_t *req)
+// Start the request if it is not running yet and its host has a free slot.
+static void req_start(request_t *req)
 {
     int r;
     char *tmp;
-    assert(g.curlm); // Check that request_init was called!
-    if (req->done) return;
-    if (!req->handle && g.nb < MAX_NB) {
+    if (!req->host) req->host = get_host(req->url);
+    if (!req->handle && (req->host->nb >= req->host->max_nb ||
+                         req->priority < req->host->min_prio)) {
+        if (req->priority > req->host->wait_prio)
+            req->host->wait_prio = req->priority;
+    }
+    if (!req->handle && req->host->nb < req->host->max_nb &&
+        req->priority >= req->host->min_prio) {
         req->handle = curl_easy_init();
         utstring_init(&req->data_buf);
         utstring_init(&req->header_buf);
         curl_easy_setopt(req->handle, CURLOPT_WRITEFUNCTION, write_callback);
-        curl_easy_setopt(req->handle, CURLOPT_WRITEDATA, &req->data_buf);
+        curl_easy_setopt(req->handle, CURLOPT_WRITEDATA, req);
         curl_easy_setopt(req->handle, CURLOPT_HEADERDATA, &req->header_buf);
         curl_easy_setopt(req->handle, CURLOPT_URL, req->url);
         curl_easy_setopt(req->handle, CURLOPT_FAILONERROR, 1);
@@ -330,6 +765,13 @@ static void req_update(request_t *req)
         curl_easy_setopt(req->handle, CURLOPT_FOLLOWLOCATION, 1);
         curl_easy_setopt(req->handle, CURLOPT_SSL_VERIFYPEER, 0);
         curl_easy_setopt(req->handle, CURLOPT_SSL_VERIFYHOST, 0);
+        curl_easy_setopt(req->handle, CURLOPT_SHARE, g.share);
+        // Use HTTP/2 when possible, and prefer to wait for an existing
+        // connection to multiplex the request rather than opening a new
+        // one.
+        curl_easy_setopt(req->handle, CURLOPT_HTTP_VERSION,
+                         CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(req->handle, CURLOPT_PIPEWAIT, 1L);
         // curl_easy_setopt(req->handle, CURLOPT_VERBOSE, 1);
         if (req->etag) {
             r = asprintf(&tmp, "If-None-Match: \"%s\"", req->etag);
@@ -342,27 +784,16 @@ static void req_update(request_t *req)
 
         curl_multi_add_handle(g.curlm, req->handle);
         g.nb++;
+        req->host->nb++;
     }
-
-    update();
 }
 
-static const char *request_get_file(request_t *req, int *status_code)
+static void req_update(request_t *req)
 {
-    FILE *file;
-    if (!req->local_path) {
-        req_update(req);
-        if (req->done && req->status_code / 100 == 2) {
-            req->local_path = create_local_path(req->url, NULL);
-            file = fopen(req->local_path, "wb");
-            if (!file) perror(NULL);
-            assert(file);
-            fwrite(utstring_body(&req->data_buf), 1, req->size, file);
-            fclose(file);
-        }
-    }
-    if (status_code) *status_code = req->status_code;
-    return req->local_path;
+    assert(g.curlm); // Check that request_init was called!
+    if (req->done) return;
+    req_start(req);
+    update();
 }
 
 const void *request_get_data(request_t *req, int *size, int *status_code)
@@ -377,14 +808,65 @@ const void *request_get_data(request_t *req, int *size, int *status_code)
     if (!req->data && req->local_path) {
         req->data = read_file(req->local_path, &req->size);
     }
+    stream_update(req);
     if (size) *size = req->size;
     return req->data;
 }
 
+void request_set_stream(request_t *req, void *user,
+                        void (*fn)(void *user, const void *data, int size))
+{
+    req->stream.fn = fn;
+    req->stream.user = user;
+}
+
+void *request_detach_data(request_t *req)
+{
+    assert(req->done && req->data && !req->data_detached);
+    if (req->data == req->packed_data) return NULL;
+    req->data_detached = true;
+    return req->data;
+}
+
+int request_cache_put(const char *key, const void *data, int size)
+{
+    if (!g.disk_cache) return -1;
+    return diskcache_put(g.disk_cache, key, data, size, NULL, 0);
+}
+
+const void *request_cache_get(const char *key, int *size)
+{
+    if (!g.disk_cache) return NULL;
+    return diskcache_get(g.disk_cache, key, size, NULL, 0, NULL);
+}
+
 void request_make_fresh(request_t *req)
 {
     free(req->etag);
     req->etag = NULL;
 }
 
+void request_set_cache_max_size(int64_t size)
+{
+    g.cache_max_size = size;
+    if (g.disk_cache)
+        diskcache_set_max_size(g.disk_cache, size ?: DISK_CACHE_MAX_SIZE);
+}
+
+int request_get_nb_running(int *nb_done)
+{
+    if (nb_done) *nb_done = g.nb_done;
+    return g.nb;
+}
+
+void request_wait(double timeout)
+{
+    if (!g.curlm || !g.nb || timeout <= 0) return;
+#if LIBCURL_VERSION_NUM >= 0x074200
+    curl_multi_poll(g.curlm, NULL, 0, timeout * 1000, NULL);
+#else
+    curl_multi_wait(g.curlm, NULL, 0, timeout * 1000, NULL);
+#endif
+}
+
 #endif // NO_LIBCURL
@@ -7,12 +7,49 @@
  * repository.
  */
 
+#include <stdint.h>
 
 typedef struct request request_t;
 
 void request_init(const char *cache_dir);
 request_t *request_create(const char *url);
 void request_delete(request_t *req);
+// Abort the request if it is running.  It will start again from scratch the
+// next time we get its data.  Does nothing if the request is done.
+void request_cancel(request_t *req);
+// Requests waiting for a free slot start in decreasing priority order.  The
+// default priority is zero.
+void request_set_priority(request_t *req, double priority);
 const void *request_get_data(request_t *req, int *size, int *status_code);
+// Set a function called with the response body chunks as they arrive, so
+// that large files can be parsed while they download.  The chunks come in
+// order and cover the whole body once the request is done, that we can
+// still get with request_get_data.  If the request restarts, the function
+// is called with NULL data, meaning that the previous chunks must be
+// discarded.  Without streaming support the body comes in a single chunk.
+void request_set_stream(request_t *req, void *user,
+                        void (*fn)(void *user, const void *data, int size));
+// Give the ownership of the returned data to the caller, that will have to
+// free it.  Return NULL if the request doesn't own the data (for example if
+// it's memory mapped), in which case the data stays valid until exit.
+void *request_detach_data(request_t *req);
+// Save some data in the disk cache under a key that is not an url, for
+// example the result of a slow parsing.  Return -1 if we have no disk cache.
+int request_cache_put(const char *key, const void *data, int size);
+// Get some data saved with request_cache_put, or NULL.  The data stays
+// valid until exit.
+const void *request_cache_get(const char *key, int *size);
 // Don't use cache even if we have a local copy.
 void request_make_fresh(request_t *req);
+// Set the max size in bytes of the persistent cache of the responses.
+// Natively the disk cache is always enabled, and zero means the default
+// size.  With emscripten the cache is stored in the browser Cache Storage,
+// and is only enabled with a non zero size.
+void request_set_cache_max_size(int64_t size);
+// Return the number of requests currently running.  If nb_done is set, it
+// receives the number of requests completed so far, so that we can tell if
+// some data arrived since a previous call.
+int request_get_nb_running(int *nb_done);
+// Block until some data arrives for the running requests, or the timeout
+// (sec) expires.  Return immediately if no request is running.
+void request_wait(double timeout);
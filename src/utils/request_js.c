@@ -13,22 +13,256 @@
 
 #define MAX_NB  16 // Max number of concurrent requests.
 
+// Min time between two saves of the persistent cache index (ms).
+#define CACHE_INDEX_SAVE_DELAY 5000
+
 struct request
 {
     char        *url;
     int         handle;
     int         status_code;
     bool        done;
+    uint32_t    id;             // Unique id, for the cache callbacks.
+    bool        cache_lookup;   // Set while we look in the cache.
+    bool        cache_checked;  // Set once we looked in the cache.
     void        *data;
+    bool        data_detached;  // Data ownership given to the caller.
     int         size;
+    double      priority;
+
+    // Streaming function, called once with the full body.
+    struct {
+        void    (*fn)(void *user, const void *data, int size);
+        void    *user;
+        bool    done;
+    } stream;
 };
 
 
 static struct {
     int nb;     // Number of current running requests.
-} g = {};
+    int nb_done; // Number of completed requests.
+    // Highest priority of the requests waiting for a slot during the
+    // current and the previous frames.
+    double wait_prio;
+    double min_prio;
+    double last_time;
+
+    // Persistent cache.  The requests waiting for a lookup keep their
+    // slot, so there can't be more than MAX_NB of them.
+    struct {
+        int64_t     max_size;   // Zero if disabled.
+        uint32_t    next_id;
+        request_t   *lookups[MAX_NB];
+    } cache;
+} g = {.wait_prio = -DBL_MAX, .min_prio = -DBL_MAX};
 
 static bool url_has_extension(const char *str, const char *ext);
+static void onload(unsigned int _, void *arg, void *data, unsigned int size);
+static void onerror(unsigned int _, void *arg, int err, const char *msg);
+static void onprogress(unsigned int _, void *arg, int nb_bytes, int size);
+
+/*
+ * Persistent cache of the responses, in the browser Cache Storage.
+ *
+ * The browser http cache evicts the tiles quickly, and doesn't know that
+ * they never change, so we keep our own copy of the binary responses
+ * (images and eph files, that is the hips tiles and the catalogues).  The
+ * text files like the hips properties can change, so they are not cached.
+ *
+ * The Cache Storage doesn't give the size or the last use time of its
+ * entries, so we keep an index {url: [size, time]} in a special entry,
+ * saved a few seconds after each change.  When the total size gets over
+ * the max size, or half of the browser storage quota, the least recently
+ * used entries are deleted.
+ *
+ * All the calls are asynchronous: a lookup keeps the request slot until
+ * <request_js_on_cache_get> gets called, and in case of a miss the
+ * download starts from there.
+ */
+
+EM_JS(void, js_cache_init, (double max_size, int save_delay), {
+  var c = Module.sweCache;
+  if (c) {
+    c.maxSize = max_size;
+    c.ready.then(function() { c.evict(); });
+    return;
+  }
+  c = Module.sweCache = {maxSize: max_size, index: {}, size: 0,
+                         quota: 0, timer: null, cache: null};
+  c.evict = function() {
+    var max = c.quota ? Math.min(c.maxSize, c.quota / 2) : c.maxSize;
+    if (c.size <= max) return;
+    var urls = Object.keys(c.index).sort(function(a, b) {
+      return c.index[a][1] - c.index[b][1];
+    });
+    for (var i = 0; i < urls.length && c.size > max * 0.9; i++) {
+      c.size -= c.index[urls[i]][0];
+      delete c.index[urls[i]];
+      c.cache.delete(urls[i]);
+    }
+    c.touch();
+  };
+  c.touch = function() {
+    if (c.timer) return;
+    c.timer = setTimeout(function() {
+      c.timer = null;
+      c.cache.put('swe-cache-index',
+                  new Response(JSON.stringify(c.index)));
+    }, save_delay);
+  };
+  if (typeof caches === 'undefined') {
+    c.ready = Promise.resolve();
+    return;
+  }
+  if (navigator.storage && navigator.storage.estimate) {
+    navigator.storage.estimate().then(function(e) { c.quota = e.quota; });
+  }
+  c.ready = caches.open('swe-requests').then(function(cache) {
+    c.cache = cache;
+    return cache.match('swe-cache-index');
+  }).then(function(resp) {
+    return resp ? resp.json() : {};
+  }).then(function(index) {
+    c.index = index;
+    for (var url in index) c.size += index[url][0];
+    c.evict();
+  }).catch(function() {
+    c.cache = null;
+  });
+});
+
+EM_JS(void, js_cache_get, (uint32_t id, const char *url), {
+  var c = Module.sweCache;
+  url = UTF8ToString(url);
+  c.ready.then(function() {
+    if (!c.cache || !c.index[url]) return null;
+    return c.cache.match(url);
+  }).then(function(resp) {
+    if (!resp && c.index[url]) {
+      c.size -= c.index[url][0];
+      delete c.index[url];
+      c.touch();
+    }
+    return resp ? resp.arrayBuffer() : null;
+  }).then(function(buf) {
+    if (!buf) {
+      _request_js_on_cache_get(id, 0, 0);
+      return;
+    }
+    var ptr = _malloc(buf.byteLength + 1);
+    HEAPU8.set(new Uint8Array(buf), ptr);
+    HEAPU8[ptr + buf.byteLength] = 0;
+    c.index[url][1] = Date.now();
+    c.touch();
+    _request_js_on_cache_get(id, ptr, buf.byteLength);
+  }).catch(function() {
+    _request_js_on_cache_get(id, 0, 0);
+  });
+});
+
+EM_JS(void, js_cache_put, (const char *url, const void *data, int size), {
+  var c = Module.sweCache;
+  if (!c.cache) return;
+  url = UTF8ToString(url);
+  c.cache.put(url, new Response(HEAPU8.slice(data, data + size)))
+  .then(function() {
+    if (c.index[url]) c.size -= c.index[url][0];
+    c.index[url] = [size, Date.now()];
+    c.size += size;
+    c.evict();
+    c.touch();
+  }).catch(function() {
+    c.quota = Math.min(c.quota || Infinity, c.size);
+    c.evict();
+  });
+});
+
+void request_set_cache_max_size(int64_t size)
+{
+    g.cache.max_size = size;
+    if (size) js_cache_init(size, CACHE_INDEX_SAVE_DELAY);
+}
+
+static bool is_cacheable(const request_t *req);
+
+static void start_download(request_t *req)
+{
+    int handle;
+    handle = emscripten_async_wget2_data(
+            req->url, "GET", NULL, req, false,
+            onload, onerror, onprogress);
+    req->handle = handle + 1; // So that we cannot get 0.
+}
+
+// Start a cache lookup, return false if we cannot.
+static bool cache_lookup_start(request_t *req)
+{
+    int i;
+    if (!g.cache.max_size || req->cache_checked || !is_cacheable(req))
+        return false;
+    for (i = 0; i < MAX_NB; i++) {
+        if (!g.cache.lookups[i]) break;
+    }
+    if (i == MAX_NB) return false;
+    req->cache_checked = true;
+    req->cache_lookup = true;
+    req->id = ++g.cache.next_id;
+    g.cache.lookups[i] = req;
+    js_cache_get(req->id, req->url);
+    return true;
+}
+
+static void cache_lookup_cancel(request_t *req)
+{
+    int i;
+    for (i = 0; i < MAX_NB; i++) {
+        if (g.cache.lookups[i] == req) g.cache.lookups[i] = NULL;
+    }
+    req->cache_lookup = false;
+    req->cache_checked = false;
+}
+
+/*
+ * Function: request_js_on_cache_get
+ * Called from js with the result of a cache lookup.
+ *
+ * Parameters:
+ *   id     - Id of the request.  The request might have been cancelled
+ *            in the meantime.
+ *   data   - Malloced data, or NULL in case of miss.
+ *   size   - Size of the data.
+ */
+EMSCRIPTEN_KEEPALIVE
+void request_js_on_cache_get(uint32_t id, void *data, int size)
+{
+    request_t *req = NULL;
+    int i;
+
+    for (i = 0; i < MAX_NB; i++) {
+        if (g.cache.lookups[i] && g.cache.lookups[i]->id == id) {
+            req = g.cache.lookups[i];
+            g.cache.lookups[i] = NULL;
+            break;
+        }
+    }
+    if (!req) {
+        free(data);
+        return;
+    }
+    req->cache_lookup = false;
+    // Miss: download with the slot we already have.
+    if (!data) {
+        start_download(req);
+        return;
+    }
+    req->status_code = 200;
+    req->data = data;
+    req->size = size;
+    req->done = true;
+    g.nb--;
+    g.nb_done++;
+}
 
 void request_init(const char *cache_dir)
 {
@@ -47,15 +281,30 @@ request_t *request_create(const char *url)
     return req;
 }
 
-void request_delete(request_t *req)
+void request_cancel(request_t *req)
 {
-    if (!req) return;
-    if (req->handle) {
-        emscripten_async_wget2_abort(req->handle - 1);
+    if (req->cache_lookup) {
+        cache_lookup_cancel(req);
         g.nb--;
+        return;
     }
+    if (!req->handle) return;
+    emscripten_async_wget2_abort(req->handle - 1);
+    req->handle = 0;
+    g.nb--;
+}
+
+void request_set_priority(request_t *req, double priority)
+{
+    req->priority = priority;
+}
+
+void request_delete(request_t *req)
+{
+    if (!req) return;
+    request_cancel(req);
     free(req->url);
-    free(req->data);
+    if (!req->data_detached) free(req->data);
     free(req);
 }
 
@@ -82,6 +331,12 @@ static bool could_be_str(const request_t *req)
            !url_has_extension(req->url, ".eph");
 }
 
+// Only the binary responses never change.
+static bool is_cacheable(const request_t *req)
+{
+    return !could_be_str(req);
+}
+
 static void onload(unsigned int _, void *arg, void *data, unsigned int size)
 {
     char *tmp;
@@ -102,6 +357,9 @@ static void onload(unsigned int _, void *arg, void *data, unsigned int size)
     req->size = size;
     req->done = true;
     g.nb--;
+    g.nb_done++;
+    if (g.cache.max_size && is_cacheable(req))
+        js_cache_put(req->url, data, size);
 }
 
 static void onerror(unsigned int _, void *arg, int err, const char *msg)
@@ -113,6 +371,7 @@ static void onerror(unsigned int _, void *arg, int err, const char *msg)
     req->status_code = err ?: 499;
     req->done = true;
     g.nb--;
+    g.nb_done++;
 }
 
 static void onprogress(unsigned int _, void *arg, int nb_bytes, int size)
@@ -121,21 +380,70 @@ static void onprogress(unsigned int _, void *arg, int nb_bytes, int size)
 
 const void *request_get_data(request_t *req, int *size, int *status_code)
 {
-    int handle;
-    if (!req->done && !req->handle && g.nb < MAX_NB) {
-        handle = emscripten_async_wget2_data(
-                req->url, "GET", NULL, req, false,
-                onload, onerror, onprogress);
-        req->handle = handle + 1; // So that we cannot get 0.
+    const bool running = req->handle || req->cache_lookup;
+    double now = emscripten_get_now();
+
+    if (now - g.last_time > 16) {
+        g.last_time = now;
+        g.min_prio = g.wait_prio;
+        g.wait_prio = -DBL_MAX;
+    }
+    if (!req->done && !running &&
+        (g.nb >= MAX_NB || req->priority < g.min_prio)) {
+        g.wait_prio = max(g.wait_prio, req->priority);
+    }
+    if (!req->done && !running && g.nb < MAX_NB &&
+        req->priority >= g.min_prio) {
         g.nb++;
+        if (!cache_lookup_start(req)) start_download(req);
+    }
+    if (req->data && req->stream.fn && !req->stream.done) {
+        req->stream.done = true;
+        req->stream.fn(req->stream.user, req->data, req->size);
     }
     if (size) *size = req->size;
     if (status_code) *status_code= req->status_code;
     return req->data;
 }
 
+void request_set_stream(request_t *req, void *user,
+                        void (*fn)(void *user, const void *data, int size))
+{
+    req->stream.fn = fn;
+    req->stream.user = user;
+}
+
+void *request_detach_data(request_t *req)
+{
+    assert(req->done && req->data && !req->data_detached);
+    req->data_detached = true;
+    return req->data;
+}
+
+int request_cache_put(const char *key, const void *data, int size)
+{
+    return -1;
+}
+
+const void *request_cache_get(const char *key, int *size)
+{
+    return NULL;
+}
+
 void request_make_fresh(request_t *req)
 {
+    req->cache_checked = true;
+}
+
+int request_get_nb_running(int *nb_done)
+{
+    if (nb_done) *nb_done = g.nb_done;
+    return g.nb;
+}
+
+void request_wait(double timeout)
+{
+    // The browser runs the main loop, nothing to do.
 }
 
 #endif
@@ -0,0 +1,290 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef __EMSCRIPTEN__
+
+#include "shmcache.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+#ifndef LOG_E
+#   define LOG_E
+#endif
+
+/*
+ * Segment layout:
+ *
+ *   header_t
+ *   slot_t[nb_slots]   - Open addressing hash table of the records.
+ *   records            - Each record is a record_t followed by the key and
+ *                        the data, aligned to 8 bytes.
+ *
+ * A slot is claimed by setting its hash with a compare and swap, and the
+ * record offset is only set once the record is fully written, so a slot
+ * with a hash but no offset is a record still being written (or that could
+ * not fit in the segment), and is considered as missing.
+ *
+ * The creator of the segment sets the magic value last, so the other
+ * processes wait for it before using the segment.
+ */
+
+#define SHM_MAGIC       0x31484d53 // "SMH1"
+
+// Number of bytes of the segment per slot of the table.
+#define BYTES_PER_SLOT  4096
+
+// Max time we wait for another process to initialize the segment (ms).
+#define INIT_TIMEOUT    1000
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    nb_slots;   // Always a power of two.
+    uint64_t    size;       // Total size of the segment.
+    uint64_t    used;       // End of the records.
+} header_t;
+
+typedef struct {
+    uint64_t    hash;       // Hash of the key, zero for empty slots.
+    uint64_t    offset;     // Offset of the record, zero until written.
+} slot_t;
+
+typedef struct {
+    uint32_t    key_len;    // Including the null byte.
+    uint32_t    data_len;   // Not including the null byte.
+} record_t;
+
+struct shmcache {
+    uint8_t     *map;
+    int64_t     size;
+    header_t    *header;
+    slot_t      *slots;
+};
+
+// FNV-1a hash.
+static uint64_t hash_key(const char *key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (; *key; key++) {
+        h ^= (uint8_t)*key;
+        h *= 1099511628211ULL;
+    }
+    return h ?: 1; // Zero is used for the empty slots.
+}
+
+static void segment_init(uint8_t *map, int64_t size)
+{
+    header_t *header = (void*)map;
+    uint32_t nb_slots = 1;
+
+    while (nb_slots * 2 <= size / BYTES_PER_SLOT) nb_slots *= 2;
+    header->nb_slots = nb_slots;
+    header->size = size;
+    header->used = sizeof(*header) + nb_slots * sizeof(slot_t);
+    __atomic_store_n(&header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+// Wait until the process that created the segment initialized it.
+static int segment_wait(int fd, int64_t *size)
+{
+    struct stat st;
+    const header_t *header;
+    int i;
+
+    for (i = 0; i < INIT_TIMEOUT; i++) {
+        if (fstat(fd, &st) != 0) return -1;
+        if (st.st_size >= sizeof(*header)) break;
+        usleep(1000);
+    }
+    if (st.st_size < sizeof(*header)) return -1;
+    header = mmap(NULL, sizeof(*header), PROT_READ, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) return -1;
+    for (; i < INIT_TIMEOUT; i++) {
+        if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == SHM_MAGIC)
+            break;
+        usleep(1000);
+    }
+    *size = (header->magic == SHM_MAGIC) ? header->size : 0;
+    munmap((void*)header, sizeof(*header));
+    return *size ? 0 : -1;
+}
+
+shmcache_t *shmcache_open(const char *name, int64_t size)
+{
+    shmcache_t *sc;
+    uint8_t *map;
+    int fd;
+    bool created = true;
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(name, O_RDWR, 0600);
+        if (fd != -1 && segment_wait(fd, &size) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd == -1) goto error;
+    if (created && ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        goto error;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        if (created) shm_unlink(name);
+        goto error;
+    }
+    if (created) segment_init(map, size);
+
+    sc = calloc(1, sizeof(*sc));
+    sc->map = map;
+    sc->size = size;
+    sc->header = (void*)map;
+    sc->slots = (void*)(sc->header + 1);
+    return sc;
+
+error:
+    LOG_E("Cannot open shared memory cache %s", name);
+    return NULL;
+}
+
+void shmcache_close(shmcache_t *sc)
+{
+    if (!sc) return;
+    munmap(sc->map, sc->size);
+    free(sc);
+}
+
+void shmcache_unlink(const char *name)
+{
+    shm_unlink(name);
+}
+
+const void *shmcache_get(shmcache_t *sc, const char *key, int *size)
+{
+    uint64_t hash = hash_key(key), h, offset;
+    uint32_t i, mask = sc->header->nb_slots - 1, probe;
+    const record_t *rec;
+    const char *rec_key;
+
+    i = hash & mask;
+    for (probe = 0; probe <= mask; probe++, i = (i + 1) & mask) {
+        h = __atomic_load_n(&sc->slots[i].hash, __ATOMIC_ACQUIRE);
+        if (!h) return NULL;
+        if (h != hash) continue;
+        offset = __atomic_load_n(&sc->slots[i].offset, __ATOMIC_ACQUIRE);
+        if (!offset) return NULL;
+        rec = (void*)(sc->map + offset);
+        // Make sure this is not a hash collision.
+        rec_key = (const char*)(rec + 1);
+        if (rec->key_len != strlen(key) + 1 || strcmp(rec_key, key) != 0)
+            return NULL;
+        *size = rec->data_len;
+        return rec_key + rec->key_len;
+    }
+    return NULL;
+}
+
+int shmcache_put(shmcache_t *sc, const char *key, const void *data, int size)
+{
+    uint64_t hash = hash_key(key), h, offset, total;
+    uint32_t i, mask = sc->header->nb_slots - 1, probe;
+    int key_len = strlen(key) + 1;
+    record_t *rec;
+
+    total = sizeof(*rec) + key_len + size + 1;
+    total = (total + 7) & ~7;
+    if (__atomic_load_n(&sc->header->used, __ATOMIC_RELAXED) + total >
+            sc->size) return -1;
+
+    // Claim a slot.  If another process already claimed one for this key,
+    // it is adding the same value.
+    i = hash & mask;
+    for (probe = 0; probe <= mask; probe++, i = (i + 1) & mask) {
+        h = 0;
+        if (__atomic_compare_exchange_n(&sc->slots[i].hash, &h, hash, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            break;
+        if (h == hash) return 0;
+    }
+    if (probe > mask) return -1;
+
+    // Allocate and write the record.  If another process filled the
+    // segment in the meantime the slot stays claimed without offset.
+    offset = __atomic_fetch_add(&sc->header->used, total, __ATOMIC_RELAXED);
+    if (offset + total > sc->size) return -1;
+    rec = (void*)(sc->map + offset);
+    rec->key_len = key_len;
+    rec->data_len = size;
+    memcpy(rec + 1, key, key_len);
+    memcpy((char*)(rec + 1) + key_len, data, size);
+    ((char*)(rec + 1))[key_len + size] = '\0';
+    __atomic_store_n(&sc->slots[i].offset, offset, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static void test_shmcache(void)
+{
+    char name[64];
+    shmcache_t *sc, *sc2;
+    const char *data;
+    char *big;
+    int size;
+
+    snprintf(name, sizeof(name), "/swe-test-shmcache-%d", (int)getpid());
+    sc = shmcache_open(name, 1 << 20);
+    assert(sc);
+    assert(shmcache_put(sc, "a", "AAA", 3) == 0);
+    assert(shmcache_put(sc, "b", "BBB", 3) == 0);
+    // Values are never replaced.
+    assert(shmcache_put(sc, "a", "AAAA", 4) == 0);
+    assert(!shmcache_get(sc, "c", &size));
+
+    // A second mapping, as another process would get, sees the same data.
+    sc2 = shmcache_open(name, 0);
+    assert(sc2);
+    data = shmcache_get(sc2, "a", &size);
+    assert(data && size == 3 && data[size] == '\0');
+    test_str(data, "AAA");
+    data = shmcache_get(sc2, "b", &size);
+    test_str(data, "BBB");
+
+    // Too big for the segment.
+    big = calloc(1, 1 << 20);
+    assert(shmcache_put(sc2, "big", big, 1 << 20) == -1);
+    assert(!shmcache_get(sc, "big", &size));
+    free(big);
+
+    shmcache_close(sc2);
+    shmcache_close(sc);
+    shmcache_unlink(name);
+}
+
+TEST_REGISTER(NULL, test_shmcache, TEST_AUTO);
+
+#endif
+
+#endif // __EMSCRIPTEN__
@@ -0,0 +1,95 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * File: shmcache.h
+ *
+ * Key/value store in a POSIX shared memory segment, so that several
+ * processes on the same host can share a single copy of the same data.
+ *
+ * The segment has a fixed size, set by the first process that opens it.  It
+ * contains an open addressing hash table of the keys, followed by an append
+ * only data area.  All the accesses are lock free: a writer first claims a
+ * slot of the table and some space in the data area with atomic operations,
+ * then writes its record and publishes it.  The readers only see the records
+ * once they are complete.
+ *
+ * The values are never removed or replaced, so once the segment is full the
+ * new values are simply not added.  The segment stays until it is deleted
+ * with <shmcache_unlink>, even when no process uses it.
+ */
+
+#include <stdint.h>
+
+/*
+ * Type: shmcache_t
+ * Represent an opened shared memory cache.
+ */
+typedef struct shmcache shmcache_t;
+
+/*
+ * Function: shmcache_open
+ * Open or create a shared memory cache.
+ *
+ * Parameters:
+ *   name   - Name of the POSIX shared memory object, starting with '/'.
+ *   size   - Size of the segment in bytes, only used if we create it.
+ *
+ * Return:
+ *   The cache, or NULL in case of error.
+ */
+shmcache_t *shmcache_open(const char *name, int64_t size);
+
+/*
+ * Function: shmcache_close
+ * Unmap a shared memory cache.
+ *
+ * All the pointers returned by <shmcache_get> become invalid.
+ */
+void shmcache_close(shmcache_t *sc);
+
+/*
+ * Function: shmcache_unlink
+ * Delete a shared memory cache segment.
+ *
+ * The processes that have it opened can keep using it.
+ */
+void shmcache_unlink(const char *name);
+
+/*
+ * Function: shmcache_get
+ * Get a value from a shared memory cache.
+ *
+ * Parameters:
+ *   sc     - A shared memory cache.
+ *   key    - Null terminated key of the value.
+ *   size   - Get the size of the data.
+ *
+ * Return:
+ *   A pointer to the data in the shared segment, or NULL if the key is not
+ *   in the cache.  The data is always followed by a null byte, and stays
+ *   valid until the cache is closed.
+ */
+const void *shmcache_get(shmcache_t *sc, const char *key, int *size);
+
+/*
+ * Function: shmcache_put
+ * Add a value to a shared memory cache.
+ *
+ * Parameters:
+ *   sc     - A shared memory cache.
+ *   key    - Null terminated key of the value.
+ *   data   - The data to store.
+ *   size   - Size of the data.
+ *
+ * Return:
+ *   0 if the value is in the cache (possibly added by another process), or
+ *   -1 if it could not be added because the segment is full.
+ */
+int shmcache_put(shmcache_t *sc, const char *key, const void *data, int size);
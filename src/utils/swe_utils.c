@@ -15,6 +15,7 @@
 #include <stdio.h>
 
 #include "webp/decode.h"
+#include "zlib.h"
 
 #ifdef __GNUC__
 #pragma GCC diagnostic push
@@ -85,6 +86,57 @@ uint8_t *img_read_from_mem(const void *data, int size,
     return stbi_load_from_memory(data, size, w, h, bpp, *bpp);
 }
 
+// Halve the size of an image in place, with a box filter.
+static void img_halve(uint8_t *img, int *w, int *h, int bpp)
+{
+    int x, y, i, sum;
+    const int w2 = max(*w / 2, 1), h2 = max(*h / 2, 1);
+    const int dx = *w > 1 ? 1 : 0, dy = *h > 1 ? *w : 0;
+    const uint8_t *src;
+
+    for (y = 0; y < h2; y++)
+    for (x = 0; x < w2; x++) {
+        src = img + ((y * 2) * *w + x * 2) * bpp;
+        for (i = 0; i < bpp; i++) {
+            sum = src[i] + src[dx * bpp + i] + src[dy * bpp + i] +
+                  src[(dx + dy) * bpp + i];
+            img[(y * w2 + x) * bpp + i] = (sum + 2) / 4;
+        }
+    }
+    *w = w2;
+    *h = h2;
+}
+
+uint8_t *img_read_from_mem_reduced(const void *data, int size, int reduce,
+                                   int *w, int *h, int *bpp)
+{
+    WebPDecoderConfig config;
+    uint8_t *img;
+
+    if (reduce <= 0) return img_read_from_mem(data, size, w, h, bpp);
+
+    if (WebPGetInfo(data, size, NULL, NULL)) {
+        if (!WebPInitDecoderConfig(&config)) return NULL;
+        if (WebPGetFeatures(data, size, &config.input) != VP8_STATUS_OK)
+            return NULL;
+        config.options.use_scaling = 1;
+        config.options.scaled_width = max(config.input.width >> reduce, 1);
+        config.options.scaled_height = max(config.input.height >> reduce, 1);
+        config.output.colorspace = MODE_RGBA;
+        if (WebPDecode(data, size, &config) != VP8_STATUS_OK) return NULL;
+        *w = config.output.width;
+        *h = config.output.height;
+        *bpp = 4;
+        return config.output.u.RGBA.rgba;
+    }
+
+    img = img_read_from_mem(data, size, w, h, bpp);
+    if (!img) return NULL;
+    for (; reduce > 0 && (*w > 1 || *h > 1); reduce--)
+        img_halve(img, w, h, *bpp);
+    return realloc(img, *w * *h * *bpp);
+}
+
 void img_write(const uint8_t *img, int w, int h, int bpp, const char *path)
 {
     stbi_write_png(path, w, h, bpp, img, 0);
@@ -136,6 +188,83 @@ error:
     return NULL;
 }
 
+// Initial size of the z_lines output buffer, it grows if a line is longer.
+#define Z_LINES_BUF_SIZE (64 * 1024)
+
+struct z_lines {
+    z_stream    stream;
+    char        *buf;
+    int         size;   // Allocated size of buf.
+    int         len;    // Number of inflated bytes in buf.
+    int         pos;    // Start of the next line in buf.
+    bool        eof;
+};
+
+z_lines_t *z_lines_open(const void *src, int src_size)
+{
+    z_lines_t *lines = calloc(1, sizeof(*lines));
+    lines->stream.next_in = (void*)src;
+    lines->stream.avail_in = src_size;
+    // Auto detect gzip or zlib header.
+    if (inflateInit2(&lines->stream, 32 + MAX_WBITS) != Z_OK) {
+        free(lines);
+        return NULL;
+    }
+    lines->size = Z_LINES_BUF_SIZE;
+    lines->buf = malloc(lines->size);
+    return lines;
+}
+
+bool z_lines_next(z_lines_t *lines, const char **line_ptr, int *len_ptr)
+{
+    char *end;
+    int r;
+
+    while (true) {
+        end = memchr(lines->buf + lines->pos, '\n', lines->len - lines->pos);
+        if (end || (lines->eof && lines->pos < lines->len)) {
+            if (!end) end = lines->buf + lines->len;
+            *end = '\0';
+            *line_ptr = lines->buf + lines->pos;
+            *len_ptr = end - *line_ptr;
+            lines->pos = min(end - lines->buf + 1, lines->len);
+            return true;
+        }
+        if (lines->eof) return false;
+
+        // Keep the start of the current line and inflate more data after it.
+        memmove(lines->buf, lines->buf + lines->pos, lines->len - lines->pos);
+        lines->len -= lines->pos;
+        lines->pos = 0;
+        // Always keep one byte for the null terminator.
+        if (lines->len >= lines->size - 1) {
+            lines->size *= 2;
+            lines->buf = realloc(lines->buf, lines->size);
+        }
+        lines->stream.next_out = (void*)(lines->buf + lines->len);
+        lines->stream.avail_out = lines->size - 1 - lines->len;
+        r = inflate(&lines->stream, Z_NO_FLUSH);
+        lines->len = lines->size - 1 - lines->stream.avail_out;
+        if (r == Z_STREAM_END) lines->eof = true;
+        if (r == Z_BUF_ERROR && !lines->stream.avail_in) {
+            LOG_W("Truncated compressed data");
+            lines->eof = true;
+        }
+        if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+            LOG_E("Cannot uncompress data: %s", lines->stream.msg);
+            lines->eof = true;
+        }
+    }
+}
+
+void z_lines_close(z_lines_t *lines)
+{
+    if (!lines) return;
+    inflateEnd(&lines->stream);
+    free(lines->buf);
+    free(lines);
+}
+
 bool str_endswith(const char *str, const char *end)
 {
     if (!str || !end) return false;
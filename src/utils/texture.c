@@ -9,6 +9,9 @@
 
 #include "texture.h"
 #include "gl.h"
+#include "utils.h"
+#include "utlist.h"
+#include "worker.h"
 
 #include <assert.h>
 #include <math.h>
@@ -17,11 +20,142 @@
 
 static struct {
     void *user;
-    uint8_t *(*load)(void *user, const char *url, int *code,
-                     int *w, int *h, int *bpp);
+    const void *(*fetch)(void *user, const char *url, int *code,
+                         int *size, void **handle);
+    uint8_t *(*decode)(void *user, const void *data, int size,
+                       int *w, int *h, int *bpp);
+    void (*release)(void *user, void *handle);
 } g_callback = {};
 
-static inline bool is_pow2(int n) {return (n & (n - 1)) == 0;}
+// Asynchronous decoding of a texture image.
+struct texture_loader {
+    worker_t    worker;
+    const void  *data;      // Encoded image.
+    int         size;
+    void        *handle;    // Returned by the fetch callback.
+    int         code;
+    uint8_t     *img;       // Decoded image, set by the worker.
+    int         w, h, bpp;
+    int         max_size;   // Copy of the texture max_size.
+    int         src_w, src_h;
+    texture_loader_t *next; // Used for the released textures list.
+};
+
+// Loaders of released textures that were still decoding.
+static texture_loader_t *g_orphan_loaders = NULL;
+
+// Bytes that can still be uploaded in the current frame.
+static int64_t g_upload_budget = INT64_MAX;
+
+// Number of texture uploads and uploaded bytes since the start.
+static struct {
+    int     count;
+    int64_t bytes;
+} g_uploads = {};
+
+// Number of allocated textures and their estimated GPU memory size.
+static struct {
+    int     count;
+    int64_t bytes;
+} g_live = {};
+
+// Number of bytes per pixel of a texture format.
+static int format_bpp(int format)
+{
+    switch (format) {
+    case GL_LUMINANCE:          return 1;
+    case GL_LUMINANCE_ALPHA:    return 2;
+    case GL_RGB:                return 3;
+    default:                    return 4;
+    }
+}
+
+// Compressed formats, not defined in all the headers.
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT_      0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT_     0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT_     0x83F3
+#define GL_COMPRESSED_RGBA_BPTC_UNORM_        0x8E8C
+#define GL_COMPRESSED_RGB8_ETC2_              0x9274
+#define GL_COMPRESSED_RGBA8_ETC2_EAC_         0x9278
+#define GL_COMPRESSED_RGBA_ASTC_4x4_KHR_      0x93B0
+#define GL_COMPRESSED_RGBA_ASTC_8x8_KHR_      0x93B7
+
+enum {
+    COMPRESSION_S3TC,
+    COMPRESSION_BPTC,
+    COMPRESSION_ETC2,
+    COMPRESSION_ASTC,
+    COMPRESSION_COUNT,
+};
+
+// Supported compressed formats, with their Vulkan format id used in the
+// KTX2 files.
+static const struct {
+    int vk_format;
+    int format;
+    int family;
+    int block_w, block_h, block_size;
+} COMPRESSED_FORMATS[] = {
+    {131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT_,  COMPRESSION_S3TC, 4, 4, 8},
+    {133, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT_, COMPRESSION_S3TC, 4, 4, 8},
+    {137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT_, COMPRESSION_S3TC, 4, 4, 16},
+    {145, GL_COMPRESSED_RGBA_BPTC_UNORM_,    COMPRESSION_BPTC, 4, 4, 16},
+    {147, GL_COMPRESSED_RGB8_ETC2_,          COMPRESSION_ETC2, 4, 4, 8},
+    {151, GL_COMPRESSED_RGBA8_ETC2_EAC_,     COMPRESSION_ETC2, 4, 4, 16},
+    {157, GL_COMPRESSED_RGBA_ASTC_4x4_KHR_,  COMPRESSION_ASTC, 4, 4, 16},
+    {171, GL_COMPRESSED_RGBA_ASTC_8x8_KHR_,  COMPRESSION_ASTC, 8, 8, 16},
+};
+
+static int get_compressed_format(int format)
+{
+    int i;
+    for (i = 0; i < ARRAY_SIZE(COMPRESSED_FORMATS); i++) {
+        if (COMPRESSED_FORMATS[i].format == format) return i;
+    }
+    return -1;
+}
+
+// Size of the data of a compressed image.
+static int compressed_size(int i, int w, int h)
+{
+    return ((w + COMPRESSED_FORMATS[i].block_w - 1) /
+                COMPRESSED_FORMATS[i].block_w) *
+           ((h + COMPRESSED_FORMATS[i].block_h - 1) /
+                COMPRESSED_FORMATS[i].block_h) *
+           COMPRESSED_FORMATS[i].block_size;
+}
+
+static bool has_extension(const char *name)
+{
+    const char *extensions = (const char*)glGetString(GL_EXTENSIONS);
+    return extensions && strstr(extensions, name);
+}
+
+// Check which compressed formats families the context supports.  The
+// WebGL extensions are exposed with their own names.
+static bool support_compression(int family)
+{
+    static int supported[COMPRESSION_COUNT] = {-1};
+    const char *version;
+    if (supported[0] == -1) {
+        version = (const char*)glGetString(GL_VERSION);
+        supported[COMPRESSION_S3TC] =
+            has_extension("texture_compression_s3tc") ||
+            has_extension("compressed_texture_s3tc");
+        supported[COMPRESSION_BPTC] =
+            has_extension("texture_compression_bptc");
+        supported[COMPRESSION_ETC2] =
+            has_extension("compressed_texture_etc") ||
+            has_extension("GL_ARB_ES3_compatibility") ||
+            (version && strstr(version, "OpenGL ES 3") &&
+             !strstr(version, "WebGL"));
+        supported[COMPRESSION_ASTC] =
+            has_extension("texture_compression_astc_ldr") ||
+            has_extension("compressed_texture_astc");
+    }
+    return supported[family];
+}
+
 static inline int next_pow2(int x) {return pow(2, ceil(log(x) / log(2)));}
 
 
@@ -38,12 +172,55 @@ static void blit(const uint8_t *src, int src_w, int src_h, int bpp,
     }
 }
 
-void texture_set_load_callback(void *user,
-        uint8_t *(*load)(void *user, const char *url, int *code,
-                         int *w, int *h, int *bpp))
+void texture_set_load_callbacks(void *user,
+        const void *(*fetch)(void *user, const char *url, int *code,
+                             int *size, void **handle),
+        uint8_t *(*decode)(void *user, const void *data, int size,
+                           int *w, int *h, int *bpp),
+        void (*release)(void *user, void *handle))
 {
     g_callback.user = user;
-    g_callback.load = load;
+    g_callback.fetch = fetch;
+    g_callback.decode = decode;
+    g_callback.release = release;
+}
+
+// Check if the GL context supports non power of two textures with the
+// given flags.  On GLES2 (WebGL 1) it is only partially supported: no
+// mipmaps and no repeat, but we always use clamp to edge.
+static bool support_npot(int flags)
+{
+#ifdef GLES2
+    static int full = -1;
+    const char *version, *extensions;
+    if (!(flags & TF_MIPMAP)) return true;
+    if (full == -1) {
+        version = (const char*)glGetString(GL_VERSION);
+        extensions = (const char*)glGetString(GL_EXTENSIONS);
+        full = (version && strstr(version, "OpenGL ES 3")) ||
+               (extensions && strstr(extensions, "GL_OES_texture_npot"));
+    }
+    return full;
+#else
+    return true;
+#endif
+}
+
+static texture_t *texture_new(void)
+{
+    texture_t *tex;
+    tex = calloc(1, sizeof(*tex));
+    tex->ref = 1;
+    g_live.count++;
+    return tex;
+}
+
+// Update the live memory stats after a change of the texture data.
+static void update_mem_size(texture_t *tex)
+{
+    int size = texture_get_memory_size(tex);
+    g_live.bytes += size - tex->mem_size;
+    tex->mem_size = size;
 }
 
 void texture_set_data(texture_t *tex, const void *data, int w, int h, int bpp)
@@ -54,14 +231,14 @@ void texture_set_data(texture_t *tex, const void *data, int w, int h, int bpp)
 
     tex->w = w;
     tex->h = h;
-    tex->tex_w = next_pow2(w);
-    tex->tex_h = next_pow2(h);
+    tex->tex_w = support_npot(tex->flags) ? w : next_pow2(w);
+    tex->tex_h = support_npot(tex->flags) ? h : next_pow2(h);
     tex->format = (int[]){
         0, GL_LUMINANCE, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA
     }[bpp];
     assert(tex->format);
 
-    if (!is_pow2(w) || !is_pow2(h)) {
+    if (tex->tex_w != w || tex->tex_h != h) {
         buff0 = calloc(bpp, tex->tex_w * tex->tex_h);
         blit(data, w, h, bpp, buff0, tex->tex_w, tex->tex_h, 0, 0, w, h);
         data = buff0;
@@ -73,10 +250,34 @@ void texture_set_data(texture_t *tex, const void *data, int w, int h, int bpp)
             (tex->flags & TF_MIPMAP)? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR));
     GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
     GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    // The rows of the data are not padded.
+    GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
     GL(glTexImage2D(GL_TEXTURE_2D, 0, tex->format, tex->tex_w, tex->tex_h,
                 0, tex->format, data_type, data));
+    GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
     free(buff0);
+    g_uploads.count++;
+    g_uploads.bytes += (int64_t)tex->tex_w * tex->tex_h * bpp;
+
+    if (tex->flags & TF_MIPMAP)
+        GL(glGenerateMipmap(GL_TEXTURE_2D));
+    update_mem_size(tex);
+}
 
+void texture_set_sub_data(texture_t *tex, const void *data,
+                          int x, int y, int w, int h)
+{
+    assert(tex->id);
+    assert(x >= 0 && x + w <= tex->tex_w && y >= 0 && y + h <= tex->tex_h);
+    GL(glActiveTexture(GL_TEXTURE0));
+    GL(glBindTexture(GL_TEXTURE_2D, tex->id));
+    // The rows of the data are not padded.
+    GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    GL(glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, tex->format,
+                       GL_UNSIGNED_BYTE, data));
+    GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    g_uploads.count++;
+    g_uploads.bytes += (int64_t)w * h * format_bpp(tex->format);
     if (tex->flags & TF_MIPMAP)
         GL(glGenerateMipmap(GL_TEXTURE_2D));
 }
@@ -84,10 +285,9 @@ void texture_set_data(texture_t *tex, const void *data, int w, int h, int bpp)
 texture_t *texture_create(int w, int h, int bpp)
 {
     texture_t *tex;
-    tex = calloc(1, sizeof(*tex));
-    tex->ref = 1;
-    tex->tex_w = next_pow2(w);
-    tex->tex_h = next_pow2(h);
+    tex = texture_new();
+    tex->tex_w = support_npot(0) ? w : next_pow2(w);
+    tex->tex_h = support_npot(0) ? h : next_pow2(h);
     tex->w = w;
     tex->h = h;
     tex->format = (int[]){0, 0, 0, GL_RGB, GL_RGBA}[bpp];
@@ -95,16 +295,48 @@ texture_t *texture_create(int w, int h, int bpp)
     return tex;
 }
 
+static void loader_delete(texture_loader_t *loader)
+{
+    if (g_callback.release) g_callback.release(g_callback.user,
+                                               loader->handle);
+    free(loader->img);
+    free(loader);
+}
+
 void texture_release(texture_t *tex)
 {
     if (!tex) return;
     tex->ref--;
     if (tex->ref) return;
+    if (tex->loader) {
+        // Can't delete the loader while a thread is still using it.
+        worker_cancel(&tex->loader->worker);
+        if (worker_is_running(&tex->loader->worker))
+            LL_PREPEND(g_orphan_loaders, tex->loader);
+        else
+            loader_delete(tex->loader);
+    }
     free(tex->url);
     GL(glDeleteTextures(1, &tex->id));
+    g_live.count--;
+    g_live.bytes -= tex->mem_size;
     free(tex);
 }
 
+int texture_get_memory_size(const texture_t *tex)
+{
+    int size;
+    if (!tex) return 0;
+    if (get_compressed_format(tex->format) >= 0)
+        size = compressed_size(get_compressed_format(tex->format),
+                               tex->tex_w, tex->tex_h);
+    else
+        size = tex->tex_w * tex->tex_h * format_bpp(tex->format);
+    // The full mipmap chain adds a third of the level zero size.
+    if (tex->flags & TF_MIPMAP) size += size / 3;
+    return size;
+}
+
 texture_t *texture_from_data(const void *data, int img_w, int img_h, int bpp,
                              int x, int y, int w, int h, int flags)
 {
@@ -112,8 +344,7 @@ texture_t *texture_from_data(const void *data, int img_w, int img_h, int bpp,
     uint8_t *img;
 
     assert(x >= 0 && x + w <= img_w && y >= 0 && y + h <= img_h);
-    tex = calloc(1, sizeof(*tex));
-    tex->ref = 1;
+    tex = texture_new();
     tex->flags = flags;
     GL(glGenTextures(1, &tex->id));
 
@@ -129,28 +360,212 @@ texture_t *texture_from_data(const void *data, int img_w, int img_h, int bpp,
     return tex;
 }
 
+static uint64_t read_u64(const uint8_t *data)
+{
+    uint64_t ret;
+    memcpy(&ret, data, 8);
+    return ret;
+}
+
+bool texture_ktx2_parse(const void *data_, int size,
+                        texture_compressed_t *out)
+{
+    static const uint8_t IDENTIFIER[12] = {
+        0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    const uint8_t *data = data_;
+    uint32_t header[9];
+    uint64_t ofs, len;
+    int i, f = -1, w, h;
+
+    if (size < 80 || memcmp(data, IDENTIFIER, 12) != 0) return false;
+    memcpy(header, data + 12, sizeof(header));
+    for (i = 0; i < ARRAY_SIZE(COMPRESSED_FORMATS); i++) {
+        if (COMPRESSED_FORMATS[i].vk_format == header[0]) f = i;
+    }
+    // Only 2d images without supercompression.
+    if (f == -1 || header[4] > 1 || header[5] > 1 || header[6] != 1 ||
+            header[8] != 0) {
+        return false;
+    }
+    memset(out, 0, sizeof(*out));
+    out->format = COMPRESSED_FORMATS[f].format;
+    out->w = header[2];
+    out->h = header[3];
+    out->levels_count = min(max(header[7], 1),
+                            ARRAY_SIZE(out->levels));
+    if (size < 80 + out->levels_count * 24) return false;
+    for (i = 0; i < out->levels_count; i++) {
+        ofs = read_u64(data + 80 + i * 24);
+        len = read_u64(data + 80 + i * 24 + 8);
+        w = max(out->w >> i, 1);
+        h = max(out->h >> i, 1);
+        if (ofs + len > size || len != compressed_size(f, w, h))
+            return false;
+        out->levels[i].data = data + ofs;
+        out->levels[i].size = len;
+    }
+    return true;
+}
+
+bool texture_supports_compression(void)
+{
+    int i;
+    for (i = 0; i < COMPRESSION_COUNT; i++) {
+        if (support_compression(i)) return true;
+    }
+    return false;
+}
+
+texture_t *texture_from_compressed(const texture_compressed_t *img)
+{
+    texture_t *tex;
+    int i, f;
+
+    f = get_compressed_format(img->format);
+    assert(f >= 0);
+    if (!support_compression(COMPRESSED_FORMATS[f].family)) return NULL;
+    tex = texture_new();
+    tex->w = tex->tex_w = img->w;
+    tex->h = tex->tex_h = img->h;
+    tex->format = img->format;
+    if (img->levels_count > 1) tex->flags |= TF_MIPMAP;
+    GL(glGenTextures(1, &tex->id));
+    GL(glActiveTexture(GL_TEXTURE0));
+    GL(glBindTexture(GL_TEXTURE_2D, tex->id));
+    GL(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GL(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+            (tex->flags & TF_MIPMAP)? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    for (i = 0; i < img->levels_count; i++) {
+        GL(glCompressedTexImage2D(GL_TEXTURE_2D, i, tex->format,
+                                  max(img->w >> i, 1), max(img->h >> i, 1),
+                                  0, img->levels[i].size,
+                                  img->levels[i].data));
+        g_uploads.bytes += img->levels[i].size;
+    }
+    g_uploads.count++;
+    update_mem_size(tex);
+    return tex;
+}
+
 texture_t *texture_from_url(const char *url, int flags)
 {
     texture_t *tex;
-    tex = calloc(1, sizeof(*tex));
-    tex->ref = 1;
+    tex = texture_new();
     tex->url = strdup(url);
     tex->flags = flags;
     if (!(flags & TF_LAZY_LOAD)) texture_load(tex, NULL);
     return tex;
 }
 
+// Halve the size of an image with a box filter.
+static uint8_t *img_halve(const uint8_t *img, int *w, int *h, int bpp)
+{
+    int x, y, i, c, sum, sx, sy;
+    int nw = max(*w / 2, 1), nh = max(*h / 2, 1);
+    uint8_t *ret = malloc(nw * nh * bpp);
+
+    for (y = 0; y < nh; y++) for (x = 0; x < nw; x++) {
+        for (c = 0; c < bpp; c++) {
+            sum = 0;
+            for (i = 0; i < 4; i++) {
+                sx = min(x * 2 + i % 2, *w - 1);
+                sy = min(y * 2 + i / 2, *h - 1);
+                sum += img[(sy * *w + sx) * bpp + c];
+            }
+            ret[(y * nw + x) * bpp + c] = (sum + 2) / 4;
+        }
+    }
+    *w = nw;
+    *h = nh;
+    return ret;
+}
+
+static int decode_worker(worker_t *worker)
+{
+    texture_loader_t *loader = (void*)worker;
+    uint8_t *img;
+
+    loader->img = g_callback.decode(g_callback.user, loader->data,
+                                    loader->size, &loader->w, &loader->h,
+                                    &loader->bpp);
+    if (!loader->img) return 0;
+    loader->src_w = loader->w;
+    loader->src_h = loader->h;
+    while (loader->max_size &&
+           (loader->w > loader->max_size || loader->h > loader->max_size)) {
+        img = img_halve(loader->img, &loader->w, &loader->h, loader->bpp);
+        free(loader->img);
+        loader->img = img;
+    }
+    return 0;
+}
+
 bool texture_load(texture_t *tex, int *code)
 {
-    int w, h, bpp = 0;
-    void *img;
+    const void *data;
+    int size;
+    void *handle = NULL;
+    texture_loader_t *loader = tex->loader;
+
     if (tex->id) return true;
     assert(tex->url);
-    assert(g_callback.load);
-    img = g_callback.load(g_callback.user, tex->url, code, &w, &h, &bpp);
-    if (!img) return false;
+    assert(g_callback.fetch);
+    if (!loader) {
+        data = g_callback.fetch(g_callback.user, tex->url, code, &size,
+                                &handle);
+        if (!data) return false;
+        loader = calloc(1, sizeof(*loader));
+        loader->data = data;
+        loader->size = size;
+        loader->handle = handle;
+        loader->code = code ? *code : 0;
+        loader->max_size = tex->max_size;
+        worker_init(&loader->worker, decode_worker);
+        tex->loader = loader;
+    }
+    if (code) *code = loader->code;
+    if (!worker_iter(&loader->worker)) return false;
+    if (!loader->img) return false; // Decoding error.
+    if (!texture_reserve_upload(loader->w * loader->h * loader->bpp))
+        return false;
     GL(glGenTextures(1, &tex->id));
-    texture_set_data(tex, img, w, h, bpp);
-    free(img);
+    texture_set_data(tex, loader->img, loader->w, loader->h, loader->bpp);
+    tex->src_w = loader->src_w;
+    tex->src_h = loader->src_h;
+    loader_delete(loader);
+    tex->loader = NULL;
+    return true;
+}
+
+bool texture_reserve_upload(int64_t bytes)
+{
+    // Always accept at least one upload per frame, whatever its size.
+    if (g_upload_budget <= 0) return false;
+    g_upload_budget -= bytes;
     return true;
 }
+
+void texture_update(int64_t upload_budget)
+{
+    texture_loader_t *loader, *tmp;
+    g_upload_budget = upload_budget;
+    LL_FOREACH_SAFE(g_orphan_loaders, loader, tmp) {
+        if (worker_is_running(&loader->worker)) continue;
+        LL_DELETE(g_orphan_loaders, loader);
+        loader_delete(loader);
+    }
+}
+
+void texture_get_uploads(int *count, int64_t *bytes)
+{
+    *count = g_uploads.count;
+    *bytes = g_uploads.bytes;
+}
+
+void texture_get_live(int *count, int64_t *bytes)
+{
+    *count = g_live.count;
+    *bytes = g_live.bytes;
+}
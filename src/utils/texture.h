@@ -22,8 +22,9 @@ enum {
  * Since a common case is to load a texture asynchronously from an url,
  * when we create a texture with <texture_from_url>, the actual data won't
  * be available immediately.  We need to call texture_load to check that the
- * texture is ready.  If we use asynchronous textures, the loading function
- * should be set with <texture_set_load_callback>.
+ * texture is ready.  If we use asynchronous textures, the loading functions
+ * should be set with <texture_set_load_callbacks>.  The images are decoded
+ * in a worker thread.
  *
  * Attributes:
  *   id     - OpenGL texture id.
@@ -35,7 +36,13 @@ enum {
  *   format - OpenGL format.
  *   flags  - Configuration bit flags
  *   url    - For async texture: url source of the image.
+ *   loader - For async texture: set while the image is decoded.
+ *   max_size - For async texture: if set, the decoded image is halved
+ *            until its size fits into it.  Must be set before loading.
+ *   src_w  - For async texture: width of the image before it was halved.
+ *   src_h  - For async texture: height of the image before it was halved.
  */
+typedef struct texture_loader texture_loader_t;
 typedef struct texture {
     uint32_t        id;
     int             ref;
@@ -43,25 +50,94 @@ typedef struct texture {
     int             format;
     int             flags;
     char            *url;
+    texture_loader_t *loader;
+    int             mem_size; // Size accounted in the live textures stats.
+    int             max_size;
+    int             src_w, src_h;
 } texture_t;
 
 /*
- * Function: texture_set_load_callback
- * Set the callback function that will be used for asynchronous textures.
+ * Function: texture_set_load_callbacks
+ * Set the callback functions that will be used for asynchronous textures.
  *
  * Parameters:
- *   user - User data data will be passed to the callback.  Can be NULL.
- *   load - The callback function.  The function takes an url as input and
- *          should return the image data or NULL if the image is not ready
- *          yet.  We also set the following values:
- *            code  - Http code that will be passed back by <texture_load>.
- *            w     - The width of the image.
- *            h     - The height of the image.
- *            bpp   - Number of bytes per pixel of the image (1, 2, 3 or 4).
+ *   user    - User data data will be passed to the callbacks.  Can be NULL.
+ *   fetch   - Called from the main thread to get the encoded image of an
+ *             url.  Should return NULL if the data is not ready yet.  We
+ *             also set the following values:
+ *               code   - Http code that will be passed back by
+ *                        <texture_load>.
+ *               size   - Size of the data.
+ *               handle - Passed to the release function once the data
+ *                        is not used anymore.
+ *   decode  - Decode an image, called from a worker thread.  Returns the
+ *             image data or NULL in case of error, and set the width,
+ *             height and number of bytes per pixel (1, 2, 3 or 4).
+ *   release - Release the handle returned by fetch.  Can be called from
+ *             any thread.
  */
-void texture_set_load_callback(void *user,
-        uint8_t *(*load)(void *user, const char *url, int *code,
-                         int *w, int *h, int *bpp));
+void texture_set_load_callbacks(void *user,
+        const void *(*fetch)(void *user, const char *url, int *code,
+                             int *size, void **handle),
+        uint8_t *(*decode)(void *user, const void *data, int size,
+                           int *w, int *h, int *bpp),
+        void (*release)(void *user, void *handle));
+
+/*
+ * Type: texture_compressed_t
+ * A compressed image, with its mipmap levels.
+ *
+ * Attributes:
+ *   format       - OpenGL compressed format.
+ *   w            - Width of the level zero.
+ *   h            - Height of the level zero.
+ *   levels_count - Number of mipmap levels.
+ *   levels       - Data and size of each level.
+ */
+typedef struct texture_compressed {
+    int format;
+    int w, h;
+    int levels_count;
+    struct {
+        const void *data;
+        int        size;
+    } levels[16];
+} texture_compressed_t;
+
+/*
+ * Function: texture_ktx2_parse
+ * Parse a KTX2 file containing a compressed image.
+ *
+ * Only the S3TC (BC1, BC3), BPTC (BC7), ETC2 and ASTC (4x4, 8x8) formats
+ * without supercompression are supported: Basis Universal files would
+ * need a transcoder.  This doesn't use OpenGL, so it can be called from
+ * any thread.
+ *
+ * Parameters:
+ *   data   - The KTX2 file data.
+ *   size   - Size of the data.
+ *   out    - Get the image.  The levels data point inside the file data.
+ *
+ * Return:
+ *   false if the data is not a supported KTX2 file.
+ */
+bool texture_ktx2_parse(const void *data, int size,
+                        texture_compressed_t *out);
+
+/*
+ * Function: texture_supports_compression
+ * Return whether the context supports at least one compressed format.
+ */
+bool texture_supports_compression(void);
+
+/*
+ * Function: texture_from_compressed
+ * Create a texture from a compressed image.
+ *
+ * Return:
+ *   The new texture, or NULL if the context doesn't support the format.
+ */
+texture_t *texture_from_compressed(const texture_compressed_t *img);
 
 texture_t *texture_create(int w, int h, int bpp);
 texture_t *texture_from_data(const void *data, int img_w, int img_h, int bpp,
@@ -69,4 +145,63 @@ texture_t *texture_from_data(const void *data, int img_w, int img_h, int bpp,
 texture_t *texture_from_url(const char *url, int flags);
 bool texture_load(texture_t *tex, int *code);
 void texture_set_data(texture_t *tex, const void *data, int w, int h, int bpp);
+
+/*
+ * Function: texture_set_sub_data
+ * Update a rectangle of a texture.
+ *
+ * The data must have the same format as the texture, and the rectangle
+ * must be inside the texture.
+ */
+void texture_set_sub_data(texture_t *tex, const void *data,
+                          int x, int y, int w, int h);
 void texture_release(texture_t *tex);
+
+/*
+ * Function: texture_get_memory_size
+ * Return an estimation of the GPU memory used by a texture, in bytes.
+ *
+ * This takes into account the power of two padding and the mipmaps.
+ */
+int texture_get_memory_size(const texture_t *tex);
+
+/*
+ * Function: texture_get_uploads
+ * Get the number of textures data uploads and their total size in bytes
+ * since the start.
+ *
+ * This covers <texture_set_data> and <texture_set_sub_data>.
+ */
+void texture_get_uploads(int *count, int64_t *bytes);
+
+/*
+ * Function: texture_get_live
+ * Get the number of textures currently allocated, and an estimation of
+ * the GPU memory they use in bytes.
+ */
+void texture_get_live(int *count, int64_t *bytes);
+
+/*
+ * Function: texture_reserve_upload
+ * Check if there is enough upload budget left for the current frame.
+ *
+ * If there is, the size is removed from the budget.  At least one upload
+ * is always accepted per frame, whatever its size.  The asynchronous
+ * textures use this automatically.
+ *
+ * Parameters:
+ *   bytes  - Size of the data we want to upload.
+ *
+ * Return:
+ *   false if the upload should be delayed to a later frame.
+ */
+bool texture_reserve_upload(int64_t bytes);
+
+/*
+ * Function: texture_update
+ * Should be called once at the start of each frame.
+ *
+ * Parameters:
+ *   upload_budget - Maximum number of bytes to upload in the frame.
+ */
+void texture_update(int64_t upload_budget);
@@ -0,0 +1,177 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "trace.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#ifdef HAVE_PTHREAD
+#   include <pthread.h>
+#endif
+
+#ifdef __EMSCRIPTEN__
+#   include <emscripten.h>
+#else
+#   define EMSCRIPTEN_KEEPALIVE
+#endif
+
+typedef struct {
+    char    phase;
+    int     tid;
+    uint32_t id;
+    const char *cat;
+    const char *name;
+    double  ts;     // Start time (sec).
+    double  dur;    // Duration (sec).
+    char    *args;  // Json arguments, without the braces.
+} event_t;
+
+static struct {
+    bool        enabled;
+    double      origin; // Unix time of the start (sec).
+    event_t     *events;
+    int         nb;
+    int         allocated;
+    int         nb_threads;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t lock;
+#endif
+} g = {
+#ifdef HAVE_PTHREAD
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
+static void lock(void)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&g.lock);
+#endif
+}
+
+static void unlock(void)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&g.lock);
+#endif
+}
+
+// Small id of the current thread, to use as trace tid.
+static int get_tid(void)
+{
+    static __thread int tid = 0;
+    if (!tid) tid = __atomic_add_fetch(&g.nb_threads, 1, __ATOMIC_RELAXED);
+    return tid;
+}
+
+static double get_unix_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000. / 1000.;
+}
+
+static void clear(void)
+{
+    int i;
+    for (i = 0; i < g.nb; i++) free(g.events[i].args);
+    g.nb = 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void trace_start(void)
+{
+    lock();
+    clear();
+    g.origin = get_unix_time();
+    __atomic_store_n(&g.enabled, true, __ATOMIC_RELEASE);
+    unlock();
+}
+
+EMSCRIPTEN_KEEPALIVE
+void trace_stop(void)
+{
+    __atomic_store_n(&g.enabled, false, __ATOMIC_RELEASE);
+}
+
+bool trace_is_enabled(void)
+{
+    return __atomic_load_n(&g.enabled, __ATOMIC_ACQUIRE);
+}
+
+double trace_get_time(void)
+{
+    return get_unix_time() - g.origin;
+}
+
+void trace_event(char phase, const char *cat, const char *name, uint32_t id,
+                 double start, double dur, const char *args, ...)
+{
+    va_list ap;
+    char *args_str = NULL;
+    event_t *ev;
+
+    if (!trace_is_enabled()) return;
+    if (args) {
+        va_start(ap, args);
+        if (vasprintf(&args_str, args, ap) == -1) args_str = NULL;
+        va_end(ap);
+    }
+    lock();
+    if (g.nb >= g.allocated) {
+        g.allocated = g.allocated ? g.allocated * 2 : 1024;
+        g.events = realloc(g.events, g.allocated * sizeof(*g.events));
+    }
+    ev = &g.events[g.nb++];
+    *ev = (event_t) {
+        .phase = phase,
+        .tid = get_tid(),
+        .id = id,
+        .cat = cat,
+        .name = name,
+        .ts = start,
+        .dur = dur,
+        .args = args_str,
+    };
+    unlock();
+}
+
+EMSCRIPTEN_KEEPALIVE
+char *trace_export(void)
+{
+    char *ret;
+    size_t size;
+    FILE *f;
+    int i;
+    const event_t *ev;
+
+    f = open_memstream(&ret, &size);
+    lock();
+    fprintf(f, "{\"traceEvents\": [");
+    for (i = 0; i < g.nb; i++) {
+        ev = &g.events[i];
+        fprintf(f, "%s\n{\"ph\": \"%c\", \"cat\": \"%s\", \"name\": \"%s\", "
+                "\"pid\": 1, \"tid\": %d, \"ts\": %.1f",
+                i ? "," : "", ev->phase, ev->cat, ev->name, ev->tid,
+                ev->ts * 1e6);
+        if (ev->phase == 'X') fprintf(f, ", \"dur\": %.1f", ev->dur * 1e6);
+        if (strchr("bne", ev->phase))
+            fprintf(f, ", \"id\": \"0x%x\"", ev->id);
+        if (ev->args) fprintf(f, ", \"args\": {%s}", ev->args);
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n]}\n");
+    unlock();
+    fclose(f);
+    return ret;
+}
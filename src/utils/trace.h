@@ -0,0 +1,82 @@
+/* Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * File: trace.h
+ * Simple events tracing, exported in the Chrome trace event format.
+ *
+ * The events are only recorded between calls to <trace_start> and
+ * <trace_stop>, and can then be exported with <trace_export>, so that we
+ * can load them into a trace viewer (chrome://tracing or Perfetto).
+ *
+ * See the trace event format documentation for the meaning of the phases
+ * and ids.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Function: trace_start
+ * Clear the recorded events and start recording.
+ */
+void trace_start(void);
+
+/*
+ * Function: trace_stop
+ * Stop recording the events.
+ */
+void trace_stop(void);
+
+/*
+ * Function: trace_is_enabled
+ * Return whether we are recording the events.
+ */
+bool trace_is_enabled(void);
+
+/*
+ * Function: trace_get_time
+ * Return the current time in the traces time base (sec).
+ */
+double trace_get_time(void);
+
+/*
+ * Function: trace_event
+ * Record an event.
+ *
+ * Does nothing if the tracing is not enabled.  Can be called from any
+ * thread.
+ *
+ * Parameters:
+ *   phase  - Trace event phase, like 'X' for a complete event, or 'b',
+ *            'n', 'e' for async events.
+ *   cat    - Category of the event.
+ *   name   - Name of the event.
+ *   id     - Id of the async events, ignored for the other phases.
+ *   start  - Time of the event, as returned by <trace_get_time>.
+ *   dur    - Duration of complete events (sec).
+ *   args   - printf format of the json arguments of the event, without
+ *            the enclosing braces, or NULL.
+ */
+void trace_event(char phase, const char *cat, const char *name, uint32_t id,
+                 double start, double dur, const char *args, ...)
+    __attribute__((format(printf, 7, 8)));
+
+/*
+ * Function: trace_export
+ * Return all the recorded events as a Chrome trace json string.
+ *
+ * The caller should free the returned string.
+ */
+char *trace_export(void);
+
+#endif // TRACE_H
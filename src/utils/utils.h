@@ -108,6 +108,25 @@ uint8_t *img_read(const char *path, int *w, int *h, int *bpp);
 uint8_t *img_read_from_mem(const void *data, int size,
                            int *w, int *h, int *bpp);
 
+/*
+ * Function: img_read_from_mem_reduced
+ * Read an image from memory, reduced by a power of two.
+ *
+ * The webp images are directly decoded at the reduced size.  The other
+ * formats are decoded at full size and then downsampled, so that we only
+ * save the memory.
+ *
+ * Parameters:
+ *   data   - The encoded image data.
+ *   size   - Size of the data.
+ *   reduce - Log2 of the reduction factor, zero for the full size.
+ *   w      - Get the reduced width.
+ *   h      - Get the reduced height.
+ *   bpp    - Bytes per pixel, or zero to use the image format.
+ */
+uint8_t *img_read_from_mem_reduced(const void *data, int size, int reduce,
+                                   int *w, int *h, int *bpp);
+
 /*
  * Function: img_write
  * Write an image to file.
@@ -126,6 +145,45 @@ int z_uncompress(void *dest, int dest_size, const void *src, int src_size);
  */
 void *z_uncompress_gz(const void *src, int src_size, int *out_size);
 
+/*
+ * Type: z_lines_t
+ * Iterator over the lines of some gzip or zlib compressed data.
+ *
+ * The data is inflated in chunks into a buffer of constant size, that only
+ * grows if a line doesn't fit in it, so we never need to hold the whole
+ * uncompressed data in memory.
+ */
+typedef struct z_lines z_lines_t;
+
+/*
+ * Function: z_lines_open
+ * Start to iterate the lines of compressed data.
+ *
+ * The source data should stay valid until <z_lines_close> is called.
+ *
+ * Return:
+ *   A new iterator, or NULL in case of error.
+ */
+z_lines_t *z_lines_open(const void *src, int src_size);
+
+/*
+ * Function: z_lines_next
+ * Get the next line of compressed data.
+ *
+ * Like <iter_lines>, but the returned lines are always null terminated.
+ * They stay valid until the next call.
+ *
+ * Return:
+ *   false after the last line, or in case of error.
+ */
+bool z_lines_next(z_lines_t *lines, const char **line, int *len);
+
+/*
+ * Function: z_lines_close
+ * Release an iterator returned by <z_lines_open>.
+ */
+void z_lines_close(z_lines_t *lines);
+
 /*
  * Function: str_startswith
  * Test is a string starts with an other one.
@@ -13,6 +13,8 @@
 #include <stdarg.h>
 #include <string.h>
 
+#include "tests.h"
+
 json_value *json_get_attr(json_value *val, const char *attr, int type)
 {
     int i;
@@ -201,3 +203,52 @@ int jcon_parse(json_value *v, ...)
     va_end(ap);
     return ret ? -1 : 0;
 }
+
+static void *arena_json_alloc(size_t size, int zero, void *user)
+{
+    return zero ? arena_calloc(user, 1, size) : arena_alloc(user, size);
+}
+
+static void arena_json_free(void *ptr, void *user)
+{
+    // Everything is released with the arena.
+}
+
+json_value *json_parse_arena(arena_t *arena, const char *str, size_t len)
+{
+    json_settings settings = {
+        .mem_alloc = arena_json_alloc,
+        .mem_free = arena_json_free,
+        .user_data = arena,
+    };
+    return json_parse_ex(&settings, str, len, NULL);
+}
+
+#if COMPILE_TESTS
+
+static void test_json_parse_arena(void)
+{
+    arena_t arena = {};
+    json_value *json;
+    const char *str = "{\"a\": [1, 2, {\"b\": \"xyz\"}], \"c\": 3.5}";
+    int i;
+
+    // Once the arena has grown, the parsing only uses the main block.
+    for (i = 0; i < 2; i++) {
+        json = json_parse_arena(&arena, str, strlen(str));
+        assert(json && json->type == json_object);
+        assert(json_get_attr_f(json, "c", 0) == 3.5);
+        json = json_get_attr(json, "a", json_array);
+        assert(json && json->u.array.length == 3);
+        assert(strcmp(json_get_attr_s(json->u.array.values[2], "b"),
+                      "xyz") == 0);
+        assert(i == 0 || !arena.extra);
+        arena_reset(&arena);
+    }
+    assert(!json_parse_arena(&arena, "{\"a\": ", 6));
+    arena_release(&arena);
+}
+
+TEST_REGISTER(NULL, test_json_parse_arena, TEST_AUTO);
+
+#endif
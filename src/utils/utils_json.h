@@ -14,6 +14,7 @@
 
 #include <stdbool.h>
 
+#include "arena.h"
 #include "json.h"
 #include "json-builder.h"
 
@@ -31,6 +32,20 @@ bool json_get_attr_b(json_value *val, const char *attr, bool default_value);
  */
 json_value *json_copy(json_value *val);
 
+/*
+ * Function: json_parse_arena
+ * Parse a json document, with all the values allocated from an arena.
+ *
+ * This is much faster than json_parse when we parse a lot of small
+ * documents, since once the arena has grown we don't do any heap
+ * allocations anymore.
+ *
+ * The returned value must not be freed with json_value_free, or modified
+ * with the json builder functions: it stays valid until the next
+ * <arena_reset>.
+ */
+json_value *json_parse_arena(arena_t *arena, const char *str, size_t len);
+
 /*
  * Special interface to parse json document using a syntax similar to bson
  * C Object notation.
@@ -157,6 +157,23 @@ DEF void mat4_copy(const double src[S 4][4], double out[S 4][4]);
 DEF void mat4_perspective(double mat[S 4][4], double fovy, double aspect,
                           double nearval, double farval);
 DEF void mat4_to_float(const double mat[S 4][4], float out[S 16]);
+
+/*
+ * Single precision versions of the most used functions.
+ *
+ * Only to be used for render computations (normals, screen space layout,
+ * ...), where the float precision is enough.  Astrometry should always be
+ * done in double.
+ */
+DEF float vec3f_dot(const float a[S 3], const float b[S 3]);
+DEF void vec3f_normalize(const float v[S 3], float out[S 3]);
+DEF void vec3f_cross(const float a[S 3], const float b[S 3], float out[S 3]);
+DEF void mat3f_mul_vec3(const float mat[S 3][3], const float v[S 3],
+                        float out[S 3]);
+DEF void mat4f_mul_vec4(const float mat[S 4][4], const float v[S 4],
+                        float out[S 4]);
+DEF void mat4f_mul_vec3_dir(const float mat[S 4][4], const float v[S 3],
+                            float out[S 3]);
 DEF void mat4_set_identity(double mat[S 4][4]);
 DEF bool mat4_is_identity(const double mat[S 4][4]);
 DEF void mat4_mul(const double a[S 4][4], const double b[S 4][4],
@@ -530,6 +547,63 @@ DEF void mat4_to_float(const double mat[S 4][4], float out[S 16])
         out[i * 4 + j] = mat[i][j];
 }
 
+DEF float vec3f_dot(const float a[S 3], const float b[S 3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+DEF void vec3f_normalize(const float v[S 3], float out[S 3])
+{
+    float n = 1.0f / sqrtf(vec3f_dot(v, v));
+    out[0] = v[0] * n;
+    out[1] = v[1] * n;
+    out[2] = v[2] * n;
+}
+
+DEF void vec3f_cross(const float a[S 3], const float b[S 3], float out[S 3])
+{
+    float tmp[3];
+    tmp[0] = a[1] * b[2] - a[2] * b[1];
+    tmp[1] = a[2] * b[0] - a[0] * b[2];
+    tmp[2] = a[0] * b[1] - a[1] * b[0];
+    vec3_copy(tmp, out);
+}
+
+DEF void mat3f_mul_vec3(const float mat[S 3][3], const float v[S 3],
+                        float out[S 3])
+{
+    float x = v[0];
+    float y = v[1];
+    float z = v[2];
+    out[0] = x * mat[0][0] + y * mat[1][0] + z * mat[2][0];
+    out[1] = x * mat[0][1] + y * mat[1][1] + z * mat[2][1];
+    out[2] = x * mat[0][2] + y * mat[1][2] + z * mat[2][2];
+}
+
+DEF void mat4f_mul_vec4(const float mat[S 4][4], const float v[S 4],
+                        float out[S 4])
+{
+    float ret[4] = {};
+    int i, j;
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 4; j++) {
+            ret[i] += mat[j][i] * v[j];
+        }
+    }
+    vec4_copy(ret, out);
+}
+
+DEF void mat4f_mul_vec3_dir(const float mat[S 4][4], const float v[S 3],
+                            float out[S 3])
+{
+    float x = v[0];
+    float y = v[1];
+    float z = v[2];
+    out[0] = x * mat[0][0] + y * mat[1][0] + z * mat[2][0];
+    out[1] = x * mat[0][1] + y * mat[1][1] + z * mat[2][1];
+    out[2] = x * mat[0][2] + y * mat[1][2] + z * mat[2][2];
+}
+
 DEF void mat3_set_identity(double mat[S 3][3])
 {
     memset(mat, 0, 9 * sizeof(double));
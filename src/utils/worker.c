@@ -8,120 +8,322 @@
  */
 
 #include "worker.h"
-#include "uthash.h"
+#include "tests.h"
+#include "utlist.h"
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 enum {
-    WORKER_RUNNING = 1,
+    WORKER_QUEUED = 1,
+    WORKER_RUNNING,
     WORKER_FINISHED,
 };
 
-// How many threads in the pool
-#define THREADS_COUNT 2
+// Max number of threads in the pool.
+#define MAX_THREADS 64
+
+// Max number of threads in the browser, must match the size of the
+// emscripten pthread pool (see SConstruct).
+#define WEB_MAX_THREADS 8
 
 #ifdef HAVE_PTHREAD
 
 #include <pthread.h>
+#include <unistd.h>
 
 typedef struct thread_t {
-    pthread_t id;
-    bool ready;
+    pthread_t       id;
+    int             index;
+    bool            started;
+    pthread_mutex_t lock;   // Protects the queue.
+    worker_t        *queue; // Deque of waiting workers.
 } thread_t;
 
 static struct {
-    thread_t threads[THREADS_COUNT];
+    thread_t threads[MAX_THREADS];
     pthread_mutex_t rlock;
     pthread_cond_t global_cond;
-    worker_t *waiting_worker;
-    bool stop;
+    int nb_threads;     // Wanted number of threads.
+    int nb_queues;      // Number of queues that might contain workers.
+    int nb_waiting;     // Total number of queued workers.
+    int next_queue;     // Queue that will get the next worker.
+    int nb_idle;        // Number of threads waiting on global_cond.
     bool initialized;
-    worker_t *workers; // Hash map of workers.
+    void (*on_finished)(void); // Atomic.
 } g = {
     .rlock = PTHREAD_MUTEX_INITIALIZER,
     .global_cond = PTHREAD_COND_INITIALIZER,
 };
 
+// Used to keep the queues sorted by priority.
+static int queue_cmp(const worker_t *a, const worker_t *b)
+{
+    return a->priority < b->priority ? 1 : -1;
+}
+
+// Add a worker in a queue.  Should be called with the queue lock acquired.
+static void queue_add(thread_t *thread, worker_t *w)
+{
+    DL_INSERT_INORDER(thread->queue, w, queue_cmp);
+}
+
+// Remove a worker from a queue.  Should be called with the queue lock
+// acquired.  We reset the list pointers so that we can tell that the
+// worker is no longer in the queue.
+static void queue_remove(thread_t *thread, worker_t *w)
+{
+    DL_DELETE(thread->queue, w);
+    w->prev = w->next = NULL;
+}
+
+// Pop the most important worker from a thread queue.
+static worker_t *queue_pop(thread_t *thread)
+{
+    worker_t *w = NULL;
+    pthread_mutex_lock(&thread->lock);
+    if (thread->queue) {
+        w = thread->queue;
+        queue_remove(thread, w);
+    }
+    pthread_mutex_unlock(&thread->lock);
+    return w;
+}
+
+// Pick the most important of all the queued workers.  We start with our own
+// queue, so that we only steal from the other threads when they have more
+// important work waiting.
+static worker_t *get_next_worker(thread_t *thread)
+{
+    thread_t *t, *best = NULL;
+    double best_priority = 0;
+    int i;
+    for (i = 0; i < g.nb_queues; i++) {
+        t = &g.threads[(thread->index + i) % g.nb_queues];
+        pthread_mutex_lock(&t->lock);
+        if (t->queue && (!best || t->queue->priority > best_priority)) {
+            best = t;
+            best_priority = t->queue->priority;
+        }
+        pthread_mutex_unlock(&t->lock);
+    }
+    return best ? queue_pop(best) : NULL;
+}
+
+static int batch_worker_fn(worker_t *w);
+
+/*
+ * The workers state is only changed with atomic operations, so that
+ * worker_iter and worker_is_running can check it without taking the
+ * global lock.  The lock is only needed to queue or cancel a worker.
+ */
+static int get_state(const worker_t *w)
+{
+    return __atomic_load_n(&w->state, __ATOMIC_ACQUIRE);
+}
+
+static void set_state(worker_t *w, int state)
+{
+    __atomic_store_n(&w->state, state, __ATOMIC_RELEASE);
+}
+
 // The only part of the code that can run in different threads.
 static void *thread_func(void *args)
 {
     worker_t *w;
     thread_t *thread = (thread_t*)args;
     int r;
+    bool notify;
+    void (*on_finished)(void);
 
-    thread->ready = true;
     while (true) {
+        w = get_next_worker(thread);
         pthread_mutex_lock(&g.rlock);
-        while (g.waiting_worker == NULL && !g.stop)
-            pthread_cond_wait(&g.global_cond, &g.rlock);
-        if (g.stop) {
+        if (!w) {
+            // Exit if the pool got resized.  Any worker left in our queue
+            // will be stolen by the other threads.
+            if (thread->index >= g.nb_threads) {
+                thread->started = false;
+                pthread_mutex_unlock(&g.rlock);
+                break;
+            }
+            if (g.nb_waiting == 0) {
+                g.nb_idle++;
+                pthread_cond_wait(&g.global_cond, &g.rlock);
+                g.nb_idle--;
+            }
             pthread_mutex_unlock(&g.rlock);
-            break;
+            continue;
         }
-        thread->ready = false;
-        w = g.waiting_worker;
-        g.waiting_worker = NULL;
+        g.nb_waiting--;
+        set_state(w, WORKER_RUNNING);
         pthread_mutex_unlock(&g.rlock);
 
+        // No need to notify the parallel for batches, the caller is
+        // already waiting for them.
+        notify = w->fn != batch_worker_fn;
         r = w->fn(w);
-
-        pthread_mutex_lock(&g.rlock);
         w->ret = r;
-        w->state = WORKER_FINISHED;
-        thread->ready = true;
-        pthread_mutex_unlock(&g.rlock);
+        // The worker might be released as soon as it is marked finished,
+        // so we don't touch it after that.
+        set_state(w, WORKER_FINISHED);
+        on_finished = __atomic_load_n(&g.on_finished, __ATOMIC_ACQUIRE);
+        if (notify && on_finished) on_finished();
     }
     return NULL;
 }
 
+static int get_default_threads_count(void)
+{
+    // Keep one cpu for the main thread.
+    long n = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (n < 2) n = 2;
+    if (n > MAX_THREADS) n = MAX_THREADS;
+#ifdef __EMSCRIPTEN__
+    if (n > WEB_MAX_THREADS) n = WEB_MAX_THREADS;
+#endif
+    return n;
+}
+
+// Start the threads up to the wanted count.  Should be called with the
+// global lock acquired.
+static void start_threads(void)
+{
+    int i;
+    thread_t *thread;
+    for (i = 0; i < g.nb_threads; i++) {
+        thread = &g.threads[i];
+        if (thread->started) continue;
+        thread->started = true;
+        if (pthread_create(&thread->id, NULL, thread_func, thread) != 0) {
+            thread->started = false;
+            g.nb_threads = i;
+            break;
+        }
+        pthread_detach(thread->id);
+    }
+    if (g.nb_threads > g.nb_queues) g.nb_queues = g.nb_threads;
+    // Wake up the threads that need to exit.
+    pthread_cond_broadcast(&g.global_cond);
+}
+
 static void g_init(void)
 {
     int i;
-    for (i = 0; i < THREADS_COUNT; i++)
-        pthread_create(&g.threads[i].id, NULL, thread_func, &g.threads[i]);
+    for (i = 0; i < MAX_THREADS; i++) {
+        g.threads[i].index = i;
+        pthread_mutex_init(&g.threads[i].lock, NULL);
+    }
+    if (!g.nb_threads) g.nb_threads = get_default_threads_count();
+    start_threads();
     g.initialized = true;
 }
 
 void worker_init(worker_t *w, int (*fn)(worker_t *w))
 {
+    pthread_mutex_lock(&g.rlock);
     if (!g.initialized) g_init();
-    w->state = 0;
+    pthread_mutex_unlock(&g.rlock);
+    set_state(w, 0);
     w->ret = 0;
     w->fn = fn;
+    w->priority = 0;
+    w->prev = w->next = NULL;
 }
 
-static bool is_thread_ready(void)
+int worker_iter(worker_t *w)
 {
-    int i;
-    if (g.waiting_worker != NULL) return false;
-    for (i = 0; i < THREADS_COUNT; i++) {
-        if (g.threads[i].ready) {
-            return true;
-        }
+    thread_t *thread;
+    int state = get_state(w);
+
+    // Only the owner of the worker can queue it, so we only need the lock
+    // for the first call.
+    if (state) return state == WORKER_FINISHED;
+    pthread_mutex_lock(&g.rlock);
+    set_state(w, WORKER_QUEUED);
+    w->queue = g.next_queue++ % g.nb_threads;
+    thread = &g.threads[w->queue];
+    pthread_mutex_lock(&thread->lock);
+    queue_add(thread, w);
+    pthread_mutex_unlock(&thread->lock);
+    g.nb_waiting++;
+    // Only wake up a thread if there is one waiting.
+    if (g.nb_idle) pthread_cond_signal(&g.global_cond);
+    pthread_mutex_unlock(&g.rlock);
+    return 0;
+}
+
+bool worker_is_running(worker_t *w)
+{
+    int state = get_state(w);
+    return state == WORKER_QUEUED || state == WORKER_RUNNING;
+}
+
+void worker_set_priority(worker_t *w, double priority)
+{
+    thread_t *thread;
+    pthread_mutex_lock(&g.rlock);
+    if (get_state(w) != WORKER_QUEUED) {
+        w->priority = priority;
+        pthread_mutex_unlock(&g.rlock);
+        return;
     }
-    return false;
+    thread = &g.threads[w->queue];
+    pthread_mutex_lock(&thread->lock);
+    // The worker might have been popped by a thread that didn't update its
+    // state yet.
+    if (w->prev) {
+        queue_remove(thread, w);
+        w->priority = priority;
+        queue_add(thread, w);
+    }
+    pthread_mutex_unlock(&thread->lock);
+    pthread_mutex_unlock(&g.rlock);
 }
 
-int worker_iter(worker_t *w)
+bool worker_cancel(worker_t *w)
 {
+    thread_t *thread;
+    bool ret = false;
+    if (get_state(w) != WORKER_QUEUED) return false;
     pthread_mutex_lock(&g.rlock);
-    if (w->state == 0) {
-        if (is_thread_ready()) {
-            w->state = WORKER_RUNNING;
-            g.waiting_worker = w;
-            pthread_cond_signal(&g.global_cond);
+    if (get_state(w) == WORKER_QUEUED) {
+        thread = &g.threads[w->queue];
+        pthread_mutex_lock(&thread->lock);
+        if (w->prev) {
+            queue_remove(thread, w);
+            set_state(w, 0);
+            g.nb_waiting--;
+            ret = true;
         }
+        pthread_mutex_unlock(&thread->lock);
     }
     pthread_mutex_unlock(&g.rlock);
-    return w->state == WORKER_FINISHED;
+    return ret;
 }
 
-bool worker_is_running(worker_t *w)
+void worker_set_threads_count(int n)
+{
+    pthread_mutex_lock(&g.rlock);
+    if (n <= 0) n = get_default_threads_count();
+    if (n > MAX_THREADS) n = MAX_THREADS;
+    g.nb_threads = n;
+    if (g.initialized) start_threads();
+    pthread_mutex_unlock(&g.rlock);
+}
+
+void worker_set_on_finished(void (*fn)(void))
+{
+    __atomic_store_n(&g.on_finished, fn, __ATOMIC_RELEASE);
+}
+
+int worker_get_threads_count(void)
 {
-    bool ret;
+    int ret;
     pthread_mutex_lock(&g.rlock);
-    ret = w->state == WORKER_RUNNING;
+    ret = g.initialized ? g.nb_threads : 0;
     pthread_mutex_unlock(&g.rlock);
     return ret;
 }
@@ -137,8 +339,8 @@ void worker_init(worker_t *w, int (*fn)(worker_t *w))
 int worker_iter(worker_t *w)
 {
     if (w->state) return 1;
-    w->fn(w);
-    w->state = 1;
+    w->ret = w->fn(w);
+    w->state = WORKER_FINISHED;
     return 1;
 }
 
@@ -147,4 +349,130 @@ bool worker_is_running(worker_t *w)
     return false;
 }
 
+void worker_set_priority(worker_t *w, double priority)
+{
+    w->priority = priority;
+}
+
+bool worker_cancel(worker_t *w)
+{
+    return false;
+}
+
+void worker_set_threads_count(int n)
+{
+}
+
+void worker_set_on_finished(void (*fn)(void))
+{
+}
+
+int worker_get_threads_count(void)
+{
+    return 0;
+}
+
+#endif
+
+typedef struct batch {
+    int     n;
+    int     block;
+    int     next;   // Atomic, start of the next block to run.
+    void    *user;
+    void    (*fn)(void *user, int start, int end);
+} batch_t;
+
+typedef struct {
+    worker_t    worker;
+    batch_t     *batch;
+} batch_worker_t;
+
+static void batch_run(batch_t *b)
+{
+    int start;
+    while ((start = __atomic_fetch_add(&b->next, b->block,
+                                       __ATOMIC_RELAXED)) < b->n) {
+        b->fn(b->user, start, start + b->block < b->n ?
+                              start + b->block : b->n);
+    }
+}
+
+static int batch_worker_fn(worker_t *w)
+{
+    batch_run(((batch_worker_t*)w)->batch);
+    return 0;
+}
+
+void worker_parallel_for(int n, int block, void *user,
+                         void (*fn)(void *user, int start, int end))
+{
+    batch_worker_t workers[MAX_THREADS];
+    batch_t batch = {n, block, 0, user, fn};
+    int i, nb;
+
+    assert(block > 0);
+    nb = worker_get_threads_count();
+    if (nb > (n + block - 1) / block - 1) nb = (n + block - 1) / block - 1;
+    for (i = 0; i < nb; i++) {
+        worker_init(&workers[i].worker, batch_worker_fn);
+        workers[i].batch = &batch;
+        // The main thread is waiting for us.
+        workers[i].worker.priority = 1e9;
+        worker_iter(&workers[i].worker);
+    }
+    // The main thread also takes blocks, so that we don't depend on the
+    // threads being available.
+    batch_run(&batch);
+    for (i = 0; i < nb; i++) {
+        if (worker_cancel(&workers[i].worker)) continue;
+        while (!worker_iter(&workers[i].worker)) {}
+    }
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static int test_worker_fn(worker_t *w)
+{
+    return *(int*)w->user * 2;
+}
+
+static void test_worker(void)
+{
+    worker_t workers[256];
+    int values[256], i, nb_done;
+    for (i = 0; i < 256; i++) {
+        values[i] = i;
+        worker_init(&workers[i], test_worker_fn);
+        workers[i].user = &values[i];
+    }
+    // All the workers get queued at once.
+    do {
+        nb_done = 0;
+        for (i = 0; i < 256; i++) nb_done += worker_iter(&workers[i]);
+    } while (nb_done < 256);
+    for (i = 0; i < 256; i++) {
+        assert(workers[i].ret == i * 2);
+        assert(!worker_is_running(&workers[i]));
+    }
+}
+
+static void test_parallel_for_fn(void *user, int start, int end)
+{
+    int i, *values = user;
+    for (i = start; i < end; i++) __atomic_add_fetch(&values[i], 1,
+                                                     __ATOMIC_RELAXED);
+}
+
+static void test_parallel_for(void)
+{
+    int values[10000] = {}, i;
+    worker_parallel_for(10000, 64, values, test_parallel_for_fn);
+    for (i = 0; i < 10000; i++) assert(values[i] == 1);
+}
+
+TEST_REGISTER(NULL, test_worker, TEST_AUTO);
+TEST_REGISTER(NULL, test_parallel_for, TEST_AUTO);
+
 #endif
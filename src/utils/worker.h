@@ -14,8 +14,16 @@
  * A worker is simply a task that run in a thread pool.  We can create a worker
  * with <worker_init> and then run it by calling <worker_iter> as many times
  * as we want, until it returns a non zero value.
+ *
+ * The pool has one task queue per thread, sorted by priority.  Each thread
+ * takes the most important queued task, from its own queue or stolen
+ * from the other threads queues.  Tasks with the same priority run in the
+ * order they were queued.
  */
 
+#ifndef WORKER_H
+#define WORKER_H
+
 #include <stdbool.h>
 
 typedef struct worker worker_t;
@@ -26,6 +34,9 @@ struct worker
     void *user;
     int ret;
     int state;
+    double priority; // Higher priority workers run first.
+    int queue; // Index of the pool queue the worker was added to.
+    worker_t *prev, *next; // Used by the pool queues.
 };
 
 /*
@@ -38,9 +49,8 @@ void worker_init(worker_t *w, int (*fn)(worker_t *w));
  * Function: worker_iter
  * Execute the worker function.
  *
- * This will attempt to start the worker function in a separate thread.
- * If the function is already running or if no thread is ready, it does
- * nothing.
+ * The first call queues the worker function into the thread pool.  The
+ * following calls just check if the function has finished.
  *
  * We can call this in a loop until it returns a non zero value to make it
  * work like a simple future object.
@@ -52,6 +62,76 @@ int worker_iter(worker_t *worker);
 
 /*
  * Function: worker_is_running
- * Return whether a worker is currently running.
+ * Return whether a worker is currently queued or running.
+ *
+ * As long as this returns true the worker struct must not be released.
  */
 bool worker_is_running(worker_t *worker);
+
+/*
+ * Function: worker_set_priority
+ * Change the priority of a worker.
+ *
+ * If the worker is already queued it gets moved into its queue so that the
+ * new priority is taken into account.  It has no effect on a worker that
+ * already started.
+ */
+void worker_set_priority(worker_t *worker, double priority);
+
+/*
+ * Function: worker_cancel
+ * Remove a queued worker from the pool before it starts.
+ *
+ * The worker goes back to its initial state, so the next call to
+ * <worker_iter> will queue it again.
+ *
+ * Return:
+ *   true if the worker was removed, false if it was not queued, or already
+ *   started.
+ */
+bool worker_cancel(worker_t *worker);
+
+/*
+ * Function: worker_parallel_for
+ * Run a function over a range of indices, split across the pool threads.
+ *
+ * The range is split in blocks that are taken by the pool threads and by
+ * the calling thread, and the function only returns once all the blocks
+ * are done.
+ *
+ * Parameters:
+ *   n      - Number of indices.
+ *   block  - Number of indices per call to fn.
+ *   user   - User data passed to fn.
+ *   fn     - Function called with a range of indices [start, end).
+ */
+void worker_parallel_for(int n, int block, void *user,
+                         void (*fn)(void *user, int start, int end));
+
+/*
+ * Function: worker_set_on_finished
+ * Set a function called each time a queued worker finishes.
+ *
+ * The function is called from the pool threads, so it has to be thread
+ * safe.  This allows a main loop that sleeps to wake up as soon as some
+ * results are ready.
+ */
+void worker_set_on_finished(void (*fn)(void));
+
+/*
+ * Function: worker_set_threads_count
+ * Set the number of threads of the pool.
+ *
+ * Parameters:
+ *   n  - Number of threads, or zero to use a value computed from the
+ *        number of available cpus.
+ */
+void worker_set_threads_count(int n);
+
+/*
+ * Function: worker_get_threads_count
+ * Return the current number of threads of the pool.
+ */
+int worker_get_threads_count(void);
+
+#endif // WORKER_H
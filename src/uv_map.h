@@ -24,6 +24,7 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
 
 enum {
     UV_MAP_HEALPIX = 1,
@@ -44,6 +45,11 @@ struct uv_map
     bool swapped;
     bool at_infinity;
     void (*map)(const uv_map_t *t, const double v[2], double out[4]);
+    // Optional uniq oid of the mapping (not healpix), and version that
+    // must change each time the mapping changes.  Allow the renderer to
+    // keep the mapped grid across frames.
+    uint64_t id;
+    int version;
 };
 
 /*
@@ -50,17 +50,58 @@ def float_trunc(v, zerobits):
 def col_get_size(col):
     if 'size' in col: return col['size']
     t = col['type']
+    if t in ['h']: return 2
     if t in ['i', 'f']: return 4
     if t in ['Q']: return 8
     assert False
 
 
-def create_tile(data, chunk_type, nuniq, path, columns):
+def create_tile(data, chunk_type, nuniq, path, columns, extra_header='',
+                slice_size=0):
     order = int(log(nuniq / 4, 2) / 2);
     pix = nuniq - 4 * (1 << (2 * order));
     path = '%s/Norder%d/Dir%d/Npix%d.eph' % (
             path, order, (pix / 10000) * 10000, pix)
     ensure_dir(path)
+    create_file(data, chunk_type, nuniq, path, columns, extra_header,
+                slice_size)
+
+
+def create_file(data, chunk_type, nuniq, path, columns, extra_header='',
+                slice_size=0):
+    """Write a table eph file
+
+    extra_header is put between the tile header and the table header, for
+    chunk types that need more data (see the STRP chunks in stars.c).  It
+    can also be a function that returns the header of a given slice.
+
+    If slice_size is set, the data (that should be sorted by vmag) is split
+    into several chunks of at most slice_size rows, so that the stars
+    module only needs to decode the brightest ones.
+    """
+    slices = [data]
+    if slice_size:
+        slices = [data[i:i + slice_size]
+                  for i in range(0, len(data), slice_size)]
+
+    ret = 'EPHE'
+    ret += struct.pack('I', 2) # File version
+
+    for data in slices:
+        header = extra_header
+        if callable(header): header = header(data)
+        chunk = create_table_chunk(data, nuniq, columns, header)
+        ret += chunk_type
+        ret += struct.pack('I', len(chunk))
+        ret += chunk
+        ret += struct.pack('I', 0) # CRC TODO
+
+    with open(path, 'wb') as out:
+        out.write(ret)
+
+
+def create_table_chunk(data, nuniq, columns, extra_header=''):
+    """Return the data of a single table chunk"""
     row_size = sum(col_get_size(x) for x in columns)
     # Header:
     header = ''
@@ -93,25 +134,16 @@ def create_tile(data, chunk_type, nuniq, path, columns):
 
     comp_data = zlib.compress(data)
 
-    ret = 'EPHE'
-    ret += struct.pack('I', 2) # File version
-
     chunk = ''
     chunk += struct.pack('I', 3) # Tile Version
     chunk += struct.pack('Q', nuniq)
+    chunk += extra_header
     chunk += header
 
     chunk += struct.pack('I', len(data))
     chunk += struct.pack('I', len(comp_data))
     chunk += comp_data
-
-    ret += chunk_type
-    ret += struct.pack('I', len(chunk))
-    ret += chunk
-    ret += struct.pack('I', 0) # CRC TODO
-
-    with open(path, 'wb') as out:
-        out.write(ret)
+    return chunk
 
 
 def read_tile(path):
@@ -10,8 +10,20 @@
 # repository.
 
 
+# Usage: make-assets.py [--files] [SOURCE DEST]
+#
+# With --files, the assets are copied uncompressed into the DEST directory,
+# to be used by the native builds compiled with ASSETS_DIR set, instead of
+# generating the C files with the bundled data.
+#
+# The data of the groups listed in PACKED_GROUPS are also written into one
+# pack file per group in PACKS_DEST.  The builds compiled with ASSETS_PACKS
+# set only register those assets, and fetch the packs on first use instead
+# of bundling the data.
+
 import os
 import re
+import shutil
 import struct
 import sys
 import zlib
@@ -19,8 +31,18 @@ import zlib
 SOURCE = "data"
 DEST = "src/assets/"
 
-if len(sys.argv) > 1:
-    SOURCE, DEST = sys.argv[1:]
+# Groups of assets that can be loaded from separate packs.  The others
+# (shaders, fonts, cities, planets.ini) are needed synchronously at
+# startup and are always bundled.
+PACKED_GROUPS = ['stars', 'mpcorb.dat', 'skycultures', 'textures',
+                 'symbols.png']
+PACKS_DEST = "build/packs/"
+
+FILES = '--files' in sys.argv
+ARGS = [x for x in sys.argv[1:] if not x.startswith('--')]
+if FILES: DEST = "build/assets/"
+if ARGS:
+    SOURCE, DEST = ARGS
 
 if os.path.dirname(__file__) != "./tools":
     print "Should be run from root directory"
@@ -88,12 +110,24 @@ def encode_bin(data):
     ret += "}"
     return ret;
 
+if FILES:
+    for f in list_data_files():
+        if is_extra(f): continue
+        dest = os.path.join(DEST, f)
+        if not os.path.exists(os.path.dirname(dest)):
+            os.makedirs(os.path.dirname(dest))
+        shutil.copyfile(os.path.join(SOURCE, f), dest)
+    sys.exit(0)
+
 # Get all the asset files sorted by group:
 groups = {}
 for f in list_data_files():
     group = f.split('/')[0]
     groups.setdefault(group, []).append(f)
 
+# Pack files data, indexed by name.
+packs = {}
+
 for group in groups:
     out = open(os.path.join(DEST, "%s.inl" % group), "w")
     print >>out, "// Auto generated from tools/makeassets.py\n"
@@ -107,22 +141,43 @@ for group in groups:
             data = struct.pack('I', size) + data
             compressed = True
         size = len(data)
+        raw = data
 
         if type["text"]:
             size += 1 # NULL terminated string.
+            raw += '\0'
             data = encode_str(data)
         else:
             data = encode_bin(data)
 
         name = f.replace('.', '_').replace('-', '_').replace('/', '_')
         extra = is_extra(f)
+        comp = 'true' if compressed else 'false'
 
         if extra: print >>out, "#if ASSETS_INCLUDE_EXTRA"
+        if group in PACKED_GROUPS:
+            # The extra assets go into their own pack, only fetched if used.
+            pack = group + ('-extra' if extra else '') + '.pack'
+            pack_data = packs.setdefault(pack, bytearray())
+            pack_data += '\0' * (-len(pack_data) % 4) # Align to 4 bytes.
+            print >>out, "#if ASSETS_PACKS"
+            print >>out, ('ASSET_REGISTER_PACKED({name}, "{url}", "{pack}", '
+                          '{offset}, {size}, {comp})').format(
+                                  name=name, url=f, pack=pack,
+                                  offset=len(pack_data), size=size,
+                                  comp=comp)
+            print >>out, "#else"
+            pack_data += raw
         print >>out, ("static const unsigned char DATA_{}[{}] "
                       "__attribute__((aligned(4))) =\n{};\n").format(
                               name, size, data)
         print >>out, 'ASSET_REGISTER({name}, "{url}", DATA_{name}, {comp})' \
-                        .format(name=name, url=f,
-                                comp='true' if compressed else 'false')
+                        .format(name=name, url=f, comp=comp)
+        if group in PACKED_GROUPS: print >>out, "#endif"
         if extra: print >>out, "#endif"
         print >>out
+
+if packs and not os.path.exists(PACKS_DEST):
+    os.makedirs(PACKS_DEST)
+for pack in packs:
+    open(os.path.join(PACKS_DEST, pack), "wb").write(packs[pack])
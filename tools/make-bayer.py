@@ -11,8 +11,8 @@
 
 # Simple script that takes as input the files from 
 #   http://heasarc.gsfc.nasa.gov/W3Browse/star-catalog/bsc5p.html
-# and generate a data file in binary format as a list of 8 bytes entries:
-#   hip (4 bytes) n (4 bytes)
+# and generate the ENTRIES table of src/bayer.c, sorted by HIP number so
+# that we can do a binary search without any runtime initialization.
 
 from math import *
 import collections
@@ -21,9 +21,7 @@ import gzip
 import os
 import requests
 import requests_cache
-import struct
 import sys
-import zlib
 
 from utils import download
 
@@ -45,16 +43,6 @@ if os.path.dirname(__file__) != "./tools":
     sys.exit(-1)
 
 
-def encode_bin(data):
-    ret = ""
-    line = ""
-    for i, c in enumerate(data):
-        line += "{},".format(ord(c))
-        if len(line) >= 70 or i == len(data) - 1:
-            ret += "    " + line + "\n"
-            line = ""
-    return ret;
-
 src = download('http://cdsarc.u-strasbg.fr/vizier/ftp/cats/IV/27A/catalog.dat',
                dest='data-src/IV_27A.dat',
                md5='7b51c0aa8255c6aaf261a1083e0f0bd8')
@@ -77,14 +65,16 @@ for line in open(src):
     sources.append(Source(cst, bayer_l, bayer_n, vmag, hip))
 sources = sorted(sources)
 
-data = ''
-for s in sources:
-    data += struct.pack("IBBBB", s.hip, s.cst, s.bayer, s.bayer_n, 0)
-
-data = struct.pack('I', len(data)) + zlib.compress(data, 9)
+# Stable sort, so that the components of double stars stay in order.
+sources = sorted(sources, key=lambda s: s.hip)
 
-print 'static const unsigned char DATA[%d]' % len(data),
-print '__attribute__((aligned(4))) = {'
-print '    %s, // uncompressed size' % ','.join(str(ord(x)) for x in data[:4])
-print encode_bin(data[4:]),
+print 'static const entry_t ENTRIES[%d] = {' % len(sources)
+line = ''
+for s in sources:
+    item = '{%d,%d,%d,%d},' % (s.hip, s.cst, s.bayer, s.bayer_n)
+    if len(line) + len(item) + 1 > 75:
+        print '    ' + line.rstrip()
+        line = ''
+    line += item + ' '
+print '    ' + line.rstrip()
 print '};'
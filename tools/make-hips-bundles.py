@@ -0,0 +1,51 @@
+#!/usr/bin/python
+# coding: utf-8
+
+# Stellarium Web Engine - Copyright (c) 2018 - Noctua Software Ltd
+#
+# This program is licensed under the terms of the GNU AGPL v3, or
+# alternatively under a commercial licence.
+#
+# The terms of the AGPL v3 license can be found in the main directory of this
+# repository.
+
+# Pack the tiles of a local hips survey into one bundle file per Dir, up
+# to a given order.  See bundle_t in src/hips.c for the format.
+#
+# Usage: make-hips-bundles.py <hips-dir> <max-order>
+
+import os
+import re
+import struct
+import sys
+
+def make_bundle(path, out):
+    tiles = []
+    for name in os.listdir(path):
+        m = re.match(r'Npix(\d+)\.\w+$', name)
+        if not m: continue
+        tiles.append((int(m.group(1)), open(os.path.join(path, name),
+                                            'rb').read()))
+    tiles.sort()
+    offset = 8 + 12 * len(tiles)
+    header = b'HBDL' + struct.pack('<I', len(tiles))
+    for pix, data in tiles:
+        header += struct.pack('<III', pix, offset, len(data))
+        offset += len(data)
+    with open(out, 'wb') as f:
+        f.write(header)
+        for pix, data in tiles:
+            f.write(data)
+
+def run(hips_dir, max_order):
+    for order in range(max_order + 1):
+        order_dir = os.path.join(hips_dir, 'Norder%d' % order)
+        if not os.path.isdir(order_dir): continue
+        for name in os.listdir(order_dir):
+            if not name.startswith('Dir'): continue
+            path = os.path.join(order_dir, name)
+            make_bundle(path, os.path.join(path, 'Bundle.bin'))
+    print('Add "hips_bundle_order = %d" to the properties file' % max_order)
+
+if __name__ == '__main__':
+    run(sys.argv[1], int(sys.argv[2]))
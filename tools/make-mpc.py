@@ -9,12 +9,87 @@
 # The terms of the AGPL v3 license can be found in the main directory of this
 # repository.
 
+import datetime
 import gzip
+import math
+import sys
 
+import eph
 from utils import download
 
 URL = 'https://minorplanetcenter.net/Extended_Files/mpcorb_extended.dat.gz'
 
+# Columns of the eph table, see on_eph_chunk in src/modules/minorplanets.c.
+COLUMNS = [
+    {'id': 'num',  'type': 'i'},
+    {'id': 'flag', 'type': 'i'},
+    {'id': 'desi', 'type': 's', 'size': 24},
+    {'id': 'name', 'type': 's', 'size': 24},
+    {'id': 'h',    'type': 'f', 'unit': eph.UNIT_VMAG},
+    {'id': 'g',    'type': 'f'},
+    {'id': 'epoc', 'type': 'f'},
+    {'id': 'm',    'type': 'f', 'unit': eph.UNIT_RAD},
+    {'id': 'w',    'type': 'f', 'unit': eph.UNIT_RAD},
+    {'id': 'o',    'type': 'f', 'unit': eph.UNIT_RAD},
+    {'id': 'i',    'type': 'f', 'unit': eph.UNIT_RAD},
+    {'id': 'e',    'type': 'f'},
+    {'id': 'n',    'type': 'f'},
+    {'id': 'a',    'type': 'f'},
+]
+
+
+def unpack_int(s):
+    v = 0
+    for c in s:
+        if c.isdigit(): d = ord(c) - ord('0')
+        elif c.isupper(): d = 10 + ord(c) - ord('A')
+        else: d = 36 + ord(c) - ord('a')
+        v = v * 10 + d
+    return v
+
+
+def unpack_epoch(s):
+    year = (ord(s[0]) - ord('I') + 18) * 100 + int(s[1:3])
+    date = datetime.date(year, unpack_int(s[3]), unpack_int(s[4]))
+    return (date - datetime.date(1858, 11, 17)).days
+
+
+def parse_line(line):
+    """Same as mpc_parse_line in src/mpc.c"""
+    readable = line[175:194].rstrip(' ')
+    name, desig = '', ''
+    if readable and not readable[0].isdigit(): name = readable
+    else: desig = readable
+    if not desig: desig = line[217:227].rstrip(' ')
+    return {
+        'num': unpack_int(line[0:5]) if line[5] == ' ' else 0,
+        'flag': int(line[161:165], 16),
+        'desi': desig,
+        'name': name,
+        'h': float(line[8:13]),
+        'g': float(line[14:19]),
+        'epoc': unpack_epoch(line[20:25]),
+        'm': math.radians(float(line[26:35])),
+        'w': math.radians(float(line[37:46])),
+        'o': math.radians(float(line[48:57])),
+        'i': math.radians(float(line[59:68])),
+        'e': float(line[70:79]),
+        'n': math.radians(float(line[80:91])),
+        'a': float(line[92:103]),
+    }
+
+
+def make_eph(lines, path):
+    """Write the lines into an eph file, that the engine loads faster"""
+    data = []
+    for line in lines:
+        if len(line) < 160: continue
+        try:
+            data.append(parse_line(line))
+        except ValueError:
+            continue
+    eph.create_file(data, 'MPCO', 4, path, COLUMNS)
+
 def run():
     path = download(URL)
     lines = gzip.GzipFile(path).readlines()
@@ -23,6 +98,9 @@ def run():
     lines = [x for x in lines if x[175:180] != 'Pluto']
     # Sort by magnitude.
     lines = sorted(lines, key=lambda x: float(x[8:14].strip() or 'inf'))
+    # Optionally save all of them as an eph file.
+    if len(sys.argv) > 1:
+        make_eph(lines, sys.argv[1])
     # Keep only 500 first.
     lines = lines[:500]
     out = open("data/mpcorb.dat", "w")
@@ -10,6 +10,15 @@
 # repository.
 
 # This script generates the eph format stars survey from HIP and BSC catalog.
+#
+# With the --render option, the tiles are saved as STRP chunks instead of
+# STAR chunks: the positions, illuminances and magnitude histogram are
+# precomputed and the stars sorted by vmag, so that the engine doesn't need
+# to do any of this at load time.
+#
+# With the --slices option, the tiles are sorted by vmag and split into
+# several magnitude slices chunks of SLICE_SIZE stars, so that the engine
+# only decodes the faint stars when it needs them.
 
 from math import *
 import collections
@@ -19,6 +28,7 @@ import healpy
 import os
 import requests
 import struct
+import sys
 import zlib
 
 import eph
@@ -26,6 +36,16 @@ from utils import ensure_dir, download, parse, DD2R
 
 MAX_SOURCES_PER_TILE = 1024
 
+RENDER = '--render' in sys.argv
+RENDER_EPOCH = 2000.0   # Epoch of the precomputed positions.
+RENDER_BITS = 32        # Quantization of the positions (16 or 32).
+SLICE_SIZE = 256 if '--slices' in sys.argv else 0
+
+# Must be the same as in src/modules/stars.c!
+HIST_MIN = -2.0
+HIST_STEP = 0.5
+HIST_NB = 48
+
 Star = collections.namedtuple('Star',
         ['hip', 'hd', 'vmag', 'ra', 'de', 'plx', 'pra', 'pde', 'bv'])
 
@@ -83,10 +103,56 @@ COLUMNS = [
     {'id': 'bv',   'type': 'f'},
 ]
 
+
+def render_columns():
+    t = 'h' if RENDER_BITS == 16 else 'i'
+    return COLUMNS + [
+        {'id': 'illu', 'type': 'f'},
+        {'id': 'x',    'type': t},
+        {'id': 'y',    'type': t},
+        {'id': 'z',    'type': t},
+    ]
+
+
+def render_source(s):
+    """Add the precomputed render attributes to a star"""
+    # Same as core_mag_to_illuminance.
+    illu = 10.7646e4 / (206264.80624709636 ** 2) * 10 ** (-0.4 * s.vmag)
+    # Astrometric direction at the catalog epoch, same as compute_pv.
+    pos = [cos(s.de) * cos(s.ra), cos(s.de) * sin(s.ra), sin(s.de)]
+    scale = (1 << (RENDER_BITS - 1)) - 1
+    ret = s._asdict()
+    ret['illu'] = illu
+    for k, v in zip('xyz', pos):
+        ret[k] = int(round(v * scale))
+    return ret
+
+
+def render_header(stars):
+    """STRP chunk header: epoch, bits and cumulated vmag histogram"""
+    ret = struct.pack('fiffi', RENDER_EPOCH, RENDER_BITS,
+                      HIST_MIN, HIST_STEP, HIST_NB)
+    for k in range(HIST_NB + 1):
+        edge = HIST_MIN + k * HIST_STEP
+        ret += struct.pack('i', len([s for s in stars if s['vmag'] < edge]))
+    return ret
+
+
 for nuniq, stars in tiles.items():
-    stars = sorted(stars, key=lambda x: x.hip * 1000000 + x.hd)
+    if RENDER:
+        stars = sorted(stars, key=lambda x: (x.vmag, x.hd))
+        eph.create_tile([render_source(s) for s in stars],
+                        chunk_type='STRP', nuniq=nuniq, path=out_dir,
+                        columns=render_columns(),
+                        extra_header=render_header,
+                        slice_size=SLICE_SIZE)
+        continue
+    if SLICE_SIZE:
+        stars = sorted(stars, key=lambda x: (x.vmag, x.hd))
+    else:
+        stars = sorted(stars, key=lambda x: x.hip * 1000000 + x.hd)
     eph.create_tile(stars, chunk_type='STAR', nuniq=nuniq, path=out_dir,
-                    columns=COLUMNS)
+                    columns=COLUMNS, slice_size=SLICE_SIZE)
 
 # Also generate the properties file.
 with open(os.path.join(out_dir, 'properties'), 'w') as out: